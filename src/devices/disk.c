@@ -1,24 +1,51 @@
 #include "devices/disk.h"
+#include <console.h>
 #include <ctype.h>
 #include <debug.h>
+#include <round.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/perf.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3], and uses the
+   48-bit addressing feature set of [ATA-6] to reach sectors
+   beyond the first 1 << 28 on disks that support it.
+
+   A device may also be a RAM disk, kept in pages of kernel
+   memory, which stands in for whatever disk is attached there.
+   Requests to it go through the same interface and, if
+   asynchronous, the same queue, but are carried out by copying
+   memory.
+
+   A disk's volatile write cache is enabled if it has one, so
+   that a write completes once the disk has the data, not once
+   the data is on the medium.  disk_flush() is then the barrier
+   between writes that must reach the medium in order. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
-#define reg_error(CHANNEL) ((CHANNEL)->reg_base + 1)    /* Error. */
+#define reg_error(CHANNEL) ((CHANNEL)->reg_base + 1)    /* Error/Features. */
 #define reg_nsect(CHANNEL) ((CHANNEL)->reg_base + 2)    /* Sector Count. */
 #define reg_lbal(CHANNEL) ((CHANNEL)->reg_base + 3)     /* LBA 0:7. */
 #define reg_lbam(CHANNEL) ((CHANNEL)->reg_base + 4)     /* LBA 15:8. */
 #define reg_lbah(CHANNEL) ((CHANNEL)->reg_base + 5)     /* LBA 23:16. */
 #define reg_device(CHANNEL) ((CHANNEL)->reg_base + 6)   /* Device/LBA 27:24. */
+
+/* With 48-bit addressing, the sector count and LBA registers
+   each take two bytes in turn, high-order byte first: the
+   Sector Count register takes bits 15:8 of the count, and the
+   LBA registers take LBA 31:24, 39:32 and 47:40. */
 #define reg_status(CHANNEL) ((CHANNEL)->reg_base + 7)   /* Status (r/o). */
 #define reg_command(CHANNEL) reg_status (CHANNEL)       /* Command (w/o). */
 
@@ -28,10 +55,29 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses.  [BMIDE] */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prd(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_STA_ACTIVE 0x01      /* Transfer in progress. */
+#define BM_STA_ERR 0x02         /* Error (write 1 to clear). */
+#define BM_STA_IRQ 0x04         /* Interrupt (write 1 to clear). */
+
+/* Features for SET FEATURES. */
+#define FEAT_ENABLE_WCACHE 0x02         /* Enable volatile write cache. */
+#define FEAT_DISABLE_WCACHE 0x82        /* Disable volatile write cache. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +93,53 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA with retries. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA with retries. */
+#define CMD_READ_SECTOR_EXT 0x24        /* READ SECTOR(S) EXT. */
+#define CMD_WRITE_SECTOR_EXT 0x34       /* WRITE SECTOR(S) EXT. */
+#define CMD_READ_DMA_EXT 0x25           /* READ DMA EXT. */
+#define CMD_WRITE_DMA_EXT 0x35          /* WRITE DMA EXT. */
+#define CMD_SET_FEATURES 0xef           /* SET FEATURES. */
+#define CMD_FLUSH_CACHE 0xe7            /* FLUSH CACHE. */
+
+/* Sectors reachable with 28-bit addressing. */
+#define LBA28_SECTORS (1UL << 28)
+
+/* PCI configuration space access.  [PCI] */
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+#define PCI_REG_COMMAND 0x04            /* Command register. */
+#define PCI_REG_CLASS 0x08              /* Class code, revision. */
+#define PCI_REG_BAR4 0x20               /* Base address register 4. */
+#define PCI_COMMAND_IO 0x0001           /* Enable I/O space. */
+#define PCI_COMMAND_MASTER 0x0004       /* Enable bus mastering. */
+
+/* Maximum number of sectors transferred by one command, 64 kB. */
+#define DISK_RUN_MAX 128
+
+/* Maximum number of requests merged into one command. */
+#define SEGMENT_MAX 8
+
+/* Number of timer ticks a request may wait before it is served
+   ahead of the elevator order. */
+#define DISK_DEADLINE (TIMER_FREQ / 2)
+
+/* A part of a transfer: CNT sectors at BUFFER. */
+struct segment
+  {
+    uint8_t *buffer;            /* Buffer. */
+    size_t cnt;                 /* Number of sectors. */
+  };
+
+/* Physical region descriptor for bus master IDE transfers.
+   A region may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical base address. */
+    uint16_t size;              /* Byte count, 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT for the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
 
 /* An ATA device. */
 struct disk 
@@ -56,7 +149,12 @@ struct disk
     int dev_no;                 /* Device 0 or 1 for master or slave. */
 
     bool is_ata;                /* 1=This device is an ATA disk. */
+    bool use_dma;               /* True to transfer by bus master DMA. */
+    bool lba48;                 /* True if 48-bit addressing is supported. */
+    bool write_cache;           /* True if writes may sit in a cache. */
     disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+    disk_sector_t head;         /* Sector after the last transfer. */
+    uint8_t **ram;              /* Pages of a RAM disk, or null. */
 
     long long read_cnt;         /* Number of sectors read. */
     long long write_cnt;        /* Number of sectors written. */
@@ -69,12 +167,21 @@ struct channel
     char name[8];               /* Name, e.g. "hd0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master base I/O port, 0 if none. */
+    struct prd *prd;            /* PRD table for bus master DMA. */
 
     struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    struct list queue;          /* Pending disk_requests, oldest first. */
+    struct lock queue_lock;     /* Protects QUEUE. */
+    struct condition queue_nonempty;    /* Signaled on submission. */
+    size_t sync_cnt;            /* Synchronous requests in QUEUE. */
+    bool busy;                  /* True while the I/O thread works. */
+    int64_t idle_since;         /* Timer tick the I/O thread went idle. */
+
     struct disk devices[2];     /* The devices on this channel. */
   };
 
@@ -82,11 +189,29 @@ struct channel
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
-static void reset_channel (struct channel *);
+/* PRD tables, two entries per segment since a segment may cross
+   a 64 kB boundary.  Aligned so that no table crosses one. */
+#define PRD_CNT (2 * SEGMENT_MAX)
+static struct prd prd_tables[CHANNEL_CNT][PRD_CNT]
+  __attribute__ ((aligned (PRD_CNT * sizeof (struct prd))));
+
+static bool reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
-
-static void select_sector (struct disk *, disk_sector_t);
+static uint16_t find_bus_master (void);
+static bool dma_transfer (struct disk *, disk_sector_t,
+                          const struct segment *, size_t seg_cnt,
+                          size_t cnt, bool read);
+static void transfer (struct disk *, disk_sector_t, const struct segment *,
+                      size_t seg_cnt, size_t cnt, bool write);
+static void queue_request (struct disk_request *);
+static void schedule_requests (struct channel *, struct list *batch);
+static void perform_requests (struct list *batch);
+static void request_and_wait (struct disk *, disk_sector_t, void *,
+                              size_t cnt, bool write);
+static void io_thread (void *);
+
+static bool select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -98,16 +223,32 @@ static void select_device_wait (const struct disk *);
 
 static void interrupt_handler (struct intr_frame *);
 
+static void ram_disk_init (struct disk *, size_t kb);
+static void ram_transfer (struct disk *, disk_sector_t,
+                          const struct segment *, size_t seg_cnt, bool write);
+
+/* Sizes in kB of RAM disks to use in place of the disks, indexed
+   by channel and device number, or 0 for none.  Set by the
+   -ramdisk and -ramswap kernel command line options. */
+size_t disk_ram_kb[2][2];
+
+/* True to enable the volatile write cache of disks that have
+   one, false to disable it.  Cleared by the -write-through
+   kernel command line option. */
+bool disk_write_cache = true;
+
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) 
 {
   size_t chan_no;
+  uint16_t bm_base = find_bus_master ();
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
       int dev_no;
+      char name[16];
 
       /* Initialize channel. */
       snprintf (c->name, sizeof c->name, "hd%zu", chan_no);
@@ -124,20 +265,33 @@ disk_init (void)
         default:
           NOT_REACHED ();
         }
+      c->bm_base = bm_base != 0 ? bm_base + 8 * chan_no : 0;
+      c->prd = prd_tables[chan_no];
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      list_init (&c->queue);
+      lock_init (&c->queue_lock);
+      cond_init (&c->queue_nonempty);
+      c->sync_cnt = 0;
+      c->busy = false;
+      c->idle_since = 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
         {
           struct disk *d = &c->devices[dev_no];
-          snprintf (d->name, sizeof d->name, "%s:%d", c->name, dev_no);
+          snprintf (d->name, sizeof d->name, "%.4s:%d", c->name, dev_no);
           d->channel = c;
           d->dev_no = dev_no;
 
           d->is_ata = false;
+          d->use_dma = false;
+          d->lba48 = false;
+          d->write_cache = false;
           d->capacity = 0;
+          d->head = 0;
+          d->ram = NULL;
 
           d->read_cnt = d->write_cnt = 0;
         }
@@ -145,17 +299,26 @@ disk_init (void)
       /* Register interrupt handler. */
       intr_register_ext (c->irq, interrupt_handler, c->name);
 
-      /* Reset hardware. */
-      reset_channel (c);
-
-      /* Distinguish ATA hard disks from other devices. */
-      if (check_device_type (&c->devices[0]))
-        check_device_type (&c->devices[1]);
-
-      /* Read hard disk identity information. */
+      /* Reset hardware.  A channel without devices is left
+         alone, which saves the waits of the reset. */
+      if (reset_channel (c))
+        {
+          /* Distinguish ATA hard disks from other devices. */
+          if (check_device_type (&c->devices[0]))
+            check_device_type (&c->devices[1]);
+
+          /* Read hard disk identity information. */
+          for (dev_no = 0; dev_no < 2; dev_no++)
+            if (c->devices[dev_no].is_ata)
+              identify_ata_device (&c->devices[dev_no]);
+        }
       for (dev_no = 0; dev_no < 2; dev_no++)
-        if (c->devices[dev_no].is_ata)
-          identify_ata_device (&c->devices[dev_no]);
+        if (disk_ram_kb[chan_no][dev_no] > 0)
+          ram_disk_init (&c->devices[dev_no], disk_ram_kb[chan_no][dev_no]);
+
+      /* Start I/O thread for asynchronous requests. */
+      snprintf (name, sizeof name, "%.4s-io", c->name);
+      thread_create (name, PRI_MAX, io_thread, c);
     }
 }
 
@@ -172,9 +335,10 @@ disk_print_stats (void)
       for (dev_no = 0; dev_no < 2; dev_no++) 
         {
           struct disk *d = disk_get (chan_no, dev_no);
-          if (d != NULL && d->is_ata) 
-            printf ("%s: %lld reads, %lld writes\n",
-                    d->name, d->read_cnt, d->write_cnt);
+          if (d != NULL) 
+            printf ("%s%s: %lld reads, %lld writes\n", d->name,
+                    d->ram != NULL ? " (RAM)" : "",
+                    d->read_cnt, d->write_cnt);
         }
     }
 }
@@ -196,7 +360,7 @@ disk_get (int chan_no, int dev_no)
   if (chan_no < (int) CHANNEL_CNT) 
     {
       struct disk *d = &channels[chan_no].devices[dev_no];
-      if (d->is_ata)
+      if (d->is_ata || d->ram != NULL)
         return d; 
     }
   return NULL;
@@ -215,59 +379,522 @@ disk_size (struct disk *d)
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for DISK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+   per-disk locking is unneeded.
+   Uses bus master DMA if available, so the CPU is free to run
+   other threads during the transfer. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) 
 {
-  struct channel *c;
-  
-  ASSERT (d != NULL);
-  ASSERT (buffer != NULL);
-
-  c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  d->read_cnt++;
-  lock_release (&c->lock);
+  disk_read_multiple (d, sec_no, buffer, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
    DISK_SECTOR_SIZE bytes.  Returns after the disk has
    acknowledged receiving the data.
    Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+   per-disk locking is unneeded.
+   Uses bus master DMA if available, as disk_read(). */
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
+{
+  disk_write_multiple (d, sec_no, buffer, 1);
+}
+
+/* Reads CNT contiguous sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Synchronizes as disk_read().
+   Synchronous reads are served before other requests, since a
+   thread is waiting for them. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, void *buffer,
+                    size_t cnt)
+{
+  request_and_wait (d, sec_no, buffer, cnt, false);
+}
+
+/* Writes CNT contiguous sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Synchronizes as disk_write(). */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no,
+                     const void *buffer, size_t cnt)
+{
+  request_and_wait (d, sec_no, (void *) buffer, cnt, true);
+}
+
+/* Makes the writes to disk D that have completed so far durable,
+   by waiting for D to move them from its write cache to the
+   medium.  Writes that complete later may reach the medium
+   before or after them, so a caller that needs one write to be
+   durable before another starts waits for the first, calls this
+   function, and only then submits the second.  Returns at once
+   if D does not cache writes. */
+void
+disk_flush (struct disk *d)
 {
   struct channel *c;
-  
+
   ASSERT (d != NULL);
-  ASSERT (buffer != NULL);
+
+  if (!d->write_cache)
+    return;
 
   c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
+  select_device_wait (d);
+  issue_pio_command (c, CMD_FLUSH_CACHE);
   sema_down (&c->completion_wait);
-  d->write_cnt++;
+  wait_while_busy (d);
+  if (inb (reg_alt_status (c)) & STA_ERR)
+    PANIC ("%s: cache flush failed", d->name);
+  perf_inc (PERF_DISK_FLUSH);
   lock_release (&c->lock);
 }
-
+
+/* Initializes REQ to transfer CNT contiguous sectors starting at
+   SEC_NO between disk D and BUFFER, writing to the disk if WRITE
+   is true and reading from it otherwise.
+   If DONE is nonnull, it is called with REQ and AUX from the
+   channel's I/O thread once the transfer completes.  Otherwise,
+   the submitter must wait for REQ with disk_wait().
+   The request takes the running thread's priority, including
+   any donated to it, which the caller may change before
+   submitting it to give it another class of service. */
+void
+disk_request_init (struct disk_request *req, struct disk *d,
+                   disk_sector_t sec_no, void *buffer, size_t cnt,
+                   bool write, disk_request_func *done, void *aux)
+{
+  ASSERT (req != NULL);
+  ASSERT (d != NULL);
+  ASSERT (buffer != NULL);
+
+  req->disk = d;
+  req->sec_no = sec_no;
+  req->buffer = buffer;
+  req->cnt = cnt;
+  req->write = write;
+  req->sync = false;
+  req->priority = thread_get_priority ();
+  req->done = done;
+  req->aux = aux;
+  sema_init (&req->completed, 0);
+}
+
+/* Queues REQ to its disk's channel and returns immediately.  REQ
+   must stay valid until it completes.
+   Submitted requests are background work, served after
+   synchronous reads unless they have waited too long. */
+void
+disk_submit (struct disk_request *req)
+{
+  req->sync = false;
+  queue_request (req);
+}
+
+/* Queues REQ to its disk's channel as a synchronous request
+   and returns immediately, so that a thread can wait on
+   requests to several disks at once.  REQ must have no
+   completion function and must be waited for with
+   disk_wait(). */
+void
+disk_submit_sync (struct disk_request *req)
+{
+  ASSERT (req->done == NULL);
+
+  req->sync = true;
+  queue_request (req);
+}
+
+/* Waits until REQ, which was submitted without a completion
+   function, completes. */
+void
+disk_wait (struct disk_request *req)
+{
+  ASSERT (req->done == NULL);
+
+  sema_down (&req->completed);
+}
+
+/* Returns true if a synchronous request, one that its submitter
+   is waiting for, is queued to any disk and not yet started. */
+bool
+disk_sync_queued (void)
+{
+  size_t chan_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    if (channels[chan_no].sync_cnt > 0)
+      return true;
+  return false;
+}
+
+/* Returns the number of timer ticks since every disk last had no
+   request queued or in progress, or 0 if one has one now.  Disk
+   requests served by RAM disks at once do not count. */
+int64_t
+disk_idle_time (void)
+{
+  int64_t idle_since = 0;
+  size_t chan_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      bool busy;
+
+      lock_acquire (&c->queue_lock);
+      busy = c->busy || !list_empty (&c->queue);
+      if (c->idle_since > idle_since)
+        idle_since = c->idle_since;
+      lock_release (&c->queue_lock);
+      if (busy)
+        return 0;
+    }
+  return timer_elapsed (idle_since);
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER as a synchronous request, writing to the disk if WRITE
+   is true.  A RAM disk is served at once, by the caller. */
+static void
+request_and_wait (struct disk *d, disk_sector_t sec_no, void *buffer,
+                  size_t cnt, bool write)
+{
+  struct disk_request req;
+
+  if (d->ram != NULL)
+    {
+      struct segment seg;
+
+      ASSERT (sec_no + cnt <= d->capacity);
+      seg.buffer = buffer;
+      seg.cnt = cnt;
+      lock_acquire (&d->channel->lock);
+      transfer (d, sec_no, &seg, 1, cnt, write);
+      lock_release (&d->channel->lock);
+      return;
+    }
+
+  disk_request_init (&req, d, sec_no, buffer, cnt, write, NULL, NULL);
+  req.sync = true;
+  queue_request (&req);
+  disk_wait (&req);
+}
+
+/* Adds REQ to its channel's queue and wakes up the I/O thread. */
+static void
+queue_request (struct disk_request *req)
+{
+  struct channel *c = req->disk->channel;
+
+  ASSERT (req->cnt > 0);
+  ASSERT (req->sec_no + req->cnt <= req->disk->capacity);
+
+  req->deadline = timer_ticks () + DISK_DEADLINE;
+  if (req->write)
+    thread_current ()->rusage.oublock += req->cnt;
+  else
+    thread_current ()->rusage.inblock += req->cnt;
+  lock_acquire (&c->queue_lock);
+  perf_inc (PERF_DISK_REQUESTS);
+  perf_add (PERF_DISK_QUEUED, list_size (&c->queue));
+  list_push_back (&c->queue, &req->elem);
+  if (req->sync)
+    c->sync_cnt++;
+  cond_signal (&c->queue_nonempty, &c->queue_lock);
+  lock_release (&c->queue_lock);
+}
+
+/* Thread function of channel C_'s I/O thread, which carries out
+   all requests to the channel's disks. */
+static void
+io_thread (void *c_) 
+{
+  struct channel *c = c_;
+
+  thread_set_class (SCHED_FIFO, PRI_MAX);
+  for (;;)
+    {
+      struct list batch;
+
+      list_init (&batch);
+      lock_acquire (&c->queue_lock);
+      if (list_empty (&c->queue))
+        {
+          c->busy = false;
+          c->idle_since = timer_ticks ();
+          while (list_empty (&c->queue))
+            cond_wait (&c->queue_nonempty, &c->queue_lock);
+        }
+      c->busy = true;
+      schedule_requests (c, &batch);
+      lock_release (&c->queue_lock);
+
+      lock_acquire (&c->lock);
+      perform_requests (&batch);
+      lock_release (&c->lock);
+
+      /* Complete requests.  A request may be gone as soon as its
+         submitter is told, so remove it from BATCH first. */
+      while (!list_empty (&batch))
+        {
+          struct disk_request *req = list_entry (list_pop_front (&batch),
+                                                 struct disk_request, elem);
+          if (req->done != NULL)
+            req->done (req, req->aux);
+          else
+            sema_up (&req->completed);
+        }
+    }
+}
+
+/* Moves the next requests to serve from channel C's queue into
+   BATCH, which then holds contiguous requests in sector order.
+
+   A request that has passed its deadline goes first, so that
+   none starves.  Otherwise, synchronous reads are preferred, then
+   requests of higher priority, and among candidates the request
+   at or just after its disk's head position is chosen (C-LOOK).
+   Queued requests continuing the chosen one in the same direction
+   are merged, up to DISK_RUN_MAX sectors. */
+static void
+schedule_requests (struct channel *c, struct list *batch)
+{
+  struct disk_request *req = NULL;
+  struct disk_request *next;
+  int64_t now = timer_ticks ();
+  struct list_elem *e;
+  size_t cnt, seg_cnt;
+
+  ASSERT (lock_held_by_current_thread (&c->queue_lock));
+  ASSERT (!list_empty (&c->queue));
+
+  /* Overdue request, oldest first. */
+  req = list_entry (list_front (&c->queue), struct disk_request, elem);
+  if (now < req->deadline)
+    {
+      /* Elevator order, synchronous reads first, then by
+         priority. */
+      bool best_urgent = false;
+      int best_priority = 0;
+      disk_sector_t best_dist = 0;
+
+      req = NULL;
+      for (e = list_begin (&c->queue); e != list_end (&c->queue);
+           e = list_next (e))
+        {
+          struct disk_request *r = list_entry (e, struct disk_request, elem);
+          bool urgent = r->sync && !r->write;
+          disk_sector_t dist = r->sec_no - r->disk->head;
+
+          if (req == NULL || urgent > best_urgent
+              || (urgent == best_urgent
+                  && (r->priority > best_priority
+                      || (r->priority == best_priority
+                          && dist < best_dist))))
+            {
+              req = r;
+              best_urgent = urgent;
+              best_priority = r->priority;
+              best_dist = dist;
+            }
+        }
+    }
+  list_remove (&req->elem);
+  list_push_back (batch, &req->elem);
+  if (req->sync)
+    c->sync_cnt--;
+
+  /* Merge requests that follow. */
+  cnt = req->cnt;
+  seg_cnt = 1;
+  while (cnt < DISK_RUN_MAX && seg_cnt < SEGMENT_MAX)
+    {
+      next = NULL;
+      for (e = list_begin (&c->queue); e != list_end (&c->queue);
+           e = list_next (e))
+        {
+          struct disk_request *r = list_entry (e, struct disk_request, elem);
+          if (r->disk == req->disk && r->write == req->write
+              && r->sec_no == req->sec_no + cnt
+              && cnt + r->cnt <= DISK_RUN_MAX)
+            {
+              next = r;
+              break;
+            }
+        }
+      if (next == NULL)
+        break;
+      list_remove (&next->elem);
+      list_push_back (batch, &next->elem);
+      if (next->sync)
+        c->sync_cnt--;
+      cnt += next->cnt;
+      seg_cnt++;
+    }
+  req->disk->head = req->sec_no + cnt;
+}
+
+/* Carries out the requests in BATCH, as produced by
+   schedule_requests().  The channel lock must be held. */
+static void
+perform_requests (struct list *batch)
+{
+  struct disk_request *first = list_entry (list_front (batch),
+                                           struct disk_request, elem);
+  struct segment segs[SEGMENT_MAX];
+  size_t seg_cnt = 0;
+  size_t cnt = 0;
+  struct list_elem *e;
+
+  if (list_next (&first->elem) == list_end (batch))
+    {
+      /* A single request, perhaps longer than a command allows. */
+      disk_sector_t sec_no = first->sec_no;
+      uint8_t *buffer = first->buffer;
+
+      for (cnt = first->cnt; cnt > 0; )
+        {
+          segs[0].buffer = buffer;
+          segs[0].cnt = cnt < DISK_RUN_MAX ? cnt : DISK_RUN_MAX;
+          transfer (first->disk, sec_no, segs, 1, segs[0].cnt, first->write);
+          sec_no += segs[0].cnt;
+          buffer += segs[0].cnt * DISK_SECTOR_SIZE;
+          cnt -= segs[0].cnt;
+        }
+      return;
+    }
+
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct disk_request *req = list_entry (e, struct disk_request, elem);
+      segs[seg_cnt].buffer = req->buffer;
+      segs[seg_cnt].cnt = req->cnt;
+      seg_cnt++;
+      cnt += req->cnt;
+    }
+  transfer (first->disk, first->sec_no, segs, seg_cnt, cnt, first->write);
+}
+
+/* Transfers CNT contiguous sectors starting at SEC_NO between
+   disk D and the SEG_CNT segments in SEGS, writing to the disk if
+   WRITE is true, with one command.  CNT may not exceed
+   DISK_RUN_MAX.  D's channel lock must be held. */
+static void
+transfer (struct disk *d, disk_sector_t sec_no, const struct segment *segs,
+          size_t seg_cnt, size_t cnt, bool write)
+{
+  struct channel *c = d->channel;
+  uint64_t start = timer_cycles ();
+  size_t i, j;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  trace (write ? TRACE_DISK_WRITE : TRACE_DISK_READ, sec_no);
+  if (d->ram != NULL)
+    ram_transfer (d, sec_no, segs, seg_cnt, write);
+  else if (!d->use_dma
+           || !dma_transfer (d, sec_no, segs, seg_cnt, cnt, !write))
+    {
+      disk_sector_t sec = sec_no;
+
+      if (!select_sector (d, sec_no, cnt))
+        issue_pio_command (c, write ? CMD_WRITE_SECTOR_RETRY
+                                    : CMD_READ_SECTOR_RETRY);
+      else
+        issue_pio_command (c, write ? CMD_WRITE_SECTOR_EXT
+                                    : CMD_READ_SECTOR_EXT);
+      for (i = 0; i < seg_cnt; i++)
+        for (j = 0; j < segs[i].cnt; j++, sec++)
+          {
+            uint8_t *buffer = segs[i].buffer + j * DISK_SECTOR_SIZE;
+            if (!write)
+              {
+                sema_down (&c->completion_wait);
+                if (!wait_while_busy (d))
+                  PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                         d->name, sec);
+                input_sector (c, buffer);
+              }
+            else
+              {
+                if (!wait_while_busy (d))
+                  PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                         d->name, sec);
+                output_sector (c, buffer);
+                sema_down (&c->completion_wait);
+              }
+          }
+    }
+
+  trace (TRACE_DISK_DONE, sec_no);
+  perf_add (write ? PERF_SECTOR_WRITE : PERF_SECTOR_READ, cnt);
+  perf_hist_add (write ? PERF_HIST_DISK_WRITE : PERF_HIST_DISK_READ,
+                 (c - channels) * 2 + d->dev_no, timer_cycles () - start);
+  if (write)
+    d->write_cnt += cnt;
+  else
+    d->read_cnt += cnt;
+}
+
+/* Makes D a RAM disk of KB kB, in zeroed pages of kernel memory,
+   in place of any disk attached there. */
+static void
+ram_disk_init (struct disk *d, size_t kb)
+{
+  size_t page_cnt = DIV_ROUND_UP (kb * 1024, PGSIZE);
+  size_t i;
+
+  d->ram = malloc (page_cnt * sizeof *d->ram);
+  if (d->ram == NULL)
+    PANIC ("%s: out of memory for RAM disk", d->name);
+  for (i = 0; i < page_cnt; i++)
+    {
+      d->ram[i] = palloc_get_page (PAL_ZERO);
+      if (d->ram[i] == NULL)
+        PANIC ("%s: out of memory for %zu kB RAM disk", d->name, kb);
+    }
+  d->is_ata = false;
+  d->use_dma = false;
+  d->lba48 = false;
+  d->write_cache = false;
+  d->capacity = kb * 1024 / DISK_SECTOR_SIZE;
+  printf ("%s: RAM disk, %zu kB\n", d->name, kb);
+}
+
+/* Copies the sectors starting at SEC_NO between RAM disk D and
+   the SEG_CNT segments in SEGS, writing to the disk if WRITE is
+   true. */
+static void
+ram_transfer (struct disk *d, disk_sector_t sec_no,
+              const struct segment *segs, size_t seg_cnt, bool write)
+{
+  size_t i, j;
+
+  for (i = 0; i < seg_cnt; i++)
+    for (j = 0; j < segs[i].cnt; j++, sec_no++)
+      {
+        uint8_t *sector = (d->ram[sec_no / (PGSIZE / DISK_SECTOR_SIZE)]
+                           + sec_no % (PGSIZE / DISK_SECTOR_SIZE)
+                           * DISK_SECTOR_SIZE);
+        uint8_t *buffer = segs[i].buffer + j * DISK_SECTOR_SIZE;
+
+        if (write)
+          memcpy (sector, buffer, DISK_SECTOR_SIZE);
+        else
+          memcpy (buffer, sector, DISK_SECTOR_SIZE);
+      }
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
 
 /* Resets an ATA channel and waits for any devices present on it
-   to finish the reset. */
-static void
+   to finish the reset.  Returns false, without resetting, if no
+   device is present. */
+static bool
 reset_channel (struct channel *c) 
 {
   bool present[2];
@@ -293,6 +920,8 @@ reset_channel (struct channel *c)
       present[dev_no] = (inb (reg_nsect (c)) == 0x55
                          && inb (reg_lbal (c)) == 0xaa);
     }
+  if (!present[0] && !present[1])
+    return false;
 
   /* Issue soft reset sequence, which selects device 0 as a side effect.
      Also enable interrupts. */
@@ -325,6 +954,7 @@ reset_channel (struct channel *c)
         }
       wait_while_busy (&c->devices[1]);
     }
+  return true;
 }
 
 /* Checks whether device D is an ATA disk and sets D's is_ata
@@ -383,8 +1013,43 @@ identify_ata_device (struct disk *d)
     }
   input_sector (c, id);
 
-  /* Calculate capacity. */
+  /* Calculate capacity.  A disk that supports 48-bit addressing
+     reports its full capacity in words 100 through 103; we can
+     use as much of it as a disk_sector_t can number. */
   d->capacity = id[60] | ((uint32_t) id[61] << 16);
+  d->lba48 = (id[83] & 0x0400) != 0;
+  if (d->lba48)
+    {
+      uint64_t capacity = (id[100] | ((uint64_t) id[101] << 16)
+                           | ((uint64_t) id[102] << 32)
+                           | ((uint64_t) id[103] << 48));
+      if (capacity > UINT32_MAX)
+        {
+          printf ("%s: using only the first %'"PRDSNu" sectors\n",
+                  d->name, (disk_sector_t) UINT32_MAX);
+          capacity = UINT32_MAX;
+        }
+      if (capacity > d->capacity)
+        d->capacity = capacity;
+    }
+
+  /* Use DMA if both the controller and the disk support it. */
+  d->use_dma = c->bm_base != 0 && (id[49] & 0x0100) != 0;
+
+  /* Enable or disable the write cache, if the disk has one.  If
+     the disk refuses, its cache may be in either state, so we
+     flush it to be safe. */
+  if (id[82] & 0x0020)
+    {
+      select_device_wait (d);
+      outb (reg_error (c), disk_write_cache ? FEAT_ENABLE_WCACHE
+                                            : FEAT_DISABLE_WCACHE);
+      issue_pio_command (c, CMD_SET_FEATURES);
+      sema_down (&c->completion_wait);
+      wait_while_busy (d);
+      d->write_cache = (disk_write_cache
+                        || (inb (reg_alt_status (c)) & STA_ERR) != 0);
+    }
 
   /* Print identification message. */
   printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
@@ -397,13 +1062,65 @@ identify_ata_device (struct disk *d)
     printf ("%"PRDSNu" kB", d->capacity / (1024 / DISK_SECTOR_SIZE));
   else
     printf ("%"PRDSNu" byte", d->capacity * DISK_SECTOR_SIZE);
-  printf (") disk, model \"");
+  printf (") disk%s, model \"", d->write_cache ? " with write cache" : "");
   print_ata_string ((char *) &id[27], 40);
   printf ("\", serial \"");
   print_ata_string ((char *) &id[10], 20);
   printf ("\"\n");
 }
 
+/* Reads the 32-bit PCI configuration register REG of function
+   FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDRESS,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes DATA to the 32-bit PCI configuration register REG of
+   function FUNC of device DEV on bus BUS. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t data)
+{
+  outl (PCI_CONFIG_ADDRESS,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, data);
+}
+
+/* Looks for a bus master capable IDE controller on PCI bus 0 and
+   enables bus mastering on it.  Returns the base I/O port of its
+   bus master registers, or 0 if there is no such controller, in
+   which case all transfers use PIO. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class = pci_read_config (0, dev, func, PCI_REG_CLASS);
+        uint32_t bar4, command;
+
+        /* Mass storage, IDE, bus master capable. */
+        if (class == 0xffffffff || (class >> 16) != 0x0101
+            || !(class & 0x8000))
+          continue;
+        bar4 = pci_read_config (0, dev, func, PCI_REG_BAR4);
+        if (!(bar4 & 1) || (bar4 & 0xfffc) == 0)
+          continue;
+
+        command = pci_read_config (0, dev, func, PCI_REG_COMMAND);
+        pci_write_config (0, dev, func, PCI_REG_COMMAND,
+                          (command & 0xffff) | PCI_COMMAND_IO
+                          | PCI_COMMAND_MASTER);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 /* Prints STRING, which consists of SIZE bytes in a funky format:
    each pair of bytes is in reverse order.  Does not print
    trailing whitespace and/or nulls. */
@@ -426,23 +1143,39 @@ print_ata_string (char *string, size_t size)
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
-static void
-select_sector (struct disk *d, disk_sector_t sec_no) 
+   writes SEC_NO and CNT to the disk's sector selection
+   registers.  (We use LBA mode.)
+   Sectors within the first LBA28_SECTORS are selected with
+   28-bit addresses, which take fewer port writes, and the
+   function returns false.  Sectors beyond them are selected with
+   48-bit addresses and the function returns true, in which case
+   the caller must issue an EXT command. */
+static bool
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) 
 {
   struct channel *c = d->channel;
+  bool ext = sec_no + cnt > LBA28_SECTORS;
 
-  ASSERT (sec_no < d->capacity);
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= DISK_RUN_MAX);
+  ASSERT (sec_no + cnt <= d->capacity);
+  ASSERT (!ext || d->lba48);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  if (ext)
+    {
+      outb (reg_nsect (c), cnt >> 8);
+      outb (reg_lbal (c), sec_no >> 24);
+      outb (reg_lbam (c), 0);
+      outb (reg_lbah (c), 0);
+    }
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
   outb (reg_device (c),
-        DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
+        DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0)
+        | (ext ? 0 : sec_no >> 24));
+  return ext;
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
@@ -474,6 +1207,84 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
 }
 
+/* Transfers CNT sectors starting at SEC_NO of disk D from or to
+   the SEG_CNT segments in SEGS by bus master DMA, depending on
+   READ, sleeping until the transfer completes.  D's channel lock
+   must be held.
+   Returns true if successful.  Otherwise, disables DMA on D and
+   returns false so that the caller falls back to PIO. */
+static bool
+dma_transfer (struct disk *d, disk_sector_t sec_no,
+              const struct segment *segs, size_t seg_cnt, size_t cnt,
+              bool read)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = read ? BM_CMD_READ : 0;
+  size_t prd_cnt = 0;
+  uint8_t bm_status;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+  ASSERT (seg_cnt <= SEGMENT_MAX);
+
+  /* Build the PRD table, splitting each segment at 64 kB
+     boundaries.  Kernel virtual memory maps physical memory
+     linearly, so each segment is physically contiguous, and as
+     CNT is at most DISK_RUN_MAX it needs at most two regions.
+     Bus master transfers require word aligned buffers. */
+  for (i = 0; i < seg_cnt; i++)
+    {
+      uintptr_t paddr = vtop (segs[i].buffer);
+      size_t size = segs[i].cnt * DISK_SECTOR_SIZE;
+
+      if (paddr & 1)
+        return false;
+      while (size > 0)
+        {
+          size_t chunk = 0x10000 - (paddr & 0xffff);
+          if (chunk > size)
+            chunk = size;
+
+          ASSERT (prd_cnt < PRD_CNT);
+          c->prd[prd_cnt].addr = paddr;
+          c->prd[prd_cnt].size = chunk;
+          c->prd[prd_cnt].flags = 0;
+          prd_cnt++;
+          paddr += chunk;
+          size -= chunk;
+        }
+    }
+  c->prd[prd_cnt - 1].flags = PRD_EOT;
+
+  /* Program the bus master and the disk, then start. */
+  outb (reg_bm_command (c), direction);
+  outl (reg_bm_prd (c), vtop (c->prd));
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_IRQ);
+  if (!select_sector (d, sec_no, cnt))
+    issue_pio_command (c, read ? CMD_READ_DMA : CMD_WRITE_DMA);
+  else
+    issue_pio_command (c, read ? CMD_READ_DMA_EXT : CMD_WRITE_DMA_EXT);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+
+  /* Wait for the completion interrupt, then stop. */
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), direction);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_IRQ);
+  wait_while_busy (d);
+
+  if ((bm_status & (BM_STA_ERR | BM_STA_ACTIVE))
+      || (inb (reg_alt_status (c)) & STA_ERR))
+    {
+      log_printf (LOG_WARN,
+                  "%s: DMA transfer failed, sector=%"PRDSNu", using PIO\n",
+                  d->name, sec_no);
+      d->use_dma = false;
+      return false;
+    }
+  return true;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -493,7 +1304,7 @@ wait_until_idle (const struct disk *d)
       timer_usleep (10);
     }
 
-  printf ("%s: idle timeout\n", d->name);
+  log_printf (LOG_WARN, "%s: idle timeout\n", d->name);
 }
 
 /* Wait up to 30 seconds for disk D to clear BSY,
@@ -561,7 +1372,7 @@ interrupt_handler (struct intr_frame *f)
             sema_up (&c->completion_wait);      /* Wake up waiter. */
           }
         else
-          printf ("%s: unexpected interrupt\n", c->name);
+          log_printf (LOG_WARN, "%s: unexpected interrupt\n", c->name);
         return;
       }
 
@@ -2,7 +2,11 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "threads/synch.h"
 
 /* Size of a disk sector in bytes. */
 #define DISK_SECTOR_SIZE 512
@@ -15,6 +19,32 @@ typedef uint32_t disk_sector_t;
    printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+struct disk_request;
+
+/* Called when an asynchronous disk request completes. */
+typedef void disk_request_func (struct disk_request *, void *aux);
+
+/* An asynchronous disk request. */
+struct disk_request
+  {
+    struct disk *disk;          /* Disk to transfer from or to. */
+    disk_sector_t sec_no;       /* First sector. */
+    void *buffer;               /* Buffer of CNT sectors. */
+    size_t cnt;                 /* Number of sectors. */
+    bool write;                 /* True to write, false to read. */
+    bool sync;                  /* True if the submitter is waiting. */
+    int priority;               /* Priority of the submitter, or as
+                                   set after disk_request_init(). */
+    int64_t deadline;           /* Timer tick to be served by. */
+    disk_request_func *done;    /* Completion function, or null. */
+    void *aux;                  /* Auxiliary data for DONE. */
+    struct semaphore completed; /* Up'd on completion if no DONE. */
+    struct list_elem elem;      /* Element in channel's queue. */
+  };
+
+extern size_t disk_ram_kb[2][2];
+extern bool disk_write_cache;
+
 void disk_init (void);
 void disk_print_stats (void);
 
@@ -22,5 +52,18 @@ struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multiple (struct disk *, disk_sector_t, void *, size_t cnt);
+void disk_write_multiple (struct disk *, disk_sector_t, const void *,
+                          size_t cnt);
+void disk_flush (struct disk *);
+
+void disk_request_init (struct disk_request *, struct disk *, disk_sector_t,
+                        void *buffer, size_t cnt, bool write,
+                        disk_request_func *, void *aux);
+void disk_submit (struct disk_request *);
+void disk_submit_sync (struct disk_request *);
+void disk_wait (struct disk_request *);
+bool disk_sync_queued (void);
+int64_t disk_idle_time (void);
 
 #endif /* devices/disk.h */
@@ -2,15 +2,21 @@
 #include <debug.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/poll.h"
+
+/* Input buffer size, in bytes.  Large enough to absorb a burst
+   of pasted or piped serial input while no thread is reading. */
+#define INPUT_BUFSIZE 1024
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
+static uint8_t buffer_data[INPUT_BUFSIZE];
 
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
-  intq_init (&buffer);
+  intq_init_buf (&buffer, buffer_data, sizeof buffer_data);
 }
 
 /* Adds a key to the input buffer.
@@ -23,6 +29,7 @@ input_putc (uint8_t key)
 
   intq_putc (&buffer, key);
   serial_notify ();
+  poll_notify ();
 }
 
 /* Retrieves a key from the input buffer.
@@ -50,3 +57,14 @@ input_full (void)
   ASSERT (intr_get_level () == INTR_OFF);
   return intq_full (&buffer);
 }
+
+/* Returns true if the input buffer is empty, that is,
+   input_getc() would wait, false otherwise. */
+bool
+input_empty (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool empty = intq_empty (&buffer);
+  intr_set_level (old_level);
+  return empty;
+}
@@ -2,17 +2,18 @@
 #include <debug.h>
 #include "threads/thread.h"
 
-static int next (int pos);
-static void wait (struct intq *q, struct thread **waiter);
-static void signal (struct intq *q, struct thread **waiter);
+static void wait (struct intq *q, struct list *waiters);
+static void signal (struct intq *q, struct list *waiters);
 
-/* Initializes interrupt queue Q. */
+/* Initializes interrupt queue Q to use the SIZE bytes at BUF,
+   which must stay valid as long as Q is in use.  SIZE must be a
+   power of 2. */
 void
-intq_init (struct intq *q) 
+intq_init_buf (struct intq *q, uint8_t *buf, size_t size) 
 {
-  lock_init (&q->lock);
-  q->not_full = q->not_empty = NULL;
-  q->head = q->tail = 0;
+  list_init (&q->not_full);
+  list_init (&q->not_empty);
+  ring_init (&q->ring, buf, size);
 }
 
 /* Returns true if Q is empty, false otherwise. */
@@ -20,7 +21,7 @@ bool
 intq_empty (const struct intq *q) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  return q->head == q->tail;
+  return ring_empty (&q->ring);
 }
 
 /* Returns true if Q is full, false otherwise. */
@@ -28,7 +29,7 @@ bool
 intq_full (const struct intq *q) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  return next (q->head) == q->tail;
+  return ring_full (&q->ring);
 }
 
 /* Removes a byte from Q and returns it.
@@ -44,13 +45,10 @@ intq_getc (struct intq *q)
   while (intq_empty (q)) 
     {
       ASSERT (!intr_context ());
-      lock_acquire (&q->lock);
       wait (q, &q->not_empty);
-      lock_release (&q->lock);
     }
   
-  byte = q->buf[q->tail];
-  q->tail = next (q->tail);
+  ring_read (&q->ring, &byte, 1);
   signal (q, &q->not_full);
   return byte;
 }
@@ -66,51 +64,41 @@ intq_putc (struct intq *q, uint8_t byte)
   while (intq_full (q))
     {
       ASSERT (!intr_context ());
-      lock_acquire (&q->lock);
       wait (q, &q->not_full);
-      lock_release (&q->lock);
     }
 
-  q->buf[q->head] = byte;
-  q->head = next (q->head);
+  ring_write (&q->ring, &byte, 1);
   signal (q, &q->not_empty);
 }
-
-/* Returns the position after POS within an intq. */
-static int
-next (int pos) 
-{
-  return (pos + 1) % INTQ_BUFSIZE;
-}
 
-/* WAITER must be the address of Q's not_empty or not_full
-   member.  Waits until the given condition is true. */
+/* WAITERS must be Q's not_empty or not_full member.  Waits
+   until the given condition is true.  Any number of threads
+   may wait at once; they are woken in the order they came. */
 static void
-wait (struct intq *q UNUSED, struct thread **waiter) 
+wait (struct intq *q UNUSED, struct list *waiters) 
 {
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT ((waiter == &q->not_empty && intq_empty (q))
-          || (waiter == &q->not_full && intq_full (q)));
+  ASSERT ((waiters == &q->not_empty && intq_empty (q))
+          || (waiters == &q->not_full && intq_full (q)));
 
-  *waiter = thread_current ();
+  list_push_back (waiters, &thread_current ()->elem);
   thread_block ();
 }
 
-/* WAITER must be the address of Q's not_empty or not_full
-   member, and the associated condition must be true.  If a
-   thread is waiting for the condition, wakes it up and resets
-   the waiting thread. */
+/* WAITERS must be Q's not_empty or not_full member, and the
+   associated condition must be true.  If any thread is waiting
+   for the condition, wakes up the one that has waited longest.
+   Only one byte was added or removed, so waking more would just
+   send them back to sleep. */
 static void
-signal (struct intq *q UNUSED, struct thread **waiter) 
+signal (struct intq *q UNUSED, struct list *waiters) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT ((waiter == &q->not_empty && !intq_empty (q))
-          || (waiter == &q->not_full && !intq_full (q)));
+  ASSERT ((waiters == &q->not_empty && !intq_empty (q))
+          || (waiters == &q->not_full && !intq_full (q)));
 
-  if (*waiter != NULL) 
-    {
-      thread_unblock (*waiter);
-      *waiter = NULL;
-    }
+  if (!list_empty (waiters)) 
+    thread_unblock (list_entry (list_pop_front (waiters),
+                                struct thread, elem));
 }
@@ -1,14 +1,16 @@
 #ifndef DEVICES_INTQ_H
 #define DEVICES_INTQ_H
 
+#include <list.h>
+#include <ring.h>
+#include <stddef.h>
 #include "threads/interrupt.h"
-#include "threads/synch.h"
 
 /* An "interrupt queue", a circular buffer shared between
    kernel threads and external interrupt handlers.
 
    Interrupt queue functions can be called from kernel threads or
-   from external interrupt handlers.  Except for intq_init(),
+   from external interrupt handlers.  Except for intq_init_buf(),
    interrupts must be off in either case.
 
    The interrupt queue has the structure of a "monitor".  Locks
@@ -17,24 +19,18 @@
    protect kernel threads from one another, not from interrupt
    handlers. */
 
-/* Queue buffer size, in bytes. */
-#define INTQ_BUFSIZE 64
-
 /* A circular queue of bytes. */
 struct intq
   {
     /* Waiting threads. */
-    struct lock lock;           /* Only one thread may wait at once. */
-    struct thread *not_full;    /* Thread waiting for not-full condition. */
-    struct thread *not_empty;   /* Thread waiting for not-empty condition. */
+    struct list not_full;       /* Threads waiting for not-full condition. */
+    struct list not_empty;      /* Threads waiting for not-empty condition. */
 
     /* Queue. */
-    uint8_t buf[INTQ_BUFSIZE];  /* Buffer. */
-    int head;                   /* New data is written here. */
-    int tail;                   /* Old data is read here. */
+    struct ring ring;           /* Bytes in the queue. */
   };
 
-void intq_init (struct intq *);
+void intq_init_buf (struct intq *, uint8_t *buf, size_t size);
 bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
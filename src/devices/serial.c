@@ -1,7 +1,7 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <ring.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -42,20 +42,46 @@
 #define LCR_DLAB 0x80           /* Divisor Latch Access Bit (DLAB). */
 
 /* MODEM Control Register. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR 0x06          /* Clear receive and transmit FIFOs. */
+#define FCR_RX_TRIG8 0x80       /* Receive interrupt at 8 bytes. */
+
+#define IIR_FIFO 0xc0           /* FIFOs enabled. */
+
 #define MCR_OUT2 0x08           /* Output line 2. */
 
 /* Line Status Register. */
 #define LSR_DR 0x01             /* Data Ready: received data byte is in RBR. */
 #define LSR_THRE 0x20           /* THR Empty. */
+#define LSR_TEMT 0x40           /* Transmitter Empty. */
+
+/* Bytes the 16550A's transmit FIFO holds. */
+#define TX_FIFO_SIZE 16
+
+/* Transmit buffer size, in bytes.  A power of 2. */
+#define TXBUF_SIZE 4096
 
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Transmit buffer.  Bytes are queued by writers and sent by the
+   interrupt handler.  Accessed with interrupts off. */
+static uint8_t txbuf[TXBUF_SIZE];
+static struct ring txring;
+
+/* Bytes that may be written to THR each time it is empty: the
+   FIFO size if the UART has a working FIFO, otherwise 1. */
+static int tx_burst;
+
+/* Threads waiting for room in the transmit buffer, woken once
+   it is half empty. */
+static struct semaphore tx_room;
+static int tx_waiters;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void tx_fill (void);
+static uint8_t tx_getc (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -71,7 +97,10 @@ init_poll (void)
   outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (115200);                  /* 115.2 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  ring_init (&txring, txbuf, sizeof txbuf);
+  tx_burst = 1;
+  sema_init (&tx_room, 0);
+  tx_waiters = 0;
   mode = POLL;
 } 
 
@@ -90,6 +119,16 @@ serial_init_queue (void)
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
   mode = QUEUE;
   old_level = intr_disable ();
+
+  /* Turn on the FIFOs once the last polled byte is out, so that
+     each transmit interrupt can send a burst of bytes.  Received
+     bytes collect in the FIFO until 8 have arrived or the line
+     goes idle, and each interrupt then drains them all. */
+  while ((inb (LSR_REG) & LSR_TEMT) == 0)
+    continue;
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR | FCR_RX_TRIG8);
+  tx_burst = (inb (IIR_REG) & IIR_FIFO) == IIR_FIFO ? TX_FIFO_SIZE : 1;
+
   write_ier ();
   intr_set_level (old_level);
 }
@@ -98,32 +137,58 @@ serial_init_queue (void)
 void
 serial_putc (uint8_t byte) 
 {
+  serial_putbuf (&byte, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port.
+   Once interrupts are set up, the bytes are queued in the
+   transmit buffer and sent by the interrupt handler, so this
+   only waits if the buffer fills up. */
+void
+serial_putbuf (const void *buffer, size_t n) 
+{
+  const uint8_t *p = buffer;
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit the bytes. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (n-- > 0)
+        putc_poll (*p++);
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      while (n > 0)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          if (ring_full (&txring))
+            {
+              if (old_level == INTR_OFF)
+                {
+                  /* Interrupts are off and the transmit buffer
+                     is full.  If we wanted to wait for it to
+                     drain, we'd have to reenable interrupts.
+                     That's impolite, so we'll send a byte via
+                     polling instead. */
+                  putc_poll (tx_getc ());
+                }
+              else
+                {
+                  tx_waiters++;
+                  sema_down (&tx_room);
+                }
+              continue;
+            }
+
+          /* Queue as much as fits and start sending it. */
+          size_t cnt = ring_write (&txring, p, n);
+          p += cnt;
+          n -= cnt;
+          tx_fill ();
+          write_ier ();
         }
-
-      intq_putc (&txq, byte); 
-      write_ier ();
     }
   
   intr_set_level (old_level);
@@ -135,8 +200,8 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (!ring_empty (&txring))
+    putc_poll (tx_getc ());
   intr_set_level (old_level);
 }
 
@@ -182,7 +247,7 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (!ring_empty (&txring))
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -205,6 +270,34 @@ putc_poll (uint8_t byte)
   outb (THR_REG, byte);
 }
 
+/* If the transmitter is empty, hands it as many queued bytes
+   as it can take at once. */
+static void
+tx_fill (void) 
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if ((inb (LSR_REG) & LSR_THRE) == 0)
+    return;
+  for (i = 0; i < tx_burst && !ring_empty (&txring); i++)
+    outb (THR_REG, tx_getc ());
+}
+
+/* Removes the next byte to send from the transmit buffer, which
+   must not be empty, and returns it. */
+static uint8_t
+tx_getc (void)
+{
+  uint8_t byte;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  ring_read (&txring, &byte, 1);
+  return byte;
+}
+
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
@@ -214,14 +307,18 @@ serial_interrupt (struct intr_frame *f UNUSED)
   inb (IIR_REG);
 
   /* As long as we have room to receive a byte, and the hardware
-     has a byte for us, receive a byte.  */
+     has a byte for us, receive a byte.  If the input buffer
+     fills, the rest wait in the FIFO until a reader makes room
+     and serial_notify() turns receive interrupts back on. */
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* Transmit a burst of bytes if the hardware is ready for it,
+     and let writers go on once the buffer is half empty. */
+  tx_fill ();
+  if (tx_waiters > 0 && ring_count (&txring) <= TXBUF_SIZE / 2)
+    for (; tx_waiters > 0; tx_waiters--)
+      sema_up (&tx_room);
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
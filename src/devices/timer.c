@@ -3,8 +3,11 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include <clock.h>
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -24,13 +27,59 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
-/* List of blocked threads waiting for timer interrupt
-   ordered by timer_tick; */
-static struct list timer_list;
+/* Time stamp counter calibration, shared read-only with user
+   processes.  Initialized by timer_calibrate(). */
+static struct clock_page *clock;
 
-static list_less_func timer_compare_ticks;
+/* Pending alarms are kept in a hierarchical timing wheel.  Level
+   L has WHEEL_SLOTS slots, each covering WHEEL_SLOTS^L ticks, so
+   that an alarm is set and cancelled in O(1) time.  Alarms in a
+   slot of level L > 0 are redistributed to lower levels once the
+   wheel reaches the slot's first tick, which costs O(1) per
+   alarm and level.  Alarms farther out than the whole wheel
+   spans wait in the top level's farthest slot and are put back
+   each time it is reached. */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/* Next tick whose alarms go off.  Only the timer interrupt
+   advances it, to ticks + 1. */
+static int64_t wheel_ticks;
+
+/* 8254 input frequency and counts per timer tick. */
+#define PIT_HZ 1193180
+static unsigned pit_count;
+
+/* If false (default), the timer interrupts every tick.
+   If true, it is reprogrammed to skip ticks without alarms while
+   the system is idle.  Controlled by kernel command-line option
+   "-tickless". */
+bool timer_tickless;
+
+/* Busy-wait loops per second, or 0 (default) to calibrate them at
+   boot.  Controlled by kernel command-line option "-loops=LOOPS",
+   which takes the figure a calibrating boot prints, so that later
+   boots on the same host skip the calibration. */
+unsigned timer_loops;
+
+/* Number of ticks the timer is programmed to cover with one
+   interrupt, or 0 if it is interrupting every tick.  IDLE_ONESHOT
+   is set while that interrupt is still as timer_idle_enter()
+   programmed it. */
+static int oneshot_ticks;
+static bool idle_oneshot;
+
+static void pit_program (int mode, unsigned count);
+static void wheel_insert (struct alarm *);
+static void wheel_cascade (int level);
+static void wheel_tick (void);
+static int wheel_idle_ticks (void);
+static alarm_func timer_wakeup;
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
+static int64_t wait_for_tick (void);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 
@@ -40,45 +89,69 @@ static void real_time_sleep (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
-  /* Initializes timer_list. */
-  list_init (&timer_list);
+  int level, slot;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SLOTS; slot++)
+      list_init (&wheel[level][slot]);
+  wheel_ticks = 1;
 
   /* 8254 input frequency divided by TIMER_FREQ, rounded to
      nearest. */
-  uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
-
-  outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-  outb (0x40, count & 0xff);
-  outb (0x40, count >> 8);
+  pit_count = (PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ;
+  pit_program (2, pit_count);
 
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays,
+   unless timer_loops gives it, and the time stamp counter
+   against the ticks the calibration takes. */
 void
 timer_calibrate (void) 
 {
   unsigned high_bit, test_bit;
+  int64_t start_ticks, end_ticks;
+  uint64_t start_tsc, tsc_hz;
 
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
+  start_ticks = wait_for_tick ();
+  start_tsc = timer_cycles ();
 
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops (loops_per_tick << 1)) 
+  if (timer_loops >= TIMER_FREQ)
+    loops_per_tick = timer_loops / TIMER_FREQ;
+  else
     {
-      loops_per_tick <<= 1;
-      ASSERT (loops_per_tick != 0);
+      /* Approximate loops_per_tick as the largest power-of-two
+         still less than one timer tick. */
+      loops_per_tick = 1u << 10;
+      while (!too_many_loops (loops_per_tick << 1)) 
+        {
+          loops_per_tick <<= 1;
+          ASSERT (loops_per_tick != 0);
+        }
+
+      /* Refine the next 8 bits of loops_per_tick. */
+      high_bit = loops_per_tick;
+      for (test_bit = high_bit >> 1; test_bit != high_bit >> 10;
+           test_bit >>= 1)
+        if (!too_many_loops (high_bit | test_bit))
+          loops_per_tick |= test_bit;
     }
 
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops (high_bit | test_bit))
-      loops_per_tick |= test_bit;
+  end_ticks = wait_for_tick ();
+  tsc_hz = (timer_cycles () - start_tsc) * TIMER_FREQ
+           / (end_ticks - start_ticks);
+
+  clock = palloc_get_page (PAL_ZERO);
+  if (clock == NULL)
+    PANIC ("cannot allocate the clock page");
+  clock->tsc_base = start_tsc - (uint64_t) start_ticks * tsc_hz / TIMER_FREQ;
+  clock->mult = (1000000000ULL << CLOCK_SHIFT) / tsc_hz;
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  printf ("%'"PRIu64" loops/s, %'"PRIu64" cycles/s.\n",
+          (uint64_t) loops_per_tick * TIMER_FREQ, tsc_hz);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -100,31 +173,259 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
-/* Compares ticks of two threads and returns true
-   if previous one has less ticks. */
-static bool
-timer_compare_ticks (const struct list_elem *e1, const struct list_elem *e2,
-                     void *aux UNUSED)
+/* Returns the number of nanoseconds since the OS booted, from
+   the time stamp counter once it is calibrated and from the
+   timer ticks before. */
+uint64_t
+timer_nanos (void)
 {
-  struct thread *t1 = list_entry (e1, struct thread, timer_elem);
-  struct thread *t2 = list_entry (e2, struct thread, timer_elem);
-  return t1->timer_ticks < t2->timer_ticks;
+  if (clock == NULL)
+    return timer_ticks () * (1000000000 / TIMER_FREQ);
+  return clock_nanos (clock, timer_cycles ());
 }
 
+/* Returns the page holding the clock calibration, to be mapped
+   into user processes, or a null pointer before
+   timer_calibrate(). */
+void *
+timer_clock_page (void)
+{
+  return clock;
+}
 
 /* Suspends execution for approximately TICKS timer ticks. */
 void
 timer_sleep (int64_t ticks) 
 {
-  enum intr_level old_level = intr_disable ();
-  struct thread *t = thread_current ();
-  t->timer_ticks = timer_ticks () + ticks;
-  list_insert_ordered (&timer_list, &t->timer_elem,
-                       timer_compare_ticks, NULL);
+  struct alarm alarm;
+  enum intr_level old_level;
+
+  if (ticks <= 0)
+    return;
+
+  alarm_init (&alarm, timer_wakeup, thread_current ());
+  old_level = intr_disable ();
+  alarm_set (&alarm, timer_ticks () + ticks);
   thread_block ();
   intr_set_level (old_level);
 }
 
+/* Initializes ALARM to call FUNC with AUX from the timer
+   interrupt when it goes off. */
+void
+alarm_init (struct alarm *alarm, alarm_func *func, void *aux)
+{
+  ASSERT (alarm != NULL);
+  ASSERT (func != NULL);
+
+  alarm->func = func;
+  alarm->aux = aux;
+  alarm->pending = false;
+}
+
+/* Sets ALARM, which must not be pending, to go off at timer tick
+   EXPIRES, or at the next tick if EXPIRES has passed. */
+void
+alarm_set (struct alarm *alarm, int64_t expires)
+{
+  enum intr_level old_level;
+
+  ASSERT (alarm != NULL);
+  ASSERT (!alarm->pending);
+
+  old_level = intr_disable ();
+  alarm->expires = expires;
+  alarm->pending = true;
+  wheel_insert (alarm);
+  intr_set_level (old_level);
+}
+
+/* Cancels ALARM.  Returns true if it was pending, false if it
+   had already gone off or was never set. */
+bool
+alarm_cancel (struct alarm *alarm)
+{
+  enum intr_level old_level;
+  bool pending;
+
+  ASSERT (alarm != NULL);
+
+  old_level = intr_disable ();
+  pending = alarm->pending;
+  if (pending)
+    {
+      list_remove (&alarm->elem);
+      alarm->pending = false;
+    }
+  intr_set_level (old_level);
+  return pending;
+}
+
+/* Called by the idle thread with interrupts off just before it
+   halts.  In tickless mode, programs the timer to interrupt only
+   when the next alarm is due, within what the 8254 can count. */
+void
+timer_idle_enter (void)
+{
+  int cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+  cnt = wheel_idle_ticks ();
+  if (cnt > 1)
+    {
+      oneshot_ticks = cnt;
+      idle_oneshot = true;
+      pit_program (0, cnt * pit_count);
+    }
+}
+
+/* Called by the scheduler with interrupts off whenever the idle
+   thread stops running.  If the timer still covers several ticks
+   because another interrupt ended the halt, reprograms it to
+   interrupt at the end of the current tick instead, catching up
+   on the ticks that have passed. */
+void
+timer_idle_exit (void)
+{
+  unsigned total, left, elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!idle_oneshot)
+    return;
+  idle_oneshot = false;
+
+  /* Latch and read counter 0.  A count beyond the programmed one
+     has wrapped past zero: the interrupt is pending already. */
+  outb (0x43, 0x00);
+  left = inb (0x40);
+  left |= inb (0x40) << 8;
+  total = oneshot_ticks * pit_count;
+  if (left == 0 || left > total)
+    return;
+
+  elapsed = total - left;
+  oneshot_ticks = elapsed / pit_count + 1;
+  pit_program (0, pit_count - elapsed % pit_count);
+}
+
+/* Programs counter 0 of the 8254 in MODE with COUNT, which must
+   not exceed 65536.  Mode 2 interrupts every COUNT input cycles,
+   mode 0 once after COUNT cycles. */
+static void
+pit_program (int mode, unsigned count)
+{
+  ASSERT (count > 0 && count <= 65536);
+
+  /* CW: counter 0, LSB then MSB, MODE, binary. */
+  outb (0x43, 0x30 | mode << 1);
+  outb (0x40, count & 0xff);
+  outb (0x40, (count >> 8) & 0xff);
+}
+
+/* Puts pending ALARM in the wheel slot for its expiry time.
+   Interrupts must be off. */
+static void
+wheel_insert (struct alarm *alarm)
+{
+  int64_t expires = alarm->expires;
+  int64_t delta;
+  int level;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (expires < wheel_ticks)
+    expires = wheel_ticks;
+  delta = expires - wheel_ticks;
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (delta < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+      break;
+  if (delta >> (WHEEL_BITS * WHEEL_LEVELS) != 0)
+    expires = wheel_ticks + ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+  list_push_back (&wheel[level][(expires >> (WHEEL_BITS * level))
+                                & (WHEEL_SLOTS - 1)],
+                  &alarm->elem);
+}
+
+/* Moves the alarms in the current slot of LEVEL, which wheel_ticks
+   has just reached, into the slots of lower levels. */
+static void
+wheel_cascade (int level)
+{
+  int slot = (wheel_ticks >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+  struct list alarms;
+
+  list_init (&alarms);
+  while (!list_empty (&wheel[level][slot]))
+    list_push_back (&alarms, list_pop_front (&wheel[level][slot]));
+  while (!list_empty (&alarms))
+    wheel_insert (list_entry (list_pop_front (&alarms), struct alarm, elem));
+}
+
+/* Advances the wheel by one tick, firing the alarms due.  Runs
+   in the timer interrupt. */
+static void
+wheel_tick (void)
+{
+  struct list *slot;
+  int level;
+
+  /* At each boundary of a higher level's slot, move its alarms
+     down, then fire those due now. */
+  for (level = 1; level < WHEEL_LEVELS; level++)
+    {
+      if ((wheel_ticks & (((int64_t) 1 << (WHEEL_BITS * level)) - 1)) != 0)
+        break;
+      wheel_cascade (level);
+    }
+  slot = &wheel[0][wheel_ticks & (WHEEL_SLOTS - 1)];
+  while (!list_empty (slot))
+    {
+      struct alarm *alarm = list_entry (list_pop_front (slot),
+                                        struct alarm, elem);
+      alarm->pending = false;
+      alarm->func (alarm->aux);
+    }
+  wheel_ticks++;
+}
+
+/* Returns how many ticks from the next one on may pass with one
+   timer interrupt at the last: no alarm is due and no level
+   boundary is crossed before it.  Interrupts must be off. */
+static int
+wheel_idle_ticks (void)
+{
+  int max = 65536 / pit_count;
+  int cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (cnt = 1; cnt < max; cnt++)
+    {
+      int64_t tick = wheel_ticks + cnt - 1;
+      if ((tick & (WHEEL_SLOTS - 1)) == 0
+          || !list_empty (&wheel[0][tick & (WHEEL_SLOTS - 1)]))
+        break;
+    }
+  return cnt;
+}
+
+/* Wakes up sleeping thread T_, preempting the running thread if
+   T_ has a higher priority. */
+static void
+timer_wakeup (void *t_)
+{
+  struct thread *t = t_;
+
+  thread_unblock (t);
+  if (t->priority > thread_current ()->priority)
+    intr_yield_on_return ();
+}
+
 /* Suspends execution for approximately MS milliseconds. */
 void
 timer_msleep (int64_t ms) 
@@ -155,22 +456,39 @@ timer_print_stats (void)
 
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
-  ticks++;
-  struct list_elem *e;
-  for (e = list_begin (&timer_list); e != list_end (&timer_list);)
+  bool user = (args->cs & 3) == 3;
+  int cnt = 1;
+
+  profile_sample (args);
+
+  /* After an interrupt covering several ticks, go back to one per
+     tick and account for all of them. */
+  if (oneshot_ticks != 0)
     {
-      struct thread *t = list_entry (e, struct thread, timer_elem);
-      if (t->timer_ticks <= ticks)
-        {
-          thread_unblock (t);
-          e = list_remove (e);
-        }
-      else
-        break;
+      cnt = oneshot_ticks;
+      oneshot_ticks = 0;
+      idle_oneshot = false;
+      pit_program (2, pit_count);
     }
-  thread_tick ();
+  while (cnt-- > 0)
+    {
+      ticks++;
+      wheel_tick ();
+      thread_tick (user);
+    }
+}
+
+/* Waits for a timer tick to begin and returns it. */
+static int64_t
+wait_for_tick (void)
+{
+  int64_t start = ticks;
+
+  while (ticks == start)
+    barrier ();
+  return ticks;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -1,14 +1,37 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Called from the timer interrupt when an alarm goes off. */
+typedef void alarm_func (void *aux);
+
+/* An alarm set to go off at a given timer tick. */
+struct alarm
+  {
+    int64_t expires;            /* Tick to go off at. */
+    alarm_func *func;           /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* Set and not yet gone off? */
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+  };
+
+/* If true, idle periods skip timer interrupts. */
+extern bool timer_tickless;
+
+/* Busy-wait loops per second, or 0 to calibrate them. */
+extern unsigned timer_loops;
+
 void timer_init (void);
 void timer_calibrate (void);
+void timer_idle_enter (void);
+void timer_idle_exit (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
@@ -18,6 +41,23 @@ void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+void alarm_init (struct alarm *, alarm_func *, void *aux);
+void alarm_set (struct alarm *, int64_t expires);
+bool alarm_cancel (struct alarm *);
+
+uint64_t timer_nanos (void);
+void *timer_clock_page (void);
+
 void timer_print_stats (void);
 
+/* Returns the processor's time stamp counter, which counts CPU
+   cycles, for timing stretches much shorter than a tick. */
+static inline uint64_t
+timer_cycles (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
 #endif /* devices/timer.h */
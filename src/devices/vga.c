@@ -13,10 +13,25 @@
 #define COL_CNT 80
 #define ROW_CNT 25
 
-/* Current cursor position.  (0,0) is in the upper left corner of
-   the display. */
+/* Number of rows in text memory, which is 32 kB.  The display
+   shows ROW_CNT of them, starting at row TOP, so that scrolling
+   the display one line up only moves the start address that the
+   CRT controller displays from.  Only when the cursor reaches
+   the end of text memory are the rows on display copied back to
+   its start, once every BUF_ROWS - ROW_CNT lines. */
+#define BUF_ROWS (0x8000 / (COL_CNT * 2))
+
+/* Current cursor position, as a column and a row of text memory.
+   (0,TOP) is in the upper left corner of the display. */
 static size_t cx, cy;
 
+/* First row of text memory on display. */
+static size_t top;
+
+/* True to leave the display alone, for example on a machine
+   without one.  Set by kernel command-line option "-headless". */
+bool vga_disabled;
+
 /* Attribute value for gray text on a black background. */
 #define GRAY_ON_BLACK 0x07
 
@@ -28,6 +43,7 @@ static uint8_t (*fb)[COL_CNT][2];
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
+static void putc_nocursor (int c);
 static void move_cursor (void);
 static void find_cursor (size_t *x, size_t *y);
 
@@ -50,12 +66,39 @@ init (void)
 void
 vga_putc (int c)
 {
+  char ch = c;
+
+  vga_putbuf (&ch, 1);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display, as
+   vga_putc() does for each of them, but moves the hardware
+   cursor only once, after the last. */
+void
+vga_putbuf (const char *buffer, size_t n)
+{
+  enum intr_level old_level;
+
+  if (vga_disabled)
+    return;
+
   /* Disable interrupts to lock out interrupt handlers
      that might write to the console. */
-  enum intr_level old_level = intr_disable ();
+  old_level = intr_disable ();
 
   init ();
-  
+  while (n-- > 0)
+    putc_nocursor ((uint8_t) *buffer++);
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes C to the VGA text display, without moving the hardware
+   cursor. */
+static void
+putc_nocursor (int c)
+{
   switch (c) 
     {
     case '\n':
@@ -88,11 +131,6 @@ vga_putc (int c)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
@@ -101,11 +139,11 @@ cls (void)
 {
   size_t y;
 
+  top = 0;
   for (y = 0; y < ROW_CNT; y++)
     clear_row (y);
 
   cx = cy = 0;
-  move_cursor ();
 }
 
 /* Clears row Y to spaces. */
@@ -129,20 +167,37 @@ newline (void)
 {
   cx = 0;
   cy++;
-  if (cy >= ROW_CNT)
+  if (cy >= top + ROW_CNT)
     {
-      cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
-      clear_row (ROW_CNT - 1);
+      top++;
+      if (cy >= BUF_ROWS)
+        {
+          memmove (&fb[0], &fb[top], sizeof fb[0] * (ROW_CNT - 1));
+          top = 0;
+          cy = ROW_CNT - 1;
+        }
+      clear_row (cy);
     }
 }
 
-/* Moves the hardware cursor to (cx,cy). */
+/* Moves the hardware cursor to (cx,cy) and makes the display
+   start at row TOP, writing the start address only if it
+   changed. */
 static void
 move_cursor (void) 
 {
-  /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
+  /* See [FREEVGA] under "Manipulating the Text-mode Cursor" and
+     "CRTC Registers". */
+  static size_t shown_top;
   uint16_t cp = cx + COL_CNT * cy;
+
+  if (top != shown_top)
+    {
+      uint16_t start = COL_CNT * top;
+      outw (0x3d4, 0x0c | (start & 0xff00));
+      outw (0x3d4, 0x0d | (start << 8));
+      shown_top = top;
+    }
   outw (0x3d4, 0x0e | (cp & 0xff00));
   outw (0x3d4, 0x0f | (cp << 8));
 }
@@ -1,6 +1,12 @@
 #ifndef DEVICES_VGA_H
 #define DEVICES_VGA_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
+extern bool vga_disabled;
+
 void vga_putc (int);
+void vga_putbuf (const char *, size_t);
 
 #endif /* devices/vga.h */
@@ -0,0 +1,34 @@
+/* bench-exec.c
+
+   Measures exec() and wait() of a process that exits at once.
+   The process is this program, run as "bench-exec child". */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+#define CALL_CNT 20
+
+int
+main (int argc, char *argv[])
+{
+  uint64_t start;
+  int i;
+
+  if (argc > 1 && !strcmp (argv[1], "child"))
+    return EXIT_SUCCESS;
+
+  start = cycles ();
+  for (i = 0; i < CALL_CNT; i++)
+    {
+      pid_t pid = exec ("bench-exec child");
+      if (pid == PID_ERROR || wait (pid) != EXIT_SUCCESS)
+        {
+          printf ("bench-exec: child %d failed\n", i);
+          return EXIT_FAILURE;
+        }
+    }
+  printf ("(bench-exec) bench exec-wait: cycles per pair %llu\n",
+          (cycles () - start) / CALL_CNT);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,49 @@
+/* bench-mmap.c
+
+   Measures mapping a file, touching each of its pages and
+   unmapping it. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 4
+#define CALL_CNT 100
+
+static const char file_name[] = "bench-mmap.tmp";
+
+int
+main (void)
+{
+  char *addr = (char *) 0x10000000;
+  uint64_t start;
+  int fd;
+  int i, j;
+
+  if (!create (file_name, PAGE_CNT * PAGE_SIZE)
+      || (fd = open (file_name)) < 0)
+    {
+      printf ("%s: create failed\n", file_name);
+      return EXIT_FAILURE;
+    }
+
+  start = cycles ();
+  for (i = 0; i < CALL_CNT; i++)
+    {
+      mapid_t map = mmap (fd, addr);
+      if (map == MAP_FAILED)
+        {
+          printf ("%s: mmap failed\n", file_name);
+          return EXIT_FAILURE;
+        }
+      for (j = 0; j < PAGE_CNT; j++)
+        addr[j * PAGE_SIZE]++;
+      munmap (map);
+    }
+  printf ("(bench-mmap) bench mmap-touch-munmap: cycles per round %llu\n",
+          (cycles () - start) / CALL_CNT);
+
+  close (fd);
+  remove (file_name);
+  return EXIT_SUCCESS;
+}
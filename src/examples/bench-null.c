@@ -0,0 +1,23 @@
+/* bench-null.c
+
+   Measures the round trip of the cheapest system call, cycles(),
+   by timing many calls of it in a row. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+#define CALL_CNT 10000
+
+int
+main (void)
+{
+  uint64_t start;
+  int i;
+
+  start = cycles ();
+  for (i = 0; i < CALL_CNT; i++)
+    cycles ();
+  printf ("(bench-null) bench null: cycles per call %llu\n",
+          (cycles () - start) / CALL_CNT);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,32 @@
+/* bench-open.c
+
+   Measures an open() and close() pair on a scratch file. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+#define CALL_CNT 1000
+
+static const char file_name[] = "bench-open.tmp";
+
+int
+main (void)
+{
+  uint64_t start;
+  int i;
+
+  if (!create (file_name, 0))
+    {
+      printf ("%s: create failed\n", file_name);
+      return EXIT_FAILURE;
+    }
+
+  start = cycles ();
+  for (i = 0; i < CALL_CNT; i++)
+    close (open (file_name));
+  printf ("(bench-open) bench open-close: cycles per pair %llu\n",
+          (cycles () - start) / CALL_CNT);
+
+  remove (file_name);
+  return EXIT_SUCCESS;
+}
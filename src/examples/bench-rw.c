@@ -0,0 +1,44 @@
+/* bench-rw.c
+
+   Measures 1-byte write() and read() calls on a scratch file,
+   which mostly time the system call path and the file descriptor
+   table rather than the file system. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+#define CALL_CNT 1000
+
+static const char file_name[] = "bench-rw.tmp";
+
+int
+main (void)
+{
+  uint64_t start;
+  char byte = 'x';
+  int fd;
+  int i;
+
+  if (!create (file_name, 0) || (fd = open (file_name)) < 0)
+    {
+      printf ("%s: create failed\n", file_name);
+      return EXIT_FAILURE;
+    }
+
+  start = cycles ();
+  for (i = 0; i < CALL_CNT; i++)
+    write (fd, &byte, 1);
+  printf ("(bench-rw) bench write: cycles per call %llu\n",
+          (cycles () - start) / CALL_CNT);
+
+  seek (fd, 0);
+  start = cycles ();
+  for (i = 0; i < CALL_CNT; i++)
+    read (fd, &byte, 1);
+  printf ("(bench-rw) bench read: cycles per call %llu\n",
+          (cycles () - start) / CALL_CNT);
+
+  close (fd);
+  remove (file_name);
+  return EXIT_SUCCESS;
+}
@@ -1,88 +1,309 @@
+/* Set default buffer cache replacement algorithm with clock
+   algorithm. */
+#if !defined(CACHE_CLOCK) && !defined(CACHE_2Q)
+#define CACHE_CLOCK
+#endif
+
 #include "filesys/cache.h"
+#include <bitmap.h>
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
+#include <ohash.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include <round.h>
 #include "devices/timer.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "filesys/volume.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/perf.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
-#define BUFFER_CACHE_NUM 64
-#define THREAD_FLUSH_BACK "buffer-cache-flush-back"
-#define THREAD_READ_AHEAD "buffer-cache-read-ahead"
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
 #define FLUSH_BACK_INTERVAL 500
+#define READ_AHEAD_MAX 32
+#define FLUSH_BATCH 16
+
+/* Dirty entries that a scan of the whole cache visits between
+   chances for a waiter of higher priority to take
+   buffer_cache_lock. */
+#define SCAN_BATCH 64
+
+/* Percentages of the cache's entries that may be dirty before
+   write-behind starts early, and before writers are made to
+   write back file data themselves. */
+#define DIRTY_BACKGROUND_PCT 25
+#define DIRTY_THROTTLE_PCT 50
+
+/* Ticks that write-behind is put off at a time while synchronous
+   disk requests are queued, for up to another FLUSH_BACK_INTERVAL
+   past its schedule. */
+#define FLUSH_BACKOFF 10
 
-/* Buffer cache entry. */
+/* Owner of a sector not written on behalf of any inode. */
+#define NO_OWNER ((disk_sector_t) -1)
+
+/* Buffer cache entry.
+
+   Members USEBIT, SECTOR, PIN_CNT and the index and free list
+   elements are protected by buffer_cache_lock.  DATA and the
+   entry's dirty bit are protected by the entry's own LOCK, which
+   is also held by whoever fills or writes back the entry, so the
+   disk I/O on a sector does not stall accesses to other
+   sectors.  An entry
+   with a nonzero PIN_CNT is never chosen for eviction.  META,
+   OWNER and the queue members are protected by buffer_cache_lock,
+   too. */
 struct buffer_cache_entry
   {
     bool usebit;                      /* Whether in use or not. */
     disk_sector_t sector;             /* Sector number. */
-    bool dirty;                       /* Dirty bit. */
-    bool accessed;                    /* Accesed bit. */
-    uint8_t data[DISK_SECTOR_SIZE];   /* Data. */
+    int pin_cnt;                      /* Number of threads using this. */
+    bool meta;                        /* Whether holds file system
+                                         metadata. */
+    disk_sector_t owner;              /* Inode that wrote the data. */
+#ifdef CACHE_2Q
+    bool hot;                         /* Whether in hot queue. */
+    struct list_elem queue_elem;      /* Element in 2Q queues. */
+#endif
+    struct lock lock;                 /* Entry data lock. */
+    struct hash_elem elem;            /* Element in sector index. */
+    struct list_elem free_elem;       /* Element in free entry list. */
+    uint8_t *data;                    /* Data, DISK_SECTOR_SIZE bytes. */
   };
 
-/* Buffer cache lock. */
+/* Buffer cache index lock.
+   Held only while looking up, pinning, or relabeling entries,
+   never across disk I/O. */
 static struct lock buffer_cache_lock;
 
-/* Buffer cache entries. */
-static struct buffer_cache_entry buffer_cache[BUFFER_CACHE_NUM];
+/* Signaled when an entry becomes unpinned. */
+static struct condition buffer_cache_unpinned;
+
+/* Number of buffer cache entries allocated at boot.
+   Controlled by kernel command-line option "-cache=SECTORS". */
+size_t buffer_cache_size = 64;
+
+/* Maximum number of buffer cache entries.  Entries beyond
+   BUFFER_CACHE_SIZE take their data pages from the user pool
+   while it has free pages and give them back when the frame
+   allocator runs out of memory.
+   Controlled by kernel command-line option "-cache-max=SECTORS". */
+size_t buffer_cache_max = 1024;
 
+/* Buffer cache entries, BUFFER_CACHE_MAX in total.  Only the
+   first BUFFER_CACHE_CNT of them have data pages. */
+static struct buffer_cache_entry *buffer_cache;
+
+/* Number of buffer cache entries with data pages. */
+static size_t buffer_cache_cnt;
+
+#ifdef CACHE_CLOCK
 /* Buffer cache array traversing position. */
-static int buffer_cache_pos;
+static size_t buffer_cache_pos;
+#else
+/* 2Q queues of entries in use.  An entry referenced for the
+   first time enters the FIFO cold queue, so a long sequential
+   scan only cycles through it.  An entry referenced again after
+   leaving the cold queue, which is remembered by the ghost
+   queue, or holding metadata enters the LRU hot queue instead.
+   Both queues have their eviction candidates at the front. */
+static struct list buffer_cache_cold;
+static struct list buffer_cache_hot;
 
-/* Read-ahead entry. */
-struct read_ahead_entry
+/* Number of entries in cold queue. */
+static size_t buffer_cache_cold_cnt;
+
+/* Ghost queue entry.  Remembers a sector recently evicted from
+   the cold queue. */
+struct buffer_cache_ghost
   {
+    bool usebit;                      /* Whether in use or not. */
     disk_sector_t sector;             /* Sector number. */
-    struct list_elem elem;            /* List element. */
+    struct hash_elem elem;            /* Element in ghost index. */
   };
 
-/* Read-ahead semaphore. */
-static struct semaphore read_ahead_sema;
+/* Ghost queue, a ring of BUFFER_CACHE_GHOST_CNT entries indexed
+   by sector, with the oldest entry at BUFFER_CACHE_GHOST_POS. */
+static struct buffer_cache_ghost *buffer_cache_ghost;
+static size_t buffer_cache_ghost_cnt;
+static size_t buffer_cache_ghost_pos;
+static struct hash buffer_cache_ghost_index;
+#endif
+
+/* Serializes flushes.  Protects BUFFER_CACHE_FLUSH_LIST. */
+static struct lock buffer_cache_flush_lock;
+
+/* Dirty entries to flush, BUFFER_CACHE_MAX slots. */
+static struct buffer_cache_entry **buffer_cache_flush_list;
+
+/* Dirty and accessed bits of the buffer cache entries,
+   BUFFER_CACHE_MAX bits each, indexed like BUFFER_CACHE.  Kept
+   apart from the entries, so that a flush finds the dirty
+   entries a word of bits at a time instead of walking the whole
+   array, and the clock hand tests and clears its bit in a word
+   shared with its neighbors.  Bits are set and cleared with
+   single instructions, so entries sharing a word need no common
+   lock. */
+static struct bitmap *buffer_cache_dirty;
+static struct bitmap *buffer_cache_accessed;
+
+/* Number of bits set in BUFFER_CACHE_DIRTY.  Updated with
+   interrupts off, since entries are made dirty and clean under
+   their own locks only. */
+static size_t buffer_cache_dirty_cnt;
+
+/* Sector to buffer cache entry index of entries in use. */
+static struct ohash buffer_cache_index;
+
+/* List of buffer cache entries not in use. */
+static struct list buffer_cache_free_list;
+
+/* Read-ahead request, run on the system work queue. */
+struct read_ahead_entry
+  {
+    disk_sector_t sector;             /* Sector number. */
+    struct work work;                 /* Work item. */
+  };
 
 /* Read-ahead lock. */
 static struct lock read_ahead_lock;
 
-/* Read-ahead list. */
-static struct list read_ahead_list;
+/* Number of read-ahead requests queued. */
+static size_t read_ahead_cnt;
+
+/* Cache of read-ahead requests. */
+static struct slab_cache *read_ahead_cache;
+
+/* Periodic write-behind, run on the system work queue from the
+   first write on, so that short runs that never write do
+   without it. */
+static struct work flush_back_work;
+static bool flush_back_started;
+
+/* Milliseconds that the disks must have been idle for before
+   write-behind runs ahead of its schedule while the cache holds
+   dirty entries, or 0 to keep to the schedule.
+   Controlled by kernel command-line option "-flush-idle=MS". */
+unsigned buffer_cache_flush_idle = 100;
+
+/* Timer tick at which write-behind last ran.  Only the work
+   function uses it. */
+static int64_t flush_back_last;
+
+static hash_hash_func buffer_cache_hash;
+static hash_less_func buffer_cache_less;
+#ifdef CACHE_2Q
+static hash_hash_func buffer_cache_ghost_hash;
+static hash_less_func buffer_cache_ghost_less;
+#endif
 
 static struct buffer_cache_entry *buffer_cache_find (disk_sector_t);
 static struct buffer_cache_entry *buffer_cache_get_empty (void);
 static struct buffer_cache_entry *buffer_cache_to_evict (void);
+#ifdef CACHE_2Q
+static struct buffer_cache_entry *buffer_cache_victim (struct list *,
+                                                       bool meta,
+                                                       bool dirty_meta);
+static bool buffer_cache_ghost_remove (disk_sector_t);
+static void buffer_cache_ghost_add (disk_sector_t);
+#endif
+static void buffer_cache_insert (struct buffer_cache_entry *);
+static void buffer_cache_delete (struct buffer_cache_entry *, bool evict);
 static struct buffer_cache_entry *buffer_cache_fetch (disk_sector_t, bool read);
+static struct buffer_cache_entry *buffer_cache_grab (disk_sector_t,
+                                                     bool *miss);
+static void buffer_cache_touch (struct buffer_cache_entry *);
+static void buffer_cache_relabel (struct buffer_cache_entry *,
+                                  disk_sector_t);
+static void buffer_cache_set_meta (struct buffer_cache_entry *);
+static size_t buffer_cache_transfer (const struct cache_seg *, size_t cnt,
+                                     bool write, disk_sector_t owner,
+                                     bool meta);
+static void buffer_cache_add_page (uint8_t *page);
+#ifdef VM
+static bool buffer_cache_grow (void);
+#endif
+static bool buffer_cache_is_dirty (const struct buffer_cache_entry *);
+static void buffer_cache_set_dirty (struct buffer_cache_entry *, bool);
+static size_t buffer_cache_next_dirty (size_t start);
+static void buffer_cache_pin (struct buffer_cache_entry *);
+static void buffer_cache_unpin (struct buffer_cache_entry *);
+static void buffer_cache_release (struct buffer_cache_entry *);
+static size_t buffer_cache_flush_batch (struct buffer_cache_entry **,
+                                        size_t cnt, bool wait);
+static void buffer_cache_commit (struct buffer_cache_entry **, size_t cnt);
+static int buffer_cache_compare (const void *, const void *);
+static void buffer_cache_flush (bool background);
+static bool buffer_cache_over_background (void);
+static void buffer_cache_start_flush_back (void);
+static void buffer_cache_balance_dirty (void);
+static bool buffer_cache_throttle (void);
 
-/* Thread function to flush back to the disk periodically. */
+/* Work function to flush back to the disk periodically.
+
+   Write-behind runs every FLUSH_BACK_INTERVAL ticks, but is put
+   off while synchronous requests are queued, since its writes
+   would only lengthen their wait, unless too much of the cache is
+   dirty or it is far behind schedule.  While the cache holds
+   dirty entries, it also runs as soon as the disks have been idle
+   for buffer_cache_flush_idle ms, so that they write back during
+   lulls instead of when the next burst of requests arrives. */
 static void
-buffer_cache_thread_flush_back (void *aux UNUSED)
+buffer_cache_flush_back (void *aux UNUSED)
 {
-  for (;;)
+  int64_t idle = (int64_t) buffer_cache_flush_idle * TIMER_FREQ / 1000;
+  int64_t now = timer_ticks ();
+  int64_t due = flush_back_last + FLUSH_BACK_INTERVAL;
+  int64_t delay;
+
+  if (idle == 0 && buffer_cache_flush_idle != 0)
+    idle = 1;
+
+  if (buffer_cache_over_background ()
+      || (now >= due
+          && (!disk_sync_queued () || now >= due + FLUSH_BACK_INTERVAL))
+      || (idle != 0 && buffer_cache_dirty_cnt > 0
+          && disk_idle_time () >= idle))
     {
-      timer_sleep (FLUSH_BACK_INTERVAL);
-      buffer_cache_done ();
+      flush_back_last = now;
+      buffer_cache_flush (true);
+      now = timer_ticks ();
+      due = flush_back_last + FLUSH_BACK_INTERVAL;
     }
+
+  delay = now < due ? due - now : FLUSH_BACKOFF;
+  if (idle != 0 && buffer_cache_dirty_cnt > 0 && idle < delay)
+    delay = idle;
+  work_queue_delayed (&system_wq, &flush_back_work, delay);
 }
 
-/* Thread function to read ahead sectors from the disk. */
+/* Work function to read ahead the sector of read-ahead request
+   ENTRY_. */
 static void
-buffer_cache_thread_read_ahead (void *aux UNUSED)
+buffer_cache_do_read_ahead (void *entry_)
 {
-  for (;;)
-    {
-      sema_down (&read_ahead_sema);
-      lock_acquire (&read_ahead_lock);
+  struct read_ahead_entry *entry = entry_;
 
-      struct list_elem *e = list_pop_front (&read_ahead_list);
-      struct read_ahead_entry *entry = list_entry (e, struct read_ahead_entry,
-                                                   elem);
-      lock_acquire (&buffer_cache_lock);
-      buffer_cache_fetch (entry->sector, true);
-      lock_release (&buffer_cache_lock);
+  lock_acquire (&read_ahead_lock);
+  read_ahead_cnt--;
+  lock_release (&read_ahead_lock);
 
-      lock_release (&read_ahead_lock);
-    }
+  buffer_cache_release (buffer_cache_fetch (entry->sector, true));
+  slab_free (read_ahead_cache, entry);
 }
 
 /* Initializes the buffer cache. */
@@ -90,17 +311,69 @@ void
 buffer_cache_init (void)
 {
   lock_init (&buffer_cache_lock);
+  lock_set_name (&buffer_cache_lock, "buffer_cache");
+  cond_init (&buffer_cache_unpinned);
+#ifdef CACHE_CLOCK
   buffer_cache_pos = 0;
-  sema_init (&read_ahead_sema, 0);
+#else
+  list_init (&buffer_cache_cold);
+  list_init (&buffer_cache_hot);
+  buffer_cache_cold_cnt = 0;
+#endif
   lock_init (&read_ahead_lock);
-  list_init (&read_ahead_list);
-  int i;
-  for (i = 0; i < BUFFER_CACHE_NUM; i++)
-    buffer_cache[i].usebit = false;
-  thread_create (THREAD_FLUSH_BACK, PRI_MAX, buffer_cache_thread_flush_back,
-                 NULL);
-  thread_create (THREAD_READ_AHEAD, PRI_MAX, buffer_cache_thread_read_ahead,
-                 NULL);
+  read_ahead_cnt = 0;
+  read_ahead_cache = slab_cache_create ("read_ahead_entry",
+                                        sizeof (struct read_ahead_entry),
+                                        NULL);
+  list_init (&buffer_cache_free_list);
+
+  /* Allocate entries. */
+  buffer_cache_size = ROUND_UP (buffer_cache_size, SECTORS_PER_PAGE);
+  if (buffer_cache_size == 0)
+    buffer_cache_size = SECTORS_PER_PAGE;
+#ifdef VM
+  buffer_cache_max = ROUND_UP (buffer_cache_max, SECTORS_PER_PAGE);
+  if (buffer_cache_max < buffer_cache_size)
+    buffer_cache_max = buffer_cache_size;
+#else
+  buffer_cache_max = buffer_cache_size;
+#endif
+  if (!ohash_init (&buffer_cache_index, buffer_cache_hash, buffer_cache_less,
+                   NULL, buffer_cache_max))
+    PANIC ("buffer cache index creation failed");
+  buffer_cache = palloc_get_multiple (PAL_ZERO,
+                                      DIV_ROUND_UP (buffer_cache_max
+                                                    * sizeof *buffer_cache,
+                                                    PGSIZE));
+  lock_init (&buffer_cache_flush_lock);
+  buffer_cache_dirty_cnt = 0;
+  size_t flush_pages = DIV_ROUND_UP (buffer_cache_max
+                                     * sizeof *buffer_cache_flush_list,
+                                     PGSIZE);
+  buffer_cache_flush_list = palloc_get_multiple (0, flush_pages);
+  buffer_cache_dirty = bitmap_create (buffer_cache_max);
+  buffer_cache_accessed = bitmap_create (buffer_cache_max);
+  if (buffer_cache == NULL || buffer_cache_flush_list == NULL
+      || buffer_cache_dirty == NULL || buffer_cache_accessed == NULL)
+    PANIC ("buffer cache creation failed--too many entries");
+  buffer_cache_cnt = 0;
+  while (buffer_cache_cnt < buffer_cache_size)
+    buffer_cache_add_page (palloc_get_page (PAL_ASSERT));
+#ifdef CACHE_2Q
+  buffer_cache_ghost_cnt = buffer_cache_max / 2;
+  buffer_cache_ghost_pos = 0;
+  size_t ghost_pages = DIV_ROUND_UP (buffer_cache_ghost_cnt
+                                     * sizeof *buffer_cache_ghost, PGSIZE);
+  buffer_cache_ghost = palloc_get_multiple (PAL_ZERO, ghost_pages);
+  if (buffer_cache_ghost == NULL
+      || !hash_init_sized (&buffer_cache_ghost_index,
+                           buffer_cache_ghost_hash, buffer_cache_ghost_less,
+                           NULL, buffer_cache_ghost_cnt))
+    PANIC ("buffer cache ghost queue creation failed");
+#endif
+
+  work_init (&flush_back_work, buffer_cache_flush_back, NULL);
+  flush_back_started = false;
 }
 
 /* Shuts down the buffer cache module, writing any unwritten data
@@ -108,17 +381,163 @@ buffer_cache_init (void)
 void
 buffer_cache_done (void)
 {
-  lock_acquire (&buffer_cache_lock);
+  buffer_cache_flush (false);
+}
+
+/* Writes back the dirty entries, as write-behind does if
+   BACKGROUND is true.
+
+   File system operations are held off meanwhile, so that the
+   dirty metadata forms a consistent state.  It is committed to
+   the journal as one transaction and then written in place.
+   Other dirty entries are written back after it in sector order,
+   a batch at a time, and become clean.  Each batch is submitted
+   to the disk at once, so the disk driver merges contiguous
+   sectors into multi-sector writes.  The index lock is not held
+   during the writes.  Write-behind stops writing back file data
+   once synchronous disk requests are queued, unless too much of
+   the cache is dirty, and leaves the rest for its next run. */
+static void
+buffer_cache_flush (bool background)
+{
+  size_t cnt = 0;
+  size_t scanned = 0;
+  size_t meta_cnt;
+  size_t i;
+
+  lock_acquire (&buffer_cache_flush_lock);
+  journal_block ();
 
-  int i;
-  for (i = 0; i < BUFFER_CACHE_NUM; i++)
+  /* Collect and pin dirty entries, metadata first. */
+  lock_acquire (&buffer_cache_lock);
+  for (i = buffer_cache_next_dirty (0); i < buffer_cache_cnt;
+       i = buffer_cache_next_dirty (i + 1))
     {
       struct buffer_cache_entry *entry = buffer_cache + i;
-      if (entry->usebit && entry->dirty)
-        disk_write (filesys_disk, entry->sector, entry->data);
+      if (entry->usebit && entry->meta)
+        {
+          buffer_cache_pin (entry);
+          buffer_cache_flush_list[cnt++] = entry;
+        }
+      if (++scanned % SCAN_BATCH == 0)
+        lock_yield (&buffer_cache_lock);
     }
+  meta_cnt = cnt;
+  for (i = buffer_cache_next_dirty (0); i < buffer_cache_cnt;
+       i = buffer_cache_next_dirty (i + 1))
+    {
+      struct buffer_cache_entry *entry = buffer_cache + i;
+      if (entry->usebit && !entry->meta)
+        {
+          buffer_cache_pin (entry);
+          buffer_cache_flush_list[cnt++] = entry;
+        }
+      if (++scanned % SCAN_BATCH == 0)
+        lock_yield (&buffer_cache_lock);
+    }
+  lock_release (&buffer_cache_lock);
 
+  /* Commit metadata.  More than the journal holds is committed
+     in several transactions. */
+  qsort (buffer_cache_flush_list, meta_cnt, sizeof *buffer_cache_flush_list,
+         buffer_cache_compare);
+  for (i = 0; i < meta_cnt; i += JOURNAL_BLOCKS)
+    buffer_cache_commit (buffer_cache_flush_list + i,
+                         meta_cnt - i < JOURNAL_BLOCKS
+                         ? meta_cnt - i : JOURNAL_BLOCKS);
+
+  /* Write back the rest. */
+  qsort (buffer_cache_flush_list + meta_cnt, cnt - meta_cnt,
+         sizeof *buffer_cache_flush_list, buffer_cache_compare);
+  for (i = meta_cnt; i < cnt; i += FLUSH_BATCH)
+    {
+      if (background && disk_sync_queued ()
+          && !buffer_cache_over_background ())
+        break;
+      buffer_cache_flush_batch (buffer_cache_flush_list + i,
+                                cnt - i < FLUSH_BATCH ? cnt - i : FLUSH_BATCH,
+                                true);
+    }
+  if (i < cnt)
+    {
+      lock_acquire (&buffer_cache_lock);
+      for (; i < cnt; i++)
+        buffer_cache_unpin (buffer_cache_flush_list[i]);
+      lock_release (&buffer_cache_lock);
+    }
+
+  journal_unblock ();
+  lock_release (&buffer_cache_flush_lock);
+}
+
+/* Writes back the dirty data sectors last written on behalf of
+   the inode in sector OWNER.  If META is true, commits all the
+   dirty metadata afterward, which has to go in one consistent
+   transaction rather than inode by inode, so that the inode's
+   length and sectors also survive a crash.  Returns once the
+   disk has them on the medium rather than in its write cache. */
+void
+buffer_cache_sync (disk_sector_t owner, bool meta)
+{
+  size_t cnt = 0;
+  size_t scanned = 0;
+  size_t i;
+
+  lock_acquire (&buffer_cache_flush_lock);
+
+  /* Data first, so that the metadata never names sectors whose
+     contents are not on disk. */
+  lock_acquire (&buffer_cache_lock);
+  for (i = buffer_cache_next_dirty (0); i < buffer_cache_cnt;
+       i = buffer_cache_next_dirty (i + 1))
+    {
+      struct buffer_cache_entry *entry = buffer_cache + i;
+      if (entry->usebit && !entry->meta
+          && entry->owner == owner)
+        {
+          buffer_cache_pin (entry);
+          buffer_cache_flush_list[cnt++] = entry;
+        }
+      if (++scanned % SCAN_BATCH == 0)
+        lock_yield (&buffer_cache_lock);
+    }
   lock_release (&buffer_cache_lock);
+  qsort (buffer_cache_flush_list, cnt, sizeof *buffer_cache_flush_list,
+         buffer_cache_compare);
+  for (i = 0; i < cnt; i += FLUSH_BATCH)
+    buffer_cache_flush_batch (buffer_cache_flush_list + i,
+                              cnt - i < FLUSH_BATCH ? cnt - i : FLUSH_BATCH,
+                              true);
+
+  if (meta)
+    {
+      journal_block ();
+      cnt = 0;
+      lock_acquire (&buffer_cache_lock);
+      for (i = buffer_cache_next_dirty (0); i < buffer_cache_cnt;
+           i = buffer_cache_next_dirty (i + 1))
+        {
+          struct buffer_cache_entry *entry = buffer_cache + i;
+          if (entry->usebit && entry->meta)
+            {
+              buffer_cache_pin (entry);
+              buffer_cache_flush_list[cnt++] = entry;
+            }
+          if (++scanned % SCAN_BATCH == 0)
+            lock_yield (&buffer_cache_lock);
+        }
+      lock_release (&buffer_cache_lock);
+      qsort (buffer_cache_flush_list, cnt, sizeof *buffer_cache_flush_list,
+             buffer_cache_compare);
+      for (i = 0; i < cnt; i += JOURNAL_BLOCKS)
+        buffer_cache_commit (buffer_cache_flush_list + i,
+                             cnt - i < JOURNAL_BLOCKS
+                             ? cnt - i : JOURNAL_BLOCKS);
+      journal_unblock ();
+    }
+  volume_flush (volume_of (owner));
+
+  lock_release (&buffer_cache_flush_lock);
 }
 
 /* Reads the SECTOR of filesys disk into ADDR.
@@ -141,13 +560,96 @@ void
 buffer_cache_read_at (disk_sector_t sector, void *addr, off_t offset,
                       size_t size)
 {
-  lock_acquire (&buffer_cache_lock);
-
   struct buffer_cache_entry *entry = buffer_cache_fetch (sector, true);
   memcpy (addr, entry->data + offset, size);
-  entry->accessed = true;
+  bitmap_mark (buffer_cache_accessed, entry - buffer_cache);
+  buffer_cache_release (entry);
+}
 
-  lock_release (&buffer_cache_lock);
+/* Reads CNT contiguous sectors starting at SECTOR into ADDR, a
+   kernel buffer, without caching them.  Sectors not
+   cached are read from the disk straight into ADDR, a run at a
+   time, and cached ones are copied from the cache, which may
+   hold newer data than the disk. */
+void
+buffer_cache_read_direct (disk_sector_t sector, void *addr, size_t cnt)
+{
+  uint8_t *buffer = addr;
+
+  ASSERT (is_kernel_vaddr (addr));
+
+  while (cnt > 0)
+    {
+      size_t run;
+
+      /* Count the uncached sectors from here.  Dirty victims stay
+         indexed until written back, so the disk is up to date for
+         those. */
+      lock_acquire (&buffer_cache_lock);
+      for (run = 0; run < cnt; run++)
+        if (buffer_cache_find (sector + run) != NULL)
+          break;
+      lock_release (&buffer_cache_lock);
+
+      if (run > 0)
+        volume_read (sector, buffer, run);
+      else
+        {
+          buffer_cache_read (sector, buffer);
+          run = 1;
+        }
+      sector += run;
+      buffer += run * DISK_SECTOR_SIZE;
+      cnt -= run;
+    }
+}
+
+/* Writes CNT contiguous sectors starting at SECTOR from ADDR, a
+   kernel buffer, without caching them, on behalf of the inode in
+   sector OWNER.  Sectors not cached are written to the disk
+   straight from ADDR, a run at a time, and cached ones are
+   written into the cache.  A sector that a reader caches while
+   its run is on the way to the disk may hold the old data, so it
+   is written into the cache afterward, too. */
+void
+buffer_cache_write_direct (disk_sector_t sector, const void *addr,
+                           size_t cnt, disk_sector_t owner)
+{
+  const uint8_t *buffer = addr;
+  size_t i;
+
+  ASSERT (is_kernel_vaddr (addr));
+
+  while (cnt > 0)
+    {
+      size_t run;
+
+      lock_acquire (&buffer_cache_lock);
+      for (run = 0; run < cnt; run++)
+        if (buffer_cache_find (sector + run) != NULL)
+          break;
+      lock_release (&buffer_cache_lock);
+
+      if (run > 0)
+        {
+          volume_write (sector, buffer, run);
+          for (i = 0; i < run; i++)
+            if (buffer_cache_contains (sector + i))
+              {
+                buffer_cache_write (sector + i, buffer + i * DISK_SECTOR_SIZE);
+                buffer_cache_set_owner (sector + i, owner);
+              }
+        }
+      else
+        {
+          buffer_cache_write (sector, buffer);
+          buffer_cache_set_owner (sector, owner);
+          run = 1;
+        }
+      sector += run;
+      buffer += run * DISK_SECTOR_SIZE;
+      cnt -= run;
+    }
 }
 
 /* Writes the data from ADDR to the SECTOR.
@@ -163,14 +665,12 @@ buffer_cache_read_at (disk_sector_t sector, void *addr, off_t offset,
 void
 buffer_cache_write (disk_sector_t sector, const void *addr)
 {
-  lock_acquire (&buffer_cache_lock);
-
   struct buffer_cache_entry *entry = buffer_cache_fetch (sector, false);
   memcpy (entry->data, addr, DISK_SECTOR_SIZE);
-  entry->accessed = true;
-  entry->dirty = true;
-
-  lock_release (&buffer_cache_lock);
+  bitmap_mark (buffer_cache_accessed, entry - buffer_cache);
+  buffer_cache_set_dirty (entry, true);
+  buffer_cache_release (entry);
+  buffer_cache_balance_dirty ();
 }
 
 /* Writes the data from ADDR to a part of SECTOR.
@@ -182,14 +682,89 @@ void
 buffer_cache_write_at (disk_sector_t sector, const void *addr, off_t offset,
                        size_t size)
 {
-  lock_acquire (&buffer_cache_lock);
-
   struct buffer_cache_entry *entry = buffer_cache_fetch (sector, true);
   memcpy (entry->data + offset, addr, size);
-  entry->accessed = true;
-  entry->dirty = true;
+  bitmap_mark (buffer_cache_accessed, entry - buffer_cache);
+  buffer_cache_set_dirty (entry, true);
+  buffer_cache_release (entry);
+  buffer_cache_balance_dirty ();
+}
+
+/* Reads the CNT segments SEGS out of the cache, caching the
+   sectors it does not hold yet.  The sectors are looked up
+   CACHE_SEG_MAX at a time under one acquisition of the index
+   lock, and the misses of each batch are read with their
+   requests submitted together, so that the disk driver merges
+   adjacent ones into one transfer.  If META is true, the
+   sectors are marked as metadata, as by
+   buffer_cache_mark_meta(). */
+void
+buffer_cache_read_multiple (const struct cache_seg *segs, size_t cnt,
+                            bool meta)
+{
+  while (cnt > 0)
+    {
+      size_t done = buffer_cache_transfer (segs, cnt, false, NO_OWNER, meta);
+      segs += done;
+      cnt -= done;
+    }
+}
+
+/* Writes the CNT segments SEGS into the cache, on behalf of the
+   inode in sector OWNER, a batch at a time as
+   buffer_cache_read_multiple() reads them.  Sectors not cached
+   are read from the disk first, unless they are written
+   whole.  If META is true, the sectors are marked as metadata
+   instead of being owned. */
+void
+buffer_cache_write_multiple (const struct cache_seg *segs, size_t cnt,
+                             disk_sector_t owner, bool meta)
+{
+  while (cnt > 0)
+    {
+      size_t done = buffer_cache_transfer (segs, cnt, true, owner, meta);
+      segs += done;
+      cnt -= done;
+    }
+  buffer_cache_balance_dirty ();
+}
+
+/* Returns true if the buffer cache holds SECTOR. */
+bool
+buffer_cache_contains (disk_sector_t sector)
+{
+  bool found;
 
+  lock_acquire (&buffer_cache_lock);
+  found = buffer_cache_find (sector) != NULL;
   lock_release (&buffer_cache_lock);
+  return found;
+}
+
+/* Returns true if the buffer cache holds SECTOR and the SIZE
+   bytes at OFFSET in it equal those at ADDR.  A sector not
+   cached is not read. */
+bool
+buffer_cache_equal (disk_sector_t sector, const void *addr, off_t offset,
+                    size_t size)
+{
+  struct buffer_cache_entry *entry;
+  bool equal;
+
+  lock_acquire (&buffer_cache_lock);
+  entry = buffer_cache_find (sector);
+  if (entry == NULL)
+    {
+      lock_release (&buffer_cache_lock);
+      return false;
+    }
+  buffer_cache_pin (entry);
+  lock_release (&buffer_cache_lock);
+
+  lock_acquire (&entry->lock);
+  equal = memcmp (entry->data + offset, addr, size) == 0;
+  buffer_cache_release (entry);
+  return equal;
 }
 
 /* Removes a buffer cache entry of the given SECTOR if exists. */
@@ -197,29 +772,93 @@ void
 buffer_cache_remove (disk_sector_t sector)
 {
   lock_acquire (&buffer_cache_lock);
-
   struct buffer_cache_entry *entry = buffer_cache_find (sector);
-  if (entry != NULL && entry->dirty)
+  if (entry == NULL)
     {
-      disk_write (filesys_disk, entry->sector, entry->data);
+      lock_release (&buffer_cache_lock);
+      return;
+    }
+  buffer_cache_pin (entry);
+  lock_release (&buffer_cache_lock);
+
+  /* Dirty metadata is written in place only after it is
+     committed, so it stays cached until then. */
+  lock_acquire (&entry->lock);
+  bool dirty = buffer_cache_is_dirty (entry) && !entry->meta;
+  if (dirty)
+    {
+      volume_write (entry->sector, entry->data, 1);
+      buffer_cache_set_dirty (entry, false);
+    }
+  lock_release (&entry->lock);
+
+  lock_acquire (&buffer_cache_lock);
+  buffer_cache_unpin (entry);
+  if (dirty && entry->pin_cnt == 0 && !buffer_cache_is_dirty (entry))
+    {
+      buffer_cache_delete (entry, false);
       entry->usebit = false;
+      list_push_back (&buffer_cache_free_list, &entry->free_elem);
     }
+  lock_release (&buffer_cache_lock);
+}
 
+/* Marks the cached SECTOR as holding file system metadata, such
+   as an inode, an indirect block or a directory, so that it is
+   evicted only when no other data can be.  Does nothing if the
+   sector is not cached. */
+void
+buffer_cache_mark_meta (disk_sector_t sector)
+{
+  lock_acquire (&buffer_cache_lock);
+  struct buffer_cache_entry *entry = buffer_cache_find (sector);
+  if (entry != NULL)
+    buffer_cache_set_meta (entry);
+  lock_release (&buffer_cache_lock);
+}
+
+/* Records that the cached SECTOR was written on behalf of the
+   inode in sector OWNER, so that buffer_cache_sync() on OWNER
+   writes it back.  Does nothing if the sector is not cached. */
+void
+buffer_cache_set_owner (disk_sector_t sector, disk_sector_t owner)
+{
+  lock_acquire (&buffer_cache_lock);
+  struct buffer_cache_entry *entry = buffer_cache_find (sector);
+  if (entry != NULL)
+    entry->owner = owner;
   lock_release (&buffer_cache_lock);
 }
 
-/* Read-ahead the given SECTOR into the buffer cache. */
+/* Read-ahead the given SECTOR into the buffer cache
+   asynchronously.  Does nothing if the sector is already cached
+   or too many read-ahead requests are pending. */
 void
 buffer_cache_read_ahead (disk_sector_t sector)
 {
-  struct read_ahead_entry *entry = malloc (sizeof (struct read_ahead_entry));
+  lock_acquire (&buffer_cache_lock);
+  bool cached = buffer_cache_find (sector) != NULL;
+  lock_release (&buffer_cache_lock);
+  if (cached)
+    return;
+
+  struct read_ahead_entry *entry = slab_alloc (read_ahead_cache);
   if (entry == NULL)
     return;
   entry->sector = sector;
+  work_init (&entry->work, buffer_cache_do_read_ahead, entry);
 
   lock_acquire (&read_ahead_lock);
-  list_push_back (&read_ahead_list, &entry->elem);
+  if (read_ahead_cnt >= READ_AHEAD_MAX)
+    {
+      lock_release (&read_ahead_lock);
+      slab_free (read_ahead_cache, entry);
+      return;
+    }
+  read_ahead_cnt++;
   lock_release (&read_ahead_lock);
+
+  work_queue (&system_wq, &entry->work);
 }
 
 /* Returns the buffer cache entry of the given SECTOR. Returns
@@ -227,13 +866,14 @@ buffer_cache_read_ahead (disk_sector_t sector)
 static struct buffer_cache_entry *
 buffer_cache_find (disk_sector_t sector)
 {
-  int i;
-  for (i = 0; i < BUFFER_CACHE_NUM; i++)
-    {
-      if (buffer_cache[i].usebit && buffer_cache[i].sector == sector)
-        return buffer_cache + i;
-    }
-  return NULL;
+  struct buffer_cache_entry entry;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  entry.sector = sector;
+  e = ohash_find (&buffer_cache_index, &entry.elem);
+  return e != NULL ? hash_entry (e, struct buffer_cache_entry, elem) : NULL;
 }
 
 /* Returns an empty buffer cache entry. Returns NULL if every
@@ -241,59 +881,899 @@ buffer_cache_find (disk_sector_t sector)
 static struct buffer_cache_entry *
 buffer_cache_get_empty (void)
 {
-  int i;
-  for (i = 0; i < BUFFER_CACHE_NUM; i++)
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  if (list_empty (&buffer_cache_free_list))
+    return NULL;
+  return list_entry (list_pop_front (&buffer_cache_free_list),
+                     struct buffer_cache_entry, free_elem);
+}
+
+#ifdef CACHE_CLOCK
+/* Returns a buffer cache entry to evict, or NULL if every entry
+   is pinned.
+   This method uses the clock replacement algorithm.  Metadata
+   entries are passed over during the first round, and dirty
+   ones, which would be written in place before being committed,
+   during the first three. */
+static struct buffer_cache_entry *
+buffer_cache_to_evict (void)
+{
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  size_t i;
+  for (i = 0; i < 4 * buffer_cache_cnt; i++)
     {
-      if (!buffer_cache[i].usebit)
-        return buffer_cache + i;
+      struct buffer_cache_entry *entry;
+      buffer_cache_pos %= buffer_cache_cnt;
+      entry = buffer_cache + buffer_cache_pos++;
+      if (entry->pin_cnt > 0)
+        continue;
+      if (entry->meta && i < buffer_cache_cnt)
+        continue;
+      if (entry->meta && buffer_cache_is_dirty (entry)
+          && i < 3 * buffer_cache_cnt)
+        continue;
+      if (!bitmap_test (buffer_cache_accessed, entry - buffer_cache))
+        return entry;
+      bitmap_reset (buffer_cache_accessed, entry - buffer_cache);
     }
   return NULL;
 }
-
-/* Returns a buffer cache entry to evict.
-   This method uses the clock replacement algorithm. */
+#else
+/* Returns a buffer cache entry to evict, or NULL if every entry
+   is pinned.
+   This method uses the 2Q replacement algorithm.  The cold queue
+   is kept within a quarter of the cache, and metadata entries
+   are evicted last, dirty ones, which would be written in place
+   before being committed, after all others. */
 static struct buffer_cache_entry *
 buffer_cache_to_evict (void)
 {
-  struct buffer_cache_entry *entry;
-  for (;;)
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  struct buffer_cache_entry *entry = NULL;
+  if (buffer_cache_cold_cnt > buffer_cache_cnt / 4)
+    entry = buffer_cache_victim (&buffer_cache_cold, false, false);
+  if (entry == NULL)
+    entry = buffer_cache_victim (&buffer_cache_hot, false, false);
+  if (entry == NULL)
+    entry = buffer_cache_victim (&buffer_cache_cold, false, false);
+  if (entry == NULL)
+    entry = buffer_cache_victim (&buffer_cache_hot, true, false);
+  if (entry == NULL)
+    entry = buffer_cache_victim (&buffer_cache_hot, true, true);
+  return entry;
+}
+
+/* Returns the first unpinned entry in QUEUE, or NULL if there
+   is none.  Metadata entries are skipped unless META is set, and
+   dirty ones unless DIRTY_META is set, too. */
+static struct buffer_cache_entry *
+buffer_cache_victim (struct list *queue, bool meta, bool dirty_meta)
+{
+  struct list_elem *e;
+  for (e = list_begin (queue); e != list_end (queue); e = list_next (e))
     {
-      entry = buffer_cache + buffer_cache_pos;
-      if (!entry->accessed)
-        break;
-      entry->accessed = false;
+      struct buffer_cache_entry *entry = list_entry (e,
+                                                     struct buffer_cache_entry,
+                                                     queue_elem);
+      if (entry->pin_cnt == 0 && (meta || !entry->meta)
+          && (dirty_meta || !entry->meta || !buffer_cache_is_dirty (entry)))
+        return entry;
     }
-  buffer_cache_pos = (buffer_cache_pos + 1) % BUFFER_CACHE_NUM;
-  return entry;
+  return NULL;
+}
+
+/* Removes SECTOR from the ghost queue.  Returns true if it was
+   there, false otherwise. */
+static bool
+buffer_cache_ghost_remove (disk_sector_t sector)
+{
+  struct buffer_cache_ghost ghost;
+  struct hash_elem *e;
+
+  ghost.sector = sector;
+  e = hash_delete (&buffer_cache_ghost_index, &ghost.elem);
+  if (e == NULL)
+    return false;
+  hash_entry (e, struct buffer_cache_ghost, elem)->usebit = false;
+  return true;
+}
+
+/* Adds SECTOR to the ghost queue, forgetting the oldest sector
+   if the queue is full. */
+static void
+buffer_cache_ghost_add (disk_sector_t sector)
+{
+  if (buffer_cache_ghost_cnt == 0)
+    return;
+
+  struct buffer_cache_ghost *ghost = buffer_cache_ghost
+                                     + buffer_cache_ghost_pos;
+  buffer_cache_ghost_pos = (buffer_cache_ghost_pos + 1)
+                           % buffer_cache_ghost_cnt;
+  if (ghost->usebit)
+    hash_delete (&buffer_cache_ghost_index, &ghost->elem);
+  ghost->usebit = true;
+  ghost->sector = sector;
+  if (hash_insert (&buffer_cache_ghost_index, &ghost->elem) != NULL)
+    ghost->usebit = false;
+}
+#endif
+
+/* Adds ENTRY, relabeled with its new sector, to the index and
+   to the replacement queues. */
+static void
+buffer_cache_insert (struct buffer_cache_entry *entry)
+{
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  entry->meta = false;
+  ohash_insert (&buffer_cache_index, &entry->elem);
+#ifdef CACHE_2Q
+  entry->hot = buffer_cache_ghost_remove (entry->sector);
+  if (entry->hot)
+    list_push_back (&buffer_cache_hot, &entry->queue_elem);
+  else
+    {
+      list_push_back (&buffer_cache_cold, &entry->queue_elem);
+      buffer_cache_cold_cnt++;
+    }
+#endif
 }
 
-/* Returns the buffer cache entry of the given SECTOR.
+/* Removes ENTRY from the index and from the replacement queues.
+   EVICT tells whether ENTRY is being replaced, which the 2Q
+   ghost queue remembers. */
+static void
+buffer_cache_delete (struct buffer_cache_entry *entry, bool evict UNUSED)
+{
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  ohash_delete (&buffer_cache_index, &entry->elem);
+#ifdef CACHE_2Q
+  list_remove (&entry->queue_elem);
+  if (!entry->hot)
+    {
+      buffer_cache_cold_cnt--;
+      if (evict)
+        buffer_cache_ghost_add (entry->sector);
+    }
+#endif
+}
+
+/* Returns the buffer cache entry of the given SECTOR, pinned
+   and with its lock held.  Release it with
+   buffer_cache_release().
    If the entry does not exist, it fetches the entry for
    the sector. If READ is set by TRUE, then it also reads
    the data from the disk. */
 static struct buffer_cache_entry *
 buffer_cache_fetch (disk_sector_t sector, bool read)
 {
-  struct buffer_cache_entry *entry = buffer_cache_find (sector);
-  if (entry == NULL)
+  struct buffer_cache_entry *entry;
+
+  lock_acquire (&buffer_cache_lock);
+  for (;;)
     {
+      /* Cache hit.  Wait for any I/O in progress on the entry
+         by acquiring its lock. */
+      entry = buffer_cache_find (sector);
+      if (entry != NULL)
+        {
+          buffer_cache_touch (entry);
+          buffer_cache_pin (entry);
+          lock_release (&buffer_cache_lock);
+          lock_acquire (&entry->lock);
+          perf_inc (PERF_CACHE_HIT);
+          return entry;
+        }
+
+      /* Cache miss.  Take a free entry if any. */
       entry = buffer_cache_get_empty ();
+      if (entry != NULL)
+        {
+          entry->usebit = true;
+          bitmap_reset (buffer_cache_accessed, entry - buffer_cache);
+          break;
+        }
+#ifdef VM
+      if (buffer_cache_grow ())
+        continue;
+#endif
+
+      /* Otherwise, choose a victim.  Wait if all are pinned. */
+      entry = buffer_cache_to_evict ();
       if (entry == NULL)
         {
-          entry = buffer_cache_to_evict ();
-          if (entry->dirty)
-            disk_write (filesys_disk, entry->sector, entry->data);
+          cond_wait (&buffer_cache_unpinned, &buffer_cache_lock);
+          continue;
         }
-      else
-        entry->usebit = true;
 
-      if (read)
+      /* A clean victim can be relabeled right away. */
+      if (!buffer_cache_is_dirty (entry))
         {
-          disk_read (filesys_disk, sector, entry->data);
-          entry->dirty = false;
+          buffer_cache_delete (entry, true);
+          perf_inc (PERF_CACHE_EVICT);
+          break;
         }
-      entry->sector = sector;
+
+      /* Write back a dirty victim without holding the index lock.
+         The victim stays indexed under its old sector meanwhile,
+         so nobody reads stale data from the disk.  Retry
+         afterwards since the world may have changed. */
+      buffer_cache_pin (entry);
+      lock_release (&buffer_cache_lock);
+      lock_acquire (&entry->lock);
+      volume_write (entry->sector, entry->data, 1);
+      buffer_cache_set_dirty (entry, false);
+      buffer_cache_release (entry);
+      lock_acquire (&buffer_cache_lock);
+    }
+
+  buffer_cache_relabel (entry, sector);
+  lock_release (&buffer_cache_lock);
+
+  /* Fill the entry.  Other threads looking for SECTOR wait on
+     the entry lock until we are done. */
+  if (read)
+    volume_read (sector, entry->data, 1);
+  return entry;
+}
+
+/* Returns the buffer cache entry of SECTOR, pinned, for a
+   batched transfer, without waiting or disk I/O.  If SECTOR was
+   not cached, the entry is relabeled for it, with its lock held
+   and its data yet to be filled, and *MISS is set to true.
+   Returns NULL if an entry would take waiting for one to be
+   unpinned or writing back a dirty victim, or if the caller
+   already holds SECTOR's entry lock. */
+static struct buffer_cache_entry *
+buffer_cache_grab (disk_sector_t sector, bool *miss)
+{
+  struct buffer_cache_entry *entry;
+
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  entry = buffer_cache_find (sector);
+  if (entry != NULL)
+    {
+      if (lock_held_by_current_thread (&entry->lock))
+        return NULL;
+      buffer_cache_touch (entry);
+      buffer_cache_pin (entry);
+      perf_inc (PERF_CACHE_HIT);
+      *miss = false;
+      return entry;
     }
 
+  entry = buffer_cache_get_empty ();
+#ifdef VM
+  if (entry == NULL && buffer_cache_grow ())
+    entry = buffer_cache_get_empty ();
+#endif
+  if (entry != NULL)
+    {
+      entry->usebit = true;
+      bitmap_reset (buffer_cache_accessed, entry - buffer_cache);
+    }
+  else
+    {
+      entry = buffer_cache_to_evict ();
+      if (entry == NULL || buffer_cache_is_dirty (entry))
+        return NULL;
+      buffer_cache_delete (entry, true);
+      perf_inc (PERF_CACHE_EVICT);
+    }
+  buffer_cache_relabel (entry, sector);
+  *miss = true;
   return entry;
 }
+
+/* Records a reference to ENTRY, which was found in the index,
+   for the replacement policy. */
+static void
+buffer_cache_touch (struct buffer_cache_entry *entry UNUSED)
+{
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+#ifdef CACHE_2Q
+  if (entry->hot)
+    {
+      list_remove (&entry->queue_elem);
+      list_push_back (&buffer_cache_hot, &entry->queue_elem);
+    }
+#endif
+}
+
+/* Relabels ENTRY, which is neither indexed nor pinned, for
+   SECTOR, and returns with it pinned and its lock held.  Nobody
+   else holds the lock since the entry was neither in use nor
+   pinned. */
+static void
+buffer_cache_relabel (struct buffer_cache_entry *entry, disk_sector_t sector)
+{
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  perf_inc (PERF_CACHE_MISS);
+  trace (TRACE_CACHE_MISS, sector);
+  entry->sector = sector;
+  buffer_cache_set_dirty (entry, false);
+  entry->owner = NO_OWNER;
+  buffer_cache_insert (entry);
+  buffer_cache_pin (entry);
+  lock_acquire (&entry->lock);
+}
+
+/* Marks ENTRY as holding metadata, moving it to the hot queue. */
+static void
+buffer_cache_set_meta (struct buffer_cache_entry *entry)
+{
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  if (entry->meta)
+    return;
+  entry->meta = true;
+#ifdef CACHE_2Q
+  if (!entry->hot)
+    {
+      list_remove (&entry->queue_elem);
+      buffer_cache_cold_cnt--;
+      entry->hot = true;
+      list_push_back (&buffer_cache_hot, &entry->queue_elem);
+    }
+#endif
+}
+
+/* Transfers a batch of the CNT segments SEGS between the cache
+   and the caller's buffers, writing into the cache if WRITE is
+   true, and returns the number of segments transferred, at
+   least 1.
+
+   The batch is as many segments, up to CACHE_SEG_MAX or an
+   eighth of the cache, as have entries to be had at once under
+   the index lock.  The cap leaves entries for others to fetch
+   while the batch is pinned, such as a fault handler paging in
+   the caller's buffer in the middle of a copy.  The misses
+   among them are filled and released before any other entry
+   lock is taken, and the rest are then copied one at a time
+   under their locks, so that no thread holds an entry lock while
+   it waits for another. */
+static size_t
+buffer_cache_transfer (const struct cache_seg *segs, size_t cnt, bool write,
+                       disk_sector_t owner, bool meta)
+{
+  struct buffer_cache_entry *entries[CACHE_SEG_MAX];
+  struct disk_request reqs[CACHE_SEG_MAX];
+  bool miss[CACHE_SEG_MAX];
+  bool done[CACHE_SEG_MAX];
+  size_t n, i;
+
+  if (cnt > CACHE_SEG_MAX)
+    cnt = CACHE_SEG_MAX;
+  if (cnt > buffer_cache_cnt / 8)
+    cnt = buffer_cache_cnt / 8 > 0 ? buffer_cache_cnt / 8 : 1;
+
+  lock_acquire (&buffer_cache_lock);
+  for (n = 0; n < cnt; n++)
+    {
+      ASSERT (segs[n].ofs + segs[n].size <= DISK_SECTOR_SIZE);
+      miss[n] = done[n] = false;
+      entries[n] = NULL;
+      if (segs[n].sector == 0)
+        {
+          /* A hole. */
+          ASSERT (!write);
+          continue;
+        }
+      entries[n] = buffer_cache_grab (segs[n].sector, &miss[n]);
+      if (entries[n] == NULL)
+        break;
+    }
+  lock_release (&buffer_cache_lock);
+
+  /* Getting the first entry may take waiting, which the
+     single-sector path does. */
+  if (n == 0)
+    {
+      const struct cache_seg *seg = &segs[0];
+
+      if (!write)
+        buffer_cache_read_at (seg->sector, seg->addr, seg->ofs, seg->size);
+      else if (seg->size == DISK_SECTOR_SIZE)
+        buffer_cache_write (seg->sector, seg->addr);
+      else
+        buffer_cache_write_at (seg->sector, seg->addr, seg->ofs, seg->size);
+      if (meta)
+        buffer_cache_mark_meta (seg->sector);
+      else if (write)
+        buffer_cache_set_owner (seg->sector, owner);
+      return 1;
+    }
+
+  /* Fill the misses, submitting the reads together.  A sector
+     written whole is not read. */
+  for (i = 0; i < n; i++)
+    if (miss[i] && (!write || segs[i].size < DISK_SECTOR_SIZE))
+      {
+        volume_request_init (&reqs[i], segs[i].sector, entries[i]->data, 1,
+                             false);
+        disk_submit_sync (&reqs[i]);
+      }
+  for (i = 0; i < n; i++)
+    if (miss[i])
+      {
+        if (!write || segs[i].size < DISK_SECTOR_SIZE)
+          disk_wait (&reqs[i]);
+        else
+          {
+            memcpy (entries[i]->data, segs[i].addr, DISK_SECTOR_SIZE);
+            buffer_cache_set_dirty (entries[i], true);
+            done[i] = true;
+          }
+        lock_release (&entries[i]->lock);
+      }
+
+  /* Copy. */
+  for (i = 0; i < n; i++)
+    {
+      const struct cache_seg *seg = &segs[i];
+      struct buffer_cache_entry *entry = entries[i];
+
+      if (entry == NULL)
+        memset (seg->addr, 0, seg->size);
+      else if (!done[i])
+        {
+          lock_acquire (&entry->lock);
+          if (write)
+            {
+              memcpy (entry->data + seg->ofs, seg->addr, seg->size);
+              buffer_cache_set_dirty (entry, true);
+            }
+          else
+            memcpy (seg->addr, entry->data + seg->ofs, seg->size);
+          lock_release (&entry->lock);
+        }
+    }
+
+  lock_acquire (&buffer_cache_lock);
+  for (i = 0; i < n; i++)
+    if (entries[i] != NULL)
+      {
+        bitmap_mark (buffer_cache_accessed, entries[i] - buffer_cache);
+        if (meta)
+          buffer_cache_set_meta (entries[i]);
+        else if (write)
+          entries[i]->owner = owner;
+        buffer_cache_unpin (entries[i]);
+      }
+  lock_release (&buffer_cache_lock);
+  return n;
+}
+
+/* Adds SECTORS_PER_PAGE new entries using PAGE for their data
+   to the end of the buffer cache array and the free list. */
+static void
+buffer_cache_add_page (uint8_t *page)
+{
+  ASSERT (page != NULL);
+  ASSERT (buffer_cache_cnt + SECTORS_PER_PAGE <= buffer_cache_max);
+
+  size_t i;
+  for (i = 0; i < SECTORS_PER_PAGE; i++)
+    {
+      struct buffer_cache_entry *entry = buffer_cache + buffer_cache_cnt++;
+      entry->usebit = false;
+      entry->pin_cnt = 0;
+      entry->data = page + i * DISK_SECTOR_SIZE;
+      lock_init (&entry->lock);
+      list_push_back (&buffer_cache_free_list, &entry->free_elem);
+    }
+}
+
+#ifdef VM
+/* Adds a page of entries taken from the user pool to the buffer
+   cache.  Returns true if successful, false if the cache is at
+   its maximum size or free user pages run low. */
+static bool
+buffer_cache_grow (void)
+{
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  if (buffer_cache_cnt >= buffer_cache_max || frame_low ())
+    return false;
+  uint8_t *page = palloc_get_page (PAL_USER);
+  if (page == NULL)
+    return false;
+  buffer_cache_add_page (page);
+  return true;
+}
+
+/* Gives the last page of entries taken from the user pool back
+   to it, writing back its dirty entries.  Called by the frame
+   allocator when it runs out of user pages.  Returns true if a
+   page was freed, false otherwise. */
+bool
+buffer_cache_shrink (void)
+{
+  struct buffer_cache_entry *first;
+  size_t i;
+
+  lock_acquire (&buffer_cache_lock);
+  if (buffer_cache_cnt <= buffer_cache_size)
+    {
+      lock_release (&buffer_cache_lock);
+      return false;
+    }
+  first = buffer_cache + buffer_cache_cnt - SECTORS_PER_PAGE;
+
+  /* Write back dirty entries. */
+  for (i = 0; i < SECTORS_PER_PAGE; i++)
+    {
+      struct buffer_cache_entry *entry = first + i;
+      if (!entry->usebit || entry->pin_cnt > 0 || entry->meta
+          || !buffer_cache_is_dirty (entry))
+        continue;
+      buffer_cache_pin (entry);
+      lock_release (&buffer_cache_lock);
+      lock_acquire (&entry->lock);
+      volume_write (entry->sector, entry->data, 1);
+      buffer_cache_set_dirty (entry, false);
+      buffer_cache_release (entry);
+      lock_acquire (&buffer_cache_lock);
+    }
+
+  /* Give up if the page became busy meanwhile. */
+  if (first + SECTORS_PER_PAGE != buffer_cache + buffer_cache_cnt)
+    {
+      lock_release (&buffer_cache_lock);
+      return false;
+    }
+  for (i = 0; i < SECTORS_PER_PAGE; i++)
+    if (first[i].usebit
+        && (first[i].pin_cnt > 0 || buffer_cache_is_dirty (&first[i])))
+      {
+        lock_release (&buffer_cache_lock);
+        return false;
+      }
+
+  /* Drop the entries and free the page. */
+  for (i = 0; i < SECTORS_PER_PAGE; i++)
+    {
+      struct buffer_cache_entry *entry = first + i;
+      if (entry->usebit)
+        buffer_cache_delete (entry, false);
+      else
+        list_remove (&entry->free_elem);
+      entry->usebit = false;
+    }
+  buffer_cache_cnt -= SECTORS_PER_PAGE;
+  palloc_free_page (first->data);
+  first->data = NULL;
+  lock_release (&buffer_cache_lock);
+  return true;
+}
+#endif
+
+/* Returns true if ENTRY is dirty, false otherwise. */
+static bool
+buffer_cache_is_dirty (const struct buffer_cache_entry *entry)
+{
+  return bitmap_test (buffer_cache_dirty, entry - buffer_cache);
+}
+
+/* Sets the dirty bit of ENTRY to DIRTY. */
+static void
+buffer_cache_set_dirty (struct buffer_cache_entry *entry, bool dirty)
+{
+  size_t idx = entry - buffer_cache;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (bitmap_test (buffer_cache_dirty, idx) != dirty)
+    {
+      bitmap_set (buffer_cache_dirty, idx, dirty);
+      if (dirty)
+        buffer_cache_dirty_cnt++;
+      else
+        buffer_cache_dirty_cnt--;
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns the index of the first dirty entry at or after START,
+   or BITMAP_ERROR if there is none. */
+static size_t
+buffer_cache_next_dirty (size_t start)
+{
+  return bitmap_scan (buffer_cache_dirty, start, 1, true);
+}
+
+/* Pins ENTRY so that it will not be evicted. */
+static void
+buffer_cache_pin (struct buffer_cache_entry *entry)
+{
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  entry->pin_cnt++;
+}
+
+/* Unpins ENTRY and wakes up a waiter for an evictable entry. */
+static void
+buffer_cache_unpin (struct buffer_cache_entry *entry)
+{
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+  ASSERT (entry->pin_cnt > 0);
+
+  if (--entry->pin_cnt == 0)
+    cond_signal (&buffer_cache_unpinned, &buffer_cache_lock);
+}
+
+/* Releases the lock of ENTRY obtained by buffer_cache_fetch()
+   and unpins it. */
+static void
+buffer_cache_release (struct buffer_cache_entry *entry)
+{
+  lock_release (&entry->lock);
+
+  lock_acquire (&buffer_cache_lock);
+  buffer_cache_unpin (entry);
+  lock_release (&buffer_cache_lock);
+}
+
+/* Writes back CNT pinned ENTRIES, sorted by sector, that are
+   still dirty and unpins them.  If WAIT is false, entries whose
+   locks are held by others are skipped rather than waited for.
+   Returns the number of entries written. */
+static size_t
+buffer_cache_flush_batch (struct buffer_cache_entry **entries, size_t cnt,
+                          bool wait)
+{
+  struct disk_request reqs[FLUSH_BATCH];
+  bool locked[FLUSH_BATCH];
+  bool submitted[FLUSH_BATCH];
+  size_t written = 0;
+  size_t i;
+
+  ASSERT (cnt <= FLUSH_BATCH);
+
+  /* Submit writes of the entries we can lock.  A thread holding
+     an entry lock may fault on a user buffer and need another
+     entry, so we never wait for an entry lock while holding one. */
+  for (i = 0; i < cnt; i++)
+    {
+      struct buffer_cache_entry *entry = entries[i];
+      if (i == 0 && wait)
+        {
+          lock_acquire (&entry->lock);
+          locked[i] = true;
+        }
+      else
+        locked[i] = lock_try_acquire (&entry->lock);
+      submitted[i] = locked[i] && buffer_cache_is_dirty (entry);
+      if (submitted[i])
+        {
+          volume_request_init (&reqs[i], entry->sector, entry->data, 1,
+                               true);
+          disk_submit (&reqs[i]);
+        }
+    }
+
+  for (i = 0; i < cnt; i++)
+    if (locked[i])
+      {
+        if (submitted[i])
+          {
+            disk_wait (&reqs[i]);
+            buffer_cache_set_dirty (entries[i], false);
+            written++;
+          }
+        buffer_cache_release (entries[i]);
+      }
+
+  /* Write back the rest one by one. */
+  for (i = 0; i < cnt; i++)
+    if (!locked[i])
+      {
+        struct buffer_cache_entry *entry = entries[i];
+        if (!wait)
+          {
+            lock_acquire (&buffer_cache_lock);
+            buffer_cache_unpin (entry);
+            lock_release (&buffer_cache_lock);
+            continue;
+          }
+        lock_acquire (&entry->lock);
+        if (buffer_cache_is_dirty (entry))
+          {
+            volume_write (entry->sector, entry->data, 1);
+            buffer_cache_set_dirty (entry, false);
+            written++;
+          }
+        buffer_cache_release (entry);
+      }
+  return written;
+}
+
+/* Commits CNT pinned ENTRIES holding metadata, sorted by sector,
+   that are still dirty to the journal as one transaction, writes
+   them in place, and unpins them.  CNT must not exceed
+   JOURNAL_BLOCKS.  Entry locks are taken in sector order, and no
+   thread holding a metadata entry lock waits for another. */
+static void
+buffer_cache_commit (struct buffer_cache_entry **entries, size_t cnt)
+{
+  static disk_sector_t sectors[JOURNAL_BLOCKS];
+  static void *data[JOURNAL_BLOCKS];
+  struct disk_request reqs[FLUSH_BATCH];
+  size_t logged = 0;
+  size_t i, j;
+
+  ASSERT (cnt <= JOURNAL_BLOCKS);
+
+  for (i = 0; i < cnt; i++)
+    {
+      lock_acquire (&entries[i]->lock);
+      if (buffer_cache_is_dirty (entries[i]))
+        {
+          sectors[logged] = entries[i]->sector;
+          data[logged++] = entries[i]->data;
+        }
+    }
+  journal_log (sectors, data, logged);
+
+  /* Write in place. */
+  for (i = 0; i < logged; i += FLUSH_BATCH)
+    {
+      size_t batch = logged - i < FLUSH_BATCH ? logged - i : FLUSH_BATCH;
+      for (j = 0; j < batch; j++)
+        {
+          volume_request_init (&reqs[j], sectors[i + j], data[i + j], 1,
+                               true);
+          disk_submit (&reqs[j]);
+        }
+      for (j = 0; j < batch; j++)
+        disk_wait (&reqs[j]);
+    }
+  journal_clear ();
+
+  for (i = 0; i < cnt; i++)
+    {
+      buffer_cache_set_dirty (entries[i], false);
+      buffer_cache_release (entries[i]);
+    }
+}
+
+/* Returns true if more than DIRTY_BACKGROUND_PCT percent of the
+   cache is dirty. */
+static bool
+buffer_cache_over_background (void)
+{
+  return (buffer_cache_dirty_cnt * 100
+          > buffer_cache_cnt * DIRTY_BACKGROUND_PCT);
+}
+
+/* Schedules the periodic write-behind.  Scheduling it twice is
+   harmless, since the work item is queued only once. */
+static void
+buffer_cache_start_flush_back (void)
+{
+  flush_back_started = true;
+  flush_back_last = timer_ticks ();
+  work_queue_delayed (&system_wq, &flush_back_work, FLUSH_BACK_INTERVAL);
+}
+
+/* Called after each write into the cache.  Starts write-behind
+   on the first write, and runs it ahead of its schedule once
+   DIRTY_BACKGROUND_PCT percent of the cache is dirty, so that
+   readers rarely have to write back a dirty victim before they
+   can fetch.  Past DIRTY_THROTTLE_PCT percent, write-behind is
+   not keeping up, and the writer writes back file data a batch
+   at a time itself until the cache is below the limit again, so
+   that a heavy writer is slowed to the disk's pace instead of
+   everyone else. */
+static void
+buffer_cache_balance_dirty (void)
+{
+  if (!flush_back_started)
+    buffer_cache_start_flush_back ();
+  if (buffer_cache_over_background ())
+    work_expedite (&flush_back_work);
+  while (buffer_cache_dirty_cnt * 100 > buffer_cache_cnt * DIRTY_THROTTLE_PCT
+         && buffer_cache_throttle ())
+    continue;
+}
+
+/* Writes back up to FLUSH_BATCH dirty entries that hold file
+   data, skipping those locked by others, since the caller may be
+   writing from a page fault taken while holding an entry lock.
+   Returns false if none could be written.  Dirty metadata is
+   left to write-behind, which commits it to the journal first.
+   Does not take buffer_cache_flush_lock, which write-behind holds
+   while it waits for file system operations, such as the
+   caller's, to finish. */
+static bool
+buffer_cache_throttle (void)
+{
+  struct buffer_cache_entry *entries[FLUSH_BATCH];
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire (&buffer_cache_lock);
+  for (i = buffer_cache_next_dirty (0);
+       i < buffer_cache_cnt && cnt < FLUSH_BATCH;
+       i = buffer_cache_next_dirty (i + 1))
+    {
+      struct buffer_cache_entry *entry = buffer_cache + i;
+      if (entry->usebit && !entry->meta)
+        {
+          buffer_cache_pin (entry);
+          entries[cnt++] = entry;
+        }
+    }
+  lock_release (&buffer_cache_lock);
+  if (cnt == 0)
+    return false;
+
+  perf_inc (PERF_CACHE_THROTTLE);
+  qsort (entries, cnt, sizeof *entries, buffer_cache_compare);
+  return buffer_cache_flush_batch (entries, cnt, false) > 0;
+}
+
+/* Orders pointers to buffer cache entries by sector. */
+static int
+buffer_cache_compare (const void *a_, const void *b_)
+{
+  const struct buffer_cache_entry *a = *(struct buffer_cache_entry **) a_;
+  const struct buffer_cache_entry *b = *(struct buffer_cache_entry **) b_;
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Returns a hash value for buffer cache entry E. */
+static unsigned
+buffer_cache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  struct buffer_cache_entry *entry = hash_entry (e, struct buffer_cache_entry,
+                                                 elem);
+  return hash_int (entry->sector);
+}
+
+/* Returns true if buffer cache entry E1 precedes E2. */
+static bool
+buffer_cache_less (const struct hash_elem *e1, const struct hash_elem *e2,
+                   void *aux UNUSED)
+{
+  struct buffer_cache_entry *entry1 = hash_entry (e1,
+                                                  struct buffer_cache_entry,
+                                                  elem);
+  struct buffer_cache_entry *entry2 = hash_entry (e2,
+                                                  struct buffer_cache_entry,
+                                                  elem);
+  return entry1->sector < entry2->sector;
+}
+
+#ifdef CACHE_2Q
+/* Returns a hash value for ghost queue entry E. */
+static unsigned
+buffer_cache_ghost_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  struct buffer_cache_ghost *ghost = hash_entry (e, struct buffer_cache_ghost,
+                                                 elem);
+  return hash_int (ghost->sector);
+}
+
+/* Returns true if ghost queue entry E1 precedes E2. */
+static bool
+buffer_cache_ghost_less (const struct hash_elem *e1,
+                         const struct hash_elem *e2, void *aux UNUSED)
+{
+  struct buffer_cache_ghost *ghost1 = hash_entry (e1,
+                                                  struct buffer_cache_ghost,
+                                                  elem);
+  struct buffer_cache_ghost *ghost2 = hash_entry (e2,
+                                                  struct buffer_cache_ghost,
+                                                  elem);
+  return ghost1->sector < ghost2->sector;
+}
+#endif
@@ -1,17 +1,53 @@
 #ifndef FILESYS_CACHE_H
 #define FILESYS_CACHE_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "devices/disk.h"
 #include "filesys/off_t.h"
 
+/* A piece of a scatter/gather transfer through the buffer
+   cache: SIZE bytes at byte OFS of SECTOR, to or from ADDR.  A
+   SECTOR of 0 stands for a hole, which reads as zeros. */
+struct cache_seg
+  {
+    disk_sector_t sector;       /* Sector, or 0 for a hole. */
+    void *addr;                 /* Caller's buffer. */
+    uint16_t ofs;               /* Byte offset within SECTOR. */
+    uint16_t size;              /* Number of bytes. */
+  };
+
+/* Most segments transferred as one batch. */
+#define CACHE_SEG_MAX 16
+
+/* Buffer cache size in sectors. */
+extern size_t buffer_cache_size;
+extern size_t buffer_cache_max;
+extern unsigned buffer_cache_flush_idle;
+
 void buffer_cache_init (void);
 void buffer_cache_done (void);
+void buffer_cache_sync (disk_sector_t owner, bool meta);
 void buffer_cache_read (disk_sector_t, void *);
 void buffer_cache_read_at (disk_sector_t, void *, off_t, size_t);
+void buffer_cache_read_direct (disk_sector_t, void *, size_t cnt);
 void buffer_cache_write (disk_sector_t, const void *);
+void buffer_cache_write_direct (disk_sector_t, const void *, size_t cnt,
+                                disk_sector_t owner);
 void buffer_cache_write_at (disk_sector_t, const void *, off_t, size_t);
+void buffer_cache_read_multiple (const struct cache_seg *, size_t cnt,
+                                 bool meta);
+void buffer_cache_write_multiple (const struct cache_seg *, size_t cnt,
+                                  disk_sector_t owner, bool meta);
 void buffer_cache_remove (disk_sector_t);
+bool buffer_cache_contains (disk_sector_t);
+bool buffer_cache_equal (disk_sector_t, const void *, off_t, size_t);
+void buffer_cache_mark_meta (disk_sector_t);
+void buffer_cache_set_owner (disk_sector_t, disk_sector_t owner);
 void buffer_cache_read_ahead (disk_sector_t);
+#ifdef VM
+bool buffer_cache_shrink (void);
+#endif
 
 #endif /* filesys/cache.h */
@@ -0,0 +1,171 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+
+/* Number of names cached, and of buckets in the index. */
+#define DCACHE_SIZE 128
+#define DCACHE_BUCKETS 64
+
+/* Directory entry cache entry.
+   Maps NAME in the directory whose inode is at DIR to the inode
+   sector of the file named, or to DCACHE_NONE if there is no
+   such file.  Only SECTOR and ACCESSED change once the entry is
+   in the index.  An entry is allocated with just the room its
+   name needs. */
+struct dcache_entry
+  {
+    disk_sector_t dir;                  /* Directory inode sector. */
+    disk_sector_t sector;               /* File inode sector. */
+    bool accessed;                      /* Looked up since last scan? */
+    struct list_elem elem;              /* Element in index bucket. */
+    struct rcu_head rcu;                /* Deferred free. */
+    char name[];                        /* Null terminated file name. */
+  };
+
+/* Entries, by slot, and an index of them by directory and name.
+   Lookups walk the index without a lock, under RCU, since they
+   far outnumber insertions: an entry is published whole, and an
+   entry replaced is freed only once no lookup may be on it.
+   Replacement is by the clock algorithm, whose hand sweeps the
+   slots, because lookups cannot reorder a list of entries by
+   use. */
+static struct dcache_entry *dcache[DCACHE_SIZE];
+static struct list dcache_index[DCACHE_BUCKETS];
+static size_t dcache_hand;
+
+/* Serializes changes to the entries, index and hand.
+   Callers hold the directory lock of the directory named in the
+   entries they look up or insert, so entries change in the same
+   order as the directories. */
+static struct lock dcache_lock;
+
+static struct dcache_entry *dcache_find (disk_sector_t, const char *);
+static struct list *dcache_bucket (disk_sector_t, const char *);
+static rcu_func dcache_free;
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  lock_init (&dcache_lock);
+  lock_set_name (&dcache_lock, "dcache");
+  for (i = 0; i < DCACHE_BUCKETS; i++)
+    list_init (&dcache_index[i]);
+  dcache_hand = 0;
+}
+
+/* Looks up NAME in the directory whose inode is at DIR.
+   Returns true and sets *SECTORP to the inode sector of the file,
+   or to DCACHE_NONE if there is no such file, if cached.
+   Returns false otherwise. */
+bool
+dcache_lookup (disk_sector_t dir, const char *name, disk_sector_t *sectorp)
+{
+  struct dcache_entry *entry;
+
+  rcu_read_lock ();
+  entry = dcache_find (dir, name);
+  if (entry != NULL)
+    {
+      entry->accessed = true;
+      *sectorp = entry->sector;
+    }
+  rcu_read_unlock ();
+  return entry != NULL;
+}
+
+/* Caches that NAME in the directory whose inode is at DIR names
+   the file whose inode is at SECTOR, or no file if SECTOR is
+   DCACHE_NONE, replacing an entry not looked up lately. */
+void
+dcache_insert (disk_sector_t dir, const char *name, disk_sector_t sector)
+{
+  struct dcache_entry *entry;
+  size_t size;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  entry = dcache_find (dir, name);
+  if (entry != NULL)
+    {
+      entry->sector = sector;
+      entry->accessed = true;
+      lock_release (&dcache_lock);
+      return;
+    }
+
+  size = strlen (name) + 1;
+  entry = malloc (sizeof *entry + size);
+  if (entry != NULL)
+    {
+      struct dcache_entry *old;
+
+      entry->dir = dir;
+      memcpy (entry->name, name, size);
+      entry->sector = sector;
+      entry->accessed = true;
+
+      /* Sweep to a slot that is empty or not looked up since the
+         hand last passed it. */
+      while ((old = dcache[dcache_hand]) != NULL && old->accessed)
+        {
+          old->accessed = false;
+          dcache_hand = (dcache_hand + 1) % DCACHE_SIZE;
+        }
+      if (old != NULL)
+        {
+          list_remove (&old->elem);
+          call_rcu (&old->rcu, dcache_free);
+        }
+      dcache[dcache_hand] = entry;
+      dcache_hand = (dcache_hand + 1) % DCACHE_SIZE;
+      rcu_list_push_front (dcache_bucket (dir, name), &entry->elem);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer if there
+   is none.  Must be called with dcache_lock held or in a
+   read-side critical section. */
+static struct dcache_entry *
+dcache_find (disk_sector_t dir, const char *name)
+{
+  struct list *bucket;
+  struct list_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  bucket = dcache_bucket (dir, name);
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
+    {
+      struct dcache_entry *entry = list_entry (e, struct dcache_entry, elem);
+      if (entry->dir == dir && !strcmp (entry->name, name))
+        return entry;
+    }
+  return NULL;
+}
+
+/* Returns the index bucket for NAME in DIR. */
+static struct list *
+dcache_bucket (disk_sector_t dir, const char *name)
+{
+  return &dcache_index[(hash_string (name) ^ hash_int (dir))
+                       % DCACHE_BUCKETS];
+}
+
+/* Frees the entry containing HEAD, once no lookup is on it. */
+static void
+dcache_free (struct rcu_head *head)
+{
+  free (list_entry (&head->elem, struct dcache_entry, rcu.elem));
+}
@@ -0,0 +1,14 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Sector cached for a name that does not exist. */
+#define DCACHE_NONE ((disk_sector_t) -1)
+
+void dcache_init (void);
+bool dcache_lookup (disk_sector_t, const char *, disk_sector_t *);
+void dcache_insert (disk_sector_t, const char *, disk_sector_t);
+
+#endif /* filesys/dcache.h */
@@ -0,0 +1,161 @@
+#include "filesys/defrag.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "threads/perf.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Online defragmenter.
+
+   Files whose blocks got scattered as they grew a little at a
+   time are moved, one at a time, into contiguous runs of free
+   blocks by inode_defrag(), so that they read sequentially
+   again.  A run walks the directory tree from the root and moves
+   up to DEFRAG_FILES files, then the next run follows after
+   defrag_interval seconds.  A run is skipped unless the disks
+   were idle since the last one, that is, no disk request was
+   made in between, since moving files competes with everything
+   else for the disk.
+
+   The walk runs in the SCHED_IDLE class, so that it uses only
+   time nobody else wants, but each file is moved at normal
+   priority: moving it holds off reads and writes of the file and
+   commits of the journal, which must not wait on an idle-class
+   thread while the CPU is busy. */
+
+/* Most files moved by a run. */
+#define DEFRAG_FILES 8
+
+/* Deepest directory walked, below the root. */
+#define DEFRAG_DEPTH 16
+
+/* Seconds between runs, or 0 to not defragment.  Set by kernel
+   command-line option "-defrag=SECS". */
+unsigned defrag_interval;
+
+/* Queue with the worker that runs the defragmenter, and the work
+   item of a run. */
+static struct workqueue defrag_wq;
+static struct work defrag_work;
+
+/* Disk requests made when the last run ended.  Only the worker
+   uses it. */
+static long long defrag_requests;
+
+/* Whether a run is under way and whether the defragmenter is
+   stopping, protected by defrag_lock. */
+static struct lock defrag_lock;
+static struct condition defrag_idle;
+static bool defrag_running;
+static bool defrag_stopping;
+
+static work_func defrag_run;
+static long long disk_requests (void);
+static size_t defrag_dir (struct dir *, int depth, size_t moved);
+
+/* Starts the defragmenter, unless defrag_interval is 0.  The
+   file system must be initialized. */
+void
+defrag_init (void)
+{
+  lock_init (&defrag_lock);
+  cond_init (&defrag_idle);
+  defrag_running = false;
+  defrag_stopping = false;
+  if (defrag_interval == 0)
+    return;
+
+  workqueue_init (&defrag_wq, "defrag", 1, SCHED_IDLE, PRI_MIN);
+  work_init (&defrag_work, defrag_run, NULL);
+  defrag_requests = -1;
+  work_queue_delayed (&defrag_wq, &defrag_work,
+                      (int64_t) defrag_interval * TIMER_FREQ);
+}
+
+/* Stops the defragmenter, waiting for a run under way to end. */
+void
+defrag_done (void)
+{
+  lock_acquire (&defrag_lock);
+  defrag_stopping = true;
+  while (defrag_running)
+    cond_wait (&defrag_idle, &defrag_lock);
+  lock_release (&defrag_lock);
+}
+
+/* Work function of a run. */
+static void
+defrag_run (void *aux UNUSED)
+{
+  lock_acquire (&defrag_lock);
+  if (defrag_stopping)
+    {
+      lock_release (&defrag_lock);
+      return;
+    }
+  defrag_running = true;
+  lock_release (&defrag_lock);
+
+  if (disk_requests () == defrag_requests)
+    defrag_dir (dir_open_root (), DEFRAG_DEPTH, 0);
+  defrag_requests = disk_requests ();
+
+  lock_acquire (&defrag_lock);
+  defrag_running = false;
+  cond_broadcast (&defrag_idle, &defrag_lock);
+  if (!defrag_stopping)
+    work_queue_delayed (&defrag_wq, &defrag_work,
+                        (int64_t) defrag_interval * TIMER_FREQ);
+  lock_release (&defrag_lock);
+}
+
+/* Returns the number of disk requests made so far. */
+static long long
+disk_requests (void)
+{
+  static struct perfstat stat;
+
+  perf_read (&stat);
+  return stat.counters[PERF_DISK_REQUESTS];
+}
+
+/* Moves the scattered files in DIR, and in the directories under
+   it down to DEPTH levels, until DEFRAG_FILES files have been
+   moved in all, counting the MOVED ones before, or the
+   defragmenter is stopping.  Closes DIR, which may be null.
+   Returns the number of files moved in all. */
+static size_t
+defrag_dir (struct dir *dir, int depth, size_t moved)
+{
+  char name[NAME_MAX + 1];
+
+  if (dir == NULL)
+    return moved;
+  while (moved < DEFRAG_FILES && !defrag_stopping
+         && dir_readdir (dir, name))
+    {
+      struct inode *inode;
+
+      if (!dir_lookup (dir, name, &inode))
+        continue;
+      if (inode_is_dir (inode))
+        {
+          if (depth > 0)
+            moved = defrag_dir (dir_open (inode), depth - 1, moved);
+          else
+            inode_close (inode);
+          continue;
+        }
+
+      thread_set_class (SCHED_NORMAL, PRI_DEFAULT);
+      if (inode_defrag (inode))
+        moved++;
+      inode_close (inode);
+      thread_set_class (SCHED_IDLE, PRI_MIN);
+    }
+  dir_close (dir);
+  return moved;
+}
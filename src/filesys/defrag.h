@@ -0,0 +1,10 @@
+#ifndef FILESYS_DEFRAG_H
+#define FILESYS_DEFRAG_H
+
+/* Seconds between defragmenter runs, or 0 for none. */
+extern unsigned defrag_interval;
+
+void defrag_init (void);
+void defrag_done (void);
+
+#endif /* filesys/defrag.h */
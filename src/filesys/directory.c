@@ -1,9 +1,12 @@
 #include "filesys/directory.h"
+#include <dirent.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/mount.h"
 #include "threads/malloc.h"
 
 /* A directory. */
@@ -13,20 +16,99 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
-/* A single directory entry. */
-struct dir_entry 
+/* Directories are made of blocks of entries, each filling a
+   sector.  Each entry is as long as its name, so that short
+   names, the common case, take little room and long ones fit
+   at all, and the entries of a block are packed one after
+   another behind a summary of the space they take.  Removing an
+   entry only marks it free, so that the entries after it stay
+   where readdir() positions point; the free space of a block is
+   reclaimed by moving its entries down only when a new entry
+   does not fit otherwise.
+
+   Directories start out as a single block.  One that outgrows it
+   is turned into a hashed directory: its first sector holds a
+   header, and each following sector is a bucket, a block of the
+   entries whose names hash to it. */
+
+/* Directory entry, as stored in a block, followed by its name,
+   which is not null terminated. */
+struct dir_entry
   {
     disk_sector_t inode_sector;         /* Sector number of header. */
-    char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
+    uint8_t name_len;                   /* Length of the name. */
+  } __attribute__ ((packed));
+
+/* Bytes taken by an entry whose name is NAME_LEN long. */
+#define ENTRY_SIZE(NAME_LEN) (sizeof (struct dir_entry) + (NAME_LEN))
+
+/* Block of entries, filling one sector. */
+struct dir_block
+  {
+    uint16_t used;                      /* Bytes of DATA holding entries. */
+    uint16_t free;                      /* Bytes of those in free entries. */
+    uint8_t data[DISK_SECTOR_SIZE - 4]; /* Entries, packed. */
+  };
+
+/* Byte offset of the entries within a block. */
+#define BLOCK_HEADER offsetof (struct dir_block, data)
+
+/* Identifies a hashed directory.  A single block never starts
+   with it, because it never uses that many bytes. */
+#define DIR_HASH_MAGIC 0x44495248
+
+/* Maximum number of buckets. */
+#define BUCKET_MAX 4096
+
+/* Header of a hashed directory, at its start. */
+struct dir_header
+  {
+    disk_sector_t magic;                /* DIR_HASH_MAGIC. */
+    uint32_t bucket_cnt;                /* Number of buckets. */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+static bool lookup (const struct dir *, const char *name,
+                    struct dir_block *, size_t *blockp, size_t *ofsp);
+static size_t read_entries (const struct dir *, off_t *pos,
+                            struct dir_block *, struct dirent *,
+                            size_t cnt);
+static bool read_next (const struct dir *, off_t *pos, struct dir_block *,
+                       char name[NAME_MAX + 1]);
+static bool read_header (const struct dir *, struct dir_header *);
+static off_t block_ofs (size_t block);
+static size_t name_bucket (const char *name, size_t bucket_cnt);
+static bool read_block (const struct dir *, size_t, struct dir_block *);
+static bool write_block (struct dir *, size_t, const struct dir_block *);
+static size_t read_entry (const struct dir_block *, size_t ofs,
+                          struct dir_entry *, char name[NAME_MAX + 1]);
+static bool block_find (const struct dir_block *, const char *name,
+                        size_t *ofsp);
+static bool block_add (struct dir_block *, const char *name,
+                       disk_sector_t);
+static void block_remove (struct dir_block *, size_t ofs);
+static void block_compact (struct dir_block *);
+static bool make_hashed (struct dir *, const struct dir_block *);
+static bool grow_hashed (struct dir *, struct dir_header *);
+
+/* Creates a directory in the given SECTOR, holding entries "."
+   for itself and ".." for the directory whose inode is in
+   PARENT_SECTOR.
+   Returns true if successful, false on failure. */
 bool
-dir_create (disk_sector_t sector, size_t entry_cnt) 
+dir_create (disk_sector_t sector, disk_sector_t parent_sector)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir *dir;
+  bool success;
+
+  if (!inode_create (sector, 0, true))
+    return false;
+  dir = dir_open (inode_open (sector));
+  success = (dir != NULL
+             && dir_add (dir, ".", sector)
+             && dir_add (dir, "..", parent_sector));
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -39,6 +121,7 @@ dir_open (struct inode *inode)
     {
       dir->inode = inode;
       dir->pos = 0;
+      inode_mark_meta (inode);
       return dir;
     }
   else
@@ -83,51 +166,92 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
-   If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+
+/* Searches DIR for a file with the given NAME, reading blocks
+   into B.  If successful, returns true, leaving the block that
+   holds the entry in B, and sets *BLOCKP to the block's number
+   and *OFSP to the entry's offset among its entries.
+   Otherwise, returns false. */
 static bool
-lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+lookup (const struct dir *dir, const char *name, struct dir_block *b,
+        size_t *blockp, size_t *ofsp)
 {
-  struct dir_entry e;
-  size_t ofs;
-  
+  struct dir_header h;
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  /* Search the bucket of NAME only in a hashed directory. */
+  if (read_header (dir, &h))
+    *blockp = name_bucket (name, h.bucket_cnt) + 1;
+  else
+    *blockp = 0;
+  return read_block (dir, *blockp, b) && block_find (b, name, ofsp);
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.  A mount point
+   is found as the root of the file system mounted on it, whose
+   ".." is the mount point's.
+   Answers from the directory entry cache when possible, and
+   caches the result of a search otherwise, including a miss. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  disk_sector_t dir_sector;
+  disk_sector_t sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  dir_sector = inode_get_inumber (dir->inode);
+  sector = mount_point (dir_sector);
+  if (sector != dir_sector && !strcmp (name, ".."))
+    {
+      struct dir *mount_dir = dir_open (inode_open (sector));
+      bool found = mount_dir != NULL && dir_lookup (mount_dir, name, inode);
+
+      dir_close (mount_dir);
+      if (!found)
+        *inode = NULL;
+      return found;
+    }
+
+  inode_lock_dir (dir->inode);
+
+  /* A removed directory holds nothing, not even "." and "..". */
+  if (inode_is_removed (dir->inode))
+    {
+      inode_unlock_dir (dir->inode);
+      *inode = NULL;
+      return false;
+    }
+
+  if (!dcache_lookup (dir_sector, name, &sector))
+    {
+      struct dir_block *b = malloc (sizeof *b);
+      size_t block, ofs;
+
+      sector = DCACHE_NONE;
+      if (b != NULL)
+        {
+          if (lookup (dir, name, b, &block, &ofs))
+            {
+              struct dir_entry e;
+
+              read_entry (b, ofs, &e, NULL);
+              sector = e.inode_sector;
+            }
+          dcache_insert (dir_sector, name, sector);
+          free (b);
+        }
+    }
+  *inode = (sector != DCACHE_NONE
+            ? inode_open (mount_covering (sector)) : NULL);
+  inode_unlock_dir (dir->inode);
 
   return *inode != NULL;
 }
@@ -141,8 +265,10 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) 
 {
-  struct dir_entry e;
-  off_t ofs;
+  struct dir_block *b;
+  struct dir_header h;
+  disk_sector_t sector;
+  size_t block, ofs;
   bool success = false;
   
   ASSERT (dir != NULL);
@@ -151,49 +277,76 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
   /* Check NAME for validity. */
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  /* Check that DIR is not removed and NAME is not in use, without
+     searching DIR if the directory entry cache knows there is no
+     such file. */
+  inode_lock_dir (dir->inode);
+  if (inode_is_removed (dir->inode))
+    goto done;
+  if ((!dcache_lookup (inode_get_inumber (dir->inode), name, &sector)
+       || sector != DCACHE_NONE)
+      && lookup (dir, name, b, &block, &ofs))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  /* Add to the block of NAME, making room until it fits: a single
+     block that is full turns into a hashed directory, and a
+     hashed directory whose bucket is full gets twice the
+     buckets. */
+  for (;;)
+    {
+      bool hashed = read_header (dir, &h);
+
+      block = hashed ? name_bucket (name, h.bucket_cnt) + 1 : 0;
+      if (!read_block (dir, block, b))
+        goto done;
+      if (block_add (b, name, inode_sector))
+        break;
+      if (hashed ? !grow_hashed (dir, &h) : !make_hashed (dir, b))
+        goto done;
+    }
+  success = write_block (dir, block, b);
 
  done:
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  inode_unlock_dir (dir->inode);
+  free (b);
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME, NAME is "." or "..", or
+   NAME is a directory that is not empty or is a mount point. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_block *b;
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool is_dir = false;
   bool success = false;
-  off_t ofs;
+  size_t block, ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  inode_lock_dir (dir->inode);
+  if (!lookup (dir, name, b, &block, &ofs))
+    goto done;
+  read_entry (b, ofs, &e, NULL);
+  if (mount_covering (e.inode_sector) != e.inode_sector)
     goto done;
 
   /* Open inode. */
@@ -201,36 +354,418 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* Only empty directories go.  Holding the directory lock of one
+     until it is removed keeps files from being added to it
+     meanwhile.  Checking reads the directory into B, so the
+     block of the entry is read again after. */
+  is_dir = inode_is_dir (inode);
+  if (is_dir)
+    {
+      struct dir child = { inode, 0 };
+      char child_name[NAME_MAX + 1];
+      off_t pos = 0;
+
+      inode_lock_dir (inode);
+      if (read_next (&child, &pos, b, child_name)
+          || !read_block (dir, block, b))
+        goto done;
+    }
+
   /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  block_remove (b, ofs);
+  if (!write_block (dir, block, b))
     goto done;
 
   /* Remove inode. */
   inode_remove (inode);
+  dcache_insert (inode_get_inumber (dir->inode), name, DCACHE_NONE);
   success = true;
 
  done:
+  if (is_dir)
+    inode_unlock_dir (inode);
+  inode_unlock_dir (dir->inode);
   inode_close (inode);
+  free (b);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries or memory is short.  "." and ".." are
+   skipped. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
-  struct dir_entry e;
+  struct dir_block *b = malloc (sizeof *b);
+  bool success;
+
+  if (b == NULL)
+    return false;
+  inode_lock_dir (dir->inode);
+  success = read_next (dir, &dir->pos, b, name);
+  inode_unlock_dir (dir->inode);
+  free (b);
+  return success;
+}
+
+/* Reads the next directory entry at or after byte offset *POS in
+   the directory INODE, as dir_readdir() does, and advances *POS
+   past it.  Returns true if successful, false if the directory
+   contains no more entries. */
+bool
+dir_readdir_at (struct inode *inode, off_t *pos, char name[NAME_MAX + 1])
+{
+  struct dir dir = { inode, *pos };
+  bool success;
+
+  success = dir_readdir (&dir, name);
+  *pos = dir.pos;
+  return success;
+}
+
+/* Reads up to CNT entries of the directory INODE, other than "."
+   and "..", at or after byte offset *POS into ENTS, and advances
+   *POS past the last one read.  The entries are read a block at
+   a time.  Returns the number of entries read, 0 if the
+   directory contains no more entries or memory is short. */
+size_t
+dir_read_entries (struct inode *inode, off_t *pos, struct dirent *ents,
+                  size_t cnt)
+{
+  struct dir dir = { inode, 0 };
+  struct dir_block *b = malloc (sizeof *b);
+  size_t n;
+
+  if (b == NULL)
+    return 0;
+  inode_lock_dir (inode);
+  n = read_entries (&dir, pos, b, ents, cnt);
+  inode_unlock_dir (inode);
+  free (b);
+  return n;
+}
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+/* Reads up to CNT entries in use of DIR, other than "." and "..",
+   at or after byte offset *POS into ENTS, reading blocks into B,
+   and advances *POS past the last one read.  Returns the number
+   of entries read.  The caller holds the directory lock of
+   DIR. */
+static size_t
+read_entries (const struct dir *dir, off_t *pos, struct dir_block *b,
+              struct dirent *ents, size_t cnt)
+{
+  struct dir_header h;
+  size_t block_cnt = read_header (dir, &h) ? h.bucket_cnt + 1 : 1;
+  size_t n = 0;
+
+  /* Skip the header of a hashed directory. */
+  if (block_cnt > 1 && *pos < block_ofs (1))
+    *pos = block_ofs (1);
+  while (n < cnt && *pos < block_ofs (block_cnt))
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
+      size_t block = *pos / DISK_SECTOR_SIZE;
+      off_t base = block_ofs (block) + BLOCK_HEADER;
+      size_t ofs, next;
+
+      if (!read_block (dir, block, b))
+        break;
+
+      /* Resume at the first entry at or after *POS, which falls
+         inside an entry only if the block was compacted since. */
+      for (ofs = 0; ofs < b->used && n < cnt; ofs = next)
+        {
+          struct dir_entry e;
+          char *name = ents[n].d_name;
+
+          next = read_entry (b, ofs, &e, name);
+          if (base + (off_t) ofs < *pos)
+            continue;
+          *pos = base + next;
+          if (e.in_use && strcmp (name, ".") && strcmp (name, ".."))
+            {
+              ents[n].d_ino = e.inode_sector;
+              n++;
+            }
+        }
+      if (ofs >= b->used)
+        *pos = block_ofs (block + 1);
+    }
+  return n;
+}
+
+/* Reads the next entry in use of DIR at or after byte offset
+   *POS, other than "." and "..", reading blocks into B, stores
+   its name in NAME and advances *POS past it.  Returns false if
+   there is none.  The caller holds the directory lock of DIR. */
+static bool
+read_next (const struct dir *dir, off_t *pos, struct dir_block *b,
+           char name[NAME_MAX + 1])
+{
+  struct dirent ent;
+
+  if (read_entries (dir, pos, b, &ent, 1) == 0)
+    return false;
+  strlcpy (name, ent.d_name, NAME_MAX + 1);
+  return true;
+}
+
+/* Reads the header of DIR into *H.
+   Returns true if DIR is a hashed directory, false otherwise. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h)
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_HASH_MAGIC);
+}
+
+/* Returns the byte offset of BLOCK in a directory.  Bucket I of
+   a hashed directory is block I + 1. */
+static off_t
+block_ofs (size_t block)
+{
+  return block * DISK_SECTOR_SIZE;
+}
+
+/* Returns the bucket for NAME among BUCKET_CNT buckets.  Buckets
+   are part of the on-disk format, so NAME is hashed with the
+   32-bit FNV-1 hash that hashed directories have always used,
+   not with hash_string(), which is free to change. */
+static size_t
+name_bucket (const char *name, size_t bucket_cnt)
+{
+  const unsigned char *s = (const unsigned char *) name;
+  uint32_t hash = 2166136261u;
+
+  while (*s != '\0')
+    hash = (hash * 16777619u) ^ *s++;
+  return hash % bucket_cnt;
+}
+
+/* Reads BLOCK of DIR into *B, as an empty block if it lies past
+   the end of DIR.
+   Returns true if successful, false if the block is corrupt. */
+static bool
+read_block (const struct dir *dir, size_t block, struct dir_block *b)
+{
+  size_t ofs, next;
+
+  memset (b, 0, sizeof *b);
+  inode_read_at (dir->inode, b, sizeof *b, block_ofs (block));
+  if (b->used > sizeof b->data || b->free > b->used)
+    return false;
+  for (ofs = 0; ofs < b->used; ofs = next)
+    {
+      struct dir_entry e;
+
+      if (b->used - ofs < sizeof e)
+        return false;
+      next = read_entry (b, ofs, &e, NULL);
+      if (e.name_len == 0 || e.name_len > NAME_MAX || next > b->used)
+        return false;
+    }
+  return true;
+}
+
+/* Writes *B to BLOCK of DIR, up to the end of its entries.
+   Returns true if successful, false on failure. */
+static bool
+write_block (struct dir *dir, size_t block, const struct dir_block *b)
+{
+  off_t size = BLOCK_HEADER + b->used;
+  return inode_write_at (dir->inode, b, size, block_ofs (block)) == size;
+}
+
+/* Reads the entry at offset OFS among the entries of B into *E,
+   and its name into NAME if NAME is non-null.
+   Returns the offset of the next entry. */
+static size_t
+read_entry (const struct dir_block *b, size_t ofs, struct dir_entry *e,
+            char name[NAME_MAX + 1])
+{
+  memcpy (e, b->data + ofs, sizeof *e);
+  if (name != NULL)
+    {
+      memcpy (name, b->data + ofs + sizeof *e, e->name_len);
+      name[e->name_len] = '\0';
+    }
+  return ofs + ENTRY_SIZE (e->name_len);
+}
+
+/* Searches B for an entry in use for NAME, comparing names only
+   if their lengths match.  If successful, returns true and sets
+   *OFSP to the entry's offset; otherwise, returns false. */
+static bool
+block_find (const struct dir_block *b, const char *name, size_t *ofsp)
+{
+  size_t len = strlen (name);
+  size_t ofs, next;
+
+  for (ofs = 0; ofs < b->used; ofs = next)
+    {
+      struct dir_entry e;
+
+      next = read_entry (b, ofs, &e, NULL);
+      if (e.in_use && e.name_len == len
+          && !memcmp (b->data + ofs + sizeof e, name, len))
         {
-          strlcpy (name, e.name, NAME_MAX + 1);
+          *ofsp = ofs;
           return true;
-        } 
+        }
     }
   return false;
 }
+
+/* Adds an entry for NAME, whose inode is in SECTOR, at the end of
+   B, compacting B first if that makes room for it.
+   Returns true if successful, false if B is full. */
+static bool
+block_add (struct dir_block *b, const char *name, disk_sector_t sector)
+{
+  size_t len = strlen (name);
+  struct dir_entry e;
+
+  if (ENTRY_SIZE (len) > sizeof b->data - b->used)
+    {
+      if (ENTRY_SIZE (len) > sizeof b->data - b->used + b->free)
+        return false;
+      block_compact (b);
+    }
+  e.inode_sector = sector;
+  e.in_use = true;
+  e.name_len = len;
+  memcpy (b->data + b->used, &e, sizeof e);
+  memcpy (b->data + b->used + sizeof e, name, len);
+  b->used += ENTRY_SIZE (len);
+  return true;
+}
+
+/* Marks the entry at offset OFS of B free. */
+static void
+block_remove (struct dir_block *b, size_t ofs)
+{
+  struct dir_entry e;
+
+  read_entry (b, ofs, &e, NULL);
+  ASSERT (e.in_use);
+  e.in_use = false;
+  memcpy (b->data + ofs, &e, sizeof e);
+  b->free += ENTRY_SIZE (e.name_len);
+}
+
+/* Moves the entries in use of B down over its free ones. */
+static void
+block_compact (struct dir_block *b)
+{
+  size_t ofs, next, end = 0;
+
+  for (ofs = 0; ofs < b->used; ofs = next)
+    {
+      struct dir_entry e;
+
+      next = read_entry (b, ofs, &e, NULL);
+      if (e.in_use)
+        {
+          memmove (b->data + end, b->data + ofs, next - ofs);
+          end += next - ofs;
+        }
+    }
+  b->used = end;
+  b->free = 0;
+}
+
+/* Turns DIR, a single block whose entries are in *OLD, into a
+   hashed directory of two buckets, which between them hold the
+   entries in use with room to spare.
+   Returns true if successful, false on failure. */
+static bool
+make_hashed (struct dir *dir, const struct dir_block *old)
+{
+  size_t bucket_cnt = 2;
+  struct dir_block *buckets = calloc (bucket_cnt, sizeof *buckets);
+  struct dir_header h;
+  size_t ofs, next, i;
+  bool success = false;
+
+  if (buckets == NULL)
+    return false;
+  for (ofs = 0; ofs < old->used; ofs = next)
+    {
+      struct dir_entry e;
+      char name[NAME_MAX + 1];
+
+      next = read_entry (old, ofs, &e, name);
+      if (e.in_use
+          && !block_add (&buckets[name_bucket (name, bucket_cnt)], name,
+                         e.inode_sector))
+        goto done;
+    }
+
+  /* Write the buckets, then the header that makes them live. */
+  for (i = bucket_cnt; i-- > 0; )
+    if (!write_block (dir, i + 1, &buckets[i]))
+      goto done;
+  h.magic = DIR_HASH_MAGIC;
+  h.bucket_cnt = bucket_cnt;
+  success = inode_write_at (dir->inode, &h, sizeof h, 0) == sizeof h;
+
+ done:
+  free (buckets);
+  return success;
+}
+
+/* Doubles the number of buckets of DIR, whose header is *H,
+   splitting the entries of each bucket I between buckets I and
+   I + *H's bucket count.
+   Returns true if successful, false on failure. */
+static bool
+grow_hashed (struct dir *dir, struct dir_header *h)
+{
+  size_t old_cnt = h->bucket_cnt;
+  size_t new_cnt = 2 * old_cnt;
+  struct dir_block *lo = malloc (sizeof *lo);
+  struct dir_block *hi = calloc (1, sizeof *hi);
+  size_t i;
+  bool success = false;
+
+  if (lo == NULL || hi == NULL || new_cnt > BUCKET_MAX)
+    goto done;
+
+  /* Extend the directory first, so that no later write fails. */
+  if (inode_write_at (dir->inode, hi, sizeof *hi, block_ofs (new_cnt))
+      != sizeof *hi)
+    goto done;
+
+  for (i = 0; i < old_cnt; i++)
+    {
+      size_t ofs, next;
+
+      if (!read_block (dir, i + 1, lo))
+        goto done;
+      memset (hi, 0, sizeof *hi);
+      for (ofs = 0; ofs < lo->used; ofs = next)
+        {
+          struct dir_entry e;
+          char name[NAME_MAX + 1];
+
+          next = read_entry (lo, ofs, &e, name);
+          if (e.in_use && name_bucket (name, new_cnt) != i)
+            {
+              block_add (hi, name, e.inode_sector);
+              block_remove (lo, ofs);
+            }
+        }
+      block_compact (lo);
+      if (!write_block (dir, i + old_cnt + 1, hi)
+          || !write_block (dir, i + 1, lo))
+        goto done;
+    }
+
+  h->bucket_cnt = new_cnt;
+  success = inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+
+ done:
+  free (lo);
+  free (hi);
+  return success;
+}
@@ -4,17 +4,19 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/disk.h"
+#include "filesys/off_t.h"
 
-/* Maximum length of a file name component.
-   This is the traditional UNIX maximum length.
-   After directories are implemented, this maximum length may be
-   retained, but much longer full path names must be allowed. */
-#define NAME_MAX 14
+/* Maximum length of a file name component.  Entries take only
+   the room their names need, so the bound is set by the name
+   buffers kept on kernel stacks rather than by the disk
+   format. */
+#define NAME_MAX 63
 
+struct dirent;
 struct inode;
 
 /* Opening and closing directories. */
-bool dir_create (disk_sector_t sector, size_t entry_cnt);
+bool dir_create (disk_sector_t sector, disk_sector_t parent_sector);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
 struct dir *dir_reopen (struct dir *);
@@ -26,5 +28,8 @@ bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, disk_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+bool dir_readdir_at (struct inode *, off_t *pos, char name[NAME_MAX + 1]);
+size_t dir_read_entries (struct inode *, off_t *pos, struct dirent *,
+                         size_t cnt);
 
 #endif /* filesys/directory.h */
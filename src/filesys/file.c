@@ -1,7 +1,9 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
 
 /* An open file. */
 struct file 
@@ -11,13 +13,23 @@ struct file
     bool deny_write;            /* Has file_deny_write() been called? */
   };
 
+/* Cache of open files. */
+static struct slab_cache *file_cache;
+
+/* Initializes the cache of open files. */
+void
+file_init (void)
+{
+  file_cache = slab_cache_create ("file", sizeof (struct file), NULL);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = slab_alloc (file_cache);
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
@@ -28,7 +40,7 @@ file_open (struct inode *inode)
   else
     {
       inode_close (inode);
-      free (file);
+      slab_free (file_cache, file);
       return NULL; 
     }
 }
@@ -49,7 +61,7 @@ file_close (struct file *file)
     {
       file_allow_write (file);
       inode_close (file->inode);
-      free (file); 
+      slab_free (file_cache, file);
     }
 }
 
@@ -68,7 +80,10 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read;
+
+  inode_wait_deferred (file->inode);
+  bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,9 +96,20 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
+  inode_wait_deferred (file->inode);
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads SIZE bytes from FILE into BUFFER like file_read_at(),
+   leaving a copy of them in the buffer cache. */
+off_t
+file_read_at_cached (struct file *file, void *buffer, off_t size,
+                     off_t file_ofs)
+{
+  inode_wait_deferred (file->inode);
+  return inode_read_at_cached (file->inode, buffer, size, file_ofs);
+}
+
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
@@ -94,11 +120,86 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written;
+
+  inode_wait_deferred (file->inode);
+  bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
 
+/* Copies up to SIZE bytes from SRC, starting at its position,
+   into DST at its position, and advances both by the number of
+   bytes copied, which is returned.  The data moves a page at a
+   time from the buffer cache into the buffer cache, through a
+   kernel page, so whole sectors the cache does not hold are
+   read from disk in runs.  Returns -1 if SRC and DST share an
+   inode and the ranges overlap, or if memory is short. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size)
+{
+  off_t bytes_copied = 0;
+  off_t left;
+  uint8_t *page;
+
+  ASSERT (dst != NULL && src != NULL);
+
+  inode_wait_deferred (src->inode);
+  inode_wait_deferred (dst->inode);
+
+  /* Copy no further than the end of SRC. */
+  left = inode_length (src->inode) - src->pos;
+  if (size > left)
+    size = left;
+  if (size <= 0)
+    return 0;
+  if (dst->inode == src->inode
+      && src->pos < dst->pos + size && dst->pos < src->pos + size)
+    return -1;
+
+  page = palloc_get_page (0);
+  if (page == NULL)
+    return -1;
+  while (size > 0)
+    {
+      off_t chunk = size < PGSIZE ? size : PGSIZE;
+      off_t bytes = inode_read_at (src->inode, page, chunk, src->pos);
+      if (bytes > 0)
+        bytes = inode_write_at (dst->inode, page, bytes, dst->pos);
+      src->pos += bytes;
+      dst->pos += bytes;
+      bytes_copied += bytes;
+      size -= bytes;
+      if (bytes < chunk)
+        break;
+    }
+  palloc_free_page (page);
+  return bytes_copied;
+}
+
+/* Punches a hole of SIZE bytes at offset FILE_OFS into FILE,
+   which then reads as zeros there and frees the disk space,
+   without changing its length.  The file's current position is
+   unaffected.
+   Returns false if writes to FILE are denied. */
+bool
+file_punch (struct file *file, off_t size, off_t file_ofs)
+{
+  inode_wait_deferred (file->inode);
+  return inode_punch (file->inode, file_ofs, size);
+}
+
+/* Writes the data of FILE still in the buffer cache to disk,
+   along with its length and layout unless DATA_ONLY is true and
+   they are unchanged since the last sync. */
+void
+file_sync (struct file *file, bool data_only)
+{
+  ASSERT (file != NULL);
+  inode_wait_deferred (file->inode);
+  inode_sync (file->inode, data_only);
+}
+
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
@@ -110,6 +211,7 @@ off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
+  inode_wait_deferred (file->inode);
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
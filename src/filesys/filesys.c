@@ -3,43 +3,101 @@
 #include <stdio.h>
 #include <string.h>
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
+#include "filesys/defrag.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "filesys/mount.h"
+#include "filesys/tmpfs.h"
+#include "filesys/volume.h"
 #include "devices/disk.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
 
-/* The disk that contains the file system. */
+/* Deepest directory a snapshot holds, below its top. */
+#define SNAPSHOT_DEPTH 16
+
+/* The disk that contains the root file system, volume 0. */
 struct disk *filesys_disk;
 
-static void do_format (void);
+/* Sectors per file system block, the unit in which the disk is
+   allocated and file data is indexed.  A power of 2, fixed when
+   the disk is formatted and recorded in the journal header.
+   Controlled by kernel command-line option "-block=BYTES". */
+size_t filesys_block_sectors = 1;
+
+static void do_format (int volume);
+static bool create (const char *name, off_t initial_size, bool is_dir);
+static struct dir *open_start (const char *path);
+static struct dir *resolve (const char *path, char name[NAME_MAX + 1]);
+static disk_sector_t open_mount_point (const char *path);
+static bool snapshot_dir (struct dir *from, struct dir *to,
+                          disk_sector_t skip, int depth);
+static void release_inumber (disk_sector_t);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
 void
 filesys_init (bool format) 
 {
+  /* The file system's first sectors, up to the journal header,
+     must lie in the first chunk of a striped volume. */
+  if (volume_chunk_sectors != 0
+      && ((volume_chunk_sectors & (volume_chunk_sectors - 1)) != 0
+          || volume_chunk_sectors <= JOURNAL_SECTOR))
+    PANIC ("RAID-0 chunk size must be a power of 2 of at least 2 kB");
+  if (!volume_attach (0))
+    PANIC ("hd0:1 (hdb) not present, file system initialization failed%s",
+           volume_chunk_sectors != 0 ? " (or hd1:0 for RAID-0)" : "");
   filesys_disk = disk_get (0, 1);
-  if (filesys_disk == NULL)
-    PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
   buffer_cache_init ();
+  file_init ();
   inode_init ();
-  free_map_init ();
+  dcache_init ();
+  mount_init ();
+  tmpfs_init ();
+  journal_init ();
+  if (!journal_open (0, format))
+    PANIC ("file system was not formatted with -raid0=%zu",
+           volume_chunk_sectors * DISK_SECTOR_SIZE);
+  if (filesys_block_sectors == 0
+      || (filesys_block_sectors & (filesys_block_sectors - 1)) != 0
+      || filesys_block_sectors > PGSIZE / DISK_SECTOR_SIZE)
+    PANIC ("block size must be a power of 2 from %d to %d bytes",
+           DISK_SECTOR_SIZE, PGSIZE);
+  if (volume_chunk_sectors % filesys_block_sectors != 0)
+    PANIC ("RAID-0 chunk size must be a multiple of the block size");
+  free_map_init (0);
 
   if (format) 
-    do_format ();
+    do_format (0);
 
-  free_map_open ();
+  free_map_open (0);
+  defrag_init ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
-   to disk. */
+   to disk, once writes handed off to be made later are made. */
 void
 filesys_done (void) 
 {
+  int volume;
+
+  inode_wait_all_deferred ();
+  defrag_done ();
   buffer_cache_done ();
-  free_map_close ();
+  for (volume = 0; volume < VOLUME_CNT; volume++)
+    if (volume_present (volume))
+      {
+        free_map_close (volume);
+        volume_flush (volume);
+      }
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -49,20 +107,20 @@ filesys_done (void)
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
-  disk_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
-  dir_close (dir);
+  return create (name, initial_size, false);
+}
 
-  return success;
+/* Creates an empty directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name)
+{
+  return create (name, 0, true);
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file with the given NAME, which may be a directory.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -70,38 +128,372 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve (name, base);
   struct inode *inode = NULL;
 
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    dir_lookup (dir, base, &inode);
   dir_close (dir);
 
   return file_open (inode);
 }
 
-/* Deletes the file named NAME.
+/* Opens the directory with the given NAME.
+   Returns the new directory if successful or a null pointer
+   otherwise.
+   Fails if no directory named NAME exists,
+   or if an internal memory allocation fails. */
+struct dir *
+filesys_open_dir (const char *name)
+{
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve (name, base);
+  struct inode *inode = NULL;
+
+  if (dir != NULL)
+    dir_lookup (dir, base, &inode);
+  dir_close (dir);
+  if (inode != NULL && !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return NULL;
+    }
+
+  return dir_open (inode);
+}
+
+/* Deletes the file named NAME, or the directory named NAME if it
+   is empty.
    Returns true if successful, false on failure.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (name, base);
+  success = dir != NULL && dir_remove (dir, base);
   dir_close (dir); 
+  journal_end ();
+
+  return success;
+}
+
+/* Creates a file named NAME with the given INITIAL_SIZE, or an
+   empty directory if IS_DIR is true.
+   Returns true if successful, false otherwise. */
+static bool
+create (const char *name, off_t initial_size, bool is_dir)
+{
+  char base[NAME_MAX + 1];
+  disk_sector_t inode_sector = 0;
+  disk_sector_t parent = 0, goal = 0;
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (name, base);
+  if (dir != NULL)
+    {
+      /* A file in a tmpfs gets a memory inode.  Otherwise, put a
+         file's inode near its directory's. */
+      parent = inode_get_inumber (dir_get_inode (dir));
+      if (tmpfs_is_inumber (parent))
+        inode_sector = tmpfs_new_inumber ();
+      else
+        goal = is_dir ? free_map_dir_goal (parent) : parent;
+    }
+  success = (dir != NULL
+             && (inode_sector != 0
+                 || free_map_allocate (1, goal, &inode_sector))
+             && (is_dir
+                 ? dir_create (inode_sector, parent)
+                 : inode_create (inode_sector, initial_size, false))
+             && dir_add (dir, base, inode_sector));
+  if (!success && inode_sector != 0) 
+    release_inumber (inode_sector);
+  dir_close (dir);
+  journal_end ();
+
+  return success;
+}
+
+/* Takes a snapshot of the directory named SRC: creates a
+   directory named DST holding copies of the files and
+   directories under SRC as they are now.  Files are copied by
+   inode_clone(), so they share their data blocks with the
+   originals until either is written, and the snapshot takes
+   time and space for its directories and index blocks only.
+   Each file is copied as it was between writes to it, but files
+   written meanwhile may be copied before or after the writes,
+   so a snapshot of several files that belong together needs
+   them left alone until it is done.  Files not on the volume of
+   DST, such as ones under mount points, are left out, and so is
+   DST itself if it lies under SRC.
+   Returns true if successful, false otherwise, in which case
+   DST may hold part of the snapshot. */
+bool
+filesys_snapshot (const char *src, const char *dst)
+{
+  struct dir *from = filesys_open_dir (src);
+  struct dir *to = NULL;
+  bool success;
+
+  success = (from != NULL
+             && create (dst, 0, true)
+             && (to = filesys_open_dir (dst)) != NULL
+             && snapshot_dir (from, to,
+                              inode_get_inumber (dir_get_inode (to)),
+                              SNAPSHOT_DEPTH));
+  dir_close (from);
+  dir_close (to);
 
   return success;
 }
+
+/* Adds to directory TO of a snapshot copies of the entries of
+   directory FROM, and of the entries under them down to DEPTH
+   levels, other than the directory whose inode is at SKIP.
+   Returns true if successful, false otherwise. */
+static bool
+snapshot_dir (struct dir *from, struct dir *to, disk_sector_t skip,
+              int depth)
+{
+  disk_sector_t parent = inode_get_inumber (dir_get_inode (to));
+  char name[NAME_MAX + 1];
+  bool success = true;
+
+  while (success && dir_readdir (from, name))
+    {
+      struct inode *inode;
+      disk_sector_t inumber;
+      disk_sector_t sector = 0;
+      bool is_dir;
+
+      if (!dir_lookup (from, name, &inode))
+        continue;
+      inumber = inode_get_inumber (inode);
+      is_dir = inode_is_dir (inode);
+      if (inumber == skip || volume_of (inumber) != volume_of (parent))
+        {
+          inode_close (inode);
+          continue;
+        }
+
+      /* Copy the entry.  A directory gets an empty one, near
+         which its own entries are then copied. */
+      journal_begin ();
+      success = free_map_allocate (1, (is_dir ? free_map_dir_goal (parent)
+                                       : parent), &sector);
+      if (success && !(is_dir
+                       ? dir_create (sector, parent)
+                       : inode_clone (inode, sector)))
+        {
+          release_inumber (sector);
+          success = false;
+        }
+      else if (success && !dir_add (to, name, sector))
+        {
+          /* Drop the copy along with the blocks it holds. */
+          struct inode *copy = inode_open (sector);
+          if (copy != NULL)
+            inode_remove (copy);
+          inode_close (copy);
+          success = false;
+        }
+      journal_end ();
+
+      if (success && is_dir)
+        {
+          struct dir *sub_from = dir_open (inode_reopen (inode));
+          struct dir *sub_to = dir_open (inode_open (sector));
+
+          success = (depth > 0 && sub_from != NULL && sub_to != NULL
+                     && snapshot_dir (sub_from, sub_to, skip, depth - 1));
+          dir_close (sub_from);
+          dir_close (sub_to);
+        }
+      inode_close (inode);
+    }
+  return success;
+}
+
+/* Mounts a new, empty tmpfs on the directory named PATH, which
+   must be a directory of a disk file system other than the root
+   directory.  Files created under PATH then live in memory until
+   they are removed or the kernel stops, and the files the
+   directory held are hidden meanwhile.
+   Returns true if successful, false otherwise. */
+bool
+filesys_mount_tmpfs (const char *path)
+{
+  disk_sector_t inumber = open_mount_point (path);
+  disk_sector_t root;
+  bool success;
+
+  if (inumber == 0)
+    return false;
+  root = tmpfs_new_inumber ();
+  success = (dir_create (root, root)
+             && mount_add (inumber, root));
+  if (!success)
+    release_inumber (root);
+
+  return success;
+}
+
+/* Mounts the file system on disk DEV_NO of channel CHAN_NO on
+   the directory named PATH, which must be a directory of a disk
+   file system other than the root directory.  The disk must be
+   hd1:0 or, in a kernel without virtual memory, hd1:1, which
+   otherwise holds swap.  If FORMAT is true, formats the disk
+   first; otherwise it must have been formatted with the block
+   size of the root file system.  The files PATH held are hidden
+   while the disk is mounted, which is until the kernel stops.
+   Returns true if successful, false otherwise. */
+bool
+filesys_mount (const char *path, int chan_no, int dev_no, bool format)
+{
+  int volume = volume_for_disk (chan_no, dev_no);
+  disk_sector_t inumber;
+
+#ifdef VM
+  if (chan_no == 1 && dev_no == 1)
+    return false;
+#endif
+  if (volume <= 0)
+    return false;
+  inumber = open_mount_point (path);
+  if (inumber == 0 || !volume_attach (volume) || !journal_open (volume, format))
+    return false;
+
+  free_map_init (volume);
+  if (format)
+    do_format (volume);
+  free_map_open (volume);
+  return mount_add (inumber, volume_sector (volume, ROOT_DIR_SECTOR));
+}
+
+/* Returns the inode number of the directory named PATH if a
+   file system may be mounted on it, or 0 if there is no such
+   directory, or it is the root directory, a tmpfs directory, a
+   mount point or the root of a mounted file system. */
+static disk_sector_t
+open_mount_point (const char *path)
+{
+  struct dir *dir = filesys_open_dir (path);
+  disk_sector_t inumber;
+
+  if (dir == NULL)
+    return 0;
+  inumber = inode_get_inumber (dir_get_inode (dir));
+  dir_close (dir);
+  if (inumber == ROOT_DIR_SECTOR
+      || tmpfs_is_inumber (inumber)
+      || mount_point (inumber) != inumber
+      || mount_covering (inumber) != inumber)
+    return 0;
+  return inumber;
+}
+
+/* Releases inode number INUMBER, which create(),
+   filesys_mount_tmpfs() or snapshot_dir() took but did not get
+   to link. */
+static void
+release_inumber (disk_sector_t inumber)
+{
+  if (tmpfs_is_inumber (inumber))
+    {
+      /* Drop the memory inode, if it was made. */
+      struct inode *inode = inode_open (inumber);
+      if (inode != NULL)
+        {
+          inode_remove (inode);
+          inode_close (inode);
+        }
+    }
+  else
+    free_map_release (inumber, 1);
+}
+
+/* Opens the directory a lookup of PATH starts from: the root
+   directory if PATH is absolute, and the current process's
+   working directory otherwise. */
+static struct dir *
+open_start (const char *path)
+{
+#ifdef USERPROG
+  if (*path != '/')
+    return process_open_cwd ();
+#endif
+  return dir_open_root ();
+}
+
+/* Opens the directory holding the last component of PATH,
+   walking down from open_start(), and stores that component in
+   NAME.  A PATH naming the root directory has "." for its last
+   component.
+   Returns the directory if successful, or a null pointer if
+   PATH is empty, a component is too long, or a directory on the
+   way does not exist. */
+static struct dir *
+resolve (const char *path, char name[NAME_MAX + 1])
+{
+  struct dir *dir;
+  const char *p;
+
+  if (*path == '\0')
+    return NULL;
+  dir = open_start (path);
+  p = path + strspn (path, "/");
+  if (*p == '\0')
+    strlcpy (name, ".", NAME_MAX + 1);
+  while (dir != NULL && *p != '\0')
+    {
+      size_t len = strcspn (p, "/");
+      struct inode *inode;
+
+      if (len > NAME_MAX)
+        break;
+      memcpy (name, p, len);
+      name[len] = '\0';
+      p += len + strspn (p + len, "/");
+      if (*p == '\0')
+        return dir;
+
+      /* Step into the directory NAME. */
+      if (!dir_lookup (dir, name, &inode) || !inode_is_dir (inode))
+        {
+          inode_close (inode);
+          break;
+        }
+      dir_close (dir);
+      dir = dir_open (inode);
+    }
+  if (*p != '\0')
+    {
+      dir_close (dir);
+      return NULL;
+    }
+  return dir;
+}
 
-/* Formats the file system. */
+/* Formats the file system of VOLUME. */
 static void
-do_format (void)
+do_format (int volume)
 {
-  printf ("Formatting file system...");
-  free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  disk_sector_t root = volume_sector (volume, ROOT_DIR_SECTOR);
+
+  printf ("Formatting file system with %zu-byte blocks...",
+          filesys_block_sectors * DISK_SECTOR_SIZE);
+  free_map_create (volume);
+  if (!dir_create (root, root))
     PANIC ("root directory creation failed");
-  free_map_close ();
+  free_map_close (volume);
   printf ("done.\n");
 }
@@ -2,19 +2,31 @@
 #define FILESYS_FILESYS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Journal header sector. */
+
+struct dir;
 
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
 
+/* Sectors per file system block. */
+extern size_t filesys_block_sectors;
+
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
+bool filesys_mkdir (const char *name);
 struct file *filesys_open (const char *name);
+struct dir *filesys_open_dir (const char *name);
 bool filesys_remove (const char *name);
+bool filesys_snapshot (const char *src, const char *dst);
+bool filesys_mount_tmpfs (const char *path);
+bool filesys_mount (const char *path, int chan_no, int dev_no, bool format);
 
 #endif /* filesys/filesys.h */
@@ -1,85 +1,301 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/volume.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
-static struct file *free_map_file;   /* Free map file. */
-static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+/* Number of blocks in a group of the free map. */
+#define GROUP_BLOCKS 256
 
-/* Initializes the free map. */
+/* Most references to a block beyond the first. */
+#define REFS_MAX UINT8_MAX
+
+/* Free map of a volume.
+
+   Blocks are numbered within the volume.  GROUP_FREE counts free
+   blocks of each group of GROUP_BLOCKS blocks, so that searches
+   skip full groups.  A search starts at a goal given by the
+   caller, so that inodes land near their directories and data
+   near its inode, or else at CURSOR, just after the last
+   allocation, so that successive allocations fill the disk in
+   order.  A sector's volume picks the free map it is allocated
+   from and released to.
+
+   REFS counts the references to each allocated block beyond the
+   first, which blocks shared between a file and its snapshots
+   have (see inode_clone()).  Releasing a shared block drops a
+   reference, and only the last release frees it.  The counts
+   are kept in the free map file after the bitmap, a byte per
+   block, unless the file system was formatted before there were
+   any, in which case no block may be shared. */
+struct free_map
+  {
+    struct file *file;          /* Free map file. */
+    struct bitmap *map;         /* Free map, one bit per block. */
+    uint8_t *refs;              /* Extra references, one byte per block. */
+    bool refs_saved;            /* Does FILE have room for REFS? */
+    struct lock lock;           /* Protects the members below. */
+    size_t *group_free;         /* Free blocks per group. */
+    size_t group_cnt;           /* Number of groups. */
+    size_t cursor;              /* Where the next search starts. */
+  };
+
+static struct free_map free_maps[VOLUME_CNT];
+
+static struct free_map *sector_map (disk_sector_t);
+static void count_groups (struct free_map *);
+static void set_blocks (struct free_map *, size_t, size_t, bool);
+static size_t find_run (struct free_map *, size_t, size_t, size_t *);
+static bool persist (struct free_map *, size_t, size_t);
+static bool persist_refs (struct free_map *, size_t, size_t);
+static size_t sectors_to_blocks (size_t);
+
+/* Initializes the free map of VOLUME, which allocates its disk
+   in blocks of filesys_block_sectors sectors.  A partial block
+   at the end of the disk is left unused. */
 void
-free_map_init (void) 
+free_map_init (int volume) 
 {
-  free_map = bitmap_create (disk_size (filesys_disk));
-  if (free_map == NULL)
+  struct free_map *fm = &free_maps[volume];
+  size_t block_cnt = volume_size (volume) / filesys_block_sectors;
+
+  fm->map = bitmap_create (block_cnt);
+  fm->group_cnt = DIV_ROUND_UP (block_cnt, GROUP_BLOCKS);
+  fm->group_free = malloc (fm->group_cnt * sizeof *fm->group_free);
+  fm->refs = calloc (block_cnt, 1);
+  if (fm->map == NULL || fm->group_free == NULL || fm->refs == NULL)
     PANIC ("bitmap creation failed--disk is too large");
-  bitmap_mark (free_map, FREE_MAP_SECTOR);
-  bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  lock_init (&fm->lock);
+  fm->file = NULL;
+  fm->refs_saved = false;
+
+  /* Reserve the blocks of the free map and root directory inodes
+     and of the journal. */
+  bitmap_set_multiple (fm->map, 0,
+                       sectors_to_blocks (JOURNAL_SECTOR + JOURNAL_BLOCKS + 1),
+                       true);
+  count_groups (fm);
+  fm->cursor = 0;
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+/* Allocates CNT consecutive sectors from the free map, rounded
+   up to whole blocks, and stores the first into *SECTORP.  The
+   search starts at sector GOAL, or at the cursor of GOAL's
+   volume if GOAL is its first sector.
    Returns true if successful, false if all sectors were
    available. */
 bool
-free_map_allocate (size_t cnt, disk_sector_t *sectorp) 
+free_map_allocate (size_t cnt, disk_sector_t goal, disk_sector_t *sectorp) 
 {
-  disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  struct free_map *fm = sector_map (goal);
+  size_t blocks = sectors_to_blocks (cnt);
+  size_t size;
+
+  lock_acquire (&fm->lock);
+  size_t block = find_run (fm, blocks,
+                           volume_ofs (goal) / filesys_block_sectors, &size);
+  if (block != BITMAP_ERROR && size == blocks)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      set_blocks (fm, block, blocks, true);
+      if (!persist (fm, block, blocks))
+        {
+          set_blocks (fm, block, blocks, false);
+          block = BITMAP_ERROR;
+        }
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  else
+    block = BITMAP_ERROR;
+  lock_release (&fm->lock);
+  if (block != BITMAP_ERROR)
+    *sectorp = volume_sector (volume_of (goal), block * filesys_block_sectors);
+  return block != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Returns where to start the search for the inode of a new
+   directory whose parent's inode is at sector PARENT.  As in
+   FFS, directories are spread out so that each one's files have
+   room to stay near it: the new one stays in the parent's group
+   if that group has at least the average free space, and goes to
+   the group with the most free space otherwise. */
+disk_sector_t
+free_map_dir_goal (disk_sector_t parent)
+{
+  struct free_map *fm = sector_map (parent);
+  size_t group = volume_ofs (parent) / filesys_block_sectors / GROUP_BLOCKS;
+  size_t total = 0;
+  size_t best = group;
+  size_t i;
+
+  lock_acquire (&fm->lock);
+  for (i = 0; i < fm->group_cnt; i++)
+    {
+      total += fm->group_free[i];
+      if (fm->group_free[i] > fm->group_free[best])
+        best = i;
+    }
+  if (fm->group_free[group] * fm->group_cnt >= total)
+    best = group;
+  lock_release (&fm->lock);
+
+  if (best == group)
+    return parent;
+  return volume_sector (volume_of (parent),
+                        best * GROUP_BLOCKS * filesys_block_sectors);
+}
+
+/* Makes CNT sectors starting at SECTOR, which were allocated
+   together, available for use.  SECTOR must start a block, and
+   the rest of the last block is made available, too.  Blocks
+   that are shared just lose a reference instead. */
 void
 free_map_release (disk_sector_t sector, size_t cnt)
 {
-  ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  struct free_map *fm = sector_map (sector);
+  size_t block = volume_ofs (sector) / filesys_block_sectors;
+  size_t end = block + sectors_to_blocks (cnt);
+
+  ASSERT (sector % filesys_block_sectors == 0);
+
+  lock_acquire (&fm->lock);
+  ASSERT (bitmap_all (fm->map, block, end - block));
+  while (block < end)
+    {
+      size_t run = 0;
+
+      while (block + run < end && fm->refs[block + run] == 0)
+        run++;
+      if (run > 0)
+        {
+          set_blocks (fm, block, run, false);
+          persist (fm, block, run);
+          block += run;
+        }
+      else
+        {
+          fm->refs[block]--;
+          persist_refs (fm, block, 1);
+          block++;
+        }
+    }
+  lock_release (&fm->lock);
+}
+
+/* Adds a reference to each of the blocks holding the CNT sectors
+   starting at SECTOR, which were allocated together, so that
+   they are shared by one more file.  SECTOR must start a block.
+   Returns true if successful, or false, changing nothing, if a
+   block has too many references already or the volume's free
+   map has no room for reference counts. */
+bool
+free_map_share (disk_sector_t sector, size_t cnt)
+{
+  struct free_map *fm = sector_map (sector);
+  size_t block = volume_ofs (sector) / filesys_block_sectors;
+  size_t blocks = sectors_to_blocks (cnt);
+  bool success = fm->refs_saved;
+  size_t i;
+
+  ASSERT (sector % filesys_block_sectors == 0);
+
+  lock_acquire (&fm->lock);
+  ASSERT (bitmap_all (fm->map, block, blocks));
+  for (i = block; i < block + blocks; i++)
+    if (fm->refs[i] == REFS_MAX)
+      success = false;
+  if (success)
+    {
+      for (i = block; i < block + blocks; i++)
+        fm->refs[i]++;
+      if (!persist_refs (fm, block, blocks))
+        {
+          for (i = block; i < block + blocks; i++)
+            fm->refs[i]--;
+          success = false;
+        }
+    }
+  lock_release (&fm->lock);
+  return success;
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Returns true if the block holding SECTOR is shared by more
+   than one file, false otherwise. */
+bool
+free_map_is_shared (disk_sector_t sector)
+{
+  struct free_map *fm = sector_map (sector);
+  size_t block = volume_ofs (sector) / filesys_block_sectors;
+  bool shared;
+
+  lock_acquire (&fm->lock);
+  shared = fm->refs[block] != 0;
+  lock_release (&fm->lock);
+  return shared;
+}
+
+/* Opens the free map file of VOLUME and reads it from disk. */
 void
-free_map_open (void) 
+free_map_open (int volume) 
 {
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  struct free_map *fm = &free_maps[volume];
+  size_t block_cnt;
+
+  fm->file = file_open (inode_open (volume_sector (volume, FREE_MAP_SECTOR)));
+  if (fm->file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
+  inode_mark_meta (file_get_inode (fm->file));
+  if (!bitmap_read (fm->map, fm->file))
+    PANIC ("can't read free map");
+  count_groups (fm);
+
+  /* Read the reference counts, if the file has them. */
+  block_cnt = bitmap_size (fm->map);
+  fm->refs_saved = (file_length (fm->file)
+                    >= (off_t) (bitmap_file_size (fm->map) + block_cnt));
+  if (fm->refs_saved
+      && (file_read_at (fm->file, fm->refs, block_cnt,
+                        bitmap_file_size (fm->map))
+          != (off_t) block_cnt))
     PANIC ("can't read free map");
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Writes the free map of VOLUME to disk and closes the free map
+   file. */
 void
-free_map_close (void) 
+free_map_close (int volume) 
 {
-  file_close (free_map_file);
+  struct free_map *fm = &free_maps[volume];
+
+  file_close (fm->file);
+  fm->file = NULL;
 }
 
-/* Creates a new free map file on disk and writes the free map to
-   it. */
+/* Creates a new free map file on the disk of VOLUME and writes
+   the free map to it. */
 void
-free_map_create (void) 
+free_map_create (int volume) 
 {
-  /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  struct free_map *fm = &free_maps[volume];
+  disk_sector_t sector = volume_sector (volume, FREE_MAP_SECTOR);
+
+  /* Create inode, with room for the reference counts, which
+     start out zero, after the bitmap. */
+  if (!inode_create (sector,
+                     bitmap_file_size (fm->map) + bitmap_size (fm->map),
+                     false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  fm->file = file_open (inode_open (sector));
+  if (fm->file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  inode_mark_meta (file_get_inode (fm->file));
+  if (!bitmap_write (fm->map, fm->file))
     PANIC ("can't write free map");
 }
 
@@ -120,14 +336,189 @@ free_map_allocate_r (size_t *cntp, size_t size, disk_sector_t *sectorp)
   if (size > *cntp)
     size = *cntp;
 
-  while (size > 0)
+  if (size > 0)
+    size = free_map_allocate_run (size, 0, sectorp);
+
+  *cntp -= size < *cntp ? size : *cntp;
+
+  return size;
+}
+
+/* Allocates up to CNT consecutive sectors, rounded up to whole
+   blocks, from the volume of HINT and stores the first into
+   *SECTORP, preferring the blocks starting at HINT so that a
+   file can grow in place.  Otherwise, takes the first run of
+   that many free blocks after HINT, or after the cursor if HINT
+   is the volume's first sector, or the longest free run if there
+   is none that long.
+   Returns the number of sectors allocated, a multiple of the
+   block size, or 0 if the disk is full. */
+size_t
+free_map_allocate_run (size_t cnt, disk_sector_t hint, disk_sector_t *sectorp)
+{
+  struct free_map *fm = sector_map (hint);
+  size_t blocks = sectors_to_blocks (cnt);
+  size_t start = sectors_to_blocks (volume_ofs (hint));
+  size_t size = 0;
+  size_t block = BITMAP_ERROR;
+
+  ASSERT (sectorp != NULL);
+
+  lock_acquire (&fm->lock);
+  if (start != 0)
+    while (size < blocks && start + size < bitmap_size (fm->map)
+           && !bitmap_test (fm->map, start + size))
+      size++;
+  if (size > 0)
+    block = start;
+  else
+    block = find_run (fm, blocks, start, &size);
+
+  if (size > 0)
     {
-      if (free_map_allocate (size, sectorp))
-        break;
-      size = size >> 1;
+      set_blocks (fm, block, size, true);
+      if (!persist (fm, block, size))
+        {
+          set_blocks (fm, block, size, false);
+          size = 0;
+        }
     }
+  lock_release (&fm->lock);
 
-  *cntp -= size;
+  if (size > 0)
+    *sectorp = volume_sector (volume_of (hint), block * filesys_block_sectors);
+  return size * filesys_block_sectors;
+}
 
-  return size;
+/* Returns the free map of the volume of SECTOR. */
+static struct free_map *
+sector_map (disk_sector_t sector)
+{
+  int volume = volume_of (sector);
+
+  ASSERT (volume < VOLUME_CNT && free_maps[volume].map != NULL);
+
+  return &free_maps[volume];
+}
+
+/* Recounts free blocks of every group of FM from its bitmap. */
+static void
+count_groups (struct free_map *fm)
+{
+  size_t bit_cnt = bitmap_size (fm->map);
+  size_t i;
+
+  for (i = 0; i < fm->group_cnt; i++)
+    {
+      size_t start = i * GROUP_BLOCKS;
+      size_t cnt = bit_cnt - start < GROUP_BLOCKS
+                   ? bit_cnt - start : GROUP_BLOCKS;
+      fm->group_free[i] = bitmap_count (fm->map, start, cnt, false);
+    }
+}
+
+/* Sets the CNT blocks of FM starting at BLOCK to VALUE, true for
+   allocated, and updates the free space index.  Every block
+   must be set to the other value beforehand. */
+static void
+set_blocks (struct free_map *fm, size_t block, size_t cnt, bool value)
+{
+  size_t i;
+
+  bitmap_set_multiple (fm->map, block, cnt, value);
+  for (i = block; i < block + cnt; i++)
+    if (value)
+      fm->group_free[i / GROUP_BLOCKS]--;
+    else
+      fm->group_free[i / GROUP_BLOCKS]++;
+  if (value)
+    fm->cursor = block + cnt < bitmap_size (fm->map) ? block + cnt : 0;
+}
+
+/* Searches FM for CNT consecutive free blocks, from block FROM,
+   or from the cursor if FROM is 0, around to just before it,
+   skipping full groups.  Returns the
+   first block of the first such run found and stores CNT into
+   *SIZEP.  If there is none, returns the longest free run found
+   and stores its length into *SIZEP instead.  Returns
+   BITMAP_ERROR if no block is free. */
+static size_t
+find_run (struct free_map *fm, size_t cnt, size_t from, size_t *sizep)
+{
+  size_t bit_cnt = bitmap_size (fm->map);
+  size_t best = BITMAP_ERROR;
+  size_t best_size = 0;
+  size_t start = 0;
+  size_t run = 0;
+  size_t scanned = 0;
+  size_t i = from != 0 && from < bit_cnt ? from : fm->cursor;
+
+  while (scanned < bit_cnt && best_size < cnt)
+    {
+      /* Runs do not wrap around the end of the disk. */
+      if (i == bit_cnt)
+        {
+          i = 0;
+          run = 0;
+        }
+
+      if (i % GROUP_BLOCKS == 0 && fm->group_free[i / GROUP_BLOCKS] == 0)
+        {
+          size_t skip = bit_cnt - i < GROUP_BLOCKS
+                        ? bit_cnt - i : GROUP_BLOCKS;
+          i += skip;
+          scanned += skip;
+          run = 0;
+          continue;
+        }
+
+      if (bitmap_test (fm->map, i))
+        run = 0;
+      else
+        {
+          if (run++ == 0)
+            start = i;
+          if (run > best_size)
+            {
+              best = start;
+              best_size = run;
+            }
+        }
+      i++;
+      scanned++;
+    }
+
+  *sizep = best_size;
+  return best;
+}
+
+/* Writes the part of FM holding the CNT blocks starting at
+   BLOCK to its free map file, if it is open.  The write only
+   dirties the covering free map sectors in the buffer cache.
+   Returns true if successful, false otherwise. */
+static bool
+persist (struct free_map *fm, size_t block, size_t cnt)
+{
+  return (fm->file == NULL
+          || bitmap_write_range (fm->map, fm->file, block, cnt));
+}
+
+/* Writes the reference counts of the CNT blocks of FM starting
+   at BLOCK to its free map file, if it is open, as persist()
+   does for the bitmap.
+   Returns true if successful, false otherwise. */
+static bool
+persist_refs (struct free_map *fm, size_t block, size_t cnt)
+{
+  return (fm->file == NULL
+          || (file_write_at (fm->file, fm->refs + block, cnt,
+                             bitmap_file_size (fm->map) + block)
+              == (off_t) cnt));
+}
+
+/* Returns the number of blocks that CNT sectors take up. */
+static size_t
+sectors_to_blocks (size_t cnt)
+{
+  return DIV_ROUND_UP (cnt, filesys_block_sectors);
 }
@@ -5,15 +5,18 @@
 #include <stddef.h>
 #include "devices/disk.h"
 
-void free_map_init (void);
-void free_map_read (void);
-void free_map_create (void);
-void free_map_open (void);
-void free_map_close (void);
+void free_map_init (int volume);
+void free_map_create (int volume);
+void free_map_open (int volume);
+void free_map_close (int volume);
 
-bool free_map_allocate (size_t, disk_sector_t *);
+bool free_map_allocate (size_t, disk_sector_t, disk_sector_t *);
+disk_sector_t free_map_dir_goal (disk_sector_t);
 void free_map_release (disk_sector_t, size_t);
+bool free_map_share (disk_sector_t, size_t);
+bool free_map_is_shared (disk_sector_t);
 
 size_t free_map_allocate_r (size_t *, size_t, disk_sector_t *);
+size_t free_map_allocate_run (size_t, disk_sector_t, disk_sector_t *);
 
 #endif /* filesys/free-map.h */
@@ -1,16 +1,25 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/volume.h"
 #include "devices/disk.h"
-#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* Pages of the buffer that fsutil_put() and fsutil_get() move
+   data through, so that each disk request and file access moves
+   many sectors at once. */
+#define TRANSFER_PAGES 16
+
+/* Sectors the buffer holds. */
+#define TRANSFER_SECTORS (TRANSFER_PAGES * PGSIZE / DISK_SECTOR_SIZE)
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -66,6 +75,19 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Takes a snapshot of directory ARGV[1] as new directory
+   ARGV[2]. */
+void
+fsutil_snapshot (char **argv)
+{
+  const char *src = argv[1];
+  const char *dst = argv[2];
+
+  printf ("Taking snapshot of '%s' as '%s'...\n", src, dst);
+  if (!filesys_snapshot (src, dst))
+    PANIC ("%s: snapshot failed", src);
+}
+
 /* Copies from the "scratch" disk, hdc or hd1:0 to file ARGV[1]
    in the file system.
 
@@ -92,11 +114,13 @@ fsutil_put (char **argv)
   printf ("Putting '%s' into the file system...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc (DISK_SECTOR_SIZE);
+  buffer = palloc_get_multiple (0, TRANSFER_PAGES);
   if (buffer == NULL)
     PANIC ("couldn't allocate buffer");
 
   /* Open source disk and read file size. */
+  if (volume_chunk_sectors != 0 || volume_present (1))
+    PANIC ("source disk (hdc or hd1:0) holds a file system");
   src = disk_get (1, 0);
   if (src == NULL)
     PANIC ("couldn't open source disk (hdc or hd1:0)");
@@ -116,11 +140,14 @@ fsutil_put (char **argv)
   if (dst == NULL)
     PANIC ("%s: open failed", file_name);
 
-  /* Do copy. */
+  /* Do copy, a buffer at a time. */
   while (size > 0)
     {
-      int chunk_size = size > DISK_SECTOR_SIZE ? DISK_SECTOR_SIZE : size;
-      disk_read (src, sector++, buffer);
+      off_t max = TRANSFER_SECTORS * DISK_SECTOR_SIZE;
+      off_t chunk_size = size > max ? max : size;
+      size_t sectors = DIV_ROUND_UP (chunk_size, DISK_SECTOR_SIZE);
+      disk_read_multiple (src, sector, buffer, sectors);
+      sector += sectors;
       if (file_write (dst, buffer, chunk_size) != chunk_size)
         PANIC ("%s: write failed with %"PROTd" bytes unwritten",
                file_name, size);
@@ -129,7 +156,7 @@ fsutil_put (char **argv)
 
   /* Finish up. */
   file_close (dst);
-  free (buffer);
+  palloc_free_multiple (buffer, TRANSFER_PAGES);
 }
 
 /* Copies file FILE_NAME from the file system to the scratch disk.
@@ -149,7 +176,7 @@ fsutil_get (char **argv)
   static disk_sector_t sector = 0;
 
   const char *file_name = argv[1];
-  void *buffer;
+  uint8_t *buffer;
   struct file *src;
   struct disk *dst;
   off_t size;
@@ -157,7 +184,7 @@ fsutil_get (char **argv)
   printf ("Getting '%s' from the file system...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc (DISK_SECTOR_SIZE);
+  buffer = palloc_get_multiple (0, TRANSFER_PAGES);
   if (buffer == NULL)
     PANIC ("couldn't allocate buffer");
 
@@ -168,6 +195,8 @@ fsutil_get (char **argv)
   size = file_length (src);
 
   /* Open target disk. */
+  if (volume_chunk_sectors != 0 || volume_present (1))
+    PANIC ("target disk (hdc or hd1:0) holds a file system");
   dst = disk_get (1, 0);
   if (dst == NULL)
     PANIC ("couldn't open target disk (hdc or hd1:0)");
@@ -178,20 +207,25 @@ fsutil_get (char **argv)
   ((int32_t *) buffer)[1] = size;
   disk_write (dst, sector++, buffer);
   
-  /* Do copy. */
+  /* Do copy, a buffer at a time.  The last sector is padded with
+     zeros. */
   while (size > 0) 
     {
-      int chunk_size = size > DISK_SECTOR_SIZE ? DISK_SECTOR_SIZE : size;
-      if (sector >= disk_size (dst))
+      off_t max = TRANSFER_SECTORS * DISK_SECTOR_SIZE;
+      off_t chunk_size = size > max ? max : size;
+      size_t sectors = DIV_ROUND_UP (chunk_size, DISK_SECTOR_SIZE);
+      if (sector + sectors > disk_size (dst))
         PANIC ("%s: out of space on scratch disk", file_name);
       if (file_read (src, buffer, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-      memset (buffer + chunk_size, 0, DISK_SECTOR_SIZE - chunk_size);
-      disk_write (dst, sector++, buffer);
+      memset (buffer + chunk_size, 0,
+              sectors * DISK_SECTOR_SIZE - chunk_size);
+      disk_write_multiple (dst, sector, buffer, sectors);
+      sector += sectors;
       size -= chunk_size;
     }
 
   /* Finish up. */
   file_close (src);
-  free (buffer);
+  palloc_free_multiple (buffer, TRANSFER_PAGES);
 }
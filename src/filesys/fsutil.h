@@ -4,6 +4,7 @@
 void fsutil_ls (char **argv);
 void fsutil_cat (char **argv);
 void fsutil_rm (char **argv);
+void fsutil_snapshot (char **argv);
 void fsutil_put (char **argv);
 void fsutil_get (char **argv);
 
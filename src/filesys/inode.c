@@ -1,45 +1,151 @@
+/* Set default on-disk inode layout with indexed blocks. */
+#if !defined(INODE_INDEXED) && !defined(INODE_EXTENT)
+#define INODE_INDEXED
+#endif
+
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/tmpfs.h"
+#include "filesys/volume.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/spinlock.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+#define READ_AHEAD_WINDOW_MAX 16
+#define DIRECT_IO_MIN PGSIZE
+#define PREALLOC_WINDOW_MIN 8
+#define PREALLOC_WINDOW_MAX 64
+#define CLOSED_INODE_MAX 32
+#define DEFRAG_SECTORS_MAX 4096
+
+/* Identifies an inode. */
+#define INODE_MAGIC 0x494e4f44
 
+/* Inode flags. */
+#define INODE_INLINE 0x1                /* Data kept in INLINE_DATA. */
+#define INODE_DIR 0x2                   /* A directory. */
+#define INODE_SHARED 0x4                /* Blocks may be shared. */
+
+#ifdef INODE_INDEXED
 #define NUM_ADDR 15
 #define IND_BLOCK 12
 #define DIND_BLOCK 14
 #define SIZE_BLOCK (DISK_SECTOR_SIZE / sizeof (disk_sector_t))
-
-/* Identifies an inode. */
-#define INODE_MAGIC 0x494e4f44
+#define INLINE_MAX 432
+
+/* Head of an on-disk inode, all of it but the inline data.
+   Open inodes keep a copy of it.  SECTORS name data blocks and
+   index blocks by their first sectors, and 0 names none.  An
+   index block holds SIZE_BLOCK entries per sector of the
+   block. */
+struct inode_head
+  {
+    disk_sector_t sectors[NUM_ADDR];    /* Blocks. */
+    off_t length;                       /* File size in bytes. */
+    unsigned magic;                     /* Magic number. */
+    uint32_t sector_cnt;                /* Bound of allocated sectors. */
+    uint32_t flags;                     /* INODE_* flags. */
+    uint32_t create_gen;                /* Creation generation. */
+  };
 
 /* On-disk inode.
-   Must be exactly DISK_SECTOR_SIZE bytes long. */
+   Must be exactly DISK_SECTOR_SIZE bytes long.
+   A file of at most INLINE_MAX bytes keeps its data in the inode
+   itself, until it grows larger.  The data is only accessed
+   through the buffer cache. */
 struct inode_disk
   {
-    disk_sector_t sectors[NUM_ADDR];    /* Sectors. */
-    off_t length;                       /* File size in bytes. */
-    unsigned magic;                     /* Magic number. */
-    uint32_t unused[111];               /* Not used. */
+    struct inode_head head;             /* Head. */
+    uint8_t inline_data[INLINE_MAX];    /* Data of an inline file. */
   };
 
-/* Inode indirect block. */
+/* Offset of the inline data in the inode sector. */
+#define INLINE_OFS offsetof (struct inode_disk, inline_data)
+
+/* One sector of an inode index block. */
 struct inode_indirect
   {
-    disk_sector_t sectors[SIZE_BLOCK];  /* Sectors. */
+    disk_sector_t sectors[SIZE_BLOCK];  /* Blocks. */
   };
+#else
+#define EXTENT_CNT 41
 
-static bool inode_allocate (struct inode_disk *);
-static bool inode_allocate_interval (struct inode_disk *, size_t);
-static bool inode_allocate_at (disk_sector_t *, size_t);
-static void inode_release (struct inode_disk *);
-static void inode_release_interval (struct inode_disk *, size_t);
-static void inode_release_at (disk_sector_t *, size_t);
-static disk_sector_t inode_get_sector (const struct inode_disk *, off_t);
-static bool inode_extend (struct inode_disk *, disk_sector_t, off_t length);
+/* A run of CNT contiguous sectors starting at START on disk,
+   holding the file's sectors from OFS on. */
+struct extent
+  {
+    uint32_t ofs;                       /* First sector index in file. */
+    disk_sector_t start;                /* First sector on disk. */
+    uint32_t cnt;                       /* Number of sectors. */
+  };
+
+/* Head of an on-disk inode, with extents in file order.  Open
+   inodes keep a copy of it. */
+struct inode_head
+  {
+    struct extent extents[EXTENT_CNT];  /* Extents. */
+    uint32_t extent_cnt;                /* Number of extents in use. */
+    off_t length;                       /* File size in bytes. */
+    unsigned magic;                     /* Magic number. */
+    uint32_t flags;                     /* INODE_* flags. */
+    uint32_t create_gen;                /* Creation generation. */
+  };
+
+/* On-disk inode.
+   Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct inode_disk
+  {
+    struct inode_head head;             /* Head. */
+  };
+#endif
+
+static bool inode_allocate (struct inode_head *, disk_sector_t);
+static size_t inode_allocated_sectors (const struct inode_head *);
+static bool inode_allocate_range (struct inode_head *, size_t start,
+                                  size_t end, disk_sector_t goal);
+static bool inode_has_hole (struct inode *, size_t start, size_t end);
+static bool inode_has_shared (struct inode *, size_t start, size_t end);
+static bool inode_unshare (struct inode *, size_t start, size_t end);
+static bool inode_clone_blocks (struct inode *, struct inode_head *,
+                                disk_sector_t);
+static void inode_release (struct inode_head *);
+static void inode_release_interval (struct inode_head *, size_t);
+#ifdef INODE_INDEXED
+static void inode_release_range (struct inode_head *, size_t from,
+                                 size_t to);
+static size_t index_entries (void);
+static bool inode_uninline (struct inode *);
+#endif
+static bool inode_is_inline (const struct inode_head *);
+static disk_sector_t inode_get_sector (const struct inode_head *, off_t);
+static disk_sector_t inode_lookup (struct inode *, size_t idx);
+static void inode_flush_map (struct inode *);
+static void inode_relocate (struct inode *, disk_sector_t start);
+static void inode_zero_range (struct inode *, size_t from, size_t to);
+static bool inode_extend (struct inode *, off_t offset, off_t length);
+static void inode_read_ahead (struct inode *, off_t offset, off_t size);
+static off_t inode_read (struct inode *, void *, off_t size, off_t offset,
+                         bool may_bypass);
+static off_t inode_write (struct inode *, const void *, off_t size,
+                          off_t offset, bool may_bypass);
+static struct inode *inode_new (disk_sector_t);
+static bool inode_create_mem (disk_sector_t, off_t length, bool is_dir);
+static off_t inode_read_mem (struct inode *, uint8_t *, off_t size,
+                             off_t offset);
+static off_t inode_write_mem (struct inode *, const uint8_t *, off_t size,
+                              off_t offset);
+static void inode_punch_mem (struct inode *, off_t offset, off_t end);
 
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
@@ -49,62 +155,193 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
-/* Returns the minimum one among two sizes. */
-static size_t
-size_min (size_t s1, size_t s2)
-{
-  return s1 < s2 ? s1 : s2;
-}
-
-/* In-memory inode. */
+/* In-memory inode.
+   ELEM, CLOSED_ELEM and OPEN_CNT are protected by
+   open_inodes_lock, and the other mutable members by LOCK.  File
+   data itself is protected sector by sector by the buffer
+   cache.
+
+   A memory inode, one of a tmpfs, has MEM set and keeps its data
+   there instead, under LOCK.  Only the length and flags of its
+   head are used.  Nothing on disk holds it, so it stays in the
+   inode index, opened once on behalf of its directory entry,
+   until it is removed. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in inode index. */
+    struct list_elem closed_elem;       /* Element in closed list. */
     disk_sector_t sector;               /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
+    struct lock lock;                   /* Inode lock. */
+    struct lock dir_lock;               /* Directory lock, if a directory. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct inode_disk data;             /* Inode content. */
+    off_t read_ahead_pos;               /* Expected next sequential read. */
+    size_t read_ahead_window;           /* Sectors to read ahead. */
+    size_t read_ahead_end;              /* Sector index read ahead to. */
+    size_t prealloc_window;             /* Sectors to allocate ahead. */
+    int io_cnt;                         /* Reads and writes under way. */
+    struct condition io_idle;           /* Signaled when IO_CNT is 0. */
+    int deferred_cnt;                   /* Batches of writes handed off. */
+    struct condition deferred_idle;     /* Signaled when that is 0. */
+    bool meta;                          /* True if data is metadata. */
+    unsigned generation;                /* Changed by every write. */
+    bool head_dirty;                    /* Head changed since sync. */
+#ifdef INODE_INDEXED
+    struct lock map_lock;               /* Protects MAP and MAP_START. */
+    disk_sector_t *map;                 /* Copy of an index sector. */
+    size_t map_start;                   /* First block it maps, or 0. */
+#endif
+    struct tmpfs_file *mem;             /* Memory inode's data, or null. */
+    struct inode_head data;             /* Head of the on-disk inode. */
   };
 
+/* Source of inode generation numbers.  Numbers are never reused,
+   even by a later in-memory inode for the same sector, so a
+   sector and generation name the same contents for good. */
+static unsigned generation_next;
+static struct spinlock generation_lock;
+
+static unsigned next_generation (void);
+static void inode_write_head (struct inode *);
+
+/* Creation generations.  Every inode records one when created,
+   and no two inodes that a sector holds over time record the
+   same one, so that an inode number saved together with its
+   creation generation names that file and no later one.  The
+   inodes in the fixed sectors of a volume, which are never
+   reused, and those written by pintos-mkfs have 0.  Others take
+   theirs from a counter that starts at 1 and goes up for good.
+   The free map inode of volume 0 records in its own CREATE_GEN
+   how far the counter may go, raised CREATE_GEN_BATCH at a time
+   ahead of use, so that after a restart it resumes past every
+   number handed out. */
+#define CREATE_GEN_BATCH 1024
+static uint32_t create_gen_next;        /* Next to hand out. */
+static uint32_t create_gen_limit;       /* Reserved up to here. */
+static struct lock create_gen_lock;
+
+static uint32_t next_create_gen (disk_sector_t);
+
 /* Returns the disk sector that contains byte offset POS within
-   INODE.
+   INODE, taken to be LENGTH bytes long.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos, off_t length) 
 {
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode_get_sector (&inode->data, pos / DISK_SECTOR_SIZE);
+  if (pos < length)
+    return inode_lookup (inode, pos / DISK_SECTOR_SIZE);
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Index of open inodes by sector, so that opening a single inode
+   twice returns the same `struct inode'.  It also holds up to
+   CLOSED_INODE_MAX inodes closed by their last opener, in
+   CLOSED_INODES from least to most recently closed, so that
+   reopening a file soon does not read its inode again. */
+static struct hash open_inodes;
+static struct list closed_inodes;
+static size_t closed_inode_cnt;
+
+/* Protects OPEN_INODES, CLOSED_INODES and open counts, and
+   DEFERRED_CNT. */
+static struct lock open_inodes_lock;
+
+/* Batches of writes handed off to be done later, to all inodes,
+   and signaled when there are none left. */
+static int deferred_cnt;
+static struct condition deferred_idle;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("open inode index creation failed");
+  list_init (&closed_inodes);
+  closed_inode_cnt = 0;
+  lock_init (&open_inodes_lock);
+  lock_set_name (&open_inodes_lock, "open_inodes");
+  cond_init (&deferred_idle);
+  spinlock_init (&generation_lock);
+  lock_init (&create_gen_lock);
+  lock_set_name (&create_gen_lock, "create_gen");
+}
+
+/* Returns a new generation number. */
+static unsigned
+next_generation (void)
+{
+  enum intr_level old_level = spinlock_acquire (&generation_lock);
+  unsigned generation = ++generation_next;
+  spinlock_release (&generation_lock, old_level);
+  return generation;
+}
+
+/* Returns the creation generation for a new inode in SECTOR. */
+static uint32_t
+next_create_gen (disk_sector_t sector)
+{
+  uint32_t create_gen;
+
+  if (!tmpfs_is_inumber (sector) && volume_ofs (sector) <= ROOT_DIR_SECTOR)
+    return 0;
+
+  journal_begin ();
+  lock_acquire (&create_gen_lock);
+  if (create_gen_next == create_gen_limit)
+    {
+      struct inode *fm = inode_open (FREE_MAP_SECTOR);
+
+      if (fm == NULL)
+        PANIC ("can't open free map inode");
+      lock_acquire (&fm->lock);
+      if (create_gen_limit == 0)
+        create_gen_next = fm->data.create_gen > 0 ? fm->data.create_gen : 1;
+      create_gen_limit = create_gen_next + CREATE_GEN_BATCH;
+      fm->data.create_gen = create_gen_limit;
+      inode_write_head (fm);
+      lock_release (&fm->lock);
+      inode_close (fm);
+    }
+  create_gen = create_gen_next++;
+  lock_release (&create_gen_lock);
+  journal_end ();
+  return create_gen;
+}
+
+/* Writes the head of INODE, which the caller has changed, into
+   its sector in the buffer cache. */
+static void
+inode_write_head (struct inode *inode)
+{
+  buffer_cache_write_at (inode->sector, &inode->data, 0, sizeof inode->data);
+  buffer_cache_mark_meta (inode->sector);
+  inode->head_dirty = true;
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   disk.
+/* Initializes an inode with LENGTH bytes of data, a directory
+   if IS_DIR is true, and writes the new inode to sector SECTOR
+   on the file system disk.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (disk_sector_t sector, off_t length)
+inode_create (disk_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
 
   ASSERT (length >= 0);
 
+  if (tmpfs_is_inumber (sector))
+    return inode_create_mem (sector, length, is_dir);
+
   /* If this assertion fails, the inode structure is not exactly
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
@@ -112,11 +349,22 @@ inode_create (disk_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
-      if (inode_allocate (disk_inode))
+      struct inode_head *head = &disk_inode->head;
+
+      head->length = length;
+      head->magic = INODE_MAGIC;
+      head->create_gen = next_create_gen (sector);
+      if (is_dir)
+        head->flags |= INODE_DIR;
+#ifdef INODE_INDEXED
+      /* Small files start out inline. */
+      if (length <= INLINE_MAX)
+        head->flags |= INODE_INLINE;
+#endif
+      if (inode_is_inline (head) || inode_allocate (head, sector))
         {
           buffer_cache_write (sector, disk_inode);
+          buffer_cache_mark_meta (sector);
           success = true; 
         } 
       free (disk_inode);
@@ -130,45 +378,195 @@ inode_create (disk_sector_t sector, off_t length)
 struct inode *
 inode_open (disk_sector_t sector) 
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already open, or recently
+     closed. */
+  lock_acquire (&open_inodes_lock);
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      inode = hash_entry (e, struct inode, elem);
+      if (inode->open_cnt++ == 0)
         {
-          inode_reopen (inode);
-          return inode; 
+          list_remove (&inode->closed_elem);
+          closed_inode_cnt--;
         }
+      lock_release (&open_inodes_lock);
+      return inode; 
+    }
+
+  /* A memory inode not in the index no longer exists. */
+  if (tmpfs_is_inumber (sector))
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
     }
 
-  /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  /* The inode is read with open_inodes_lock held so that nobody
+     finds it in the index before it is ready. */
+  inode = inode_new (sector);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
+  buffer_cache_read_at (inode->sector, &inode->data, 0, sizeof inode->data);
+  buffer_cache_mark_meta (inode->sector);
+  lock_release (&open_inodes_lock);
+  return inode;
+}
+
+/* Opens the inode at SECTOR as inode_open() does, for a caller
+   that found SECTOR and CREATE_GEN somewhere it cannot trust,
+   such as a file written by a user program.  Returns a null
+   pointer unless SECTOR lies in a present volume and holds a
+   live inode with creation generation CREATE_GEN that is a
+   directory if IS_DIR is true or a file other than metadata
+   otherwise. */
+struct inode *
+inode_open_checked (disk_sector_t sector, uint32_t create_gen, bool is_dir)
+{
+  struct inode *inode;
+
+  /* Look before opening, so that a sector that holds no inode
+     never gets into the inode index. */
+  if (!tmpfs_is_inumber (sector))
+    {
+      int volume = volume_of (sector);
+      struct inode_head head;
+
+      if (volume >= VOLUME_CNT || !volume_present (volume)
+          || volume_ofs (sector) >= volume_size (volume))
+        return NULL;
+      buffer_cache_read_at (sector, &head, 0, sizeof head);
+      if (head.magic != INODE_MAGIC)
+        return NULL;
+    }
+
+  inode = inode_open (sector);
+  if (inode != NULL
+      && (inode->removed || inode->data.magic != INODE_MAGIC
+          || inode->data.create_gen != create_gen
+          || inode_is_dir (inode) != is_dir
+          || (!is_dir && inode->meta)))
+    {
+      inode_close (inode);
+      inode = NULL;
+    }
+  return inode;
+}
+
+/* Returns a new in-memory inode for SECTOR, opened once and in
+   the inode index, with all but its head initialized, or a null
+   pointer if memory is short.  The caller must hold
+   open_inodes_lock. */
+static struct inode *
+inode_new (disk_sector_t sector)
+{
+  struct inode *inode = malloc (sizeof *inode);
+
+  ASSERT (lock_held_by_current_thread (&open_inodes_lock));
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  if (inode == NULL)
+    return NULL;
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->elem);
   inode->open_cnt = 1;
+  lock_init (&inode->lock);
+  lock_set_name (&inode->lock, "inode");
+  lock_init (&inode->dir_lock);
+  lock_set_name (&inode->dir_lock, "directory");
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  buffer_cache_read (inode->sector, &inode->data);
+  inode->read_ahead_pos = 0;
+  inode->read_ahead_window = 0;
+  inode->read_ahead_end = 0;
+  inode->prealloc_window = 0;
+  inode->io_cnt = 0;
+  cond_init (&inode->io_idle);
+  inode->deferred_cnt = 0;
+  cond_init (&inode->deferred_idle);
+  inode->meta = false;
+  inode->generation = next_generation ();
+  inode->head_dirty = false;
+#ifdef INODE_INDEXED
+  lock_init (&inode->map_lock);
+  lock_set_name (&inode->map_lock, "inode_map");
+  inode->map = NULL;
+  inode->map_start = 0;
+#endif
+  inode->mem = NULL;
   return inode;
 }
 
+/* Creates memory inode INUMBER as inode_create() does, with its
+   data all a hole.  It counts as opened by the directory entry
+   that is to name it. */
+static bool
+inode_create_mem (disk_sector_t inumber, off_t length, bool is_dir)
+{
+  struct tmpfs_file *mem = tmpfs_file_create ();
+  uint32_t create_gen = next_create_gen (inumber);
+  struct inode *inode = NULL;
+
+  if (mem == NULL)
+    return false;
+  lock_acquire (&open_inodes_lock);
+  inode = inode_new (inumber);
+  if (inode != NULL)
+    {
+      memset (&inode->data, 0, sizeof inode->data);
+      inode->data.length = length;
+      inode->data.magic = INODE_MAGIC;
+      inode->data.create_gen = create_gen;
+      if (is_dir)
+        inode->data.flags |= INODE_DIR;
+      inode->mem = mem;
+    }
+  lock_release (&open_inodes_lock);
+  if (inode == NULL)
+    tmpfs_file_destroy (mem);
+  return inode != NULL;
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
+/* Returns INODE's creation generation, which with its inode
+   number names it and no later inode in the same sector. */
+uint32_t
+inode_create_gen (const struct inode *inode)
+{
+  return inode->data.create_gen;
+}
+
+/* Returns INODE's generation, which changes whenever INODE is
+   written. */
+unsigned
+inode_generation (struct inode *inode)
+{
+  unsigned generation;
+
+  lock_acquire (&inode->lock);
+  generation = inode->generation;
+  lock_release (&inode->lock);
+  return generation;
+}
+
 /* Returns INODE's inode number. */
 disk_sector_t
 inode_get_inumber (const struct inode *inode)
@@ -177,8 +575,11 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, keeps it among the
+   recently closed inodes, freeing the memory of the least
+   recently closed one if there are too many.
+   If INODE was also a removed inode, frees its memory and
+   blocks right away. */
 void
 inode_close (struct inode *inode) 
 {
@@ -186,14 +587,64 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
+  /* A memory inode is closed for the last time once removed,
+     and its data goes with it. */
+  if (inode->mem != NULL)
+    {
+      lock_acquire (&open_inodes_lock);
+      if (--inode->open_cnt > 0)
+        inode = NULL;
+      else
+        hash_delete (&open_inodes, &inode->elem);
+      lock_release (&open_inodes_lock);
+      if (inode != NULL)
+        {
+          ASSERT (inode->removed);
+          tmpfs_file_destroy (inode->mem);
+          free (inode);
+        }
+      return;
+    }
+
   /* Release resources if this was the last opener. */
+  journal_begin ();
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
+      /* Return blocks allocated ahead past the end of file, before
+         a new opener can read the inode again. */
+      size_t sectors = ROUND_UP (bytes_to_sectors (inode->data.length),
+                                 filesys_block_sectors);
+      if (!inode->removed
+          && inode_allocated_sectors (&inode->data) > sectors)
+        {
+          inode_release_interval (&inode->data, sectors);
+          inode_flush_map (inode);
+          inode_write_head (inode);
+        }
+
+      /* Keep in the index if not removed, and choose an inode to
+         free instead, if any. */
+      if (!inode->removed)
+        {
+          list_push_back (&closed_inodes, &inode->closed_elem);
+          if (++closed_inode_cnt <= CLOSED_INODE_MAX)
+            {
+              lock_release (&open_inodes_lock);
+              journal_end ();
+              return;
+            }
+          inode = list_entry (list_pop_front (&closed_inodes),
+                              struct inode, closed_elem);
+          closed_inode_cnt--;
+        }
+
+      /* Remove from inode index and release lock. */
+      hash_delete (&open_inodes, &inode->elem);
+      lock_release (&open_inodes_lock);
+
       /* Write data into disk and remove buffer */
       buffer_cache_remove (inode->sector);
-
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
@@ -202,8 +653,14 @@ inode_close (struct inode *inode)
           inode_release (&inode->data);
         }
 
+#ifdef INODE_INDEXED
+      free (inode->map);
+#endif
       free (inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
+  journal_end ();
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -211,27 +668,130 @@ inode_close (struct inode *inode)
 void
 inode_remove (struct inode *inode) 
 {
+  bool was_removed;
+
   ASSERT (inode != NULL);
+  lock_acquire (&inode->lock);
+  was_removed = inode->removed;
   inode->removed = true;
+  lock_release (&inode->lock);
+
+  /* Drop the opening of a memory inode by its directory entry.
+     The caller still has it open. */
+  if (inode->mem != NULL && !was_removed)
+    {
+      lock_acquire (&open_inodes_lock);
+      ASSERT (inode->open_cnt > 1);
+      inode->open_cnt--;
+      lock_release (&open_inodes_lock);
+    }
+}
+
+/* Returns true if INODE is to be deleted once closed. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_DIR) != 0;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  return inode_read (inode, buffer, size, offset, true);
+}
+
+/* Reads like inode_read_at(), but always through the buffer
+   cache, so that the cache keeps a copy of the sectors read even
+   when BUFFER is a page. */
+off_t
+inode_read_at_cached (struct inode *inode, void *buffer, off_t size,
+                      off_t offset)
+{
+  return inode_read (inode, buffer, size, offset, false);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFFSET,
+   for inode_read_at() and inode_read_at_cached().  Unless
+   MAY_BYPASS is true, the read goes through the buffer cache
+   whatever its size. */
+static off_t
+inode_read (struct inode *inode, void *buffer_, off_t size, off_t offset,
+            bool may_bypass)
 {
   uint8_t *buffer = buffer_;
+  struct cache_seg segs[CACHE_SEG_MAX];
+  size_t seg_cnt = 0;
   off_t bytes_read = 0;
+  off_t length;
+  bool direct;
+
+  if (inode->mem != NULL)
+    return inode_read_mem (inode, buffer, size, offset);
+
+  /* Large reads of file data into kernel buffers, such as pages
+     being loaded, bypass the cache for sectors it does not hold.
+     Those are not read ahead either. */
+  direct = (may_bypass && !inode->meta && size >= DIRECT_IO_MIN
+            && is_kernel_vaddr (buffer));
+
+  /* The inode lock is not held while copying, since BUFFER may
+     be a user page whose fault handler reads a file.  Files never
+     shrink, and holes are not punched while the read is counted
+     in IO_CNT, so data up to LENGTH stays in place. */
+  lock_acquire (&inode->lock);
+  length = inode->data.length;
+#ifdef INODE_INDEXED
+  if (inode_is_inline (&inode->data))
+    {
+      /* Inline data is copied under the inode lock, so a user
+         BUFFER, which could fault, gets it through a bounce
+         buffer after the lock is released. */
+      uint8_t *bounce = NULL;
+      if (offset < length)
+        {
+          bytes_read = size < length - offset ? size : length - offset;
+          if (is_user_vaddr (buffer))
+            {
+              bounce = malloc (bytes_read);
+              if (bounce == NULL)
+                bytes_read = 0;
+            }
+          buffer_cache_read_at (inode->sector,
+                                bounce != NULL ? bounce : buffer,
+                                INLINE_OFS + offset, bytes_read);
+        }
+      lock_release (&inode->lock);
+      if (bounce != NULL)
+        {
+          memcpy (buffer, bounce, bytes_read);
+          free (bounce);
+        }
+      return bytes_read;
+    }
+#endif
+  inode->io_cnt++;
+  if (!direct)
+    inode_read_ahead (inode, offset, size);
+  lock_release (&inode->lock);
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      disk_sector_t sector_idx = byte_to_sector (inode, offset, length);
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = length - offset;
       int sector_left = DISK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -240,49 +800,211 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
-        /* Read full sector directly into caller's buffer. */
-        buffer_cache_read (sector_idx, buffer + bytes_read);
-      else 
-        /* Read sector partially into caller's buffer. */
-        buffer_cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
-                              chunk_size);
+      if (direct && chunk_size == DISK_SECTOR_SIZE && sector_idx != 0)
+        {
+          /* Read full sectors contiguous on disk at once. */
+          off_t run = DISK_SECTOR_SIZE;
+          buffer_cache_read_multiple (segs, seg_cnt, inode->meta);
+          seg_cnt = 0;
+          while (size - run >= DISK_SECTOR_SIZE
+                 && length - offset - run >= DISK_SECTOR_SIZE
+                 && (byte_to_sector (inode, offset + run, length)
+                     == sector_idx + run / DISK_SECTOR_SIZE))
+            run += DISK_SECTOR_SIZE;
+          buffer_cache_read_direct (sector_idx, buffer + bytes_read,
+                                    run / DISK_SECTOR_SIZE);
+          size -= run;
+          offset += run;
+          bytes_read += run;
+          continue;
+        }
+      /* Gather the sector, or a hole, which reads as zeros, into
+         the next batch read through the cache. */
+      segs[seg_cnt].sector = sector_idx;
+      segs[seg_cnt].addr = buffer + bytes_read;
+      segs[seg_cnt].ofs = sector_ofs;
+      segs[seg_cnt].size = chunk_size;
+      if (++seg_cnt == CACHE_SEG_MAX)
+        {
+          buffer_cache_read_multiple (segs, seg_cnt, inode->meta);
+          seg_cnt = 0;
+        }
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
+  buffer_cache_read_multiple (segs, seg_cnt, inode->meta);
 
+  lock_acquire (&inode->lock);
+  if (--inode->io_cnt == 0)
+    cond_broadcast (&inode->io_idle, &inode->lock);
+  lock_release (&inode->lock);
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   A write past end of file extends the inode, and one into a
+   hole fills it.  The new length becomes visible only after the
+   data is written, so concurrent readers never see unwritten
+   bytes. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
+  uint8_t *bounce;
+
+  /* Writes that extend INODE, or go to data kept inline in it,
+     copy BUFFER under the inode lock.  A user BUFFER could fault
+     then, and the fault may need the lock to read in a page of
+     this very file, so those are copied to a kernel page first, a
+     page at a time.  Files never shrink, so other writes never
+     become such writes. */
+  if (inode->mem != NULL || !is_user_vaddr (buffer)
+      || (offset + size <= inode_length (inode)
+          && !inode_is_inline (&inode->data)))
+    return inode_write (inode, buffer, size, offset, true);
+
+  bounce = palloc_get_page (0);
+  if (bounce == NULL)
+    return 0;
+  while (bytes_written < size)
+    {
+      off_t chunk = size - bytes_written < PGSIZE ? size - bytes_written
+                                                   : PGSIZE;
+      off_t n;
+
+      memcpy (bounce, buffer + bytes_written, chunk);
+      n = inode_write (inode, bounce, chunk, offset + bytes_written, false);
+      bytes_written += n;
+      if (n < chunk)
+        break;
+    }
+  palloc_free_page (bounce);
+  return bytes_written;
+}
 
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   for inode_write_at().  Unless MAY_BYPASS is true, the write
+   goes through the buffer cache whatever its size. */
+static off_t
+inode_write (struct inode *inode, const void *buffer_, off_t size,
+             off_t offset, bool may_bypass)
+{
+  const uint8_t *buffer = buffer_;
+  struct cache_seg segs[CACHE_SEG_MAX];
+  size_t seg_cnt = 0;
+  off_t bytes_written = 0;
+  off_t length;
+  bool extending;
+  bool journaled;
+  bool direct;
+
+  if (inode->mem != NULL)
+    return inode_write_mem (inode, buffer, size, offset);
+
+  /* Large writes of file data from kernel buffers, such as memory
+     mapped pages being written back, bypass the cache for sectors
+     it does not hold, so that the page and the cache do not both
+     keep the data. */
+  direct = (may_bypass && !inode->meta && size >= DIRECT_IO_MIN
+            && is_kernel_vaddr (buffer));
+
+  /* Writes that may extend INODE change metadata, as do writes
+     to data kept inline in it.  Files never shrink, so others
+     never become extending ones, and never move their data back
+     inline. */
+  journaled = (offset + size > inode_length (inode)
+               || inode_is_inline (&inode->data));
+ retry:
+  if (journaled)
+    journal_begin ();
+
+  lock_acquire (&inode->lock);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      lock_release (&inode->lock);
+      if (journaled)
+        journal_end ();
+      return 0;
+    }
 
-  if (!inode_extend (&inode->data, inode->sector, offset + size))
-    return 0;
+#ifdef INODE_INDEXED
+  /* Inline data that still fits is written in place.  Otherwise
+     it moves to a sector first. */
+  if (inode_is_inline (&inode->data))
+    {
+      if (offset + size <= INLINE_MAX)
+        {
+          buffer_cache_write_at (inode->sector, buffer, INLINE_OFS + offset,
+                                 size);
+          buffer_cache_mark_meta (inode->sector);
+          inode->head_dirty = true;
+          if (offset + size > inode->data.length)
+            {
+              inode->data.length = offset + size;
+              inode_write_head (inode);
+            }
+          inode->generation = next_generation ();
+          lock_release (&inode->lock);
+          journal_end ();
+          return size;
+        }
+      if (!inode_uninline (inode))
+        {
+          lock_release (&inode->lock);
+          journal_end ();
+          return 0;
+        }
+    }
+#endif
+
+  /* Writes into holes change metadata too, as they fill them,
+     and so do writes to blocks shared with another file, which
+     get copies of their own first. */
+  length = inode->data.length;
+  extending = offset + size > length;
+  if (!journaled
+      && (inode_has_hole (inode, offset / DISK_SECTOR_SIZE,
+                          bytes_to_sectors (offset + size))
+          || inode_has_shared (inode, offset / DISK_SECTOR_SIZE,
+                               bytes_to_sectors (offset + size))))
+    {
+      lock_release (&inode->lock);
+      journaled = true;
+      goto retry;
+    }
+  if (journaled
+      && (!inode_extend (inode, offset, offset + size)
+          || !inode_unshare (inode, offset / DISK_SECTOR_SIZE,
+                             bytes_to_sectors (offset + size))))
+    {
+      lock_release (&inode->lock);
+      journal_end ();
+      return 0;
+    }
+  inode->io_cnt++;
+
+  /* An extending write keeps the inode lock until it publishes
+     the new length.  Other writes release it right away. */
+  if (extending)
+    length = offset + size;
+  else
+    lock_release (&inode->lock);
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      disk_sector_t sector_idx = byte_to_sector (inode, offset, length);
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = length - offset;
       int sector_left = DISK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -291,16 +1013,36 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
-        /* Write full sector directly to disk. */
-        buffer_cache_write (sector_idx, buffer + bytes_written);
-      else 
+      if (direct && chunk_size == DISK_SECTOR_SIZE)
         {
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            buffer_cache_write_at (sector_idx, buffer + bytes_written,
-                                   sector_ofs, chunk_size);
-          else
-            buffer_cache_write (sector_idx, buffer + bytes_written);
+          /* Write full sectors contiguous on disk at once. */
+          off_t run = DISK_SECTOR_SIZE;
+          buffer_cache_write_multiple (segs, seg_cnt, inode->sector,
+                                       inode->meta);
+          seg_cnt = 0;
+          while (size - run >= DISK_SECTOR_SIZE
+                 && length - offset - run >= DISK_SECTOR_SIZE
+                 && (byte_to_sector (inode, offset + run, length)
+                     == sector_idx + run / DISK_SECTOR_SIZE))
+            run += DISK_SECTOR_SIZE;
+          buffer_cache_write_direct (sector_idx, buffer + bytes_written,
+                                     run / DISK_SECTOR_SIZE, inode->sector);
+          size -= run;
+          offset += run;
+          bytes_written += run;
+          continue;
+        }
+      /* Gather the sector into the next batch written through
+         the cache. */
+      segs[seg_cnt].sector = sector_idx;
+      segs[seg_cnt].addr = (void *) (buffer + bytes_written);
+      segs[seg_cnt].ofs = sector_ofs;
+      segs[seg_cnt].size = chunk_size;
+      if (++seg_cnt == CACHE_SEG_MAX)
+        {
+          buffer_cache_write_multiple (segs, seg_cnt, inode->sector,
+                                       inode->meta);
+          seg_cnt = 0;
         }
 
       /* Advance. */
@@ -308,17 +1050,348 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-
+  buffer_cache_write_multiple (segs, seg_cnt, inode->sector, inode->meta);
+
+  /* Bump the generation once the data is in place. */
+  if (!extending)
+    lock_acquire (&inode->lock);
+  inode->generation = next_generation ();
+  if (extending)
+    inode->data.length = length;
+  if (journaled)
+    inode_write_head (inode);
+  if (--inode->io_cnt == 0)
+    cond_broadcast (&inode->io_idle, &inode->lock);
+  lock_release (&inode->lock);
+  if (journaled)
+    journal_end ();
   return bytes_written;
 }
 
+/* Punches a hole of SIZE bytes at OFFSET into INODE, up to its
+   end, which then reads as zeros.  Whole sectors in the hole are
+   released, along with the index blocks left empty, and the rest
+   is zeroed.  The length of INODE is unchanged.  Waits for reads
+   and writes under way, which count on their sectors staying in
+   place.
+   Returns false if writes to INODE are denied, or if the disk
+   is too full to give it copies of the blocks it shares with
+   another file and must zero. */
+bool
+inode_punch (struct inode *inode, off_t offset, off_t size)
+{
+  static char zeros[DISK_SECTOR_SIZE];
+  bool success = true;
+  off_t end;
+
+  ASSERT (offset >= 0 && size >= 0);
+
+  journal_begin ();
+  lock_acquire (&inode->lock);
+  while (inode->io_cnt > 0)
+    cond_wait (&inode->io_idle, &inode->lock);
+  if (inode->deny_write_cnt)
+    {
+      lock_release (&inode->lock);
+      journal_end ();
+      return false;
+    }
+
+  end = size < inode->data.length - offset ? offset + size
+        : inode->data.length;
+  if (inode->mem != NULL)
+    {
+      if (offset < end)
+        inode_punch_mem (inode, offset, end);
+    }
+  else
+#ifdef INODE_INDEXED
+  if (offset < end && inode_is_inline (&inode->data))
+    {
+      buffer_cache_write_at (inode->sector, zeros, INLINE_OFS + offset,
+                             end - offset);
+      buffer_cache_mark_meta (inode->sector);
+      inode->head_dirty = true;
+      inode->generation = next_generation ();
+    }
+  else
+#endif
+  if (offset < end)
+    {
+      /* Sectors wholly in the hole.  The last sector is, if the
+         hole reaches the end of file. */
+      size_t first = DIV_ROUND_UP (offset, DISK_SECTOR_SIZE);
+      size_t last = (end == inode->data.length ? bytes_to_sectors (end)
+                     : (size_t) end / DISK_SECTOR_SIZE);
+      off_t head_end = (off_t) first * DISK_SECTOR_SIZE;
+      disk_sector_t sector;
+
+      /* Blocks wholly in the hole.  A block reaching past the end
+         of file counts as whole, if the hole reaches the end of
+         file.  The others are zeroed in place, so they must not be
+         shared. */
+      size_t block_first = ROUND_UP (first, filesys_block_sectors);
+      size_t block_last = (end == inode->data.length
+                           ? ROUND_UP (last, filesys_block_sectors)
+                           : ROUND_DOWN (last, filesys_block_sectors));
+      if (first >= last || block_first >= block_last)
+        block_first = block_last = last;
+      if (!inode_unshare (inode, offset / DISK_SECTOR_SIZE, block_first)
+          || !inode_unshare (inode, block_last, bytes_to_sectors (end)))
+        {
+          success = false;
+          goto done;
+        }
+
+      /* Zero the partial sectors at either end. */
+      if (head_end > end)
+        head_end = end;
+      sector = byte_to_sector (inode, offset, end);
+      if (offset < head_end && sector != 0)
+        {
+          buffer_cache_write_at (sector, zeros, offset % DISK_SECTOR_SIZE,
+                                 head_end - offset);
+          buffer_cache_set_owner (sector, inode->sector);
+        }
+      if (first <= last && (off_t) last * DISK_SECTOR_SIZE < end)
+        {
+          sector = inode_lookup (inode, last);
+          if (sector != 0)
+            {
+              buffer_cache_write_at (sector, zeros, 0,
+                                     end % DISK_SECTOR_SIZE);
+              buffer_cache_set_owner (sector, inode->sector);
+            }
+        }
+
+#ifdef INODE_INDEXED
+      /* Release the whole blocks in the hole, and zero the sectors
+         of the others. */
+      if (first < last)
+        {
+          inode_zero_range (inode, first, block_first);
+          inode_zero_range (inode, block_last, last);
+          if (block_first < block_last)
+            {
+              inode_release_range (&inode->data, block_first, block_last);
+              inode_flush_map (inode);
+            }
+        }
+#else
+      /* Files of the extent layout have no holes.  Zero the
+         sectors in place instead. */
+      inode_zero_range (inode, first, last);
+#endif
+      inode_write_head (inode);
+      inode->generation = next_generation ();
+    }
+ done:
+  lock_release (&inode->lock);
+  journal_end ();
+  return success;
+}
+
+/* Writes the data of INODE still in the buffer cache to disk,
+   along with its head and index blocks unless DATA_ONLY is true
+   and they have not changed since the last sync.  The caller
+   must not be inside a journal operation. */
+void
+inode_sync (struct inode *inode, bool data_only)
+{
+  bool meta;
+
+  if (inode->mem != NULL)
+    return;
+
+  lock_acquire (&inode->lock);
+  meta = !data_only || inode->head_dirty;
+  inode->head_dirty = false;
+  lock_release (&inode->lock);
+  buffer_cache_sync (inode->sector, meta);
+}
+
+/* Moves the data blocks of INODE, if they lie in more than one
+   run on disk, into one run of free blocks near the inode, in
+   file order.  Holes stay holes.  The data is copied first, and
+   then the block pointers are switched over and the old blocks
+   released within one journal operation, so that a crash leaves
+   the file in either its old blocks or its new ones.  Reads and
+   writes of INODE wait meanwhile, so files over
+   DEFRAG_SECTORS_MAX sectors are left alone.  So are directories
+   and other metadata, whose sectors only the journal writes, and
+   files that share blocks with others, which would lose the
+   sharing.
+   Returns true if INODE was moved, false if it was not scattered
+   or no run was free. */
+bool
+inode_defrag (struct inode *inode)
+{
+  size_t sectors, data_sectors, breaks;
+  disk_sector_t start, prev;
+  uint8_t *buffer;
+  size_t i, j, k;
+  bool moved = false;
+
+  if (inode->mem != NULL)
+    return false;
+  buffer = palloc_get_page (0);
+  if (buffer == NULL)
+    return false;
+
+  journal_begin ();
+  lock_acquire (&inode->lock);
+  while (inode->io_cnt > 0)
+    cond_wait (&inode->io_idle, &inode->lock);
+  if (inode->removed || inode->meta || inode_is_dir (inode)
+      || inode_is_inline (&inode->data))
+    goto done;
+
+  /* Count the data blocks, and the ones that do not follow the
+     block before on disk. */
+  sectors = inode_allocated_sectors (&inode->data);
+  data_sectors = breaks = 0;
+  prev = 0;
+  for (i = 0; i < sectors && data_sectors <= DEFRAG_SECTORS_MAX;
+       i += filesys_block_sectors)
+    {
+      disk_sector_t sector = inode_lookup (inode, i);
+      if (sector == 0)
+        continue;
+      if (inode_has_shared (inode, i, i + 1))
+        goto done;
+      if (prev != 0 && sector != prev + filesys_block_sectors)
+        breaks++;
+      prev = sector;
+      data_sectors += filesys_block_sectors;
+    }
+  if (breaks == 0 || data_sectors > DEFRAG_SECTORS_MAX
+      || !free_map_allocate (data_sectors, inode->sector, &start))
+    goto done;
+
+  /* Copy, a page at a time.  Sectors the cache holds are copied
+     from and to it, and the rest go straight between the disk and
+     BUFFER. */
+  for (i = k = 0; i < sectors; i += filesys_block_sectors)
+    {
+      disk_sector_t sector = inode_lookup (inode, i);
+      if (sector == 0)
+        continue;
+      for (j = 0; j < filesys_block_sectors; j += PGSIZE / DISK_SECTOR_SIZE)
+        {
+          size_t cnt = filesys_block_sectors - j;
+          if (cnt > PGSIZE / DISK_SECTOR_SIZE)
+            cnt = PGSIZE / DISK_SECTOR_SIZE;
+          buffer_cache_read_direct (sector + j, buffer, cnt);
+          buffer_cache_write_direct (start + k + j, buffer, cnt,
+                                     inode->sector);
+        }
+      k += filesys_block_sectors;
+    }
+
+  inode_relocate (inode, start);
+  inode_flush_map (inode);
+  inode_write_head (inode);
+  moved = true;
+
+ done:
+  lock_release (&inode->lock);
+  journal_end ();
+  palloc_free_page (buffer);
+  return moved;
+}
+
+/* Creates at SECTOR, on the volume of INODE, a file with the
+   contents of INODE, a file of a disk file system, as a snapshot
+   of it.  Data blocks are shared between the two rather than
+   copied, with a reference added to each, and only the index
+   blocks are copied, so the cost is small next to the file's
+   size.  Each file then gets a copy of a shared block of its own
+   before it writes to the block.  Files of the extent layout,
+   whose extents cannot be split for that, have their data copied
+   instead.  Waits for writes to INODE under way, so that the
+   snapshot holds all of each or none of it.
+   Returns true if successful, false if INODE is a directory or
+   other metadata, or if the disk is full or a block of INODE is
+   shared too many times already. */
+bool
+inode_clone (struct inode *inode, disk_sector_t sector)
+{
+  struct inode_disk *disk_inode;
+  uint32_t create_gen;
+  bool success = false;
+
+  if (inode->mem != NULL)
+    return false;
+  disk_inode = malloc (sizeof *disk_inode);
+  if (disk_inode == NULL)
+    return false;
+  create_gen = next_create_gen (sector);
+
+  journal_begin ();
+  lock_acquire (&inode->lock);
+  while (inode->io_cnt > 0)
+    cond_wait (&inode->io_idle, &inode->lock);
+  if (inode->meta || inode_is_dir (inode))
+    goto done;
+
+  /* Inline data comes along with the rest of the sector. */
+  buffer_cache_read (inode->sector, disk_inode);
+  disk_inode->head = inode->data;
+  disk_inode->head.create_gen = create_gen;
+  if (!inode_is_inline (&inode->data)
+      && !inode_clone_blocks (inode, &disk_inode->head, sector))
+    goto done;
+  if (disk_inode->head.flags & INODE_SHARED)
+    {
+      inode->data.flags |= INODE_SHARED;
+      inode_write_head (inode);
+    }
+  buffer_cache_write (sector, disk_inode);
+  buffer_cache_mark_meta (sector);
+  success = true;
+
+ done:
+  lock_release (&inode->lock);
+  journal_end ();
+  free (disk_inode);
+  return success;
+}
+
+/* Marks data of INODE as file system metadata, which the buffer
+   cache keeps in preference to file data. */
+void
+inode_mark_meta (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+  inode->meta = true;
+  lock_release (&inode->lock);
+}
+
+/* Acquires the directory lock of INODE, which serializes
+   operations on the directory INODE holds.  It is separate from
+   the inode lock since those operations read and write INODE. */
+void
+inode_lock_dir (struct inode *inode)
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases the directory lock of INODE. */
+void
+inode_unlock_dir (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -327,9 +1400,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -339,374 +1414,1231 @@ inode_length (const struct inode *inode)
   return inode->data.length;
 }
 
-/* Adjusts number of sectors to allocate. */
-static size_t
-adjust_cnt (size_t alloc, size_t curr, size_t cnt)
+/* Returns true if the SIZE bytes at OFFSET in INODE all lie
+   within its data and in the buffer cache or in holes, so that
+   reading them needs no disk I/O. */
+bool
+inode_cached (struct inode *inode, off_t offset, off_t size)
 {
-  if (alloc + cnt < curr)
-    return 0;
-  if (alloc < curr)
-    return alloc + cnt - curr;
-  return cnt;
+  off_t length;
+  off_t pos;
+
+  lock_acquire (&inode->lock);
+  length = inode->data.length;
+  lock_release (&inode->lock);
+  if (offset + size > length)
+    return false;
+  if (inode->mem != NULL || inode_is_inline (&inode->data))
+    return true;
+  for (pos = offset - offset % DISK_SECTOR_SIZE; pos < offset + size;
+       pos += DISK_SECTOR_SIZE)
+    {
+      disk_sector_t sector = byte_to_sector (inode, pos, length);
+      if (sector != 0 && !buffer_cache_contains (sector))
+        return false;
+    }
+  return true;
+}
+
+/* Starts reading the sectors holding the SIZE bytes at OFFSET in
+   INODE into the buffer cache, without waiting for them, as far
+   as the read-ahead queue has room.  Bytes past the end of INODE
+   are ignored. */
+void
+inode_prefetch (struct inode *inode, off_t offset, off_t size)
+{
+  off_t length;
+  off_t pos;
+
+  lock_acquire (&inode->lock);
+  length = inode->data.length;
+  lock_release (&inode->lock);
+  if (inode->mem != NULL || inode_is_inline (&inode->data))
+    return;
+  if (size > length - offset)
+    size = length - offset;
+  for (pos = offset - offset % DISK_SECTOR_SIZE; pos < offset + size;
+       pos += DISK_SECTOR_SIZE)
+    {
+      disk_sector_t sector = byte_to_sector (inode, pos, length);
+      if (sector != 0)
+        buffer_cache_read_ahead (sector);
+    }
+}
+
+/* Returns true if writing the SIZE bytes at BUFFER to INODE at
+   OFFSET, all within one sector, would change nothing, as far as
+   can be told without disk I/O: the bytes lie within INODE, and
+   their sector is cached with the same contents or is a hole and
+   they are all zero. */
+bool
+inode_unchanged (struct inode *inode, const void *buffer, off_t size,
+                 off_t offset)
+{
+  const uint8_t *p = buffer;
+  disk_sector_t sector;
+  off_t length;
+
+  ASSERT (offset % DISK_SECTOR_SIZE + size <= DISK_SECTOR_SIZE);
+
+  lock_acquire (&inode->lock);
+  length = inode->data.length;
+  lock_release (&inode->lock);
+  if (offset + size > length || inode->mem != NULL
+      || inode_is_inline (&inode->data))
+    return false;
+  sector = byte_to_sector (inode, offset, length);
+  if (sector != 0)
+    return buffer_cache_equal (sector, buffer, offset % DISK_SECTOR_SIZE,
+                               size);
+  while (size-- > 0)
+    if (*p++ != 0)
+      return false;
+  return true;
+}
+
+/* Reads SIZE bytes from memory inode INODE into BUFFER, starting
+   at OFFSET, as inode_read_at() does.  Each page is looked up
+   under the inode lock but copied without it, since BUFFER may
+   be a user page, and IO_CNT keeps the pages in place
+   meanwhile. */
+static off_t
+inode_read_mem (struct inode *inode, uint8_t *buffer, off_t size,
+                off_t offset)
+{
+  off_t bytes_read = 0;
+  off_t length;
+
+  lock_acquire (&inode->lock);
+  length = inode->data.length;
+  inode->io_cnt++;
+  lock_release (&inode->lock);
+
+  if (size > length - offset)
+    size = length - offset;
+  while (size > 0)
+    {
+      size_t page_ofs = offset % PGSIZE;
+      off_t chunk_size = size < (off_t) (PGSIZE - page_ofs)
+                         ? size : (off_t) (PGSIZE - page_ofs);
+      uint8_t *page;
+
+      lock_acquire (&inode->lock);
+      page = tmpfs_page (inode->mem, offset / PGSIZE, false);
+      lock_release (&inode->lock);
+      if (page != NULL)
+        memcpy (buffer + bytes_read, page + page_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
+
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+
+  lock_acquire (&inode->lock);
+  if (--inode->io_cnt == 0)
+    cond_broadcast (&inode->io_idle, &inode->lock);
+  lock_release (&inode->lock);
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into memory inode INODE,
+   starting at OFFSET, as inode_write_at() does, copying as
+   inode_read_mem() does.  Pages are allocated as they are
+   written.  Returns fewer than SIZE bytes if memory runs out. */
+static off_t
+inode_write_mem (struct inode *inode, const uint8_t *buffer, off_t size,
+                 off_t offset)
+{
+  off_t bytes_written = 0;
+
+  lock_acquire (&inode->lock);
+  if (inode->deny_write_cnt)
+    {
+      lock_release (&inode->lock);
+      return 0;
+    }
+  inode->io_cnt++;
+  lock_release (&inode->lock);
+
+  while (size > 0)
+    {
+      size_t page_ofs = offset % PGSIZE;
+      off_t chunk_size = size < (off_t) (PGSIZE - page_ofs)
+                         ? size : (off_t) (PGSIZE - page_ofs);
+      uint8_t *page;
+
+      lock_acquire (&inode->lock);
+      page = tmpfs_page (inode->mem, offset / PGSIZE, true);
+      lock_release (&inode->lock);
+      if (page == NULL)
+        break;
+      memcpy (page + page_ofs, buffer + bytes_written, chunk_size);
+
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_written += chunk_size;
+    }
+
+  /* Publish the new length once the data is in place. */
+  lock_acquire (&inode->lock);
+  if (bytes_written > 0)
+    {
+      inode->generation = next_generation ();
+      if (offset > inode->data.length)
+        inode->data.length = offset;
+    }
+  if (--inode->io_cnt == 0)
+    cond_broadcast (&inode->io_idle, &inode->lock);
+  lock_release (&inode->lock);
+  return bytes_written;
+}
+
+/* Punches a hole from byte OFFSET to END into memory inode
+   INODE, as inode_punch() does, freeing the pages wholly in it
+   and zeroing the rest.  A page reaching past the end of file
+   counts as whole, if the hole reaches the end of file.  The
+   caller holds the inode lock, with no reads or writes under
+   way. */
+static void
+inode_punch_mem (struct inode *inode, off_t offset, off_t end)
+{
+  size_t first = DIV_ROUND_UP (offset, PGSIZE);
+  size_t last = (end == inode->data.length
+                 ? (size_t) DIV_ROUND_UP (end, PGSIZE)
+                 : (size_t) end / PGSIZE);
+  off_t head_end = (off_t) first * PGSIZE;
+  uint8_t *page;
+
+  if (head_end > end)
+    head_end = end;
+  page = tmpfs_page (inode->mem, offset / PGSIZE, false);
+  if (offset < head_end && page != NULL)
+    memset (page + offset % PGSIZE, 0, head_end - offset);
+  if (first <= last && (off_t) last * PGSIZE < end)
+    {
+      page = tmpfs_page (inode->mem, last, false);
+      if (page != NULL)
+        memset (page, 0, end % PGSIZE);
+    }
+  if (first < last)
+    tmpfs_free_pages (inode->mem, first, last);
+  inode->generation = next_generation ();
 }
 
-/* Allocates TARGET_SECTORS sectors to the inode DISK_INODE.
-   This does not reallocate already allocated one.
+/* Allocates sectors to save data of size DISK_INODE->LENGTH,
+   which is new and is to be written at SECTOR.
    Returns TRUE if successful, FALSE otherwise. */
 static bool
-inode_allocate_interval (struct inode_disk *disk_inode, size_t target_sectors)
+inode_allocate (struct inode_head *disk_inode, disk_sector_t sector)
 {
-  size_t curr_sectors = bytes_to_sectors (disk_inode->length);
-  if (curr_sectors >= target_sectors)
+  if (inode_allocate_range (disk_inode, 0,
+                            bytes_to_sectors (disk_inode->length), sector))
     return true;
+  inode_release (disk_inode);
+  return false;
+}
 
-  // Declare variables
-  int i;
-  disk_sector_t *pos;
-  size_t cnt;
-  size_t cnt_orig;
-  size_t alloc_sectors = 0;
-
-  // Allocate direct blocks
-  cnt_orig = size_min (target_sectors, IND_BLOCK);
-  cnt = adjust_cnt (alloc_sectors, curr_sectors, cnt_orig);
-  pos = &disk_inode->sectors[cnt_orig - cnt];
-  if (!inode_allocate_at (pos, cnt))
-    return false;
-  alloc_sectors += cnt_orig;
+/* Releases sectors controlled by DISK_INODE. It does not
+   release its own inode. */
+static void
+inode_release (struct inode_head *disk_inode)
+{
+  inode_release_interval (disk_inode, 0);
+}
 
-  // Done if all sectors are allocated
-  if (alloc_sectors == target_sectors)
-    return true;
+/* Zeroes the sectors FROM to TO - 1 of INODE that do not lie in
+   holes. */
+static void
+inode_zero_range (struct inode *inode, size_t from, size_t to)
+{
+  static char zeros[DISK_SECTOR_SIZE];
 
-  // Allocate indirect blocks
-  for (i = 0; i < DIND_BLOCK - IND_BLOCK; i++)
+  for (; from < to; from++)
     {
-      // Allocate indirect block
-      struct inode_indirect temp_ind_block;
-      disk_sector_t *ind_pos = &disk_inode->sectors[IND_BLOCK + i];
-      bool is_ind_created = false;
-      if (curr_sectors <= alloc_sectors)
-        {
-          is_ind_created = true;
-          if (!inode_allocate_at (ind_pos, 1))
-            goto fail;
-        }
-
-      // Allocate sectors
-      cnt_orig = size_min (target_sectors - alloc_sectors, SIZE_BLOCK);
-      cnt = adjust_cnt (alloc_sectors, curr_sectors, cnt_orig);
-      pos = &temp_ind_block.sectors[cnt_orig - cnt];
-      if (!inode_allocate_at (pos, cnt))
+      disk_sector_t sector = inode_lookup (inode, from);
+      if (sector != 0)
         {
-          if (is_ind_created)
-            inode_release_at (ind_pos, 1);
-          goto fail;
+          buffer_cache_write (sector, zeros);
+          buffer_cache_set_owner (sector, inode->sector);
         }
-      alloc_sectors += cnt_orig;
+    }
+}
 
-      // Wirte sector data
-      if (cnt > 0)
-        buffer_cache_write_at (*ind_pos,
-                               &temp_ind_block.sectors[cnt_orig - cnt],
-                               (cnt_orig - cnt) * sizeof (disk_sector_t),
-                               cnt * sizeof (disk_sector_t));
+/* Returns true if any of the blocks holding sectors START to
+   END - 1 of INODE is shared with another file. */
+static bool
+inode_has_shared (struct inode *inode, size_t start, size_t end)
+{
+  size_t i;
 
-      // Done if all sectors are allocated
-      if (alloc_sectors == target_sectors)
+  if ((inode->data.flags & INODE_SHARED) == 0)
+    return false;
+  for (i = ROUND_DOWN (start, filesys_block_sectors); i < end;
+       i += filesys_block_sectors)
+    {
+      disk_sector_t sector = inode_lookup (inode, i);
+      if (sector != 0 && free_map_is_shared (sector))
         return true;
     }
+  return false;
+}
+
+#ifdef INODE_INDEXED
+/* Returns the number of entries in an index block. */
+static size_t
+index_entries (void)
+{
+  return SIZE_BLOCK * filesys_block_sectors;
+}
+
+/* Returns the number of file blocks under an entry of an inode's
+   SECTORS at the given LEVEL of indirection: 0 for a data block,
+   1 for an indirect block and 2 for a doubly indirect block. */
+static size_t
+level_span (int level)
+{
+  size_t entries = index_entries ();
+
+  return level == 0 ? 1 : level == 1 ? entries : entries * entries;
+}
+
+/* Returns the level of indirection of entry SLOT of an inode's
+   SECTORS and stores into *START the index of the first file
+   block under it. */
+static int
+slot_level (size_t slot, size_t *start)
+{
+  if (slot < IND_BLOCK)
+    {
+      *start = slot;
+      return 0;
+    }
+  if (slot < DIND_BLOCK)
+    {
+      *start = IND_BLOCK + (slot - IND_BLOCK) * level_span (1);
+      return 1;
+    }
+  *start = (IND_BLOCK + (DIND_BLOCK - IND_BLOCK) * level_span (1)
+            + (slot - DIND_BLOCK) * level_span (2));
+  return 2;
+}
+
+/* Returns the entry of an inode's SECTORS under which file block
+   IDX lies, or the last entry if IDX is past the largest file. */
+static size_t
+block_slot (size_t idx)
+{
+  size_t dind_start = IND_BLOCK + (DIND_BLOCK - IND_BLOCK) * level_span (1);
+  size_t slot;
+
+  if (idx < IND_BLOCK)
+    return idx;
+  if (idx < dind_start)
+    return IND_BLOCK + (idx - IND_BLOCK) / level_span (1);
+  slot = DIND_BLOCK + (idx - dind_start) / level_span (2);
+  return slot < NUM_ADDR ? slot : NUM_ADDR - 1;
+}
+
+/* Allocates a zeroed block into *BLOCK, at *HINT if it is free,
+   and advances *HINT past it.
+   Returns TRUE if successful, FALSE if the disk is full. */
+static bool
+inode_allocate_block (disk_sector_t *block, disk_sector_t *hint)
+{
+  static char zeros[DISK_SECTOR_SIZE];
+  size_t i;
+
+  if (free_map_allocate_run (filesys_block_sectors, *hint, block) == 0)
+    return false;
+  for (i = 0; i < filesys_block_sectors; i++)
+    buffer_cache_write (*block + i, zeros);
+  *hint = *block + filesys_block_sectors;
+  return true;
+}
+
+/* Returns the sector holding file sector IDX of DISK_INODE, or 0
+   if IDX lies in a hole.  Block 0 holds the free map's inode,
+   so no file data lives there.
+   If HINT is nonnull, a hole is filled first, with a zeroed
+   block and any index blocks missing above it allocated from
+   *HINT on, and *HINT is advanced; 0 is then returned only if
+   the disk is full or IDX is past the largest file.  DISK_INODE
+   is not modified otherwise. */
+static disk_sector_t
+inode_map (struct inode_head *disk_inode, size_t idx, disk_sector_t *hint)
+{
+  size_t ofs = idx % filesys_block_sectors;
+  size_t slot = block_slot (idx / filesys_block_sectors);
+  size_t start;
+  int level = slot_level (slot, &start);
+  disk_sector_t *entry = &disk_inode->sectors[slot];
+  disk_sector_t block;
+
+  idx = idx / filesys_block_sectors - start;
+  if (idx >= level_span (level))
+    return 0;
+  if (*entry == 0 && (hint == NULL || !inode_allocate_block (entry, hint)))
+    return 0;
 
-  // Allocate doubly indirect blocks
-  for (i = 0; i < NUM_ADDR - DIND_BLOCK; i++)
+  /* Walk down the index blocks. */
+  block = *entry;
+  while (level-- > 0)
     {
-      // Allocate doubly indirect block
-      struct inode_indirect temp_dind_block;
-      disk_sector_t *dind_pos = &disk_inode->sectors[DIND_BLOCK + i];
-      bool is_dind_created = false;
-      if (curr_sectors <= alloc_sectors)
+      size_t i = idx / level_span (level);
+      disk_sector_t sector = block + i / SIZE_BLOCK;
+      off_t entry_ofs = i % SIZE_BLOCK * sizeof block;
+
+      idx %= level_span (level);
+      buffer_cache_read_at (sector, &block, entry_ofs, sizeof block);
+      buffer_cache_mark_meta (sector);
+      if (block == 0)
         {
-          is_dind_created = true;
-          if (!inode_allocate_at (dind_pos, 1))
-            goto fail;
+          if (hint == NULL || !inode_allocate_block (&block, hint))
+            return 0;
+          buffer_cache_write_at (sector, &block, entry_ofs, sizeof block);
         }
+    }
+  return block + ofs;
+}
+
+/* Returns the sector number of SECTOR_OFS-th sector of
+   DISK_INODE, or 0 if it lies in a hole. */
+static disk_sector_t
+inode_get_sector (const struct inode_head *disk_inode, off_t sector_ofs)
+{
+  return inode_map ((struct inode_head *) disk_inode, sector_ofs, NULL);
+}
+
+/* Returns true if DISK_INODE keeps its data inline. */
+static bool
+inode_is_inline (const struct inode_head *disk_inode)
+{
+  return (disk_inode->flags & INODE_INLINE) != 0;
+}
+
+/* Moves the data INODE keeps inline into a sector of its own, so
+   that it can grow past INLINE_MAX bytes.  The caller saves the
+   head of INODE.
+   Returns TRUE if successful, FALSE if the disk is full. */
+static bool
+inode_uninline (struct inode *inode)
+{
+  static char zeros[INLINE_MAX];
+  struct inode_head *disk_inode = &inode->data;
+
+  if (disk_inode->length > 0)
+    {
+      uint8_t data[INLINE_MAX];
+
+      if (!inode_allocate_range (disk_inode, 0, 1, inode->sector))
+        return false;
+      buffer_cache_read_at (inode->sector, data, INLINE_OFS,
+                            disk_inode->length);
+      buffer_cache_write_at (inode_get_sector (disk_inode, 0), data, 0,
+                             disk_inode->length);
+      buffer_cache_set_owner (inode_get_sector (disk_inode, 0),
+                              inode->sector);
+    }
+  disk_inode->flags &= ~INODE_INLINE;
+  buffer_cache_write_at (inode->sector, zeros, INLINE_OFS, INLINE_MAX);
+  return true;
+}
+
+/* Returns the number of sectors below which all sectors allocated
+   to DISK_INODE lie.  Those below it may still be holes. */
+static size_t
+inode_allocated_sectors (const struct inode_head *disk_inode)
+{
+  return disk_inode->sector_cnt;
+}
+
+/* Returns true if any of the sectors START to END - 1 of INODE
+   lies in a hole. */
+static bool
+inode_has_hole (struct inode *inode, size_t start, size_t end)
+{
+  size_t i;
+
+  if (start < end && end > inode->data.sector_cnt)
+    return true;
+  for (i = start; i < end; i++)
+    if (inode_lookup (inode, i) == 0)
+      return true;
+  return false;
+}
 
-      // Allocate indirect blocks
-      int j;
-      for (j = 0; j < SIZE_BLOCK; j++)
+/* Returns the index sector holding the entry of file block IDX,
+   which lies past the direct blocks of DISK_INODE, or 0 if its
+   index block is missing. */
+static disk_sector_t
+inode_leaf (const struct inode_head *disk_inode, size_t idx)
+{
+  size_t slot = block_slot (idx);
+  size_t start;
+  int level = slot_level (slot, &start);
+  disk_sector_t block = disk_inode->sectors[slot];
+
+  ASSERT (level > 0);
+  idx -= start;
+  if (idx >= level_span (level) || block == 0)
+    return 0;
+  if (level == 2)
+    {
+      size_t i = idx / level_span (1);
+      disk_sector_t sector = block + i / SIZE_BLOCK;
+
+      idx %= level_span (1);
+      buffer_cache_read_at (sector, &block, i % SIZE_BLOCK * sizeof block,
+                            sizeof block);
+      buffer_cache_mark_meta (sector);
+      if (block == 0)
+        return 0;
+    }
+  return block + idx / SIZE_BLOCK;
+}
+
+/* Returns the sector holding file sector IDX of INODE, or 0 if
+   it lies in a hole.  INODE keeps a copy of the last index
+   sector used, so that sequential accesses find their blocks
+   there rather than in the buffer cache.  Index sectors map
+   aligned runs of SIZE_BLOCK blocks, so a run starts at
+   IND_BLOCK or later and 0 names none. */
+static disk_sector_t
+inode_lookup (struct inode *inode, size_t idx)
+{
+  size_t block = idx / filesys_block_sectors;
+  size_t map_start;
+  disk_sector_t sector;
+
+  if (block < IND_BLOCK)
+    sector = inode->data.sectors[block];
+  else
+    {
+      map_start = block - (block - IND_BLOCK) % SIZE_BLOCK;
+      lock_acquire (&inode->map_lock);
+      if (inode->map_start != map_start)
         {
-          // Allocate indirect block
-          struct inode_indirect temp_ind_block;
-          disk_sector_t *ind_pos = &temp_dind_block.sectors[i];
-          bool is_ind_created = false;
-          if (curr_sectors <= alloc_sectors)
-            {
-              is_ind_created = true;
-              if (!inode_allocate_at (ind_pos, 1))
-                {
-                  if (j == 0 && is_dind_created)
-                    inode_release_at (dind_pos, 1);
-                  goto fail;
-                }
-            }
+          disk_sector_t leaf = inode_leaf (&inode->data, block);
 
-          // Allocate sectors
-          cnt_orig = size_min (target_sectors - alloc_sectors, SIZE_BLOCK);
-          cnt = adjust_cnt (alloc_sectors, curr_sectors, cnt_orig);
-          pos = &temp_ind_block.sectors[cnt_orig - cnt];
-          if (!inode_allocate_at (pos, cnt))
+          if (leaf == 0)
             {
-              if (is_ind_created)
-                {
-                  if (j == 0 && is_dind_created)
-                    inode_release_at (dind_pos, 1);
-                  inode_release_at (ind_pos, 1);
-                }
-              goto fail;
+              lock_release (&inode->map_lock);
+              return 0;
             }
-          alloc_sectors += cnt_orig;
-
-          // Wirte sector data
-          if (cnt > 0)
+          if (inode->map == NULL)
+            inode->map = malloc (DISK_SECTOR_SIZE);
+          if (inode->map == NULL)
             {
-              buffer_cache_write_at (*ind_pos,
-                                     &temp_ind_block.sectors[cnt_orig - cnt],
-                                     (cnt_orig - cnt) * sizeof (disk_sector_t),
-                                     cnt * sizeof (disk_sector_t));
-              if (is_ind_created)
-                buffer_cache_write_at (*dind_pos, &temp_dind_block.sectors[j],
-                                       j * sizeof (disk_sector_t),
-                                       sizeof (disk_sector_t));
+              lock_release (&inode->map_lock);
+              return inode_get_sector (&inode->data, idx);
             }
-
-          // Done if all sectors are allocated
-          if (alloc_sectors == target_sectors)
-            return true;
+          buffer_cache_read (leaf, inode->map);
+          buffer_cache_mark_meta (leaf);
+          inode->map_start = map_start;
         }
+      sector = inode->map[block - map_start];
+      lock_release (&inode->map_lock);
     }
+  return sector != 0 ? sector + idx % filesys_block_sectors : 0;
+}
 
- fail:
-  // Arrive here if allocation fails. Release allocated sectors.
-  disk_inode->length = alloc_sectors * DISK_SECTOR_SIZE;
-  inode_release_interval (disk_inode, curr_sectors);
-  return false;
+/* Empties the copy of an index block kept by INODE, after the
+   caller changed its index blocks. */
+static void
+inode_flush_map (struct inode *inode)
+{
+  lock_acquire (&inode->map_lock);
+  inode->map_start = 0;
+  lock_release (&inode->map_lock);
 }
 
-/* Allocates sectors to save data of size DISK_INODE->LENGTH.
+/* Allocates zeroed blocks to the holes among the blocks holding
+   sectors START to END - 1 of DISK_INODE, each after the one
+   before it on disk if that is free.  A block with none before
+   it is looked for after GOAL, the inode's own sector.  On
+   failure, the blocks allocated so far are kept.
    Returns TRUE if successful, FALSE otherwise. */
 static bool
-inode_allocate (struct inode_disk *disk_inode)
+inode_allocate_range (struct inode_head *disk_inode, size_t start,
+                      size_t end, disk_sector_t goal)
 {
-  off_t length = disk_inode->length;
-  size_t sectors = bytes_to_sectors (length);
-  disk_inode->length = 0;
-  bool success = inode_allocate_interval (disk_inode, sectors);
-  disk_inode->length = length;
+  size_t first = ROUND_DOWN (start, filesys_block_sectors);
+  disk_sector_t hint = goal;
+  size_t i;
+
+  end = ROUND_UP (end, filesys_block_sectors);
+  if (first > 0 && first <= disk_inode->sector_cnt)
+    {
+      disk_sector_t prev = inode_get_sector (disk_inode, first - 1);
+      if (prev != 0)
+        hint = prev + 1;
+    }
+  for (i = first; i < end; i += filesys_block_sectors)
+    {
+      disk_sector_t sector = inode_map (disk_inode, i, &hint);
+      if (sector == 0)
+        {
+          /* An index block may have been allocated for block I. */
+          if (disk_inode->sector_cnt < i + filesys_block_sectors)
+            disk_inode->sector_cnt = i + filesys_block_sectors;
+          return false;
+        }
+      hint = sector + filesys_block_sectors;
+    }
+  if (disk_inode->sector_cnt < end)
+    disk_inode->sector_cnt = end;
+  return true;
+}
+
+/* Points the entry of file block BLOCK of INODE, which is
+   allocated, at the block starting at sector SECTOR instead.
+   The caller flushes the copy of an index block INODE keeps. */
+static void
+inode_set_block (struct inode *inode, size_t block, disk_sector_t sector)
+{
+  if (block < IND_BLOCK)
+    inode->data.sectors[block] = sector;
+  else
+    {
+      disk_sector_t leaf = inode_leaf (&inode->data, block);
+      buffer_cache_write_at (leaf, &sector, ((block - IND_BLOCK)
+                                             % SIZE_BLOCK * sizeof sector),
+                             sizeof sector);
+      buffer_cache_mark_meta (leaf);
+    }
+}
+
+/* Points the data blocks of INODE, in file order, at the
+   consecutive blocks starting at sector START instead, and
+   releases the blocks they were in.  The caller has copied their
+   data.  Index blocks stay where they are. */
+static void
+inode_relocate (struct inode *inode, disk_sector_t start)
+{
+  size_t i;
+
+  for (i = 0; i < inode->data.sector_cnt; i += filesys_block_sectors)
+    {
+      disk_sector_t old = inode_lookup (inode, i);
+
+      if (old == 0)
+        continue;
+      inode_set_block (inode, i / filesys_block_sectors, start);
+      free_map_release (old, filesys_block_sectors);
+      start += filesys_block_sectors;
+    }
+}
+
+/* Gives INODE blocks of its own, with copies of their data, in
+   place of the ones it shares with other files among the blocks
+   holding sectors START to END - 1, so that it may write to
+   them.  The shared blocks lose a reference.  The caller saves
+   the head of INODE.
+   Returns TRUE if successful, FALSE if the disk is full. */
+static bool
+inode_unshare (struct inode *inode, size_t start, size_t end)
+{
+  uint8_t *buffer = NULL;
+  bool success = true;
+  size_t i, j;
+
+  if ((inode->data.flags & INODE_SHARED) == 0)
+    return true;
+  for (i = ROUND_DOWN (start, filesys_block_sectors); i < end && success;
+       i += filesys_block_sectors)
+    {
+      disk_sector_t old = inode_lookup (inode, i);
+      disk_sector_t new;
+
+      if (old == 0 || !free_map_is_shared (old))
+        continue;
+      if (buffer == NULL)
+        buffer = malloc (DISK_SECTOR_SIZE);
+      if (buffer == NULL
+          || !free_map_allocate (filesys_block_sectors, inode->sector, &new))
+        {
+          success = false;
+          break;
+        }
+      for (j = 0; j < filesys_block_sectors; j++)
+        {
+          buffer_cache_read (old + j, buffer);
+          buffer_cache_write (new + j, buffer);
+          buffer_cache_set_owner (new + j, inode->sector);
+        }
+      inode_set_block (inode, i / filesys_block_sectors, new);
+      inode_flush_map (inode);
+      free_map_release (old, filesys_block_sectors);
+    }
+  free (buffer);
   return success;
 }
 
-/* Allocates CNT sectors and saves their sector numbers at
-   *SECTORP_ to *(SECTORP_ + CNT).
+/* Makes *ENTRY, an entry at LEVEL of indirection copied from
+   another inode, name blocks of the inode whose sector is GOAL
+   as well: a data block gets another reference, and an index
+   block is copied, with its entries made to do the same in
+   turn.  On failure, *ENTRY and the entries under it are left
+   naming just the blocks that did, or 0, so that they can be
+   released.
    Returns TRUE if successful, FALSE otherwise. */
 static bool
-inode_allocate_at (disk_sector_t *sectorp_, size_t cnt_)
+inode_share_entry (disk_sector_t *entry, int level, disk_sector_t goal)
 {
-  disk_sector_t *sectorp = sectorp_;
-  size_t cnt = cnt_;
-
-  size_t size = cnt;
-  disk_sector_t temp_sector;
   static char zeros[DISK_SECTOR_SIZE];
+  disk_sector_t copy;
+  bool success = true;
+  size_t s, i;
+
+  if (*entry == 0)
+    return true;
+  if (level == 0)
+    {
+      if (free_map_share (*entry, filesys_block_sectors))
+        return true;
+      *entry = 0;
+      return false;
+    }
+  if (!free_map_allocate (filesys_block_sectors, goal, &copy))
+    {
+      *entry = 0;
+      return false;
+    }
 
-  while (cnt > 0)
+  /* Go through the index block an entry at a time, rather than
+     keep a sector of it on the stack at each level. */
+  for (s = 0; s < filesys_block_sectors; s++)
     {
-      size = free_map_allocate_r (&cnt, size, &temp_sector);
-      if (size == 0)
+      buffer_cache_write (copy + s, zeros);
+      buffer_cache_mark_meta (copy + s);
+      for (i = 0; i < SIZE_BLOCK && success; i++)
         {
-          inode_release_at (sectorp_, cnt_ - cnt);
-          return false;
+          disk_sector_t sector;
+
+          buffer_cache_read_at (*entry + s, &sector, i * sizeof sector,
+                                sizeof sector);
+          if (sector == 0)
+            continue;
+          success = inode_share_entry (&sector, level - 1, goal);
+          buffer_cache_write_at (copy + s, &sector, i * sizeof sector,
+                                 sizeof sector);
         }
+    }
+  *entry = copy;
+  return success;
+}
+
+/* Makes DISK_INODE, a copy of the head of INODE for the new
+   inode at SECTOR, share the data blocks of INODE, with index
+   blocks of its own.
+   Returns TRUE if successful, FALSE otherwise. */
+static bool
+inode_clone_blocks (struct inode *inode UNUSED,
+                    struct inode_head *disk_inode, disk_sector_t sector)
+{
+  size_t slot;
+
+  for (slot = 0; slot < NUM_ADDR; slot++)
+    {
+      size_t start;
+      int level = slot_level (slot, &start);
 
-      size_t i;
-      for (i = 0; i < size; i++)
+      if (!inode_share_entry (&disk_inode->sectors[slot], level, sector))
         {
-          *sectorp++ = temp_sector;
-          buffer_cache_write (temp_sector++, zeros);
+          while (++slot < NUM_ADDR)
+            disk_inode->sectors[slot] = 0;
+          inode_release (disk_inode);
+          return false;
         }
     }
-
+  disk_inode->flags |= INODE_SHARED;
   return true;
 }
 
-/* Releases sectors controlled by DISK_INODE followed after
-   CURR_SECTORS. */
+/* Releases the allocated blocks among blocks FROM to TO - 1 of
+   the ones under *ENTRY, an entry at LEVEL of indirection, and
+   the index blocks left with no entries.  *ENTRY becomes 0 if it
+   is released. */
 static void
-inode_release_interval (struct inode_disk *disk_inode, size_t curr_sectors)
-{
-  int i;
-  disk_sector_t *pos;
-  size_t cnt;
-  size_t cnt_orig;
-  size_t target_sectors = bytes_to_sectors (disk_inode->length);
-  size_t alloc_sectors = 0;
-
-  // Release direct blocks
-  cnt_orig = size_min (target_sectors, IND_BLOCK);
-  cnt = adjust_cnt (alloc_sectors, curr_sectors, cnt_orig);
-  pos = &disk_inode->sectors[cnt_orig - cnt];
-  inode_release_at (pos, cnt);
-  alloc_sectors += cnt_orig;
-
-  // Done if all sectors are released
-  if (alloc_sectors == target_sectors)
+inode_release_entry (disk_sector_t *entry, int level, size_t from,
+                     size_t to)
+{
+  if (*entry == 0)
     return;
-
-  // Release indirect blocks
-  for (i = 0; i < DIND_BLOCK - IND_BLOCK; i++)
+  if (level > 0)
     {
-      // Read indirect block
-      struct inode_indirect temp_ind_block;
-      disk_sector_t *ind_pos = &disk_inode->sectors[IND_BLOCK + i];
-      buffer_cache_read (*ind_pos, &temp_ind_block);
-
-      // Release sectors
-      cnt_orig = size_min (target_sectors - alloc_sectors, SIZE_BLOCK);
-      cnt = adjust_cnt (alloc_sectors, curr_sectors, cnt_orig);
-      pos = &temp_ind_block.sectors[cnt_orig - cnt];
-      inode_release_at (pos, cnt);
-      alloc_sectors += cnt_orig;
+      struct inode_indirect block;
+      size_t span = level_span (level - 1);
+      bool empty = true;
+      size_t s, i;
+
+      /* Go through the index block a sector at a time.  Changed
+         sectors are written back even if the block turns out to
+         be empty and is released. */
+      for (s = 0; s < filesys_block_sectors; s++)
+        {
+          bool changed = false;
 
-      // Release indirect block
-      inode_release_at (ind_pos, 1);
+          buffer_cache_read (*entry + s, &block);
+          for (i = 0; i < SIZE_BLOCK; i++)
+            {
+              size_t lo = (s * SIZE_BLOCK + i) * span;
+              size_t hi = lo + span;
+              if (from < hi && lo < to && block.sectors[i] != 0)
+                {
+                  inode_release_entry (&block.sectors[i], level - 1,
+                                       (from > lo ? from : lo) - lo,
+                                       (to < hi ? to : hi) - lo);
+                  changed = true;
+                }
+              if (block.sectors[i] != 0)
+                empty = false;
+            }
+          if (changed)
+            {
+              buffer_cache_write (*entry + s, &block);
+              buffer_cache_mark_meta (*entry + s);
+            }
+        }
 
-      if (alloc_sectors == target_sectors)
+      /* Keep the block if it still points to blocks. */
+      if (!empty)
         return;
     }
+  free_map_release (*entry, filesys_block_sectors);
+  *entry = 0;
+}
 
-  // Release doubly indirect blocks
-  for (i = 0; i < NUM_ADDR - DIND_BLOCK; i++)
+/* Releases the allocated blocks wholly among sectors FROM to
+   TO - 1 of DISK_INODE, along with index blocks left with no
+   entries. */
+static void
+inode_release_range (struct inode_head *disk_inode, size_t from, size_t to)
+{
+  size_t slot;
+
+  from = DIV_ROUND_UP (from, filesys_block_sectors);
+  to /= filesys_block_sectors;
+  for (slot = 0; slot < NUM_ADDR; slot++)
     {
-      // Read doubly indirect block
-      struct inode_indirect temp_dind_block;
-      disk_sector_t *dind_pos = &disk_inode->sectors[DIND_BLOCK + i];
-      buffer_cache_read (*dind_pos, &temp_dind_block);
+      size_t start;
+      int level = slot_level (slot, &start);
+      size_t end = start + level_span (level);
+      if (from < end && start < to)
+        inode_release_entry (&disk_inode->sectors[slot], level,
+                             (from > start ? from : start) - start,
+                             (to < end ? to : end) - start);
+    }
+}
 
-      // Release indirect blocks in doubly indirect block
-      int j;
-      for (j = 0; j < SIZE_BLOCK; j++)
-        {
-          // Read indirect block
-          struct inode_indirect temp_ind_block;
-          disk_sector_t *ind_pos = &temp_dind_block.sectors[i];
-          buffer_cache_read (*ind_pos, &temp_ind_block);
+/* Releases blocks of DISK_INODE after the ones holding the first
+   CURR_SECTORS sectors, along with indirect blocks left with no
+   blocks to point to. */
+static void
+inode_release_interval (struct inode_head *disk_inode, size_t curr_sectors)
+{
+  curr_sectors = ROUND_UP (curr_sectors, filesys_block_sectors);
+  if (curr_sectors >= disk_inode->sector_cnt)
+    return;
+  inode_release_range (disk_inode, curr_sectors, disk_inode->sector_cnt);
+  disk_inode->sector_cnt = curr_sectors;
+}
+
+#else
+/* Returns false, since files of this layout have no room for
+   inline data. */
+static bool
+inode_is_inline (const struct inode_head *disk_inode UNUSED)
+{
+  return false;
+}
 
-          // Release sectors
-          cnt_orig = size_min (target_sectors - alloc_sectors, SIZE_BLOCK);
-          cnt = adjust_cnt (alloc_sectors, curr_sectors, cnt_orig);
-          pos = &temp_ind_block.sectors[cnt_orig - cnt];
-          inode_release_at (pos, cnt);
-          alloc_sectors += cnt_orig;
+/* Returns the number of sectors allocated to DISK_INODE. */
+static size_t
+inode_allocated_sectors (const struct inode_head *disk_inode)
+{
+  const struct extent *e;
 
-          // Release indirect block
-          inode_release_at (ind_pos, 1);
+  if (disk_inode->extent_cnt == 0)
+    return 0;
+  e = &disk_inode->extents[disk_inode->extent_cnt - 1];
+  return e->ofs + e->cnt;
+}
 
-          if (alloc_sectors == target_sectors)
-            {
-              inode_release_at (dind_pos, 1);
-              return;
-            }
+/* Returns true if any of the sectors START to END - 1 of
+   INODE is unallocated.  Files of this layout have no holes,
+   so only sectors past the allocated ones are. */
+static bool
+inode_has_hole (struct inode *inode, size_t start, size_t end)
+{
+  return start < end && end > inode_allocated_sectors (&inode->data);
+}
+
+/* Returns the sector holding file sector IDX of INODE.  Extents
+   are searched in memory, so nothing is cached. */
+static disk_sector_t
+inode_lookup (struct inode *inode, size_t idx)
+{
+  return inode_get_sector (&inode->data, idx);
+}
+
+/* Does nothing, as INODE keeps no copy of index blocks. */
+static void
+inode_flush_map (struct inode *inode UNUSED)
+{
+}
+
+/* Allocates sectors to DISK_INODE until it has the first END,
+   zeroing them, which covers sectors START to END - 1 since
+   files of this layout have no holes.  Each run is taken right
+   after the last extent if possible, growing that extent, and as
+   long as possible otherwise, the first one after GOAL, the
+   inode's own sector.  Runs are whole blocks, so more
+   than END sectors may be allocated.
+   Returns TRUE if successful, FALSE otherwise. */
+static bool
+inode_allocate_range (struct inode_head *disk_inode, size_t start UNUSED,
+                      size_t end, disk_sector_t goal)
+{
+  size_t target_sectors = end;
+  static char zeros[DISK_SECTOR_SIZE];
+  size_t orig_sectors = inode_allocated_sectors (disk_inode);
+  size_t curr_sectors = orig_sectors;
+
+  while (curr_sectors < target_sectors)
+    {
+      struct extent *last = NULL;
+      disk_sector_t hint = goal;
+      disk_sector_t sector;
+      size_t cnt, i;
+
+      if (disk_inode->extent_cnt > 0)
+        {
+          last = &disk_inode->extents[disk_inode->extent_cnt - 1];
+          hint = last->start + last->cnt;
+        }
+      cnt = free_map_allocate_run (target_sectors - curr_sectors, hint,
+                                   &sector);
+      if (cnt == 0)
+        goto fail;
+
+      if (last != NULL && sector == hint)
+        last->cnt += cnt;
+      else if (disk_inode->extent_cnt < EXTENT_CNT)
+        {
+          struct extent *e = &disk_inode->extents[disk_inode->extent_cnt++];
+          e->ofs = curr_sectors;
+          e->start = sector;
+          e->cnt = cnt;
+        }
+      else
+        {
+          free_map_release (sector, cnt);
+          goto fail;
         }
 
-      // Release doubly indirect block
-      inode_release_at (dind_pos, 1);
+      for (i = 0; i < cnt; i++)
+        buffer_cache_write (sector + i, zeros);
+      curr_sectors += cnt;
     }
+  return true;
+
+ fail:
+  inode_release_interval (disk_inode, orig_sectors);
+  return false;
 }
 
-/* Releases sectors controlled by DISK_INODE. It does not
-   release its own inode. */
+/* Makes the extents of INODE one extent starting at sector
+   START instead, and releases the sectors they were in.  The
+   caller has copied their data. */
 static void
-inode_release (struct inode_disk *disk_inode)
+inode_relocate (struct inode *inode, disk_sector_t start)
 {
-  inode_release_interval (disk_inode, 0);
+  struct inode_head *disk_inode = &inode->data;
+  size_t sectors = inode_allocated_sectors (disk_inode);
+  size_t i;
+
+  for (i = 0; i < disk_inode->extent_cnt; i++)
+    free_map_release (disk_inode->extents[i].start,
+                      disk_inode->extents[i].cnt);
+  disk_inode->extents[0].ofs = 0;
+  disk_inode->extents[0].start = start;
+  disk_inode->extents[0].cnt = sectors;
+  disk_inode->extent_cnt = 1;
 }
 
-/* Releases CNT sectors of numbers given by from *SECTORP to
-   *(SECTORP + CNT - 1). It also sets corresponding disk_sector
-   sector entry as 0. */
-static void
-inode_release_at (disk_sector_t *sectorp, size_t cnt)
+/* Does nothing, as files of this layout share no blocks. */
+static bool
+inode_unshare (struct inode *inode UNUSED, size_t start UNUSED,
+               size_t end UNUSED)
+{
+  return true;
+}
+
+/* Gives DISK_INODE, a copy of the head of INODE for the new
+   inode at SECTOR, extents of its own with a copy of the data of
+   INODE.  Sharing them would mean splitting an extent on every
+   write to one of its blocks, for which there may not be room
+   in the inode.
+   Returns TRUE if successful, FALSE if the disk is full. */
+static bool
+inode_clone_blocks (struct inode *inode, struct inode_head *disk_inode,
+                    disk_sector_t sector)
 {
+  size_t sectors = inode_allocated_sectors (disk_inode);
+  uint8_t *buffer;
   size_t i;
-  for (i = 0; i < cnt; i++)
+
+  disk_inode->extent_cnt = 0;
+  if (!inode_allocate_range (disk_inode, 0, sectors, sector))
+    return false;
+  buffer = palloc_get_page (0);
+  if (buffer == NULL)
+    {
+      inode_release (disk_inode);
+      return false;
+    }
+
+  /* Copy a page at a time, or up to where either file's sectors
+     stop being contiguous. */
+  for (i = 0; i < sectors; )
+    {
+      disk_sector_t from = inode_lookup (inode, i);
+      disk_sector_t to = inode_get_sector (disk_inode, i);
+      size_t cnt = 1;
+
+      while (cnt < PGSIZE / DISK_SECTOR_SIZE && i + cnt < sectors
+             && inode_lookup (inode, i + cnt) == from + cnt
+             && inode_get_sector (disk_inode, i + cnt) == to + cnt)
+        cnt++;
+      buffer_cache_read_direct (from, buffer, cnt);
+      buffer_cache_write_direct (to, buffer, cnt, sector);
+      i += cnt;
+    }
+  palloc_free_page (buffer);
+  return true;
+}
+
+/* Releases blocks of DISK_INODE after the ones holding the first
+   CURR_SECTORS sectors. */
+static void
+inode_release_interval (struct inode_head *disk_inode, size_t curr_sectors)
+{
+  curr_sectors = ROUND_UP (curr_sectors, filesys_block_sectors);
+  while (disk_inode->extent_cnt > 0)
     {
-      free_map_release (*sectorp, 1);
-      *sectorp++ = 0;
+      struct extent *e = &disk_inode->extents[disk_inode->extent_cnt - 1];
+      if (e->ofs + e->cnt <= curr_sectors)
+        break;
+      if (e->ofs >= curr_sectors)
+        {
+          free_map_release (e->start, e->cnt);
+          disk_inode->extent_cnt--;
+        }
+      else
+        {
+          size_t keep = curr_sectors - e->ofs;
+          free_map_release (e->start + keep, e->cnt - keep);
+          e->cnt = keep;
+        }
     }
 }
 
 /* Returns the sector number of SECTOR_OFS-th sector of
-   DISK_INODE. */
+   DISK_INODE, found by binary search over its extents. */
 static disk_sector_t
-inode_get_sector (const struct inode_disk *disk_inode, off_t sector_ofs)
-{
-  // Get from direct block
-  if (sector_ofs < IND_BLOCK)
-    return disk_inode->sectors[sector_ofs];
-  sector_ofs -= IND_BLOCK;
-
-  // Get from indirect block
-  off_t ind_ofs = sector_ofs / SIZE_BLOCK;
-  if (ind_ofs < DIND_BLOCK - IND_BLOCK)
-    {
-      struct inode_indirect temp_ind_block;
-      disk_sector_t ind_pos = disk_inode->sectors[IND_BLOCK + ind_ofs];
-      buffer_cache_read (ind_pos, &temp_ind_block);
-      return temp_ind_block.sectors[sector_ofs % SIZE_BLOCK];
-    }
-  sector_ofs -= (DIND_BLOCK - IND_BLOCK) * SIZE_BLOCK;
-
-  // Get from doubly indirect block
-  off_t dind_ofs = sector_ofs / (SIZE_BLOCK * SIZE_BLOCK);
-  struct inode_indirect temp_dind_block;
-  disk_sector_t dind_pos = disk_inode->sectors[DIND_BLOCK + dind_ofs];
-  buffer_cache_read (dind_pos, &temp_dind_block);
-  sector_ofs = sector_ofs % (SIZE_BLOCK * SIZE_BLOCK);
-
-  ind_ofs = sector_ofs / SIZE_BLOCK;
-  struct inode_indirect temp_ind_block;
-  disk_sector_t ind_pos = temp_dind_block.sectors[ind_ofs];
-  buffer_cache_read (ind_pos, &temp_ind_block);
-  return temp_ind_block.sectors[sector_ofs % SIZE_BLOCK];
-}
-
-/* Extends number of allocated sectors upto available number
-   to store DISK_INODE->LENGTH data and then saves extended
-   length by LENGTH. It also updates sector at SECTOR with
-   updated DISK_INODE.
+inode_get_sector (const struct inode_head *disk_inode, off_t sector_ofs)
+{
+  size_t lo = 0;
+  size_t hi = disk_inode->extent_cnt;
+
+  ASSERT (sector_ofs >= 0);
+
+  while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      const struct extent *e = &disk_inode->extents[mid];
+      if ((uint32_t) sector_ofs < e->ofs)
+        hi = mid;
+      else if ((uint32_t) sector_ofs >= e->ofs + e->cnt)
+        lo = mid + 1;
+      else
+        return e->start + (sector_ofs - e->ofs);
+    }
+  NOT_REACHED ();
+}
+#endif
+
+/* Allocates the sectors INODE lacks to store the bytes from
+   OFFSET up to LENGTH, for a write there.  Sectors a write past
+   end of file skips over are left as holes.
+   Appends at end of file allocate a preallocation window of
+   sectors ahead, which doubles on each such allocation from
+   PREALLOC_WINDOW_MIN up to PREALLOC_WINDOW_MAX sectors, so that
+   later appends find their sectors allocated and contiguous.
+   The length of INODE is left unchanged; the caller updates it
+   and saves INODE once the new data is written.
    Returns TRUE if successful, FALSE otherwise. */
 static bool
-inode_extend (struct inode_disk *disk_inode, disk_sector_t sector, off_t length)
+inode_extend (struct inode *inode, off_t offset, off_t length)
 {
-  disk_sector_t sector_curr = bytes_to_sectors (disk_inode->length);
-  disk_sector_t sector_max = bytes_to_sectors (length);
+  size_t start = offset / DISK_SECTOR_SIZE;
+  size_t sectors = bytes_to_sectors (length);
+  bool success;
 
-  // If no more sector is needed, just update length
-  if (sector_max <= sector_curr)
+  if (!inode_has_hole (inode, start, sectors))
+    return true;
+
+  /* Adjust the window.  Filling holes leaves it alone. */
+  if (length > inode->data.length)
     {
-      if (disk_inode->length < length)
+      if (offset <= inode->data.length)
         {
-          disk_inode->length = length;
-          buffer_cache_write (sector, disk_inode);
+          if (inode->prealloc_window == 0)
+            inode->prealloc_window = PREALLOC_WINDOW_MIN;
+          else if (inode->prealloc_window < PREALLOC_WINDOW_MAX)
+            inode->prealloc_window *= 2;
         }
-      return true;
+      else
+        inode->prealloc_window = 0;
+
+      success = (inode->prealloc_window > 0
+                 && inode_allocate_range (&inode->data, start,
+                                          sectors + inode->prealloc_window,
+                                          inode->sector));
+    }
+  else
+    success = false;
+  if (!success)
+    success = inode_allocate_range (&inode->data, start, sectors,
+                                    inode->sector);
+  inode_flush_map (inode);
+  return success;
+}
+
+/* Detects sequential reads of INODE and reads ahead the sectors
+   following a read of SIZE bytes at OFFSET.  The read-ahead
+   window doubles on each sequential read up to
+   READ_AHEAD_WINDOW_MAX sectors and is closed on a random
+   read. */
+static void
+inode_read_ahead (struct inode *inode, off_t offset, off_t size)
+{
+  if (size <= 0)
+    return;
+
+  /* Adjust the window. */
+  if (offset == inode->read_ahead_pos && offset != 0)
+    {
+      if (inode->read_ahead_window == 0)
+        inode->read_ahead_window = 1;
+      else if (inode->read_ahead_window < READ_AHEAD_WINDOW_MAX)
+        inode->read_ahead_window *= 2;
     }
+  else
+    {
+      inode->read_ahead_window = 0;
+      inode->read_ahead_end = 0;
+    }
+  inode->read_ahead_pos = offset + size;
+  if (inode->read_ahead_window == 0)
+    return;
 
-  // Allocate new sectors
-  bool success = inode_allocate_interval (disk_inode, sector_max);
-  if (success)
+  /* Queue sectors after this read not yet queued, within the
+     window and the file. */
+  size_t start = bytes_to_sectors (offset + size);
+  size_t end = start + inode->read_ahead_window;
+  size_t length = bytes_to_sectors (inode_length (inode));
+  if (start < inode->read_ahead_end)
+    start = inode->read_ahead_end;
+  if (end > length)
+    end = length;
+  for (; start < end; start++)
     {
-      disk_inode->length = length;
-      buffer_cache_write (sector, disk_inode);
+      disk_sector_t sector = inode_lookup (inode, start);
+      if (sector != 0)
+        buffer_cache_read_ahead (sector);
     }
-  return success;
+  if (inode->read_ahead_end < end)
+    inode->read_ahead_end = end;
+}
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  struct inode *inode = hash_entry (e, struct inode, elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if inode E1 precedes E2. */
+static bool
+inode_less (const struct hash_elem *e1, const struct hash_elem *e2,
+            void *aux UNUSED)
+{
+  struct inode *inode1 = hash_entry (e1, struct inode, elem);
+  struct inode *inode2 = hash_entry (e2, struct inode, elem);
+  return inode1->sector < inode2->sector;
+}
+
+/* Notes that a batch of writes to INODE is handed off, to be
+   made later with inode_write_at() by a caller that keeps INODE
+   open and then calls inode_deferred_done().  Until then,
+   inode_wait_deferred() waits, so that the file's later readers
+   and writers see the writes in order. */
+void
+inode_defer_writes (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+  inode->deferred_cnt++;
+  lock_release (&inode->lock);
+
+  lock_acquire (&open_inodes_lock);
+  deferred_cnt++;
+  lock_release (&open_inodes_lock);
+}
+
+/* Notes that a batch of writes to INODE handed off by
+   inode_defer_writes() is made. */
+void
+inode_deferred_done (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+  ASSERT (inode->deferred_cnt > 0);
+  if (--inode->deferred_cnt == 0)
+    cond_broadcast (&inode->deferred_idle, &inode->lock);
+  lock_release (&inode->lock);
+
+  lock_acquire (&open_inodes_lock);
+  if (--deferred_cnt == 0)
+    cond_broadcast (&deferred_idle, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
+}
+
+/* Waits until the writes to INODE handed off by
+   inode_defer_writes() are made.  Checking without the lock
+   first keeps this cheap in the usual case of there being
+   none. */
+void
+inode_wait_deferred (struct inode *inode)
+{
+  if (inode->deferred_cnt == 0)
+    return;
+  lock_acquire (&inode->lock);
+  while (inode->deferred_cnt > 0)
+    cond_wait (&inode->deferred_idle, &inode->lock);
+  lock_release (&inode->lock);
+}
+
+/* Waits until every write handed off by inode_defer_writes() is
+   made, so that the buffer cache holds them all. */
+void
+inode_wait_all_deferred (void)
+{
+  lock_acquire (&open_inodes_lock);
+  while (deferred_cnt > 0)
+    cond_wait (&deferred_idle, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
 }
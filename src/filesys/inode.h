@@ -8,16 +8,39 @@
 struct bitmap;
 
 void inode_init (void);
-bool inode_create (disk_sector_t, off_t);
+bool inode_create (disk_sector_t, off_t, bool is_dir);
 struct inode *inode_open (disk_sector_t);
+struct inode *inode_open_checked (disk_sector_t, uint32_t create_gen,
+                                  bool is_dir);
 struct inode *inode_reopen (struct inode *);
 disk_sector_t inode_get_inumber (const struct inode *);
+uint32_t inode_create_gen (const struct inode *);
+unsigned inode_generation (struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_is_removed (const struct inode *);
+bool inode_is_dir (const struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_at_cached (struct inode *, void *, off_t size,
+                            off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+bool inode_punch (struct inode *, off_t offset, off_t size);
+void inode_sync (struct inode *, bool data_only);
+bool inode_defrag (struct inode *);
+bool inode_clone (struct inode *, disk_sector_t);
+void inode_mark_meta (struct inode *);
+void inode_lock_dir (struct inode *);
+void inode_unlock_dir (struct inode *);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+bool inode_cached (struct inode *, off_t offset, off_t size);
+void inode_prefetch (struct inode *, off_t offset, off_t size);
+bool inode_unchanged (struct inode *, const void *, off_t size,
+                      off_t offset);
+void inode_defer_writes (struct inode *);
+void inode_deferred_done (struct inode *);
+void inode_wait_deferred (struct inode *);
+void inode_wait_all_deferred (void);
 
 #endif /* filesys/inode.h */
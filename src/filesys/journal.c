@@ -0,0 +1,288 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/volume.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Identifies a journal. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Number of log writes submitted at once. */
+#define JOURNAL_BATCH 16
+
+/* The journal is a header sector at JOURNAL_SECTOR followed by
+   JOURNAL_BLOCKS sectors of log.  A transaction is committed by
+   writing its sectors to the log and then the header listing
+   their home sectors, and it is finished by clearing the header
+   once they are written in place.  Recovery replays a header
+   that was not cleared.  Disk write caches are flushed before
+   the header is written, so that it never names a log the disk
+   has not kept, and after, so that the commit is durable; and
+   before the header is cleared, so that the sectors are kept in
+   place first.
+
+   The header is read before anything else on the disk, so it
+   also records the block size the disk was formatted with, the
+   volume it was formatted as, and the chunk size if the volume
+   is striped.  The header lies in the first chunk of a striped
+   volume, on its first disk, whatever the chunk size.
+
+   Every volume has its own journal, which logs only that
+   volume's sectors.  No file system operation changes more than
+   one volume, so a transaction that spans volumes can be
+   committed on each one separately.
+
+   Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t block_sectors;             /* Sectors per block. */
+    uint32_t volume;                    /* Volume number. */
+    uint32_t chunk_sectors;             /* Sectors per chunk, or 0. */
+    uint32_t cnt;                       /* Number of sectors logged. */
+    disk_sector_t sectors[JOURNAL_BLOCKS];  /* Home sectors. */
+  };
+
+/* Journal of a volume. */
+struct journal
+  {
+    bool enabled;               /* False if formatted without one. */
+    struct journal_header header;   /* Written by committer only. */
+  };
+
+static struct journal journals[VOLUME_CNT];
+
+/* Operations in progress and whether new ones must wait for a
+   commit, protected by journal_lock. */
+static struct lock journal_lock;
+static struct condition journal_idle;
+static struct condition journal_unblocked;
+static int journal_active;
+static bool journal_blocked;
+
+static void journal_write_log (int volume, const disk_sector_t[],
+                               void *const[], size_t cnt);
+static void journal_recover (int volume);
+
+/* Initializes the journal module. */
+void
+journal_init (void)
+{
+  ASSERT (sizeof (struct journal_header) == DISK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  cond_init (&journal_idle);
+  cond_init (&journal_unblocked);
+  journal_active = 0;
+  journal_blocked = false;
+}
+
+/* Opens the journal of VOLUME, which must be attached, writing
+   an empty one if FORMAT is true.  Otherwise, replays a
+   committed transaction.  For volume 0, sets
+   filesys_block_sectors from the header; any other volume must
+   have been formatted with the same block size, as that volume,
+   and with a journal.  A volume must also be striped as it was
+   formatted.  Returns true if successful, false if the volume
+   cannot be used.  Must run before anything on VOLUME is
+   read through the buffer cache. */
+bool
+journal_open (int volume, bool format)
+{
+  struct journal *j = &journals[volume];
+  struct journal_header *h = &j->header;
+
+  ASSERT (volume_present (volume));
+
+  if (format)
+    {
+      memset (h, 0, sizeof *h);
+      h->magic = JOURNAL_MAGIC;
+      h->block_sectors = filesys_block_sectors;
+      h->volume = volume;
+      h->chunk_sectors = volume == 0 ? volume_chunk_sectors : 0;
+      volume_write (volume_sector (volume, JOURNAL_SECTOR), h, 1);
+      j->enabled = true;
+      return true;
+    }
+
+  volume_read (volume_sector (volume, JOURNAL_SECTOR), h, 1);
+  j->enabled = h->magic == JOURNAL_MAGIC;
+  if (volume == 0)
+    {
+      filesys_block_sectors = j->enabled ? h->block_sectors : 1;
+      if ((j->enabled ? h->chunk_sectors : 0) != volume_chunk_sectors)
+        {
+          j->enabled = false;
+          return false;
+        }
+    }
+  else if (!j->enabled || h->block_sectors != filesys_block_sectors
+           || h->volume != (uint32_t) volume)
+    {
+      j->enabled = false;
+      return false;
+    }
+  if (j->enabled && h->cnt > 0)
+    journal_recover (volume);
+  return true;
+}
+
+/* Begins a file system operation that may change metadata.
+   Waits while a commit is in progress.  Operations nest. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth++ > 0)
+    return;
+  lock_acquire (&journal_lock);
+  while (journal_blocked)
+    cond_wait (&journal_unblocked, &journal_lock);
+  journal_active++;
+  lock_release (&journal_lock);
+}
+
+/* Ends an operation begun by journal_begin(). */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+  lock_acquire (&journal_lock);
+  if (--journal_active == 0)
+    cond_broadcast (&journal_idle, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Waits for operations in progress to end and keeps new ones
+   from beginning, so that the cached metadata is consistent
+   until journal_unblock(). */
+void
+journal_block (void)
+{
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  while (journal_blocked)
+    cond_wait (&journal_unblocked, &journal_lock);
+  journal_blocked = true;
+  while (journal_active > 0)
+    cond_wait (&journal_idle, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Lets operations begin again. */
+void
+journal_unblock (void)
+{
+  lock_acquire (&journal_lock);
+  journal_blocked = false;
+  cond_broadcast (&journal_unblocked, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Commits a transaction of CNT sectors, whose home sectors are
+   SECTORS, sorted, and whose contents are DATA, to the logs of
+   their volumes.  The caller then writes them in place and calls
+   journal_clear(). */
+void
+journal_log (const disk_sector_t sectors[], void *const data[], size_t cnt)
+{
+  size_t i, j;
+
+  ASSERT (cnt <= JOURNAL_BLOCKS);
+
+  /* Sorting puts the sectors of each volume together. */
+  for (i = 0; i < cnt; i = j)
+    {
+      int volume = volume_of (sectors[i]);
+      for (j = i + 1; j < cnt && volume_of (sectors[j]) == volume; j++)
+        continue;
+      journal_write_log (volume, sectors + i, data + i, j - i);
+    }
+}
+
+/* Finishes the transaction committed by journal_log(). */
+void
+journal_clear (void)
+{
+  int volume;
+
+  for (volume = 0; volume < VOLUME_CNT; volume++)
+    {
+      struct journal *j = &journals[volume];
+      if (j->enabled && j->header.cnt > 0)
+        {
+          volume_flush (volume);
+          j->header.cnt = 0;
+          volume_write (volume_sector (volume, JOURNAL_SECTOR),
+                        &j->header, 1);
+        }
+    }
+}
+
+/* Commits the CNT sectors of VOLUME, whose home sectors are
+   SECTORS and whose contents are DATA, to VOLUME's log. */
+static void
+journal_write_log (int volume, const disk_sector_t sectors[],
+                   void *const data[], size_t cnt)
+{
+  struct journal *j = &journals[volume];
+  struct disk_request reqs[JOURNAL_BATCH];
+  size_t i, k;
+
+  if (!j->enabled)
+    return;
+
+  /* Write the log, then the header that commits it. */
+  for (i = 0; i < cnt; i += JOURNAL_BATCH)
+    {
+      size_t batch = cnt - i < JOURNAL_BATCH ? cnt - i : JOURNAL_BATCH;
+      for (k = 0; k < batch; k++)
+        {
+          volume_request_init (&reqs[k],
+                               volume_sector (volume,
+                                              JOURNAL_SECTOR + 1 + i + k),
+                               data[i + k], 1, true);
+          disk_submit (&reqs[k]);
+        }
+      for (k = 0; k < batch; k++)
+        disk_wait (&reqs[k]);
+    }
+  volume_flush (volume);
+  j->header.cnt = cnt;
+  memcpy (j->header.sectors, sectors, cnt * sizeof *sectors);
+  volume_write (volume_sector (volume, JOURNAL_SECTOR), &j->header, 1);
+  volume_flush (volume);
+}
+
+/* Writes the sectors logged by the transaction in VOLUME's
+   header in place and clears it.  Logged sectors that do not
+   belong to VOLUME are ignored. */
+static void
+journal_recover (int volume)
+{
+  static uint8_t block[DISK_SECTOR_SIZE];
+  struct journal_header *h = &journals[volume].header;
+  size_t i;
+
+  if (h->cnt > JOURNAL_BLOCKS)
+    h->cnt = JOURNAL_BLOCKS;
+  for (i = 0; i < h->cnt; i++)
+    if (volume_of (h->sectors[i]) == volume)
+      {
+        volume_read (volume_sector (volume, JOURNAL_SECTOR + 1 + i),
+                     block, 1);
+        volume_write (h->sectors[i], block, 1);
+      }
+  volume_flush (volume);
+  h->cnt = 0;
+  volume_write (volume_sector (volume, JOURNAL_SECTOR), h, 1);
+}
@@ -0,0 +1,21 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+
+/* Number of sectors a transaction may log. */
+#define JOURNAL_BLOCKS 123
+
+void journal_init (void);
+bool journal_open (int volume, bool format);
+void journal_begin (void);
+void journal_end (void);
+void journal_block (void);
+void journal_unblock (void);
+void journal_log (const disk_sector_t sectors[], void *const data[],
+                  size_t cnt);
+void journal_clear (void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,90 @@
+#include "filesys/mount.h"
+#include <debug.h>
+#include "threads/synch.h"
+
+/* Mount table.
+
+   A file system, a tmpfs or another volume, is mounted by
+   recording its root directory's inode number against the
+   directory it is mounted on, the mount point, which it then
+   hides: looking up the mount point's name finds the root
+   instead, and ".." of the root is ".." of the mount point.
+   Mounts are never undone. */
+
+/* Most mounts at once. */
+#define MOUNT_MAX 8
+
+/* File system whose root is ROOT mounted on directory DIR. */
+struct mount
+  {
+    disk_sector_t dir;          /* Mount point's inode number. */
+    disk_sector_t root;         /* Root directory's inode number. */
+  };
+
+/* Mounts, of which the first MOUNT_CNT are in use.  Mounts are
+   only ever added, each in one store of MOUNT_CNT after it is
+   complete, so they may be read without the lock. */
+static struct mount mounts[MOUNT_MAX];
+static size_t mount_cnt;
+
+/* Serializes adding mounts. */
+static struct lock mount_lock;
+
+/* Initializes the mount table. */
+void
+mount_init (void)
+{
+  lock_init (&mount_lock);
+  mount_cnt = 0;
+}
+
+/* Mounts the file system whose root directory has inode number
+   ROOT on the directory with inode number DIR.  Returns false if
+   DIR is already a mount point or the root of a mounted file
+   system, or if there are too many mounts. */
+bool
+mount_add (disk_sector_t dir, disk_sector_t root)
+{
+  bool success = false;
+
+  lock_acquire (&mount_lock);
+  if (mount_cnt < MOUNT_MAX
+      && mount_covering (dir) == dir && mount_point (dir) == dir)
+    {
+      mounts[mount_cnt].dir = dir;
+      mounts[mount_cnt].root = root;
+      barrier ();
+      mount_cnt++;
+      success = true;
+    }
+  lock_release (&mount_lock);
+  return success;
+}
+
+/* Returns the root of the file system mounted on the directory
+   with inode number INUMBER, or INUMBER itself if it is not a
+   mount point. */
+disk_sector_t
+mount_covering (disk_sector_t inumber)
+{
+  size_t i;
+
+  for (i = 0; i < mount_cnt; i++)
+    if (mounts[i].dir == inumber)
+      return mounts[i].root;
+  return inumber;
+}
+
+/* Returns the mount point of the file system whose root
+   directory has inode number INUMBER, or INUMBER itself if it
+   is not such a root. */
+disk_sector_t
+mount_point (disk_sector_t inumber)
+{
+  size_t i;
+
+  for (i = 0; i < mount_cnt; i++)
+    if (mounts[i].root == inumber)
+      return mounts[i].dir;
+  return inumber;
+}
@@ -0,0 +1,12 @@
+#ifndef FILESYS_MOUNT_H
+#define FILESYS_MOUNT_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+void mount_init (void);
+bool mount_add (disk_sector_t dir, disk_sector_t root);
+disk_sector_t mount_covering (disk_sector_t);
+disk_sector_t mount_point (disk_sector_t);
+
+#endif /* filesys/mount.h */
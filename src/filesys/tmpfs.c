@@ -0,0 +1,123 @@
+#include "filesys/tmpfs.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+
+/* Memory file system.
+
+   A tmpfs is a tree of memory inodes, whose data lives in pages
+   of kernel memory instead of on disk, mounted on a directory of
+   a disk file system (see mount.c).  Memory inodes go through
+   the same inode interface as disk inodes, so directories and
+   files on a tmpfs work as elsewhere, but they are never read or
+   written through the buffer cache or the journal, and they are
+   gone once the kernel stops.
+
+   This file keeps the parts that do not depend on the inode:
+   inode numbers and the page table of a file's data.  inode.c
+   keeps a memory inode alive while a directory names it. */
+
+/* Data of a memory file: page IDX holds bytes IDX * PGSIZE on,
+   or is null for a hole, which reads as zeros.  The caller
+   synchronizes access. */
+struct tmpfs_file
+  {
+    uint8_t **pages;            /* Pages, each null or a kernel page. */
+    size_t page_cnt;            /* Number of elements in PAGES. */
+  };
+
+/* Next inode number to hand out.  Numbers are never reused. */
+static disk_sector_t next_inumber;
+
+/* Protects NEXT_INUMBER. */
+static struct lock tmpfs_lock;
+
+/* Initializes the memory file system. */
+void
+tmpfs_init (void)
+{
+  lock_init (&tmpfs_lock);
+  next_inumber = TMPFS_INUMBER_MIN;
+}
+
+/* Returns a new memory inode number. */
+disk_sector_t
+tmpfs_new_inumber (void)
+{
+  disk_sector_t inumber;
+
+  lock_acquire (&tmpfs_lock);
+  inumber = next_inumber++;
+  lock_release (&tmpfs_lock);
+  return inumber;
+}
+
+/* Returns true if INUMBER names a memory inode. */
+bool
+tmpfs_is_inumber (disk_sector_t inumber)
+{
+  return inumber >= TMPFS_INUMBER_MIN;
+}
+
+/* Returns a new, empty memory file, or a null pointer if memory
+   is short. */
+struct tmpfs_file *
+tmpfs_file_create (void)
+{
+  return calloc (1, sizeof (struct tmpfs_file));
+}
+
+/* Frees memory file F and its pages. */
+void
+tmpfs_file_destroy (struct tmpfs_file *f)
+{
+  if (f != NULL)
+    {
+      tmpfs_free_pages (f, 0, f->page_cnt);
+      free (f->pages);
+      free (f);
+    }
+}
+
+/* Returns page IDX of F, or a null pointer if it is a hole.  If
+   CREATE is true, a hole is filled with a zeroed page first, and
+   a null pointer means that memory is short. */
+void *
+tmpfs_page (struct tmpfs_file *f, size_t idx, bool create)
+{
+  if (idx >= f->page_cnt)
+    {
+      size_t new_cnt = f->page_cnt > 0 ? f->page_cnt : 1;
+      uint8_t **pages;
+
+      if (!create)
+        return NULL;
+      while (new_cnt <= idx)
+        new_cnt *= 2;
+      pages = realloc (f->pages, new_cnt * sizeof *pages);
+      if (pages == NULL)
+        return NULL;
+      memset (pages + f->page_cnt, 0,
+              (new_cnt - f->page_cnt) * sizeof *pages);
+      f->pages = pages;
+      f->page_cnt = new_cnt;
+    }
+  if (f->pages[idx] == NULL && create)
+    f->pages[idx] = palloc_get_page (PAL_ZERO);
+  return f->pages[idx];
+}
+
+/* Frees pages FROM to TO - 1 of F, which become holes. */
+void
+tmpfs_free_pages (struct tmpfs_file *f, size_t from, size_t to)
+{
+  size_t i;
+
+  for (i = from; i < to && i < f->page_cnt; i++)
+    {
+      palloc_free_page (f->pages[i]);
+      f->pages[i] = NULL;
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef FILESYS_TMPFS_H
+#define FILESYS_TMPFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+
+/* Inode numbers from this one up name memory inodes, which are
+   never on disk.  No disk is that large. */
+#define TMPFS_INUMBER_MIN 0x80000000u
+
+struct tmpfs_file;
+
+void tmpfs_init (void);
+
+/* Inode numbers. */
+disk_sector_t tmpfs_new_inumber (void);
+bool tmpfs_is_inumber (disk_sector_t);
+
+/* File data. */
+struct tmpfs_file *tmpfs_file_create (void);
+void tmpfs_file_destroy (struct tmpfs_file *);
+void *tmpfs_page (struct tmpfs_file *, size_t idx, bool create);
+void tmpfs_free_pages (struct tmpfs_file *, size_t from, size_t to);
+
+#endif /* filesys/tmpfs.h */
@@ -0,0 +1,220 @@
+#include "filesys/volume.h"
+#include <debug.h>
+
+/* Most pieces of a striped transfer in flight at once. */
+#define VOLUME_BATCH 16
+
+/* Disk position of each volume, as channel and device numbers. */
+static const int volume_slots[VOLUME_CNT][2] =
+  {
+    {0, 1}, {1, 0}, {1, 1},
+  };
+
+/* Sectors per chunk of volume 0 when it is striped over hd0:1
+   and hd1:0, or 0 if it is hd0:1 alone.  Controlled by kernel
+   command-line option "-raid0=BYTES". */
+size_t volume_chunk_sectors;
+
+/* Disks of each attached volume, of which the first
+   VOLUME_WIDTH are in use, or none if it is not attached.  A
+   striped volume keeps chunk I of its sectors on disk I %
+   VOLUME_WIDTH, so that a transfer of several chunks keeps the
+   channels of all its disks busy at once.  Set once, while the
+   volume is attached, before any of its sectors are used. */
+static struct disk *volume_disks[VOLUME_CNT][2];
+static size_t volume_width[VOLUME_CNT];
+
+static struct disk *map_sector (disk_sector_t, disk_sector_t *sec_no,
+                                size_t *cnt);
+static void transfer (disk_sector_t, void *, size_t cnt, bool write);
+
+/* Returns the volume on disk DEV_NO of channel CHAN_NO, or -1 if
+   there is none. */
+int
+volume_for_disk (int chan_no, int dev_no)
+{
+  int volume;
+
+  for (volume = 0; volume < VOLUME_CNT; volume++)
+    if (volume_slots[volume][0] == chan_no
+        && volume_slots[volume][1] == dev_no)
+      return volume;
+  return -1;
+}
+
+/* Attaches VOLUME to its disk, so that its sectors may be read
+   and written.  If volume_chunk_sectors is nonzero, volume 0
+   takes the disk of volume 1 as well, which then cannot be
+   attached.  Returns false if VOLUME is already attached or a
+   disk is not present. */
+bool
+volume_attach (int volume)
+{
+  size_t width = volume == 0 && volume_chunk_sectors != 0 ? 2 : 1;
+  size_t i;
+
+  ASSERT (volume >= 0 && volume < VOLUME_CNT);
+
+  if (volume_width[volume] != 0 || (volume == 1 && volume_chunk_sectors != 0))
+    return false;
+  for (i = 0; i < width; i++)
+    {
+      volume_disks[volume][i] = disk_get (volume_slots[volume + i][0],
+                                          volume_slots[volume + i][1]);
+      if (volume_disks[volume][i] == NULL)
+        return false;
+    }
+  volume_width[volume] = width;
+  return true;
+}
+
+/* Returns true if VOLUME is attached. */
+bool
+volume_present (int volume)
+{
+  return volume >= 0 && volume < VOLUME_CNT && volume_width[volume] != 0;
+}
+
+/* Returns the size of VOLUME, which must be attached, in
+   sectors.  A striped volume has as many whole chunks on each
+   disk as its smallest disk holds.  Sectors that a file system
+   sector number cannot reach are left unused. */
+disk_sector_t
+volume_size (int volume)
+{
+  disk_sector_t size;
+  size_t i;
+
+  ASSERT (volume_present (volume));
+
+  size = disk_size (volume_disks[volume][0]);
+  for (i = 1; i < volume_width[volume]; i++)
+    if (disk_size (volume_disks[volume][i]) < size)
+      size = disk_size (volume_disks[volume][i]);
+  if (volume_width[volume] > 1)
+    {
+      size -= size % volume_chunk_sectors;
+      if (size > VOLUME_SECTORS / volume_width[volume])
+        size = VOLUME_SECTORS / volume_width[volume];
+      return size * volume_width[volume];
+    }
+  return size < VOLUME_SECTORS ? size : VOLUME_SECTORS;
+}
+
+/* Reads CNT sectors starting at file system sector number SECTOR
+   into BUFFER, as disk_read_multiple() does. */
+void
+volume_read (disk_sector_t sector, void *buffer, size_t cnt)
+{
+  transfer (sector, buffer, cnt, false);
+}
+
+/* Writes CNT sectors starting at file system sector number
+   SECTOR from BUFFER, as disk_write_multiple() does. */
+void
+volume_write (disk_sector_t sector, const void *buffer, size_t cnt)
+{
+  transfer (sector, (void *) buffer, cnt, true);
+}
+
+/* Makes the writes to VOLUME that have completed so far durable,
+   as disk_flush() does for each of its disks. */
+void
+volume_flush (int volume)
+{
+  size_t i;
+
+  ASSERT (volume_present (volume));
+
+  for (i = 0; i < volume_width[volume]; i++)
+    disk_flush (volume_disks[volume][i]);
+}
+
+/* Initializes REQ to transfer CNT sectors starting at file system
+   sector number SECTOR, as disk_request_init() does without a
+   completion function.  The sectors must not cross a chunk
+   boundary of a striped volume. */
+void
+volume_request_init (struct disk_request *req, disk_sector_t sector,
+                     void *buffer, size_t cnt, bool write)
+{
+  disk_sector_t sec_no;
+  size_t piece = cnt;
+  struct disk *d = map_sector (sector, &sec_no, &piece);
+
+  ASSERT (piece == cnt);
+
+  disk_request_init (req, d, sec_no, buffer, cnt, write, NULL, NULL);
+}
+
+/* Returns the disk holding file system sector number SECTOR and
+   stores its sector number on that disk in *SEC_NO.  Reduces
+   *CNT to the number of sectors from SECTOR on that follow it on
+   the same disk, if fewer. */
+static struct disk *
+map_sector (disk_sector_t sector, disk_sector_t *sec_no, size_t *cnt)
+{
+  int volume = volume_of (sector);
+  disk_sector_t ofs = volume_ofs (sector);
+  size_t width, chunk, within;
+
+  ASSERT (volume_present (volume));
+
+  width = volume_width[volume];
+  if (width == 1)
+    {
+      *sec_no = ofs;
+      return volume_disks[volume][0];
+    }
+  chunk = ofs / volume_chunk_sectors;
+  within = ofs % volume_chunk_sectors;
+  *sec_no = chunk / width * volume_chunk_sectors + within;
+  if (*cnt > volume_chunk_sectors - within)
+    *cnt = volume_chunk_sectors - within;
+  return volume_disks[volume][chunk % width];
+}
+
+/* Transfers CNT sectors starting at file system sector number
+   SECTOR between the disk and BUFFER, writing to the disk if
+   WRITE is true.  The pieces of a transfer that crosses chunks
+   of a striped volume are queued together as synchronous
+   requests, so that every disk works on its own at once. */
+static void
+transfer (disk_sector_t sector, void *buffer_, size_t cnt, bool write)
+{
+  struct disk_request reqs[VOLUME_BATCH];
+  uint8_t *buffer = buffer_;
+  size_t n = 0;
+  size_t i;
+
+  while (cnt > 0)
+    {
+      disk_sector_t sec_no;
+      size_t piece = cnt;
+      struct disk *d = map_sector (sector, &sec_no, &piece);
+
+      if (n == 0 && piece == cnt)
+        {
+          /* All on one disk. */
+          if (write)
+            disk_write_multiple (d, sec_no, buffer, cnt);
+          else
+            disk_read_multiple (d, sec_no, buffer, cnt);
+          return;
+        }
+
+      disk_request_init (&reqs[n], d, sec_no, buffer, piece, write,
+                         NULL, NULL);
+      disk_submit_sync (&reqs[n++]);
+      sector += piece;
+      buffer += piece * DISK_SECTOR_SIZE;
+      cnt -= piece;
+
+      if (n == VOLUME_BATCH || cnt == 0)
+        {
+          for (i = 0; i < n; i++)
+            disk_wait (&reqs[i]);
+          n = 0;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef FILESYS_VOLUME_H
+#define FILESYS_VOLUME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+
+/* Volumes.
+
+   Each disk that holds a file system is a volume, numbered by
+   the disk's position: volume 0 is hd0:1, which holds the root
+   directory, and volumes 1 and 2 are hd1:0 and hd1:1.  hd0:0
+   holds the kernel and is never a volume.
+   A file system sector number carries its volume number in its
+   top bits, so that inodes, directory entries, the buffer cache
+   and the journal name sectors of every volume alike, and only
+   actual disk I/O looks at the volume.  Sector numbers of volume
+   0 are plain disk sectors.  Sector numbers are also stored on
+   disk, so a disk must stay in the position it was formatted
+   in.
+
+   Volume 0 may instead be striped over hd0:1 and hd1:0, one on
+   each IDE channel, in chunks of volume_chunk_sectors sectors.
+   Volume 1 is then unavailable. */
+
+/* Number of volumes. */
+#define VOLUME_CNT 3
+
+/* Bit position of the volume number in a sector number.  A
+   volume uses at most the first VOLUME_SECTORS sectors, 128 GB,
+   of a larger disk. */
+#define VOLUME_SHIFT 28
+#define VOLUME_SECTORS ((disk_sector_t) 1 << VOLUME_SHIFT)
+
+/* Returns the volume of file system sector number SECTOR. */
+#define volume_of(SECTOR) ((int) ((SECTOR) >> VOLUME_SHIFT))
+
+/* Returns the file system sector number of sector SECTOR of
+   VOLUME's disk. */
+#define volume_sector(VOLUME, SECTOR)                           \
+        (((disk_sector_t) (VOLUME) << VOLUME_SHIFT) | (SECTOR))
+
+/* Returns the disk sector of file system sector number SECTOR
+   within its volume. */
+#define volume_ofs(SECTOR) ((SECTOR) & ((1u << VOLUME_SHIFT) - 1))
+
+/* Sectors per chunk of a striped volume 0, or 0. */
+extern size_t volume_chunk_sectors;
+
+int volume_for_disk (int chan_no, int dev_no);
+bool volume_attach (int volume);
+bool volume_present (int volume);
+disk_sector_t volume_size (int volume);
+
+void volume_read (disk_sector_t, void *, size_t cnt);
+void volume_write (disk_sector_t, const void *, size_t cnt);
+void volume_flush (int volume);
+void volume_request_init (struct disk_request *, disk_sector_t,
+                          void *buffer, size_t cnt, bool write);
+
+#endif /* filesys/volume.h */
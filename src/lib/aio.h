@@ -0,0 +1,51 @@
+#ifndef __LIB_AIO_H
+#define __LIB_AIO_H
+
+/* Asynchronous I/O operations. */
+enum aio_op
+  {
+    AIO_READ,                   /* Read from a file. */
+    AIO_WRITE                   /* Write to a file. */
+  };
+
+/* A submission queue entry: an I/O to start. */
+struct aio_sqe
+  {
+    int op;                     /* An enum aio_op. */
+    int fd;                     /* File descriptor of an open file. */
+    void *buf;                  /* Buffer to read into or write from. */
+    unsigned size;              /* Bytes to transfer. */
+    unsigned offset;            /* File offset to transfer at. */
+    unsigned user_data;         /* Handed back in the completion. */
+  };
+
+/* A completion queue entry: the result of an I/O. */
+struct aio_cqe
+  {
+    unsigned user_data;         /* From the submission. */
+    int result;                 /* Bytes transferred, or -1. */
+  };
+
+/* Submission and completion rings, in user memory.
+
+   The program fills SQES[SQ_TAIL % ENTRIES] and advances
+   SQ_TAIL; the kernel advances SQ_HEAD as it takes entries.  The
+   kernel fills CQES[CQ_TAIL % ENTRIES] and advances CQ_TAIL; the
+   program advances CQ_HEAD as it consumes entries.  Indexes run
+   freely and wrap around.  ENTRIES, the size of both arrays,
+   must be a power of 2 no greater than AIO_ENTRIES_MAX. */
+struct aio_ring
+  {
+    unsigned entries;           /* Entries in each ring. */
+    unsigned sq_head, sq_tail;  /* Submission queue indexes. */
+    unsigned cq_head, cq_tail;  /* Completion queue indexes. */
+    struct aio_sqe *sqes;       /* Submission queue entries. */
+    struct aio_cqe *cqes;       /* Completion queue entries. */
+  };
+
+#define AIO_ENTRIES_MAX 64
+
+/* Most bytes one I/O transfers.  Larger ones are cut short. */
+#define AIO_IO_MAX 16384
+
+#endif /* lib/aio.h */
@@ -0,0 +1,18 @@
+#ifndef __LIB_BATCH_H
+#define __LIB_BATCH_H
+
+/* One system call of a batch, in user memory.  The kernel runs
+   the calls of a batch in order and fills in each one's RESULT
+   before reading the next, so a call may use what an earlier one
+   wrote. */
+struct batch_call
+  {
+    int nr;                     /* System call number. */
+    unsigned args[4];           /* Arguments; extra ones are ignored. */
+    int result;                 /* Return value, set by the kernel. */
+  };
+
+/* Most calls one batch system call runs. */
+#define BATCH_MAX 256
+
+#endif /* lib/batch.h */
@@ -0,0 +1,32 @@
+#ifndef __LIB_CLOCK_H
+#define __LIB_CLOCK_H
+
+#include <stdint.h>
+
+/* The kernel's clock calibration, kept in a page that is mapped
+   read-only into every process at CLOCK_PAGE, so that gettime()
+   can tell the time without a system call. */
+struct clock_page
+  {
+    uint64_t tsc_base;          /* Time stamp counter at time 0. */
+    uint32_t mult;              /* Nanoseconds per cycle, scaled by
+                                   2**CLOCK_SHIFT, or 0 if not yet
+                                   calibrated. */
+  };
+
+#define CLOCK_SHIFT 24
+#define CLOCK_PAGE ((const struct clock_page *) 0x08000000)
+
+/* Converts time stamp counter value TSC to nanoseconds since
+   boot by C's calibration.  The cycles are split at CLOCK_SHIFT
+   bits so that neither product overflows. */
+static inline uint64_t
+clock_nanos (const struct clock_page *c, uint64_t tsc)
+{
+  uint64_t d = tsc - c->tsc_base;
+
+  return (d >> CLOCK_SHIFT) * c->mult
+         + (((d & ((1u << CLOCK_SHIFT) - 1)) * c->mult) >> CLOCK_SHIFT);
+}
+
+#endif /* lib/clock.h */
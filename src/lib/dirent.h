@@ -0,0 +1,18 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+/* Longest file name in a directory entry.  Must be NAME_MAX in
+   filesys/directory.h. */
+#define DIRENT_NAME_MAX 63
+
+/* Most entries one getdents system call returns. */
+#define DIRENT_MAX 128
+
+/* A directory entry returned by the getdents system call. */
+struct dirent
+  {
+    int d_ino;                          /* Inode number. */
+    char d_name[DIRENT_NAME_MAX + 1];   /* Null terminated file name. */
+  };
+
+#endif /* lib/dirent.h */
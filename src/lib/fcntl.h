@@ -0,0 +1,15 @@
+#ifndef __LIB_FCNTL_H
+#define __LIB_FCNTL_H
+
+/* Commands of the fcntl system call. */
+#define F_GETFL 3               /* Return the descriptor's flags. */
+#define F_SETFL 4               /* Set the descriptor's flags. */
+
+/* Descriptor flags. */
+#define O_NONBLOCK 0x800        /* Reads and writes do not wait. */
+
+/* A read or write of a descriptor with O_NONBLOCK set that would
+   have to wait returns -EAGAIN instead. */
+#define EAGAIN 11
+
+#endif /* lib/fcntl.h */
@@ -46,6 +46,53 @@ bit_mask (size_t bit_idx)
   return (elem_type) 1 << (bit_idx % ELEM_BITS);
 }
 
+/* Returns the index of the first bit of the element after the
+   one holding bit START, or END if that is less. */
+static inline size_t
+next_elem (size_t start, size_t end)
+{
+  size_t next = (elem_idx (start) + 1) * ELEM_BITS;
+  return next < end ? next : end;
+}
+
+/* Returns an elem_type where only the bits numbered START
+   through END - 1 are turned on, all of which must be in the
+   same element. */
+static inline elem_type
+elem_mask (size_t start, size_t end)
+{
+  size_t ofs = start % ELEM_BITS;
+  size_t len = end - start;
+  elem_type mask = (elem_type) -1 << ofs;
+
+  if (ofs + len < ELEM_BITS)
+    mask &= ((elem_type) 1 << (ofs + len)) - 1;
+  return mask;
+}
+
+/* Returns the element of B holding bit IDX, inverted if VALUE is
+   false, so that bits set to VALUE are turned on. */
+static inline elem_type
+elem_value (const struct bitmap *b, size_t idx, bool value)
+{
+  elem_type bits = b->bits[elem_idx (idx)];
+  return value ? bits : ~bits;
+}
+
+/* Returns the number of bits turned on in BITS. */
+static inline size_t
+count_bits (elem_type bits)
+{
+  size_t cnt = 0;
+
+  while (bits != 0)
+    {
+      bits &= bits - 1;
+      cnt++;
+    }
+  return cnt;
+}
+
 /* Returns the number of elements required for BIT_CNT bits. */
 static inline size_t
 elem_cnt (size_t bit_cnt)
@@ -69,6 +116,24 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns the index of the first bit in B numbered START
+   through END - 1 that is set to VALUE, or END if there is none.
+   Elements with no such bit are skipped as a whole. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  while (start < end)
+    {
+      size_t next = next_elem (start, end);
+      elem_type bits = elem_value (b, start, value)
+                       & elem_mask (start, next);
+      if (bits != 0)
+        return elem_idx (start) * ELEM_BITS + __builtin_ctzl (bits);
+      start = next;
+    }
+  return end;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -214,18 +279,32 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Whole elements are stored at once, and partial ones are
+   updated atomically as in bitmap_mark() and bitmap_reset(). */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
+  size_t end = start + cnt;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end)
+    {
+      size_t next = next_elem (start, end);
+      size_t idx = elem_idx (start);
+      elem_type mask = elem_mask (start, next);
+
+      if (mask == (elem_type) -1)
+        b->bits[idx] = value ? mask : 0;
+      else if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+      start = next;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -233,16 +312,21 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end)
+    {
+      size_t next = next_elem (start, end);
+      elem_type bits = elem_value (b, start, value);
+      value_cnt += count_bits (bits & elem_mask (start, next));
+      start = next;
+    }
   return value_cnt;
 }
 
@@ -251,16 +335,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_next (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -299,13 +378,28 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Find the next bit set to VALUE, then the first bit not
+         set to VALUE after it.  The run between them is either
+         long enough or skipped as a whole. */
+      while (i <= last)
+        {
+          size_t j;
+
+          i = find_next (b, i, last + 1, value);
+          if (i > last)
+            break;
+          j = find_next (b, i, i + cnt, !value);
+          if (j == i + cnt)
+            return i;
+          i = j + 1;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -359,6 +453,28 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B holding the CNT bits starting at START
+   to FILE, so that only the file sectors covering those bits are
+   rewritten.  Return true if successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (cnt <= b->bit_cnt - start);
+
+  if (cnt == 0)
+    return true;
+  else
+    {
+      size_t first = elem_idx (start);
+      off_t ofs = first * sizeof (elem_type);
+      off_t size = (elem_idx (start + cnt - 1) - first + 1)
+                   * sizeof (elem_type);
+      return file_write_at (file, b->bits + first, size, ofs) == size;
+    }
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -1,15 +1,41 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
+#include "devices/timer.h"
 #include "devices/vga.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
+/* Bytes of output that vprintf() gathers before writing them. */
+#define PRINTF_BUFFER_SIZE 128
+
+/* Messages that one log_printf() call site may print in each
+   interval of LOG_INTERVAL timer ticks. */
+#define LOG_BURST 10
+#define LOG_INTERVAL (5 * TIMER_FREQ)
+
+/* Output of one vprintf() call, gathered on the stack so that it
+   reaches the serial port and vga display in runs rather than a
+   character at a time. */
+struct printf_buffer
+  {
+    char buf[PRINTF_BUFFER_SIZE];
+    size_t len;                 /* Bytes in BUF. */
+    int char_cnt;               /* Characters formatted in all. */
+    bool locked;                /* Console lock acquired? */
+  };
+
 static void vprintf_helper (char, void *);
+static void putbuf_have_lock (const char *, size_t);
 static void putchar_have_lock (uint8_t c);
 
+/* Most detailed level of messages that log_printf() prints.  Set
+   by kernel command-line option "-log=LEVEL". */
+enum log_level log_level = LOG_INFO;
+
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
    safe to call them at any time.
@@ -121,17 +147,27 @@ console_locked_by_current_thread (void)
 
 /* The standard vprintf() function,
    which is like printf() but uses a va_list.
-   Writes its output to both vga display and serial port. */
+   Writes its output to both vga display and serial port.
+
+   The output is formatted into a buffer and written a buffer at
+   a time.  Output longer than the buffer is written in pieces,
+   holding the console lock from the first piece to the last so
+   that other output does not come between them. */
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct printf_buffer pb;
 
-  acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  pb.len = 0;
+  pb.char_cnt = 0;
+  pb.locked = false;
+  __vprintf (format, args, vprintf_helper, &pb);
+  if (!pb.locked)
+    acquire_console ();
+  putbuf_have_lock (pb.buf, pb.len);
   release_console ();
 
-  return char_cnt;
+  return pb.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -140,21 +176,58 @@ int
 puts (const char *s) 
 {
   acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
+  putbuf_have_lock (s, strlen (s));
   putchar_have_lock ('\n');
   release_console ();
 
   return 0;
 }
 
-/* Writes the N characters in BUFFER to the console. */
+/* Prints a message for log_printf(), which has checked its
+   level, unless the call site LIMIT has printed LOG_BURST
+   messages already in the current interval.  The first message
+   of the next interval says how many were dropped. */
+void
+log_print (struct log_limit *limit, const char *format, ...) 
+{
+  int64_t now = timer_ticks ();
+  enum intr_level old_level;
+  int suppressed = 0;
+  bool print;
+  va_list args;
+
+  old_level = intr_disable ();
+  if (limit->cnt == 0 || now - limit->start >= LOG_INTERVAL)
+    {
+      suppressed = limit->suppressed;
+      limit->start = now;
+      limit->cnt = 0;
+      limit->suppressed = 0;
+    }
+  print = limit->cnt < LOG_BURST;
+  if (print)
+    limit->cnt++;
+  else
+    limit->suppressed++;
+  intr_set_level (old_level);
+
+  if (!print)
+    return;
+  if (suppressed > 0)
+    printf ("(%d messages suppressed)\n", suppressed);
+  va_start (args, format);
+  vprintf (format, args);
+  va_end (args);
+}
+
+/* Writes the N characters in BUFFER to the console.
+   The serial port takes them all at once, and sends them in the
+   background, and the vga display moves its cursor once. */
 void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -171,11 +244,34 @@ putchar (int c)
 
 /* Helper function for vprintf(). */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (char c, void *pb_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct printf_buffer *pb = pb_;
+
+  pb->char_cnt++;
+  if (pb->len == sizeof pb->buf)
+    {
+      if (!pb->locked)
+        {
+          acquire_console ();
+          pb->locked = true;
+        }
+      putbuf_have_lock (pb->buf, pb->len);
+      pb->len = 0;
+    }
+  pb->buf[pb->len++] = c;
+}
+
+/* Writes the N characters in BUFFER to the vga display and
+   serial port.  The caller has already acquired the console lock
+   if appropriate. */
+static void
+putbuf_have_lock (const char *buffer, size_t n) 
+{
+  ASSERT (console_locked_by_current_thread ());
+  write_cnt += n;
+  serial_putbuf (buffer, n);
+  vga_putbuf (buffer, n);
 }
 
 /* Writes C to the vga display and serial port.
@@ -1,6 +1,51 @@
 #ifndef __LIB_KERNEL_CONSOLE_H
 #define __LIB_KERNEL_CONSOLE_H
 
+#include <debug.h>
+#include <stdint.h>
+
+/* Levels of log_printf() messages, from most to least severe. */
+enum log_level
+  {
+    LOG_ERR,                    /* Something failed. */
+    LOG_WARN,                   /* Something is amiss but works. */
+    LOG_INFO,                   /* Progress worth reporting. */
+    LOG_DEBUG                   /* Detail for debugging. */
+  };
+
+/* Most detailed level that log_printf() calls are compiled in
+   for.  Building with -DLOG_LEVEL_MAX=LOG_INFO, for example,
+   leaves no trace of LOG_DEBUG messages in the kernel. */
+#ifndef LOG_LEVEL_MAX
+#define LOG_LEVEL_MAX LOG_DEBUG
+#endif
+
+extern enum log_level log_level;
+
+/* Rate limit of one log_printf() call site. */
+struct log_limit
+  {
+    int64_t start;              /* Timer tick the interval began. */
+    int cnt;                    /* Messages printed in it. */
+    int suppressed;             /* Messages dropped in it. */
+  };
+
+/* Prints a message like printf() if LEVEL is no more detailed
+   than log_level, at most a few times a second from each call
+   site, so that a message in a hot path does not flood the
+   console.  The arguments are not evaluated if LEVEL leaves the
+   message out, but they are if the rate limit drops it. */
+#define log_printf(LEVEL, ...)                                  \
+        do                                                      \
+          {                                                     \
+            static struct log_limit log_limit_;                 \
+            if ((LEVEL) <= LOG_LEVEL_MAX && (LEVEL) <= log_level) \
+              log_print (&log_limit_, __VA_ARGS__);             \
+          }                                                     \
+        while (0)
+
+void log_print (struct log_limit *, const char *, ...) PRINTF_FORMAT (2, 3);
+
 void console_init (void);
 void console_panic (void);
 void console_print_stats (void);
@@ -6,6 +6,8 @@
    See hash.h for basic information. */
 
 #include "hash.h"
+#include <stdint.h>
+#include <string.h>
 #include "../debug.h"
 #include "threads/malloc.h"
 
@@ -13,21 +15,40 @@
         list_entry(LIST_ELEM, struct hash_elem, list_elem)
 
 static struct list *find_bucket (struct hash *, struct hash_elem *);
+static size_t ideal_bucket_cnt (size_t elem_cnt);
+static void clear_buckets (struct hash *, struct list *, size_t,
+                           hash_action_func *);
 static struct hash_elem *find_elem (struct hash *, struct list *,
                                     struct hash_elem *);
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
+static void migrate (struct hash *);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
 bool
 hash_init (struct hash *h,
            hash_hash_func *hash, hash_less_func *less, void *aux) 
+{
+  return hash_init_sized (h, hash, less, aux, 0);
+}
+
+/* Initializes hash table H like hash_init(), with enough buckets
+   for ELEM_CNT elements from the start.  The table never shrinks
+   below that size, so a table whose size is known in advance is
+   not resized at all. */
+bool
+hash_init_sized (struct hash *h, hash_hash_func *hash, hash_less_func *less,
+                 void *aux, size_t elem_cnt)
 {
   h->elem_cnt = 0;
-  h->bucket_cnt = 4;
+  h->bucket_cnt = ideal_bucket_cnt (elem_cnt);
   h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->migrate_idx = 0;
+  h->min_bucket_cnt = h->bucket_cnt;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
@@ -53,22 +74,14 @@ hash_init (struct hash *h,
 void
 hash_clear (struct hash *h, hash_action_func *destructor) 
 {
-  size_t i;
-
-  for (i = 0; i < h->bucket_cnt; i++) 
+  if (h->old_buckets != NULL)
     {
-      struct list *bucket = &h->buckets[i];
-
-      if (destructor != NULL) 
-        while (!list_empty (bucket)) 
-          {
-            struct list_elem *list_elem = list_pop_front (bucket);
-            struct hash_elem *hash_elem = list_elem_to_hash_elem (list_elem);
-            destructor (hash_elem, h->aux);
-          }
-
-      list_init (bucket); 
-    }    
+      clear_buckets (h, h->old_buckets + h->migrate_idx,
+                     h->old_bucket_cnt - h->migrate_idx, destructor);
+      free (h->old_buckets);
+      h->old_buckets = NULL;
+    }
+  clear_buckets (h, h->buckets, h->bucket_cnt, destructor);
 
   h->elem_cnt = 0;
 }
@@ -88,6 +101,7 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
 {
   if (destructor != NULL)
     hash_clear (h, destructor);
+  free (h->old_buckets);
   free (h->buckets);
 }
 
@@ -162,20 +176,17 @@ hash_delete (struct hash *h, struct hash_elem *e)
 void
 hash_apply (struct hash *h, hash_action_func *action) 
 {
-  size_t i;
+  struct hash_iterator i;
+  struct hash_elem *e;
   
   ASSERT (action != NULL);
 
-  for (i = 0; i < h->bucket_cnt; i++) 
+  hash_first (&i, h);
+  for (e = hash_next (&i); e != NULL; ) 
     {
-      struct list *bucket = &h->buckets[i];
-      struct list_elem *elem, *next;
-
-      for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) 
-        {
-          next = list_next (elem);
-          action (list_elem_to_hash_elem (elem), h->aux);
-        }
+      struct hash_elem *next = hash_next (&i);
+      action (e, h->aux);
+      e = next;
     }
 }
 
@@ -203,7 +214,10 @@ hash_first (struct hash_iterator *i, struct hash *h)
   ASSERT (h != NULL);
 
   i->hash = h;
-  i->bucket = i->hash->buckets;
+  if (h->old_buckets != NULL)
+    i->bucket = h->old_buckets + h->migrate_idx;
+  else
+    i->bucket = h->buckets;
   i->elem = list_elem_to_hash_elem (list_head (i->bucket));
 }
 
@@ -223,7 +237,17 @@ hash_next (struct hash_iterator *i)
   i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
   while (i->elem == list_elem_to_hash_elem (list_end (i->bucket)))
     {
-      if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt)
+      struct hash *h = i->hash;
+
+      /* The old buckets not yet moved come first. */
+      if (h->old_buckets != NULL
+          && i->bucket >= h->old_buckets
+          && i->bucket < h->old_buckets + h->old_bucket_cnt)
+        {
+          if (++i->bucket >= h->old_buckets + h->old_bucket_cnt)
+            i->bucket = h->buckets;
+        }
+      else if (++i->bucket >= h->buckets + h->bucket_cnt)
         {
           i->elem = NULL;
           break;
@@ -257,56 +281,141 @@ hash_empty (struct hash *h)
   return h->elem_cnt == 0;
 }
 
-/* Fowler-Noll-Vo hash constants, for 32-bit word sizes. */
-#define FNV_32_PRIME 16777619u
-#define FNV_32_BASIS 2166136261u
+/* The hash functions below are MurmurHash3's 32-bit variant by
+   Austin Appleby, which takes in a word at a time where
+   Fowler-Noll-Vo took a byte, and its finalizer, which on its
+   own makes a good mixer for integer and pointer keys.  Every
+   bit of the result depends on every bit of the input, so keys
+   whose low bits are all zero, such as page addresses, still
+   spread across the buckets, which are picked by the low bits
+   of the hash. */
+#define MURMUR_C1 0xcc9e2d51u
+#define MURMUR_C2 0x1b873593u
+
+/* A word that may be unaligned and may alias any other type. */
+typedef uint32_t __attribute__ ((may_alias, aligned (1))) word_t;
+
+/* Returns X rotated left by N bits, 0 < N < 32. */
+static inline uint32_t
+rotl (uint32_t x, int n)
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+/* Scrambles K, a word of input, for adding to a hash. */
+static inline uint32_t
+scramble (uint32_t k)
+{
+  return rotl (k * MURMUR_C1, 15) * MURMUR_C2;
+}
+
+/* Mixes all the bits of H together. */
+static inline uint32_t
+fmix (uint32_t h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
 
 /* Returns a hash of the SIZE bytes in BUF. */
 unsigned
 hash_bytes (const void *buf_, size_t size)
 {
-  /* Fowler-Noll-Vo 32-bit hash, for bytes. */
   const unsigned char *buf = buf_;
-  unsigned hash;
+  uint32_t hash = 0;
+  uint32_t k;
+  size_t i;
 
   ASSERT (buf != NULL);
 
-  hash = FNV_32_BASIS;
-  while (size-- > 0)
-    hash = (hash * FNV_32_PRIME) ^ *buf++;
+  /* Whole words. */
+  for (i = 0; i + 4 <= size; i += 4)
+    hash = rotl (hash ^ scramble (*(const word_t *) (buf + i)), 13) * 5
+           + 0xe6546b64u;
+
+  /* The last 1 to 3 bytes, if any. */
+  k = 0;
+  switch (size & 3)
+    {
+    case 3:
+      k ^= buf[i + 2] << 16;
+      /* Fall through. */
+    case 2:
+      k ^= buf[i + 1] << 8;
+      /* Fall through. */
+    case 1:
+      k ^= buf[i];
+      hash ^= scramble (k);
+    }
 
-  return hash;
+  return fmix (hash ^ size);
 } 
 
 /* Returns a hash of string S. */
 unsigned
-hash_string (const char *s_) 
+hash_string (const char *s) 
 {
-  const unsigned char *s = (const unsigned char *) s_;
-  unsigned hash;
-
   ASSERT (s != NULL);
 
-  hash = FNV_32_BASIS;
-  while (*s != '\0')
-    hash = (hash * FNV_32_PRIME) ^ *s++;
-
-  return hash;
+  return hash_bytes (s, strlen (s));
 }
 
 /* Returns a hash of integer I. */
 unsigned
 hash_int (int i) 
 {
-  return hash_bytes (&i, sizeof i);
+  return fmix (i);
 }
-
-/* Returns the bucket in H that E belongs in. */
+
+/* Returns a hash of pointer P. */
+unsigned
+hash_ptr (const void *p)
+{
+  return fmix ((uintptr_t) p);
+}
+
+/* Returns the bucket in H that E belongs in.  That is the old
+   bucket for E's hash value while a resize has yet to move it. */
 static struct list *
 find_bucket (struct hash *h, struct hash_elem *e) 
 {
-  size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  unsigned hash = h->hash (e, h->aux);
+
+  if (h->old_buckets != NULL)
+    {
+      size_t old_idx = hash & (h->old_bucket_cnt - 1);
+      if (old_idx >= h->migrate_idx)
+        return &h->old_buckets[old_idx];
+    }
+  return &h->buckets[hash & (h->bucket_cnt - 1)];
+}
+
+/* Removes the elements from the CNT buckets at BUCKETS in H,
+   calling DESTRUCTOR on each if it is non-null. */
+static void
+clear_buckets (struct hash *h, struct list *buckets, size_t cnt,
+               hash_action_func *destructor)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++) 
+    {
+      struct list *bucket = &buckets[i];
+
+      if (destructor != NULL) 
+        while (!list_empty (bucket)) 
+          {
+            struct list_elem *list_elem = list_pop_front (bucket);
+            struct hash_elem *hash_elem = list_elem_to_hash_elem (list_elem);
+            destructor (hash_elem, h->aux);
+          }
+
+      list_init (bucket); 
+    }    
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -344,35 +453,57 @@ is_power_of_2 (size_t x)
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
+/* Old buckets moved to the new array per insertion or deletion
+   while a resize is in progress. */
+#define REHASH_STEP 8
+
+/* Returns the number of buckets to use for ELEM_CNT elements.
+   We want one bucket for about every BEST_ELEMS_PER_BUCKET.
+   We must have at least four buckets, and the number of buckets
+   must be a power of 2. */
+static size_t
+ideal_bucket_cnt (size_t elem_cnt)
+{
+  size_t bucket_cnt = elem_cnt / BEST_ELEMS_PER_BUCKET;
+
+  if (bucket_cnt < 4)
+    bucket_cnt = 4;
+  while (!is_power_of_2 (bucket_cnt))
+    bucket_cnt = turn_off_least_1bit (bucket_cnt);
+  return bucket_cnt;
+}
+
 /* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
-   condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+   ideal.  The elements are not moved at once: the new buckets
+   are installed beside the old ones, which are emptied a few at
+   a time by this and later calls, so no single insertion or
+   deletion pays for moving the whole table.  This function can
+   fail because of an out-of-memory condition, but that'll just
+   make hash accesses less efficient; we can still continue. */
 static void
 rehash (struct hash *h) 
 {
-  size_t old_bucket_cnt, new_bucket_cnt;
-  struct list *new_buckets, *old_buckets;
+  size_t new_bucket_cnt;
+  struct list *new_buckets;
   size_t i;
 
   ASSERT (h != NULL);
 
-  /* Save old bucket info for later use. */
-  old_buckets = h->buckets;
-  old_bucket_cnt = h->bucket_cnt;
+  /* Finish the resize in progress before starting another. */
+  if (h->old_buckets != NULL)
+    {
+      migrate (h);
+      return;
+    }
 
-  /* Calculate the number of buckets to use now.
-     We want one bucket for about every BEST_ELEMS_PER_BUCKET.
-     We must have at least four buckets, and the number of
-     buckets must be a power of 2. */
-  new_bucket_cnt = h->elem_cnt / BEST_ELEMS_PER_BUCKET;
-  if (new_bucket_cnt < 4)
-    new_bucket_cnt = 4;
-  while (!is_power_of_2 (new_bucket_cnt))
-    new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
+  /* Calculate the number of buckets to use now, never fewer than
+     the table started with. */
+  new_bucket_cnt = ideal_bucket_cnt (h->elem_cnt);
+  if (new_bucket_cnt < h->min_bucket_cnt)
+    new_bucket_cnt = h->min_bucket_cnt;
 
   /* Don't do anything if the bucket count wouldn't change. */
-  if (new_bucket_cnt == old_bucket_cnt)
+  if (new_bucket_cnt == h->bucket_cnt)
     return;
 
   /* Allocate new buckets and initialize them as empty. */
@@ -387,29 +518,46 @@ rehash (struct hash *h)
   for (i = 0; i < new_bucket_cnt; i++) 
     list_init (&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info, keeping the old buckets until their
+     elements have been moved. */
+  h->old_buckets = h->buckets;
+  h->old_bucket_cnt = h->bucket_cnt;
+  h->migrate_idx = 0;
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
 
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) 
+  migrate (h);
+}
+
+/* Moves the elements of up to REHASH_STEP old buckets in H into
+   the new buckets, freeing the old array once all are moved.
+   The table is consistent between any two moves. */
+static void
+migrate (struct hash *h)
+{
+  size_t end = h->migrate_idx + REHASH_STEP;
+
+  if (end > h->old_bucket_cnt)
+    end = h->old_bucket_cnt;
+  for (; h->migrate_idx < end; h->migrate_idx++)
     {
-      struct list *old_bucket;
-      struct list_elem *elem, *next;
+      struct list *old_bucket = &h->old_buckets[h->migrate_idx];
 
-      old_bucket = &old_buckets[i];
-      for (elem = list_begin (old_bucket);
-           elem != list_end (old_bucket); elem = next) 
+      while (!list_empty (old_bucket))
         {
-          struct list *new_bucket
-            = find_bucket (h, list_elem_to_hash_elem (elem));
-          next = list_next (elem);
-          list_remove (elem);
-          list_push_front (new_bucket, elem);
+          struct list_elem *elem = list_pop_front (old_bucket);
+          unsigned hash = h->hash (list_elem_to_hash_elem (elem), h->aux);
+          list_push_front (&h->buckets[hash & (h->bucket_cnt - 1)], elem);
         }
     }
 
-  free (old_buckets);
+  if (h->migrate_idx >= h->old_bucket_cnt)
+    {
+      free (h->old_buckets);
+      h->old_buckets = NULL;
+      h->old_bucket_cnt = 0;
+      h->migrate_idx = 0;
+    }
 }
 
 /* Inserts E into BUCKET (in hash table H). */
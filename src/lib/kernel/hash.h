@@ -55,12 +55,21 @@ typedef bool hash_less_func (const struct hash_elem *a,
    data AUX. */
 typedef void hash_action_func (struct hash_elem *e, void *aux);
 
-/* Hash table. */
+/* Hash table.
+
+   The table is resized a few buckets at a time.  While a resize
+   is in progress, the buckets of `old_buckets' from `migrate_idx'
+   on still hold their elements; the others have been moved to
+   `buckets'. */
 struct hash 
   {
     size_t elem_cnt;            /* Number of elements in table. */
     size_t bucket_cnt;          /* Number of buckets, a power of 2. */
     struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    struct list *old_buckets;   /* Buckets being moved, or null. */
+    size_t old_bucket_cnt;      /* Number of `old_buckets'. */
+    size_t migrate_idx;         /* First old bucket not yet moved. */
+    size_t min_bucket_cnt;      /* Fewest buckets ever used. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -76,6 +85,8 @@ struct hash_iterator
 
 /* Basic life cycle. */
 bool hash_init (struct hash *, hash_hash_func *, hash_less_func *, void *aux);
+bool hash_init_sized (struct hash *, hash_hash_func *, hash_less_func *,
+                      void *aux, size_t elem_cnt);
 void hash_clear (struct hash *, hash_action_func *);
 void hash_destroy (struct hash *, hash_action_func *);
 
@@ -99,5 +110,6 @@ bool hash_empty (struct hash *);
 unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
 unsigned hash_int (int);
+unsigned hash_ptr (const void *);
 
 #endif /* lib/kernel/hash.h */
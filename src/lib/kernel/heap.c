@@ -0,0 +1,204 @@
+/* Priority queue.
+
+   See heap.h for basic information. */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *,
+                               struct heap_elem *, struct heap_elem *);
+static struct heap_elem *meld_children (struct heap *, struct heap_elem *);
+static void cut (struct heap_elem *);
+
+/* Initializes heap H to order its elements using LESS, given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->elem_cnt = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_insert (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = h->root != NULL ? meld (h, h->root, e) : e;
+  h->elem_cnt++;
+}
+
+/* Removes the least element from H and returns it.  H must not
+   be empty. */
+struct heap_elem *
+heap_pop (struct heap *h)
+{
+  struct heap_elem *root;
+
+  ASSERT (h != NULL);
+  ASSERT (h->root != NULL);
+
+  root = h->root;
+  h->root = meld_children (h, root);
+  h->elem_cnt--;
+  return root;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  if (e == h->root)
+    heap_pop (h);
+  else
+    {
+      struct heap_elem *children;
+
+      cut (e);
+      children = meld_children (h, e);
+      if (children != NULL)
+        h->root = meld (h, h->root, children);
+      h->elem_cnt--;
+    }
+}
+
+/* Moves E, which must be in H, up to its place after its value
+   has decreased, that is, after it has come to be less than or
+   equal to what it was.  Takes O(1) time. */
+void
+heap_decrease (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  if (e != h->root)
+    {
+      cut (e);
+      h->root = meld (h, h->root, e);
+    }
+}
+
+/* Returns the least element in H, or a null pointer if H is
+   empty. */
+struct heap_elem *
+heap_top (const struct heap *h)
+{
+  ASSERT (h != NULL);
+
+  return h->root;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h)
+{
+  ASSERT (h != NULL);
+
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+heap_empty (const struct heap *h)
+{
+  ASSERT (h != NULL);
+
+  return h->root == NULL;
+}
+
+/* Melds the trees rooted at A and B, which are not in any other
+   tree, and returns the root of the result.  The greater root
+   becomes the first child of the lesser; B loses a tie. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  if (h->less (b, a, h->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  a->next = a->prev = NULL;
+  return a;
+}
+
+/* Melds together the children of E, detaching them from E, and
+   returns the root of the resulting tree, or a null pointer if E
+   has no children. */
+static struct heap_elem *
+meld_children (struct heap *h, struct heap_elem *e)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *child = e->child;
+  struct heap_elem *root;
+
+  e->child = NULL;
+
+  /* Meld the children in pairs, left to right, stacking the
+     results on PAIRS through their `next' members. */
+  while (child != NULL)
+    {
+      struct heap_elem *a = child;
+      struct heap_elem *b = a->next;
+
+      if (b != NULL)
+        {
+          child = b->next;
+          a = meld (h, a, b);
+        }
+      else
+        {
+          child = NULL;
+          a->prev = NULL;
+        }
+      a->next = pairs;
+      pairs = a;
+    }
+
+  /* Meld the pairs into one tree, right to left. */
+  root = pairs;
+  if (root != NULL)
+    {
+      pairs = root->next;
+      root->next = NULL;
+      while (pairs != NULL)
+        {
+          struct heap_elem *next = pairs->next;
+          root = meld (h, root, pairs);
+          pairs = next;
+        }
+    }
+  return root;
+}
+
+/* Cuts E, with the tree under it, away from its parent. */
+static void
+cut (struct heap_elem *e)
+{
+  ASSERT (e->prev != NULL);
+
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  e->next = e->prev = NULL;
+}
@@ -0,0 +1,79 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   This is a pairing heap, after Fredman, Sedgewick, Sleator, and
+   Tarjan.  Each element of the heap is the root of a tree of the
+   elements that are not less than it, kept as a list of
+   children, and the heap itself is the tree whose root is the
+   least element.  Inserting an element or
+   melding in a tree just makes the loser of one comparison a
+   child of the winner, in O(1) time.  Removing the root melds
+   its children in pairs, left to right, then melds the pairs
+   together right to left, which takes O(lg n) amortized time.
+
+   Like the list and the hash table, the heap does no dynamic
+   allocation.  Each structure that can be in a heap must embed a
+   struct heap_elem member, and the heap_entry macro converts
+   from a struct heap_elem back to the structure that contains
+   it.  See lib/kernel/list.h for a detailed explanation.
+
+   "Least" is as defined by the heap's heap_less_func, so a heap
+   whose comparison function puts higher priorities first keeps
+   the highest priority element on top.  Elements that compare
+   equal come off in no particular order; a caller that wants
+   first-in, first-out order among them must break the tie in
+   its comparison function. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* First child. */
+    struct heap_elem *next;     /* Next sibling. */
+    struct heap_elem *prev;     /* Previous sibling, or parent if
+                                   this is the first child. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child    \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Least element, or null if empty. */
+    size_t elem_cnt;            /* Number of elements in heap. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+/* Insertion and removal. */
+void heap_insert (struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_decrease (struct heap *, struct heap_elem *);
+
+/* Information. */
+struct heap_elem *heap_top (const struct heap *);
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -0,0 +1,140 @@
+/* Interval tree.
+
+   See itree.h for basic information. */
+
+#include "itree.h"
+#include "../debug.h"
+
+#define rb_to_itree(RB_ELEM)                                    \
+        ((RB_ELEM) != NULL                                      \
+         ? rb_entry (RB_ELEM, struct itree_elem, rb_elem) : NULL)
+
+static rb_less_func itree_less;
+static rb_augment_func itree_augment;
+
+/* Initializes interval tree T. */
+void
+itree_init (struct itree *t)
+{
+  ASSERT (t != NULL);
+
+  rb_init (&t->tree, itree_less, itree_augment, NULL);
+}
+
+/* Inserts E into T as the interval [START, END), which must not
+   be empty.  Intervals in T may overlap, and may even be
+   equal. */
+void
+itree_insert (struct itree *t, struct itree_elem *e,
+              uintptr_t start, uintptr_t end)
+{
+  struct rb_elem *old UNUSED;
+
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+  ASSERT (start < end);
+
+  e->start = start;
+  e->end = e->max_end = end;
+  old = rb_insert (&t->tree, &e->rb_elem);
+  ASSERT (old == NULL);
+}
+
+/* Removes E, which must be in T, from T. */
+void
+itree_remove (struct itree *t, struct itree_elem *e)
+{
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+
+  rb_remove (&t->tree, &e->rb_elem);
+}
+
+/* Returns the interval in T with the lowest start among those
+   that overlap [START, END), or a null pointer if none of them
+   does. */
+struct itree_elem *
+itree_find (struct itree *t, uintptr_t start, uintptr_t end)
+{
+  struct itree_elem *e = rb_to_itree (t->tree.root);
+
+  ASSERT (start < end);
+
+  while (e != NULL)
+    {
+      struct itree_elem *left = rb_to_itree (e->rb_elem.left);
+
+      /* If any interval on the left ends past START, the lowest
+         overlap is there if anywhere, because the rest start no
+         lower than one that would have overlapped it. */
+      if (left != NULL && left->max_end > start)
+        e = left;
+      else if (e->start >= end)
+        return NULL;
+      else if (e->end > start)
+        return e;
+      else
+        e = rb_to_itree (e->rb_elem.right);
+    }
+  return NULL;
+}
+
+/* Returns the interval in T with the lowest start, or a null
+   pointer if T is empty. */
+struct itree_elem *
+itree_first (struct itree *t)
+{
+  return rb_to_itree (rb_first (&t->tree));
+}
+
+/* Returns the interval that follows E in start order, or a null
+   pointer if E is the last. */
+struct itree_elem *
+itree_next (struct itree_elem *e)
+{
+  return rb_to_itree (rb_next (&e->rb_elem));
+}
+
+/* Returns the number of intervals in T. */
+size_t
+itree_size (struct itree *t)
+{
+  return rb_size (&t->tree);
+}
+
+/* Returns true if T contains no intervals, false otherwise. */
+bool
+itree_empty (struct itree *t)
+{
+  return rb_empty (&t->tree);
+}
+
+/* Orders intervals by start, and equal starts by address so
+   that every element is distinct. */
+static bool
+itree_less (const struct rb_elem *a_, const struct rb_elem *b_,
+            void *aux UNUSED)
+{
+  const struct itree_elem *a = rb_entry (a_, struct itree_elem, rb_elem);
+  const struct itree_elem *b = rb_entry (b_, struct itree_elem, rb_elem);
+
+  if (a->start != b->start)
+    return a->start < b->start;
+  return a < b;
+}
+
+/* Sets the greatest end in E's subtree from E's own and its
+   children's. */
+static void
+itree_augment (struct rb_elem *e_, void *aux UNUSED)
+{
+  struct itree_elem *e = rb_entry (e_, struct itree_elem, rb_elem);
+  struct itree_elem *left = rb_to_itree (e_->left);
+  struct itree_elem *right = rb_to_itree (e_->right);
+
+  e->max_end = e->end;
+  if (left != NULL && left->max_end > e->max_end)
+    e->max_end = left->max_end;
+  if (right != NULL && right->max_end > e->max_end)
+    e->max_end = right->max_end;
+}
@@ -0,0 +1,60 @@
+#ifndef __LIB_KERNEL_ITREE_H
+#define __LIB_KERNEL_ITREE_H
+
+/* Interval tree.
+
+   A red-black tree (see rbtree.h) of half-open intervals
+   [START, END), ordered by START, in which each element also
+   keeps the greatest END in its subtree.  That is enough to find
+   an interval that overlaps a given range in O(lg n) time: a
+   subtree whose greatest END is at or below the range's start
+   cannot hold one, and neither can the part of the tree to the
+   right of an element whose START is at or past the range's
+   end.
+
+   Each structure that can be in an interval tree embeds a struct
+   itree_elem member, whose START and END are set by
+   itree_insert() and must not change while it is in the tree.
+   The itree_entry macro converts from a struct itree_elem back
+   to the structure that contains it. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rbtree.h"
+
+/* Interval tree element. */
+struct itree_elem
+  {
+    struct rb_elem rb_elem;     /* Red-black tree element. */
+    uintptr_t start;            /* First value in interval. */
+    uintptr_t end;              /* One past last value in interval. */
+    uintptr_t max_end;          /* Greatest END in subtree. */
+  };
+
+/* Converts pointer to interval tree element ITREE_ELEM into a
+   pointer to the structure that ITREE_ELEM is embedded inside.
+   Supply the name of the outer structure STRUCT and the member
+   name MEMBER of the interval tree element. */
+#define itree_entry(ITREE_ELEM, STRUCT, MEMBER)                 \
+        ((STRUCT *) ((uint8_t *) &(ITREE_ELEM)->rb_elem         \
+                     - offsetof (STRUCT, MEMBER.rb_elem)))
+
+/* Interval tree. */
+struct itree
+  {
+    struct rb_tree tree;        /* Elements, ordered by START. */
+  };
+
+void itree_init (struct itree *);
+void itree_insert (struct itree *, struct itree_elem *,
+                   uintptr_t start, uintptr_t end);
+void itree_remove (struct itree *, struct itree_elem *);
+struct itree_elem *itree_find (struct itree *, uintptr_t start,
+                               uintptr_t end);
+struct itree_elem *itree_first (struct itree *);
+struct itree_elem *itree_next (struct itree_elem *);
+size_t itree_size (struct itree *);
+bool itree_empty (struct itree *);
+
+#endif /* lib/kernel/itree.h */
@@ -0,0 +1,372 @@
+/* Open-addressed hash table.
+
+   See ohash.h for basic information. */
+
+#include "ohash.h"
+#include "../debug.h"
+#include "threads/malloc.h"
+
+/* Fewest slots in a table. */
+#define MIN_SLOT_CNT 8
+
+/* Load factor bounds, in eighths of the slots used.  The table
+   grows when more than MAX_LOAD eighths are used, and shrinks
+   when fewer than MIN_LOAD eighths are. */
+#define MAX_LOAD 6
+#define MIN_LOAD 1
+
+static size_t ideal_slot_cnt (size_t elem_cnt);
+static size_t home (const struct ohash *, unsigned hash);
+static size_t distance (const struct ohash *, size_t idx);
+static struct ohash_slot *find_slot (struct ohash *, struct hash_elem *,
+                                     unsigned hash);
+static void place (struct ohash *, struct hash_elem *, unsigned hash);
+static void remove_slot (struct ohash *, struct ohash_slot *);
+static bool resize (struct ohash *, size_t slot_cnt);
+static void rehash (struct ohash *);
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX.
+   The table starts with room for ELEM_CNT elements, which may be
+   0, and never shrinks below that. */
+bool
+ohash_init (struct ohash *h, hash_hash_func *hash, hash_less_func *less,
+            void *aux, size_t elem_cnt)
+{
+  h->elem_cnt = 0;
+  h->slot_cnt = ideal_slot_cnt (elem_cnt);
+  h->min_slot_cnt = h->slot_cnt;
+  h->slots = malloc (sizeof *h->slots * h->slot_cnt);
+  h->hash = hash;
+  h->less = less;
+  h->aux = aux;
+
+  if (h->slots != NULL)
+    {
+      ohash_clear (h, NULL);
+      return true;
+    }
+  else
+    return false;
+}
+
+/* Removes all the elements from H, calling DESTRUCTOR on each
+   if it is non-null.  The same rules as for hash_clear()
+   apply. */
+void
+ohash_clear (struct ohash *h, hash_action_func *destructor)
+{
+  size_t i;
+
+  for (i = 0; i < h->slot_cnt; i++)
+    {
+      struct hash_elem *e = h->slots[i].elem;
+
+      h->slots[i].elem = NULL;
+      if (e != NULL && destructor != NULL)
+        destructor (e, h->aux);
+    }
+  h->elem_cnt = 0;
+}
+
+/* Destroys hash table H, first calling DESTRUCTOR on each
+   element if it is non-null. */
+void
+ohash_destroy (struct ohash *h, hash_action_func *destructor)
+{
+  if (destructor != NULL)
+    ohash_clear (h, destructor);
+  free (h->slots);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW. */
+struct hash_elem *
+ohash_insert (struct ohash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  struct ohash_slot *s = find_slot (h, new, hash);
+
+  if (s != NULL)
+    return s->elem;
+
+  h->elem_cnt++;
+  rehash (h);
+  place (h, new, hash);
+  return NULL;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned. */
+struct hash_elem *
+ohash_replace (struct ohash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  struct ohash_slot *s = find_slot (h, new, hash);
+  struct hash_elem *old;
+
+  if (s != NULL)
+    {
+      old = s->elem;
+      s->elem = new;
+      return old;
+    }
+
+  h->elem_cnt++;
+  rehash (h);
+  place (h, new, hash);
+  return NULL;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table. */
+struct hash_elem *
+ohash_find (struct ohash *h, struct hash_elem *e)
+{
+  struct ohash_slot *s = find_slot (h, e, h->hash (e, h->aux));
+
+  return s != NULL ? s->elem : NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table. */
+struct hash_elem *
+ohash_delete (struct ohash *h, struct hash_elem *e)
+{
+  struct ohash_slot *s = find_slot (h, e, h->hash (e, h->aux));
+  struct hash_elem *found;
+
+  if (s == NULL)
+    return NULL;
+
+  found = s->elem;
+  remove_slot (h, s);
+  h->elem_cnt--;
+  rehash (h);
+  return found;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order.  Modifying H meanwhile yields undefined behavior. */
+void
+ohash_apply (struct ohash *h, hash_action_func *action)
+{
+  size_t i;
+
+  ASSERT (action != NULL);
+
+  for (i = 0; i < h->slot_cnt; i++)
+    if (h->slots[i].elem != NULL)
+      action (h->slots[i].elem, h->aux);
+}
+
+/* Initializes I for iterating hash table H, with the same idiom
+   as hash_first().  Modifying H during iteration invalidates all
+   iterators. */
+void
+ohash_first (struct ohash_iterator *i, struct ohash *h)
+{
+  ASSERT (i != NULL);
+  ASSERT (h != NULL);
+
+  i->hash = h;
+  i->idx = (size_t) -1;
+  i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left. */
+struct hash_elem *
+ohash_next (struct ohash_iterator *i)
+{
+  struct ohash *h;
+
+  ASSERT (i != NULL);
+
+  h = i->hash;
+  while (++i->idx < h->slot_cnt)
+    if (h->slots[i->idx].elem != NULL)
+      return i->elem = h->slots[i->idx].elem;
+  i->idx = h->slot_cnt;
+  return i->elem = NULL;
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table. */
+struct hash_elem *
+ohash_cur (struct ohash_iterator *i)
+{
+  return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+ohash_size (struct ohash *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+ohash_empty (struct ohash *h)
+{
+  return h->elem_cnt == 0;
+}
+
+/* Returns the number of slots, a power of 2, that holds
+   ELEM_CNT elements within the maximum load. */
+static size_t
+ideal_slot_cnt (size_t elem_cnt)
+{
+  size_t slot_cnt = MIN_SLOT_CNT;
+
+  while (elem_cnt * 8 > slot_cnt * MAX_LOAD)
+    slot_cnt *= 2;
+  return slot_cnt;
+}
+
+/* Returns the home slot in H of elements with HASH. */
+static size_t
+home (const struct ohash *h, unsigned hash)
+{
+  return hash & (h->slot_cnt - 1);
+}
+
+/* Returns how far the element in occupied slot IDX of H lies
+   from its home slot. */
+static size_t
+distance (const struct ohash *h, size_t idx)
+{
+  return (idx - home (h, h->slots[idx].hash)) & (h->slot_cnt - 1);
+}
+
+/* Returns the slot in H holding an element equal to E, whose
+   hash value is HASH, or a null pointer if there is none. */
+static struct ohash_slot *
+find_slot (struct ohash *h, struct hash_elem *e, unsigned hash)
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t idx = home (h, hash);
+  size_t dist;
+
+  for (dist = 0; dist < h->slot_cnt; dist++, idx = (idx + 1) & mask)
+    {
+      struct ohash_slot *s = &h->slots[idx];
+
+      /* An element nearer to its home than E would be means E is
+         not in the table, or it would have taken that slot. */
+      if (s->elem == NULL || distance (h, idx) < dist)
+        return NULL;
+      if (s->hash == hash
+          && !h->less (s->elem, e, h->aux) && !h->less (e, s->elem, h->aux))
+        return s;
+    }
+  return NULL;
+}
+
+/* Puts E, whose hash value is HASH and which is not in H, into a
+   slot of H.  On the way, E takes the slot of any element nearer
+   to its home, which then moves on in E's place.  H must have a
+   free slot. */
+static void
+place (struct ohash *h, struct hash_elem *e, unsigned hash)
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t idx = home (h, hash);
+  size_t dist;
+
+  for (dist = 0; ; dist++, idx = (idx + 1) & mask)
+    {
+      struct ohash_slot *s = &h->slots[idx];
+      size_t s_dist;
+
+      if (s->elem == NULL)
+        {
+          s->elem = e;
+          s->hash = hash;
+          return;
+        }
+
+      s_dist = distance (h, idx);
+      if (s_dist < dist)
+        {
+          struct hash_elem *e_tmp = s->elem;
+          unsigned hash_tmp = s->hash;
+
+          s->elem = e;
+          s->hash = hash;
+          e = e_tmp;
+          hash = hash_tmp;
+          dist = s_dist;
+        }
+    }
+}
+
+/* Empties slot S of H, moving each following element that is
+   away from its home back by one slot, so that no lookup stops
+   early at the gap. */
+static void
+remove_slot (struct ohash *h, struct ohash_slot *s)
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t idx = s - h->slots;
+
+  for (;;)
+    {
+      size_t next = (idx + 1) & mask;
+
+      if (h->slots[next].elem == NULL || distance (h, next) == 0)
+        break;
+      h->slots[idx] = h->slots[next];
+      idx = next;
+    }
+  h->slots[idx].elem = NULL;
+}
+
+/* Changes the number of slots in H to SLOT_CNT, moving every
+   element.  Returns false if out of memory, leaving H
+   unchanged. */
+static bool
+resize (struct ohash *h, size_t slot_cnt)
+{
+  struct ohash_slot *old_slots = h->slots;
+  size_t old_slot_cnt = h->slot_cnt;
+  size_t i;
+
+  h->slots = malloc (sizeof *h->slots * slot_cnt);
+  if (h->slots == NULL)
+    {
+      h->slots = old_slots;
+      return false;
+    }
+  h->slot_cnt = slot_cnt;
+  for (i = 0; i < slot_cnt; i++)
+    h->slots[i].elem = NULL;
+
+  for (i = 0; i < old_slot_cnt; i++)
+    if (old_slots[i].elem != NULL)
+      place (h, old_slots[i].elem, old_slots[i].hash);
+  free (old_slots);
+  return true;
+}
+
+/* Resizes H, if needed, so that its current element count,
+   which may count one element not yet placed, stays within the
+   load bounds.  If growing runs out of memory, the table fills
+   up further, which only makes probes longer, but a completely
+   full table that cannot grow is a kernel panic. */
+static void
+rehash (struct ohash *h)
+{
+  if (h->elem_cnt * 8 > h->slot_cnt * MAX_LOAD)
+    {
+      if (!resize (h, h->slot_cnt * 2) && h->elem_cnt > h->slot_cnt)
+        PANIC ("open hash table full and out of memory");
+    }
+  else if (h->slot_cnt > h->min_slot_cnt
+           && h->elem_cnt * 8 < h->slot_cnt * MIN_LOAD)
+    resize (h, h->slot_cnt / 2);
+}
@@ -0,0 +1,79 @@
+#ifndef __LIB_KERNEL_OHASH_H
+#define __LIB_KERNEL_OHASH_H
+
+/* Open-addressed hash table.
+
+   A variant of the hash table in hash.h that keeps its elements
+   in a flat array of slots instead of chained lists, so that a
+   lookup scans neighbouring slots rather than following list
+   pointers.  Each slot holds a pointer to an element and the
+   element's hash value, which is compared before calling the
+   comparison function.
+
+   Collisions are resolved by linear probing with Robin Hood
+   ordering: an element being inserted takes the slot of any
+   element that is closer to its home slot, so probe lengths stay
+   short and even, and a lookup stops as soon as it reaches an
+   element nearer to home than the one it looks for.  Deletion
+   shifts the following elements back instead of leaving
+   tombstones.
+
+   Elements embed a struct hash_elem as for hash.h, and the
+   same hash_hash_func and hash_less_func are used, so a table
+   can be switched between the two implementations by changing
+   only the calls.  The struct hash_elem is not modified. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "hash.h"
+
+/* Slot. */
+struct ohash_slot
+  {
+    unsigned hash;              /* Hash value of `elem'. */
+    struct hash_elem *elem;     /* Element, or null if empty. */
+  };
+
+/* Open-addressed hash table. */
+struct ohash
+  {
+    size_t elem_cnt;            /* Number of elements in table. */
+    size_t slot_cnt;            /* Number of slots, a power of 2. */
+    size_t min_slot_cnt;        /* Fewest slots ever used. */
+    struct ohash_slot *slots;   /* Array of `slot_cnt' slots. */
+    hash_hash_func *hash;       /* Hash function. */
+    hash_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `hash' and `less'. */
+  };
+
+/* An open-addressed hash table iterator. */
+struct ohash_iterator
+  {
+    struct ohash *hash;         /* The hash table. */
+    size_t idx;                 /* Index of the current slot. */
+    struct hash_elem *elem;     /* Current hash element. */
+  };
+
+/* Basic life cycle. */
+bool ohash_init (struct ohash *, hash_hash_func *, hash_less_func *,
+                 void *aux, size_t elem_cnt);
+void ohash_clear (struct ohash *, hash_action_func *);
+void ohash_destroy (struct ohash *, hash_action_func *);
+
+/* Search, insertion, deletion. */
+struct hash_elem *ohash_insert (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_replace (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_find (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_delete (struct ohash *, struct hash_elem *);
+
+/* Iteration. */
+void ohash_apply (struct ohash *, hash_action_func *);
+void ohash_first (struct ohash_iterator *, struct ohash *);
+struct hash_elem *ohash_next (struct ohash_iterator *);
+struct hash_elem *ohash_cur (struct ohash_iterator *);
+
+/* Information. */
+size_t ohash_size (struct ohash *);
+bool ohash_empty (struct ohash *);
+
+#endif /* lib/kernel/ohash.h */
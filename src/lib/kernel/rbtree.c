@@ -0,0 +1,418 @@
+/* Red-black tree.
+
+   See rbtree.h for basic information. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static void augment_path (struct rb_tree *, struct rb_elem *);
+static void replace_child (struct rb_tree *, struct rb_elem *old,
+                           struct rb_elem *new);
+static void rotate_left (struct rb_tree *, struct rb_elem *);
+static void rotate_right (struct rb_tree *, struct rb_elem *);
+static void insert_fixup (struct rb_tree *, struct rb_elem *);
+static void remove_fixup (struct rb_tree *, struct rb_elem *,
+                          struct rb_elem *parent);
+static struct rb_elem *leftmost (struct rb_elem *);
+static struct rb_elem *rightmost (struct rb_elem *);
+static bool is_red (const struct rb_elem *);
+
+/* Initializes tree T to order its elements using LESS and, if
+   AUGMENT is non-null, to keep each element's augmented data up
+   to date with AUGMENT, given auxiliary data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, rb_augment_func *augment,
+         void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->elem_cnt = 0;
+  t->less = less;
+  t->augment = augment;
+  t->aux = aux;
+}
+
+/* Inserts NEW into tree T, if no equal element is already in
+   the tree.  If an equal element is already in the tree, returns
+   it without inserting NEW. */
+struct rb_elem *
+rb_insert (struct rb_tree *t, struct rb_elem *new)
+{
+  struct rb_elem **link = &t->root;
+  struct rb_elem *parent = NULL;
+
+  ASSERT (new != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (t->less (new, parent, t->aux))
+        link = &parent->left;
+      else if (t->less (parent, new, t->aux))
+        link = &parent->right;
+      else
+        return parent;
+    }
+
+  new->parent = parent;
+  new->left = new->right = NULL;
+  new->red = true;
+  *link = new;
+  t->elem_cnt++;
+
+  augment_path (t, new);
+  insert_fixup (t, new);
+  return NULL;
+}
+
+/* Finds and returns an element equal to E in tree T, or a null
+   pointer if no equal element exists in the tree. */
+struct rb_elem *
+rb_find (struct rb_tree *t, const struct rb_elem *e)
+{
+  struct rb_elem *p = t->root;
+
+  while (p != NULL)
+    if (t->less (e, p, t->aux))
+      p = p->left;
+    else if (t->less (p, e, t->aux))
+      p = p->right;
+    else
+      return p;
+  return NULL;
+}
+
+/* Removes element E, which must be in tree T, from T. */
+void
+rb_remove (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *x, *x_parent;
+  bool removed_red;
+
+  ASSERT (e != NULL);
+
+  if (e->left == NULL || e->right == NULL)
+    {
+      /* Splice E out, moving up its only child, if any. */
+      x = e->left != NULL ? e->left : e->right;
+      x_parent = e->parent;
+      removed_red = e->red;
+      replace_child (t, e, x);
+    }
+  else
+    {
+      /* Splice out E's successor, which has no left child, and
+         put it in E's place. */
+      struct rb_elem *y = leftmost (e->right);
+
+      x = y->right;
+      removed_red = y->red;
+      if (y->parent == e)
+        x_parent = y;
+      else
+        {
+          x_parent = y->parent;
+          replace_child (t, y, x);
+          y->right = e->right;
+          y->right->parent = y;
+        }
+      replace_child (t, e, y);
+      y->left = e->left;
+      y->left->parent = y;
+      y->red = e->red;
+    }
+  t->elem_cnt--;
+
+  augment_path (t, x_parent);
+  if (!removed_red)
+    remove_fixup (t, x, x_parent);
+}
+
+/* Returns the least element in tree T, or a null pointer if T
+   is empty. */
+struct rb_elem *
+rb_first (struct rb_tree *t)
+{
+  return t->root != NULL ? leftmost (t->root) : NULL;
+}
+
+/* Returns the greatest element in tree T, or a null pointer if
+   T is empty. */
+struct rb_elem *
+rb_last (struct rb_tree *t)
+{
+  return t->root != NULL ? rightmost (t->root) : NULL;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the greatest. */
+struct rb_elem *
+rb_next (struct rb_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->right != NULL)
+    return leftmost (e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element that precedes E in its tree, or a null
+   pointer if E is the least. */
+struct rb_elem *
+rb_prev (struct rb_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->left != NULL)
+    return rightmost (e->left);
+  while (e->parent != NULL && e == e->parent->left)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size (struct rb_tree *t)
+{
+  return t->elem_cnt;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool
+rb_empty (struct rb_tree *t)
+{
+  return t->root == NULL;
+}
+
+/* Recomputes the augmented data of E and each of its ancestors,
+   if T is augmented. */
+static void
+augment_path (struct rb_tree *t, struct rb_elem *e)
+{
+  if (t->augment != NULL)
+    for (; e != NULL; e = e->parent)
+      t->augment (e, t->aux);
+}
+
+/* Puts NEW, which may be null, in OLD's place as a child of
+   OLD's parent or as T's root. */
+static void
+replace_child (struct rb_tree *t, struct rb_elem *old, struct rb_elem *new)
+{
+  struct rb_elem *parent = old->parent;
+
+  if (parent == NULL)
+    t->root = new;
+  else if (parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+  if (new != NULL)
+    new->parent = parent;
+}
+
+/* Rotates E's right child up into E's place, making E its left
+   child. */
+static void
+rotate_left (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *r = e->right;
+
+  e->right = r->left;
+  if (r->left != NULL)
+    r->left->parent = e;
+  replace_child (t, e, r);
+  r->left = e;
+  e->parent = r;
+
+  if (t->augment != NULL)
+    {
+      t->augment (e, t->aux);
+      t->augment (r, t->aux);
+    }
+}
+
+/* Rotates E's left child up into E's place, making E its right
+   child. */
+static void
+rotate_right (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *l = e->left;
+
+  e->left = l->right;
+  if (l->right != NULL)
+    l->right->parent = e;
+  replace_child (t, e, l);
+  l->right = e;
+  e->parent = l;
+
+  if (t->augment != NULL)
+    {
+      t->augment (e, t->aux);
+      t->augment (l, t->aux);
+    }
+}
+
+/* Restores the red-black properties after red element E was
+   inserted into T. */
+static void
+insert_fixup (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *parent;
+
+  while ((parent = e->parent) != NULL && parent->red)
+    {
+      /* PARENT is red, so it is not the root. */
+      struct rb_elem *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+        {
+          struct rb_elem *uncle = grandparent->right;
+          if (is_red (uncle))
+            {
+              /* Push the grandparent's blackness down a level and
+                 carry on from there. */
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->right)
+            {
+              rotate_left (t, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_right (t, grandparent);
+        }
+      else
+        {
+          struct rb_elem *uncle = grandparent->left;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->left)
+            {
+              rotate_right (t, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_left (t, grandparent);
+        }
+    }
+  t->root->red = false;
+}
+
+/* Restores the red-black properties after a black element was
+   removed from T, leaving X, which may be null, as the child of
+   PARENT one black element short on its paths. */
+static void
+remove_fixup (struct rb_tree *t, struct rb_elem *x, struct rb_elem *parent)
+{
+  while (x != t->root && !is_red (x))
+    {
+      /* X's sibling has at least one black element on each of
+         its paths, so it exists. */
+      if (x == parent->left)
+        {
+          struct rb_elem *sibling = parent->right;
+          if (sibling->red)
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_left (t, parent);
+              sibling = parent->right;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              /* Take one black from both sides, moving the
+                 shortage up a level. */
+              sibling->red = true;
+              x = parent;
+              parent = x->parent;
+              continue;
+            }
+          if (!is_red (sibling->right))
+            {
+              sibling->left->red = false;
+              sibling->red = true;
+              rotate_right (t, sibling);
+              sibling = parent->right;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->right->red = false;
+          rotate_left (t, parent);
+        }
+      else
+        {
+          struct rb_elem *sibling = parent->left;
+          if (sibling->red)
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_right (t, parent);
+              sibling = parent->left;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              x = parent;
+              parent = x->parent;
+              continue;
+            }
+          if (!is_red (sibling->left))
+            {
+              sibling->right->red = false;
+              sibling->red = true;
+              rotate_left (t, sibling);
+              sibling = parent->left;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->left->red = false;
+          rotate_right (t, parent);
+        }
+      x = t->root;
+    }
+  if (x != NULL)
+    x->red = false;
+}
+
+/* Returns the least element in the subtree rooted at E. */
+static struct rb_elem *
+leftmost (struct rb_elem *e)
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Returns the greatest element in the subtree rooted at E. */
+static struct rb_elem *
+rightmost (struct rb_elem *e)
+{
+  while (e->right != NULL)
+    e = e->right;
+  return e;
+}
+
+/* Returns true if E is a red element, false if it is black or
+   null. */
+static bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
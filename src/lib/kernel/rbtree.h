@@ -0,0 +1,88 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A binary search tree that keeps itself balanced by coloring
+   each node red or black, such that no red node has a red child
+   and every path from a node down to a leaf passes the same
+   number of black nodes.  The longest path is then at most twice
+   the shortest, so searching, inserting, and removing take
+   O(lg n) time.  See chapter 13 of Cormen et al., "Introduction
+   to Algorithms".
+
+   Like the list and the hash table, the tree does no dynamic
+   allocation.  Each structure that can be in a tree must embed a
+   struct rb_elem member, and the rb_entry macro converts from a
+   struct rb_elem back to the structure that contains it.  See
+   lib/kernel/list.h for a detailed explanation.
+
+   A tree may be augmented with data kept in each element that
+   summarizes the element's subtree, such as the greatest end of
+   the intervals in it (see itree.h).  The tree calls its
+   rb_augment_func on each element whose subtree changes, always
+   after calling it on the element's children, so the function
+   need only combine the element's own data with its children's
+   summaries. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Red-black tree element. */
+struct rb_elem
+  {
+    struct rb_elem *parent;     /* Parent, or null for the root. */
+    struct rb_elem *left;       /* Left child, or null. */
+    struct rb_elem *right;      /* Right child, or null. */
+    bool red;                   /* Red, or black if false. */
+  };
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+   structure that RB_ELEM is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)               \
+        ((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent     \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b,
+                           void *aux);
+
+/* Recomputes the augmented data of tree element E from its own
+   data and that of its children, given auxiliary data AUX. */
+typedef void rb_augment_func (struct rb_elem *e, void *aux);
+
+/* Red-black tree. */
+struct rb_tree
+  {
+    struct rb_elem *root;       /* Root, or null if empty. */
+    size_t elem_cnt;            /* Number of elements in tree. */
+    rb_less_func *less;         /* Comparison function. */
+    rb_augment_func *augment;   /* Augmentation function, or null. */
+    void *aux;                  /* Auxiliary data for the functions. */
+  };
+
+void rb_init (struct rb_tree *, rb_less_func *, rb_augment_func *,
+              void *aux);
+
+/* Search, insertion, deletion. */
+struct rb_elem *rb_insert (struct rb_tree *, struct rb_elem *);
+struct rb_elem *rb_find (struct rb_tree *, const struct rb_elem *);
+void rb_remove (struct rb_tree *, struct rb_elem *);
+
+/* Traversal in order. */
+struct rb_elem *rb_first (struct rb_tree *);
+struct rb_elem *rb_last (struct rb_tree *);
+struct rb_elem *rb_next (struct rb_elem *);
+struct rb_elem *rb_prev (struct rb_elem *);
+
+/* Information. */
+size_t rb_size (struct rb_tree *);
+bool rb_empty (struct rb_tree *);
+
+#endif /* lib/kernel/rbtree.h */
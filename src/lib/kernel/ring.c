@@ -0,0 +1,142 @@
+/* Single-producer, single-consumer ring buffer.
+
+   See ring.h for basic information. */
+
+#include "ring.h"
+#include <string.h>
+#include "../debug.h"
+
+/* Keeps the compiler from moving memory accesses across it.  An
+   x86 CPU does not reorder stores with other stores, or loads
+   with other loads or with later stores (see "Memory Ordering"
+   in [IA32-v3a]), which is all the ordering the ring needs, so
+   no fence instruction is needed even on a multiprocessor. */
+#define ring_barrier() asm volatile ("" : : : "memory")
+
+static void copy_in (struct ring *, size_t pos, const uint8_t *, size_t);
+static void copy_out (const struct ring *, size_t pos, uint8_t *, size_t);
+
+/* Initializes R to use the SIZE bytes at BUF, which must stay
+   valid as long as R is in use.  SIZE must be a power of 2. */
+void
+ring_init (struct ring *r, void *buf, size_t size)
+{
+  ASSERT (r != NULL);
+  ASSERT (buf != NULL);
+  ASSERT (size > 0 && (size & (size - 1)) == 0);
+
+  r->buf = buf;
+  r->size = size;
+  r->head = r->tail = 0;
+}
+
+/* Adds up to SIZE bytes from BUF to R, as many as there is room
+   for, and returns the number added.  Called by the producer. */
+size_t
+ring_write (struct ring *r, const void *buf, size_t size)
+{
+  size_t head = r->head;
+  size_t space = r->size - (head - r->tail);
+
+  if (size > space)
+    size = space;
+  ring_barrier ();
+  copy_in (r, head, buf, size);
+  ring_barrier ();
+  r->head = head + size;
+  return size;
+}
+
+/* Adds the SIZE bytes at BUF to R as one record and returns
+   true, or returns false and adds nothing if there is not room
+   for all of them.  Called by the producer. */
+bool
+ring_put (struct ring *r, const void *buf, size_t size)
+{
+  if (ring_space (r) < size)
+    return false;
+  ring_write (r, buf, size);
+  return true;
+}
+
+/* Removes up to SIZE bytes from R into BUF, as many as it holds,
+   and returns the number removed.  Called by the consumer. */
+size_t
+ring_read (struct ring *r, void *buf, size_t size)
+{
+  size_t tail = r->tail;
+  size_t count = r->head - tail;
+
+  if (size > count)
+    size = count;
+  ring_barrier ();
+  copy_out (r, tail, buf, size);
+  ring_barrier ();
+  r->tail = tail + size;
+  return size;
+}
+
+/* Removes a record of SIZE bytes from R into BUF and returns
+   true, or returns false and removes nothing if R holds fewer
+   than SIZE bytes.  Called by the consumer. */
+bool
+ring_get (struct ring *r, void *buf, size_t size)
+{
+  if (ring_count (r) < size)
+    return false;
+  ring_read (r, buf, size);
+  return true;
+}
+
+/* Returns the number of bytes in R. */
+size_t
+ring_count (const struct ring *r)
+{
+  return r->head - r->tail;
+}
+
+/* Returns the number of bytes that may be added to R. */
+size_t
+ring_space (const struct ring *r)
+{
+  return r->size - ring_count (r);
+}
+
+/* Returns true if R holds no bytes, false otherwise. */
+bool
+ring_empty (const struct ring *r)
+{
+  return r->head == r->tail;
+}
+
+/* Returns true if R has no room for another byte, false
+   otherwise. */
+bool
+ring_full (const struct ring *r)
+{
+  return ring_count (r) == r->size;
+}
+
+/* Copies the SIZE bytes at SRC into R's buffer at byte count
+   POS, wrapping around the end of the buffer. */
+static void
+copy_in (struct ring *r, size_t pos, const uint8_t *src, size_t size)
+{
+  size_t ofs = pos & (r->size - 1);
+  size_t first = r->size - ofs < size ? r->size - ofs : size;
+
+  memcpy (r->buf + ofs, src, first);
+  memcpy (r->buf, src + first, size - first);
+}
+
+/* Copies SIZE bytes from R's buffer at byte count POS into DST,
+   wrapping around the end of the buffer. */
+static void
+copy_out (const struct ring *r, size_t pos, uint8_t *dst, size_t size)
+{
+  size_t ofs = pos & (r->size - 1);
+  size_t first = r->size - ofs < size ? r->size - ofs : size;
+
+  memcpy (dst, r->buf + ofs, first);
+  memcpy (dst + first, r->buf, size - first);
+}
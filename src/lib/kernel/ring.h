@@ -0,0 +1,58 @@
+#ifndef __LIB_KERNEL_RING_H
+#define __LIB_KERNEL_RING_H
+
+/* Single-producer, single-consumer ring buffer.
+
+   A circular buffer of bytes, of a power-of-2 size, into which
+   one party writes while another reads.  HEAD counts the bytes
+   ever written and TAIL the bytes ever read; each only grows,
+   wrapping around at the top of size_t, and is reduced modulo
+   the buffer size to index the buffer.  HEAD - TAIL is then the
+   number of bytes held, and all SIZE bytes of the buffer can be
+   used.
+
+   Only the producer changes HEAD and only the consumer changes
+   TAIL, so no lock is needed between them as long as there is
+   just one of each at a time: the producer copies data in before
+   it publishes the new HEAD, and the consumer copies data out
+   before it publishes the new TAIL, with barriers in between
+   that keep the compiler, and on a multiprocessor the CPU, from
+   reordering the two.  Several producers or several consumers
+   must serialize among themselves, for example by disabling
+   interrupts as the interrupt queue in devices/intq.c does.
+
+   ring_write() and ring_read() move as many bytes as they can.
+   ring_put() and ring_get() move a record of a given size whole
+   or not at all, so records of any size can be queued without
+   either side ever seeing part of one. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Ring buffer. */
+struct ring
+  {
+    uint8_t *buf;               /* Buffer. */
+    size_t size;                /* Buffer size, a power of 2. */
+    volatile size_t head;       /* Bytes ever written, by producer. */
+    volatile size_t tail;       /* Bytes ever read, by consumer. */
+  };
+
+void ring_init (struct ring *, void *buf, size_t size);
+
+/* Producer. */
+size_t ring_write (struct ring *, const void *, size_t);
+bool ring_put (struct ring *, const void *, size_t);
+
+/* Consumer. */
+size_t ring_read (struct ring *, void *, size_t);
+bool ring_get (struct ring *, void *, size_t);
+
+/* Information. */
+size_t ring_count (const struct ring *);
+size_t ring_space (const struct ring *);
+bool ring_empty (const struct ring *);
+bool ring_full (const struct ring *);
+
+#endif /* lib/kernel/ring.h */
@@ -0,0 +1,16 @@
+#ifndef __LIB_MADVISE_H
+#define __LIB_MADVISE_H
+
+/* Hints about the use of a range of memory, as given to the
+   madvise system call.  The first three are kept for each page
+   until changed; the others act once. */
+enum madvise_advice
+  {
+    MADV_NORMAL,                /* No particular order. */
+    MADV_SEQUENTIAL,            /* Used in order: read ahead further. */
+    MADV_RANDOM,                /* Used in no order: do not read ahead. */
+    MADV_WILLNEED,              /* Used soon: start reading it in. */
+    MADV_DONTNEED               /* Not used any more: free it. */
+  };
+
+#endif /* lib/madvise.h */
@@ -0,0 +1,17 @@
+#ifndef __LIB_MEMSTAT_H
+#define __LIB_MEMSTAT_H
+
+#include <stddef.h>
+
+/* Memory use of a process, in pages, as reported by the memstat
+   system call.  Shared pages, such as executable code, are not
+   counted. */
+struct memstat
+  {
+    size_t resident;            /* Pages in memory. */
+    size_t working_set;         /* Resident pages used recently. */
+    size_t soft_limit;          /* Soft resident set limit, or 0. */
+    size_t hard_limit;          /* Hard resident set limit, or 0. */
+  };
+
+#endif /* lib/memstat.h */
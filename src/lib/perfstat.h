@@ -0,0 +1,78 @@
+#ifndef __LIB_PERFSTAT_H
+#define __LIB_PERFSTAT_H
+
+/* Kernel performance counters. */
+enum perf_counter
+  {
+    PERF_CACHE_HIT,             /* Buffer cache hits. */
+    PERF_CACHE_MISS,            /* Buffer cache misses. */
+    PERF_CACHE_EVICT,           /* Buffer cache entries evicted. */
+    PERF_CACHE_THROTTLE,        /* Writes throttled to write back. */
+    PERF_FAULT_ZERO,            /* Page faults on zero pages. */
+    PERF_FAULT_FILE,            /* Page faults on file pages. */
+    PERF_FAULT_SWAP,            /* Page faults on swapped-out pages. */
+    PERF_FAULT_COW,             /* Copy-on-write faults. */
+    PERF_FAULT_STACK,           /* Page faults growing the stack. */
+    PERF_FAULT_BAD,             /* Page faults on invalid addresses. */
+    PERF_SWAP_IN,               /* Pages swapped in. */
+    PERF_SWAP_OUT,              /* Pages swapped out. */
+    PERF_PAGE_MERGE,            /* Identical pages merged. */
+    PERF_LOCK_CONTENDED,        /* Lock acquisitions that blocked. */
+    PERF_CONTEXT_SWITCH,        /* Thread switches. */
+    PERF_DISK_REQUESTS,         /* Disk requests queued. */
+    PERF_DISK_QUEUED,           /* Requests already waiting, summed over
+                                   all queued requests. */
+    PERF_SECTOR_READ,           /* Disk sectors read. */
+    PERF_SECTOR_WRITE,          /* Disk sectors written. */
+    PERF_DISK_FLUSH,            /* Disk write cache flushes. */
+    PERF_TLB_PAGE,              /* TLB entries invalidated one by one. */
+    PERF_TLB_FLUSH,             /* Whole TLB flushes. */
+    PERF_PAGE_MIGRATE,          /* Pages moved by compaction. */
+    PERF_CNT                    /* Number of counters. */
+  };
+
+/* System call numbers counted. */
+#define PERF_SYSCALL_CNT 64
+
+/* Kernel performance counters since boot, as reported by the
+   perfstat system call.  Ticks come at the kernel's timer
+   frequency, 100 Hz by default.  The average disk queue depth is
+   PERF_DISK_QUEUED divided by PERF_DISK_REQUESTS. */
+struct perfstat
+  {
+    long long ticks;                        /* Timer ticks since boot. */
+    long long counters[PERF_CNT];           /* By enum perf_counter. */
+    long long syscalls[PERF_SYSCALL_CNT];   /* By system call number. */
+  };
+
+/* Latency histograms, as reported by the perfhist system call. */
+enum perf_hist
+  {
+    PERF_HIST_SYSCALL,          /* System calls, by number. */
+    PERF_HIST_FAULT,            /* Page faults resolved, index 0 only. */
+    PERF_HIST_DISK_READ,        /* Disk reads, by disk. */
+    PERF_HIST_DISK_WRITE,       /* Disk writes, by disk. */
+    PERF_HIST_CNT               /* Number of kinds of histogram. */
+  };
+
+/* Disks with histograms, numbered 2 * channel + device. */
+#define PERF_HIST_DISKS 4
+
+/* Buckets per histogram.  Latencies are in CPU cycles, as counted
+   by the time stamp counter.  Buckets 0 and 1 hold latencies of 0
+   and 1; from there on each power of 2 is split in two halves, so
+   that bucket 2 * N holds [2**N, 1.5 * 2**N) and bucket 2 * N + 1
+   holds [1.5 * 2**N, 2**(N + 1)).  The last bucket also holds all
+   longer latencies. */
+#define PERF_HIST_BUCKETS 64
+
+/* A latency histogram. */
+struct perfhist
+  {
+    long long count;                        /* Latencies recorded. */
+    long long sum;                          /* Their sum, in cycles. */
+    long long max;                          /* Longest, in cycles. */
+    unsigned buckets[PERF_HIST_BUCKETS];    /* Counts by bucket. */
+  };
+
+#endif /* lib/perfstat.h */
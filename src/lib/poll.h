@@ -0,0 +1,29 @@
+#ifndef __LIB_POLL_H
+#define __LIB_POLL_H
+
+/* A file descriptor to watch, as given to the poll system call.
+   The caller sets FD and EVENTS; poll sets REVENTS to the events
+   of EVENTS that are ready, plus POLLERR, POLLHUP, and POLLNVAL
+   whether asked for or not. */
+struct pollfd
+  {
+    int fd;                     /* File descriptor. */
+    short events;               /* Events to watch for. */
+    short revents;              /* Events that are ready. */
+  };
+
+/* Events. */
+#define POLLIN   0x001          /* Reading would not block. */
+#define POLLOUT  0x004          /* Writing would not block. */
+#define POLLERR  0x008          /* No reader left to write to. */
+#define POLLHUP  0x010          /* No writer left to read from. */
+#define POLLNVAL 0x020          /* FD is not open. */
+
+/* Descriptor standing for the completions of asynchronous I/O,
+   readable when completions are waiting for aio_enter(). */
+#define POLL_AIO_FD (-2)
+
+/* Most descriptors watched by one call. */
+#define POLL_FDS_MAX 64
+
+#endif /* lib/poll.h */
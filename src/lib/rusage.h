@@ -0,0 +1,26 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+/* Whose resource use the getrusage system call reports. */
+#define RUSAGE_SELF 0           /* All threads of the process. */
+#define RUSAGE_THREAD 1         /* The calling thread. */
+
+/* Resource use, as reported by the getrusage system call.  Ticks
+   come at the kernel's timer frequency, 100 Hz by default.  A
+   major fault is one on a file or swapped-out page, which may
+   read the disk; the others are minor.  Sectors are counted as
+   disk requests are made, so write-back of cached data counts
+   for the kernel thread that does it. */
+struct rusage
+  {
+    long long utime;            /* Ticks running in user mode. */
+    long long stime;            /* Ticks running in the kernel. */
+    long long minflt;           /* Minor page faults. */
+    long long majflt;           /* Major page faults. */
+    long long inblock;          /* Disk sectors read. */
+    long long oublock;          /* Disk sectors written. */
+    long long nvcsw;            /* Switches away while blocking. */
+    long long nivcsw;           /* Switches away while runnable. */
+  };
+
+#endif /* lib/rusage.h */
@@ -3,6 +3,7 @@
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Converts a string representation of a signed decimal integer
    in S into an `int', which is returned. */
@@ -52,7 +53,7 @@ compare_thunk (const void *a, const void *b, void *aux)
    using COMPARE.  When COMPARE is passed a pair of elements A
    and B, respectively, it must return a strcmp()-type result,
    i.e. less than zero if A < B, zero if A == B, greater than
-   zero if A > B.  Runs in O(n lg n) time and O(1) space in
+   zero if A > B.  Runs in O(n lg n) time and O(lg n) space in
    CNT. */
 void
 qsort (void *array, size_t cnt, size_t size,
@@ -61,43 +62,145 @@ qsort (void *array, size_t cnt, size_t size,
   sort (array, cnt, size, compare_thunk, &compare);
 }
 
-/* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
-   with elements of SIZE bytes each. */
+/* How to exchange two elements, chosen once for each sort from
+   the element size and alignment. */
+enum swap_type
+  {
+    SWAP_BYTES,                 /* Byte by byte. */
+    SWAP_WORDS,                 /* Word by word. */
+    SWAP_WORD,                  /* A single 4-byte word. */
+    SWAP_DWORD                  /* A single 8-byte double word. */
+  };
+
+/* A sort in progress. */
+struct sorter
+  {
+    size_t size;                /* Element size in bytes. */
+    enum swap_type swap;        /* How to exchange elements. */
+    int (*compare) (const void *, const void *, void *aux);
+    void *aux;                  /* Auxiliary data for COMPARE. */
+  };
+
+/* Partitions of at most this many elements are finished with an
+   insertion sort. */
+#define INSERTION_MAX 12
+
+/* Swaps the elements at A and B. */
+static inline void
+swap_elems (const struct sorter *s, unsigned char *a, unsigned char *b)
+{
+  switch (s->swap)
+    {
+    case SWAP_WORD:
+      {
+        uint32_t t = *(uint32_t *) a;
+        *(uint32_t *) a = *(uint32_t *) b;
+        *(uint32_t *) b = t;
+      }
+      break;
+
+    case SWAP_DWORD:
+      {
+        uint64_t t = *(uint64_t *) a;
+        *(uint64_t *) a = *(uint64_t *) b;
+        *(uint64_t *) b = t;
+      }
+      break;
+
+    case SWAP_WORDS:
+      {
+        uint32_t *wa = (uint32_t *) a;
+        uint32_t *wb = (uint32_t *) b;
+        size_t i;
+
+        for (i = 0; i < s->size / sizeof (uint32_t); i++)
+          {
+            uint32_t t = wa[i];
+            wa[i] = wb[i];
+            wb[i] = t;
+          }
+      }
+      break;
+
+    case SWAP_BYTES:
+      {
+        size_t i;
+
+        for (i = 0; i < s->size; i++)
+          {
+            unsigned char t = a[i];
+            a[i] = b[i];
+            b[i] = t;
+          }
+      }
+      break;
+    }
+}
+
+/* Compares the elements at A and B and returns a strcmp()-type
+   result. */
+static inline int
+compare_elems (const struct sorter *s, const void *a, const void *b)
+{
+  return s->compare (a, b, s->aux);
+}
+
+/* Sorts the CNT elements at ARRAY by insertion sort.  Elements
+   that fit in a register are held aside and the larger ones
+   shifted up past them, instead of being swapped down one place
+   at a time. */
 static void
-do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
+insertion_sort (const struct sorter *s, unsigned char *array, size_t cnt)
 {
-  unsigned char *a = array + (a_idx - 1) * size;
-  unsigned char *b = array + (b_idx - 1) * size;
   size_t i;
 
-  for (i = 0; i < size; i++)
+  if (s->swap == SWAP_WORD)
     {
-      unsigned char t = a[i];
-      a[i] = b[i];
-      b[i] = t;
+      uint32_t *w = (uint32_t *) array;
+
+      for (i = 1; i < cnt; i++)
+        {
+          uint32_t t = w[i];
+          size_t j;
+
+          for (j = i; j > 0 && compare_elems (s, &t, &w[j - 1]) < 0; j--)
+            w[j] = w[j - 1];
+          w[j] = t;
+        }
     }
-}
+  else if (s->swap == SWAP_DWORD)
+    {
+      uint64_t *d = (uint64_t *) array;
 
-/* Compares elements with 1-based indexes A_IDX and B_IDX in
-   ARRAY with elements of SIZE bytes each, using COMPARE to
-   compare elements, passing AUX as auxiliary data, and returns a
-   strcmp()-type result. */
-static int
-do_compare (unsigned char *array, size_t a_idx, size_t b_idx, size_t size,
-            int (*compare) (const void *, const void *, void *aux),
-            void *aux) 
-{
-  return compare (array + (a_idx - 1) * size, array + (b_idx - 1) * size, aux);
+      for (i = 1; i < cnt; i++)
+        {
+          uint64_t t = d[i];
+          size_t j;
+
+          for (j = i; j > 0 && compare_elems (s, &t, &d[j - 1]) < 0; j--)
+            d[j] = d[j - 1];
+          d[j] = t;
+        }
+    }
+  else
+    for (i = 1; i < cnt; i++)
+      {
+        unsigned char *p;
+
+        for (p = array + i * s->size;
+             p > array && compare_elems (s, p, p - s->size) < 0;
+             p -= s->size)
+          swap_elems (s, p, p - s->size);
+      }
 }
 
-/* "Float down" the element with 1-based index I in ARRAY of CNT
-   elements of SIZE bytes each, using COMPARE to compare
-   elements, passing AUX as auxiliary data. */
+/* "Float down" the element with 1-based index I in the heap of
+   CNT elements at ARRAY. */
 static void
-heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
-         int (*compare) (const void *, const void *, void *aux),
-         void *aux) 
+heapify (const struct sorter *s, unsigned char *array, size_t i, size_t cnt)
 {
+  unsigned char *base = array - s->size;
+
   for (;;) 
     {
       /* Set `max' to the index of the largest element among I
@@ -105,10 +208,13 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
       size_t left = 2 * i;
       size_t right = 2 * i + 1;
       size_t max = i;
-      if (left <= cnt && do_compare (array, left, max, size, compare, aux) > 0)
+      if (left <= cnt
+          && compare_elems (s, base + left * s->size,
+                            base + max * s->size) > 0)
         max = left;
       if (right <= cnt
-          && do_compare (array, right, max, size, compare, aux) > 0) 
+          && compare_elems (s, base + right * s->size,
+                            base + max * s->size) > 0) 
         max = right;
 
       /* If the maximum value is already in element I, we're
@@ -117,38 +223,159 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
         break;
 
       /* Swap and continue down the heap. */
-      do_swap (array, i, max, size);
+      swap_elems (s, base + i * s->size, base + max * s->size);
       i = max;
     }
 }
 
+/* Sorts the CNT elements at ARRAY by heapsort, which is slower
+   than quicksort on average but never worse than O(n lg n). */
+static void
+heap_sort (const struct sorter *s, unsigned char *array, size_t cnt)
+{
+  size_t i;
+
+  /* Build a heap. */
+  for (i = cnt / 2; i > 0; i--)
+    heapify (s, array, i, cnt);
+
+  /* Sort the heap. */
+  for (i = cnt; i > 1; i--) 
+    {
+      swap_elems (s, array, array + (i - 1) * s->size);
+      heapify (s, array, 1, i - 1); 
+    }
+}
+
+/* Moves the median of the first, middle, and last of the CNT
+   elements at ARRAY to the front, to serve as the pivot. */
+static void
+choose_pivot (const struct sorter *s, unsigned char *array, size_t cnt)
+{
+  unsigned char *a = array;
+  unsigned char *b = array + (cnt / 2) * s->size;
+  unsigned char *c = array + (cnt - 1) * s->size;
+  unsigned char *median;
+
+  if (compare_elems (s, a, b) < 0)
+    {
+      if (compare_elems (s, b, c) < 0)
+        median = b;
+      else
+        median = compare_elems (s, a, c) < 0 ? c : a;
+    }
+  else
+    {
+      if (compare_elems (s, a, c) < 0)
+        median = a;
+      else
+        median = compare_elems (s, b, c) < 0 ? c : b;
+    }
+  if (median != array)
+    swap_elems (s, array, median);
+}
+
+/* Partitions the CNT elements at ARRAY, CNT >= 2, around the
+   first one as pivot and returns the pivot's final index.
+   Elements before it compare less than or equal to it, elements
+   after it greater than or equal.  Scans stop on elements equal
+   to the pivot, so that runs of equal elements split evenly. */
+static size_t
+partition (const struct sorter *s, unsigned char *array, size_t cnt)
+{
+  unsigned char *i = array + s->size;
+  unsigned char *j = array + (cnt - 1) * s->size;
+
+  for (;;)
+    {
+      while (i <= j && compare_elems (s, i, array) < 0)
+        i += s->size;
+      while (i <= j && compare_elems (s, j, array) > 0)
+        j -= s->size;
+      if (i >= j)
+        break;
+      swap_elems (s, i, j);
+      i += s->size;
+      j -= s->size;
+    }
+  if (j != array)
+    swap_elems (s, array, j);
+  return (j - array) / s->size;
+}
+
+/* Sorts the CNT elements at ARRAY by introsort: quicksort until
+   DEPTH levels of partitioning have been used up, which only
+   happens on unlucky pivots, then heapsort.  Recurses on the
+   smaller partition and loops on the larger one, so the stack
+   depth is O(lg n). */
+static void
+intro_sort (const struct sorter *s, unsigned char *array, size_t cnt,
+            int depth)
+{
+  while (cnt > INSERTION_MAX)
+    {
+      size_t mid;
+
+      if (depth-- == 0)
+        {
+          heap_sort (s, array, cnt);
+          return;
+        }
+
+      choose_pivot (s, array, cnt);
+      mid = partition (s, array, cnt);
+      if (mid < cnt - mid - 1)
+        {
+          intro_sort (s, array, mid, depth);
+          array += (mid + 1) * s->size;
+          cnt -= mid + 1;
+        }
+      else
+        {
+          intro_sort (s, array + (mid + 1) * s->size, cnt - mid - 1, depth);
+          cnt = mid;
+        }
+    }
+  insertion_sort (s, array, cnt);
+}
+
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
    using COMPARE to compare elements, passing AUX as auxiliary
    data.  When COMPARE is passed a pair of elements A and B,
    respectively, it must return a strcmp()-type result, i.e. less
    than zero if A < B, zero if A == B, greater than zero if A >
-   B.  Runs in O(n lg n) time and O(1) space in CNT. */
+   B.  Runs in O(n lg n) time and O(lg n) space in CNT. */
 void
 sort (void *array, size_t cnt, size_t size,
       int (*compare) (const void *, const void *, void *aux),
       void *aux) 
 {
-  size_t i;
+  struct sorter s;
+  int depth;
+  size_t n;
 
   ASSERT (array != NULL || cnt == 0);
   ASSERT (compare != NULL);
   ASSERT (size > 0);
 
-  /* Build a heap. */
-  for (i = cnt / 2; i > 0; i--)
-    heapify (array, i, cnt, size, compare, aux);
+  s.size = size;
+  s.compare = compare;
+  s.aux = aux;
+  if ((((uintptr_t) array | size) & (sizeof (uint32_t) - 1)) != 0)
+    s.swap = SWAP_BYTES;
+  else if (size == sizeof (uint32_t))
+    s.swap = SWAP_WORD;
+  else if (size == sizeof (uint64_t))
+    s.swap = SWAP_DWORD;
+  else
+    s.swap = SWAP_WORDS;
 
-  /* Sort the heap. */
-  for (i = cnt; i > 1; i--) 
-    {
-      do_swap (array, 1, i, size);
-      heapify (array, 1, i - 1, size, compare, aux); 
-    }
+  /* Allow 2 * floor(lg CNT) levels of partitioning. */
+  depth = 0;
+  for (n = cnt; n > 1; n >>= 1)
+    depth += 2;
+
+  intro_sort (&s, array, cnt, depth);
 }
 
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
@@ -1,5 +1,64 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The block functions below move whole 32-bit words with the
+   string instructions, which is much faster than moving bytes,
+   and handle the unaligned head and the tail a byte at a time.
+   Blocks shorter than WORD_MIN bytes are moved bytewise, as the
+   setup would cost more than it saves.  They rely on the
+   direction flag being clear, as both the kernel's interrupt
+   entry and the user ABI guarantee. */
+#define WORD_MIN 16
+
+/* A word that may alias any other type. */
+typedef uint32_t __attribute__ ((may_alias)) word_t;
+
+/* The string scanning functions below read aligned words, after
+   stepping a byte at a time up to a word boundary.  An aligned
+   word never straddles a page boundary, so reading one that
+   holds the last byte of a string cannot fault even if the rest
+   of the word lies past the end.  Each word is tested for a null
+   byte (or a wanted byte, after XORing it with a copy of that
+   byte in every position) with the usual "has zero byte" trick,
+   and the byte itself is then found byte by byte. */
+
+/* Each byte of a word set to 0x01, and to 0x80. */
+#define ONES 0x01010101u
+#define HIGHS 0x80808080u
+
+/* Returns true if any byte in W is zero.  Subtracting 1 from a
+   zero byte borrows into its high bit; the AND with ~W throws
+   out bytes whose high bit was already set. */
+static inline bool
+has_zero (uint32_t w)
+{
+  return ((w - ONES) & ~w & HIGHS) != 0;
+}
+
+/* Returns true if P is aligned on a word boundary. */
+static inline bool
+is_aligned (const void *p)
+{
+  return ((uintptr_t) p & (sizeof (word_t) - 1)) == 0;
+}
+
+/* Copies CNT bytes from SRC to DST upward with "rep movsb". */
+static inline void
+copy_bytes (unsigned char **dst, const unsigned char **src, size_t cnt)
+{
+  asm volatile ("rep movsb"
+                : "+D" (*dst), "+S" (*src), "+c" (cnt) : : "memory");
+}
+
+/* Copies CNT words from SRC to DST upward with "rep movsl". */
+static inline void
+copy_words (unsigned char **dst, const unsigned char **src, size_t cnt)
+{
+  asm volatile ("rep movsl"
+                : "+D" (*dst), "+S" (*src), "+c" (cnt) : : "memory");
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,8 +71,16 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
+  if (size >= WORD_MIN)
+    {
+      /* Align DST, then copy words. */
+      size_t head = -(uintptr_t) dst & 3;
+      copy_bytes (&dst, &src, head);
+      size -= head;
+      copy_words (&dst, &src, size / 4);
+      size %= 4;
+    }
+  copy_bytes (&dst, &src, size);
 
   return dst_;
 }
@@ -29,20 +96,29 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
+  /* Copying upward is safe unless DST lies within SRC, since
+     every byte is read before it can be overwritten. */
+  if (dst <= src || dst >= src + size)
+    return memcpy (dst_, src_, size);
+
+  /* Otherwise copy downward: the tail bytes, then words. */
+  dst += size;
+  src += size;
+  while (size % 4 != 0)
     {
-      while (size-- > 0)
-        *dst++ = *src++;
+      *--dst = *--src;
+      size--;
     }
-  else 
+  if (size > 0)
     {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
+      size_t cnt = size / 4;
+      dst -= 4;
+      src -= 4;
+      asm volatile ("std; rep movsl; cld"
+                    : "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
     }
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +134,12 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  /* Skip equal words.  The bytes of the first differing one are
+     compared below. */
+  for (; size >= 4; a += 4, b += 4, size -= 4)
+    if (*(const word_t *) a != *(const word_t *) b)
+      break;
+
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -78,6 +160,21 @@ strcmp (const char *a_, const char *b_)
   ASSERT (a != NULL);
   ASSERT (b != NULL);
 
+  /* If A and B are equally aligned, compare bytes up to a word
+     boundary and then skip words that are equal and have no
+     null byte.  The characters that differ, or the end of both
+     strings, are then found below. */
+  if ((((uintptr_t) a ^ (uintptr_t) b) & (sizeof (word_t) - 1)) == 0)
+    {
+      for (; !is_aligned (a); a++, b++)
+        if (*a == '\0' || *a != *b)
+          return *a < *b ? -1 : *a > *b;
+      for (; *(const word_t *) a == *(const word_t *) b
+             && !has_zero (*(const word_t *) a);
+           a += sizeof (word_t), b += sizeof (word_t))
+        continue;
+    }
+
   while (*a != '\0' && *a == *b) 
     {
       a++;
@@ -95,9 +192,17 @@ memchr (const void *block_, int ch_, size_t size)
 {
   const unsigned char *block = block_;
   unsigned char ch = ch_;
+  uint32_t mask = ch * ONES;
 
   ASSERT (block != NULL || size == 0);
 
+  for (; size > 0 && !is_aligned (block); size--, block++)
+    if (*block == ch)
+      return (void *) block;
+  for (; size >= sizeof (word_t)
+         && !has_zero (*(const word_t *) block ^ mask);
+       size -= sizeof (word_t), block += sizeof (word_t))
+    continue;
   for (; size-- > 0; block++)
     if (*block == ch)
       return (void *) block;
@@ -113,9 +218,22 @@ char *
 strchr (const char *string, int c_) 
 {
   char c = c_;
+  uint32_t mask = (unsigned char) c * ONES;
 
   ASSERT (string != NULL);
 
+  for (; !is_aligned (string); string++)
+    if (*string == c)
+      return (char *) string;
+    else if (*string == '\0')
+      return NULL;
+  for (;; string += sizeof (word_t))
+    {
+      uint32_t w = *(const word_t *) string;
+      if (has_zero (w) || has_zero (w ^ mask))
+        break;
+    }
+
   for (;;) 
     if (*string == c)
       return (char *) string;
@@ -279,11 +397,23 @@ void *
 memset (void *dst_, int value, size_t size) 
 {
   unsigned char *dst = dst_;
+  uint32_t word = (unsigned char) value * 0x01010101u;
 
   ASSERT (dst != NULL || size == 0);
-  
-  while (size-- > 0)
-    *dst++ = value;
+
+  if (size >= WORD_MIN)
+    {
+      /* Align DST, then store words. */
+      size_t head = -(uintptr_t) dst & 3;
+      size_t cnt = (size - head) / 4;
+      size = (size - head) % 4;
+      asm volatile ("rep stosb"
+                    : "+D" (dst), "+c" (head) : "a" (word) : "memory");
+      asm volatile ("rep stosl"
+                    : "+D" (dst), "+c" (cnt) : "a" (word) : "memory");
+    }
+  asm volatile ("rep stosb"
+                : "+D" (dst), "+c" (size) : "a" (word) : "memory");
 
   return dst_;
 }
@@ -296,7 +426,12 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
+  for (p = string; !is_aligned (p); p++)
+    if (*p == '\0')
+      return p - string;
+  while (!has_zero (*(const word_t *) p))
+    p += sizeof (word_t);
+  for (; *p != '\0'; p++)
     continue;
   return p - string;
 }
@@ -306,11 +441,9 @@ strlen (const char *string)
 size_t
 strnlen (const char *string, size_t maxlen) 
 {
-  size_t length;
+  const char *end = memchr (string, '\0', maxlen);
 
-  for (length = 0; string[length] != '\0' && length < maxlen; length++)
-    continue;
-  return length;
+  return end != NULL ? (size_t) (end - string) : maxlen;
 }
 
 /* Copies string SRC to DST.  If SRC is longer than SIZE - 1
@@ -28,7 +28,73 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+    SYS_GETDENTS,               /* Reads many directory entries. */
+
+    /* Project 3 extension. */
+    SYS_FORK,                   /* Copy this process. */
+    SYS_SBRK,                   /* Move the program break. */
+    SYS_MEMSTAT,                /* Report memory use. */
+
+    /* Vectored and positional I/O. */
+    SYS_READV,                  /* Read into several buffers. */
+    SYS_WRITEV,                 /* Write from several buffers. */
+    SYS_PREAD,                  /* Read at a file offset. */
+    SYS_PWRITE,                 /* Write at a file offset. */
+    SYS_COPY_FILE_RANGE,        /* Copy between files in the kernel. */
+    SYS_PUNCH_HOLE,             /* Free a range of a file. */
+    SYS_FSYNC,                  /* Write a file back to disk. */
+    SYS_FDATASYNC,              /* Write a file's data back to disk. */
+
+    /* Process creation with arguments and files. */
+    SYS_SPAWN,                  /* Start another process. */
+
+    /* Inter-process communication. */
+    SYS_PIPE,                   /* Create a pipe. */
+    SYS_SHM_MAP,                /* Map a shared memory segment. */
+
+    /* Threads. */
+    SYS_CLONE,                  /* Start a thread in this process. */
+    SYS_THREAD_EXIT,            /* Terminate this thread. */
+    SYS_FUTEX_WAIT,             /* Wait on a futex. */
+    SYS_FUTEX_WAKE,             /* Wake threads waiting on a futex. */
+
+    /* Statistics. */
+    SYS_PERFSTAT,               /* Read kernel performance counters. */
+    SYS_CYCLES,                 /* Read the time stamp counter. */
+    SYS_GETTIME,                /* Read the time since boot. */
+
+    /* Asynchronous I/O. */
+    SYS_AIO_SETUP,              /* Register submission and completion
+                                   rings. */
+    SYS_AIO_ENTER,              /* Start I/Os and collect completions. */
+
+    /* Batched system calls. */
+    SYS_BATCH,                  /* Run several system calls at once. */
+
+    /* File system snapshots. */
+    SYS_SNAPSHOT,               /* Take a snapshot of a directory. */
+
+    /* Processes. */
+    SYS_WAIT_ANY,               /* Wait for any child process to die. */
+
+    /* Memory hints. */
+    SYS_MADVISE,                /* Give hints about the use of memory. */
+
+    /* Multiplexed waiting. */
+    SYS_POLL,                   /* Wait for any of several descriptors. */
+
+    /* Descriptor flags. */
+    SYS_FCNTL,                  /* Get or set descriptor flags. */
+
+    /* Resource use. */
+    SYS_GETRUSAGE,              /* Read CPU, fault, and I/O use. */
+
+    /* Latency histograms. */
+    SYS_PERFHIST,               /* Read a latency histogram. */
+
+    /* Checkpoints. */
+    SYS_CHECKPOINT              /* Save this process to a file. */
   };
 
 #endif /* lib/syscall-nr.h */
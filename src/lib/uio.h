@@ -0,0 +1,16 @@
+#ifndef __LIB_UIO_H
+#define __LIB_UIO_H
+
+#include <stddef.h>
+
+/* Most buffers one readv or writev system call takes. */
+#define IOV_MAX 64
+
+/* A buffer of a readv or writev system call. */
+struct iovec
+  {
+    void *iov_base;             /* Start of the buffer. */
+    size_t iov_len;             /* Its size in bytes. */
+  };
+
+#endif /* lib/uio.h */
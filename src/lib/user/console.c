@@ -8,7 +8,21 @@
 int
 vprintf (const char *format, va_list args) 
 {
-  return vhprintf (STDOUT_FILENO, format, args);
+  return vfprintf (stdout, format, args);
+}
+
+/* Like printf(), but writes output to stream F. */
+int
+fprintf (FILE *f, const char *format, ...) 
+{
+  va_list args;
+  int retval;
+
+  va_start (args, format);
+  retval = vfprintf (f, format, args);
+  va_end (args);
+
+  return retval;
 }
 
 /* Like printf(), but writes output to the given HANDLE. */
@@ -25,33 +39,32 @@ hprintf (int handle, const char *format, ...)
   return retval;
 }
 
-/* Writes string S to the console, followed by a new-line
+/* Writes string S to stdout, followed by a new-line
    character. */
 int
 puts (const char *s) 
 {
-  write (STDOUT_FILENO, s, strlen (s));
+  fputs (s, stdout);
   putchar ('\n');
 
   return 0;
 }
 
-/* Writes C to the console. */
+/* Writes C to stdout. */
 int
 putchar (int c) 
 {
-  char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
-  return c;
+  return fputc (c, stdout);
 }
-
+
 /* Auxiliary data for vhprintf_helper(). */
 struct vhprintf_aux 
   {
     char buf[64];       /* Character buffer. */
     char *p;            /* Current position in buffer. */
     int char_cnt;       /* Total characters written so far. */
-    int handle;         /* Output file handle. */
+    int handle;         /* Output file handle, if STREAM is null. */
+    FILE *stream;       /* Output stream, or a null pointer. */
   };
 
 static void add_char (char, void *);
@@ -59,14 +72,35 @@ static void flush (struct vhprintf_aux *);
 
 /* Formats the printf() format specification FORMAT with
    arguments given in ARGS and writes the output to the given
-   HANDLE. */
+   HANDLE.  Output to STDOUT_FILENO goes through stdout, so that
+   it stays in order with printf(). */
 int
 vhprintf (int handle, const char *format, va_list args) 
 {
   struct vhprintf_aux aux;
+
+  if (handle == STDOUT_FILENO)
+    return vfprintf (stdout, format, args);
+
   aux.p = aux.buf;
   aux.char_cnt = 0;
   aux.handle = handle;
+  aux.stream = NULL;
+  __vprintf (format, args, add_char, &aux);
+  flush (&aux);
+  return aux.char_cnt;
+}
+
+/* Formats the printf() format specification FORMAT with
+   arguments given in ARGS and writes the output to stream F. */
+int
+vfprintf (FILE *f, const char *format, va_list args) 
+{
+  struct vhprintf_aux aux;
+  aux.p = aux.buf;
+  aux.char_cnt = 0;
+  aux.handle = f->fd;
+  aux.stream = f;
   __vprintf (format, args, add_char, &aux);
   flush (&aux);
   return aux.char_cnt;
@@ -89,6 +123,11 @@ static void
 flush (struct vhprintf_aux *aux)
 {
   if (aux->p > aux->buf)
-    write (aux->handle, aux->buf, aux->p - aux->buf);
+    {
+      if (aux->stream != NULL)
+        fwrite (aux->buf, 1, aux->p - aux->buf, aux->stream);
+      else
+        write (aux->handle, aux->buf, aux->p - aux->buf);
+    }
   aux->p = aux->buf;
 }
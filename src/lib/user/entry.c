@@ -6,5 +6,6 @@ void _start (int argc, char *argv[]);
 void
 _start (int argc, char *argv[]) 
 {
+  _syscall_init ();
   exit (main (argc, argv));
 }
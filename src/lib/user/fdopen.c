@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Streams for fdopen(), with their buffers.  A stream is free
+   if its BUF is a null pointer. */
+static FILE files[FOPEN_MAX];
+static char buffers[FOPEN_MAX][BUFSIZ];
+
+/* Opens a fully buffered stream on file handle FD.  MODE is
+   accepted for compatibility and ignored, since a stream may
+   both read and write.  Returns the stream, or a null pointer
+   if FD is negative or FOPEN_MAX streams are already open. */
+FILE *
+fdopen (int fd, const char *mode UNUSED)
+{
+  size_t i;
+
+  if (fd < 0)
+    return NULL;
+  for (i = 0; i < FOPEN_MAX; i++)
+    if (files[i].buf == NULL)
+      {
+        FILE *f = &files[i];
+
+        memset (f, 0, sizeof *f);
+        f->fd = fd;
+        f->mode = _IOFBF;
+        f->buf = buffers[i];
+        f->size = BUFSIZ;
+        __stream_link (f);
+        return f;
+      }
+  return NULL;
+}
+
+/* Flushes F and closes it and its file handle.  Returns 0 if
+   successful, EOF if the flush failed. */
+int
+fclose (FILE *f)
+{
+  int retval = fflush (f);
+
+  __stream_unlink (f);
+  close (f->fd);
+  if (f >= files && f < files + FOPEN_MAX)
+    f->buf = NULL;
+  return retval;
+}
@@ -0,0 +1,493 @@
+#include <malloc.h>
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A user memory allocator, on the lines of the kernel's
+   threads/malloc.c.
+
+   The size of each request of up to 2 kB is rounded up to a
+   power of 2 and assigned to the "descriptor" that manages
+   blocks of that size.  A descriptor carves one-page "arenas"
+   into blocks, keeps its free blocks on a list, and gives an
+   arena back once none of its blocks is in use.  Bigger requests
+   take whole pages, with the page count in the arena header.
+
+   Pages come from a list of free runs of pages in the heap, kept
+   in address order and merged with their neighbors.  When the
+   list runs dry, the heap grows with sbrk().  When the run at
+   the top of the heap reaches TRIM_PAGES pages, it is given back
+   to the kernel by shrinking the heap.
+
+   Each descriptor and the page list has its own lock, built on a
+   futex, so threads allocating different sizes do not contend,
+   and an uncontended lock costs no system call. */
+
+#define PGSIZE 4096
+
+/* Offset of P within its page. */
+#define pg_ofs(P) ((uintptr_t) (P) & (PGSIZE - 1))
+
+/* Free pages at the top of the heap that are given back. */
+#define TRIM_PAGES 4
+
+/* A lock built on a futex: 0 if unlocked, 1 if locked, 2 if
+   locked with threads possibly waiting. */
+typedef int mutex;
+
+/* Descriptor. */
+struct desc
+  {
+    size_t block_size;          /* Size of each element in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    struct block *free_list;    /* Free blocks. */
+    mutex lock;                 /* Lock. */
+  };
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x5be1a7c3
+
+/* Arena. */
+struct arena 
+  {
+    unsigned magic;             /* Always set to ARENA_MAGIC. */
+    struct desc *desc;          /* Owning descriptor, null for big block. */
+    size_t free_cnt;            /* Free blocks; pages in big block. */
+    unsigned pad;               /* Keeps blocks 16-byte aligned. */
+  };
+
+/* Free block. */
+struct block 
+  {
+    struct block *prev, *next;  /* Free list neighbors. */
+  };
+
+/* Free run of pages. */
+struct run
+  {
+    size_t page_cnt;            /* Pages in run. */
+    struct run *next;           /* Next run up in memory. */
+  };
+
+/* Our set of descriptors, for 16 bytes through 2 kB. */
+#define DESC_CNT 8
+static struct desc descs[DESC_CNT];
+static bool descs_ready;
+
+/* Free page runs, in address order. */
+static struct run *runs;
+static mutex page_lock;
+
+static void mutex_lock (mutex *);
+static void mutex_unlock (mutex *);
+static void init_descs (void);
+static struct arena *block_to_arena (struct block *);
+static struct block *arena_to_block (struct arena *, size_t idx);
+static void free_locked (struct desc *, struct block *);
+static void *get_pages (size_t page_cnt);
+static void free_pages (void *, size_t page_cnt);
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size) 
+{
+  struct desc *d;
+  struct block *b;
+  struct arena *a;
+
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0)
+    return NULL;
+
+  /* Find the smallest descriptor that satisfies a SIZE-byte
+     request. */
+  if (!descs_ready)
+    init_descs ();
+  for (d = descs; d < descs + DESC_CNT; d++)
+    if (d->block_size >= size)
+      break;
+  if (d == descs + DESC_CNT) 
+    {
+      /* SIZE is too big for any descriptor.
+         Allocate enough pages to hold SIZE plus an arena. */
+      size_t page_cnt;
+
+      if (size > SIZE_MAX - sizeof *a - PGSIZE)
+        return NULL;
+      page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+      a = get_pages (page_cnt);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize the arena to indicate a big block of PAGE_CNT
+         pages, and return it. */
+      a->magic = ARENA_MAGIC;
+      a->desc = NULL;
+      a->free_cnt = page_cnt;
+      return a + 1;
+    }
+
+  mutex_lock (&d->lock);
+
+  /* If the free list is empty, create a new arena. */
+  if (d->free_list == NULL)
+    {
+      size_t i;
+
+      /* Allocate a page. */
+      a = get_pages (1);
+      if (a == NULL) 
+        {
+          mutex_unlock (&d->lock);
+          return NULL; 
+        }
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          b = arena_to_block (a, i);
+          b->prev = NULL;
+          b->next = d->free_list;
+          if (d->free_list != NULL)
+            d->free_list->prev = b;
+          d->free_list = b;
+        }
+    }
+
+  /* Get a block from free list and return it. */
+  b = d->free_list;
+  d->free_list = b->next;
+  if (d->free_list != NULL)
+    d->free_list->prev = NULL;
+  a = block_to_arena (b);
+  a->free_cnt--;
+  mutex_unlock (&d->lock);
+  return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) 
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  size = a * b;
+  if (size < a || size < b)
+    return NULL;
+
+  /* Allocate and zero memory.  Fresh heap pages are zero, but
+     reused blocks are not. */
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block) 
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+  struct desc *d = a->desc;
+
+  return d != NULL ? d->block_size : PGSIZE * a->free_cnt - sizeof *a;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) 
+{
+  if (new_size == 0) 
+    {
+      free (old_block);
+      return NULL;
+    }
+  else if (old_block != NULL && new_size <= block_size (old_block))
+    return old_block;
+  else 
+    {
+      void *new_block = malloc (new_size);
+      if (old_block != NULL && new_block != NULL)
+        {
+          size_t old_size = block_size (old_block);
+          size_t min_size = new_size < old_size ? new_size : old_size;
+          memcpy (new_block, old_block, min_size);
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) 
+{
+  free_bulk (&p, 1);
+}
+
+/* Frees the CNT blocks in P[], skipping null pointers.  A
+   descriptor's lock is taken once for each run of blocks of the
+   same size, so freeing many blocks of a size together is
+   cheaper than freeing them one at a time. */
+void
+free_bulk (void *p[], size_t cnt) 
+{
+  struct desc *locked = NULL;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct block *b = p[i];
+      struct arena *a;
+
+      if (b == NULL)
+        continue;
+      a = block_to_arena (b);
+      if (a->desc != locked && locked != NULL)
+        {
+          mutex_unlock (&locked->lock);
+          locked = NULL;
+        }
+
+      if (a->desc == NULL)
+        {
+          /* It's a big block.  Free its pages. */
+          free_pages (a, a->free_cnt);
+          continue;
+        }
+
+      if (locked == NULL)
+        {
+          locked = a->desc;
+          mutex_lock (&locked->lock);
+        }
+      free_locked (locked, b);
+    }
+  if (locked != NULL)
+    mutex_unlock (&locked->lock);
+}
+
+/* Adds block B to D's free list, giving back B's arena if none
+   of its blocks is in use any more.  D's lock must be held. */
+static void
+free_locked (struct desc *d, struct block *b) 
+{
+  struct arena *a = block_to_arena (b);
+
+#ifndef NDEBUG
+  /* Clear the block to help detect use-after-free bugs. */
+  memset (b, 0xcc, d->block_size);
+#endif
+
+  b->prev = NULL;
+  b->next = d->free_list;
+  if (d->free_list != NULL)
+    d->free_list->prev = b;
+  d->free_list = b;
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *ab = arena_to_block (a, i);
+          if (ab->prev != NULL)
+            ab->prev->next = ab->next;
+          else
+            d->free_list = ab->next;
+          if (ab->next != NULL)
+            ab->next->prev = ab->prev;
+        }
+      free_pages (a, 1);
+    }
+}
+
+/* Sets up the descriptors. */
+static void
+init_descs (void) 
+{
+  static mutex init_lock;
+  size_t i;
+
+  mutex_lock (&init_lock);
+  if (!descs_ready)
+    {
+      for (i = 0; i < DESC_CNT; i++)
+        {
+          struct desc *d = &descs[i];
+          d->block_size = 16 << i;
+          d->blocks_per_arena = (PGSIZE - sizeof (struct arena))
+                                / d->block_size;
+        }
+      descs_ready = true;
+    }
+  mutex_unlock (&init_lock);
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (struct block *b)
+{
+  struct arena *a = (struct arena *) ((uintptr_t) b & ~(PGSIZE - 1));
+
+  /* Check that the arena is valid. */
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+
+  /* Check that the block is properly aligned for the arena. */
+  ASSERT (a->desc == NULL
+          || ((uintptr_t) b - (uintptr_t) (a + 1)) % a->desc->block_size
+             == 0);
+  ASSERT (a->desc != NULL || (uintptr_t) b == (uintptr_t) (a + 1));
+
+  return a;
+}
+
+/* Returns the (IDX - 1)'th block within arena A. */
+static struct block *
+arena_to_block (struct arena *a, size_t idx) 
+{
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+  ASSERT (idx < a->desc->blocks_per_arena);
+  return (struct block *) ((uint8_t *) a
+                           + sizeof *a
+                           + idx * a->desc->block_size);
+}
+
+/* Returns PAGE_CNT contiguous free pages, taken from the free
+   runs or from new heap, or a null pointer if the kernel has no
+   more memory to give. */
+static void *
+get_pages (size_t page_cnt) 
+{
+  struct run **rp;
+  uint8_t *pages;
+  size_t pad;
+
+  mutex_lock (&page_lock);
+
+  /* First fit among the free runs. */
+  for (rp = &runs; *rp != NULL; rp = &(*rp)->next)
+    {
+      struct run *r = *rp;
+      if (r->page_cnt >= page_cnt)
+        {
+          pages = (uint8_t *) r;
+          if (r->page_cnt > page_cnt)
+            {
+              struct run *rest = (struct run *) (pages + page_cnt * PGSIZE);
+              rest->page_cnt = r->page_cnt - page_cnt;
+              rest->next = r->next;
+              *rp = rest;
+            }
+          else
+            *rp = r->next;
+          mutex_unlock (&page_lock);
+          return pages;
+        }
+    }
+
+  /* Grow the heap, starting from a page boundary. */
+  pad = (PGSIZE - pg_ofs (sbrk (0))) % PGSIZE;
+  pages = sbrk (pad + page_cnt * PGSIZE);
+  mutex_unlock (&page_lock);
+  if (pages == (void *) -1)
+    return NULL;
+  return pages + pad;
+}
+
+/* Gives the PAGE_CNT pages at PAGES back to the free runs,
+   merging them with their neighbors, and gives a big enough run
+   at the top of the heap back to the kernel. */
+static void
+free_pages (void *pages, size_t page_cnt) 
+{
+  struct run *r = pages, *prev = NULL, *next;
+  struct run **rp;
+
+  mutex_lock (&page_lock);
+  for (next = runs; next != NULL && next < r; next = next->next)
+    prev = next;
+
+  /* Insert R between PREV and NEXT, merging with either. */
+  r->page_cnt = page_cnt;
+  r->next = next;
+  if (next != NULL && (uint8_t *) r + page_cnt * PGSIZE == (uint8_t *) next)
+    {
+      r->page_cnt += next->page_cnt;
+      r->next = next->next;
+    }
+  if (prev == NULL)
+    runs = r;
+  else if ((uint8_t *) prev + prev->page_cnt * PGSIZE == (uint8_t *) r)
+    {
+      prev->page_cnt += r->page_cnt;
+      prev->next = r->next;
+    }
+  else
+    prev->next = r;
+
+  /* Shrink the heap if its top run is big enough. */
+  for (rp = &runs; *rp != NULL && (*rp)->next != NULL; rp = &(*rp)->next)
+    continue;
+  r = *rp;
+  if (r != NULL && r->page_cnt >= TRIM_PAGES
+      && (uint8_t *) r + r->page_cnt * PGSIZE == (uint8_t *) sbrk (0))
+    {
+      *rp = NULL;
+      sbrk (-(intptr_t) (r->page_cnt * PGSIZE));
+    }
+  mutex_unlock (&page_lock);
+}
+
+/* Acquires lock M, sleeping on its futex while another thread
+   holds it.  See Drepper, "Futexes Are Tricky". */
+static void
+mutex_lock (mutex *m) 
+{
+  int c = __sync_val_compare_and_swap (m, 0, 1);
+
+  if (c != 0)
+    {
+      if (c != 2)
+        c = __sync_lock_test_and_set (m, 2);
+      while (c != 0)
+        {
+          futex_wait (m, 2);
+          c = __sync_lock_test_and_set (m, 2);
+        }
+    }
+}
+
+/* Releases lock M, waking a waiter if there may be one. */
+static void
+mutex_unlock (mutex *m) 
+{
+  if (__sync_fetch_and_sub (m, 1) != 1)
+    {
+      *m = 0;
+      futex_wake (m, 1);
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef __LIB_USER_MALLOC_H
+#define __LIB_USER_MALLOC_H
+
+#include <debug.h>
+#include <stddef.h>
+
+/* User memory allocator.  It takes memory from the kernel with
+   sbrk(), which only kernels with virtual memory provide. */
+void *malloc (size_t) __attribute__ ((malloc));
+void *calloc (size_t, size_t) __attribute__ ((malloc));
+void *realloc (void *, size_t);
+void free (void *);
+void free_bulk (void *[], size_t cnt);
+
+#endif /* lib/user/malloc.h */
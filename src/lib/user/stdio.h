@@ -4,4 +4,73 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Buffered streams.
+
+   A stream buffers reads from or writes to a file handle, so
+   that many small transfers cost one system call.  Output
+   buffered in a stream reaches its file only when the buffer
+   fills, at fflush(), or, for a line-buffered stream, at each
+   new-line.  exit() flushes all streams, but a process killed
+   by the kernel loses what it had buffered.
+
+   stdout is line-buffered, so each line of printf() output is
+   still written, and interleaved with other processes' output,
+   as a whole.  stdin is unbuffered, because a read from the
+   console waits until the whole requested size has been typed.
+
+   Streams are not locked, so threads of a process must not use
+   one at the same time. */
+
+/* Buffering modes for setvbuf(). */
+#define _IOFBF 0                /* Full buffering. */
+#define _IOLBF 1                /* Line buffering. */
+#define _IONBF 2                /* No buffering. */
+
+/* Default stream buffer size. */
+#define BUFSIZ 512
+
+/* Most streams fdopen() can have open at once. */
+#define FOPEN_MAX 8
+
+/* End of file or error, returned by character functions. */
+#define EOF (-1)
+
+/* A stream.  Its members are private to the library. */
+typedef struct __file
+  {
+    int fd;                     /* File handle. */
+    int mode;                   /* _IOFBF, _IOLBF, or _IONBF. */
+    char *buf;                  /* Buffer. */
+    size_t size;                /* Buffer size. */
+    size_t pos;                 /* Bytes written, or next byte to read. */
+    size_t len;                 /* Bytes read into BUF. */
+    bool reading;               /* Does BUF hold read data? */
+    bool eof;                   /* End of file seen? */
+    bool error;                 /* Error seen? */
+    struct __file *next;        /* Next open stream. */
+  }
+FILE;
+
+extern FILE *stdin;
+extern FILE *stdout;
+
+FILE *fdopen (int fd, const char *mode);
+int fclose (FILE *);
+int fflush (FILE *);
+int setvbuf (FILE *, char *buf, int mode, size_t size);
+size_t fread (void *, size_t size, size_t cnt, FILE *);
+size_t fwrite (const void *, size_t size, size_t cnt, FILE *);
+int fgetc (FILE *);
+int fputc (int, FILE *);
+int fputs (const char *, FILE *);
+int fprintf (FILE *, const char *, ...) PRINTF_FORMAT (2, 3);
+int vfprintf (FILE *, const char *, va_list) PRINTF_FORMAT (2, 0);
+int fileno (FILE *);
+int feof (FILE *);
+int ferror (FILE *);
+
+/* Internal functions. */
+void __stream_link (FILE *);
+void __stream_unlink (FILE *);
+
 #endif /* lib/user/stdio.h */
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Standard streams. */
+static char stdout_buf[BUFSIZ];
+static FILE stdin_file = { STDIN_FILENO, _IONBF, NULL, 0, 0, 0,
+                           false, false, false, NULL };
+static FILE stdout_file = { STDOUT_FILENO, _IOLBF, stdout_buf, BUFSIZ,
+                            0, 0, false, false, false, &stdin_file };
+FILE *stdin = &stdin_file;
+FILE *stdout = &stdout_file;
+
+/* Open streams, most recently opened first. */
+static FILE *streams = &stdout_file;
+
+static bool flush_write (FILE *);
+static void drop_read (FILE *);
+static size_t write_through (FILE *, const char *, size_t);
+
+/* Adds F to the list of open streams, for fflush (NULL). */
+void
+__stream_link (FILE *f)
+{
+  f->next = streams;
+  streams = f;
+}
+
+/* Removes F from the list of open streams. */
+void
+__stream_unlink (FILE *f)
+{
+  FILE **fp;
+
+  for (fp = &streams; *fp != NULL; fp = &(*fp)->next)
+    if (*fp == f)
+      {
+        *fp = f->next;
+        break;
+      }
+}
+
+/* Writes out the output buffered in F, or in every open stream
+   if F is a null pointer.  Returns 0 if successful, EOF on
+   error. */
+int
+fflush (FILE *f)
+{
+  if (f == NULL)
+    {
+      int retval = 0;
+
+      for (f = streams; f != NULL; f = f->next)
+        if (fflush (f) != 0)
+          retval = EOF;
+      return retval;
+    }
+
+  if (f->reading)
+    drop_read (f);
+  return flush_write (f) ? 0 : EOF;
+}
+
+/* Makes F buffer according to MODE in the SIZE bytes at BUF, or
+   in its own buffer if BUF is a null pointer.  Must be called
+   before any I/O on F.  Returns 0 if successful, nonzero if F
+   has no buffer of its own to use. */
+int
+setvbuf (FILE *f, char *buf, int mode, size_t size)
+{
+  if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+    return EOF;
+  if (mode != _IONBF && buf != NULL && size > 0)
+    {
+      f->buf = buf;
+      f->size = size;
+    }
+  else if (mode != _IONBF && f->buf == NULL)
+    return EOF;
+  f->mode = mode;
+  return 0;
+}
+
+/* Reads up to CNT elements of SIZE bytes each from F into
+   BUFFER.  Returns the number of whole elements read, which is
+   less than CNT at end of file or on error. */
+size_t
+fread (void *buffer, size_t size, size_t cnt, FILE *f)
+{
+  char *dst = buffer;
+  size_t total = size * cnt;
+  size_t done = 0;
+
+  if (total == 0)
+    return 0;
+
+  /* Show the user any prompt before waiting for input. */
+  if (f == stdin && stdout->mode != _IOFBF)
+    fflush (stdout);
+
+  if (!f->reading)
+    {
+      if (!flush_write (f))
+        return 0;
+      f->reading = true;
+      f->pos = f->len = 0;
+    }
+
+  while (done < total)
+    {
+      size_t n = f->len - f->pos;
+      int bytes;
+
+      if (n > 0)
+        {
+          /* Take what is buffered. */
+          if (n > total - done)
+            n = total - done;
+          memcpy (dst + done, f->buf + f->pos, n);
+          f->pos += n;
+          done += n;
+          continue;
+        }
+
+      if (f->mode == _IONBF || total - done >= f->size)
+        {
+          /* Read large requests straight into BUFFER. */
+          bytes = read (f->fd, dst + done, total - done);
+          if (bytes > 0)
+            done += bytes;
+        }
+      else
+        {
+          bytes = read (f->fd, f->buf, f->size);
+          f->pos = 0;
+          f->len = bytes > 0 ? bytes : 0;
+        }
+      if (bytes <= 0)
+        {
+          if (bytes == 0)
+            f->eof = true;
+          else
+            f->error = true;
+          break;
+        }
+    }
+  return done / size;
+}
+
+/* Writes CNT elements of SIZE bytes each from BUFFER to F.
+   Returns the number of whole elements written, which is less
+   than CNT only on error. */
+size_t
+fwrite (const void *buffer, size_t size, size_t cnt, FILE *f)
+{
+  const char *src = buffer;
+  size_t total = size * cnt;
+  size_t done = 0;
+
+  if (total == 0)
+    return 0;
+  if (f->reading)
+    {
+      drop_read (f);
+      f->reading = false;
+      f->pos = 0;
+    }
+
+  if (f->mode == _IONBF || total >= f->size)
+    {
+      /* Write large requests straight from BUFFER, after what
+         is already buffered. */
+      if (!flush_write (f))
+        return 0;
+      done = write_through (f, src, total);
+    }
+  else
+    {
+      while (done < total)
+        {
+          size_t n = f->size - f->pos;
+          if (n > total - done)
+            n = total - done;
+          memcpy (f->buf + f->pos, src + done, n);
+          f->pos += n;
+          done += n;
+          if (f->pos == f->size && !flush_write (f))
+            return 0;
+        }
+      if (f->mode == _IOLBF && memchr (src, '\n', total) != NULL
+          && !flush_write (f))
+        return 0;
+    }
+  return done / size;
+}
+
+/* Reads a character from F and returns it as an unsigned char,
+   or EOF at end of file or on error. */
+int
+fgetc (FILE *f)
+{
+  unsigned char c;
+
+  return fread (&c, 1, 1, f) == 1 ? c : EOF;
+}
+
+/* Writes C, as an unsigned char, to F.  Returns C, or EOF on
+   error. */
+int
+fputc (int c, FILE *f)
+{
+  unsigned char c2 = c;
+
+  /* Fast path for a buffered write with room to spare. */
+  if (!f->reading && f->mode != _IONBF && f->pos + 1 < f->size
+      && c2 != '\n')
+    {
+      f->buf[f->pos++] = c2;
+      return c2;
+    }
+  return fwrite (&c2, 1, 1, f) == 1 ? c2 : EOF;
+}
+
+/* Writes string S to F, without a new-line.  Returns 0 if
+   successful, EOF on error. */
+int
+fputs (const char *s, FILE *f)
+{
+  size_t len = strlen (s);
+
+  return fwrite (s, 1, len, f) == len ? 0 : EOF;
+}
+
+/* Returns F's file handle. */
+int
+fileno (FILE *f)
+{
+  return f->fd;
+}
+
+/* Returns nonzero if a read from F has reached end of file. */
+int
+feof (FILE *f)
+{
+  return f->eof;
+}
+
+/* Returns nonzero if an I/O on F has failed. */
+int
+ferror (FILE *f)
+{
+  return f->error;
+}
+
+/* Writes out the output buffered in F.  Returns false on
+   error. */
+static bool
+flush_write (FILE *f)
+{
+  size_t n = f->pos;
+
+  if (f->reading || n == 0)
+    return true;
+  f->pos = 0;
+  return write_through (f, f->buf, n) == n;
+}
+
+/* Discards the input read ahead into F, seeking back over it
+   so that the file position is where F's reader left off. */
+static void
+drop_read (FILE *f)
+{
+  size_t unread = f->len - f->pos;
+
+  if (unread > 0 && f->fd != STDIN_FILENO)
+    seek (f->fd, tell (f->fd) - unread);
+  f->pos = f->len = 0;
+}
+
+/* Writes the SIZE bytes at BUFFER to F's file.  Returns the
+   number of bytes written, marking F as in error if it is less
+   than SIZE. */
+static size_t
+write_through (FILE *f, const char *buffer, size_t size)
+{
+  int bytes = write (f->fd, buffer, size);
+
+  if (bytes < 0 || (size_t) bytes != size)
+    {
+      f->error = true;
+      return bytes > 0 ? bytes : 0;
+    }
+  return size;
+}
@@ -1,65 +1,77 @@
 #include <syscall.h>
+#include <clock.h>
+#include <stdio.h>
 #include "../syscall-nr.h"
 
-/* Invokes syscall NUMBER, passing no arguments, and returns the
-   return value as an `int'. */
-#define syscall0(NUMBER)                                        \
-        ({                                                      \
-          int retval;                                           \
-          asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
-               : "=a" (retval)                                  \
-               : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
-          retval;                                               \
-        })
+/* Nonzero if the CPU has SYSENTER, which the kernel then sets up
+   for system calls.  Set by _syscall_init(). */
+bool _syscall_sysenter;
 
-/* Invokes syscall NUMBER, passing argument ARG0, and returns the
-   return value as an `int'. */
-#define syscall1(NUMBER, ARG0)                                           \
-        ({                                                               \
-          int retval;                                                    \
-          asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
-               : "=a" (retval)                                           \
-               : [number] "i" (NUMBER),                                  \
-                 [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
-          retval;                                                        \
-        })
+/* Enters the kernel with the system call number in EAX and its
+   arguments in EBX, ECX, EDX, and ESI.  SYSENTER is much faster
+   than int $0x31, but takes the stack pointer in EBP and the
+   return address in EDI, and returns with the former in ECX and
+   the latter in EDX.  See userprog/sysenter.S. */
+#define SYSCALL_TRAP                                            \
+        "cmpb $0, _syscall_sysenter; je 1f; "                   \
+        "pushl %%ebp; movl %%esp, %%ebp; movl $2f, %%edi; "     \
+        "sysenter; 2: popl %%ebp; jmp 3f; "                     \
+        "1: int $0x31; 3: "
 
-/* Invokes syscall NUMBER, passing arguments ARG0 and ARG1, and
-   returns the return value as an `int'. */
-#define syscall2(NUMBER, ARG0, ARG1)                            \
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
         ({                                                      \
           int retval;                                           \
+          uint32_t ecx_ = (uint32_t) (ARG1);                    \
+          uint32_t edx_ = (uint32_t) (ARG2);                    \
           asm volatile                                          \
-            ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
-               : "=a" (retval)                                  \
-               : [number] "i" (NUMBER),                         \
-                 [arg0] "g" (ARG0),                             \
-                 [arg1] "g" (ARG1)                              \
-               : "memory");                                     \
+            (SYSCALL_TRAP                                       \
+               : "=a" (retval), "+c" (ecx_), "+d" (edx_)        \
+               : "a" (NUMBER),                                  \
+                 "b" ((uint32_t) (ARG0)),                       \
+                 "S" ((uint32_t) (ARG3))                        \
+               : "edi", "cc", "memory");                        \
           retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing arguments ARG0, ARG1, and
    ARG2, and returns the return value as an `int'. */
-#define syscall3(NUMBER, ARG0, ARG1, ARG2)                      \
-        ({                                                      \
-          int retval;                                           \
-          asm volatile                                          \
-            ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
-               : "=a" (retval)                                  \
-               : [number] "i" (NUMBER),                         \
-                 [arg0] "g" (ARG0),                             \
-                 [arg1] "g" (ARG1),                             \
-                 [arg2] "g" (ARG2)                              \
-               : "memory");                                     \
-          retval;                                               \
-        })
+#define syscall3(NUMBER, ARG0, ARG1, ARG2) \
+        syscall4 (NUMBER, ARG0, ARG1, ARG2, 0)
+
+/* Invokes syscall NUMBER, passing arguments ARG0 and ARG1, and
+   returns the return value as an `int'. */
+#define syscall2(NUMBER, ARG0, ARG1) syscall4 (NUMBER, ARG0, ARG1, 0, 0)
+
+/* Invokes syscall NUMBER, passing argument ARG0, and returns the
+   return value as an `int'. */
+#define syscall1(NUMBER, ARG0) syscall4 (NUMBER, ARG0, 0, 0, 0)
+
+/* Invokes syscall NUMBER, passing no arguments, and returns the
+   return value as an `int'. */
+#define syscall0(NUMBER) syscall4 (NUMBER, 0, 0, 0, 0)
+
+/* CPUID feature flag: SYSENTER and SYSEXIT. */
+#define CPUID_SEP (1u << 11)
+
+/* Decides how to enter the kernel for system calls.  Called by
+   _start() before anything else. */
+void
+_syscall_init (void) 
+{
+  uint32_t eax, ebx, ecx, edx;
+
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1));
+
+  /* The Pentium Pro claims SEP but does not implement it. */
+  _syscall_sysenter = ((edx & CPUID_SEP) != 0
+                       && !(((eax >> 8) & 0xf) == 6
+                            && ((eax >> 4) & 0xf) < 3
+                            && (eax & 0xf) < 3));
+}
 
 void
 halt (void) 
@@ -71,6 +83,7 @@ halt (void)
 void
 exit (int status)
 {
+  fflush (NULL);
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -87,6 +100,12 @@ wait (pid_t pid)
   return syscall1 (SYS_WAIT, pid);
 }
 
+pid_t
+wait_any (int *status)
+{
+  return (pid_t) syscall1 (SYS_WAIT_ANY, status);
+}
+
 bool
 create (const char *file, unsigned initial_size)
 {
@@ -153,6 +172,227 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+mapid_t
+shm_map (const char *name, size_t size, void *addr)
+{
+  return syscall3 (SYS_SHM_MAP, name, size, addr);
+}
+
+pid_t
+fork (void)
+{
+  /* Otherwise the child would write out a copy of the output
+     buffered so far, too. */
+  fflush (NULL);
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+int
+checkpoint (const char *file)
+{
+  /* Otherwise the resumed process would write out a copy of the
+     output buffered so far, too. */
+  fflush (NULL);
+  return syscall1 (SYS_CHECKPOINT, file);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+void
+memstat (struct memstat *st)
+{
+  syscall1 (SYS_MEMSTAT, st);
+}
+
+bool
+madvise (void *addr, size_t size, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, size, advice);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+copy_file_range (int fd_in, int fd_out, unsigned size)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, fd_in, fd_out, size);
+}
+
+bool
+punch_hole (int fd, unsigned offset, unsigned size)
+{
+  return syscall3 (SYS_PUNCH_HOLE, fd, offset, size);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+bool
+fdatasync (int fd)
+{
+  return syscall1 (SYS_FDATASYNC, fd);
+}
+
+pid_t
+spawn (const char *file, char *const argv[], const int fds[], int fd_cnt)
+{
+  return (pid_t) syscall4 (SYS_SPAWN, file, argv, fds, fd_cnt);
+}
+
+int
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+int
+poll (struct pollfd *fds, unsigned nfds, int timeout)
+{
+  return syscall3 (SYS_POLL, fds, nfds, timeout);
+}
+
+int
+fcntl (int fd, int cmd, int arg)
+{
+  return syscall3 (SYS_FCNTL, fd, cmd, arg);
+}
+
+int
+getrusage (int who, struct rusage *usage)
+{
+  return syscall2 (SYS_GETRUSAGE, who, usage);
+}
+
+bool
+perfhist (int kind, unsigned idx, struct perfhist *h)
+{
+  return syscall3 (SYS_PERFHIST, kind, idx, h);
+}
+
+/* Where a thread made by clone() starts: runs FUNC (ARG), then
+   ends the thread. */
+static void NO_RETURN
+thread_start (void (*func) (void *), void *arg)
+{
+  func (arg);
+  thread_exit (0);
+}
+
+pid_t
+clone (void (*func) (void *), void *arg, void *stack)
+{
+  return (pid_t) syscall4 (SYS_CLONE, thread_start, func, arg, stack);
+}
+
+void
+thread_exit (int status)
+{
+  syscall1 (SYS_THREAD_EXIT, status);
+  NOT_REACHED ();
+}
+
+int
+futex_wait (int *addr, int val)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, val);
+}
+
+int
+futex_wake (int *addr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
+
+void
+perfstat (struct perfstat *st)
+{
+  syscall1 (SYS_PERFSTAT, st);
+}
+
+uint64_t
+cycles (void)
+{
+  uint64_t retval;
+
+  /* The kernel returns the high word in EDX, which rules out
+     SYSENTER. */
+  asm volatile ("int $0x31"
+                : "=A" (retval)
+                : "a" (SYS_CYCLES)
+                : "memory");
+  return retval;
+}
+
+int
+aio_setup (struct aio_ring *ring)
+{
+  return syscall1 (SYS_AIO_SETUP, ring);
+}
+
+int
+aio_enter (unsigned min_complete)
+{
+  return syscall1 (SYS_AIO_ENTER, min_complete);
+}
+
+int
+batch (struct batch_call *calls, int cnt)
+{
+  return syscall2 (SYS_BATCH, calls, cnt);
+}
+
+/* Returns the nanoseconds since boot.  The time is computed from
+   the clock page the kernel maps into every process, without a
+   system call, once the kernel has calibrated it. */
+uint64_t
+gettime (void)
+{
+  uint64_t retval;
+
+  if (CLOCK_PAGE->mult != 0)
+    {
+      asm volatile ("rdtsc" : "=A" (retval));
+      return clock_nanos (CLOCK_PAGE, retval);
+    }
+
+  /* The kernel returns the high word in EDX, which rules out
+     SYSENTER. */
+  asm volatile ("int $0x31"
+                : "=A" (retval)
+                : "a" (SYS_GETTIME)
+                : "memory");
+  return retval;
+}
+
 bool
 chdir (const char *dir)
 {
@@ -182,3 +422,15 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+getdents (int fd, struct dirent *ents, unsigned cnt)
+{
+  return syscall3 (SYS_GETDENTS, fd, ents, cnt);
+}
+
+bool
+snapshot (const char *dir, const char *snap)
+{
+  return syscall2 (SYS_SNAPSHOT, dir, snap);
+}
@@ -2,7 +2,18 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <aio.h>
+#include <batch.h>
 #include <debug.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <madvise.h>
+#include <memstat.h>
+#include <perfstat.h>
+#include <poll.h>
+#include <rusage.h>
+#include <uio.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -13,7 +24,7 @@ typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
 /* Maximum characters in a filename written by readdir(). */
-#define READDIR_MAX_LEN 14
+#define READDIR_MAX_LEN 63
 
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
@@ -24,6 +35,7 @@ void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
 pid_t exec (const char *file);
 int wait (pid_t);
+pid_t wait_any (int *status);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 int open (const char *file);
@@ -33,10 +45,41 @@ int write (int fd, const void *buffer, unsigned length);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int copy_file_range (int fd_in, int fd_out, unsigned length);
+bool punch_hole (int fd, unsigned offset, unsigned length);
+bool fsync (int fd);
+bool fdatasync (int fd);
+pid_t spawn (const char *file, char *const argv[], const int fds[],
+             int fd_cnt);
+int pipe (int fds[2]);
+int poll (struct pollfd *, unsigned nfds, int timeout);
+int fcntl (int fd, int cmd, int arg);
+int getrusage (int who, struct rusage *);
+pid_t clone (void (*func) (void *), void *arg, void *stack);
+void thread_exit (int status) NO_RETURN;
+int futex_wait (int *addr, int val);
+int futex_wake (int *addr, int cnt);
+void perfstat (struct perfstat *);
+bool perfhist (int kind, unsigned idx, struct perfhist *);
+uint64_t cycles (void);
+uint64_t gettime (void);
+int aio_setup (struct aio_ring *);
+int aio_enter (unsigned min_complete);
+int batch (struct batch_call *, int cnt);
 
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+mapid_t shm_map (const char *name, size_t size, void *addr);
+pid_t fork (void);
+int checkpoint (const char *file);
+void *sbrk (intptr_t increment);
+void memstat (struct memstat *);
+bool madvise (void *addr, size_t size, int advice);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -44,5 +87,10 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+int getdents (int fd, struct dirent *, unsigned cnt);
+bool snapshot (const char *dir, const char *snap);
+
+/* Startup, called by _start() only. */
+void _syscall_init (void);
 
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,36 @@
+#include "tests/bench.h"
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Starts measuring B, named NAME. */
+void
+bench_start (struct bench *b, const char *name)
+{
+  b->name = name;
+  perfstat (&b->start);
+}
+
+/* Stops measuring B, which did OPS operations moving BYTES bytes,
+   and reports the time it took and the kernel's work meanwhile,
+   as a line of the form "bench NAME: KEY VALUE, ...".  The
+   "bench" target of the tests/ makefiles collects these lines. */
+void
+bench_stop (struct bench *b, size_t ops, size_t bytes)
+{
+  struct perfstat end;
+  long long d[PERF_CNT];
+  int i;
+
+  perfstat (&end);
+  for (i = 0; i < PERF_CNT; i++)
+    d[i] = end.counters[i] - b->start.counters[i];
+
+  msg ("bench %s: ticks %lld, ops %zu, bytes %zu, "
+       "sectors read %lld, sectors written %lld, cache misses %lld, "
+       "faults %lld, swap in %lld, swap out %lld",
+       b->name, end.ticks - b->start.ticks, ops, bytes,
+       d[PERF_SECTOR_READ], d[PERF_SECTOR_WRITE], d[PERF_CACHE_MISS],
+       d[PERF_FAULT_ZERO] + d[PERF_FAULT_FILE] + d[PERF_FAULT_SWAP]
+       + d[PERF_FAULT_COW] + d[PERF_FAULT_STACK],
+       d[PERF_SWAP_IN], d[PERF_SWAP_OUT]);
+}
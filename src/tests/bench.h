@@ -0,0 +1,17 @@
+#ifndef TESTS_BENCH_H
+#define TESTS_BENCH_H
+
+#include <perfstat.h>
+#include <stddef.h>
+
+/* A measured stretch of a benchmark. */
+struct bench
+  {
+    const char *name;           /* What is measured. */
+    struct perfstat start;      /* Counters when it began. */
+  };
+
+void bench_start (struct bench *, const char *name);
+void bench_stop (struct bench *, size_t ops, size_t bytes);
+
+#endif /* tests/bench.h */
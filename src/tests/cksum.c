@@ -1,5 +1,12 @@
-/* crctab[] and cksum() are from the `cksum' entry in SUSv3. */
+/* crctab[] and cksum() are from the `cksum' entry in SUSv3.
 
+   The data is run through the CRC eight bytes at a time
+   ("slicing-by-8"): crctabs[K][C] is the CRC of byte C followed
+   by K zero bytes, so the CRC of eight bytes is the XOR of one
+   lookup per byte, and the lookups do not depend on each other.
+   crctabs[0] is crctab[]; the others are built on first use. */
+
+#include <stdbool.h>
 #include <stdint.h>
 #include "tests/cksum.h"
 
@@ -58,27 +65,89 @@ static unsigned long crctab[] = {
   0xa2f33668, 0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
-/* This is the algorithm used by the Posix `cksum' utility. */
-unsigned long
-cksum (const void *b_, size_t n)
+/* Slicing tables, built by init_crctabs(). */
+static uint32_t crctabs[8][256];
+static bool crctabs_ready;
+
+static void init_crctabs (void);
+
+/* Starts computing the checksum of a stream of data in C. */
+void
+cksum_init (struct cksum *c)
+{
+  if (!crctabs_ready)
+    init_crctabs ();
+  c->crc = 0;
+  c->length = 0;
+}
+
+/* Adds the N bytes at B_ to the stream of data in C. */
+void
+cksum_update (struct cksum *c, const void *b_, size_t n)
 {
   const unsigned char *b = b_;
-  uint32_t s = 0;
-  size_t i;
-  for (i = n; i > 0; --i)
+  uint32_t s = c->crc;
+
+  c->length += n;
+  for (; n >= 8; n -= 8, b += 8)
     {
-      unsigned char c = *b++;
-      s = (s << 8) ^ crctab[(s >> 24) ^ c];
+      uint32_t hi = s ^ ((uint32_t) b[0] << 24 | (uint32_t) b[1] << 16
+                         | (uint32_t) b[2] << 8 | b[3]);
+      s = (crctabs[7][hi >> 24] ^ crctabs[6][(hi >> 16) & 0xff]
+           ^ crctabs[5][(hi >> 8) & 0xff] ^ crctabs[4][hi & 0xff]
+           ^ crctabs[3][b[4]] ^ crctabs[2][b[5]]
+           ^ crctabs[1][b[6]] ^ crctabs[0][b[7]]);
     }
+  for (; n > 0; n--)
+    s = (s << 8) ^ crctabs[0][(s >> 24) ^ *b++];
+  c->crc = s;
+}
+
+/* Returns the checksum of the stream of data in C, which is then
+   done with. */
+unsigned long
+cksum_finish (struct cksum *c)
+{
+  uint32_t s = c->crc;
+  size_t n = c->length;
+
   while (n != 0)
     {
-      unsigned char c = n;
+      unsigned char ch = n;
       n >>= 8;
-      s = (s << 8) ^ crctab[(s >> 24) ^ c];
+      s = (s << 8) ^ crctabs[0][(s >> 24) ^ ch];
     }
   return ~s;
 }
 
+/* This is the algorithm used by the Posix `cksum' utility. */
+unsigned long
+cksum (const void *b, size_t n)
+{
+  struct cksum c;
+
+  cksum_init (&c);
+  cksum_update (&c, b, n);
+  return cksum_finish (&c);
+}
+
+/* Builds the slicing tables from crctab[]. */
+static void
+init_crctabs (void)
+{
+  int i, k;
+
+  for (i = 0; i < 256; i++)
+    crctabs[0][i] = crctab[i];
+  for (k = 1; k < 8; k++)
+    for (i = 0; i < 256; i++)
+      {
+        uint32_t prev = crctabs[k - 1][i];
+        crctabs[k][i] = (prev << 8) ^ crctab[prev >> 24];
+      }
+  crctabs_ready = true;
+}
+
 #ifdef STANDALONE_TEST
 #include <stdio.h>
 int
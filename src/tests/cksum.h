@@ -2,6 +2,18 @@
 #define TESTS_CKSUM_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+/* Checksum of a stream of data, computed piece by piece. */
+struct cksum
+  {
+    uint32_t crc;               /* CRC of the data so far. */
+    size_t length;              /* Bytes of data so far. */
+  };
+
+void cksum_init (struct cksum *);
+void cksum_update (struct cksum *, const void *, size_t);
+unsigned long cksum_finish (struct cksum *);
 
 unsigned long cksum(const void *, size_t);
 
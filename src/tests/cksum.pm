@@ -61,10 +61,8 @@ sub cksum {
     my ($b) = @_;
     my ($n) = length ($b);
     my ($s) = 0;
-    for my $i (0...$n - 1) {
-	my ($c) = ord (substr ($b, $i, 1));
-	$s = ($s << 8) ^ $crctab[($s >> 24) ^ $c];
-	$s &= 0xffff_ffff;
+    for my $c (unpack ('C*', $b)) {
+	$s = (($s << 8) & 0xffff_ffff) ^ $crctab[($s >> 24) ^ $c];
     }
     while ($n != 0) {
 	my ($c) = $n & 0xff;
@@ -0,0 +1,50 @@
+/* Creates enough files in the root directory to make it grow
+   well past a sector of entries, then removes every other one
+   and checks that exactly the rest can still be opened. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+
+void
+test_main (void) 
+{
+  char name[16];
+  int i;
+
+  msg ("creating %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  msg ("removing every other file");
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+
+  msg ("opening each file");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "file%d", i);
+      fd = open (name);
+      if (i % 2 == 0 && fd != -1)
+        fail ("open \"%s\" succeeded after remove", name);
+      if (i % 2 == 1)
+        {
+          if (fd < 2)
+            fail ("open \"%s\" failed", name);
+          close (fd);
+        }
+    }
+}
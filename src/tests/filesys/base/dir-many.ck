@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-many) begin
+(dir-many) creating 200 files
+(dir-many) removing every other file
+(dir-many) opening each file
+(dir-many) end
+EOF
+pass;
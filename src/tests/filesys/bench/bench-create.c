@@ -0,0 +1,44 @@
+/* Measures the rate at which small files are created, written
+   and deleted. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 100
+#define FILE_SIZE 512
+
+static char data[FILE_SIZE];
+
+void
+test_main (void)
+{
+  struct bench b;
+  char name[16];
+  int i;
+
+  bench_start (&b, "create");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "small%d", i);
+      if (!create (name, 0) || (fd = open (name)) < 2)
+        fail ("create \"%s\" failed", name);
+      if (write (fd, data, FILE_SIZE) != FILE_SIZE)
+        fail ("write \"%s\" failed", name);
+      close (fd);
+    }
+  bench_stop (&b, FILE_CNT, FILE_CNT * FILE_SIZE);
+
+  bench_start (&b, "delete");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "small%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+  bench_stop (&b, FILE_CNT, 0);
+}
@@ -0,0 +1,50 @@
+/* Measures directory lookup latency: opens files in random
+   order as the root directory grows to several sizes. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LOOKUP_CNT 500
+
+/* Directory sizes measured, in increasing order. */
+static const int sizes[] = { 16, 64, 256 };
+
+void
+test_main (void)
+{
+  int entry_cnt = 0;
+  size_t i;
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      struct bench b;
+      char name[32];
+      int j;
+
+      for (; entry_cnt < sizes[i]; entry_cnt++)
+        {
+          snprintf (name, sizeof name, "f%d", entry_cnt);
+          if (!create (name, 0))
+            fail ("create \"%s\" failed", name);
+        }
+
+      snprintf (name, sizeof name, "lookup-%d", entry_cnt);
+      bench_start (&b, name);
+      for (j = 0; j < LOOKUP_CNT; j++)
+        {
+          char file_name[16];
+          int fd;
+
+          snprintf (file_name, sizeof file_name, "f%lu",
+                    random_ulong () % entry_cnt);
+          if ((fd = open (file_name)) < 2)
+            fail ("open \"%s\" failed", file_name);
+          close (fd);
+        }
+      bench_stop (&b, LOOKUP_CNT, 0);
+    }
+}
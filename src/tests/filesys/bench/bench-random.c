@@ -0,0 +1,47 @@
+/* Measures random access throughput: reads and writes single
+   sectors at random offsets of a file too big for the buffer
+   cache. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (256 * 1024)
+#define BLOCK_SIZE 512
+#define BLOCK_CNT (FILE_SIZE / BLOCK_SIZE)
+#define OP_CNT 1000
+
+static char block[BLOCK_SIZE];
+
+static void
+random_ops (int fd, const char *name, bool write_)
+{
+  struct bench b;
+  int i;
+
+  bench_start (&b, name);
+  for (i = 0; i < OP_CNT; i++)
+    {
+      size_t ofs = random_ulong () % BLOCK_CNT * BLOCK_SIZE;
+      seek (fd, ofs);
+      if ((write_
+           ? write (fd, block, BLOCK_SIZE)
+           : read (fd, block, BLOCK_SIZE)) != BLOCK_SIZE)
+        fail ("%s at offset %zu failed", name, ofs);
+    }
+  bench_stop (&b, OP_CNT, OP_CNT * BLOCK_SIZE);
+}
+
+void
+test_main (void)
+{
+  int fd;
+
+  CHECK (create ("random", FILE_SIZE), "create \"random\"");
+  CHECK ((fd = open ("random")) > 1, "open \"random\"");
+  random_ops (fd, "random-write", true);
+  random_ops (fd, "random-read", false);
+  close (fd);
+}
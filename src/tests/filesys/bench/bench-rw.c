@@ -0,0 +1,24 @@
+/* Measures concurrent throughput: several child processes read
+   and write their own regions of one file at the same time. */
+
+#include <syscall.h>
+#include "tests/bench.h"
+#include "tests/filesys/bench/bench-rw.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  struct bench b;
+
+  CHECK (create (file_name, CHILD_CNT * REGION_SIZE),
+         "create \"%s\"", file_name);
+
+  bench_start (&b, "concurrent-rw");
+  exec_children ("child-bench-rw", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+  bench_stop (&b, CHILD_CNT * PASS_CNT * 2 * (REGION_SIZE / BLOCK_SIZE),
+              CHILD_CNT * PASS_CNT * 2 * REGION_SIZE);
+}
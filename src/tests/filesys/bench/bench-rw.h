@@ -0,0 +1,10 @@
+#ifndef TESTS_FILESYS_BENCH_BENCH_RW_H
+#define TESTS_FILESYS_BENCH_BENCH_RW_H
+
+#define CHILD_CNT 4
+#define REGION_SIZE (32 * 1024)
+#define BLOCK_SIZE 1024
+#define PASS_CNT 4
+static const char file_name[] = "shared";
+
+#endif /* tests/filesys/bench/bench-rw.h */
@@ -0,0 +1,38 @@
+/* Measures sequential throughput: writes a file a block at a
+   time, then reads it back the same way. */
+
+#include <syscall.h>
+#include "tests/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (256 * 1024)
+#define BLOCK_SIZE 4096
+
+static char block[BLOCK_SIZE];
+
+void
+test_main (void)
+{
+  struct bench b;
+  size_t ofs;
+  int fd;
+
+  CHECK (create ("seq", 0), "create \"seq\"");
+  CHECK ((fd = open ("seq")) > 1, "open \"seq\"");
+
+  bench_start (&b, "seq-write");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+    if (write (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+      fail ("write %d bytes at offset %zu failed", BLOCK_SIZE, ofs);
+  bench_stop (&b, FILE_SIZE / BLOCK_SIZE, FILE_SIZE);
+
+  seek (fd, 0);
+  bench_start (&b, "seq-read");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+    if (read (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+      fail ("read %d bytes at offset %zu failed", BLOCK_SIZE, ofs);
+  bench_stop (&b, FILE_SIZE / BLOCK_SIZE, FILE_SIZE);
+
+  close (fd);
+}
@@ -0,0 +1,40 @@
+/* Child process for the bench-rw benchmark.
+   Writes its region of the shared file and reads it back a few
+   times, while the other children do the same with theirs. */
+
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench-rw.h"
+#include "tests/lib.h"
+
+static char block[BLOCK_SIZE];
+
+int
+main (int argc, char *argv[])
+{
+  int child_idx;
+  int fd;
+  int pass;
+  size_t ofs;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (pass = 0; pass < PASS_CNT; pass++)
+    {
+      seek (fd, REGION_SIZE * child_idx);
+      for (ofs = 0; ofs < REGION_SIZE; ofs += BLOCK_SIZE)
+        if (write (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+          fail ("write \"%s\" failed", file_name);
+      seek (fd, REGION_SIZE * child_idx);
+      for (ofs = 0; ofs < REGION_SIZE; ofs += BLOCK_SIZE)
+        if (read (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+          fail ("read \"%s\" failed", file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($fs);
+$fs->{'d'}{sprintf ("file%03d-", $_) . 'y' x 32} = [''] foreach grep ($_ % 2, 0...119);
+check_archive ($fs);
+pass;
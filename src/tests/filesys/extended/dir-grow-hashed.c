@@ -0,0 +1,128 @@
+/* Creates enough files with long names in one directory that it
+   turns into a hashed directory and then grows its buckets a few
+   times.  Then makes sure that every file can be opened and is
+   listed by readdir exactly once, and that removing half of them
+   leaves the other half in place. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 120
+#define NAME_LEN 40
+
+static void make_name (char name[], size_t i);
+static size_t count_entries (bool seen[FILE_CNT]);
+
+void
+test_main (void) 
+{
+  bool seen[FILE_CNT];
+  char name[NAME_LEN + 1];
+  size_t i;
+  int fd;
+
+  CHECK (mkdir ("/d"), "mkdir \"/d\"");
+  CHECK (chdir ("/d"), "chdir \"/d\"");
+
+  msg ("creating %d files", FILE_CNT);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      make_name (name, i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("opening %d files", FILE_CNT);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      make_name (name, i);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      close (fd);
+    }
+  quiet = false;
+
+  CHECK (count_entries (seen) == FILE_CNT, "readdir \"/d\" lists %d files",
+         FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    if (!seen[i])
+      fail ("file %zu not listed", i);
+
+  msg ("removing even-numbered files");
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i += 2) 
+    {
+      make_name (name, i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("checking what is left");
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      make_name (name, i);
+      fd = open (name);
+      if (i % 2 == 0)
+        CHECK (fd == -1, "open \"%s\" (must return -1)", name);
+      else
+        {
+          CHECK (fd > 1, "open \"%s\"", name);
+          close (fd);
+        }
+    }
+  quiet = false;
+
+  CHECK (count_entries (seen) == FILE_CNT / 2,
+         "readdir \"/d\" lists %d files", FILE_CNT / 2);
+  for (i = 1; i < FILE_CNT; i += 2)
+    if (!seen[i])
+      fail ("file %zu not listed", i);
+}
+
+/* Writes the name of file I, NAME_LEN characters long, to NAME. */
+static void
+make_name (char name[], size_t i) 
+{
+  size_t len = snprintf (name, NAME_LEN + 1, "file%03zu-", i);
+  memset (name + len, 'y', NAME_LEN - len);
+  name[NAME_LEN] = '\0';
+}
+
+/* Reads the current directory, marking in SEEN each file
+   listed, and returns the number of files listed.  Fails if a
+   file is listed twice or is not one of ours. */
+static size_t
+count_entries (bool seen[FILE_CNT]) 
+{
+  char name[READDIR_MAX_LEN + 1];
+  size_t cnt = 0;
+  int fd;
+
+  memset (seen, 0, sizeof *seen * FILE_CNT);
+  CHECK ((fd = open (".")) > 1, "open \".\"");
+  while (readdir (fd, name)) 
+    {
+      char expected[NAME_LEN + 1];
+      int i;
+
+      i = memcmp (name, "file", 4) ? -1 : atoi (name + 4);
+      if (i < 0 || i >= FILE_CNT)
+        fail ("readdir returned unexpected \"%s\"", name);
+      make_name (expected, i);
+      if (strcmp (name, expected))
+        fail ("readdir returned unexpected \"%s\"", name);
+      if (seen[i])
+        fail ("readdir returned \"%s\" twice", name);
+      seen[i] = true;
+      cnt++;
+    }
+  msg ("close \".\"");
+  close (fd);
+  return cnt;
+}
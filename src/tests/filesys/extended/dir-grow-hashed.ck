@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-grow-hashed) begin
+(dir-grow-hashed) mkdir "/d"
+(dir-grow-hashed) chdir "/d"
+(dir-grow-hashed) creating 120 files
+(dir-grow-hashed) opening 120 files
+(dir-grow-hashed) open "."
+(dir-grow-hashed) close "."
+(dir-grow-hashed) readdir "/d" lists 120 files
+(dir-grow-hashed) removing even-numbered files
+(dir-grow-hashed) checking what is left
+(dir-grow-hashed) open "."
+(dir-grow-hashed) close "."
+(dir-grow-hashed) readdir "/d" lists 60 files
+(dir-grow-hashed) end
+EOF
+pass;
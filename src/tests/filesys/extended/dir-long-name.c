@@ -0,0 +1,43 @@
+/* Creates a file whose name is as long as a name can be in a new
+   directory, finds it with readdir, and removes it.  A name one character longer
+   must be refused. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char name[READDIR_MAX_LEN + 2];
+  char found[READDIR_MAX_LEN + 1];
+  int dir_fd;
+  int fd;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (chdir ("d"), "chdir \"d\"");
+
+  memset (name, 'x', sizeof name - 1);
+  name[sizeof name - 1] = '\0';
+  CHECK (!create (name, 0), "create %d-character name (must fail)",
+         (int) strlen (name));
+
+  name[READDIR_MAX_LEN] = '\0';
+  CHECK (create (name, 0), "create %d-character name", (int) strlen (name));
+  CHECK ((fd = open (name)) > 1, "open %d-character name",
+         (int) strlen (name));
+  msg ("close %d-character name", (int) strlen (name));
+  close (fd);
+
+  CHECK ((dir_fd = open (".")) > 1, "open \".\"");
+  CHECK (readdir (dir_fd, found), "readdir \".\"");
+  CHECK (!strcmp (found, name), "readdir returned the long name");
+  CHECK (!readdir (dir_fd, found), "readdir \".\" (must return false)");
+  msg ("close \".\"");
+  close (dir_fd);
+
+  CHECK (remove (name), "remove %d-character name", (int) strlen (name));
+  CHECK (open (name) == -1, "open %d-character name (must return -1)",
+         (int) strlen (name));
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-long-name) begin
+(dir-long-name) mkdir "d"
+(dir-long-name) chdir "d"
+(dir-long-name) create 64-character name (must fail)
+(dir-long-name) create 63-character name
+(dir-long-name) open 63-character name
+(dir-long-name) close 63-character name
+(dir-long-name) open "."
+(dir-long-name) readdir "."
+(dir-long-name) readdir returned the long name
+(dir-long-name) readdir "." (must return false)
+(dir-long-name) close "."
+(dir-long-name) remove 63-character name
+(dir-long-name) open 63-character name (must return -1)
+(dir-long-name) end
+EOF
+pass;
@@ -0,0 +1,138 @@
+/* Test program for lib/kernel/bitmap.c.
+
+   Checks the word-at-a-time bitmap operations against bit by bit
+   versions on random bitmaps, then times scans of a large, mostly
+   full bitmap, as in a large page or sector pool.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Number of bits in bitmaps checked for correctness. */
+#define CHECK_BITS 200
+
+/* Number of bits in the bitmap timed, as in a 64 MB pool of
+   sectors. */
+#define BENCH_BITS (64 * 1024 * 2)
+
+/* Number of scans timed. */
+#define BENCH_SCANS 64
+
+static size_t slow_count (const struct bitmap *, size_t, size_t, bool);
+static size_t slow_scan (const struct bitmap *, size_t, size_t, bool);
+static void check (void);
+static void bench (void);
+
+/* Tests the bitmap implementation. */
+void
+test (void)
+{
+  check ();
+  bench ();
+}
+
+/* Returns the number of bits in B between START and START + CNT
+   set to VALUE, testing each bit. */
+static size_t
+slow_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, value_cnt = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+/* Returns the first run of CNT bits in B at or after START set
+   to VALUE, testing each bit, or BITMAP_ERROR. */
+static size_t
+slow_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i;
+
+  for (i = start; i + cnt <= bitmap_size (b); i++)
+    if (slow_count (b, i, cnt, value) == cnt)
+      return i;
+  return BITMAP_ERROR;
+}
+
+/* Compares the bitmap operations to the versions above on
+   random bitmaps and ranges. */
+static void
+check (void)
+{
+  struct bitmap *b = bitmap_create (CHECK_BITS);
+  int round;
+
+  ASSERT (b != NULL);
+  printf ("checking bitmap operations:");
+  for (round = 0; round < 1000; round++)
+    {
+      size_t start = random_ulong () % CHECK_BITS;
+      size_t cnt = random_ulong () % (CHECK_BITS - start + 1);
+      bool value = random_ulong () % 2;
+      size_t i;
+
+      /* Fill with runs of random length. */
+      for (i = 0; i < CHECK_BITS; )
+        {
+          size_t len = random_ulong () % 40 + 1;
+          if (len > CHECK_BITS - i)
+            len = CHECK_BITS - i;
+          bitmap_set_multiple (b, i, len, random_ulong () % 3 == 0);
+          i += len;
+        }
+
+      ASSERT (bitmap_count (b, start, cnt, value)
+              == slow_count (b, start, cnt, value));
+      ASSERT (bitmap_contains (b, start, cnt, value)
+              == (slow_count (b, start, cnt, value) > 0));
+      ASSERT (bitmap_scan (b, start, cnt % 20, value)
+              == slow_scan (b, start, cnt % 20, value));
+
+      bitmap_set_multiple (b, start, cnt, value);
+      ASSERT (slow_count (b, start, cnt, value) == cnt);
+      if ((round + 1) % 100 == 0)
+        printf (" %d", round + 1);
+    }
+  printf (" done\n");
+  bitmap_destroy (b);
+}
+
+/* Times scans for runs of free bits in a large bitmap that is
+   full except near its end. */
+static void
+bench (void)
+{
+  struct bitmap *b = bitmap_create (BENCH_BITS);
+  int64_t start;
+  int i;
+
+  ASSERT (b != NULL);
+  bitmap_set_all (b, true);
+  bitmap_set_multiple (b, BENCH_BITS - 64, 64, false);
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_SCANS; i++)
+    ASSERT (bitmap_scan (b, 0, 32, false) == BENCH_BITS - 64);
+  printf ("%d word scans: %"PRId64" ticks\n",
+          BENCH_SCANS, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_SCANS; i++)
+    ASSERT (slow_scan (b, 0, 32, false) == BENCH_BITS - 64);
+  printf ("%d bit scans: %"PRId64" ticks\n",
+          BENCH_SCANS, timer_elapsed (start));
+
+  bitmap_destroy (b);
+}
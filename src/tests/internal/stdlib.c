@@ -13,15 +13,27 @@
 #include <random.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/test.h"
 
 /* Maximum number of elements in an array that we will test. */
 #define MAX_CNT 4096
 
+/* An element bigger than a double word, for the general swap. */
+struct triple
+  {
+    int key;
+    int pad[2];
+  };
+
 static void shuffle (int[], size_t);
 static int compare_ints (const void *, const void *);
+static int compare_longs (const void *, const void *);
+static int compare_triples (const void *, const void *);
 static void verify_order (const int[], size_t);
 static void verify_bsearch (const int[], size_t);
+static void test_patterns (int cnt);
+static void test_sizes (int cnt);
 
 /* Test sorting and searching implementations. */
 void
@@ -50,12 +62,77 @@ test (void)
           verify_order (values, cnt);
           verify_bsearch (values, cnt);
         }
+      test_patterns (cnt);
+      test_sizes (cnt);
     }
   
   printf (" done\n");
   printf ("stdlib: PASS\n");
 }
 
+/* Sorts CNT ints that start out already in order, in reverse
+   order, and all equal, which are the usual worst cases for a
+   quicksort. */
+static void
+test_patterns (int cnt)
+{
+  static int values[MAX_CNT];
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    values[i] = i;
+  qsort (values, cnt, sizeof *values, compare_ints);
+  verify_order (values, cnt);
+
+  for (i = 0; i < cnt; i++)
+    values[i] = cnt - i - 1;
+  qsort (values, cnt, sizeof *values, compare_ints);
+  verify_order (values, cnt);
+
+  for (i = 0; i < cnt; i++)
+    values[i] = 0;
+  qsort (values, cnt, sizeof *values, compare_ints);
+  for (i = 0; i < cnt; i++)
+    ASSERT (values[i] == 0);
+}
+
+/* Sorts CNT elements of 8 and 12 bytes and of 4 bytes at an
+   unaligned address, so that each way of swapping is used. */
+static void
+test_sizes (int cnt)
+{
+  static long long longs[MAX_CNT];
+  static struct triple triples[MAX_CNT];
+  static int values[MAX_CNT];
+  static char bytes[MAX_CNT * sizeof (int) + 1];
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    values[i] = i;
+  shuffle (values, cnt);
+
+  for (i = 0; i < cnt; i++)
+    longs[i] = (long long) values[i] << 32;
+  qsort (longs, cnt, sizeof *longs, compare_longs);
+  for (i = 0; i < cnt; i++)
+    ASSERT (longs[i] == (long long) i << 32);
+
+  for (i = 0; i < cnt; i++)
+    {
+      triples[i].key = values[i];
+      triples[i].pad[0] = triples[i].pad[1] = values[i];
+    }
+  qsort (triples, cnt, sizeof *triples, compare_triples);
+  for (i = 0; i < cnt; i++)
+    ASSERT (triples[i].key == i
+            && triples[i].pad[0] == i && triples[i].pad[1] == i);
+
+  memcpy (bytes + 1, values, cnt * sizeof *values);
+  qsort (bytes + 1, cnt, sizeof *values, compare_ints);
+  memcpy (values, bytes + 1, cnt * sizeof *values);
+  verify_order (values, cnt);
+}
+
 /* Shuffles the CNT elements in ARRAY into random order. */
 static void
 shuffle (int *array, size_t cnt) 
@@ -83,6 +160,25 @@ compare_ints (const void *a_, const void *b_)
   return *a < *b ? -1 : *a > *b;
 }
 
+/* Compares long longs *A and *B as compare_ints() does. */
+static int
+compare_longs (const void *a_, const void *b_) 
+{
+  const long long *a = a_;
+  const long long *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Compares the keys of triples *A and *B as compare_ints()
+   does. */
+static int
+compare_triples (const void *a_, const void *b_) 
+{
+  return compare_ints (&((const struct triple *) a_)->key,
+                       &((const struct triple *) b_)->key);
+}
+
 /* Verifies that ARRAY contains the CNT ints 0...CNT-1. */
 static void
 verify_order (const int *array, size_t cnt) 
@@ -0,0 +1,279 @@
+/* Test program for the block and string scanning functions in
+   lib/string.c.
+
+   Checks memcpy(), memmove(), memset() and memcmp() against byte
+   by byte versions at all small alignments and lengths, then
+   times copies of 16 bytes, a sector and a page against a byte
+   loop.  Checks strlen(), strchr(), strcmp(), memchr() and
+   strlcpy() the same way, then times strlen() and strcmp() on
+   strings as long as typical command-line arguments and file
+   names.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Size of the buffers checked for correctness. */
+#define CHECK_SIZE 96
+
+/* Bytes copied per timed size. */
+#define BENCH_BYTES (8 * 1024 * 1024)
+
+static uint8_t src[4096], dst[4096], ref[4096];
+
+static void slow_copy (uint8_t *, const uint8_t *, size_t);
+static void fill (void);
+static void check (void);
+static void bench (size_t size);
+static void fill_string (char *, size_t len);
+static void check_strings (void);
+static size_t slow_strlen (const char *);
+static int slow_strcmp (const char *, const char *);
+static void bench_strings (size_t len);
+
+/* Tests the block functions. */
+void
+test (void)
+{
+  check ();
+  bench (16);
+  bench (512);
+  bench (4096);
+  check_strings ();
+  bench_strings (8);
+  bench_strings (24);
+  bench_strings (64);
+}
+
+/* Copies SIZE bytes from SRC to DST one at a time. */
+static void
+slow_copy (uint8_t *dst_, const uint8_t *src_, size_t size)
+{
+  volatile uint8_t *d = dst_;
+  const uint8_t *s = src_;
+
+  while (size-- > 0)
+    *d++ = *s++;
+}
+
+/* Fills SRC with random bytes and DST and REF with copies. */
+static void
+fill (void)
+{
+  size_t i;
+
+  for (i = 0; i < CHECK_SIZE; i++)
+    src[i] = random_ulong ();
+  slow_copy (dst, src, CHECK_SIZE);
+  slow_copy (ref, src, CHECK_SIZE);
+}
+
+/* Compares each function to a byte by byte version for every
+   pair of offsets within a word and every length up to half of
+   the buffers. */
+static void
+check (void)
+{
+  size_t sofs, dofs, len, i;
+
+  printf ("checking block functions:");
+  for (sofs = 0; sofs < 8; sofs++)
+    for (dofs = 0; dofs < 8; dofs++)
+      for (len = 0; len <= CHECK_SIZE / 2; len++)
+        {
+          int value = random_ulong ();
+
+          fill ();
+          ASSERT (memcpy (dst + dofs, src + sofs, len) == dst + dofs);
+          slow_copy (ref + dofs, src + sofs, len);
+          for (i = 0; i < CHECK_SIZE; i++)
+            ASSERT (dst[i] == ref[i]);
+
+          /* Overlapping moves in both directions. */
+          fill ();
+          ASSERT (memmove (dst + dofs, dst + sofs, len) == dst + dofs);
+          for (i = 0; i < len; i++)
+            ASSERT (dst[dofs + i] == src[sofs + i]);
+
+          fill ();
+          ASSERT (memset (dst + dofs, value, len) == dst + dofs);
+          for (i = 0; i < CHECK_SIZE; i++)
+            ASSERT (dst[i] == (i >= dofs && i < dofs + len
+                               ? (uint8_t) value : src[i]));
+
+          fill ();
+          ASSERT (memcmp (dst + sofs, src + sofs, len) == 0);
+          if (len > 0)
+            {
+              size_t ofs = sofs + random_ulong () % len;
+              dst[ofs]++;
+              ASSERT (memcmp (dst + sofs, src + sofs, len)
+                      == (dst[ofs] > src[ofs] ? 1 : -1));
+            }
+        }
+  printf (" done\n");
+}
+
+/* Times copying BENCH_BYTES in blocks of SIZE bytes with
+   memcpy() and with a byte loop. */
+static void
+bench (size_t size)
+{
+  size_t cnt = BENCH_BYTES / size;
+  int64_t start;
+  size_t i;
+
+  start = timer_ticks ();
+  for (i = 0; i < cnt; i++)
+    memcpy (dst, src, size);
+  printf ("%zu-byte memcpy: %"PRId64" ticks\n", size, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < cnt; i++)
+    slow_copy (dst, src, size);
+  printf ("%zu-byte byte loop: %"PRId64" ticks\n",
+          size, timer_elapsed (start));
+}
+
+/* Fills the LEN + 1 bytes at S with a string of LEN random
+   nonnull characters, some with the high bit set. */
+static void
+fill_string (char *s, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    s[i] = random_ulong () % 255 + 1;
+  s[len] = '\0';
+}
+
+/* Compares the string functions to byte by byte versions for
+   strings at every offset within a word and of every length up
+   to half of the buffers. */
+static void
+check_strings (void)
+{
+  char *a = (char *) src;
+  char *b = (char *) dst;
+  size_t aofs, bofs, len, i;
+
+  printf ("checking string functions:");
+  for (aofs = 0; aofs < 8; aofs++)
+    for (bofs = 0; bofs < 8; bofs++)
+      for (len = 0; len <= CHECK_SIZE / 2; len++)
+        {
+          char *s = a + aofs;
+          char *t = b + bofs;
+
+          fill_string (s, len);
+          ASSERT (strlen (s) == len);
+          ASSERT (strnlen (s, len / 2) == len / 2);
+          ASSERT (strnlen (s, len + 5) == len);
+
+          /* Each character of S is found at its first
+             occurrence, and the terminator at the end. */
+          for (i = 0; i < len; i++)
+            {
+              char *p = strchr (s, s[i]);
+              ASSERT (p != NULL && p <= s + i && *p == s[i]);
+              ASSERT (memchr (s, s[i], len) == p);
+            }
+          ASSERT (strchr (s, '\0') == s + len);
+          ASSERT (memchr (s, '\0', len) == NULL);
+          ASSERT (memchr (s, '\0', len + 1) == s + len);
+
+          /* Copies compare equal, and a changed or missing
+             character makes a difference. */
+          ASSERT (strlcpy (t, s, CHECK_SIZE) == len);
+          ASSERT (strcmp (s, t) == 0);
+          if (len > 0)
+            {
+              size_t ofs = random_ulong () % len;
+
+              ASSERT (strlcpy (t, s, ofs + 1) == len);
+              ASSERT (strlen (t) == ofs);
+              ASSERT (strcmp (s, t) > 0 && strcmp (t, s) < 0);
+
+              strlcpy (t, s, CHECK_SIZE);
+              t[ofs] = t[ofs] == (char) 0xff ? 1 : t[ofs] + 1;
+              ASSERT (strcmp (s, t) == slow_strcmp (s, t));
+              ASSERT (strcmp (t, s) == -slow_strcmp (s, t));
+            }
+        }
+  printf (" done\n");
+}
+
+/* Returns the length of S, counted a byte at a time. */
+static size_t
+slow_strlen (const char *s_)
+{
+  const volatile char *s = s_;
+  size_t len = 0;
+
+  while (s[len] != '\0')
+    len++;
+  return len;
+}
+
+/* Compares strings A and B a byte at a time, returning -1, 0,
+   or 1. */
+static int
+slow_strcmp (const char *a_, const char *b_)
+{
+  const volatile unsigned char *a = (const unsigned char *) a_;
+  const volatile unsigned char *b = (const unsigned char *) b_;
+
+  while (*a != '\0' && *a == *b)
+    {
+      a++;
+      b++;
+    }
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Times strlen() and strcmp() of equal strings of LEN
+   characters against byte loops. */
+static void
+bench_strings (size_t len)
+{
+  size_t cnt = BENCH_BYTES / (len + 1);
+  char *a = (char *) src;
+  char *b = (char *) dst;
+  volatile size_t sink = 0;
+  int64_t start;
+  size_t i;
+
+  fill_string (a, len);
+  strlcpy (b, a, len + 1);
+
+  start = timer_ticks ();
+  for (i = 0; i < cnt; i++)
+    sink += strlen (a);
+  printf ("%zu-char strlen: %"PRId64" ticks\n", len, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < cnt; i++)
+    sink += slow_strlen (a);
+  printf ("%zu-char byte strlen: %"PRId64" ticks\n",
+          len, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < cnt; i++)
+    sink += strcmp (a, b);
+  printf ("%zu-char strcmp: %"PRId64" ticks\n", len, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < cnt; i++)
+    sink += slow_strcmp (a, b);
+  printf ("%zu-char byte strcmp: %"PRId64" ticks\n",
+          len, timer_elapsed (start));
+}
@@ -0,0 +1,318 @@
+/* Scheduler benchmarks.
+
+   Each benchmark reports its results as a line of the form
+   "bench NAME: KEY VALUE, ...", which utils/bench-compare
+   compares between builds.  Times shorter than a tick are
+   measured in time stamp counter cycles. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <random.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Iterations of the switch and wakeup benchmarks. */
+#define ROUND_CNT 1000
+
+/* Ping-pong between two threads. */
+struct ping_pong
+  {
+    struct semaphore ping, pong;
+    struct semaphore done;
+  };
+
+static void
+pong_thread (void *pp_)
+{
+  struct ping_pong *pp = pp_;
+  int i;
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      sema_down (&pp->ping);
+      sema_up (&pp->pong);
+    }
+  sema_up (&pp->done);
+}
+
+/* Measures the cost of a context switch: two threads of equal
+   priority hand a semaphore back and forth, switching twice per
+   round. */
+void
+test_bench_switch (void)
+{
+  struct ping_pong pp;
+  uint64_t start;
+  int64_t start_ticks;
+  int i;
+
+  sema_init (&pp.ping, 0);
+  sema_init (&pp.pong, 0);
+  sema_init (&pp.done, 0);
+  thread_create ("pong", thread_get_priority (), pong_thread, &pp);
+
+  start_ticks = timer_ticks ();
+  start = timer_cycles ();
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      sema_up (&pp.ping);
+      sema_down (&pp.pong);
+    }
+  msg ("bench switch: cycles per switch %"PRIu64", ticks %"PRId64,
+       (timer_cycles () - start) / (2 * ROUND_CNT),
+       timer_elapsed (start_ticks));
+  sema_down (&pp.done);
+}
+
+/* Wakeup latency measurement. */
+struct wakeup
+  {
+    struct semaphore sema;
+    struct semaphore done;
+    uint64_t up_time;           /* When sema_up() was called. */
+    uint64_t total, max;        /* Latencies. */
+  };
+
+static void
+wakee_thread (void *w_)
+{
+  struct wakeup *w = w_;
+  int i;
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      uint64_t latency;
+
+      sema_down (&w->sema);
+      latency = timer_cycles () - w->up_time;
+      w->total += latency;
+      if (latency > w->max)
+        w->max = latency;
+    }
+  sema_up (&w->done);
+}
+
+/* Measures the time from sema_up() to the woken thread running,
+   for a thread of higher priority than the one waking it. */
+void
+test_bench_wakeup (void)
+{
+  struct wakeup w;
+  int i;
+
+  sema_init (&w.sema, 0);
+  sema_init (&w.done, 0);
+  w.total = w.max = 0;
+  thread_create ("wakee", thread_get_priority () + 1, wakee_thread, &w);
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      w.up_time = timer_cycles ();
+      sema_up (&w.sema);
+    }
+  sema_down (&w.done);
+  msg ("bench wakeup: average cycles %"PRIu64", max cycles %"PRIu64,
+       w.total / ROUND_CNT, w.max);
+}
+
+/* Threads spinning and sleeping in the sleep benchmark. */
+#define SPINNER_CNT 4
+#define SLEEPER_CNT 4
+#define SLEEP_CNT 10
+
+struct sleep_info
+  {
+    struct semaphore done;
+    int64_t late_total;         /* Ticks late, summed. */
+    int64_t late_max;           /* Most ticks late. */
+    volatile bool stop;         /* Tells spinners to finish. */
+  };
+
+static void
+spinner_thread (void *si_)
+{
+  struct sleep_info *si = si_;
+
+  while (!si->stop)
+    continue;
+  sema_up (&si->done);
+}
+
+static void
+sleeper_thread (void *si_)
+{
+  struct sleep_info *si = si_;
+  int i;
+
+  for (i = 0; i < SLEEP_CNT; i++)
+    {
+      int64_t ticks = random_ulong () % 10 + 1;
+      int64_t start = timer_ticks ();
+      int64_t late;
+
+      timer_sleep (ticks);
+      late = timer_elapsed (start) - ticks;
+      si->late_total += late;
+      if (late > si->late_max)
+        si->late_max = late;
+    }
+  sema_up (&si->done);
+}
+
+/* Measures how late timer_sleep() returns while threads of the
+   same priority keep the CPU busy. */
+void
+test_bench_sleep (void)
+{
+  struct sleep_info si;
+  int i;
+
+  sema_init (&si.done, 0);
+  si.late_total = si.late_max = 0;
+  si.stop = false;
+  random_init (0);
+
+  for (i = 0; i < SPINNER_CNT; i++)
+    thread_create ("spinner", PRI_DEFAULT, spinner_thread, &si);
+  for (i = 0; i < SLEEPER_CNT; i++)
+    thread_create ("sleeper", PRI_DEFAULT, sleeper_thread, &si);
+
+  thread_set_priority (PRI_DEFAULT + 1);
+  for (i = 0; i < SLEEPER_CNT; i++)
+    sema_down (&si.done);
+  si.stop = true;
+  for (i = 0; i < SPINNER_CNT; i++)
+    sema_down (&si.done);
+  thread_set_priority (PRI_DEFAULT);
+
+  msg ("bench sleep: sleeps %d, ticks late %"PRId64", "
+       "max ticks late %"PRId64,
+       SLEEPER_CNT * SLEEP_CNT, si.late_total, si.late_max);
+}
+
+/* Lock handoff with donation. */
+struct handoff
+  {
+    struct lock lock;
+    struct semaphore go;
+    struct semaphore done;
+  };
+
+static void
+donor_thread (void *h_)
+{
+  struct handoff *h = h_;
+  int i;
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      sema_down (&h->go);
+      lock_acquire (&h->lock);
+      lock_release (&h->lock);
+    }
+  sema_up (&h->done);
+}
+
+/* Measures the cost of handing a lock to a thread of higher
+   priority.  In each round this thread takes the lock and wakes
+   the donor, which preempts it, blocks on the lock and donates
+   its priority; releasing the lock then passes it, and the CPU,
+   back to the donor. */
+void
+test_bench_donate (void)
+{
+  struct handoff h;
+  uint64_t start;
+  int i;
+
+  lock_init (&h.lock);
+  sema_init (&h.go, 0);
+  sema_init (&h.done, 0);
+  thread_create ("donor", thread_get_priority () + 1, donor_thread, &h);
+
+  start = timer_cycles ();
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      lock_acquire (&h.lock);
+      sema_up (&h.go);
+      lock_release (&h.lock);
+    }
+  msg ("bench donate: cycles per handoff %"PRIu64,
+       (timer_cycles () - start) / ROUND_CNT);
+  sema_down (&h.done);
+}
+
+/* Threads and run time of the MLFQS fairness benchmark. */
+#define FAIR_CNT 8
+#define FAIR_TICKS (10 * TIMER_FREQ)
+
+struct fair_info
+  {
+    struct semaphore done;
+    int64_t start;
+    int ticks[FAIR_CNT];
+  };
+
+struct fair_thread
+  {
+    struct fair_info *fi;
+    int idx;
+  };
+
+static void
+fair_thread (void *ft_)
+{
+  struct fair_thread *ft = ft_;
+  struct fair_info *fi = ft->fi;
+  int64_t last = 0;
+
+  while (timer_elapsed (fi->start) < FAIR_TICKS)
+    {
+      int64_t cur = timer_ticks ();
+      if (cur != last)
+        fi->ticks[ft->idx]++;
+      last = cur;
+    }
+  sema_up (&fi->done);
+}
+
+/* Measures how evenly the MLFQS scheduler shares the CPU among
+   CPU-bound threads of equal niceness. */
+void
+test_bench_mlfqs (void)
+{
+  struct fair_info fi;
+  struct fair_thread ft[FAIR_CNT];
+  int min, max, total;
+  int i;
+
+  ASSERT (thread_mlfqs);
+
+  sema_init (&fi.done, 0);
+  fi.start = timer_ticks ();
+  thread_set_nice (-20);
+  for (i = 0; i < FAIR_CNT; i++)
+    {
+      ft[i].fi = &fi;
+      ft[i].idx = i;
+      fi.ticks[i] = 0;
+      thread_create ("fair", PRI_DEFAULT, fair_thread, &ft[i]);
+    }
+  for (i = 0; i < FAIR_CNT; i++)
+    sema_down (&fi.done);
+
+  min = max = total = fi.ticks[0];
+  for (i = 1; i < FAIR_CNT; i++)
+    {
+      if (fi.ticks[i] < min)
+        min = fi.ticks[i];
+      if (fi.ticks[i] > max)
+        max = fi.ticks[i];
+      total += fi.ticks[i];
+    }
+  msg ("bench mlfqs: threads %d, ticks %d, min ticks %d, max ticks %d",
+       FAIR_CNT, total, min, max);
+}
@@ -32,6 +32,11 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_bench_switch;
+extern test_func test_bench_wakeup;
+extern test_func test_bench_sleep;
+extern test_func test_bench_donate;
+extern test_func test_bench_mlfqs;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
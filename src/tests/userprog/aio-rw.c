@@ -0,0 +1,86 @@
+/* Writes four blocks of a file with one batch of asynchronous
+   I/Os and reads them back with another, checking each
+   completion, then checks that an I/O on a bad descriptor
+   completes with -1. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ENTRIES 8
+#define BLOCKS 4
+#define BLOCK_SIZE 512
+
+static struct aio_sqe sqes[ENTRIES];
+static struct aio_cqe cqes[ENTRIES];
+static struct aio_ring ring = { ENTRIES, 0, 0, 0, 0, sqes, cqes };
+static char data[BLOCKS][BLOCK_SIZE];
+static char back[BLOCKS][BLOCK_SIZE];
+
+/* Queues an I/O. */
+static void
+push (int op, int fd, void *buf, unsigned size, unsigned offset,
+      unsigned user_data)
+{
+  struct aio_sqe *sqe = &sqes[ring.sq_tail++ % ENTRIES];
+
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buf = buf;
+  sqe->size = size;
+  sqe->offset = offset;
+  sqe->user_data = user_data;
+}
+
+/* Consumes CNT completions, which must each have result
+   EXPECTED, and returns them as a bit set of user data. */
+static unsigned
+reap (int cnt, int expected)
+{
+  unsigned seen = 0;
+
+  while (cnt-- > 0)
+    {
+      struct aio_cqe *cqe;
+
+      if (ring.cq_head == ring.cq_tail)
+        fail ("completion missing");
+      cqe = &cqes[ring.cq_head++ % ENTRIES];
+      if (cqe->result != expected)
+        fail ("I/O %u returned %d", cqe->user_data, cqe->result);
+      seen |= 1u << cqe->user_data;
+    }
+  return seen;
+}
+
+void
+test_main (void)
+{
+  int fd;
+  int i;
+
+  CHECK (create ("aio", BLOCKS * BLOCK_SIZE), "create \"aio\"");
+  CHECK ((fd = open ("aio")) > 1, "open \"aio\"");
+  CHECK (aio_setup (&ring) == 0, "aio_setup");
+
+  for (i = 0; i < BLOCKS; i++)
+    {
+      memset (data[i], 'a' + i, BLOCK_SIZE);
+      push (AIO_WRITE, fd, data[i], BLOCK_SIZE, i * BLOCK_SIZE, i);
+    }
+  CHECK (aio_enter (BLOCKS) == BLOCKS, "submit %d writes", BLOCKS);
+  CHECK (reap (BLOCKS, BLOCK_SIZE) == (1u << BLOCKS) - 1,
+         "all writes completed");
+
+  for (i = 0; i < BLOCKS; i++)
+    push (AIO_READ, fd, back[i], BLOCK_SIZE, i * BLOCK_SIZE, i);
+  CHECK (aio_enter (BLOCKS) == BLOCKS, "submit %d reads", BLOCKS);
+  CHECK (reap (BLOCKS, BLOCK_SIZE) == (1u << BLOCKS) - 1,
+         "all reads completed");
+  CHECK (!memcmp (data, back, sizeof data), "data read back matches");
+
+  push (AIO_READ, 1234, back[0], BLOCK_SIZE, 0, 0);
+  CHECK (aio_enter (1) == 1, "submit read of bad fd");
+  CHECK (reap (1, -1) == 1, "read of bad fd failed");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(aio-rw) begin
+(aio-rw) create "aio"
+(aio-rw) open "aio"
+(aio-rw) aio_setup
+(aio-rw) submit 4 writes
+(aio-rw) all writes completed
+(aio-rw) submit 4 reads
+(aio-rw) all reads completed
+(aio-rw) data read back matches
+(aio-rw) submit read of bad fd
+(aio-rw) read of bad fd failed
+(aio-rw) end
+aio-rw: exit(0)
+EOF
+pass;
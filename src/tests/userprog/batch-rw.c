@@ -0,0 +1,52 @@
+/* Writes a file, seeks back, and reads it again in one batch of
+   system calls, checking each result, then checks that a batch
+   stops at a call that cannot be batched. */
+
+#include <batch.h>
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char data[] = "batched system calls";
+static char back[sizeof data];
+static struct batch_call calls[8];
+
+/* Sets call I to system call NR with arguments A0...A2. */
+static void
+set_call (int i, int nr, unsigned a0, unsigned a1, unsigned a2)
+{
+  calls[i].nr = nr;
+  calls[i].args[0] = a0;
+  calls[i].args[1] = a1;
+  calls[i].args[2] = a2;
+  calls[i].result = -2;
+}
+
+void
+test_main (void)
+{
+  int fd;
+
+  CHECK (create ("batch", 0), "create \"batch\"");
+  CHECK ((fd = open ("batch")) > 1, "open \"batch\"");
+
+  set_call (0, SYS_WRITE, fd, (unsigned) data, sizeof data);
+  set_call (1, SYS_TELL, fd, 0, 0);
+  set_call (2, SYS_SEEK, fd, 0, 0);
+  set_call (3, SYS_READ, fd, (unsigned) back, sizeof back);
+  set_call (4, SYS_FILESIZE, fd, 0, 0);
+  CHECK (batch (calls, 5) == 5, "run batch of 5");
+  CHECK (calls[0].result == sizeof data, "write result");
+  CHECK (calls[1].result == sizeof data, "tell result");
+  CHECK (calls[3].result == sizeof data, "read result");
+  CHECK (calls[4].result == sizeof data, "filesize result");
+  CHECK (!memcmp (data, back, sizeof data), "data read back matches");
+
+  set_call (0, SYS_TELL, fd, 0, 0);
+  set_call (1, SYS_BATCH, (unsigned) calls, 1, 0);
+  set_call (2, SYS_TELL, fd, 0, 0);
+  CHECK (batch (calls, 3) == 1, "batch stops at nested batch");
+  CHECK (calls[2].result == -2, "call after stop not run");
+}
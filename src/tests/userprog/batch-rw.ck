@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(batch-rw) begin
+(batch-rw) create "batch"
+(batch-rw) open "batch"
+(batch-rw) run batch of 5
+(batch-rw) write result
+(batch-rw) tell result
+(batch-rw) read result
+(batch-rw) filesize result
+(batch-rw) data read back matches
+(batch-rw) batch stops at nested batch
+(batch-rw) call after stop not run
+(batch-rw) end
+batch-rw: exit(0)
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Child process run by pipe-spawn test.
+
+   Writes bulk data and a short message to descriptor 2. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/pipe-spawn.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-pipe";
+
+static char buf[PIPE_BULK_SIZE];
+
+int
+main (void) 
+{
+  size_t i;
+
+  for (i = 0; i < PIPE_BULK_SIZE; i++)
+    buf[i] = PIPE_BYTE (i);
+  CHECK (write (2, buf, sizeof buf) == (int) sizeof buf,
+         "write %zu bytes", sizeof buf);
+  CHECK (write (2, PIPE_TAIL, strlen (PIPE_TAIL))
+         == (int) strlen (PIPE_TAIL), "write \"%s\"", PIPE_TAIL);
+  CHECK (read (2, buf, 1) == -1, "read from write end fails");
+
+  return 0;
+}
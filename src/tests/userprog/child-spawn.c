@@ -0,0 +1,41 @@
+/* Child process run by spawn-args test.
+
+   Checks the arguments and descriptors it was spawned with. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/userprog/spawn-args.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-spawn";
+
+int
+main (int argc, char *argv[]) 
+{
+  int i;
+
+  msg ("begin");
+  msg ("argc = %d", argc);
+  CHECK (argc == SPAWN_ARGC + 1, "argc is %d", SPAWN_ARGC + 1);
+  for (i = 0; i < SPAWN_ARGC; i++)
+    {
+      char expected[8];
+      snprintf (expected, sizeof expected, "arg%04d", i);
+      if (strcmp (argv[i + 1], expected))
+        fail ("argv[%d] is \"%s\", expected \"%s\"",
+              i + 1, argv[i + 1], expected);
+    }
+  if (argv[argc] != NULL)
+    fail ("argv[argc] is not null");
+  msg ("verified argv");
+
+  if (filesize (2) != -1)
+    fail ("descriptor 2 is open");
+  msg ("descriptor 2 closed");
+  check_file_handle (3, "sample.txt", sample, sizeof sample - 1);
+  msg ("end");
+
+  return 0;
+}
@@ -0,0 +1,72 @@
+/* Starts threads that wait on a futex until released, then add
+   to a counter under a mutex built on futexes, and joins them
+   with wait(). */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITER_CNT 1000
+#define STACK_SIZE 4096
+
+static char stacks[THREAD_CNT][STACK_SIZE];
+static int start;
+static int mutex;
+static int counter;
+
+/* Atomically stores V in *P and returns the old value. */
+static int
+xchg (int *p, int v)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (v), "+m" (*p) : : "memory");
+  return v;
+}
+
+static void
+mutex_lock (void)
+{
+  while (xchg (&mutex, 1) != 0)
+    futex_wait (&mutex, 1);
+}
+
+static void
+mutex_unlock (void)
+{
+  xchg (&mutex, 0);
+  futex_wake (&mutex, 1);
+}
+
+static void
+worker (void *aux)
+{
+  int i;
+
+  while (start == 0)
+    futex_wait (&start, 0);
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      mutex_lock ();
+      counter++;
+      mutex_unlock ();
+    }
+  thread_exit ((int) aux);
+}
+
+void
+test_main (void) 
+{
+  pid_t tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK ((tids[i] = clone (worker, (void *) i, stacks[i] + STACK_SIZE))
+           != PID_ERROR, "clone thread %d", i);
+  xchg (&start, 1);
+  futex_wake (&start, THREAD_CNT);
+  for (i = 0; i < THREAD_CNT; i++)
+    msg ("wait(thread %d) = %d", i, wait (tids[i]));
+  if (counter != THREAD_CNT * ITER_CNT)
+    fail ("counter is %d, not %d", counter, THREAD_CNT * ITER_CNT);
+  msg ("counter is %d", counter);
+}
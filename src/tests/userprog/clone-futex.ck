@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(clone-futex) begin
+(clone-futex) clone thread 0
+(clone-futex) clone thread 1
+(clone-futex) clone thread 2
+(clone-futex) clone thread 3
+(clone-futex) wait(thread 0) = 0
+(clone-futex) wait(thread 1) = 1
+(clone-futex) wait(thread 2) = 2
+(clone-futex) wait(thread 3) = 3
+(clone-futex) counter is 4000
+(clone-futex) end
+clone-futex: exit(0)
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Copies a file of several pages into another with
+   copy_file_range, in two calls, and checks the data, the file
+   positions, and that bad descriptors and overlapping ranges of
+   one file are refused. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (3 * 4096 + 100)
+
+static char buf[SIZE];
+
+void
+test_main (void) 
+{
+  int src, dst;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i * 7 + i / 256;
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((src = open ("src")) > 1, "open \"src\"");
+  CHECK ((dst = open ("dst")) > 1, "open \"dst\"");
+  CHECK (write (src, buf, SIZE) == SIZE, "write \"src\"");
+
+  seek (src, 0);
+  CHECK (copy_file_range (src, dst, 5000) == 5000, "copy 5000 bytes");
+  CHECK (tell (src) == 5000 && tell (dst) == 5000,
+         "positions after first copy");
+  CHECK (copy_file_range (src, dst, SIZE) == SIZE - 5000,
+         "copy the rest");
+  CHECK (copy_file_range (src, dst, 100) == 0, "copy at end of file");
+  CHECK (filesize (dst) == SIZE, "size of \"dst\"");
+  seek (dst, 0);
+  check_file_handle (dst, "dst", buf, SIZE);
+
+  CHECK (copy_file_range (src, 42, 1) == -1, "copy to bad fd");
+  seek (src, 0);
+  seek (dst, 0);
+  CHECK (copy_file_range (src, src, 100) == -1,
+         "copy over the same range");
+}
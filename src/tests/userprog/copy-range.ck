@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-range) begin
+(copy-range) create "src"
+(copy-range) create "dst"
+(copy-range) open "src"
+(copy-range) open "dst"
+(copy-range) write "src"
+(copy-range) copy 5000 bytes
+(copy-range) positions after first copy
+(copy-range) copy the rest
+(copy-range) copy at end of file
+(copy-range) size of "dst"
+(copy-range) verified contents of "dst"
+(copy-range) copy to bad fd
+(copy-range) copy over the same range
+(copy-range) end
+copy-range: exit(0)
+EOF
+pass;
@@ -0,0 +1,52 @@
+/* Grows a file and writes it back with fsync(), overwrites it in
+   place and writes it back with fdatasync(), and checks that the
+   data reads back unchanged afterward.  Then does the same with a
+   file small enough to keep its data inline in its inode. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 5000
+#define SMALL_SIZE 100
+
+static char buf[SIZE];
+static char expected[SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    expected[i] = 'a' + i % 19;
+  CHECK (create ("synced", 0), "create \"synced\"");
+  CHECK ((fd = open ("synced")) > 1, "open \"synced\"");
+  CHECK (write (fd, expected, SIZE) == SIZE, "write \"synced\"");
+  CHECK (fsync (fd), "fsync \"synced\"");
+
+  memcpy (expected + 2000, "overwritten", 11);
+  CHECK (pwrite (fd, "overwritten", 11, 2000) == 11, "overwrite in place");
+  CHECK (fdatasync (fd), "fdatasync \"synced\"");
+  CHECK (filesize (fd) == SIZE, "size of \"synced\"");
+  CHECK (pread (fd, buf, SIZE, 0) == SIZE && !memcmp (buf, expected, SIZE),
+         "data after sync");
+
+  CHECK (create ("small", 0), "create \"small\"");
+  CHECK ((fd = open ("small")) > 1, "open \"small\"");
+  CHECK (write (fd, expected, SMALL_SIZE) == SMALL_SIZE, "write \"small\"");
+  CHECK (fsync (fd), "fsync \"small\"");
+  memcpy (expected + 40, "overwritten", 11);
+  CHECK (pwrite (fd, "overwritten", 11, 40) == 11,
+         "overwrite \"small\" in place");
+  CHECK (fdatasync (fd), "fdatasync \"small\"");
+  CHECK (filesize (fd) == SMALL_SIZE, "size of \"small\"");
+  CHECK (pread (fd, buf, SMALL_SIZE, 0) == SMALL_SIZE
+         && !memcmp (buf, expected, SMALL_SIZE),
+         "data of \"small\" after sync");
+
+  CHECK (!fsync (42), "fsync bad fd");
+  CHECK (!fdatasync (42), "fdatasync bad fd");
+}
@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fsync) begin
+(fsync) create "synced"
+(fsync) open "synced"
+(fsync) write "synced"
+(fsync) fsync "synced"
+(fsync) overwrite in place
+(fsync) fdatasync "synced"
+(fsync) size of "synced"
+(fsync) data after sync
+(fsync) create "small"
+(fsync) open "small"
+(fsync) write "small"
+(fsync) fsync "small"
+(fsync) overwrite "small" in place
+(fsync) fdatasync "small"
+(fsync) size of "small"
+(fsync) data of "small" after sync
+(fsync) fsync bad fd
+(fsync) fdatasync bad fd
+(fsync) end
+fsync: exit(0)
+EOF
+pass;
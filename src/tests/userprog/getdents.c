@@ -0,0 +1,60 @@
+/* Creates a directory of many files, lists it with getdents a
+   few entries at a time, and checks that each file is listed
+   once with its inode number, that "." and ".." are not, and
+   that files are refused. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 40
+#define BATCH 7
+
+void
+test_main (void) 
+{
+  struct dirent ents[BATCH];
+  bool seen[FILE_CNT];
+  int dir_fd, fd, cnt, total = 0;
+  int i;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[32];
+      snprintf (name, sizeof name, "d/f%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+      seen[i] = false;
+    }
+  msg ("created %d files", FILE_CNT);
+
+  CHECK ((dir_fd = open ("d")) > 1, "open \"d\"");
+  while ((cnt = getdents (dir_fd, ents, BATCH)) > 0)
+    for (i = 0; i < cnt; i++)
+      {
+        char name[32];
+        int n;
+
+        if (ents[i].d_name[0] != 'f')
+          fail ("unexpected entry \"%s\"", ents[i].d_name);
+        n = atoi (ents[i].d_name + 1);
+        if (n < 0 || n >= FILE_CNT || seen[n])
+          fail ("bad or repeated entry \"%s\"", ents[i].d_name);
+        seen[n] = true;
+        snprintf (name, sizeof name, "d/%s", ents[i].d_name);
+        fd = open (name);
+        if (fd < 2 || inumber (fd) != ents[i].d_ino)
+          fail ("inumber of \"%s\"", name);
+        close (fd);
+        total++;
+      }
+  CHECK (cnt == 0, "getdents at end of directory");
+  CHECK (total == FILE_CNT, "listed %d files", total);
+
+  CHECK (create ("g", 0), "create \"g\"");
+  CHECK ((fd = open ("g")) > 1, "open \"g\"");
+  CHECK (getdents (fd, ents, BATCH) == -1, "getdents on a file");
+}
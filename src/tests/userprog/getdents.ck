@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getdents) begin
+(getdents) mkdir "d"
+(getdents) created 40 files
+(getdents) open "d"
+(getdents) getdents at end of directory
+(getdents) listed 40 files
+(getdents) create "g"
+(getdents) open "g"
+(getdents) getdents on a file
+(getdents) end
+getdents: exit(0)
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Reads the time many times in a row and checks that it never
+   goes backwards, then that it moves forward while spinning. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CALLS 1000
+
+/* Spin at most this many times waiting for 1 ms to pass. */
+#define SPIN_MAX 100000000
+
+void
+test_main (void)
+{
+  uint64_t start, prev, now;
+  bool monotonic = true;
+  int i;
+
+  start = prev = gettime ();
+  for (i = 0; i < CALLS; i++)
+    {
+      now = gettime ();
+      if (now < prev)
+        monotonic = false;
+      prev = now;
+    }
+  CHECK (monotonic, "time never goes backwards");
+
+  for (i = 0; i < SPIN_MAX; i++)
+    if (gettime () - start >= 1000000)
+      break;
+  CHECK (i < SPIN_MAX, "time advances by 1 ms");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(gettime) begin
+(gettime) time never goes backwards
+(gettime) time advances by 1 ms
+(gettime) end
+gettime: exit(0)
+EOF
+pass;
@@ -0,0 +1,43 @@
+/* Writes a file small enough to be kept inline in its inode,
+   reads it back, then grows it past the inline limit and checks
+   that the data written first survives the move. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SMALL 100
+#define LARGE 1500
+
+static char buf[LARGE];
+static char expected[LARGE];
+
+void
+test_main (void) 
+{
+  static const char zeros[300];
+  int fd;
+  size_t i;
+
+  CHECK (create ("zeros", sizeof zeros), "create \"zeros\"");
+  CHECK ((fd = open ("zeros")) > 1, "open \"zeros\"");
+  CHECK (read (fd, buf, LARGE) == sizeof zeros
+         && !memcmp (buf, zeros, sizeof zeros),
+         "read \"zeros\"");
+  close (fd);
+
+  for (i = 0; i < LARGE; i++)
+    expected[i] = 'A' + i % 26;
+  CHECK (create ("tiny", 0), "create \"tiny\"");
+  CHECK ((fd = open ("tiny")) > 1, "open \"tiny\"");
+  CHECK (write (fd, expected, SMALL) == SMALL, "write %d bytes", SMALL);
+  CHECK (pread (fd, buf, LARGE, 0) == SMALL
+         && !memcmp (buf, expected, SMALL),
+         "read %d bytes", SMALL);
+  CHECK (write (fd, expected + SMALL, LARGE - SMALL) == LARGE - SMALL,
+         "grow to %d bytes", LARGE);
+  CHECK (filesize (fd) == LARGE, "size of \"tiny\"");
+  seek (fd, 0);
+  check_file_handle (fd, "tiny", expected, LARGE);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(inline-grow) begin
+(inline-grow) create "zeros"
+(inline-grow) open "zeros"
+(inline-grow) read "zeros"
+(inline-grow) create "tiny"
+(inline-grow) open "tiny"
+(inline-grow) write 100 bytes
+(inline-grow) read 100 bytes
+(inline-grow) grow to 1500 bytes
+(inline-grow) size of "tiny"
+(inline-grow) verified contents of "tiny"
+(inline-grow) end
+inline-grow: exit(0)
+EOF
+pass;
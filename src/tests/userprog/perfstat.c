@@ -0,0 +1,30 @@
+/* Reads the kernel performance counters around a number of
+   perfstat calls and checks that each call was counted and that
+   no counter went down. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CALLS 10
+
+void
+test_main (void)
+{
+  static struct perfstat before, during, after;
+  bool monotonic = true;
+  int i;
+
+  perfstat (&before);
+  for (i = 0; i < CALLS; i++)
+    perfstat (&during);
+  perfstat (&after);
+
+  CHECK (after.syscalls[SYS_PERFSTAT] - before.syscalls[SYS_PERFSTAT]
+         == CALLS + 1, "%d perfstat calls counted", CALLS + 1);
+  for (i = 0; i < PERF_CNT; i++)
+    if (after.counters[i] < before.counters[i])
+      monotonic = false;
+  CHECK (monotonic, "counters never decrease");
+}
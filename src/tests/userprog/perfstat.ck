@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(perfstat) begin
+(perfstat) 11 perfstat calls counted
+(perfstat) counters never decrease
+(perfstat) end
+perfstat: exit(0)
+EOF
+pass;
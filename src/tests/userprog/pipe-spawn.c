@@ -0,0 +1,44 @@
+/* Spawns a child with the write end of a pipe as its descriptor
+   2 and reads, until end of file, a large write that takes the
+   direct path followed by a small one that is buffered. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/pipe-spawn.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[PIPE_BULK_SIZE + 64];
+
+void
+test_main (void) 
+{
+  char *argv[] = { "child-pipe", NULL };
+  int fds[2];
+  size_t total = 0;
+  size_t i;
+  pid_t pid;
+  int n;
+
+  CHECK (pipe (fds) == 0, "pipe");
+  CHECK ((pid = spawn ("child-pipe", argv, &fds[1], 1)) != PID_ERROR,
+         "spawn child-pipe");
+  close (fds[1]);
+  CHECK (write (fds[0], buf, 1) == -1, "write to read end fails");
+
+  while ((n = read (fds[0], buf + total, sizeof buf - total)) > 0)
+    total += n;
+  CHECK (n == 0, "read until end of file");
+
+  if (total != PIPE_BULK_SIZE + strlen (PIPE_TAIL))
+    fail ("read %zu bytes, expected %zu",
+          total, PIPE_BULK_SIZE + strlen (PIPE_TAIL));
+  for (i = 0; i < PIPE_BULK_SIZE; i++)
+    if (buf[i] != PIPE_BYTE (i))
+      fail ("byte %zu is %d, expected %d", i, buf[i], PIPE_BYTE (i));
+  if (memcmp (buf + PIPE_BULK_SIZE, PIPE_TAIL, strlen (PIPE_TAIL)))
+    fail ("message after the bulk data is wrong");
+  msg ("verified %zu bytes", total);
+
+  msg ("wait(child-pipe) = %d", wait (pid));
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-spawn) begin
+(pipe-spawn) pipe
+(pipe-spawn) spawn child-pipe
+(pipe-spawn) write to read end fails
+(child-pipe) write 12288 bytes
+(child-pipe) write "done"
+(child-pipe) read from write end fails
+child-pipe: exit(0)
+(pipe-spawn) read until end of file
+(pipe-spawn) verified 12292 bytes
+(pipe-spawn) wait(child-pipe) = 0
+(pipe-spawn) end
+pipe-spawn: exit(0)
+EOF
+pass;
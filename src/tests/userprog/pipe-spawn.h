@@ -0,0 +1,11 @@
+#ifndef TESTS_USERPROG_PIPE_SPAWN_H
+#define TESTS_USERPROG_PIPE_SPAWN_H
+
+/* Bytes child-pipe writes in one go, then a short message. */
+#define PIPE_BULK_SIZE (3 * 4096)
+#define PIPE_TAIL "done"
+
+/* Byte I of the bulk data. */
+#define PIPE_BYTE(I) ((char) ((I) % 251))
+
+#endif /* tests/userprog/pipe-spawn.h */
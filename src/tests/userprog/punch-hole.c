@@ -0,0 +1,56 @@
+/* Writes past the end of an empty file and checks that the gap
+   reads as zeros, then punches a hole into a file, checks that
+   it reads as zeros without the length changing, and writes
+   into the hole again. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 6000
+#define HOLE_OFS 1000
+#define HOLE_SIZE 3000
+
+static char buf[SIZE];
+static char expected[SIZE];
+
+void
+test_main (void) 
+{
+  static const char zeros[512];
+  int sparse, fd;
+  size_t i;
+
+  CHECK (create ("sparse", 0), "create \"sparse\"");
+  CHECK ((sparse = open ("sparse")) > 1, "open \"sparse\"");
+  seek (sparse, 100000);
+  CHECK (write (sparse, "end", 3) == 3, "write at offset 100000");
+  CHECK (filesize (sparse) == 100003, "size of \"sparse\"");
+  CHECK (pread (sparse, buf, 512, 0) == 512 && !memcmp (buf, zeros, 512),
+         "gap at offset 0 reads as zeros");
+  CHECK (pread (sparse, buf, 512, 50000) == 512
+         && !memcmp (buf, zeros, 512),
+         "gap at offset 50000 reads as zeros");
+  CHECK (pread (sparse, buf, 3, 100000) == 3 && !memcmp (buf, "end", 3),
+         "data at offset 100000");
+
+  for (i = 0; i < SIZE; i++)
+    expected[i] = 'a' + i % 23;
+  CHECK (create ("punch", 0), "create \"punch\"");
+  CHECK ((fd = open ("punch")) > 1, "open \"punch\"");
+  CHECK (write (fd, expected, SIZE) == SIZE, "write \"punch\"");
+  CHECK (punch_hole (fd, HOLE_OFS, HOLE_SIZE), "punch hole");
+  CHECK (filesize (fd) == SIZE && tell (fd) == SIZE,
+         "size and position after punch");
+  memset (expected + HOLE_OFS, 0, HOLE_SIZE);
+  CHECK (pread (fd, buf, SIZE, 0) == SIZE && !memcmp (buf, expected, SIZE),
+         "hole reads as zeros");
+
+  memcpy (expected + 1500, "refilled", 8);
+  CHECK (pwrite (fd, "refilled", 8, 1500) == 8, "write into hole");
+  CHECK (pread (fd, buf, SIZE, 0) == SIZE && !memcmp (buf, expected, SIZE),
+         "data after writing into hole");
+
+  CHECK (!punch_hole (42, 0, 1), "punch hole in bad fd");
+}
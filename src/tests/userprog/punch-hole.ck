@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(punch-hole) begin
+(punch-hole) create "sparse"
+(punch-hole) open "sparse"
+(punch-hole) write at offset 100000
+(punch-hole) size of "sparse"
+(punch-hole) gap at offset 0 reads as zeros
+(punch-hole) gap at offset 50000 reads as zeros
+(punch-hole) data at offset 100000
+(punch-hole) create "punch"
+(punch-hole) open "punch"
+(punch-hole) write "punch"
+(punch-hole) punch hole
+(punch-hole) size and position after punch
+(punch-hole) hole reads as zeros
+(punch-hole) write into hole
+(punch-hole) data after writing into hole
+(punch-hole) punch hole in bad fd
+(punch-hole) end
+punch-hole: exit(0)
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Writes a file with writev, reads parts of it back with pread
+   and readv, and checks that pread and pwrite leave the file
+   position alone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char hello[] = "Hello, ";
+  char world[] = "world!";
+  struct iovec out[2] = { { hello, 7 }, { world, 6 } };
+  char buf[16], a[5], b[8];
+  struct iovec in[2] = { { a, sizeof a }, { b, sizeof b } };
+  int handle;
+
+  CHECK (create ("test.txt", 13), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (writev (handle, out, 2) == 13, "writev 2 buffers");
+  CHECK (tell (handle) == 13, "position after writev");
+
+  memset (buf, 0, sizeof buf);
+  CHECK (pread (handle, buf, 6, 7) == 6, "pread at offset 7");
+  CHECK (!strcmp (buf, "world!"), "pread data");
+  CHECK (pwrite (handle, "W", 1, 7) == 1, "pwrite at offset 7");
+  CHECK (tell (handle) == 13, "position after pread and pwrite");
+
+  seek (handle, 0);
+  CHECK (readv (handle, in, 2) == 13, "readv 2 buffers");
+  CHECK (!memcmp (a, "Hello", 5) && !memcmp (b, ", World!", 8),
+         "readv data");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rw-vector) begin
+(rw-vector) create "test.txt"
+(rw-vector) open "test.txt"
+(rw-vector) writev 2 buffers
+(rw-vector) position after writev
+(rw-vector) pread at offset 7
+(rw-vector) pread data
+(rw-vector) pwrite at offset 7
+(rw-vector) position after pread and pwrite
+(rw-vector) readv 2 buffers
+(rw-vector) readv data
+(rw-vector) end
+rw-vector: exit(0)
+EOF
+pass;
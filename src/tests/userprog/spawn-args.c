@@ -0,0 +1,33 @@
+/* Spawns a child with more arguments than fit in a page, handing
+   it an open file as its descriptor 3 and leaving descriptor 2
+   closed.  The child checks all of them. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/userprog/spawn-args.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char strings[SPAWN_ARGC][8];
+static char *argv[SPAWN_ARGC + 2];
+
+void
+test_main (void) 
+{
+  int fds[2];
+  int i;
+
+  CHECK ((fds[1] = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  fds[0] = -1;
+
+  argv[0] = "child-spawn";
+  for (i = 0; i < SPAWN_ARGC; i++)
+    {
+      snprintf (strings[i], sizeof strings[i], "arg%04d", i);
+      argv[i + 1] = strings[i];
+    }
+  argv[SPAWN_ARGC + 1] = NULL;
+
+  msg ("wait(spawn()) = %d",
+       wait (spawn ("child-spawn", argv, fds, 2)));
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(spawn-args) begin
+(spawn-args) open "sample.txt"
+(child-spawn) begin
+(child-spawn) argc = 1001
+(child-spawn) argc is 1001
+(child-spawn) verified argv
+(child-spawn) descriptor 2 closed
+(child-spawn) verified contents of "sample.txt"
+(child-spawn) end
+child-spawn: exit(0)
+(spawn-args) wait(spawn()) = 0
+(spawn-args) end
+spawn-args: exit(0)
+EOF
+pass;
@@ -0,0 +1,7 @@
+#ifndef TESTS_USERPROG_SPAWN_ARGS_H
+#define TESTS_USERPROG_SPAWN_ARGS_H
+
+/* Arguments spawn-args passes after the program name. */
+#define SPAWN_ARGC 1000
+
+#endif /* tests/userprog/spawn-args.h */
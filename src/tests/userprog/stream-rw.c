@@ -0,0 +1,51 @@
+/* Writes a file one character at a time through a buffered
+   stream, checking that it took only a few write system calls,
+   then reads it back one character at a time. */
+
+#include <perfstat.h>
+#include <stdio.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 1000
+
+/* Returns the number of write system calls made so far. */
+static long long
+write_cnt (void)
+{
+  static struct perfstat st;
+
+  perfstat (&st);
+  return st.syscalls[SYS_WRITE];
+}
+
+void
+test_main (void)
+{
+  long long writes;
+  bool closed;
+  FILE *f;
+  int i;
+
+  CHECK (create ("stream", 0), "create \"stream\"");
+  CHECK ((f = fdopen (open ("stream"), "w")) != NULL, "fdopen \"stream\"");
+  writes = write_cnt ();
+  for (i = 0; i < SIZE; i++)
+    if (fputc ('a' + i % 26, f) == EOF)
+      fail ("fputc failed");
+  closed = fclose (f) == 0;
+  writes = write_cnt () - writes;
+  CHECK (closed, "fclose \"stream\"");
+  if (writes > (SIZE + BUFSIZ - 1) / BUFSIZ)
+    fail ("%lld writes for %d bytes", writes, SIZE);
+  msg ("few writes");
+
+  CHECK ((f = fdopen (open ("stream"), "r")) != NULL, "fdopen \"stream\"");
+  for (i = 0; i < SIZE; i++)
+    if (fgetc (f) != 'a' + i % 26)
+      fail ("byte %d differs", i);
+  CHECK (fgetc (f) == EOF && feof (f), "end of file");
+  CHECK (fclose (f) == 0, "fclose \"stream\"");
+}
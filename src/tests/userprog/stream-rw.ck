@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(stream-rw) begin
+(stream-rw) create "stream"
+(stream-rw) fdopen "stream"
+(stream-rw) fclose "stream"
+(stream-rw) few writes
+(stream-rw) fdopen "stream"
+(stream-rw) end of file
+(stream-rw) fclose "stream"
+(stream-rw) end
+stream-rw: exit(0)
+EOF
+pass;
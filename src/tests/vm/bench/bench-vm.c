@@ -0,0 +1,155 @@
+/* Virtual memory benchmark.
+
+   Usage: NAME PATTERN PAGES ACCESSES PROCS
+
+   Touches PAGES pages once to bring them in, then makes ACCESSES
+   accesses to them in PATTERN, which is "seq" for a sequential
+   sweep, "random" for uniformly random pages, or "zipf" for
+   pages drawn from a Zipf distribution.  With PROCS greater than
+   1, runs PROCS copies of itself at once instead and measures
+   them together.  The user pool size is fixed by the makefile,
+   so working sets larger than it make the kernel swap. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/bench.h"
+#include "tests/lib.h"
+
+#define PAGE_SIZE 4096
+#define MAX_PAGES 512
+#define MAX_PROCS 8
+
+/* Zipf weights are scaled by this much. */
+#define ZIPF_SCALE (1 << 20)
+
+static char pages[MAX_PAGES][PAGE_SIZE];
+
+/* For the Zipf pattern, the pages in order of popularity, and
+   the running sums of their weights. */
+static unsigned short zipf_page[MAX_PAGES];
+static unsigned long zipf_sum[MAX_PAGES];
+
+/* Sets up the Zipf distribution over PAGE_CNT pages, in which
+   the page of rank I is picked with weight 1 / (I + 1).  The
+   ranks are given to the pages in random order, so that hot
+   pages are not neighbours. */
+static void
+zipf_init (size_t page_cnt)
+{
+  unsigned long sum = 0;
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      zipf_page[i] = i;
+      sum += ZIPF_SCALE / (i + 1);
+      zipf_sum[i] = sum;
+    }
+  shuffle (zipf_page, page_cnt, sizeof *zipf_page);
+}
+
+/* Returns a page drawn from the Zipf distribution over PAGE_CNT
+   pages. */
+static size_t
+zipf_next (size_t page_cnt)
+{
+  unsigned long x = random_ulong () % zipf_sum[page_cnt - 1];
+  size_t lo = 0, hi = page_cnt - 1;
+
+  /* Find the first running sum above X. */
+  while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      if (zipf_sum[mid] > x)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+  return zipf_page[lo];
+}
+
+/* Makes ACCESS_CNT accesses to PAGE_CNT pages in PATTERN. */
+static void
+run (const char *pattern, size_t page_cnt, size_t access_cnt)
+{
+  struct bench b;
+  char name[32];
+  size_t i;
+
+  bench_start (&b, "populate");
+  for (i = 0; i < page_cnt; i++)
+    pages[i][0] = i;
+  bench_stop (&b, page_cnt, page_cnt * PAGE_SIZE);
+
+  if (!strcmp (pattern, "zipf"))
+    zipf_init (page_cnt);
+  else if (strcmp (pattern, "seq") && strcmp (pattern, "random"))
+    fail ("unknown pattern \"%s\"", pattern);
+
+  snprintf (name, sizeof name, "%s-%zu", pattern, page_cnt);
+  bench_start (&b, name);
+  for (i = 0; i < access_cnt; i++)
+    {
+      size_t page;
+
+      if (pattern[0] == 's')
+        page = i % page_cnt;
+      else if (pattern[0] == 'r')
+        page = random_ulong () % page_cnt;
+      else
+        page = zipf_next (page_cnt);
+      pages[page][i % PAGE_SIZE]++;
+    }
+  bench_stop (&b, access_cnt, 0);
+}
+
+/* Runs PROC_CNT processes, each running the benchmark. */
+static void
+run_parallel (const char *pattern, size_t page_cnt, size_t access_cnt,
+              size_t proc_cnt)
+{
+  pid_t pids[MAX_PROCS];
+  struct bench b;
+  char cmd_line[128];
+  size_t i;
+
+  snprintf (cmd_line, sizeof cmd_line, "%s %s %zu %zu 1",
+            test_name, pattern, page_cnt, access_cnt);
+  bench_start (&b, "parallel");
+  for (i = 0; i < proc_cnt; i++)
+    if ((pids[i] = exec (cmd_line)) == PID_ERROR)
+      fail ("exec \"%s\" failed", cmd_line);
+  for (i = 0; i < proc_cnt; i++)
+    if (wait (pids[i]) != 0)
+      fail ("process %zu of %zu failed", i + 1, proc_cnt);
+  bench_stop (&b, proc_cnt * access_cnt, 0);
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t page_cnt, access_cnt, proc_cnt;
+
+  test_name = argv[0];
+  if (argc != 5)
+    fail ("usage: %s PATTERN PAGES ACCESSES PROCS", argv[0]);
+  page_cnt = atoi (argv[2]);
+  access_cnt = atoi (argv[3]);
+  proc_cnt = atoi (argv[4]);
+  if (page_cnt < 1 || page_cnt > MAX_PAGES)
+    fail ("PAGES must be between 1 and %d", MAX_PAGES);
+  if (proc_cnt < 1 || proc_cnt > MAX_PROCS)
+    fail ("PROCS must be between 1 and %d", MAX_PROCS);
+
+  msg ("begin");
+  random_init (0);
+  if (proc_cnt == 1)
+    run (argv[1], page_cnt, access_cnt);
+  else
+    run_parallel (argv[1], page_cnt, access_cnt, proc_cnt);
+  msg ("end");
+  return 0;
+}
@@ -0,0 +1,49 @@
+/* Saves the process with checkpoint() and then runs the image
+   with exec().  The resumed process must get 1 from checkpoint()
+   and find its memory and an open file's position as they were
+   when it was saved, even though the saving process has since
+   cleared its memory. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  char data[3];
+  pid_t child;
+  size_t i;
+  int result;
+  int fd;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, "0123456789", 10) == 10, "write \"data\"");
+  seek (fd, 4);
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  result = checkpoint ("image");
+  if (result == 1)
+    {
+      msg ("resumed from \"image\"");
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != (char) (i % 251))
+          fail ("resumed process sees byte %zu wrong", i);
+      CHECK (tell (fd) == 4, "tell \"data\"");
+      CHECK (read (fd, data, 3) == 3 && !memcmp (data, "456", 3),
+             "read \"data\"");
+      exit (81);
+    }
+  CHECK (result == 0, "checkpoint \"image\"");
+
+  memset (buf, 0, SIZE);
+  child = exec ("image");
+  CHECK (wait (child) == 81, "exec \"image\" and wait for it");
+}
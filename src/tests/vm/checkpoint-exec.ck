@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(checkpoint-exec) begin
+(checkpoint-exec) create "data"
+(checkpoint-exec) open "data"
+(checkpoint-exec) write "data"
+(checkpoint-exec) checkpoint "image"
+(checkpoint-exec) resumed from "image"
+(checkpoint-exec) tell "data"
+(checkpoint-exec) read "data"
+(checkpoint-exec) exec "image" and wait for it
+(checkpoint-exec) end
+EOF
+pass;
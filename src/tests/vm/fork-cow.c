@@ -0,0 +1,36 @@
+/* Forks a child that shares a large buffer copy-on-write with its
+   parent.  The child overwrites half of the buffer, and each
+   process must see only its own writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (128 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  memset (buf, 'a', SIZE);
+  child = fork ();
+  if (child == 0)
+    {
+      memset (buf, 'b', SIZE / 2);
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != (i < SIZE / 2 ? 'b' : 'a'))
+          fail ("child sees byte %zu wrong", i);
+      exit (81);
+    }
+  CHECK (child != -1, "fork");
+  CHECK (wait (child) == 81, "wait for child");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 'a')
+      fail ("parent sees byte %zu changed", i);
+  msg ("parent's buffer is intact");
+}
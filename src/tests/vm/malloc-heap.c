@@ -0,0 +1,75 @@
+/* Allocates blocks of many sizes with the user malloc(), checks
+   that none overlaps another by filling each with its own byte,
+   resizes some with realloc(), frees half one at a time and the
+   rest with free_bulk(), and checks that the heap shrank back to
+   about where it started. */
+
+#include <malloc.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 256
+
+static void *blocks[BLOCK_CNT];
+static size_t sizes[BLOCK_CNT];
+
+/* Checks that block I holds SIZE bytes of its own fill byte. */
+static void
+check_block (int i, size_t size)
+{
+  const unsigned char *p = blocks[i];
+  size_t j;
+
+  for (j = 0; j < size; j++)
+    if (p[j] != (unsigned char) i)
+      fail ("block %d byte %zu is %#x", i, j, p[j]);
+}
+
+void
+test_main (void)
+{
+  char *start = sbrk (0);
+  size_t grown;
+  int i;
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      sizes[i] = i % 16 == 15 ? 12345 + i : 1 + (i * 37) % 3000;
+      blocks[i] = malloc (sizes[i]);
+      if (blocks[i] == NULL)
+        fail ("malloc of %zu bytes failed", sizes[i]);
+      memset (blocks[i], i, sizes[i]);
+    }
+  for (i = 0; i < BLOCK_CNT; i++)
+    check_block (i, sizes[i]);
+  msg ("allocated %d blocks", BLOCK_CNT);
+
+  for (i = 0; i < BLOCK_CNT; i += 8)
+    {
+      blocks[i] = realloc (blocks[i], sizes[i] * 3);
+      if (blocks[i] == NULL)
+        fail ("realloc failed");
+      check_block (i, sizes[i]);
+      memset (blocks[i], i, sizes[i] * 3);
+      sizes[i] *= 3;
+    }
+  for (i = 0; i < BLOCK_CNT; i++)
+    check_block (i, sizes[i]);
+  msg ("resized blocks kept their data");
+
+  grown = (char *) sbrk (0) - start;
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    {
+      free (blocks[i]);
+      blocks[i] = NULL;
+    }
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    check_block (i, sizes[i]);
+  free_bulk (blocks, BLOCK_CNT);
+  msg ("freed all blocks");
+
+  CHECK ((size_t) ((char *) sbrk (0) - start) < grown / 4,
+         "heap shrank after freeing");
+}
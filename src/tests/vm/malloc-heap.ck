@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-heap) begin
+(malloc-heap) allocated 256 blocks
+(malloc-heap) resized blocks kept their data
+(malloc-heap) freed all blocks
+(malloc-heap) heap shrank after freeing
+(malloc-heap) end
+malloc-heap: exit(0)
+EOF
+pass;
@@ -0,0 +1,29 @@
+/* Touches pages of a new heap and checks that the process's
+   resident set grows by as many pages, then gives the heap back
+   and checks that the resident set shrinks again. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 32
+
+void
+test_main (void)
+{
+  struct memstat before, during, after;
+  char *heap;
+
+  memstat (&before);
+  heap = sbrk (PAGES * 4096);
+  CHECK (heap != (void *) -1, "grow heap");
+  memset (heap, 'x', PAGES * 4096);
+  memstat (&during);
+  CHECK (during.resident >= before.resident + PAGES,
+         "resident set grows by %d pages", PAGES);
+  CHECK (sbrk (-PAGES * 4096) == heap + PAGES * 4096, "shrink heap");
+  memstat (&after);
+  CHECK (after.resident + PAGES <= during.resident,
+         "resident set shrinks by %d pages", PAGES);
+}
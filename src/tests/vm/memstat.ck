@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(memstat) begin
+(memstat) grow heap
+(memstat) resident set grows by 32 pages
+(memstat) shrink heap
+(memstat) resident set shrinks by 32 pages
+(memstat) end
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Grows the heap with sbrk, checks that the new memory reads as
+   zeros and keeps what is written to it, then shrinks and grows
+   it again and checks that the pages given back come back
+   zeroed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+void
+test_main (void)
+{
+  char *heap, *p;
+  size_t i;
+
+  heap = sbrk (SIZE);
+  CHECK (heap != (void *) -1, "grow heap");
+  CHECK (sbrk (0) == heap + SIZE, "break moved");
+  for (i = 0; i < SIZE; i++)
+    if (heap[i] != 0)
+      fail ("byte %zu of new heap is nonzero", i);
+  memset (heap, 'x', SIZE);
+
+  CHECK (sbrk (-SIZE / 2) == heap + SIZE, "shrink heap");
+  p = sbrk (SIZE / 2);
+  CHECK (p == heap + SIZE / 2, "grow heap again");
+  for (i = 0; i < SIZE / 2; i++)
+    if (heap[i] != 'x')
+      fail ("byte %zu of kept heap changed", i);
+  for (i = SIZE / 2; i < SIZE; i++)
+    if (heap[i] != 0)
+      fail ("byte %zu of regrown heap is nonzero", i);
+
+  CHECK (sbrk (-2 * SIZE) == (void *) -1, "shrink below heap start");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sbrk-heap) begin
+(sbrk-heap) grow heap
+(sbrk-heap) break moved
+(sbrk-heap) shrink heap
+(sbrk-heap) grow heap again
+(sbrk-heap) shrink below heap start
+(sbrk-heap) end
+EOF
+pass;
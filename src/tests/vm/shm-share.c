@@ -0,0 +1,44 @@
+/* Maps a shared memory segment and forks a child, which does not
+   inherit the mapping but maps the segment by name itself.  The
+   child sees the parent's data and overwrites half of it, and
+   the parent must see the child's writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+#define ADDR ((char *) 0x10000000)
+
+void
+test_main (void)
+{
+  mapid_t map;
+  pid_t child;
+  size_t i;
+
+  CHECK ((map = shm_map ("shm-share", SIZE, ADDR)) != MAP_FAILED,
+         "shm_map \"shm-share\"");
+  memset (ADDR, 'a', SIZE);
+  child = fork ();
+  if (child == 0)
+    {
+      if (shm_map ("shm-share", SIZE * 2, ADDR + SIZE) != MAP_FAILED)
+        fail ("mapped more than the segment holds");
+      if (shm_map ("shm-share", SIZE, ADDR) == MAP_FAILED)
+        fail ("child cannot map the segment");
+      for (i = 0; i < SIZE; i++)
+        if (ADDR[i] != 'a')
+          fail ("child sees byte %zu wrong", i);
+      memset (ADDR, 'b', SIZE / 2);
+      exit (81);
+    }
+  CHECK (child != -1, "fork");
+  CHECK (wait (child) == 81, "wait for child");
+  for (i = 0; i < SIZE; i++)
+    if (ADDR[i] != (i < SIZE / 2 ? 'b' : 'a'))
+      fail ("parent sees byte %zu wrong", i);
+  msg ("parent sees the child's writes");
+  munmap (map);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(shm-share) begin
+(shm-share) shm_map "shm-share"
+(shm-share) fork
+(shm-share) wait for child
+(shm-share) parent sees the child's writes
+(shm-share) end
+EOF
+pass;
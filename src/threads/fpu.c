@@ -0,0 +1,206 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* The kernel is compiled with -msoft-float and never touches the
+   FPU, so FPU and SSE state belongs to user threads alone, and is
+   switched lazily.  Switching to a thread other than the one
+   whose state is loaded sets CR0.TS, making its first FPU
+   instruction raise #NM.  The #NM handler saves the loaded state
+   into its owner's area and loads the current thread's, so a
+   thread that never uses the FPU never pays for it. */
+
+/* CR0 and CR4 bits. */
+#define CR0_MP 0x00000002       /* Monitor coprocessor. */
+#define CR0_EM 0x00000004       /* Emulation. */
+#define CR0_TS 0x00000008       /* Task switched. */
+#define CR0_NE 0x00000020       /* Native FPU error reporting. */
+#define CR4_OSFXSR 0x00000200   /* FXSAVE/FXRSTOR and SSE enabled. */
+#define CR4_OSXMMEXCPT 0x00000400 /* SSE exceptions raise #XF. */
+
+/* CPUID leaf 1 EDX bits. */
+#define CPUID_FXSR (1u << 24)
+#define CPUID_SSE (1u << 25)
+
+/* Size of an FXSAVE area, which must be 16-byte aligned, and of
+   an FNSAVE area. */
+#define FXSAVE_SIZE 512
+#define FNSAVE_SIZE 108
+
+/* Default MXCSR: all SSE exceptions masked. */
+#define MXCSR_DEFAULT 0x1f80
+
+/* Use FXSAVE/FXRSTOR, which also cover SSE state? */
+static bool use_fxsr;
+
+/* Thread whose state is in the FPU, or a null pointer. */
+static struct thread *fpu_owner;
+
+static intr_handler_func fpu_fault;
+
+/* Returns CR0. */
+static inline uint32_t
+read_cr0 (void)
+{
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+/* Sets CR0 to CR0. */
+static inline void
+write_cr0 (uint32_t cr0)
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0));
+}
+
+/* Returns the 16-byte aligned save area of T. */
+static inline void *
+fpu_area (struct thread *t)
+{
+  return (void *) (((uintptr_t) t->fpu + 15) & ~(uintptr_t) 15);
+}
+
+/* Enables the FPU, and SSE if the CPU has it, with lazy state
+   switching. */
+void
+fpu_init (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1));
+  use_fxsr = (edx & CPUID_FXSR) != 0;
+  if (use_fxsr)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      cr4 |= CR4_OSFXSR;
+      if (edx & CPUID_SSE)
+        cr4 |= CR4_OSXMMEXCPT;
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+    }
+
+  write_cr0 ((read_cr0 () & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+  intr_register_int (7, 0, INTR_ON, fpu_fault,
+                     "#NM Device Not Available Exception");
+}
+
+/* Called by the scheduler, with interrupts off, when thread T
+   starts running.  Lets T use the FPU directly if its state is
+   loaded and makes it trap otherwise. */
+void
+fpu_switch (struct thread *t)
+{
+  uint32_t cr0 = read_cr0 ();
+  uint32_t new_cr0 = t == fpu_owner ? cr0 & ~CR0_TS : cr0 | CR0_TS;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (new_cr0 != cr0)
+    write_cr0 (new_cr0);
+}
+
+/* Releases the FPU state of the running thread, which is
+   exiting. */
+void
+fpu_exit (void)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (fpu_owner == t)
+    fpu_owner = NULL;
+  intr_set_level (old_level);
+
+  free (t->fpu);
+  t->fpu = NULL;
+}
+
+/* Gives the running thread, just forked, a copy of the FPU state
+   of PARENT.  Returns false if memory allocation fails. */
+bool
+fpu_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  size_t size = use_fxsr ? FXSAVE_SIZE : FNSAVE_SIZE;
+  enum intr_level old_level;
+
+  if (parent->fpu == NULL)
+    return true;
+  t->fpu = malloc (size + 15);
+  if (t->fpu == NULL)
+    return false;
+
+  old_level = intr_disable ();
+  if (fpu_owner == parent)
+    {
+      /* Save the loaded state, which stays loaded.  FNSAVE
+         reinitializes the FPU, so reload it after. */
+      asm volatile ("clts");
+      if (use_fxsr)
+        asm volatile ("fxsave %0"
+                      : "=m" (*(char *) fpu_area (parent)) : : "memory");
+      else
+        asm volatile ("fnsave %0; frstor %0"
+                      : "+m" (*(char *) fpu_area (parent)) : : "memory");
+      write_cr0 (read_cr0 () | CR0_TS);
+    }
+  memcpy (fpu_area (t), fpu_area (parent), size);
+  intr_set_level (old_level);
+
+  return true;
+}
+
+/* #NM handler: the running thread used the FPU while its state
+   was not loaded.  Saves the loaded state, if any, then loads
+   the running thread's, giving it a fresh one on first use. */
+static void
+fpu_fault (struct intr_frame *f UNUSED)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+  bool fresh = t->fpu == NULL;
+
+  if (fresh)
+    {
+      t->fpu = malloc ((use_fxsr ? FXSAVE_SIZE : FNSAVE_SIZE) + 15);
+      if (t->fpu == NULL)
+        PANIC ("out of memory for FPU state of %s", t->name);
+    }
+
+  old_level = intr_disable ();
+  asm volatile ("clts");
+  if (fpu_owner != t)
+    {
+      if (fpu_owner != NULL)
+        {
+          if (use_fxsr)
+            asm volatile ("fxsave %0"
+                          : "=m" (*(char *) fpu_area (fpu_owner)) : : "memory");
+          else
+            asm volatile ("fnsave %0"
+                          : "=m" (*(char *) fpu_area (fpu_owner)) : : "memory");
+        }
+      if (fresh)
+        {
+          uint32_t mxcsr = MXCSR_DEFAULT;
+          asm volatile ("fninit");
+          if (use_fxsr)
+            asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+        }
+      else if (use_fxsr)
+        asm volatile ("fxrstor %0" : : "m" (*(char *) fpu_area (t)));
+      else
+        asm volatile ("frstor %0" : : "m" (*(char *) fpu_area (t)));
+      fpu_owner = t;
+    }
+  intr_set_level (old_level);
+}
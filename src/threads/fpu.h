@@ -0,0 +1,13 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+
+struct thread;
+
+void fpu_init (void);
+void fpu_switch (struct thread *);
+void fpu_exit (void);
+bool fpu_fork (struct thread *parent);
+
+#endif /* threads/fpu.h */
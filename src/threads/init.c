@@ -13,16 +13,26 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/perf.h"
+#include "threads/poll.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
+#include "userprog/aio.h"
 #include "userprog/exception.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
@@ -31,14 +41,27 @@
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/cache.h"
+#include "filesys/defrag.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/volume.h"
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/shm.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 #endif
 
+/* Global page support: CPUID leaf 1 EDX bit and CR4 bit. */
+#define CPUID_PGE (1u << 13)
+#define CR4_PGE 0x00000080
+
+/* 4 MB page support: CPUID leaf 1 EDX bit and CR4 bit. */
+#define CPUID_PSE (1u << 3)
+#define CR4_PSE 0x00000010
+
 /* Amount of physical memory, in 4 kB pages. */
 size_t ram_pages;
 
@@ -48,6 +71,16 @@ uint32_t *base_page_dir;
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
+
+/* -tmpfs: Directory to mount a tmpfs on, or null. */
+static const char *tmpfs_dir;
+
+/* -mount: Disks to mount, each as "hdC:D:DIR". */
+#define MOUNT_OPT_MAX 2
+static const char *mount_opts[MOUNT_OPT_MAX];
+static size_t mount_opt_cnt;
+
+static void mount_disks (void);
 #endif
 
 /* -q: Power off after kernel tasks complete? */
@@ -58,6 +91,7 @@ static void paging_init (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
+static enum log_level parse_log_level (const char *);
 static void run_actions (char **argv);
 static void usage (void);
 
@@ -93,6 +127,8 @@ main (void)
   paging_init ();
 #ifdef VM
   frame_table_init ();
+  suppl_pt_init ();
+  shm_init ();
 #endif
 
   /* Segmentation. */
@@ -103,25 +139,47 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  fpu_init ();
   timer_init ();
+  profile_init ();
+  trace_init ();
+  poll_init ();
+  rcu_init ();
   kbd_init ();
   input_init ();
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  futex_init ();
+  process_table_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_system_init ();
   serial_init_queue ();
   timer_calibrate ();
+#ifdef USERPROG
+  process_init ();
+  aio_init ();
+#endif
 
 #ifdef FILESYS
   /* Initialize file system. */
   disk_init ();
   filesys_init (format_filesys);
+  if (tmpfs_dir != NULL)
+    {
+      filesys_mkdir (tmpfs_dir);
+      if (!filesys_mount_tmpfs (tmpfs_dir))
+        PANIC ("can't mount tmpfs on %s", tmpfs_dir);
+    }
+  mount_disks ();
 #ifdef VM
   swap_table_init ();
+  frame_pageout_init ();
+  frame_merge_init ();
+  frame_age_init ();
 #endif
 #endif
 
@@ -161,14 +219,34 @@ ram_init (void)
    At the time this function is called, the active page table
    (set up by loader.S) only maps the first 4 MB of RAM, so we
    should not try to use extravagant amounts of memory.
-   Fortunately, there is no need to do so. */
+   Fortunately, there is no need to do so.
+
+   If the CPU supports them, each 4 MB of RAM that holds none of
+   the kernel's text, which must stay read-only, is mapped by a
+   single 4 MB page, which takes no page table and one TLB entry
+   instead of 1024.  See [IA32-v3a] 3.7.3 "Mixing 4-KByte and
+   4-MByte Pages". */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
+  uint32_t eax, ebx, ecx, edx;
   size_t page;
   extern char _start, _end_kernel_text;
 
+  asm volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1));
+
+  /* 4 MB pages must be enabled before a page directory uses
+     them. */
+  bool pse = (edx & CPUID_PSE) != 0;
+  if (pse)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
+
   pd = base_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < ram_pages; page++) 
@@ -179,13 +257,21 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (pse && pte_idx == 0 && ram_pages - page >= PTSPAN / PGSIZE
+          && (vaddr + PTSPAN <= &_start || &_end_kernel_text <= vaddr))
+        {
+          pd[pde_idx] = pde_create_kernel_large (vaddr) | PTE_G;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | PTE_G;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -194,6 +280,17 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)));
+
+  /* Kernel mappings are the same in every page directory and
+     never change, so if the CPU supports it they are marked
+     global and survive the TLB flush of a CR3 load.  See
+     [IA32-v3a] 3.12 "Translation Lookaside Buffers (TLBs)". */
+  if (edx & CPUID_PGE)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE));
+    }
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -249,14 +346,84 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-cache"))
+        buffer_cache_size = atoi (value);
+      else if (!strcmp (name, "-block"))
+        filesys_block_sectors = atoi (value) / DISK_SECTOR_SIZE;
+      else if (!strcmp (name, "-raid0"))
+        volume_chunk_sectors = atoi (value) / DISK_SECTOR_SIZE;
+      else if (!strcmp (name, "-write-through"))
+        disk_write_cache = false;
+      else if (!strcmp (name, "-defrag"))
+        defrag_interval = atoi (value);
+      else if (!strcmp (name, "-flush-idle"))
+        buffer_cache_flush_idle = atoi (value);
+      else if (!strcmp (name, "-ramdisk"))
+        {
+          /* A new RAM disk holds no file system yet. */
+          disk_ram_kb[0][1] = atoi (value);
+          format_filesys = true;
+        }
+      else if (!strcmp (name, "-tmpfs"))
+        tmpfs_dir = value;
+      else if (!strcmp (name, "-mount"))
+        {
+          if (mount_opt_cnt >= MOUNT_OPT_MAX)
+            PANIC ("too many -mount options");
+          mount_opts[mount_opt_cnt++] = value;
+        }
+#ifdef VM
+      else if (!strcmp (name, "-ramswap"))
+        disk_ram_kb[1][1] = atoi (value);
+      else if (!strcmp (name, "-cache-max"))
+        buffer_cache_max = atoi (value);
+#endif
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-loops"))
+        timer_loops = atoi (value);
+      else if (!strcmp (name, "-slice"))
+        thread_slice[SCHED_NORMAL] = thread_slice[SCHED_IDLE] = atoi (value);
+      else if (!strcmp (name, "-rt-slice"))
+        thread_slice[SCHED_RR] = atoi (value);
+      else if (!strcmp (name, "-boost"))
+        thread_boost = atoi (value);
+      else if (!strcmp (name, "-lockstat"))
+        lock_profile = true;
+      else if (!strcmp (name, "-profile"))
+        profile_samples = atoi (value);
+      else if (!strcmp (name, "-trace"))
+        trace_records = atoi (value);
+      else if (!strcmp (name, "-irqoff"))
+        intr_trace_windows = atoi (value);
+      else if (!strcmp (name, "-headless"))
+        vga_disabled = true;
+      else if (!strcmp (name, "-log"))
+        log_level = parse_log_level (value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-swap"))
+        swap_disk_names = value;
+      else if (!strcmp (name, "-zswap"))
+        zswap_pages = atoi (value);
+      else if (!strcmp (name, "-rss-soft"))
+        frame_rss_soft = atoi (value);
+      else if (!strcmp (name, "-rss-hard"))
+        frame_rss_hard = atoi (value);
+      else if (!strcmp (name, "-merge"))
+        frame_merge_rate = atoi (value);
+      else if (!strcmp (name, "-stack"))
+        suppl_pt_stack_pages = atoi (value);
+      else if (!strcmp (name, "-startup"))
+        startup_profile_ms = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -265,6 +432,19 @@ parse_options (char **argv)
   return argv;
 }
 
+/* Returns the log level named NAME, panicking if there is none. */
+static enum log_level
+parse_log_level (const char *name) 
+{
+  static const char *names[] = {"err", "warn", "info", "debug"};
+  size_t i;
+
+  for (i = 0; i < sizeof names / sizeof *names; i++)
+    if (name != NULL && !strcmp (name, names[i]))
+      return i;
+  PANIC ("unknown log level `%s' (use -h for help)", name);
+}
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -301,6 +481,7 @@ run_actions (char **argv)
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
+      {"snapshot", 3, fsutil_snapshot},
       {"put", 2, fsutil_put},
       {"get", 2, fsutil_get},
 #endif
@@ -331,6 +512,32 @@ run_actions (char **argv)
   
 }
 
+#ifdef FILESYS
+/* Mounts the disks named by -mount options, creating each mount
+   point if needed, and formatting each disk if -f was given.
+   Panics if one cannot be mounted. */
+static void
+mount_disks (void)
+{
+  size_t i;
+
+  for (i = 0; i < mount_opt_cnt; i++)
+    {
+      const char *opt = mount_opts[i] != NULL ? mount_opts[i] : "";
+      const char *dir;
+
+      if (memcmp (opt, "hd", 2)
+          || opt[2] < '0' || opt[2] > '1' || opt[3] != ':'
+          || opt[4] < '0' || opt[4] > '1' || opt[5] != ':' || opt[6] == '\0')
+        PANIC ("-mount needs hdC:D:DIR, not \"%s\"", opt);
+      dir = opt + 6;
+      filesys_mkdir (dir);
+      if (!filesys_mount (dir, opt[2] - '0', opt[4] - '0', format_filesys))
+        PANIC ("can't mount hd%c:%c on %s", opt[2], opt[4], dir);
+    }
+}
+#endif
+
 /* Prints a kernel command line help message and powers off the
    machine. */
 static void
@@ -349,6 +556,7 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  snapshot DIR SNAP  Snapshot DIR as new directory SNAP.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  put FILE           Put FILE into file system from scratch disk.\n"
           "  get FILE           Get FILE from file system into scratch disk.\n"
@@ -356,11 +564,49 @@ usage (void)
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
           "  -q                 Power off VM after actions or on panic.\n"
-          "  -f                 Format file system disk during startup.\n"
+          "  -f                 Format file system disks during startup.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Skip timer interrupts while idle.\n"
+          "  -loops=LOOPS       Skip timer calibration, using LOOPS loops/s.\n"
+          "  -slice=TICKS       Give time-sharing threads TICKS-tick slices.\n"
+          "  -rt-slice=TICKS    Give round-robin real-time threads TICKS.\n"
+          "  -boost=LEVELS      Raise threads woken from I/O by LEVELS.\n"
+          "  -lockstat          Collect lock statistics by lock class.\n"
+          "  -profile=SAMPLES   Keep the last SAMPLES profiler samples.\n"
+          "  -trace=RECORDS     Keep the last RECORDS trace records.\n"
+          "  -irqoff=COUNT      Keep the COUNT longest interrupts-off times.\n"
+          "  -headless          Turn off VGA output, leaving the serial port.\n"
+          "  -log=LEVEL         Print messages up to LEVEL: err, warn, info,\n"
+          "                     or debug.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -swap=DISKS        Stripe swap over DISKS, e.g. hd1:0,hd1:1.\n"
+          "  -zswap=PAGES       Keep up to PAGES pages of compressed swap.\n"
+          "  -rss-soft=PAGES    Evict first from processes over PAGES pages.\n"
+          "  -rss-hard=PAGES    Limit each process to PAGES resident pages.\n"
+          "  -merge=PAGES       Scan PAGES pages a second to merge identical\n"
+          "                     ones.\n"
+          "  -stack=PAGES       Limit each process's stack to PAGES pages.\n"
+          "  -startup=MS        Prefetch what programs touch in their first\n"
+          "                     MS ms.\n"
+#endif
+#ifdef FILESYS
+          "  -cache=SECTORS     Set buffer cache size to SECTORS sectors.\n"
+          "  -block=BYTES       Format file system with BYTES-byte blocks.\n"
+          "  -raid0=BYTES       Stripe file system over hd0:1 and hd1:0.\n"
+          "  -write-through     Turn off disk write caches.\n"
+          "  -defrag=SECS       Defragment files every SECS s while idle.\n"
+          "  -flush-idle=MS     Write back once disks are idle for MS ms.\n"
+          "  -ramdisk=KB        Format a KB kB RAM disk as file system.\n"
+          "  -tmpfs=DIR         Mount a memory file system on DIR.\n"
+          "  -mount=hdC:D:DIR   Mount the file system on disk hdC:D on DIR.\n"
+#ifdef VM
+          "  -ramswap=KB        Swap to a KB kB RAM disk.\n"
+          "  -cache-max=SECTORS Let buffer cache grow up to SECTORS sectors.\n"
+#endif
 #endif
           );
   power_off ();
@@ -397,12 +643,21 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  palloc_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
+#endif
+#ifdef VM
+  swap_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+  perf_print_stats ();
+  lock_print_stats ();
+  profile_print_stats ();
+  trace_print_stats ();
+  intr_print_stats ();
 }
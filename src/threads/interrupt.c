@@ -3,12 +3,17 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#endif
 
 /* Number of x86 interrupts. */
 #define INTR_CNT 256
@@ -35,6 +40,52 @@ static const char *intr_names[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Interrupts-off latency tracer.
+
+   Every stretch of time that interrupts stay off, from the
+   intr_disable() or interrupt entry that turns them off to the
+   intr_enable() or interrupt return that turns them back on, is
+   timed with the CPU's time stamp counter.  The longest ones are
+   kept with the addresses that turned interrupts off and on, and
+   printed at shutdown for "backtrace" to turn into functions.
+   The window that a thread switch spans is charged to the
+   address in the old thread that disabled interrupts and the one
+   in the new thread that enabled them, as both hold off interrupt
+   handlers for all of it. */
+
+/* A window with interrupts off. */
+struct intr_window
+  {
+    uint64_t cycles;            /* Length, in time stamp counts. */
+    void *off_site;             /* Where interrupts went off. */
+    void *on_site;              /* Where they went back on. */
+  };
+
+/* Most windows kept. */
+#define INTR_WINDOW_MAX 32
+
+/* Number of the longest windows kept, or 0 to not trace.
+   Controlled by kernel command-line option "-irqoff=COUNT". */
+size_t intr_trace_windows;
+
+/* The longest windows so far, longest first, and the number
+   kept.  The tracer runs with interrupts off, so nothing else
+   touches them. */
+static struct intr_window windows[INTR_WINDOW_MAX];
+static size_t window_cnt;
+
+/* The window under way, if any, and totals. */
+static bool window_open;
+static uint64_t window_start;
+static void *window_site;
+static long long window_total;
+static uint64_t window_cycles;
+
+static enum intr_level enable_at (void *site);
+static enum intr_level disable_at (void *site);
+static void window_begin (void *site);
+static void window_end (void *site);
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -67,16 +118,46 @@ intr_get_level (void)
 enum intr_level
 intr_set_level (enum intr_level level) 
 {
-  return level == INTR_ON ? intr_enable () : intr_disable ();
+  void *site = __builtin_return_address (0);
+
+  return level == INTR_ON ? enable_at (site) : disable_at (site);
 }
 
 /* Enables interrupts and returns the previous interrupt status. */
 enum intr_level
 intr_enable (void) 
+{
+  return enable_at (__builtin_return_address (0));
+}
+
+/* Disables interrupts and returns the previous interrupt status. */
+enum intr_level
+intr_disable (void) 
+{
+  return disable_at (__builtin_return_address (0));
+}
+
+/* Tells the latency tracer that the caller is about to enable
+   interrupts itself, as the idle thread does with "sti; hlt",
+   rather than through intr_enable(). */
+void
+intr_enabling (void) 
+{
+  if (intr_trace_windows != 0)
+    window_end (__builtin_return_address (0));
+}
+
+/* Enables interrupts for the caller at SITE and returns the
+   previous interrupt status. */
+static enum intr_level
+enable_at (void *site) 
 {
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  if (intr_trace_windows != 0 && old_level == INTR_OFF)
+    window_end (site);
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -86,9 +167,10 @@ intr_enable (void)
   return old_level;
 }
 
-/* Disables interrupts and returns the previous interrupt status. */
-enum intr_level
-intr_disable (void) 
+/* Disables interrupts for the caller at SITE and returns the
+   previous interrupt status. */
+static enum intr_level
+disable_at (void *site) 
 {
   enum intr_level old_level = intr_get_level ();
 
@@ -97,8 +179,78 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (intr_trace_windows != 0 && old_level == INTR_ON)
+    window_begin (site);
+
   return old_level;
 }
+
+/* Starts timing a window with interrupts off, which SITE turned
+   off.  Interrupts must be off. */
+static void
+window_begin (void *site) 
+{
+  window_open = true;
+  window_start = timer_cycles ();
+  window_site = site;
+}
+
+/* Ends the window with interrupts off, if one is being timed,
+   because SITE is turning interrupts on, and keeps it if it is
+   among the longest.  Interrupts must be off. */
+static void
+window_end (void *site) 
+{
+  uint64_t cycles;
+  size_t i;
+
+  if (!window_open)
+    return;
+  window_open = false;
+  cycles = timer_cycles () - window_start;
+  window_total++;
+  window_cycles += cycles;
+
+  if (window_cnt == intr_trace_windows)
+    {
+      if (cycles <= windows[window_cnt - 1].cycles)
+        return;
+      window_cnt--;
+    }
+  for (i = window_cnt; i > 0 && windows[i - 1].cycles < cycles; i--)
+    windows[i] = windows[i - 1];
+  windows[i].cycles = cycles;
+  windows[i].off_site = window_site;
+  windows[i].on_site = site;
+  window_cnt++;
+}
+
+/* Prints the longest windows with interrupts off. */
+void
+intr_print_stats (void) 
+{
+  struct intr_window copy[INTR_WINDOW_MAX];
+  long long total;
+  uint64_t cycles;
+  enum intr_level old_level;
+  size_t cnt, i;
+
+  if (intr_trace_windows == 0)
+    return;
+
+  old_level = intr_disable ();
+  memcpy (copy, windows, sizeof windows);
+  cnt = window_cnt;
+  total = window_total;
+  cycles = window_cycles;
+  intr_set_level (old_level);
+
+  printf ("Interrupts off: %lld windows, %"PRIu64" cycles in all\n",
+          total, cycles);
+  for (i = 0; i < cnt; i++)
+    printf ("  %"PRIu64" cycles, off at %p, on at %p\n",
+            copy[i].cycles, copy[i].off_site, copy[i].on_site);
+}
 
 /* Initializes the interrupt system. */
 void
@@ -107,6 +259,9 @@ intr_init (void)
   uint64_t idtr_operand;
   int i;
 
+  if (intr_trace_windows > INTR_WINDOW_MAX)
+    intr_trace_windows = INTR_WINDOW_MAX;
+
   /* Initialize interrupt controller. */
   pic_init ();
 
@@ -346,6 +501,10 @@ intr_handler (struct intr_frame *frame)
      and they need to be acknowledged on the PIC (see below).
      An external interrupt handler cannot sleep. */
   external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  handler = intr_handlers[frame->vec_no];
+  if (intr_trace_windows != 0 && (frame->eflags & FLAG_IF)
+      && intr_get_level () == INTR_OFF)
+    window_begin (handler);
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
@@ -356,7 +515,6 @@ intr_handler (struct intr_frame *frame)
     }
 
   /* Invoke the interrupt's handler. */
-  handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
     handler (frame);
   else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
@@ -384,7 +542,22 @@ intr_handler (struct intr_frame *frame)
 
       if (yield_on_return) 
         thread_yield (); 
+
+#ifdef USERPROG
+      /* A user thread of an exiting process exits on its way back
+         to user mode, so that one busy in user code stops too. */
+      if (frame->cs == SEL_UCSEG && process_exiting ())
+        {
+          intr_enable ();
+          thread_exit ();
+        }
+#endif
     }
+
+  /* Returning from the interrupt turns interrupts back on. */
+  if (intr_trace_windows != 0 && (frame->eflags & FLAG_IF)
+      && intr_get_level () == INTR_OFF)
+    window_end (handler);
 }
 
 /* Dumps interrupt frame F to the console, for debugging. */
@@ -2,6 +2,7 @@
 #define THREADS_INTERRUPT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* Interrupts on or off? */
@@ -15,6 +16,11 @@ enum intr_level intr_get_level (void);
 enum intr_level intr_set_level (enum intr_level);
 enum intr_level intr_enable (void);
 enum intr_level intr_disable (void);
+void intr_enabling (void);
+
+/* Number of the longest interrupts-off windows traced, or 0.
+   Controlled by kernel command-line option "-irqoff=COUNT". */
+extern size_t intr_trace_windows;
 
 /* Interrupt stack frame. */
 struct intr_frame
@@ -65,6 +71,7 @@ bool intr_context (void);
 void intr_yield_on_return (void);
 
 void intr_dump_frame (const struct intr_frame *);
+void intr_print_stats (void);
 const char *intr_name (uint8_t vec);
 
 #endif /* threads/interrupt.h */
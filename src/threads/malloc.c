@@ -32,7 +32,19 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.  A freed
+   big block of up to BIG_CLASSES pages is kept for a while, up
+   to BIG_CACHE_PAGES pages in all, and handed out again for a
+   request of the same number of pages, so that buffers that
+   come and go do not go through the page allocator each time.
+
+   realloc() keeps a block where it is if the new size still
+   fits, and grows a big block in place if the pages that follow
+   it are free. */
+
+/* Largest big block cached, in pages, and most pages cached. */
+#define BIG_CLASSES 16
+#define BIG_CACHE_PAGES 64
 
 /* Descriptor. */
 struct desc
@@ -64,14 +76,24 @@ struct block
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Cached big blocks, by number of pages less one, and the pages
+   they hold in all. */
+static struct list big_cache[BIG_CLASSES];
+static size_t big_cache_pages;
+static struct lock big_lock;
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct arena *big_alloc (size_t page_cnt);
+static void big_free (struct arena *);
+static bool big_cache_flush (void);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
   size_t block_size;
+  size_t i;
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
@@ -82,6 +104,9 @@ malloc_init (void)
       list_init (&d->free_list);
       lock_init (&d->lock);
     }
+  for (i = 0; i < BIG_CLASSES; i++)
+    list_init (&big_cache[i]);
+  lock_init (&big_lock);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -107,7 +132,7 @@ malloc (size_t size)
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = big_alloc (page_cnt);
       if (a == NULL)
         return NULL;
 
@@ -201,7 +226,42 @@ realloc (void *old_block, size_t new_size)
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block;
+
+      if (old_block != NULL)
+        {
+          struct arena *a = block_to_arena (old_block);
+          size_t old_size = block_size (old_block);
+
+          if (a->desc == NULL && new_size > old_size)
+            {
+              /* Grow a big block into the pages after it. */
+              size_t page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+              if (palloc_grow (a, a->free_cnt, page_cnt))
+                {
+                  a->free_cnt = page_cnt;
+                  return old_block;
+                }
+            }
+          else if (a->desc == NULL
+                   && new_size > descs[desc_cnt - 1].block_size)
+            {
+              /* Shrink a big block that stays big by freeing its
+                 last pages. */
+              size_t page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+              if (page_cnt < a->free_cnt)
+                {
+                  palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                                        a->free_cnt - page_cnt);
+                  a->free_cnt = page_cnt;
+                }
+              return old_block;
+            }
+          else if (a->desc != NULL && new_size <= old_size)
+            return old_block;
+        }
+
+      new_block = malloc (new_size);
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -256,13 +316,92 @@ free (void *p)
         }
       else
         {
-          /* It's a big block.  Free its pages. */
-          palloc_free_multiple (a, a->free_cnt);
+          /* It's a big block.  Cache or free its pages. */
+          big_free (a);
           return;
         }
     }
 }
 
+/* Returns the arena of a new big block of PAGE_CNT pages, taken
+   from the cache if one of that size is there, or a null pointer
+   if memory is not available. */
+static struct arena *
+big_alloc (size_t page_cnt)
+{
+  struct arena *a = NULL;
+
+  if (page_cnt <= BIG_CLASSES)
+    {
+      struct list *cached = &big_cache[page_cnt - 1];
+
+      lock_acquire (&big_lock);
+      if (!list_empty (cached))
+        {
+          struct block *b = list_entry (list_pop_front (cached),
+                                        struct block, free_elem);
+          a = pg_round_down (b);
+          big_cache_pages -= page_cnt;
+        }
+      lock_release (&big_lock);
+      if (a != NULL)
+        return a;
+    }
+
+  a = palloc_get_multiple (0, page_cnt);
+  if (a == NULL && big_cache_flush ())
+    a = palloc_get_multiple (0, page_cnt);
+  return a;
+}
+
+/* Frees big block arena A, keeping it in the cache if there is
+   room. */
+static void
+big_free (struct arena *a)
+{
+  size_t page_cnt = a->free_cnt;
+
+  if (page_cnt <= BIG_CLASSES)
+    {
+      bool cached = false;
+
+      lock_acquire (&big_lock);
+      if (big_cache_pages + page_cnt <= BIG_CACHE_PAGES)
+        {
+          struct block *b = (struct block *) (a + 1);
+          list_push_front (&big_cache[page_cnt - 1], &b->free_elem);
+          big_cache_pages += page_cnt;
+          cached = true;
+        }
+      lock_release (&big_lock);
+      if (cached)
+        return;
+    }
+  palloc_free_multiple (a, page_cnt);
+}
+
+/* Gives the cached big blocks back to the page allocator.
+   Returns true if there were any. */
+static bool
+big_cache_flush (void)
+{
+  bool flushed = false;
+  size_t i;
+
+  lock_acquire (&big_lock);
+  for (i = 0; i < BIG_CLASSES; i++)
+    while (!list_empty (&big_cache[i]))
+      {
+        struct block *b = list_entry (list_pop_front (&big_cache[i]),
+                                      struct block, free_elem);
+        palloc_free_multiple (pg_round_down (b), i + 1);
+        flushed = true;
+      }
+  big_cache_pages = 0;
+  lock_release (&big_lock);
+  return flushed;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -2,15 +2,20 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -24,16 +29,76 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Its free pages
+   form blocks of 2**ORDER pages, aligned to their size within
+   the pool, with one free list for each order.  A request takes
+   a block of the smallest order that holds it, splitting a
+   larger block if none is free, and gives back the pages it
+   does not need.  A freed block is merged with its buddy, the
+   other half of the block of the next order, for as long as the
+   buddy is free too.  Both take O(log n) steps, and a single
+   page comes straight off the order-0 list whenever that list is
+   not empty, without splitting a larger block.
+
+   The idle thread also zeroes free pages ahead of time, up to
+   ZERO_MAX per pool, and keeps them on a list of their own, so a
+   request for one zeroed page is usually met without clearing
+   it.  The pages stay free: they go back to the buddy lists when
+   the lists run dry.
+
+   Single pages, which most requests are, also pass through a
+   small cache of free pages in each pool, a stack that is taken
+   from and pushed to with interrupts off instead of under the
+   pool's lock.  The cache is refilled from the buddy lists and
+   drained back to them CACHE_BATCH pages at a time, so the lock
+   is taken once for that many single-page requests.  Cached
+   pages count as free but stay marked used in the bitmap.
+
+   Under VM, a request for several user pages that finds no
+   block large enough has the frame table move the pages of user
+   processes out of a nearly free block, so that single-page
+   allocations do not leave the user pool too fragmented for
+   them. */
+
+/* Number of block orders.  Blocks are at most 2**(ORDER_CNT - 1)
+   pages. */
+#define ORDER_CNT 20
+
+/* Most pages of a pool kept zeroed. */
+#define ZERO_MAX 64
+
+/* Most pages in a pool's cache, and the number moved between it
+   and the buddy lists at once. */
+#define CACHE_MAX 32
+#define CACHE_BATCH 16
 
 /* A memory pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct bitmap *used_map;            /* Bitmap of used pages. */
+    uint8_t *order_map;                 /* Per page, 1 + order of the
+                                           free block it starts, or
+                                           0. */
+    struct list free_lists[ORDER_CNT];  /* Free blocks by order. */
+    size_t free_cnt;                    /* Number of free pages. */
+    struct list zero_list;              /* Zeroed free pages. */
+    size_t zero_cnt;                    /* Pages in ZERO_LIST. */
+    void *cache[CACHE_MAX];             /* Cached free pages.  Changed
+                                           with interrupts off. */
+    size_t cache_cnt;                   /* Pages in CACHE. */
     uint8_t *base;                      /* Base of pool. */
   };
 
+/* A free block, kept in its first page. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in a free list or
+                                           ZERO_LIST. */
+  };
+
 /* Two pools: one for kernel data, one for user pages. */
 struct pool kernel_pool, user_pool;
 
@@ -43,6 +108,22 @@ size_t user_page_limit = SIZE_MAX;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static struct free_block *idx_to_block (struct pool *, size_t page_idx);
+static size_t block_to_idx (struct pool *, struct free_block *);
+static size_t buddy_alloc (struct pool *, int order);
+static void buddy_free (struct pool *, size_t page_idx, int order);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static bool buddy_claim (struct pool *, size_t page_idx);
+static bool zero_page (struct pool *);
+static bool zero_drain (struct pool *);
+static void *cache_get (struct pool *);
+static bool cache_put (struct pool *, void *page);
+static void cache_fill (struct pool *);
+static size_t cache_drain (struct pool *, size_t cnt);
+#ifndef NDEBUG
+static bool cache_contains (const struct pool *, const void *page);
+#endif
+static void pool_print_stats (struct pool *, const char *name);
 
 /* Initializes the page allocator. */
 void
@@ -79,14 +160,85 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
-  size_t page_idx;
+  size_t page_idx = BITMAP_ERROR;
+  bool zeroed = false;
+#ifdef VM
+  bool compacted = false;
+#endif
+  int order = 0;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  /* Take a single page from the cache, unless a zeroed one is
+     asked for and there are some of those, or the caller needs
+     the cache left alone. */
+  if (page_cnt == 1 && !(flags & PAL_NOCACHE)
+      && !((flags & PAL_ZERO) && pool->zero_cnt > 0))
+    {
+      pages = cache_get (pool);
+      if (pages == NULL)
+        {
+          cache_fill (pool);
+          pages = cache_get (pool);
+        }
+      if (pages != NULL)
+        {
+          if (flags & PAL_ZERO)
+            memset (pages, 0, PGSIZE);
+          return pages;
+        }
+    }
+
+  /* Take a block of the smallest order that holds PAGE_CNT pages
+     and give back the rest of it. */
+  while (order < ORDER_CNT && ((size_t) 1 << order) < page_cnt)
+    order++;
+#ifdef VM
+ retry:
+#endif
+  if (order < ORDER_CNT)
+    {
+      lock_acquire (&pool->lock);
+      if (page_cnt == 1 && (flags & PAL_ZERO) && pool->zero_cnt > 0)
+        {
+          /* Clear the list element, the only nonzero bytes. */
+          struct list_elem *e = list_pop_front (&pool->zero_list);
+          struct free_block *b = list_entry (e, struct free_block, elem);
+          memset (b, 0, sizeof *b);
+          page_idx = block_to_idx (pool, b);
+          pool->zero_cnt--;
+          zeroed = true;
+        }
+      else
+        {
+          page_idx = buddy_alloc (pool, order);
+          if (page_idx == BITMAP_ERROR
+              && (zero_drain (pool) | (cache_drain (pool, CACHE_MAX) > 0)))
+            page_idx = buddy_alloc (pool, order);
+          if (page_idx != BITMAP_ERROR)
+            free_range (pool, page_idx + page_cnt,
+                        ((size_t) 1 << order) - page_cnt);
+        }
+      if (page_idx != BITMAP_ERROR)
+        {
+          ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+          bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+          pool->free_cnt -= page_cnt;
+        }
+      lock_release (&pool->lock);
+    }
+
+#ifdef VM
+  /* Compact the user pool and try once more. */
+  if (page_idx == BITMAP_ERROR && pool == &user_pool && page_cnt > 1
+      && order < ORDER_CNT && !compacted)
+    {
+      compacted = true;
+      if (frame_compact (order))
+        goto retry;
+    }
+#endif
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -95,7 +247,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      if ((flags & PAL_ZERO) && !zeroed)
         memset (pages, 0, PGSIZE * page_cnt);
     }
   else 
@@ -144,8 +296,75 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  /* Push a single page onto the cache, making room first if it
+     is full. */
+  if (page_cnt == 1)
+    {
+      ASSERT (bitmap_test (pool->used_map, page_idx));
+      if (cache_put (pool, pages))
+        return;
+      lock_acquire (&pool->lock);
+      cache_drain (pool, CACHE_BATCH);
+      lock_release (&pool->lock);
+      if (cache_put (pool, pages))
+        return;
+    }
+
+  lock_acquire (&pool->lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  pool->free_cnt += page_cnt;
+  free_range (pool, page_idx, page_cnt);
+  lock_release (&pool->lock);
+}
+
+/* Grows the group of PAGE_CNT pages starting at PAGES, obtained
+   from palloc_get_multiple(), in place to NEW_CNT pages, if the
+   pages that follow it are free.  Returns true if successful, in
+   which case the group is freed as NEW_CNT pages from then on.
+   The new pages are not zeroed. */
+bool
+palloc_grow (void *pages, size_t page_cnt, size_t new_cnt)
+{
+  struct pool *pool;
+  size_t page_idx, i;
+  bool success = false;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (new_cnt >= page_cnt);
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base) + page_cnt;
+  new_cnt -= page_cnt;
+  if (page_idx + new_cnt > bitmap_size (pool->used_map))
+    return false;
+
+  lock_acquire (&pool->lock);
+  if (bitmap_none (pool->used_map, page_idx, new_cnt))
+    {
+      /* Take each page out of the free block it is in.  A zeroed
+         page is on no buddy list, so give back those taken before
+         it. */
+      for (i = 0; i < new_cnt; i++)
+        if (!buddy_claim (pool, page_idx + i))
+          break;
+      if (i == new_cnt)
+        {
+          bitmap_set_multiple (pool->used_map, page_idx, new_cnt, true);
+          pool->free_cnt -= new_cnt;
+          success = true;
+        }
+      else
+        free_range (pool, page_idx, i);
+    }
+  lock_release (&pool->lock);
+  return success;
 }
 
 /* Frees the page at PAGE. */
@@ -155,25 +374,106 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the first page of the user pool. */
+void *
+palloc_user_base (void)
+{
+  return user_pool.base;
+}
+
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void)
+{
+  return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free_cnt (void)
+{
+  size_t cnt;
+
+  lock_acquire (&user_pool.lock);
+  cnt = user_pool.free_cnt + user_pool.cache_cnt;
+  lock_release (&user_pool.lock);
+  return cnt;
+}
+
+/* Returns true if the page at PAGE_IDX in the user pool is
+   allocated or cached, false if it is free. */
+bool
+palloc_user_page_used (size_t page_idx)
+{
+  bool used;
+
+  lock_acquire (&user_pool.lock);
+  used = bitmap_test (user_pool.used_map, page_idx);
+  lock_release (&user_pool.lock);
+  return used;
+}
+
+/* Returns the pages in the user pool's cache to its buddy lists,
+   so that they count as free in palloc_user_page_used(). */
+void
+palloc_user_drain_cache (void)
+{
+  lock_acquire (&user_pool.lock);
+  cache_drain (&user_pool, CACHE_MAX);
+  lock_release (&user_pool.lock);
+}
+
+/* Zeroes a free page ahead of time, if a pool has fewer than
+   ZERO_MAX zeroed.  Called by the idle thread, which must not
+   block, so a pool that is locked is skipped.  Returns true if a page
+   was zeroed. */
+bool
+palloc_zero_idle (void)
+{
+  return zero_page (&user_pool) || zero_page (&kernel_pool);
+}
+
+/* Prints the free pages of each pool and how fragmented they
+   are. */
+void
+palloc_print_stats (void)
+{
+  pool_print_stats (&kernel_pool, "Kernel pool");
+  pool_print_stats (&user_pool, "User pool");
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's used_map and order_map at its base.
+     Calculate the space needed for them
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
+  /* Initialize the pool, and free all of its pages. */
   lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->order_map = (uint8_t *) base + bm_size;
+  memset (p->order_map, 0, page_cnt);
+  for (order = 0; order < ORDER_CNT; order++)
+    list_init (&p->free_lists[order]);
+  p->free_cnt = page_cnt;
+  list_init (&p->zero_list);
+  p->zero_cnt = 0;
+  p->cache_cnt = 0;
   p->base = base + bm_pages * PGSIZE;
+  lock_acquire (&p->lock);
+  free_range (p, 0, page_cnt);
+  lock_release (&p->lock);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -187,3 +487,303 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free block at page PAGE_IDX of POOL. */
+static struct free_block *
+idx_to_block (struct pool *pool, size_t page_idx)
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index in POOL of the page that free block B
+   starts. */
+static size_t
+block_to_idx (struct pool *pool, struct free_block *b)
+{
+  return ((uint8_t *) b - pool->base) / PGSIZE;
+}
+
+/* Removes and returns a free block of 2**ORDER pages from POOL,
+   splitting the smallest larger block if there is none of that
+   order.  Returns its first page's index, or BITMAP_ERROR if no
+   block is free. */
+static size_t
+buddy_alloc (struct pool *pool, int order)
+{
+  struct list_elem *e;
+  size_t page_idx;
+  int i;
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+
+  for (i = order; i < ORDER_CNT; i++)
+    if (!list_empty (&pool->free_lists[i]))
+      break;
+  if (i == ORDER_CNT)
+    return BITMAP_ERROR;
+
+  e = list_pop_front (&pool->free_lists[i]);
+  page_idx = block_to_idx (pool, list_entry (e, struct free_block, elem));
+  pool->order_map[page_idx] = 0;
+
+  /* Free the upper halves split off. */
+  while (i-- > order)
+    {
+      size_t buddy = page_idx + ((size_t) 1 << i);
+      pool->order_map[buddy] = i + 1;
+      list_push_front (&pool->free_lists[i],
+                       &idx_to_block (pool, buddy)->elem);
+    }
+  return page_idx;
+}
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX to the free lists
+   of POOL, merging it with its buddy while the buddy is free. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, int order)
+{
+  size_t page_cnt = bitmap_size (pool->used_map);
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+  ASSERT (page_idx % ((size_t) 1 << order) == 0);
+
+  for (; order + 1 < ORDER_CNT; order++)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+      if (buddy + ((size_t) 1 << order) > page_cnt
+          || pool->order_map[buddy] != order + 1)
+        break;
+      list_remove (&idx_to_block (pool, buddy)->elem);
+      pool->order_map[buddy] = 0;
+      page_idx &= ~((size_t) 1 << order);
+    }
+  pool->order_map[page_idx] = order + 1;
+  list_push_front (&pool->free_lists[order],
+                   &idx_to_block (pool, page_idx)->elem);
+}
+
+/* Frees the PAGE_CNT pages of POOL starting at PAGE_IDX, as the
+   largest aligned blocks that they divide into. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+      while (order + 1 < ORDER_CNT
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      buddy_free (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Takes the free page at PAGE_IDX of POOL out of the free block
+   on the buddy lists that holds it, and frees the rest of that
+   block.  Returns false if no free block holds the page. */
+static bool
+buddy_claim (struct pool *pool, size_t page_idx)
+{
+  int order;
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      size_t start = page_idx & ~(((size_t) 1 << order) - 1);
+      size_t end = start + ((size_t) 1 << order);
+      if (pool->order_map[start] == order + 1)
+        {
+          list_remove (&idx_to_block (pool, start)->elem);
+          pool->order_map[start] = 0;
+          free_range (pool, start, page_idx - start);
+          free_range (pool, page_idx + 1, end - (page_idx + 1));
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Takes a free page of POOL off its buddy lists, zeroes it and
+   adds it to its zeroed pages, unless POOL has ZERO_MAX zeroed
+   pages, has no free page, or is locked.  Returns true if
+   successful.
+
+   Interrupts stay off while the lock is held, so that no thread
+   preempts the idle thread and waits for the lock, which would
+   donate priority to the idle thread and so treat it as a ready
+   thread. */
+static bool
+zero_page (struct pool *pool)
+{
+  size_t page_idx = BITMAP_ERROR;
+  enum intr_level old_level;
+
+  if (pool->zero_cnt >= ZERO_MAX)
+    return false;
+  old_level = intr_disable ();
+  if (!lock_try_acquire (&pool->lock))
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  if (pool->zero_cnt < ZERO_MAX)
+    page_idx = buddy_alloc (pool, 0);
+  if (page_idx != BITMAP_ERROR)
+    {
+      struct free_block *b = idx_to_block (pool, page_idx);
+      memset (b, 0, PGSIZE);
+      list_push_back (&pool->zero_list, &b->elem);
+      pool->zero_cnt++;
+    }
+  lock_release (&pool->lock);
+  intr_set_level (old_level);
+  return page_idx != BITMAP_ERROR;
+}
+
+/* Gives the zeroed pages of POOL back to its buddy lists.
+   Returns true if there were any. */
+static bool
+zero_drain (struct pool *pool)
+{
+  bool drained = pool->zero_cnt > 0;
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+
+  while (!list_empty (&pool->zero_list))
+    {
+      struct list_elem *e = list_pop_front (&pool->zero_list);
+      struct free_block *b = list_entry (e, struct free_block, elem);
+      buddy_free (pool, block_to_idx (pool, b), 0);
+    }
+  pool->zero_cnt = 0;
+  return drained;
+}
+
+/* Pops a page off the cache of POOL and returns it, or returns
+   a null pointer if the cache is empty. */
+static void *
+cache_get (struct pool *pool)
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = intr_disable ();
+  if (pool->cache_cnt > 0)
+    page = pool->cache[--pool->cache_cnt];
+  intr_set_level (old_level);
+  return page;
+}
+
+/* Pushes PAGE, which is marked used, onto the cache of POOL.
+   Returns false if the cache is full. */
+static bool
+cache_put (struct pool *pool, void *page)
+{
+  enum intr_level old_level;
+  bool put = false;
+
+  old_level = intr_disable ();
+  ASSERT (!cache_contains (pool, page));
+  if (pool->cache_cnt < CACHE_MAX)
+    {
+      pool->cache[pool->cache_cnt++] = page;
+      put = true;
+    }
+  intr_set_level (old_level);
+  return put;
+}
+
+#ifndef NDEBUG
+/* Returns true if PAGE is in the cache of POOL.  A page freed
+   twice stays marked used while it is cached, so only this
+   catches the second free.  Interrupts must be off. */
+static bool
+cache_contains (const struct pool *pool, const void *page)
+{
+  size_t i;
+
+  for (i = 0; i < pool->cache_cnt; i++)
+    if (pool->cache[i] == page)
+      return true;
+  return false;
+}
+#endif
+
+/* Moves up to CACHE_BATCH pages off the order-0 buddy lists of
+   POOL, splitting larger blocks as needed, onto its cache. */
+static void
+cache_fill (struct pool *pool)
+{
+  enum intr_level old_level;
+  size_t page_idx;
+
+  lock_acquire (&pool->lock);
+  old_level = intr_disable ();
+  while (pool->cache_cnt < CACHE_BATCH
+         && (page_idx = buddy_alloc (pool, 0)) != BITMAP_ERROR)
+    {
+      bitmap_mark (pool->used_map, page_idx);
+      pool->free_cnt--;
+      pool->cache[pool->cache_cnt++] = pool->base + PGSIZE * page_idx;
+    }
+  intr_set_level (old_level);
+  lock_release (&pool->lock);
+}
+
+/* Moves up to CNT pages off the cache of POOL back to its buddy
+   lists.  Returns the number moved. */
+static size_t
+cache_drain (struct pool *pool, size_t cnt)
+{
+  enum intr_level old_level;
+  size_t moved = 0;
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+
+  old_level = intr_disable ();
+  while (moved < cnt && pool->cache_cnt > 0)
+    {
+      void *page = pool->cache[--pool->cache_cnt];
+      size_t page_idx = pg_no (page) - pg_no (pool->base);
+
+      bitmap_reset (pool->used_map, page_idx);
+      pool->free_cnt++;
+      buddy_free (pool, page_idx, 0);
+      moved++;
+    }
+  intr_set_level (old_level);
+  return moved;
+}
+
+/* Prints the free pages of POOL, named NAME, with the number of
+   free blocks of each order that has any.  Fragmentation is the
+   share of the pages on the buddy lists outside the largest free
+   block, which is the most that one request can get. */
+static void
+pool_print_stats (struct pool *pool, const char *name)
+{
+  size_t buddy_cnt = pool->free_cnt - pool->zero_cnt;
+  size_t largest = 0;
+  int order;
+
+  if (pool->used_map == NULL)
+    return;
+  lock_acquire (&pool->lock);
+  printf ("%s: %zu of %zu pages free, blocks by order:", name,
+          pool->free_cnt + pool->cache_cnt, bitmap_size (pool->used_map));
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      size_t cnt = list_size (&pool->free_lists[order]);
+      if (cnt == 0)
+        continue;
+      printf (" %d:%zu", order, cnt);
+      largest = (size_t) 1 << order;
+    }
+  printf (", %zu zeroed, %zu cached, %zu%% fragmented\n", pool->zero_cnt,
+          pool->cache_cnt,
+          buddy_cnt > 0 ? (buddy_cnt - largest) * 100 / buddy_cnt : 0);
+  lock_release (&pool->lock);
+}
@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -8,7 +9,8 @@ enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+    PAL_NOCACHE = 010           /* Bypass the single-page cache. */
   };
 
 /* Maximum number of pages to put in user pool. */
@@ -19,5 +21,13 @@ void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_grow (void *, size_t page_cnt, size_t new_cnt);
+void *palloc_user_base (void);
+size_t palloc_user_page_cnt (void);
+size_t palloc_user_free_cnt (void);
+bool palloc_user_page_used (size_t page_idx);
+void palloc_user_drain_cache (void);
+bool palloc_zero_idle (void);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
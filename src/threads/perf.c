@@ -0,0 +1,240 @@
+#include "threads/perf.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+/* Counters.  They are updated with interrupts off, since
+   interrupt handlers count too and a 64-bit addition is not
+   atomic. */
+static struct perfstat perf;
+
+/* Latency histograms, laid out as the system call histograms,
+   the page fault histogram, and the read and then write
+   histograms of the disks.  Updated with interrupts off, like
+   the counters. */
+#define PERF_HIST_TOTAL (PERF_SYSCALL_CNT + 1 + 2 * PERF_HIST_DISKS)
+static struct perfhist perf_hists[PERF_HIST_TOTAL];
+
+/* Counter names, for perf_print_stats(). */
+static const char *perf_names[PERF_CNT] =
+  {
+    [PERF_CACHE_HIT] = "cache hits",
+    [PERF_CACHE_MISS] = "cache misses",
+    [PERF_CACHE_EVICT] = "cache evictions",
+    [PERF_CACHE_THROTTLE] = "cache write throttles",
+    [PERF_FAULT_ZERO] = "zero page faults",
+    [PERF_FAULT_FILE] = "file page faults",
+    [PERF_FAULT_SWAP] = "swap page faults",
+    [PERF_FAULT_COW] = "copy-on-write faults",
+    [PERF_FAULT_STACK] = "stack growth faults",
+    [PERF_FAULT_BAD] = "bad faults",
+    [PERF_SWAP_IN] = "pages swapped in",
+    [PERF_SWAP_OUT] = "pages swapped out",
+    [PERF_PAGE_MERGE] = "pages merged",
+    [PERF_LOCK_CONTENDED] = "contended locks",
+    [PERF_CONTEXT_SWITCH] = "context switches",
+    [PERF_DISK_REQUESTS] = "disk requests",
+    [PERF_DISK_QUEUED] = "disk requests waiting",
+    [PERF_SECTOR_READ] = "sectors read",
+    [PERF_SECTOR_WRITE] = "sectors written",
+    [PERF_DISK_FLUSH] = "disk cache flushes",
+    [PERF_TLB_PAGE] = "TLB pages invalidated",
+    [PERF_TLB_FLUSH] = "TLB flushes",
+    [PERF_PAGE_MIGRATE] = "pages migrated",
+  };
+
+/* Histogram names, for perf_print_stats(). */
+static const char *perf_hist_names[PERF_HIST_CNT] =
+  {
+    [PERF_HIST_SYSCALL] = "system call",
+    [PERF_HIST_FAULT] = "page fault",
+    [PERF_HIST_DISK_READ] = "disk read",
+    [PERF_HIST_DISK_WRITE] = "disk write",
+  };
+
+static struct perfhist *perf_hist_get (enum perf_hist, unsigned idx);
+static int perf_hist_bucket (uint64_t cycles);
+static long long perf_hist_percentile (const struct perfhist *, int pct);
+static void perf_hist_print (enum perf_hist, unsigned idx);
+
+/* Adds CNT to COUNTER. */
+void
+perf_add (enum perf_counter counter, long long cnt)
+{
+  enum intr_level old_level;
+
+  ASSERT (counter < PERF_CNT);
+
+  old_level = intr_disable ();
+  perf.counters[counter] += cnt;
+  intr_set_level (old_level);
+}
+
+/* Counts a call of system call NR. */
+void
+perf_syscall (unsigned nr)
+{
+  enum intr_level old_level;
+
+  if (nr >= PERF_SYSCALL_CNT)
+    return;
+  old_level = intr_disable ();
+  perf.syscalls[nr]++;
+  intr_set_level (old_level);
+}
+
+/* Records a latency of CYCLES in histogram IDX of kind KIND.
+   Histograms beyond those kept are ignored. */
+void
+perf_hist_add (enum perf_hist kind, unsigned idx, uint64_t cycles)
+{
+  struct perfhist *h = perf_hist_get (kind, idx);
+  int bucket = perf_hist_bucket (cycles);
+  enum intr_level old_level;
+
+  if (h == NULL)
+    return;
+  old_level = intr_disable ();
+  h->count++;
+  h->sum += cycles;
+  if ((long long) cycles > h->max)
+    h->max = cycles;
+  h->buckets[bucket]++;
+  intr_set_level (old_level);
+}
+
+/* Stores a snapshot of histogram IDX of kind KIND in H.  Returns
+   false if there is no such histogram. */
+bool
+perf_hist_read (enum perf_hist kind, unsigned idx, struct perfhist *h)
+{
+  struct perfhist *src = perf_hist_get (kind, idx);
+  enum intr_level old_level;
+
+  if (src == NULL)
+    return false;
+  old_level = intr_disable ();
+  memcpy (h, src, sizeof *h);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Stores a snapshot of the counters in ST. */
+void
+perf_read (struct perfstat *st)
+{
+  enum intr_level old_level = intr_disable ();
+  memcpy (st, &perf, sizeof *st);
+  st->ticks = timer_ticks ();
+  intr_set_level (old_level);
+}
+
+/* Prints the counters that are not zero and the number of
+   system calls. */
+void
+perf_print_stats (void)
+{
+  struct perfstat st;
+  long long syscall_cnt = 0;
+  int i;
+
+  perf_read (&st);
+  for (i = 0; i < PERF_SYSCALL_CNT; i++)
+    syscall_cnt += st.syscalls[i];
+  printf ("Perf:");
+  for (i = 0; i < PERF_CNT; i++)
+    if (st.counters[i] != 0)
+      printf (" %lld %s,", st.counters[i], perf_names[i]);
+  printf (" %lld system calls\n", syscall_cnt);
+
+  for (i = 0; i < PERF_SYSCALL_CNT; i++)
+    perf_hist_print (PERF_HIST_SYSCALL, i);
+  perf_hist_print (PERF_HIST_FAULT, 0);
+  for (i = 0; i < PERF_HIST_DISKS; i++)
+    {
+      perf_hist_print (PERF_HIST_DISK_READ, i);
+      perf_hist_print (PERF_HIST_DISK_WRITE, i);
+    }
+}
+
+/* Returns histogram IDX of kind KIND, or a null pointer if there
+   is none. */
+static struct perfhist *
+perf_hist_get (enum perf_hist kind, unsigned idx)
+{
+  switch (kind)
+    {
+    case PERF_HIST_SYSCALL:
+      return idx < PERF_SYSCALL_CNT ? &perf_hists[idx] : NULL;
+    case PERF_HIST_FAULT:
+      return idx == 0 ? &perf_hists[PERF_SYSCALL_CNT] : NULL;
+    case PERF_HIST_DISK_READ:
+    case PERF_HIST_DISK_WRITE:
+      if (idx >= PERF_HIST_DISKS)
+        return NULL;
+      if (kind == PERF_HIST_DISK_WRITE)
+        idx += PERF_HIST_DISKS;
+      return &perf_hists[PERF_SYSCALL_CNT + 1 + idx];
+    default:
+      return NULL;
+    }
+}
+
+/* Returns the bucket of a latency of CYCLES, as described in
+   <perfstat.h>. */
+static int
+perf_hist_bucket (uint64_t cycles)
+{
+  int msb, bucket;
+
+  if (cycles < 2)
+    return cycles;
+  for (msb = 1; cycles >> (msb + 1) != 0; msb++)
+    continue;
+  bucket = 2 * msb + ((cycles >> (msb - 1)) & 1);
+  return bucket < PERF_HIST_BUCKETS ? bucket : PERF_HIST_BUCKETS - 1;
+}
+
+/* Returns the smallest latency, in cycles, that at least PCT
+   percent of the latencies in H are below, rounded up to the
+   end of its bucket but not past H's maximum. */
+static long long
+perf_hist_percentile (const struct perfhist *h, int pct)
+{
+  long long seen = 0;
+  int b;
+
+  for (b = 0; b < PERF_HIST_BUCKETS - 1; b++)
+    {
+      seen += h->buckets[b];
+      if (seen * 100 >= h->count * pct)
+        {
+          long long end;
+
+          if (b < 2)
+            end = b + 1;
+          else
+            end = (b & 1 ? 2LL : 3LL) << (b / 2 - (b & 1 ? 0 : 1));
+          return end < h->max ? end : h->max;
+        }
+    }
+  return h->max;
+}
+
+/* Prints histogram IDX of kind KIND, if it holds any latency, as
+   its count, mean, median, 99th percentile, and maximum. */
+static void
+perf_hist_print (enum perf_hist kind, unsigned idx)
+{
+  struct perfhist h;
+
+  if (!perf_hist_read (kind, idx, &h) || h.count == 0)
+    return;
+  printf ("Latency of %s %u: %lld times, mean %lld, p50 %lld, "
+          "p99 %lld, max %lld cycles\n",
+          perf_hist_names[kind], idx, h.count, h.sum / h.count,
+          perf_hist_percentile (&h, 50), perf_hist_percentile (&h, 99),
+          h.max);
+}
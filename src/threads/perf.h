@@ -0,0 +1,22 @@
+#ifndef THREADS_PERF_H
+#define THREADS_PERF_H
+
+#include <perfstat.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+void perf_add (enum perf_counter, long long);
+void perf_syscall (unsigned nr);
+void perf_read (struct perfstat *);
+void perf_hist_add (enum perf_hist, unsigned idx, uint64_t cycles);
+bool perf_hist_read (enum perf_hist, unsigned idx, struct perfhist *);
+void perf_print_stats (void);
+
+/* Adds one to COUNTER. */
+static inline void
+perf_inc (enum perf_counter counter)
+{
+  perf_add (counter, 1);
+}
+
+#endif /* threads/perf.h */
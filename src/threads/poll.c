@@ -0,0 +1,124 @@
+#include "threads/poll.h"
+#include <debug.h>
+#include <list.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Waiting for any of several event sources.
+
+   A thread waiting on several sources at once, such as the
+   console and a few pipes, cannot sleep on any one of them.
+   Instead, each source calls poll_notify() whenever it may have
+   become ready, which counts an event and wakes up every waiter
+   to check its sources again.  A waiter reads the count with
+   poll_events() before checking, and passes it to poll_wait(),
+   which does not sleep if an event came in between, so that none
+   is missed.  poll_notify() may be called from an interrupt
+   handler, so all of this is protected by turning interrupts
+   off. */
+
+/* A waiting thread. */
+struct poll_waiter
+  {
+    struct list_elem elem;      /* In poll_waiters. */
+    struct thread *thread;      /* The thread. */
+    bool woken;                 /* Woken by an event? */
+  };
+
+/* Events so far and waiting threads. */
+static unsigned poll_count;
+static struct list poll_waiters;
+
+static alarm_func poll_timeout;
+
+/* Initializes the list of waiting threads. */
+void
+poll_init (void)
+{
+  list_init (&poll_waiters);
+}
+
+/* Returns the number of events so far, to pass to poll_wait(). */
+unsigned
+poll_events (void)
+{
+  enum intr_level old_level = intr_disable ();
+  unsigned events = poll_count;
+  intr_set_level (old_level);
+  return events;
+}
+
+/* Sleeps until an event comes after the first EVENTS, which may
+   already have happened, or until timer tick DEADLINE, or
+   forever if DEADLINE is negative.  Returns true if there was an
+   event, false if DEADLINE passed first. */
+bool
+poll_wait (unsigned events, int64_t deadline)
+{
+  struct poll_waiter w;
+  struct alarm alarm;
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  if (poll_count != events)
+    w.woken = true;
+  else if (deadline >= 0 && timer_ticks () >= deadline)
+    w.woken = false;
+  else
+    {
+      w.thread = thread_current ();
+      w.woken = false;
+      list_push_back (&poll_waiters, &w.elem);
+      if (deadline >= 0)
+        {
+          alarm_init (&alarm, poll_timeout, &w);
+          alarm_set (&alarm, deadline);
+        }
+      thread_block ();
+      if (deadline >= 0)
+        alarm_cancel (&alarm);
+    }
+  intr_set_level (old_level);
+  return w.woken;
+}
+
+/* Counts an event and wakes up every waiting thread. */
+void
+poll_notify (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool yield = false;
+
+  poll_count++;
+  while (!list_empty (&poll_waiters))
+    {
+      struct list_elem *e = list_pop_front (&poll_waiters);
+      struct poll_waiter *w = list_entry (e, struct poll_waiter, elem);
+
+      w->woken = true;
+      thread_unblock (w->thread);
+      if (w->thread->priority > thread_current ()->priority)
+        yield = true;
+    }
+  if (yield && intr_context ())
+    intr_yield_on_return ();
+  intr_set_level (old_level);
+}
+
+/* Wakes up waiter W_ when its deadline passes, unless an event
+   woke it first. */
+static void
+poll_timeout (void *w_)
+{
+  struct poll_waiter *w = w_;
+
+  if (w->woken)
+    return;
+  list_remove (&w->elem);
+  thread_unblock (w->thread);
+  if (w->thread->priority > thread_current ()->priority)
+    intr_yield_on_return ();
+}
@@ -0,0 +1,12 @@
+#ifndef THREADS_POLL_H
+#define THREADS_POLL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void poll_init (void);
+unsigned poll_events (void);
+bool poll_wait (unsigned events, int64_t deadline);
+void poll_notify (void);
+
+#endif /* threads/poll.h */
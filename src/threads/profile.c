@@ -0,0 +1,102 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Sampling profiler.
+
+   On every timer interrupt, the address that was interrupted,
+   in the kernel or in a user program, is recorded with the
+   running thread's id in a ring buffer.  At shutdown the samples
+   are printed by thread, sorted by address, in lines like
+
+      Profile of thread 3: 0xc0021f3a 0xc0021f3a 0x0804812c ...
+
+   which "backtrace -p kernel.o [PROGRAM]... ADDRESS..." turns
+   into a flat profile, samples per function. */
+
+/* A sample. */
+struct profile_sample
+  {
+    uintptr_t eip;              /* Interrupted instruction. */
+    tid_t tid;                  /* Thread running it. */
+  };
+
+/* Number of samples kept. */
+size_t profile_samples = 0;
+
+/* Ring buffer of PROFILE_SAMPLES samples, and the number of
+   samples taken since boot.  Written by the timer interrupt
+   only. */
+static struct profile_sample *samples;
+static long long sample_cnt;
+
+static int compare_samples (const void *, const void *);
+
+/* Allocates the ring buffer if profiling is enabled. */
+void
+profile_init (void)
+{
+  if (profile_samples == 0)
+    return;
+  samples = calloc (profile_samples, sizeof *samples);
+  if (samples == NULL)
+    PANIC ("cannot allocate %zu profile samples", profile_samples);
+}
+
+/* Records the instruction interrupted by timer interrupt F. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  struct profile_sample *s;
+
+  if (samples == NULL)
+    return;
+  s = &samples[sample_cnt++ % profile_samples];
+  s->eip = (uintptr_t) f->eip;
+  s->tid = thread_current ()->tid;
+}
+
+/* Prints the samples kept, a line per thread. */
+void
+profile_print_stats (void)
+{
+  size_t cnt, i;
+
+  if (samples == NULL)
+    return;
+
+  /* Stop sampling; the machine is going down. */
+  intr_disable ();
+  cnt = sample_cnt < (long long) profile_samples ? sample_cnt
+                                                 : profile_samples;
+  qsort (samples, cnt, sizeof *samples, compare_samples);
+
+  printf ("Profile: %lld samples, %zu kept\n", sample_cnt, cnt);
+  for (i = 0; i < cnt; i++)
+    {
+      if (i == 0 || samples[i].tid != samples[i - 1].tid)
+        printf ("%sProfile of thread %d:", i == 0 ? "" : "\n",
+                samples[i].tid);
+      printf (" %#"PRIxPTR, samples[i].eip);
+    }
+  if (cnt > 0)
+    printf ("\n");
+}
+
+/* Orders samples A and B by thread id, then by address. */
+static int
+compare_samples (const void *a_, const void *b_)
+{
+  const struct profile_sample *a = a_;
+  const struct profile_sample *b = b_;
+
+  if (a->tid != b->tid)
+    return a->tid < b->tid ? -1 : 1;
+  if (a->eip != b->eip)
+    return a->eip < b->eip ? -1 : 1;
+  return 0;
+}
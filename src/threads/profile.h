@@ -0,0 +1,16 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stddef.h>
+#include "threads/interrupt.h"
+
+/* Number of samples the sampling profiler keeps, the latest
+   ones.  Zero disables it.
+   Controlled by kernel command-line option "-profile=SAMPLES". */
+extern size_t profile_samples;
+
+void profile_init (void);
+void profile_sample (const struct intr_frame *);
+void profile_print_stats (void);
+
+#endif /* threads/profile.h */
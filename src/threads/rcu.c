@@ -0,0 +1,211 @@
+#include "threads/rcu.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Read-copy update.
+
+   Tables that are looked up far more often than they change,
+   such as the directory entry cache, are read without a lock
+   between rcu_read_lock() and rcu_read_unlock().  A writer,
+   which still serializes with other writers, changes them only
+   by publishing new objects and unlinking old ones, each in one
+   store, so that a reader sees either.  An unlinked object is
+   handed to call_rcu(), which frees it once a grace period is
+   over, that is, once every reader that may have found it is
+   done.
+
+   Readers may be preempted, and even sleep, so a context switch
+   alone does not end a grace period.  Instead, each reader is
+   counted against the phase, 0 or 1, that was current when it
+   began.  A grace period starts by flipping the phase and is
+   over once no reader is left in the old one: those that began
+   later cannot have found an object unlinked before the flip.
+   rcu_switch() checks for this at each context switch, and
+   starts the next grace period for the objects handed over in
+   the meantime.  Their functions are then called, in thread
+   context, from the system work queue, which keeps that out of
+   schedule() and lets them free memory.
+
+   This is all protected by turning interrupts off, which is
+   cheap compared to a lock and never blocks. */
+
+/* Readers in each phase, and the current phase. */
+static int rcu_readers[2];
+static int rcu_phase;
+
+/* Objects handed over since the grace period under way started,
+   those waiting for it to end, and those whose functions are
+   due. */
+static struct list rcu_next;
+static struct list rcu_wait;
+static struct list rcu_done;
+
+/* Calls the functions due. */
+static struct work rcu_work;
+
+/* A wait of synchronize_rcu(). */
+struct rcu_sync
+  {
+    struct rcu_head head;       /* Handed to call_rcu(). */
+    struct semaphore done;      /* Upped when the wait is over. */
+  };
+
+static work_func rcu_reclaim;
+static rcu_func rcu_sync_done;
+static void splice_all (struct list *dst, struct list *src);
+
+/* Initializes read-copy update, before the first context
+   switch. */
+void
+rcu_init (void)
+{
+  list_init (&rcu_next);
+  list_init (&rcu_wait);
+  list_init (&rcu_done);
+  work_init (&rcu_work, rcu_reclaim, NULL);
+}
+
+/* Begins a read-side critical section.  Objects found before
+   the matching rcu_read_unlock() are not freed until then.
+   Sections nest. */
+void
+rcu_read_lock (void)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  if (t->rcu_nesting++ == 0)
+    {
+      t->rcu_phase = rcu_phase;
+      rcu_readers[t->rcu_phase]++;
+    }
+  intr_set_level (old_level);
+}
+
+/* Ends a read-side critical section. */
+void
+rcu_read_unlock (void)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (t->rcu_nesting > 0);
+
+  old_level = intr_disable ();
+  if (--t->rcu_nesting == 0)
+    rcu_readers[t->rcu_phase]--;
+  intr_set_level (old_level);
+}
+
+/* Calls FUNC with HEAD, in a kernel worker, once every reader
+   that may have found the object containing HEAD is done.  The
+   object must already be unlinked from where readers look. */
+void
+call_rcu (struct rcu_head *head, rcu_func *func)
+{
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  head->func = func;
+  old_level = intr_disable ();
+  list_push_back (&rcu_next, &head->elem);
+  intr_set_level (old_level);
+  work_queue_delayed (&system_wq, &rcu_work, 1);
+}
+
+/* Waits until every reader that began before the call is done.
+   Must not be called in a read-side critical section. */
+void
+synchronize_rcu (void)
+{
+  struct rcu_sync sync;
+
+  ASSERT (thread_current ()->rcu_nesting == 0);
+
+  sema_init (&sync.done, 0);
+  call_rcu (&sync.head, rcu_sync_done);
+  sema_down (&sync.done);
+}
+
+/* Ends the grace period under way if its readers are done, and
+   starts the next one for the objects handed over meanwhile.
+   Called by schedule() with interrupts off. */
+void
+rcu_switch (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!list_empty (&rcu_wait) && rcu_readers[!rcu_phase] == 0)
+    splice_all (&rcu_done, &rcu_wait);
+  if (list_empty (&rcu_wait) && !list_empty (&rcu_next))
+    {
+      splice_all (&rcu_wait, &rcu_next);
+      rcu_phase = !rcu_phase;
+    }
+}
+
+/* Inserts ELEM at the front of LIST, which readers may be
+   walking at the same time, once ELEM's object is initialized.
+   list_remove() already leaves a removed element's links in
+   place for readers that are on it. */
+void
+rcu_list_push_front (struct list *list, struct list_elem *elem)
+{
+  struct list_elem *next = list_begin (list);
+
+  elem->prev = next->prev;
+  elem->next = next;
+  barrier ();
+  next->prev->next = elem;
+  next->prev = elem;
+}
+
+/* Calls the functions due, and comes back after a tick while
+   grace periods are under way.  Work function of rcu_work. */
+static void
+rcu_reclaim (void *aux UNUSED)
+{
+  enum intr_level old_level;
+  struct list done;
+  bool waiting;
+
+  list_init (&done);
+  old_level = intr_disable ();
+  rcu_switch ();
+  splice_all (&done, &rcu_done);
+  waiting = !list_empty (&rcu_wait) || !list_empty (&rcu_next);
+  intr_set_level (old_level);
+
+  while (!list_empty (&done))
+    {
+      struct rcu_head *head = list_entry (list_pop_front (&done),
+                                          struct rcu_head, elem);
+      head->func (head);
+    }
+  if (waiting)
+    work_queue_delayed (&system_wq, &rcu_work, 1);
+}
+
+/* Ends the wait of synchronize_rcu() that contains HEAD. */
+static void
+rcu_sync_done (struct rcu_head *head)
+{
+  struct rcu_sync *sync = list_entry (&head->elem, struct rcu_sync,
+                                     head.elem);
+  sema_up (&sync->done);
+}
+
+/* Moves the elements of SRC to the end of DST. */
+static void
+splice_all (struct list *dst, struct list *src)
+{
+  if (!list_empty (src))
+    list_splice (list_end (dst), list_begin (src), list_end (src));
+}
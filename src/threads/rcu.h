@@ -0,0 +1,26 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <list.h>
+
+/* Deferred call made once the readers that may still see an
+   object have finished. */
+struct rcu_head;
+typedef void rcu_func (struct rcu_head *);
+
+struct rcu_head
+  {
+    struct list_elem elem;      /* In a batch of rcu.c. */
+    rcu_func *func;             /* Function to call. */
+  };
+
+void rcu_init (void);
+void rcu_read_lock (void);
+void rcu_read_unlock (void);
+void call_rcu (struct rcu_head *, rcu_func *);
+void synchronize_rcu (void);
+void rcu_switch (void);
+
+void rcu_list_push_front (struct list *, struct list_elem *);
+
+#endif /* threads/rcu.h */
@@ -0,0 +1,264 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Slab caches.
+
+   A slab cache hands out objects of one type.  Its objects come
+   from slabs, pages carved into objects of the cache's size, and
+   each slab chains its free objects through a link word, the
+   object's first word or, in a cache with a constructor, a word
+   past its end that leaves the constructed state alone.
+   A new slab is not divided up front: objects are taken from
+   its unused tail one at a time, and only then constructed, so
+   making a slab costs a page and nothing more.
+
+   In front of the slabs sits a magazine, a small stack of free
+   objects kept per CPU, which this kernel has one of.  It is
+   reached with interrupts off instead of through the cache's
+   lock, so most allocations and frees take neither a lock nor a
+   list operation.  An empty magazine is refilled, and a full one
+   drained, half a magazine at a time under the lock. */
+
+/* Objects held by a magazine. */
+#define MAGAZINE_SIZE 16
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* A slab cache. */
+struct slab_cache
+  {
+    const char *name;           /* Name, for debugging. */
+    size_t obj_size;            /* Object size in bytes, with link. */
+    size_t link_ofs;            /* Offset of free chain link. */
+    size_t obj_cnt;             /* Objects per slab. */
+    slab_ctor_func *ctor;       /* Constructor, or NULL. */
+
+    struct lock lock;           /* Protects PARTIAL and EMPTY_CNT. */
+    struct list partial;        /* Slabs that are not fully in use. */
+    size_t empty_cnt;           /* Slabs in PARTIAL wholly free. */
+
+    void *magazine[MAGAZINE_SIZE]; /* Free objects, with interrupts
+                                      off. */
+    size_t magazine_cnt;        /* Objects in MAGAZINE. */
+  };
+
+/* A slab, at the start of its page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's PARTIAL. */
+    size_t in_use;              /* Objects handed out or cached. */
+    size_t fresh;               /* Objects ever taken from the tail. */
+    void *free;                 /* Chain of free objects. */
+  };
+
+/* Offset of a slab's first object, past its header. */
+#define SLAB_HEADER ROUND_UP (sizeof (struct slab), 8)
+
+static size_t slab_get (struct slab_cache *, void **objs, size_t cnt);
+static void slab_put (struct slab_cache *, void **objs, size_t cnt);
+static struct slab *obj_to_slab (struct slab_cache *, void *);
+
+/* Returns the free chain link of OBJ in C. */
+static inline void **
+obj_link (struct slab_cache *c, void *obj)
+{
+  return (void **) ((uint8_t *) obj + c->link_ofs);
+}
+
+/* Creates a cache of objects of SIZE bytes named NAME, which must
+   stay valid.  CTOR, if nonnull, constructs each object when its
+   slab is made.  SIZE must be small enough that a page holds at
+   least 8 objects.  Panics if memory is short, since caches are
+   made as the kernel starts. */
+struct slab_cache *
+slab_cache_create (const char *name, size_t size, slab_ctor_func *ctor)
+{
+  struct slab_cache *c = malloc (sizeof *c);
+
+  if (c == NULL)
+    PANIC ("cannot create slab cache %s", name);
+  c->name = name;
+  c->obj_size = ROUND_UP (size > sizeof (void *) ? size : sizeof (void *),
+                          sizeof (void *));
+  c->link_ofs = 0;
+  if (ctor != NULL)
+    {
+      c->link_ofs = c->obj_size;
+      c->obj_size += sizeof (void *);
+    }
+  c->obj_cnt = (PGSIZE - SLAB_HEADER) / c->obj_size;
+  ASSERT (c->obj_cnt >= 8);
+  c->ctor = ctor;
+  lock_init (&c->lock);
+  list_init (&c->partial);
+  c->empty_cnt = 0;
+  c->magazine_cnt = 0;
+  return c;
+}
+
+/* Obtains and returns an object from cache C, or a null pointer
+   if memory is not available. */
+void *
+slab_alloc (struct slab_cache *c)
+{
+  void *objs[MAGAZINE_SIZE / 2];
+  enum intr_level old_level;
+  size_t cnt;
+
+  old_level = intr_disable ();
+  if (c->magazine_cnt > 0)
+    {
+      void *obj = c->magazine[--c->magazine_cnt];
+      intr_set_level (old_level);
+      return obj;
+    }
+  intr_set_level (old_level);
+
+  /* Refill the magazine, keeping the first object.  Another
+     thread may have refilled it meanwhile, in which case the
+     objects that do not fit go back to their slabs. */
+  cnt = slab_get (c, objs, MAGAZINE_SIZE / 2);
+  if (cnt == 0)
+    return NULL;
+  old_level = intr_disable ();
+  while (cnt > 1 && c->magazine_cnt < MAGAZINE_SIZE)
+    c->magazine[c->magazine_cnt++] = objs[--cnt];
+  intr_set_level (old_level);
+  if (cnt > 1)
+    slab_put (c, objs + 1, cnt - 1);
+  return objs[0];
+}
+
+/* Gives OBJ, which must have come from slab_alloc() on C, back to
+   C.  A null OBJ is ignored. */
+void
+slab_free (struct slab_cache *c, void *obj)
+{
+  void *objs[MAGAZINE_SIZE / 2 + 1];
+  enum intr_level old_level;
+  size_t cnt = 0;
+
+  if (obj == NULL)
+    return;
+  ASSERT (obj_to_slab (c, obj) != NULL);
+
+  /* Drain half of a full magazine, along with OBJ. */
+  old_level = intr_disable ();
+  if (c->magazine_cnt < MAGAZINE_SIZE)
+    {
+      c->magazine[c->magazine_cnt++] = obj;
+      intr_set_level (old_level);
+      return;
+    }
+  while (cnt < MAGAZINE_SIZE / 2)
+    objs[cnt++] = c->magazine[--c->magazine_cnt];
+  intr_set_level (old_level);
+  objs[cnt++] = obj;
+  slab_put (c, objs, cnt);
+}
+
+/* Takes up to CNT objects of C from its slabs, making a slab if
+   none has a free object, and stores them in OBJS.  Returns the
+   number taken, which is 0 only if memory is short. */
+static size_t
+slab_get (struct slab_cache *c, void **objs, size_t cnt)
+{
+  size_t n = 0;
+
+  lock_acquire (&c->lock);
+  while (n < cnt)
+    {
+      struct slab *s;
+
+      if (list_empty (&c->partial))
+        {
+          s = palloc_get_page (0);
+          if (s == NULL)
+            break;
+          s->magic = SLAB_MAGIC;
+          s->cache = c;
+          s->in_use = 0;
+          s->fresh = 0;
+          s->free = NULL;
+          list_push_front (&c->partial, &s->elem);
+          c->empty_cnt++;
+        }
+      s = list_entry (list_front (&c->partial), struct slab, elem);
+      if (s->in_use == 0)
+        c->empty_cnt--;
+
+      /* Take freed objects first, then the unused tail. */
+      while (n < cnt && s->in_use < c->obj_cnt)
+        {
+          void *obj = s->free;
+          if (obj != NULL)
+            s->free = *obj_link (c, obj);
+          else
+            {
+              obj = (uint8_t *) s + SLAB_HEADER + s->fresh++ * c->obj_size;
+              if (c->ctor != NULL)
+                c->ctor (obj);
+            }
+          s->in_use++;
+          objs[n++] = obj;
+        }
+      if (s->in_use == c->obj_cnt)
+        list_remove (&s->elem);
+    }
+  lock_release (&c->lock);
+  return n;
+}
+
+/* Gives the CNT objects in OBJS back to their slabs in C.  A slab
+   left wholly free is given back to the page allocator, unless
+   it is the only such slab, which is kept for the next refill. */
+static void
+slab_put (struct slab_cache *c, void **objs, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&c->lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct slab *s = obj_to_slab (c, objs[i]);
+
+      if (s->in_use == c->obj_cnt)
+        list_push_back (&c->partial, &s->elem);
+      *obj_link (c, objs[i]) = s->free;
+      s->free = objs[i];
+      if (--s->in_use == 0)
+        {
+          if (c->empty_cnt > 0)
+            {
+              list_remove (&s->elem);
+              palloc_free_page (s);
+            }
+          else
+            c->empty_cnt++;
+        }
+    }
+  lock_release (&c->lock);
+}
+
+/* Returns the slab of C that OBJ is inside. */
+static struct slab *
+obj_to_slab (struct slab_cache *c, void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  ASSERT ((pg_ofs (obj) - SLAB_HEADER) % c->obj_size == 0);
+  return s;
+}
@@ -0,0 +1,18 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Constructor, run once on each object when its slab is made.
+   Objects must be given back to slab_free() in the state it
+   leaves them in. */
+typedef void slab_ctor_func (void *obj);
+
+struct slab_cache;
+
+struct slab_cache *slab_cache_create (const char *name, size_t size,
+                                      slab_ctor_func *);
+void *slab_alloc (struct slab_cache *) __attribute__ ((malloc));
+void slab_free (struct slab_cache *, void *);
+
+#endif /* threads/slab.h */
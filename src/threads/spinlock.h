@@ -0,0 +1,59 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <debug.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+/* A spinlock guards data touched by interrupt handlers or kept
+   for only a few instructions, such as a semaphore's waiter
+   list.  Acquiring it disables interrupts on this CPU, which is
+   all a uniprocessor needs, and then takes LOCKED with an atomic
+   exchange, which keeps other CPUs out as well.  It must never
+   be held across anything that sleeps. */
+struct spinlock
+  {
+    volatile uint32_t locked;   /* Nonzero while held. */
+  };
+
+/* Initializes LOCK as released. */
+static inline void
+spinlock_init (struct spinlock *lock)
+{
+  lock->locked = 0;
+}
+
+/* Disables interrupts, then acquires LOCK, busy-waiting while
+   another CPU holds it.  Returns the previous interrupt level,
+   to be passed to spinlock_release(). */
+static inline enum intr_level
+spinlock_acquire (struct spinlock *lock)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t busy = 1;
+
+  for (;;)
+    {
+      asm volatile ("xchgl %0, %1"
+                    : "+r" (busy), "+m" (lock->locked) : : "memory");
+      if (busy == 0)
+        break;
+      while (lock->locked != 0)
+        asm volatile ("pause");
+      busy = 1;
+    }
+  return old_level;
+}
+
+/* Releases LOCK and restores interrupt level OLD_LEVEL. */
+static inline void
+spinlock_release (struct spinlock *lock, enum intr_level old_level)
+{
+  ASSERT (lock->locked != 0);
+
+  asm volatile ("" : : : "memory");
+  lock->locked = 0;
+  intr_set_level (old_level);
+}
+
+#endif /* threads/spinlock.h */
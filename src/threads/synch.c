@@ -29,8 +29,29 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
+#include "threads/perf.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+
+/* Number of times lock_acquire() checks a lock whose holder is
+   running on another CPU before it blocks. */
+#define LOCK_SPIN_MAX 1000
+
+/* Maximum number of lock classes. */
+#define LOCK_CLASS_MAX 32
+
+/* If true, locks with a class collect statistics. */
+bool lock_profile;
+
+/* Lock classes, protected by disabling interrupts. */
+static struct lock_class lock_classes[LOCK_CLASS_MAX];
+static int lock_class_cnt;
+
+static int sema_wake (struct semaphore *);
+static heap_less_func sema_waiter_less;
+static void lock_account (struct lock *, bool contended, int64_t wait);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -47,7 +68,9 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, sema_waiter_less, NULL);
+  sema->arrivals = 0;
+  spinlock_init (&sema->guard);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -66,14 +89,22 @@ sema_down (struct semaphore *sema)
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
-  old_level = intr_disable ();
+  old_level = spinlock_acquire (&sema->guard);
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      /* The waiter on top of the heap is the one to wake and,
+         for a lock, the one whose priority is donated.
+         Interrupts stay off until we block, so a wakeup cannot
+         come before it. */
+      struct thread *t = thread_current ();
+      t->wait_arrival = sema->arrivals++;
+      heap_insert (&sema->waiters, &t->wait_elem);
+      spinlock_release (&sema->guard, INTR_OFF);
       thread_block ();
+      spinlock_acquire (&sema->guard);
     }
   sema->value--;
-  intr_set_level (old_level);
+  spinlock_release (&sema->guard, old_level);
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -89,7 +120,7 @@ sema_try_down (struct semaphore *sema)
 
   ASSERT (sema != NULL);
 
-  old_level = intr_disable ();
+  old_level = spinlock_acquire (&sema->guard);
   if (sema->value > 0) 
     {
       sema->value--;
@@ -97,7 +128,7 @@ sema_try_down (struct semaphore *sema)
     }
   else
     success = false;
-  intr_set_level (old_level);
+  spinlock_release (&sema->guard, old_level);
 
   return success;
 }
@@ -109,22 +140,53 @@ sema_try_down (struct semaphore *sema)
 void
 sema_up (struct semaphore *sema) 
 {
-  enum intr_level old_level;
-
   ASSERT (sema != NULL);
 
-  old_level = intr_disable ();
+  /* Let a woken thread of higher priority run, after returning
+     from the interrupt if we are in one. */
+  if (sema_wake (sema) > thread_get_priority ())
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
+}
+
+/* Up operation on SEMA that does not yield.  Returns the
+   priority of the thread woken, or -1 if there was none. */
+static int
+sema_wake (struct semaphore *sema)
+{
+  enum intr_level old_level;
+  int priority = -1;
+
+  old_level = spinlock_acquire (&sema->guard);
   sema->value++;
-  if (!list_empty (&sema->waiters))
+  if (!heap_empty (&sema->waiters))
     {
-      list_sort (&sema->waiters, thread_compare_priority, NULL);
-      struct thread *t = list_entry (list_pop_front (&sema->waiters),
-                                     struct thread, elem);
+      struct thread *t = heap_entry (heap_pop (&sema->waiters),
+                                     struct thread, wait_elem);
       thread_unblock (t);
-      if (t->priority > thread_get_priority ())
-        thread_yield ();
+      priority = t->priority;
     }
-  intr_set_level (old_level);
+  spinlock_release (&sema->guard, old_level);
+  return priority;
+}
+
+/* Returns true if the thread waiting at A should be woken
+   before the one at B: it has a higher priority, or the same
+   priority and it came first. */
+static bool
+sema_waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, wait_elem);
+  const struct thread *b = heap_entry (b_, struct thread, wait_elem);
+
+  if (a->priority != b->priority)
+    return a->priority > b->priority;
+  return (int) (a->wait_arrival - b->wait_arrival) < 0;
 }
 
 static void sema_test_helper (void *sema_);
@@ -166,6 +228,8 @@ sema_test_helper (void *sema_)
 
 static void lock_donate (struct lock *);
 static int lock_retrieve (void);
+static void sema_reorder (struct semaphore *, struct thread *);
+static void cond_reorder (struct thread *);
 
 /* Initializes LOCK.  A lock can be held by at most a single
    thread at any given time.  Our locks are not "recursive", that
@@ -188,9 +252,57 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->class = NULL;
+  lock->acquired = 0;
   sema_init (&lock->semaphore, 1);
 }
 
+/* Puts LOCK in the class called NAME for statistics, creating
+   the class if it is new.  Locks that guard the same kind of
+   object, such as the locks of all inodes, share a class.  If
+   there are too many classes, LOCK is left without one. */
+void
+lock_set_name (struct lock *lock, const char *name)
+{
+  enum intr_level old_level;
+  int i;
+
+  ASSERT (lock != NULL);
+  ASSERT (name != NULL);
+
+  old_level = intr_disable ();
+  for (i = 0; i < lock_class_cnt; i++)
+    if (!strcmp (lock_classes[i].name, name))
+      break;
+  if (i == lock_class_cnt && lock_class_cnt < LOCK_CLASS_MAX)
+    lock_classes[lock_class_cnt++].name = name;
+  if (i < lock_class_cnt)
+    lock->class = &lock_classes[i];
+  intr_set_level (old_level);
+}
+
+/* Prints the statistics of the lock classes that were used. */
+void
+lock_print_stats (void)
+{
+  int i;
+
+  if (!lock_profile)
+    return;
+  for (i = 0; i < lock_class_cnt; i++)
+    {
+      struct lock_class *c = &lock_classes[i];
+      if (c->acquire_cnt == 0)
+        continue;
+      printf ("Lock %s: %lld acquired, %lld contended, "
+              "%lld ticks waited (%lld max), "
+              "%lld ticks held (%lld max)\n",
+              c->name, c->acquire_cnt, c->contended_cnt,
+              c->wait_ticks, c->max_wait_ticks,
+              c->hold_ticks, c->max_hold_ticks);
+    }
+}
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
@@ -198,21 +310,52 @@ lock_init (struct lock *lock)
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
-   we need to sleep. */
+   we need to sleep.
+
+   The lock is adaptive: while its holder is running, which can
+   only be on another CPU, the critical section will likely end
+   sooner than a context switch would, so we spin for a while
+   first.  A holder that is not running makes us block at once,
+   donating our priority to it. */
 void
 lock_acquire (struct lock *lock)
 {
+  int spins;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  if (lock->holder != NULL)
+  for (spins = 0; spins < LOCK_SPIN_MAX; spins++)
+    {
+      struct thread *holder = lock->holder;
+      if (holder == NULL)
+        {
+          /* Failing here means a woken waiter is about to take
+             the lock. */
+          if (lock_try_acquire (lock))
+            return;
+          break;
+        }
+      else if (holder->status != THREAD_RUNNING)
+        break;
+      asm volatile ("pause");
+    }
+
+  int64_t start = lock_profile ? timer_ticks () : 0;
+
+  perf_inc (PERF_LOCK_CONTENDED);
+  trace (TRACE_LOCK_WAIT, (uintptr_t) lock);
+  if (lock->holder != NULL && !thread_mlfqs)
     lock_donate (lock);
   thread_current ()->waiting_lock = lock;
   sema_down (&lock->semaphore);
+  trace (TRACE_LOCK_TAKEN, (uintptr_t) lock);
   lock->holder = thread_current ();
   thread_current ()->waiting_lock = NULL;
   list_push_back (&thread_current ()->lock_list, &lock->elem);
+  if (lock_profile)
+    lock_account (lock, true, timer_elapsed (start));
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -235,6 +378,8 @@ lock_try_acquire (struct lock *lock)
       lock->holder = thread_current ();
       thread_current ()->waiting_lock = NULL;
       list_push_back (&thread_current ()->lock_list, &lock->elem);
+      if (lock_profile)
+        lock_account (lock, false, 0);
     }
   return success;
 }
@@ -252,11 +397,53 @@ lock_release (struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
 
   list_remove (&lock->elem);
-  thread_current ()->priority = lock_retrieve ();
+  if (!thread_mlfqs)
+    thread_current ()->priority = lock_retrieve ();
+  if (lock_profile && lock->class != NULL)
+    {
+      int64_t held = timer_elapsed (lock->acquired);
+      enum intr_level old_level = intr_disable ();
+      lock->class->hold_ticks += held;
+      if (held > lock->class->max_hold_ticks)
+        lock->class->max_hold_ticks = held;
+      intr_set_level (old_level);
+    }
   lock->holder = NULL;
   sema_up (&lock->semaphore);
 }
 
+/* Preemption point for long loops that hold LOCK, which the
+   current thread must hold.  If a thread of higher priority than
+   the current thread's own is waiting for LOCK, releases LOCK,
+   which lets that thread run and take it, then acquires LOCK
+   again and returns true, to tell the caller that what LOCK
+   protects may have changed.  Otherwise returns false at once.
+
+   A waiter of lower priority would not run before LOCK is taken
+   back, so it is not worth the switch. */
+bool
+lock_yield (struct lock *lock)
+{
+  struct semaphore *sema = &lock->semaphore;
+  struct thread *curr = thread_current ();
+  enum intr_level old_level;
+  int priority = -1;
+
+  ASSERT (lock_held_by_current_thread (lock));
+
+  old_level = spinlock_acquire (&sema->guard);
+  if (!heap_empty (&sema->waiters))
+    priority = heap_entry (heap_top (&sema->waiters),
+                           struct thread, wait_elem)->priority;
+  spinlock_release (&sema->guard, old_level);
+
+  if (priority <= (thread_mlfqs ? curr->priority : curr->priority_orig))
+    return false;
+  lock_release (lock);
+  lock_acquire (lock);
+  return true;
+}
+
 /* Returns true if the current thread holds LOCK, false
    otherwise.  (Note that testing whether some other thread holds
    a lock would be racy.) */
@@ -268,6 +455,30 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
+/* Counts an acquisition of LOCK, which the current thread has
+   just taken, in its class.  CONTENDED tells whether it had to
+   block, for WAIT ticks. */
+static void
+lock_account (struct lock *lock, bool contended, int64_t wait)
+{
+  struct lock_class *c = lock->class;
+  enum intr_level old_level;
+
+  if (c == NULL)
+    return;
+  lock->acquired = timer_ticks ();
+  old_level = intr_disable ();
+  c->acquire_cnt++;
+  if (contended)
+    {
+      c->contended_cnt++;
+      c->wait_ticks += wait;
+      if (wait > c->max_wait_ticks)
+        c->max_wait_ticks = wait;
+    }
+  intr_set_level (old_level);
+}
+
 /* Donates the priority of the current thread to holder thread of
    desired lock recursively if the current one has a higher priority. */
 static void
@@ -276,18 +487,37 @@ lock_donate (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (lock->holder != NULL);
 
-  if (thread_current ()->priority > lock->holder->priority)
+  struct thread *holder = lock->holder;
+  if (thread_current ()->priority > holder->priority)
     {
-      lock->holder->priority = thread_current ()->priority;
-      if (lock->holder->waiting_lock != NULL)
-        lock_donate (lock->holder->waiting_lock);
+      thread_donate_priority (holder, thread_current ()->priority);
+      if (holder->waiting_lock != NULL)
+        {
+          sema_reorder (&holder->waiting_lock->semaphore, holder);
+          lock_donate (holder->waiting_lock);
+        }
+      else if (holder->cond_waiter != NULL)
+        cond_reorder (holder);
     }
 }
 
+/* Moves thread T, whose priority was raised, to its place in
+   SEMA's waiters if it is waiting there.  T may also be about to
+   wait on SEMA, having been preempted before it blocked. */
+static void
+sema_reorder (struct semaphore *sema, struct thread *t)
+{
+  enum intr_level old_level = spinlock_acquire (&sema->guard);
+  if (t->status == THREAD_BLOCKED)
+    heap_decrease (&sema->waiters, &t->wait_elem);
+  spinlock_release (&sema->guard, old_level);
+}
+
 /* Retrieves the priority of the current thread. Among priorities from
    waiting threads for locks held by the current thread together with
    the original priority of the current thread, find the maximum priority
-   and returns it. */
+   and returns it.  Each lock's top waiter has the highest priority
+   among its waiters, so this takes one step per lock held. */
 static int
 lock_retrieve ()
 {
@@ -301,10 +531,11 @@ lock_retrieve ()
   for (e = list_begin (list); e != list_end (list); e = list_next (e))
     {
       struct semaphore *sema = &list_entry (e, struct lock, elem)->semaphore;
-      if (!list_empty (&sema->waiters))
+      if (!heap_empty (&sema->waiters))
         {
-          int temp_priority = list_entry (list_begin (&sema->waiters),
-                                          struct thread, elem)->priority;
+          int temp_priority = heap_entry (heap_top (&sema->waiters),
+                                          struct thread,
+                                          wait_elem)->priority;
           if (temp_priority > priority)
             priority = temp_priority;
         }
@@ -312,23 +543,49 @@ lock_retrieve ()
   return priority;
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem 
+/* A thread waiting on a condition variable, on its stack. */
+struct cond_waiter
   {
     struct list_elem elem;              /* List element. */
-    struct semaphore semaphore;         /* This semaphore. */
-    int priority;                       /* Priority. */
+    struct semaphore semaphore;         /* Upped to wake THREAD. */
+    struct thread *thread;              /* Waiting thread. */
+    struct condition *cond;             /* Condition waited on. */
   };
 
-/* Compares priorities of two waiters and returns true
-   if previous one has higher priority. */
+/* Compares the current priorities of two waiters and returns
+   true if the previous one has higher priority. */
 static bool
 cond_compare_priority (const struct list_elem *e1, const struct list_elem *e2,
                        void *aux UNUSED)
 {
-  struct semaphore_elem *s1 = list_entry (e1, struct semaphore_elem, elem);
-  struct semaphore_elem *s2 = list_entry (e2, struct semaphore_elem, elem);
-  return s1->priority > s2->priority;
+  struct cond_waiter *w1 = list_entry (e1, struct cond_waiter, elem);
+  struct cond_waiter *w2 = list_entry (e2, struct cond_waiter, elem);
+  return w1->thread->priority > w2->thread->priority;
+}
+
+/* Moves thread T, whose priority was raised by donation while
+   it waits on a condition variable, to its place among the
+   condition's waiters.  T's waiter stays on its stack until it
+   is woken, which cannot happen with interrupts off. */
+static void
+cond_reorder (struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+  struct cond_waiter *w = t->cond_waiter;
+
+  if (w != NULL)
+    {
+      struct condition *cond = w->cond;
+      spinlock_acquire (&cond->guard);
+      if (t->cond_waiter == w)
+        {
+          list_remove (&w->elem);
+          list_insert_ordered (&cond->waiters, &w->elem,
+                               cond_compare_priority, NULL);
+        }
+      spinlock_release (&cond->guard, INTR_OFF);
+    }
+  intr_set_level (old_level);
 }
 
 /* Initializes condition variable COND.  A condition variable
@@ -340,6 +597,7 @@ cond_init (struct condition *cond)
   ASSERT (cond != NULL);
 
   list_init (&cond->waiters);
+  spinlock_init (&cond->guard);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -358,6 +616,10 @@ cond_init (struct condition *cond)
    condition variables.  That is, there is a one-to-many mapping
    from locks to condition variables.
 
+   Waiters are kept in order of priority, and a waiter whose
+   priority is raised by donation moves up, so the one signaled
+   is always at the front.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -365,7 +627,8 @@ cond_init (struct condition *cond)
 void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
-  struct semaphore_elem waiter;
+  struct cond_waiter waiter;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
@@ -373,9 +636,13 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  waiter.priority = thread_get_priority ();
+  waiter.thread = thread_current ();
+  waiter.cond = cond;
+  old_level = spinlock_acquire (&cond->guard);
   list_insert_ordered (&cond->waiters, &waiter.elem,
                        cond_compare_priority, NULL);
+  waiter.thread->cond_waiter = &waiter;
+  spinlock_release (&cond->guard, old_level);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
@@ -391,14 +658,24 @@ cond_wait (struct condition *cond, struct lock *lock)
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED) 
 {
+  struct cond_waiter *w = NULL;
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = spinlock_acquire (&cond->guard);
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      w = list_entry (list_pop_front (&cond->waiters),
+                      struct cond_waiter, elem);
+      w->thread->cond_waiter = NULL;
+    }
+  spinlock_release (&cond->guard, old_level);
+  if (w != NULL)
+    sema_up (&w->semaphore);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -406,13 +683,124 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
-   interrupt handler. */
+   interrupt handler.
+
+   The waiters are taken off COND at once and woken in one pass,
+   and we yield at most once, at the end, rather than to each
+   waiter of higher priority in turn. */
 void
-cond_broadcast (struct condition *cond, struct lock *lock) 
+cond_broadcast (struct condition *cond, struct lock *lock UNUSED) 
 {
+  struct list woken;
+  struct list_elem *e, *next;
+  enum intr_level old_level;
+  int priority = -1;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  list_init (&woken);
+  old_level = spinlock_acquire (&cond->guard);
+  list_splice (list_end (&woken), list_begin (&cond->waiters),
+               list_end (&cond->waiters));
+  for (e = list_begin (&woken); e != list_end (&woken); e = list_next (e))
+    list_entry (e, struct cond_waiter, elem)->thread->cond_waiter = NULL;
+  spinlock_release (&cond->guard, old_level);
+
+  /* A woken waiter's element is gone once it runs, so the next
+     one is found first. */
+  for (e = list_begin (&woken); e != list_end (&woken); e = next)
+    {
+      struct cond_waiter *w = list_entry (e, struct cond_waiter, elem);
+      int p;
+
+      next = list_next (e);
+      p = sema_wake (&w->semaphore);
+      if (p > priority)
+        priority = p;
+    }
+  if (priority > thread_get_priority ())
+    thread_yield ();
+}
+
+/* Initializes read-write lock RW.  Any number of readers may
+   hold RW at once, or a single writer.
+
+   Readers and writers alike pass through TURNSTILE, which a
+   writer keeps until it is done.  Waiters therefore queue in
+   priority order behind a writer and donate their priority to
+   it, and readers arriving after a waiting writer cannot starve
+   it.  A writer that holds the turnstile then waits for the
+   readers already inside to leave. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->turnstile);
+  lock_init (&rw->guard);
+  cond_init (&rw->drained);
+  rw->readers = 0;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   waits for it.  Must not be called with RW held. */
+void
+rwlock_read_acquire (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->turnstile);
+  lock_acquire (&rw->guard);
+  rw->readers++;
+  lock_release (&rw->guard);
+  lock_release (&rw->turnstile);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_read_release (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->guard);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    cond_signal (&rw->drained, &rw->guard);
+  lock_release (&rw->guard);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it.  Must not be called with RW held. */
+void
+rwlock_write_acquire (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->turnstile);
+  lock_acquire (&rw->guard);
+  while (rw->readers > 0)
+    cond_wait (&rw->drained, &rw->guard);
+  lock_release (&rw->guard);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_write_release (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (lock_held_by_current_thread (&rw->turnstile));
+
+  lock_release (&rw->turnstile);
+}
+
+/* Returns true if the current thread holds RW for writing. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
 
-  while (!list_empty (&cond->waiters))
-    cond_signal (cond, lock);
+  return lock_held_by_current_thread (&rw->turnstile);
 }
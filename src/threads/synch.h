@@ -1,14 +1,20 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/spinlock.h"
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, highest priority
+                                   on top. */
+    unsigned arrivals;          /* Waits so far, to order equals. */
+    struct spinlock guard;      /* Protects the members above. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -17,24 +23,47 @@ bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* Statistics of a named class of locks, collected while
+   LOCK_PROFILE is true.  Times are in timer ticks. */
+struct lock_class
+  {
+    const char *name;           /* Class name. */
+    long long acquire_cnt;      /* Acquisitions. */
+    long long contended_cnt;    /* Acquisitions that had to block. */
+    int64_t wait_ticks;         /* Total time blocked. */
+    int64_t max_wait_ticks;     /* Longest time blocked. */
+    int64_t hold_ticks;         /* Total time held. */
+    int64_t max_hold_ticks;     /* Longest time held. */
+  };
+
+/* If true, locks with a class collect statistics.
+   Controlled by kernel command-line option "-lockstat". */
+extern bool lock_profile;
+
 /* Lock. */
 struct lock 
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
     struct list_elem elem;      /* List element. */
+    struct lock_class *class;   /* Statistics, or NULL. */
+    int64_t acquired;           /* Tick at which HOLDER took the lock. */
   };
 
 void lock_init (struct lock *);
+void lock_set_name (struct lock *, const char *name);
+void lock_print_stats (void);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
+bool lock_yield (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct list waiters;        /* Waiters, highest priority first. */
+    struct spinlock guard;      /* Protects WAITERS. */
   };
 
 void cond_init (struct condition *);
@@ -42,6 +71,22 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Read-write lock. */
+struct rwlock
+  {
+    struct lock turnstile;      /* Passed by all, held by a writer. */
+    struct lock guard;          /* Protects READERS. */
+    struct condition drained;   /* Signaled when READERS drops to 0. */
+    int readers;                /* Number of readers holding the lock. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_read_acquire (struct rwlock *);
+void rwlock_read_release (struct rwlock *);
+void rwlock_write_acquire (struct rwlock *);
+void rwlock_write_release (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -4,12 +4,17 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/perf.h"
+#include "threads/rcu.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #ifdef USERPROG
 #include "threads/malloc.h"
@@ -25,9 +30,22 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, in one FIFO queue per
+   priority. */
+static struct list ready_queues[PRI_MAX + 1];
+
+/* Bit P of word P / 32 is set iff ready_queues[P] is nonempty,
+   so the highest nonempty queue is found with one bit scan. */
+#define READY_WORDS ((PRI_MAX + 32) / 32)
+static uint32_t ready_bits[READY_WORDS];
+
+/* Number of threads in the run queues. */
+static int ready_cnt;
+
+/* List of all live threads except the idle thread, for the
+   MLFQS scheduler's once a second update. */
+static struct list all_list;
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -35,8 +53,15 @@ static struct thread *idle_thread;
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
-static struct lock tid_lock;
+/* Most pages of dead threads kept for new threads.  Taking one
+   from here skips the page allocator's lock and bitmap scan, and
+   the zeroing of a page that init_thread() clears anyway. */
+#define THREAD_PAGE_CACHE 8
+
+/* Pages of dead threads, protected by disabling interrupts, as
+   schedule_tail() adds to it with interrupts off. */
+static void *thread_pages[THREAD_PAGE_CACHE];
+static size_t thread_page_cnt;
 
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
@@ -53,24 +78,47 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+#define RT_TIME_SLICE 2         /* # of timer ticks for SCHED_RR. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
+/* Time slice of each scheduling class in timer ticks. */
+unsigned thread_slice[SCHED_CLASS_CNT] =
+  {
+    [SCHED_RR] = RT_TIME_SLICE,
+    [SCHED_NORMAL] = TIME_SLICE,
+    [SCHED_IDLE] = TIME_SLICE,
+  };
+
+/* Wakeup boost, in priority levels.  See thread.h. */
+int thread_boost;
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* System load average for the MLFQS scheduler. */
+static fixed_t load_avg;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
-static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
+static void unblock (struct thread *, bool boost);
+static void unboost (struct thread *);
+static void ready_insert (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_priority (void);
+static void mlfqs_update_priority (struct thread *);
+static void mlfqs_update_second (void);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static struct thread *thread_page_get (void);
+static void thread_page_free (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -90,8 +138,11 @@ thread_init (void)
 {
   ASSERT (intr_get_level () == INTR_OFF);
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
+  size_t i;
+
+  for (i = 0; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -121,10 +172,11 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+/* Called by the timer interrupt handler at each timer tick, with
+   USER true if the tick interrupted user mode.  Thus, this
+   function runs in an external interrupt context. */
 void
-thread_tick (void) 
+thread_tick (bool user) 
 {
   struct thread *t = thread_current ();
 
@@ -137,9 +189,42 @@ thread_tick (void)
 #endif
   else
     kernel_ticks++;
+  if (user)
+    t->rusage.utime++;
+  else if (t != idle_thread)
+    t->rusage.stime++;
+
+  /* Only the running thread's recent_cpu changes between the
+     updates once a second, so only its priority needs updating
+     every fourth tick.  Yield if it falls below a ready thread. */
+  if (thread_mlfqs)
+    {
+      int64_t ticks = timer_ticks ();
+
+      if (t != idle_thread)
+        t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+      if (ticks % TIMER_FREQ == 0)
+        mlfqs_update_second ();
+      if (ticks % TIME_SLICE == 0 && t != idle_thread)
+        {
+          mlfqs_update_priority (t);
+          if (ready_priority () > t->priority)
+            intr_yield_on_return ();
+        }
+    }
+
+  /* A wakeup boost lasts for a tick of running at most. */
+  if (t->boost_base >= 0)
+    {
+      unboost (t);
+      if (ready_priority () > t->priority)
+        intr_yield_on_return ();
+    }
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  /* Enforce preemption once the time slice of the thread's class
+     is used up.  SCHED_FIFO threads have none. */
+  if (t->sched_class != SCHED_FIFO
+      && ++thread_ticks >= thread_slice[t->sched_class])
     intr_yield_on_return ();
 }
 
@@ -179,13 +264,20 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_get ();
   if (t == NULL)
     return TID_ERROR;
 
-  /* Initialize thread. */
+  /* Initialize thread.  Under the MLFQS scheduler it inherits
+     niceness and recent CPU time, which determine its priority. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  if (thread_mlfqs)
+    {
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      mlfqs_update_priority (t);
+    }
 
 #ifdef USERPROG
   struct process *curr_proc = process_current ();
@@ -199,7 +291,10 @@ thread_create (const char *name, int priority,
   new_proc_info = (struct process_info *) malloc (sizeof (struct process_info));
   if (new_proc_info == NULL)
     {
-      palloc_free_page (t);
+      enum intr_level old_level = intr_disable ();
+      list_remove (&t->allelem);
+      intr_set_level (old_level);
+      thread_page_free (t);
       return TID_ERROR;
     }
 
@@ -209,7 +304,9 @@ thread_create (const char *name, int priority,
   new_proc_info->status = PROCESS_LOADING;
   new_proc_info->exit_code = -1;
   new_proc_info->is_waiting = false;
-  list_push_back (&curr_proc->child_list, &new_proc_info->elem);
+  sema_init (&new_proc_info->loaded, 0);
+  sema_init (&new_proc_info->exited, 0);
+  process_add_child (curr_proc, new_proc_info);
 #endif
 
   /* Stack frame for kernel_thread(). */
@@ -227,7 +324,7 @@ thread_create (const char *name, int priority,
   sf->eip = switch_entry;
 
   /* Add to run queue. */
-  thread_unblock (t);
+  unblock (t, false);
 
   /* Yield for preemption. */
   if (t->priority > thread_get_priority ())
@@ -248,6 +345,8 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  trace (TRACE_BLOCK, 0);
+  unboost (thread_current ());
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -262,6 +361,18 @@ thread_block (void)
    update other data. */
 void
 thread_unblock (struct thread *t) 
+{
+  unblock (t, true);
+}
+
+/* Makes blocked thread T ready to run, giving it a wakeup boost
+   if BOOST is true and T qualifies: a SCHED_NORMAL thread that
+   was not waiting for a lock, which is likely to have waited for
+   I/O, a timer or another thread.  Such a thread goes ahead of
+   CPU-bound threads of its own priority, so it gets the CPU back
+   without waiting out their time slices. */
+static void
+unblock (struct thread *t, bool boost) 
 {
   enum intr_level old_level;
 
@@ -269,11 +380,38 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_insert_ordered (&ready_list, &t->elem, thread_compare_priority, NULL);
+  trace (TRACE_UNBLOCK, t->tid);
+  if (boost && thread_boost > 0 && !thread_mlfqs
+      && t->sched_class == SCHED_NORMAL && t->waiting_lock == NULL)
+    {
+      t->boost_base = t->priority;
+      t->priority = (t->priority + thread_boost < PRI_MAX
+                     ? t->priority + thread_boost : PRI_MAX);
+    }
+  ready_insert (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
 
+/* Ends the wakeup boost of T, which is running, if it has one.
+   A priority that changed meanwhile, by donation or otherwise,
+   is left alone.  Interrupts must be off. */
+static void
+unboost (struct thread *t) 
+{
+  int boosted;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->boost_base < 0)
+    return;
+  boosted = (t->boost_base + thread_boost < PRI_MAX
+             ? t->boost_base + thread_boost : PRI_MAX);
+  if (t->priority == boosted)
+    t->priority = t->boost_base;
+  t->boost_base = -1;
+}
+
 /* Returns the name of the running thread. */
 const char *
 thread_name (void) 
@@ -317,10 +455,13 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
+  ASSERT (thread_current ()->rcu_nesting == 0);
 
   /* Just set our status to dying and schedule another process.
      We will be destroyed during the call to schedule_tail(). */
   intr_disable ();
+  list_remove (&thread_current ()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -338,18 +479,20 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (curr != idle_thread)
-    list_insert_ordered (&ready_list, &curr->elem,
-                         thread_compare_priority, NULL);
+    ready_insert (curr);
   curr->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY.  Ignored
+   under the MLFQS scheduler, which computes priorities itself. */
 void
 thread_set_priority (int new_priority) 
 {
   struct thread *curr = thread_current ();
+  if (thread_mlfqs)
+    return;
   int old_priority = curr->priority;
   if (curr->priority == curr->priority_orig || new_priority > old_priority)
     curr->priority = new_priority;
@@ -365,47 +508,135 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Compares priorities of two threads and returns true
-   if previous one has higher priority. */
-bool
-thread_compare_priority (const struct list_elem *e1,
-                         const struct list_elem *e2, void *aux UNUSED)
+/* Raises the priority of thread T to PRIORITY by donation,
+   moving T to the matching run queue if it is ready. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  old_level = intr_disable ();
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_insert (t);
+    }
+  else
+    t->priority = priority;
+  intr_set_level (old_level);
+}
+
+/* Puts the current thread, which must hold no locks, in
+   scheduling class CLASS with PRIORITY, or PRI_MIN for
+   SCHED_IDLE.  The MLFQS scheduler leaves the priorities of
+   threads outside SCHED_NORMAL alone, so kernel service threads
+   keep theirs. */
+void
+thread_set_class (enum sched_class class, int priority)
 {
-  struct thread *t1 = list_entry (e1, struct thread, elem);
-  struct thread *t2 = list_entry (e2, struct thread, elem);
-  return t1->priority > t2->priority;
+  struct thread *curr = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (class < SCHED_CLASS_CNT);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+  ASSERT (list_empty (&curr->lock_list));
+
+  if (class == SCHED_IDLE)
+    priority = PRI_MIN;
+  old_level = intr_disable ();
+  curr->sched_class = class;
+  curr->priority = priority;
+  curr->priority_orig = priority;
+  if (ready_priority () > priority)
+    thread_yield ();
+  intr_set_level (old_level);
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it is no longer the highest. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *curr = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  curr->nice = nice;
+  if (thread_mlfqs)
+    {
+      mlfqs_update_priority (curr);
+      if (ready_priority () > curr->priority)
+        thread_yield ();
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+  return recent_cpu_100;
+}
+
+/* Adds the resource use in SRC to DST. */
+void
+rusage_add (struct rusage *dst, const struct rusage *src)
+{
+  dst->utime += src->utime;
+  dst->stime += src->stime;
+  dst->minflt += src->minflt;
+  dst->majflt += src->majflt;
+  dst->inblock += src->inblock;
+  dst->oublock += src->oublock;
+  dst->nvcsw += src->nvcsw;
+  dst->nivcsw += src->nivcsw;
+}
+
+#ifdef USERPROG
+/* Adds the resource use of every live thread of the process led
+   by LEADER, LEADER included, to RU. */
+void
+thread_rusage_process (const struct thread *leader, struct rusage *ru)
+{
+  enum intr_level old_level = intr_disable ();
+  struct list_elem *e;
+
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      if (t->leader == leader && t->status != THREAD_DYING)
+        rusage_add (ru, &t->rusage);
+    }
+  intr_set_level (old_level);
 }
+#endif
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
@@ -421,13 +652,22 @@ idle (void *idle_started_ UNUSED)
 {
   struct semaphore *idle_started = idle_started_;
   idle_thread = thread_current ();
+  intr_disable ();
+  list_remove (&idle_thread->allelem);
+  intr_enable ();
   sema_up (idle_started);
 
   for (;;) 
     {
+      /* Zero free pages while there is nothing else to do.  A
+         thread woken meanwhile preempts this one. */
+      while (palloc_zero_idle ())
+        continue;
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
+      timer_idle_enter ();
 
       /* Re-enable interrupts and wait for the next one.
 
@@ -441,6 +681,7 @@ idle (void *idle_started_ UNUSED)
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
          7.11.1 "HLT Instruction". */
+      intr_enabling ();
       asm volatile ("sti; hlt" : : : "memory");
     }
 }
@@ -456,7 +697,9 @@ kernel_thread (thread_func *function, void *aux)
   thread_exit ();       /* If function() returns, kill the thread. */
 }
 
-/* Returns the running thread. */
+/* Returns the running thread, without thread_current()'s checks,
+   so that it works while the thread's status is changing, as in
+   schedule(). */
 struct thread *
 running_thread (void) 
 {
@@ -482,6 +725,8 @@ is_thread (struct thread *t)
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
+  enum intr_level old_level;
+
   ASSERT (t != NULL);
   ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
   ASSERT (name != NULL);
@@ -492,19 +737,127 @@ init_thread (struct thread *t, const char *name, int priority)
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
   t->priority_orig = priority;
+  t->boost_base = -1;
   t->waiting_lock = NULL;
+  t->cond_waiter = NULL;
   list_init (&t->lock_list);
+  t->sched_class = SCHED_NORMAL;
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = 0;
   t->magic = THREAD_MAGIC;
 
+  old_level = intr_disable ();
+  list_push_back (&all_list, &t->allelem);
+  intr_set_level (old_level);
+
 #ifdef USERPROG
+  t->leader = t;
   list_init (&(&t->process)->child_list);
-  list_init (&(&t->process)->file_list);
+  list_init (&t->process.exited_list);
+  cond_init (&t->process.child_exited);
+  t->process.thread_cnt = 0;
+  t->process.exiting = false;
+  t->process.stdin_flags = 0;
+  lock_init (&t->process.thread_lock);
+  cond_init (&t->process.thread_done);
 #ifdef VM
-  list_init (&(&t->process)->mmap_list);
+  process_mmap_init (&t->process);
 #endif
 #endif
 }
 
+/* Appends T to the run queue for its priority.  Interrupts must
+   be off. */
+static void
+ready_insert (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_bits[t->priority / 32] |= 1u << t->priority % 32;
+  ready_cnt++;
+}
+
+/* Removes T from its run queue.  Interrupts must be off. */
+static void
+ready_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_bits[t->priority / 32] &= ~(1u << t->priority % 32);
+  ready_cnt--;
+}
+
+/* Returns the highest priority of a ready thread, or -1 if no
+   thread is ready.  Interrupts must be off. */
+static int
+ready_priority (void)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = READY_WORDS - 1; i >= 0; i--)
+    if (ready_bits[i] != 0)
+      return i * 32 + 31 - __builtin_clz (ready_bits[i]);
+  return -1;
+}
+
+/* Recomputes the MLFQS priority of T from its recent_cpu and
+   nice values, moving T to the matching run queue if it is
+   ready.  Interrupts must be off unless T is not yet running. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority = PRI_MAX - fp_trunc (t->recent_cpu / 4) - t->nice * 2;
+
+  if (t->sched_class != SCHED_NORMAL)
+    return;
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  if (priority == t->priority)
+    return;
+
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_insert (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Updates the load average, then decays every thread's
+   recent_cpu and recomputes its priority.  Called once a second
+   from the timer interrupt.  The decay factor is computed once,
+   so each thread costs a multiplication. */
+static void
+mlfqs_update_second (void)
+{
+  struct thread *curr = thread_current ();
+  int ready_threads = ready_cnt + (curr != idle_thread);
+  fixed_t decay;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  load_avg = (load_avg * 59 + fp_from_int (ready_threads)) / 60;
+  decay = fp_div (load_avg * 2, fp_add_int (load_avg * 2, 1));
+
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      t->recent_cpu = fp_add_int (fp_mul (decay, t->recent_cpu), t->nice);
+      mlfqs_update_priority (t);
+    }
+}
+
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
    returns a pointer to the frame's base. */
 static void *
@@ -526,10 +879,14 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int priority = ready_priority ();
+  struct thread *t;
+
+  if (priority < 0)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  t = list_entry (list_front (&ready_queues[priority]), struct thread, elem);
+  ready_remove (t);
+  return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -561,8 +918,13 @@ schedule_tail (struct thread *prev)
   /* Start new time slice. */
   thread_ticks = 0;
 
+  /* Make the FPU trap unless it holds our state. */
+  fpu_switch (curr);
+
 #ifdef USERPROG
   /* Activate the new address space. */
+  if (prev != NULL)
+    process_deactivate (prev);
   process_activate ();
 #endif
 
@@ -574,7 +936,7 @@ schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != curr);
-      palloc_free_page (prev);
+      thread_page_free (prev);
     }
 }
 
@@ -596,8 +958,20 @@ schedule (void)
   ASSERT (curr->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  if (curr == idle_thread)
+    timer_idle_exit ();
+
   if (curr != next)
-    prev = switch_threads (curr, next);
+    {
+      if (curr->status == THREAD_READY)
+        curr->rusage.nivcsw++;
+      else
+        curr->rusage.nvcsw++;
+      perf_inc (PERF_CONTEXT_SWITCH);
+      trace (TRACE_SWITCH, next->tid);
+      rcu_switch ();
+      prev = switch_threads (curr, next);
+    }
   schedule_tail (prev); 
 }
 
@@ -606,14 +980,50 @@ static tid_t
 allocate_tid (void) 
 {
   static tid_t next_tid = 1;
-  tid_t tid;
-
-  lock_acquire (&tid_lock);
-  tid = next_tid++;
-  lock_release (&tid_lock);
+  tid_t tid = 1;
 
+  asm volatile ("lock; xaddl %0, %1"
+                : "+r" (tid), "+m" (next_tid) : : "memory");
   return tid;
 }
+
+/* Returns a page for a new thread, recycled from a dead thread
+   if possible, or a null pointer if memory is exhausted.  The
+   page is not zeroed. */
+static struct thread *
+thread_page_get (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (thread_page_cnt > 0)
+    t = thread_pages[--thread_page_cnt];
+  intr_set_level (old_level);
+
+  return t != NULL ? t : palloc_get_page (0);
+}
+
+/* Frees the page of thread T, keeping it for a new thread if
+   there is room.  A kept page loses its magic number, so that
+   is_thread() still catches pointers to the dead thread. */
+static void
+thread_page_free (struct thread *t)
+{
+  enum intr_level old_level;
+
+  t->magic = 0;
+  old_level = intr_disable ();
+  if (thread_page_cnt < THREAD_PAGE_CACHE)
+    {
+      thread_pages[thread_page_cnt++] = t;
+      t = NULL;
+    }
+  intr_set_level (old_level);
+
+  if (t != NULL)
+    palloc_free_page (t);
+}
 
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
@@ -2,8 +2,11 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
+#include <rusage.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -30,6 +33,24 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Scheduling classes.  A thread's class sets the time slice it
+   runs for before being preempted by a ready thread of the same
+   priority, and whether the MLFQS scheduler computes its
+   priority. */
+enum sched_class
+  {
+    SCHED_FIFO,         /* Real time, runs until it blocks or yields. */
+    SCHED_RR,           /* Real time, round robin. */
+    SCHED_NORMAL,       /* Time sharing, the default. */
+    SCHED_IDLE,         /* Runs at PRI_MIN, when nothing else can. */
+    SCHED_CLASS_CNT
+  };
+
+/* Thread niceness for the MLFQS scheduler. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -81,11 +102,13 @@ typedef int tid_t;
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   the run queue (thread.c), or it can be an element in a wait
+   list such as an interrupt queue's (intq.c).  It can be used
+   these two ways only because they are mutually exclusive: only
+   a thread in the ready state is on the run queue, whereas only
+   a thread in the blocked state is on a wait list.  A thread
+   waiting on a semaphore is in the semaphore's heap of waiters
+   through `wait_elem' instead (synch.c). */
 struct thread
   {
     /* Owned by thread.c. */
@@ -95,24 +118,43 @@ struct thread
     uint8_t *stack;                     /* Saved stack pointer. */
     int priority;                       /* Priority. */
     int priority_orig;                  /* Original priority. */
+    int boost_base;                     /* Priority before a wakeup
+                                           boost, or -1 if none. */
     struct lock *waiting_lock;          /* Waiting lock. */
+    struct cond_waiter *cond_waiter;    /* Waiting condition, in synch.c. */
     struct list lock_list;              /* Lock list that this is holding. */
+    enum sched_class sched_class;       /* Scheduling class. */
+    int nice;                           /* Niceness for MLFQS. */
+    fixed_t recent_cpu;                 /* Recent CPU time for MLFQS. */
+    struct list_elem allelem;           /* List element for all threads. */
+    void *fpu;                          /* FPU state, owned by fpu.c. */
+    struct rusage rusage;               /* Resource use.  Others add to
+                                           it for the thread itself. */
+
+    /* Owned by threads/rcu.c. */
+    int rcu_nesting;                    /* Read-side section depth. */
+    int rcu_phase;                      /* Phase of outermost section. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
-
-    /* Owned by devices/timer.c. */
-    struct list_elem timer_elem;        /* Timer list element. */
-    int64_t timer_ticks;                /* Tick to wake-up. */
+    struct heap_elem wait_elem;         /* Semaphore waiters element. */
+    unsigned wait_arrival;              /* Order of arrival at semaphore. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     struct process process;             /* User process. */
+    struct thread *leader;              /* Thread whose PROCESS this
+                                           thread runs in. */
     uint32_t *pagedir;                  /* Page directory. */
     struct suppl_pt *suppl_pt;          /* Suppplemental page table. */
     uint32_t *esp;                      /* Stack pointer. */
 #endif
 
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of operations. */
+#endif
+
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
@@ -122,10 +164,23 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* Time slice of each scheduling class in timer ticks, unused for
+   SCHED_FIFO.  Controlled by kernel command-line options
+   "-slice=TICKS" for SCHED_NORMAL and SCHED_IDLE and
+   "-rt-slice=TICKS" for SCHED_RR. */
+extern unsigned thread_slice[SCHED_CLASS_CNT];
+
+/* Priority levels by which a SCHED_NORMAL thread woken from
+   anything but a lock is raised until it blocks again or runs
+   for a timer tick, or 0 for none.  Ignored by the MLFQS
+   scheduler.  Controlled by kernel command-line option
+   "-boost=LEVELS". */
+extern int thread_boost;
+
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (bool user);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -135,6 +190,7 @@ void thread_block (void);
 void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
+struct thread *running_thread (void);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
@@ -143,11 +199,17 @@ void thread_yield (void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
-list_less_func thread_compare_priority;
+void thread_donate_priority (struct thread *, int);
+void thread_set_class (enum sched_class, int priority);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
+void rusage_add (struct rusage *, const struct rusage *);
+#ifdef USERPROG
+void thread_rusage_process (const struct thread *leader, struct rusage *);
+#endif
+
 #endif /* threads/thread.h */
@@ -0,0 +1,105 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Event tracing.
+
+   Tracepoints append fixed-size binary records, stamped with the
+   CPU's time stamp counter, to a ring buffer.  A record's slot
+   is claimed with one atomic increment of the head, so a
+   tracepoint takes no lock and never waits, and one that
+   interrupts another simply gets the next slot.  There is one
+   CPU, so one buffer serves as the per-CPU buffer.
+
+   At shutdown the records are printed in hex, oldest first, for
+   utils/pintos-trace to decode. */
+
+/* Number of records kept. */
+size_t trace_records = 0;
+
+/* Ring buffer of TRACE_RECORDS records. */
+struct trace_record *trace_buffer;
+
+/* Records claimed since boot. */
+static uint32_t trace_head;
+
+/* Time stamp counter and timer ticks when tracing started, to
+   convert time stamps to time. */
+static uint64_t start_tsc;
+static int64_t start_ticks;
+
+/* Allocates the trace buffer if tracing is enabled. */
+void
+trace_init (void)
+{
+  size_t cnt = 1;
+
+  if (trace_records == 0)
+    return;
+  while (cnt < trace_records)
+    cnt *= 2;
+  trace_records = cnt;
+  start_tsc = timer_cycles ();
+  start_ticks = timer_ticks ();
+  trace_buffer = calloc (trace_records, sizeof *trace_buffer);
+  if (trace_buffer == NULL)
+    PANIC ("cannot allocate %zu trace records", trace_records);
+}
+
+/* Appends a record of EVENT with ARG to the trace buffer.
+   Takes the thread from running_thread(), since schedule()
+   records a switch after the running thread's status changed. */
+void
+trace_record (enum trace_event event, uint32_t arg)
+{
+  struct trace_record *r;
+  uint32_t idx = 1;
+
+  asm volatile ("lock; xaddl %0, %1"
+                : "+r" (idx), "+m" (trace_head) : : "memory");
+  r = &trace_buffer[idx & (trace_records - 1)];
+  r->tsc = timer_cycles ();
+  r->event = event;
+  r->tid = running_thread ()->tid;
+  r->arg = arg;
+}
+
+/* Prints the records kept in hex, four to a line, oldest first,
+   after a header giving the time stamp counter rate. */
+void
+trace_print_stats (void)
+{
+  int64_t ticks;
+  uint32_t first, i;
+
+  if (trace_buffer == NULL)
+    return;
+
+  /* Stop tracing; the machine is going down. */
+  intr_disable ();
+  ticks = timer_elapsed (start_ticks);
+  first = trace_head > trace_records ? trace_head - trace_records : 0;
+  printf ("Trace: %"PRIu32" records, %"PRIu32" kept, "
+          "%"PRIu64" cycles in %"PRId64" ticks of %d Hz\n",
+          trace_head, trace_head - first, timer_cycles () - start_tsc,
+          ticks, TIMER_FREQ);
+  for (i = first; i != trace_head; i++)
+    {
+      struct trace_record *r = &trace_buffer[i & (trace_records - 1)];
+      const uint8_t *p = (const uint8_t *) r;
+      size_t j;
+
+      if ((i - first) % 4 == 0)
+        printf ("%sTrace data:", i == first ? "" : "\n");
+      putchar (' ');
+      for (j = 0; j < sizeof (struct trace_record); j++)
+        printf ("%02x", p[j]);
+    }
+  if (trace_head != first)
+    printf ("\n");
+}
@@ -0,0 +1,51 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Trace events.  ARG is what each event records. */
+enum trace_event
+  {
+    TRACE_BLOCK = 1,            /* Thread blocks; 0. */
+    TRACE_UNBLOCK,              /* Thread is unblocked; its tid. */
+    TRACE_SWITCH,               /* Switch to thread; its tid. */
+    TRACE_LOCK_WAIT,            /* Blocks on lock; its address. */
+    TRACE_LOCK_TAKEN,           /* Got lock waited for; its address. */
+    TRACE_DISK_READ,            /* Disk read starts; first sector. */
+    TRACE_DISK_WRITE,           /* Disk write starts; first sector. */
+    TRACE_DISK_DONE,            /* Disk transfer ends; first sector. */
+    TRACE_PAGE_FAULT,           /* Page fault; faulting address. */
+    TRACE_CACHE_MISS            /* Buffer cache miss; sector. */
+  };
+
+/* A trace record, as dumped. */
+struct trace_record
+  {
+    uint64_t tsc;               /* Time stamp counter. */
+    uint16_t event;             /* enum trace_event. */
+    uint16_t tid;               /* Running thread, low bits. */
+    uint32_t arg;               /* Event argument. */
+  };
+
+/* Number of trace records kept, the latest ones, rounded up to
+   a power of 2.  Zero disables tracing.
+   Controlled by kernel command-line option "-trace=RECORDS". */
+extern size_t trace_records;
+
+/* Trace buffer, or NULL if tracing is off. */
+extern struct trace_record *trace_buffer;
+
+void trace_init (void);
+void trace_record (enum trace_event, uint32_t arg);
+void trace_print_stats (void);
+
+/* Records EVENT with ARG if tracing is on. */
+static inline void
+trace (enum trace_event event, uint32_t arg)
+{
+  if (trace_buffer != NULL)
+    trace_record (event, arg);
+}
+
+#endif /* threads/trace.h */
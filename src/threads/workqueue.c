@@ -0,0 +1,193 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+
+/* Work queues.
+
+   Kernel services hand background work to a queue instead of
+   each starting threads of its own, so that the threads serving
+   them are shared.  Items may be queued from interrupt handlers,
+   which keeps the work itself out of the handlers, where
+   interrupts are off. */
+
+/* Number of workers of the system queue, so that one long item,
+   such as a write-behind, does not hold up the rest. */
+#define SYSTEM_WORKERS 2
+
+struct workqueue system_wq;
+
+static void workqueue_start (struct workqueue *);
+static void work_enqueue (struct workqueue *, struct work *);
+static alarm_func work_expire;
+static thread_func worker;
+
+/* Initializes the system queue. */
+void
+workqueue_system_init (void)
+{
+  workqueue_init (&system_wq, "kworker", SYSTEM_WORKERS, SCHED_RR, PRI_MAX);
+}
+
+/* Initializes WQ, to be served by WORKER_CNT threads named NAME
+   of scheduling class CLASS at PRIORITY. */
+void
+workqueue_init (struct workqueue *wq, const char *name, size_t worker_cnt,
+                enum sched_class class, int priority)
+{
+  ASSERT (worker_cnt > 0);
+
+  wq->name = name;
+  wq->worker_cnt = worker_cnt;
+  wq->class = class;
+  wq->priority = priority;
+  wq->started = false;
+  list_init (&wq->items);
+  sema_init (&wq->item_cnt, 0);
+}
+
+/* Initializes WORK to run FUNC with AUX. */
+void
+work_init (struct work *work, work_func *func, void *aux)
+{
+  ASSERT (work != NULL);
+  ASSERT (func != NULL);
+
+  work->func = func;
+  work->aux = aux;
+  work->pending = false;
+  work->wq = NULL;
+  alarm_init (&work->alarm, work_expire, work);
+}
+
+/* Queues WORK on WQ.  May be called from an interrupt handler
+   once WQ has been used from a thread.  Returns false if WORK
+   was already pending. */
+bool
+work_queue (struct workqueue *wq, struct work *work)
+{
+  enum intr_level old_level;
+  bool queued;
+
+  workqueue_start (wq);
+  old_level = intr_disable ();
+  queued = !work->pending;
+  if (queued)
+    {
+      work->pending = true;
+      work_enqueue (wq, work);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Queues WORK on WQ after TICKS timer ticks.  May be called from
+   an interrupt handler once WQ has been used from a thread.
+   Returns false if WORK was already pending. */
+bool
+work_queue_delayed (struct workqueue *wq, struct work *work, int64_t ticks)
+{
+  enum intr_level old_level;
+  bool queued;
+
+  if (ticks <= 0)
+    return work_queue (wq, work);
+
+  workqueue_start (wq);
+  old_level = intr_disable ();
+  queued = !work->pending;
+  if (queued)
+    {
+      work->pending = true;
+      work->wq = wq;
+      alarm_set (&work->alarm, timer_ticks () + ticks);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Queues WORK at once if it is waiting for the delay given to
+   work_queue_delayed().  May be called from an interrupt
+   handler.  Returns false if WORK was not waiting for a delay,
+   because it was not pending or was already queued. */
+bool
+work_expedite (struct work *work)
+{
+  enum intr_level old_level;
+  bool expedited;
+
+  old_level = intr_disable ();
+  expedited = work->pending && alarm_cancel (&work->alarm);
+  if (expedited)
+    work_enqueue (work->wq, work);
+  intr_set_level (old_level);
+  return expedited;
+}
+
+/* Starts the workers of WQ if they are not running, unless
+   called from an interrupt handler, which cannot create
+   threads. */
+static void
+workqueue_start (struct workqueue *wq)
+{
+  enum intr_level old_level;
+  bool start;
+  size_t i;
+
+  if (wq->started)
+    return;
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  start = !wq->started;
+  wq->started = true;
+  intr_set_level (old_level);
+
+  if (start)
+    for (i = 0; i < wq->worker_cnt; i++)
+      if (thread_create (wq->name, wq->priority, worker, wq) == TID_ERROR)
+        PANIC ("cannot start worker %zu of %s", i, wq->name);
+}
+
+/* Appends WORK to WQ and wakes a worker.  Interrupts must be
+   off. */
+static void
+work_enqueue (struct workqueue *wq, struct work *work)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&wq->items, &work->elem);
+  sema_up (&wq->item_cnt);
+}
+
+/* Queues the work item WORK_ once its delay is over.  Runs in the
+   timer interrupt. */
+static void
+work_expire (void *work_)
+{
+  struct work *work = work_;
+
+  work_enqueue (work->wq, work);
+}
+
+/* Thread function of a worker of queue WQ_. */
+static void
+worker (void *wq_)
+{
+  struct workqueue *wq = wq_;
+
+  thread_set_class (wq->class, wq->priority);
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct work *work;
+
+      sema_down (&wq->item_cnt);
+      old_level = intr_disable ();
+      work = list_entry (list_pop_front (&wq->items), struct work, elem);
+      work->pending = false;
+      intr_set_level (old_level);
+
+      work->func (work->aux);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Function a work item runs. */
+typedef void work_func (void *aux);
+
+/* A work item, run by a worker thread of the queue it is put on.
+   An item is on at most one queue at a time, and may be queued
+   again, by itself too, once its function has begun. */
+struct work
+  {
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* Queued or waiting for its delay? */
+    struct workqueue *wq;       /* Queue to run on after the delay. */
+    struct alarm alarm;         /* Delay. */
+    struct list_elem elem;      /* Element in the queue. */
+  };
+
+/* A queue of work items, served in order by WORKER_CNT kernel
+   threads of one scheduling class and priority.  The threads are
+   started when the first item is queued from a thread. */
+struct workqueue
+  {
+    const char *name;           /* Name of the worker threads. */
+    size_t worker_cnt;          /* Number of worker threads. */
+    enum sched_class class;     /* Scheduling class of the workers. */
+    int priority;               /* Priority of the workers. */
+    bool started;               /* Whether the workers are started. */
+    struct list items;          /* Queued items. */
+    struct semaphore item_cnt;  /* Number of queued items. */
+  };
+
+/* Queue shared by kernel services, such as the buffer cache's
+   write-behind and read-ahead, with real-time workers. */
+extern struct workqueue system_wq;
+
+void workqueue_system_init (void);
+void workqueue_init (struct workqueue *, const char *name, size_t worker_cnt,
+                     enum sched_class, int priority);
+void work_init (struct work *, work_func *, void *aux);
+bool work_queue (struct workqueue *, struct work *);
+bool work_queue_delayed (struct workqueue *, struct work *, int64_t ticks);
+bool work_expedite (struct work *);
+
+#endif /* threads/workqueue.h */
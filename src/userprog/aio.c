@@ -0,0 +1,337 @@
+#include "userprog/aio.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/poll.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+
+/* Asynchronous I/O.
+
+   A process registers a pair of rings in its memory with
+   aio_setup(), fills in submissions, and calls aio_enter() to
+   start all of them at once and collect completions.  The I/Os
+   are carried out by a pool of kernel threads on bounce buffers,
+   so that they never touch user memory: data to write is copied
+   in when an I/O is submitted, and data read is copied out when
+   its completion is posted, both in the process's own context.
+   A file is reopened for each I/O, so it stays open while the
+   I/O is under way even if the process closes it. */
+
+/* Number of I/O threads. */
+#define AIO_WORKERS 2
+
+/* A process's asynchronous I/O state. */
+struct aio_context
+  {
+    struct aio_ring *ring;      /* User address of the rings. */
+    unsigned entries;           /* Entries in each ring. */
+    struct lock lock;           /* Protects the members below. */
+    struct condition completed; /* Signaled as I/Os complete. */
+    struct list done;           /* Completed, not yet posted. */
+    unsigned pending;           /* Submitted, not yet posted. */
+  };
+
+/* An I/O. */
+struct aio_request
+  {
+    struct list_elem elem;      /* In aio_queue or a DONE list. */
+    struct aio_context *ctx;    /* Owner. */
+    int op;                     /* An enum aio_op. */
+    struct file *file;          /* File, or NULL if failed. */
+    void *buf;                  /* Bounce buffer. */
+    void *ubuf;                 /* User buffer. */
+    off_t size;                 /* Bytes to transfer. */
+    off_t offset;               /* File offset. */
+    unsigned user_data;         /* From the submission. */
+    int result;                 /* Bytes transferred, or -1. */
+  };
+
+/* I/Os waiting for an I/O thread. */
+static struct list aio_queue;
+static struct lock aio_lock;
+static struct condition aio_nonempty;
+
+static thread_func aio_worker;
+static struct aio_request *aio_submit (struct aio_context *,
+                                       const struct aio_sqe *);
+static void aio_complete (struct aio_request *);
+static int aio_post (struct aio_request *);
+static void aio_request_free (struct aio_request *);
+
+/* Starts the I/O threads. */
+void
+aio_init (void)
+{
+  int i;
+
+  list_init (&aio_queue);
+  lock_init (&aio_lock);
+  lock_set_name (&aio_lock, "aio");
+  cond_init (&aio_nonempty);
+  for (i = 0; i < AIO_WORKERS; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "aio%d", i);
+      if (thread_create (name, PRI_DEFAULT, aio_worker, NULL) == TID_ERROR)
+        PANIC ("cannot start I/O thread %s", name);
+    }
+}
+
+/* Registers RING, in user memory, as the current process's pair
+   of rings.  Returns 0 if successful, or -1 if the rings are
+   malformed or the process already has a pair. */
+int
+aio_setup (struct aio_ring *ring)
+{
+  struct process *proc = process_current ();
+  struct aio_context *ctx;
+  unsigned entries;
+
+  if (proc->aio != NULL
+      || !copy_from_user (&entries, &ring->entries, sizeof entries)
+      || entries == 0 || entries > AIO_ENTRIES_MAX
+      || (entries & (entries - 1)) != 0)
+    return -1;
+
+  ctx = malloc (sizeof *ctx);
+  if (ctx == NULL)
+    return -1;
+  ctx->ring = ring;
+  ctx->entries = entries;
+  lock_init (&ctx->lock);
+  cond_init (&ctx->completed);
+  list_init (&ctx->done);
+  ctx->pending = 0;
+  proc->aio = ctx;
+  return 0;
+}
+
+/* Starts every I/O in the current process's submission queue,
+   as long as no more than a ring's worth is outstanding, then
+   posts completions until at least MIN_COMPLETE are posted, the
+   completion queue is full, or nothing is outstanding.  Returns
+   the number of I/Os started, or -1 if the process has no rings
+   or they cannot be accessed. */
+int
+aio_enter (unsigned min_complete)
+{
+  struct aio_context *ctx = process_current ()->aio;
+  struct aio_ring r;
+  unsigned mask, started = 0, posted = 0;
+
+  if (ctx == NULL || !copy_from_user (&r, ctx->ring, sizeof r))
+    return -1;
+  mask = ctx->entries - 1;
+
+  /* Submit. */
+  for (; r.sq_head != r.sq_tail && ctx->pending < ctx->entries;
+       r.sq_head++)
+    {
+      struct aio_sqe sqe;
+      struct aio_request *req;
+
+      if (!copy_from_user (&sqe, r.sqes + (r.sq_head & mask), sizeof sqe))
+        break;
+      req = aio_submit (ctx, &sqe);
+      if (req == NULL)
+        break;
+      started++;
+    }
+  if (!copy_to_user (&ctx->ring->sq_head, &r.sq_head, sizeof r.sq_head))
+    return -1;
+
+  /* Post completions while the completion queue has room. */
+  for (;;)
+    {
+      struct aio_request *req = NULL;
+      struct aio_cqe cqe;
+
+      if (r.cq_tail - r.cq_head >= ctx->entries)
+        break;
+      lock_acquire (&ctx->lock);
+      while (list_empty (&ctx->done) && posted < min_complete
+             && ctx->pending > 0)
+        cond_wait (&ctx->completed, &ctx->lock);
+      if (!list_empty (&ctx->done))
+        {
+          req = list_entry (list_pop_front (&ctx->done),
+                            struct aio_request, elem);
+          ctx->pending--;
+        }
+      lock_release (&ctx->lock);
+      if (req == NULL)
+        break;
+
+      cqe.user_data = req->user_data;
+      cqe.result = aio_post (req);
+      aio_request_free (req);
+      if (!copy_to_user (r.cqes + (r.cq_tail & mask), &cqe, sizeof cqe))
+        return -1;
+      r.cq_tail++;
+      posted++;
+      if (!copy_to_user (&ctx->ring->cq_tail, &r.cq_tail,
+                         sizeof r.cq_tail)
+          || !copy_from_user (&r.cq_head, &ctx->ring->cq_head,
+                              sizeof r.cq_head))
+        return -1;
+    }
+  return started;
+}
+
+/* Returns 1 if completions of the current process's I/Os are
+   waiting to be posted by aio_enter(), 0 if not, or -1 if the
+   process has no rings. */
+int
+aio_ready (void)
+{
+  struct aio_context *ctx = process_current ()->aio;
+  bool ready;
+
+  if (ctx == NULL)
+    return -1;
+  lock_acquire (&ctx->lock);
+  ready = !list_empty (&ctx->done);
+  lock_release (&ctx->lock);
+  return ready;
+}
+
+/* Waits for the I/Os of CTX to complete and frees it. */
+void
+aio_destroy (struct aio_context *ctx)
+{
+  if (ctx == NULL)
+    return;
+
+  lock_acquire (&ctx->lock);
+  while (list_size (&ctx->done) < ctx->pending)
+    cond_wait (&ctx->completed, &ctx->lock);
+  lock_release (&ctx->lock);
+
+  while (!list_empty (&ctx->done))
+    aio_request_free (list_entry (list_pop_front (&ctx->done),
+                                  struct aio_request, elem));
+  free (ctx);
+}
+
+/* Starts the I/O SQE for CTX.  An I/O that cannot be started
+   completes at once with result -1.  Returns the request, or a
+   null pointer if memory is short. */
+static struct aio_request *
+aio_submit (struct aio_context *ctx, const struct aio_sqe *sqe)
+{
+  struct aio_request *req = malloc (sizeof *req);
+  struct file *file;
+
+  if (req == NULL)
+    return NULL;
+  req->ctx = ctx;
+  req->op = sqe->op;
+  req->file = NULL;
+  req->ubuf = sqe->buf;
+  req->size = sqe->size < AIO_IO_MAX ? sqe->size : AIO_IO_MAX;
+  req->offset = sqe->offset;
+  req->user_data = sqe->user_data;
+  req->result = -1;
+  req->buf = malloc (req->size > 0 ? req->size : 1);
+  if (req->buf == NULL)
+    {
+      free (req);
+      return NULL;
+    }
+
+  lock_acquire (&ctx->lock);
+  ctx->pending++;
+  lock_release (&ctx->lock);
+
+  /* Check the I/O, and take the data to write.  Directories are
+     refused, as read() and write() refuse them. */
+  file = process_get_file (sqe->fd);
+  if (file != NULL && inode_is_dir (file_get_inode (file)))
+    file = NULL;
+  if ((sqe->op != AIO_READ && sqe->op != AIO_WRITE)
+      || file == NULL || req->offset < 0
+      || (sqe->op == AIO_WRITE
+          && !copy_from_user (req->buf, req->ubuf, req->size))
+      || (req->file = file_reopen (file)) == NULL)
+    {
+      aio_complete (req);
+      return req;
+    }
+
+  lock_acquire (&aio_lock);
+  list_push_back (&aio_queue, &req->elem);
+  cond_signal (&aio_nonempty, &aio_lock);
+  lock_release (&aio_lock);
+  return req;
+}
+
+/* Thread function of an I/O thread, which carries out queued
+   I/Os one at a time. */
+static void
+aio_worker (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct aio_request *req;
+      struct inode *inode;
+
+      lock_acquire (&aio_lock);
+      while (list_empty (&aio_queue))
+        cond_wait (&aio_nonempty, &aio_lock);
+      req = list_entry (list_pop_front (&aio_queue),
+                        struct aio_request, elem);
+      lock_release (&aio_lock);
+
+      /* Let write-back of unmapped pages of the file land first,
+         as file_read_at() and file_write_at() do. */
+      inode = file_get_inode (req->file);
+      inode_wait_deferred (inode);
+      if (req->op == AIO_READ)
+        req->result = inode_read_at (inode, req->buf, req->size,
+                                     req->offset);
+      else
+        req->result = inode_write_at (inode, req->buf, req->size,
+                                      req->offset);
+      aio_complete (req);
+    }
+}
+
+/* Puts REQ on its owner's list of completed I/Os. */
+static void
+aio_complete (struct aio_request *req)
+{
+  struct aio_context *ctx = req->ctx;
+
+  lock_acquire (&ctx->lock);
+  list_push_back (&ctx->done, &req->elem);
+  cond_broadcast (&ctx->completed, &ctx->lock);
+  lock_release (&ctx->lock);
+  poll_notify ();
+}
+
+/* Copies the data REQ read to its user buffer.  Returns REQ's
+   result, or -1 if the buffer cannot be written. */
+static int
+aio_post (struct aio_request *req)
+{
+  if (req->op == AIO_READ && req->result > 0
+      && !copy_to_user (req->ubuf, req->buf, req->result))
+    return -1;
+  return req->result;
+}
+
+/* Frees REQ and closes its file. */
+static void
+aio_request_free (struct aio_request *req)
+{
+  file_close (req->file);
+  free (req->buf);
+  free (req);
+}
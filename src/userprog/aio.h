@@ -0,0 +1,14 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+#include <aio.h>
+
+struct aio_context;
+
+void aio_init (void);
+int aio_setup (struct aio_ring *);
+int aio_enter (unsigned min_complete);
+int aio_ready (void);
+void aio_destroy (struct aio_context *);
+
+#endif /* userprog/aio.h */
@@ -2,14 +2,15 @@
 #include <debug.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
+#include "threads/perf.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 
-#define STACK_LIMIT ((void *) 0x40000000)
-
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
@@ -50,8 +51,6 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
-                     "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
   intr_register_int (13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -147,6 +146,7 @@ page_fault (struct intr_frame *f)
 
   /* Count page faults. */
   page_fault_cnt++;
+  trace (TRACE_PAGE_FAULT, (uintptr_t) fault_addr);
 
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
@@ -154,28 +154,63 @@ page_fault (struct intr_frame *f)
   user = (f->error_code & PF_U) != 0;
 
 #ifdef VM
+  uint64_t start = timer_cycles ();
   void *upage = pg_round_down (fault_addr);
 
-  /* Only deal with a fault caused by a non-present page.
+  /* Threads of the process fault one at a time. */
+  bool locked = suppl_pt_lock ();
+
+  /* Only deal with a fault caused by a non-present page, or by a
+     write to the shared zero page or a copy-on-write page, which
+     gets a page of its own.
      See [IA32-v3a] 6-41 for more information. */
   if (!not_present)
-    goto page_level_protection_violation;
+    {
+      if (write && suppl_pt_copy_on_write (upage))
+        {
+          perf_inc (PERF_FAULT_COW);
+          thread_current ()->rusage.minflt++;
+          goto done;
+        }
+      goto page_level_protection_violation;
+    }
 
   /* Stack growth. */
   uint32_t *esp = user ? f->esp : thread_current ()->esp;
   if (STACK_LIMIT <= fault_addr && fault_addr < PHYS_BASE
-      && (void *) (esp - 16) <= fault_addr && suppl_pt_get_page (upage) == NULL)
+      && (void *) (esp - 16) <= fault_addr
+      && suppl_pt_lookup (upage) == NULL)
     {
-      if (!suppl_pt_set_zero (upage))
+      if (!suppl_pt_grow_stack (upage))
         goto page_level_protection_violation;
+      perf_inc (PERF_FAULT_STACK);
+    }
+
+  /* Count the fault by the type of its page. */
+  struct suppl_pte *pte = suppl_pt_lookup (upage);
+  if (pte != NULL)
+    {
+      perf_inc (pte->type == PAGE_FILE ? PERF_FAULT_FILE
+                : pte->type == PAGE_SWAP ? PERF_FAULT_SWAP
+                : PERF_FAULT_ZERO);
+      if (pte->type == PAGE_FILE || pte->type == PAGE_SWAP)
+        thread_current ()->rusage.majflt++;
+      else
+        thread_current ()->rusage.minflt++;
+      process_startup_fault (pte);
     }
 
-  /* Load page from appropriate source. */
-  if (suppl_pt_load_page (upage))
-    return;
+  /* Load page from appropriate source, and the cheap ones near. */
+  if ((!write && suppl_pt_map_zero (upage)) || suppl_pt_load_page (upage))
+    {
+      suppl_pt_fault_around (upage);
+      goto done;
+    }
 
  page_level_protection_violation:
+  suppl_pt_unlock (locked);
 #endif
+  perf_inc (PERF_FAULT_BAD);
   /* Change EIP to the next instruction address which is saved on
      EAX, and set EAX by -1 to return the failure code. */
   if (!user)
@@ -188,5 +223,11 @@ page_fault (struct intr_frame *f)
   /* Terminate the process. */
   syscall_exit (-1);
   NOT_REACHED ();
+
+#ifdef VM
+ done:
+  suppl_pt_unlock (locked);
+  perf_hist_add (PERF_HIST_FAULT, 0, timer_cycles () - start);
+#endif
 }
 
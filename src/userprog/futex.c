@@ -0,0 +1,182 @@
+#include "userprog/futex.h"
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+
+/* Futexes.
+
+   A futex is a word of user memory that threads of a process
+   sleep on until another thread wakes them.  Sleepers are kept
+   in a fixed table of queues, found by hashing the process and
+   the futex's user address, so no memory is set aside for a
+   futex nobody waits on, and user locks that are not contended
+   never enter the kernel.  Each queue is kept in priority order,
+   so the highest-priority sleepers are woken first. */
+
+/* Number of queues, a power of 2. */
+#define FUTEX_QUEUE_CNT 64
+
+/* A queue of sleepers on the futexes that hash to it. */
+struct futex_queue
+  {
+    struct lock lock;           /* Protects WAITERS. */
+    struct list waiters;        /* List of struct futex_waiter. */
+  };
+
+/* A thread sleeping on a futex. */
+struct futex_waiter
+  {
+    struct process *proc;       /* Process, naming the address space. */
+    const int *addr;            /* User address of the futex. */
+    struct thread *thread;      /* Sleeping thread. */
+    struct semaphore sema;      /* Upped to wake the thread. */
+    struct list_elem elem;      /* Element in futex_queue's WAITERS. */
+  };
+
+static struct futex_queue futex_queues[FUTEX_QUEUE_CNT];
+
+static struct futex_queue *futex_queue (struct process *, const int *);
+static list_less_func futex_waiter_less;
+static void futex_queue_wake (struct futex_queue *,
+                              struct futex_waiter *);
+
+/* Initializes the futex queues. */
+void
+futex_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < FUTEX_QUEUE_CNT; i++)
+    {
+      lock_init (&futex_queues[i].lock);
+      list_init (&futex_queues[i].waiters);
+    }
+}
+
+/* Locks and returns the queue of the current process's futex at
+   ADDR.  The caller checks the futex's value, then either sleeps
+   with futex_queue_sleep() or gives up with
+   futex_queue_unlock(); since futex_wake() takes the same lock,
+   no wakeup comes in between. */
+struct futex_queue *
+futex_queue_lock (const int *addr)
+{
+  struct futex_queue *q = futex_queue (process_current (), addr);
+
+  lock_acquire (&q->lock);
+  return q;
+}
+
+/* Unlocks Q, locked by futex_queue_lock(). */
+void
+futex_queue_unlock (struct futex_queue *q)
+{
+  lock_release (&q->lock);
+}
+
+/* Puts the current thread to sleep on the futex at ADDR, whose
+   queue Q futex_queue_lock() returned, after unlocking Q, until
+   futex_wake() or futex_wake_all() wakes it. */
+void
+futex_queue_sleep (struct futex_queue *q, const int *addr)
+{
+  struct futex_waiter w;
+
+  ASSERT (lock_held_by_current_thread (&q->lock));
+
+  w.proc = process_current ();
+  w.addr = addr;
+  w.thread = thread_current ();
+  sema_init (&w.sema, 0);
+  list_insert_ordered (&q->waiters, &w.elem, futex_waiter_less, NULL);
+  lock_release (&q->lock);
+
+  sema_down (&w.sema);
+}
+
+/* Wakes up to CNT threads of the current process sleeping on the
+   futex at ADDR, those of highest priority first.  Returns the
+   number woken. */
+int
+futex_wake (const int *addr, int cnt)
+{
+  struct process *proc = process_current ();
+  struct futex_queue *q = futex_queue (proc, addr);
+  struct list_elem *e;
+  int woken = 0;
+
+  lock_acquire (&q->lock);
+  for (e = list_begin (&q->waiters);
+       e != list_end (&q->waiters) && woken < cnt;)
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+      e = list_next (e);
+      if (w->proc == proc && w->addr == addr)
+        {
+          futex_queue_wake (q, w);
+          woken++;
+        }
+    }
+  lock_release (&q->lock);
+  return woken;
+}
+
+/* Wakes every thread of the current process sleeping on a
+   futex, as the process exits. */
+void
+futex_wake_all (void)
+{
+  struct process *proc = process_current ();
+  size_t i;
+
+  for (i = 0; i < FUTEX_QUEUE_CNT; i++)
+    {
+      struct futex_queue *q = &futex_queues[i];
+      struct list_elem *e;
+
+      lock_acquire (&q->lock);
+      for (e = list_begin (&q->waiters); e != list_end (&q->waiters);)
+        {
+          struct futex_waiter *w = list_entry (e, struct futex_waiter,
+                                               elem);
+          e = list_next (e);
+          if (w->proc == proc)
+            futex_queue_wake (q, w);
+        }
+      lock_release (&q->lock);
+    }
+}
+
+/* Returns the queue of PROC's futex at ADDR. */
+static struct futex_queue *
+futex_queue (struct process *proc, const int *addr)
+{
+  uintptr_t key[2] = { (uintptr_t) proc, (uintptr_t) addr };
+
+  return &futex_queues[hash_bytes (key, sizeof key)
+                       & (FUTEX_QUEUE_CNT - 1)];
+}
+
+/* Orders waiters by descending priority of their threads, and
+   in the order they came among equals. */
+static bool
+futex_waiter_less (const struct list_elem *a, const struct list_elem *b,
+                   void *aux UNUSED)
+{
+  return (list_entry (a, struct futex_waiter, elem)->thread->priority
+          > list_entry (b, struct futex_waiter, elem)->thread->priority);
+}
+
+/* Removes W from Q, which the current thread has locked, and
+   wakes its thread. */
+static void
+futex_queue_wake (struct futex_queue *q, struct futex_waiter *w)
+{
+  ASSERT (lock_held_by_current_thread (&q->lock));
+
+  list_remove (&w->elem);
+  sema_up (&w->sema);
+}
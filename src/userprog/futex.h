@@ -0,0 +1,15 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdbool.h>
+
+struct futex_queue;
+
+void futex_init (void);
+struct futex_queue *futex_queue_lock (const int *addr);
+void futex_queue_unlock (struct futex_queue *);
+void futex_queue_sleep (struct futex_queue *, const int *addr);
+int futex_wake (const int *addr, int cnt);
+void futex_wake_all (void);
+
+#endif /* userprog/futex.h */
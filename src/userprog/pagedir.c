@@ -1,32 +1,65 @@
 #include "userprog/pagedir.h"
+#include <clock.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/perf.h"
+#include "threads/thread.h"
+
+/* Most TLB entries invalidated one by one at the end of a batch.
+   Past this, flushing the whole TLB is cheaper. */
+#define BATCH_PAGES 32
+
+/* Invalidations of the TLB deferred by the thread that began a
+   batch, which owns them.  Those of the pages in BATCH_PD, which
+   is the owner's active page directory, are kept in BATCH_VPAGES
+   until there are too many. */
+static struct thread *batch_owner;
+static uint32_t *batch_pd;
+static const void *batch_vpages[BATCH_PAGES];
+static size_t batch_cnt;
+static bool batch_overflow;
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *vpage, bool defer);
 
 /* Creates a new page directory that has mappings for kernel
-   virtual addresses, but none for user virtual addresses.
+   virtual addresses, and for user virtual addresses only the
+   read-only clock page at CLOCK_PAGE.
    Returns the new page directory, or a null pointer if memory
    allocation fails. */
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
-  if (pd != NULL)
-    memcpy (pd, base_page_dir, PGSIZE);
+  uint32_t *pd = palloc_get_page (PAL_ZERO);
+  size_t kernel_pde = pd_no (PHYS_BASE);
+  void *clock = timer_clock_page ();
+
+  if (pd == NULL)
+    return NULL;
+
+  /* The user entries are zero, so only the kernel's are copied. */
+  memcpy (pd + kernel_pde, base_page_dir + kernel_pde,
+          PGSIZE - kernel_pde * sizeof *pd);
+  if (clock != NULL
+      && !pagedir_set_page (pd, (void *) CLOCK_PAGE, clock, false))
+    {
+      pagedir_destroy (pd);
+      return NULL;
+    }
   return pd;
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references except the shared clock page. */
 void
 pagedir_destroy (uint32_t *pd) 
 {
+  void *clock = timer_clock_page ();
   uint32_t *pde;
 
   if (pd == NULL)
@@ -40,7 +73,7 @@ pagedir_destroy (uint32_t *pd)
         uint32_t *pte;
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          if (*pte & PTE_P) 
+          if ((*pte & PTE_P) && pte_get_page (*pte) != clock)
             palloc_free_page (pte_get_page (*pte));
         palloc_free_page (pt);
       }
@@ -52,7 +85,8 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.  Kernel memory mapped by a 4 MB page has
+   no page table entry either. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -79,6 +113,8 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
       else
         return NULL;
     }
+  else if (*pde & PTE_PS)
+    return NULL;
 
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
@@ -152,10 +188,31 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage, false);
     }
 }
 
+/* Points the mapping of user virtual page UPAGE in page
+   directory PD at the frame identified by kernel virtual address
+   KPAGE instead, keeping its other bits.  Returns false if UPAGE
+   is not mapped. */
+bool
+pagedir_remap (uint32_t *pd, const void *upage, void *kpage)
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (pd, upage, false);
+  if (pte == NULL || (*pte & PTE_P) == 0)
+    return false;
+  *pte = vtop (kpage) | (*pte & PTE_FLAGS);
+  invalidate_page (pd, upage, false);
+  return true;
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -180,7 +237,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage, false);
         }
     }
 }
@@ -209,7 +266,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage, true);
         }
     }
 }
@@ -230,6 +287,18 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Activates page directory PD, or the kernel-only page
+   directory if PD is null, unless it is already active, keeping
+   the TLB in that case. */
+void
+pagedir_switch (uint32_t *pd)
+{
+  if (pd == NULL)
+    pd = base_page_dir;
+  if (active_pd () != pd)
+    pagedir_activate (pd);
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
@@ -243,21 +312,83 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Begins a batch of changes to accessed bits by the running
+   thread, such as a pass over the frame table.  The TLB entries
+   of the pages whose accessed bits pagedir_set_accessed() clears
+   are invalidated together at pagedir_batch_end(), one by one if
+   there are few and by flushing the whole TLB otherwise, instead
+   of by a flush for each page.  Until then, a page with a stale
+   entry is not marked accessed again, so it may look unused, but
+   nothing worse happens.  Cleared present and dirty bits are
+   never deferred, since a stale entry would then let the page be
+   used or written unnoticed.  Batches do not nest, and only one
+   thread at a time may have one, which the frame table lock
+   ensures. */
+void
+pagedir_batch_begin (void)
+{
+  ASSERT (batch_owner == NULL);
+
+  batch_owner = thread_current ();
+  batch_pd = NULL;
+  batch_cnt = 0;
+  batch_overflow = false;
+}
+
+/* Ends the running thread's batch, invalidating the TLB entries
+   it deferred. */
+void
+pagedir_batch_end (void)
+{
+  size_t i;
+
+  ASSERT (batch_owner == thread_current ());
+
+  batch_owner = NULL;
+  if (batch_pd == NULL || active_pd () != batch_pd)
+    return;
+  if (batch_overflow)
+    {
+      pagedir_activate (batch_pd);
+      perf_inc (PERF_TLB_FLUSH);
+    }
+  else
+    {
+      for (i = 0; i < batch_cnt; i++)
+        asm volatile ("invlpg %0" : : "m" (*(const char *) batch_vpages[i])
+                      : "memory");
+      perf_add (PERF_TLB_PAGE, batch_cnt);
+    }
+}
+
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entry of the page changed.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the TLB entry of VPAGE if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  If DEFER is true and the running thread has a
+   batch, this is put off until the batch ends. */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *vpage, bool defer)
 {
-  if (active_pd () == pd) 
+  if (active_pd () != pd)
+    return;
+
+  if (defer && batch_owner == thread_current ())
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+      batch_pd = pd;
+      if (batch_cnt < BATCH_PAGES)
+        batch_vpages[batch_cnt++] = vpage;
+      else
+        batch_overflow = true;
+      return;
+    }
+
+  /* See [IA32-v3a] 3.12 "Translation Lookaside Buffers (TLBs)"
+     and [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+  asm volatile ("invlpg %0" : : "m" (*(const char *) vpage) : "memory");
+  perf_inc (PERF_TLB_PAGE);
 }
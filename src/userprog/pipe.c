@@ -0,0 +1,262 @@
+#include "userprog/pipe.h"
+#include <debug.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <ring.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/poll.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+/* Pipes.
+
+   Small writes go through a ring buffer of one page.  A write of
+   at least PIPE_DIRECT_MIN bytes to an empty pipe is instead
+   handed to the reader directly: the writer publishes its
+   buffer, whose pages the caller has made resident, and sleeps
+   until readers have copied it, straight out of the writer's
+   frames, into their own buffers.  Large transfers so cost one
+   copy instead of two.
+
+   Every change that may let a blocked reader or writer go on
+   also calls poll_notify(), for threads polling the pipe. */
+
+/* Size of the ring buffer. */
+#define PIPE_SIZE PGSIZE
+
+/* Smallest write handed to the reader directly. */
+#define PIPE_DIRECT_MIN PGSIZE
+
+/* A pipe. */
+struct pipe
+  {
+    struct lock lock;           /* Protects all members. */
+    struct condition readable;  /* Signaled when data arrives. */
+    struct condition writable;  /* Signaled when data is taken. */
+    int readers;                /* Open read ends. */
+    int writers;                /* Open write ends. */
+
+    struct ring ring;           /* Ring buffer of PIPE_SIZE bytes. */
+
+    uint32_t *direct_pd;        /* Page directory of direct writer. */
+    const uint8_t *direct_buf;  /* Next byte of the direct write. */
+    size_t direct_left;         /* Bytes of it left, 0 if none. */
+  };
+
+static size_t direct_get (struct pipe *, uint8_t *dst, size_t size);
+
+/* Creates a pipe with one read end and one write end open.
+   Returns the pipe, or NULL if memory is short. */
+struct pipe *
+pipe_create (void)
+{
+  struct pipe *p = malloc (sizeof *p);
+  uint8_t *buf;
+
+  if (p == NULL)
+    return NULL;
+  buf = palloc_get_page (0);
+  if (buf == NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  lock_init (&p->lock);
+  cond_init (&p->readable);
+  cond_init (&p->writable);
+  p->readers = p->writers = 1;
+  ring_init (&p->ring, buf, PIPE_SIZE);
+  p->direct_pd = NULL;
+  p->direct_buf = NULL;
+  p->direct_left = 0;
+  return p;
+}
+
+/* Opens another read end of P, or a write end if WRITER. */
+void
+pipe_reopen (struct pipe *p, bool writer)
+{
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writers++;
+  else
+    p->readers++;
+  lock_release (&p->lock);
+}
+
+/* Closes a read end of P, or a write end if WRITER, and frees P
+   once no end is open. */
+void
+pipe_close (struct pipe *p, bool writer)
+{
+  bool dead;
+
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writers--;
+  else
+    p->readers--;
+  cond_broadcast (&p->readable, &p->lock);
+  cond_broadcast (&p->writable, &p->lock);
+  poll_notify ();
+  dead = p->readers == 0 && p->writers == 0;
+  lock_release (&p->lock);
+
+  if (dead)
+    {
+      palloc_free_page (p->ring.buf);
+      free (p);
+    }
+}
+
+/* Reads up to SIZE bytes from P into BUFFER, which must be
+   resident, waiting until some data is there unless NONBLOCK.
+   Returns the number of bytes read, 0 at end of file once no
+   write end is open, or -EAGAIN if NONBLOCK and there is no data
+   yet. */
+int
+pipe_read (struct pipe *p, void *buffer, size_t size, bool nonblock)
+{
+  size_t bytes;
+
+  lock_acquire (&p->lock);
+  while (ring_empty (&p->ring) && p->direct_left == 0 && p->writers > 0)
+    {
+      if (nonblock)
+        {
+          lock_release (&p->lock);
+          return size > 0 ? -EAGAIN : 0;
+        }
+      cond_wait (&p->readable, &p->lock);
+    }
+
+  /* Buffered data was written before any direct write. */
+  bytes = ring_read (&p->ring, buffer, size);
+  bytes += direct_get (p, (uint8_t *) buffer + bytes, size - bytes);
+  if (bytes > 0)
+    {
+      cond_broadcast (&p->writable, &p->lock);
+      poll_notify ();
+    }
+  lock_release (&p->lock);
+
+  return bytes;
+}
+
+/* Writes SIZE bytes from BUFFER, which must be resident, to P,
+   waiting for readers to make room.  Returns the number of
+   bytes written, which is less than SIZE only if the last read
+   end was closed meanwhile, or -1 if no read end is open.  If
+   NONBLOCK, writes only what fits in the ring buffer without
+   waiting, and returns -EAGAIN if nothing does. */
+int
+pipe_write (struct pipe *p, const void *buffer, size_t size,
+            bool nonblock)
+{
+  const uint8_t *src = buffer;
+  size_t bytes = 0;
+  int result;
+
+  lock_acquire (&p->lock);
+
+  /* A direct write in progress goes first. */
+  while (p->direct_left > 0 && p->readers > 0 && !nonblock)
+    cond_wait (&p->writable, &p->lock);
+
+  if (size >= PIPE_DIRECT_MIN && ring_empty (&p->ring) && p->readers > 0
+      && !nonblock)
+    {
+      /* Hand the buffer to the readers and wait until they are
+         done with it. */
+      p->direct_pd = thread_current ()->pagedir;
+      p->direct_buf = src;
+      p->direct_left = size;
+      cond_broadcast (&p->readable, &p->lock);
+      poll_notify ();
+      while (p->direct_left > 0 && p->readers > 0)
+        cond_wait (&p->writable, &p->lock);
+      bytes = size - p->direct_left;
+      p->direct_left = 0;
+      p->direct_buf = NULL;
+      p->direct_pd = NULL;
+      cond_broadcast (&p->writable, &p->lock);
+      poll_notify ();
+    }
+  else
+    while (bytes < size && p->readers > 0)
+      {
+        if (ring_full (&p->ring) || p->direct_left > 0)
+          {
+            if (nonblock)
+              break;
+            cond_wait (&p->writable, &p->lock);
+            continue;
+          }
+        bytes += ring_write (&p->ring, src + bytes, size - bytes);
+        cond_broadcast (&p->readable, &p->lock);
+        poll_notify ();
+      }
+
+  if (bytes > 0 || size == 0)
+    result = bytes;
+  else
+    result = p->readers > 0 ? -EAGAIN : -1;
+  lock_release (&p->lock);
+  return result;
+}
+
+/* Returns the poll events, as in <poll.h>, that are ready on a
+   read end of P, or a write end if WRITER: POLLIN if a read
+   would not wait, POLLHUP if no write end is open, POLLOUT if a
+   write would not wait, POLLERR if no read end is open. */
+int
+pipe_poll (struct pipe *p, bool writer)
+{
+  int events = 0;
+
+  lock_acquire (&p->lock);
+  if (!writer)
+    {
+      if (!ring_empty (&p->ring) || p->direct_left > 0)
+        events |= POLLIN;
+      if (p->writers == 0)
+        events |= POLLHUP;
+    }
+  else if (p->readers == 0)
+    events |= POLLERR;
+  else if (!ring_full (&p->ring) && p->direct_left == 0)
+    events |= POLLOUT;
+  lock_release (&p->lock);
+  return events;
+}
+
+/* Copies up to SIZE bytes of P's direct write into DST, a page
+   of the writer at a time through its page directory.  Returns
+   the number of bytes copied. */
+static size_t
+direct_get (struct pipe *p, uint8_t *dst, size_t size)
+{
+  size_t bytes = 0;
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+
+  while (bytes < size && p->direct_left > 0)
+    {
+      const uint8_t *kaddr = pagedir_get_page (p->direct_pd, p->direct_buf);
+      size_t n = PGSIZE - pg_ofs (p->direct_buf);
+      ASSERT (kaddr != NULL);
+      if (n > p->direct_left)
+        n = p->direct_left;
+      if (n > size - bytes)
+        n = size - bytes;
+      memcpy (dst + bytes, kaddr, n);
+      p->direct_buf += n;
+      p->direct_left -= n;
+      bytes += n;
+    }
+  return bytes;
+}
@@ -1,113 +1,247 @@
 #include "userprog/process.h"
+#include <bitmap.h>
+#include <clock.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/aio.h"
 #include "userprog/gdt.h"
+#include "userprog/futex.h"
 #include "userprog/pagedir.h"
+#include "userprog/pipe.h"
 #include "userprog/tss.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/poll.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 #ifdef VM
 #include "userprog/syscall.h"
+#include "vm/checkpoint.h"
 #include "vm/frame.h"
 #include "vm/page.h"
 #endif
 
 #define FD_MIN 2            /* Min value for file descriptors. */
+#define FDS_INIT 8          /* Initial size of descriptor tables. */
 #ifdef VM
 #define MAPID_MIN 0         /* Min value for memory mapped identifiers. */
 #endif
 
-/* Structure for arguments. */
-struct arguments
+/* The memory of a dead process, waiting for the reaper. */
+struct reap_item
   {
-    int argc;               /* Number of arguments. */
-    char **argv;            /* Array of arguments. */
+    uint32_t *pagedir;      /* Page directory. */
+#ifdef VM
+    struct suppl_pt *suppl_pt;  /* Supplemental page table. */
+#endif
+    struct file *exec_file; /* Executable, which code pages refer to. */
+    struct list_elem elem;  /* Element in reap_list. */
+  };
+
+/* Dead processes' memory, freed by the reaper thread so that
+   exiting processes and their waiting parents need not wait for
+   it.  Protected by reap_lock; reap_sema is upped for each item
+   queued. */
+static struct list reap_list;
+static struct lock reap_lock;
+static struct semaphore reap_sema;
+
+/* Process information of every child, process or thread, that
+   its parent has not waited for yet, by pid, so that a parent
+   finds a child without walking its children.  pid_lock protects
+   the table and, for every process, its CHILD_LIST, EXITED_LIST
+   and WAIT_CNT, and the STATUS, IS_WAITING and EXITED_ELEM of
+   their members, and a child's PARENT and INFO. */
+static struct hash pid_table;
+static struct lock pid_lock;
+
+/* Structure for a thread being cloned. */
+struct clone_args
+  {
+    struct thread *leader;  /* Leader of the process to run in. */
+    void *eip;              /* User code to start at. */
+    void *esp;              /* User stack pointer. */
+  };
+
+#ifdef VM
+/* Structure for a process being forked. */
+struct fork_args
+  {
+    struct thread *parent;  /* Forking thread. */
+    struct intr_frame if_;  /* User context of the parent at the fork. */
   };
+#endif
 
-static struct arguments *parse_arguments(char *str_input);
 static thread_func start_process NO_RETURN;
-static bool load (struct arguments *args, void (**eip) (void), void **esp,
+static bool spawn_fds (struct arguments *);
+static thread_func start_clone NO_RETURN;
+static void wait_threads (struct process *);
+static void exit_clone (struct thread *);
+static struct process_info *find_child (pid_t);
+static void report_exit (struct process_info *);
+static void forget_child (struct process *, struct process_info *);
+static hash_hash_func pid_hash;
+static hash_less_func pid_less;
+static thread_func reaper NO_RETURN;
+static void reap (struct reap_item *);
+static struct dir *open_cwd (struct process *);
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+static bool fork_files (struct process *parent);
+#endif
+static bool load (struct arguments *args, struct intr_frame *if_,
                   struct file **exec_file);
 
-/* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+/* Starts a new thread running the user program and arguments
+   in CMD_LINE, separated by spaces.  The new thread may be
+   scheduled (and may even exit) before process_execute()
+   returns.  Returns the new process's thread id, or TID_ERROR if
+   the thread cannot be created. */
 pid_t
-process_execute (const char *file_name)
+process_execute (const char *cmd_line)
 {
-  char *fn_copy;
   struct arguments *args;
-  pid_t pid;
+  const char *arg;
+  size_t len;
 
-  /* Make a copy of FILE_NAME.
-     Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
+  /* The program is the first argument. */
+  cmd_line += strspn (cmd_line, " ");
+  args = process_args_create (cmd_line, strcspn (cmd_line, " "));
+  if (args == NULL)
     return PID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
 
-  /* Parse arguments into the structure. */
-  args = parse_arguments (fn_copy);
-  if (args == NULL)
+  /* Copy the arguments straight into place. */
+  for (arg = cmd_line; *arg != '\0'; arg += len)
     {
-      free (args);
-      palloc_free_page (fn_copy);
-      return PID_ERROR;
+      arg += strspn (arg, " ");
+      len = strcspn (arg, " ");
+      if (len > 0 && !process_args_push (args, arg, len))
+        {
+          process_args_destroy (args);
+          return PID_ERROR;
+        }
     }
 
-  /* Create a new thread to execute the given file name. */
-  pid = (pid_t) thread_create (args->argv[0], PRI_DEFAULT, start_process, args);
+  return process_spawn (args);
+}
+
+/* Starts a new thread running the user program ARGS->file with
+   arguments ARGS, which it takes over.  Returns the new
+   process's thread id, or TID_ERROR if the thread cannot be
+   created. */
+pid_t
+process_spawn (struct arguments *args)
+{
+  pid_t pid;
+
+  /* Free dead processes' memory first, so that it is there for
+     the new one. */
+  process_reap ();
+
+  /* The new process starts in the current working directory. */
+  args->cwd = process_open_cwd ();
+  pid = (pid_t) thread_create (args->file, PRI_DEFAULT, start_process, args);
   if (pid == TID_ERROR)
-    {
-      palloc_free_page (args->argv);
-      free(args);
-      palloc_free_page (fn_copy);
-    }
+    process_args_destroy (args);
   return pid;
 }
 
-/* Parses arguments from the given string by replacing whole
-   adjacent spaces to the null character. Then stores it in
-   given arguments struct. Returns the pointer of arguments
-   struct if successful, NULL otherwise. */
-static struct arguments *
-parse_arguments (char *str_input)
+/* Returns new arguments for running the LEN-byte program name
+   FILE, with no arguments and no files, or NULL if memory is
+   short.  The arguments start with one page, and grow up to
+   ARGS_PAGES. */
+struct arguments *
+process_args_create (const char *file, size_t len)
 {
-  struct arguments *args;
-  char *leftover;
-  char *curr;
-
-  args = (struct arguments *) malloc (sizeof (struct arguments));
+  struct arguments *args = malloc (sizeof *args);
   if (args == NULL)
     return NULL;
-
-  args->argc = 0;
-  args->argv = (char **) palloc_get_page (0);
-  if (args->argv == NULL)
+  args->file = malloc (len + 1);
+  args->strings = palloc_get_page (0);
+  if (args->file == NULL || args->strings == NULL)
     {
+      free (args->file);
+      palloc_free_page (args->strings);
       free (args);
       return NULL;
     }
-
-  for (curr = strtok_r (str_input, " ", &leftover); curr != NULL;
-       curr = strtok_r (NULL, " ", &leftover))
-     args->argv[args->argc ++] = curr;
+  memcpy (args->file, file, len);
+  args->file[len] = '\0';
+  args->argc = 0;
+  args->size = 0;
+  args->page_cnt = 1;
+  args->fd_cnt = 0;
+  args->cwd = NULL;
   return args;
 }
 
+/* Doubles the room for ARGS's strings, up to ARGS_PAGES pages.
+   Returns false if they have that much already, or memory is
+   short. */
+bool
+process_args_grow (struct arguments *args)
+{
+  size_t page_cnt = args->page_cnt * 2;
+  char *strings;
+
+  if (args->page_cnt >= ARGS_PAGES)
+    return false;
+  if (page_cnt > ARGS_PAGES)
+    page_cnt = ARGS_PAGES;
+  strings = palloc_get_multiple (0, page_cnt);
+  if (strings == NULL)
+    return false;
+  memcpy (strings, args->strings, args->size);
+  palloc_free_multiple (args->strings, args->page_cnt);
+  args->strings = strings;
+  args->page_cnt = page_cnt;
+  return true;
+}
+
+/* Appends the LEN bytes at ARG to ARGS as a new argument.
+   Returns false if there is no room for it. */
+bool
+process_args_push (struct arguments *args, const char *arg, size_t len)
+{
+  while (args->size + len + 1 > args->page_cnt * PGSIZE)
+    if (!process_args_grow (args))
+      return false;
+  memcpy (args->strings + args->size, arg, len);
+  args->strings[args->size + len] = '\0';
+  args->size += len + 1;
+  args->argc++;
+  return true;
+}
+
+/* Frees ARGS, closing the descriptors it still holds. */
+void
+process_args_destroy (struct arguments *args)
+{
+  int i;
+
+  for (i = 0; i < args->fd_cnt; i++)
+    process_fd_close (&args->fds[i]);
+  dir_close (args->cwd);
+  free (args->file);
+  palloc_free_multiple (args->strings, args->page_cnt);
+  free (args);
+}
+
 /* A thread function that loads a user process and makes it start
    running. */
 static void
@@ -123,7 +257,10 @@ start_process (void *arguments)
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (args, &if_.eip, &if_.esp, &exec_file);
+  process_current ()->cwd = args->cwd;
+  args->cwd = NULL;
+  success = (load (args, &if_, &exec_file)
+             && spawn_fds (args));
 
   /* Save load result. */
   struct process *curr = process_current ();
@@ -133,17 +270,15 @@ start_process (void *arguments)
         curr->info->status |= PROCESS_RUNNING;
       else
         curr->info->status |= PROCESS_FAIL;
+      sema_up (&curr->info->loaded);
     }
   curr->exec_file = exec_file;
-  curr->fd_next = FD_MIN;
 #ifdef VM
   curr->mapid_next = MAPID_MIN;
 #endif
 
   /* Free resources. */
-  palloc_free_page (args->argv[0]);
-  palloc_free_page (args->argv);
-  free (args);
+  process_args_destroy (args);
 
   /* If load failed, quit. */
   if (!success)
@@ -159,6 +294,257 @@ start_process (void *arguments)
   NOT_REACHED ();
 }
 
+/* Gives the current process the descriptors in ARGS as its
+   first descriptors, in order.  A process restored from a
+   checkpoint keeps its own instead, and those in ARGS are closed
+   with them.  Returns true if successful. */
+static bool
+spawn_fds (struct arguments *args)
+{
+  struct process *curr = process_current ();
+
+  if (args->fd_cnt == 0 || curr->fd_cnt != 0)
+    return true;
+  curr->fds = calloc (args->fd_cnt, sizeof *curr->fds);
+  if (curr->fds == NULL)
+    return false;
+  memcpy (curr->fds, args->fds, args->fd_cnt * sizeof *curr->fds);
+  curr->fd_cnt = args->fd_cnt;
+  curr->fd_free = 0;
+  args->fd_cnt = 0;
+  return true;
+}
+
+/* Starts a new thread in the current process, sharing its memory
+   and descriptors, which runs the user code at EIP with user
+   stack pointer ESP.  The thread is a child of the process, so
+   wait() on its thread id joins it.  Returns the new thread's
+   id, or TID_ERROR if the thread cannot be created or the
+   process is exiting. */
+pid_t
+process_clone (void *eip, void *esp)
+{
+  struct process *proc = process_current ();
+  struct clone_args *args;
+  pid_t tid;
+
+  args = malloc (sizeof *args);
+  if (args == NULL)
+    return TID_ERROR;
+  args->leader = thread_current ()->leader;
+  args->eip = eip;
+  args->esp = esp;
+
+  /* Count the thread first, so that the leader waits for it if
+     the process exits meanwhile. */
+  lock_acquire (&proc->thread_lock);
+  if (proc->exiting)
+    {
+      lock_release (&proc->thread_lock);
+      free (args);
+      return TID_ERROR;
+    }
+  proc->thread_cnt++;
+  lock_release (&proc->thread_lock);
+
+  tid = (pid_t) thread_create (thread_name (), PRI_DEFAULT, start_clone,
+                               args);
+  if (tid == TID_ERROR)
+    {
+      free (args);
+      lock_acquire (&proc->thread_lock);
+      proc->thread_cnt--;
+      cond_signal (&proc->thread_done, &proc->thread_lock);
+      lock_release (&proc->thread_lock);
+    }
+  return tid;
+}
+
+/* A thread function that joins the process of the cloning thread
+   and jumps to the user code it was given. */
+static void
+start_clone (void *clone_args)
+{
+  struct clone_args *args = clone_args;
+  struct thread *t = thread_current ();
+  struct intr_frame if_;
+
+  /* Share the leader's memory. */
+  t->leader = args->leader;
+  t->pagedir = t->leader->pagedir;
+#ifdef VM
+  t->suppl_pt = t->leader->suppl_pt;
+#endif
+  process_activate ();
+  lock_acquire (&pid_lock);
+  t->process.info->status |= PROCESS_RUNNING | PROCESS_THREAD;
+  if (!t->process.info->is_waiting)
+    t->process.parent->wait_cnt--;
+  lock_release (&pid_lock);
+  if (process_exiting ())
+    {
+      free (args);
+      thread_exit ();
+    }
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = (void (*) (void)) args->eip;
+  if_.esp = args->esp;
+  free (args);
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Stores the resource use of the current process in RU, that of
+   its live threads and of those that have exited. */
+void
+process_rusage (struct rusage *ru)
+{
+  enum intr_level old_level = intr_disable ();
+
+  *ru = process_current ()->rusage_exited;
+  thread_rusage_process (thread_current ()->leader, ru);
+  intr_set_level (old_level);
+}
+
+/* Tells the threads of the current process to exit.  Those
+   waiting on futexes or polling are woken; the others exit on
+   their way back to user mode.  Returns true if they had not
+   been told already. */
+bool
+process_stop (void)
+{
+  struct process *proc = process_current ();
+  bool first;
+
+  lock_acquire (&proc->thread_lock);
+  first = !proc->exiting;
+  proc->exiting = true;
+  lock_release (&proc->thread_lock);
+  if (first)
+    {
+      futex_wake_all ();
+      poll_notify ();
+    }
+  return first;
+}
+
+/* Returns true if the threads of the current process are to
+   exit, because one of them called exit() or was killed. */
+bool
+process_exiting (void)
+{
+  return process_current ()->exiting;
+}
+
+#ifdef VM
+/* Starts a new thread running a copy of the current process,
+   which made a system call with user context F.  Its memory is
+   shared copy-on-write with the current process.  Returns the
+   new process's thread id, or TID_ERROR if the thread cannot be
+   created. */
+pid_t
+process_fork (struct intr_frame *f)
+{
+  struct fork_args *args;
+  pid_t pid;
+
+  process_reap ();
+  args = malloc (sizeof *args);
+  if (args == NULL)
+    return PID_ERROR;
+  args->parent = thread_current ();
+  args->if_ = *f;
+
+  pid = (pid_t) thread_create (thread_name (), PRI_DEFAULT, start_fork, args);
+  if (pid == TID_ERROR)
+    free (args);
+  return pid;
+}
+
+/* A thread function that copies the forking process and makes
+   the copy return 0 from the system call. */
+static void
+start_fork (void *fork_args)
+{
+  struct fork_args *args = fork_args;
+  struct thread *parent = args->parent;
+  struct intr_frame if_ = args->if_;
+  struct thread *t = thread_current ();
+  struct process *curr = process_current ();
+  bool success = false;
+
+  free (args);
+  curr->exec_file = NULL;
+  curr->mapid_next = parent->leader->process.mapid_next;
+  curr->heap_start = parent->leader->process.heap_start;
+  curr->brk = parent->leader->process.brk;
+
+  /* Allocate and activate page directory. */
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    goto done;
+  process_activate ();
+  t->suppl_pt = suppl_pt_create ();
+  if (t->suppl_pt == NULL)
+    goto done;
+
+  /* Copy the executable, open files, memory and FPU state.  The
+     parent waits in the system call meanwhile. */
+  curr->exec_file = file_reopen (parent->leader->process.exec_file);
+  if (curr->exec_file == NULL)
+    goto done;
+  file_deny_write (curr->exec_file);
+  curr->cwd = open_cwd (&parent->leader->process);
+  success = (fork_files (&parent->leader->process)
+             && suppl_pt_fork (parent->suppl_pt, curr->exec_file)
+             && fpu_fork (parent));
+
+ done:
+  /* Save fork result. */
+  if (curr->info != NULL)
+    {
+      curr->info->status |= success ? PROCESS_RUNNING : PROCESS_FAIL;
+      sema_up (&curr->info->loaded);
+    }
+  if (!success)
+    thread_exit ();
+
+  /* Return to user mode as the parent did, but with 0 returned. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Opens the files of PARENT again, with the same descriptors
+   and positions, in the current process.  Returns true if
+   successful. */
+static bool
+fork_files (struct process *parent)
+{
+  struct process *curr = process_current ();
+  int i;
+
+  curr->stdin_flags = parent->stdin_flags;
+  if (parent->fd_cnt == 0)
+    return true;
+  curr->fds = calloc (parent->fd_cnt, sizeof *curr->fds);
+  if (curr->fds == NULL)
+    return false;
+  curr->fd_cnt = parent->fd_cnt;
+  curr->fd_free = parent->fd_free;
+
+  for (i = 0; i < parent->fd_cnt; i++)
+    if (!process_fd_dup (&curr->fds[i], &parent->fds[i]))
+      return false;
+  return true;
+}
+#endif
+
 /* Waits for thread PID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If PID is invalid or if it was not a
@@ -168,88 +554,267 @@ start_process (void *arguments)
 int
 process_wait (pid_t child_pid)
 {
-  struct process_info *child = process_find_child (child_pid);
+  struct process *proc = process_current ();
+  struct process_info *child;
 
+  lock_acquire (&pid_lock);
+  child = find_child (child_pid);
   if (child == NULL || child->is_waiting)
-    return -1;
+    {
+      lock_release (&pid_lock);
+      return -1;
+    }
   child->is_waiting = true;
-  while (!(child->status & PROCESS_EXIT))
-    thread_yield ();
+  if (!(child->status & PROCESS_THREAD))
+    {
+      proc->wait_cnt--;
+      if (child->status & PROCESS_EXIT)
+        list_remove (&child->exited_elem);
+    }
+  lock_release (&pid_lock);
+  sema_down (&child->exited);
 
   int exit_code = child->exit_code;
-  list_remove (&child->elem);
+  lock_acquire (&pid_lock);
+  forget_child (proc, child);
+  lock_release (&pid_lock);
   free (child);
   return exit_code;
 }
 
-/* Frees the current process's resources. */
+/* Waits for any child process of the current process that has
+   not been waited for to die, stores its exit status in
+   *EXIT_CODE, and returns its pid.  Returns PID_ERROR at once if
+   there is no such child.  Children that have died are kept in
+   order of death, so this takes no longer with many children
+   than with one. */
+pid_t
+process_wait_any (int *exit_code)
+{
+  struct process *proc = process_current ();
+  struct process_info *child;
+  pid_t pid;
+
+  lock_acquire (&pid_lock);
+  while (list_empty (&proc->exited_list))
+    {
+      if (proc->wait_cnt == 0)
+        {
+          lock_release (&pid_lock);
+          return PID_ERROR;
+        }
+      cond_wait (&proc->child_exited, &pid_lock);
+    }
+  child = list_entry (list_pop_front (&proc->exited_list),
+                      struct process_info, exited_elem);
+  proc->wait_cnt--;
+  forget_child (proc, child);
+  lock_release (&pid_lock);
+
+  pid = child->pid;
+  *exit_code = child->exit_code;
+  free (child);
+  return pid;
+}
+
+/* Adds INFO, describing a new child of PROC, to PROC's children,
+   where process_wait() and process_wait_any() find it. */
+void
+process_add_child (struct process *proc, struct process_info *info)
+{
+  info->parent = proc;
+  lock_acquire (&pid_lock);
+  list_push_back (&proc->child_list, &info->elem);
+  hash_insert (&pid_table, &info->pid_elem);
+  proc->wait_cnt++;
+  lock_release (&pid_lock);
+}
+
+/* Frees the current process's resources, once its other threads
+   have exited.  A thread other than the leader leaves them to
+   the leader. */
 void
 process_exit (void)
 {
   struct process *proc = process_current ();
 
+  if (thread_current ()->leader != thread_current ())
+    {
+      exit_clone (thread_current ());
+      return;
+    }
+  process_stop ();
+  wait_threads (proc);
+
   /* Inform exit to child processes. */
-  struct list_elem *e;
-  for (e = list_begin (&proc->child_list); e != list_end (&proc->child_list);)
+  lock_acquire (&pid_lock);
+  while (!list_empty (&proc->child_list))
     {
-      struct process_info *child = list_entry (e, struct process_info, elem);
+      struct process_info *child = list_entry (list_front (&proc->child_list),
+                                               struct process_info, elem);
       if (!(child->status & PROCESS_EXIT))
         {
           child->process->parent = NULL;
           child->process->info = NULL;
         }
-      e = list_next (e);
+      forget_child (proc, child);
       free (child);
     }
+  list_init (&proc->exited_list);
+  proc->wait_cnt = 0;
+  lock_release (&pid_lock);
 
-  /* Update the process status and free resources. */
-  if (proc->info != NULL)
-    proc->info->status |= PROCESS_EXIT;
-  file_close (proc->exec_file);
-  for (e = list_begin (&proc->file_list); e != list_end (&proc->file_list);)
-    {
-      struct process_file *pfe = list_entry (e, struct process_file, elem);
-      e = list_next (e);
-      file_close (pfe->file);
-      free (pfe);
-    }
+  /* Free resources. */
+  aio_destroy (proc->aio);
+  proc->aio = NULL;
+  int i;
+  for (i = 0; i < proc->fd_cnt; i++)
+    process_fd_close (&proc->fds[i]);
+  free (proc->fds);
+  proc->fds = NULL;
+  proc->fd_cnt = 0;
+  dir_close (proc->cwd);
+  proc->cwd = NULL;
 #ifdef VM
-  for (e = list_begin (&proc->mmap_list); e != list_end (&proc->mmap_list);)
-    {
-      struct process_mmap *mmap = list_entry (e, struct process_mmap, elem);
-      e = list_next (e);
-      mmap_unmap_item (mmap);
-    }
+  while (!rb_empty (&proc->mmap_ids))
+    mmap_unmap_item (rb_entry (rb_first (&proc->mmap_ids),
+                               struct process_mmap, id_elem));
 #endif
 
+  /* Let the executable be written as soon as the process is
+     gone, though its code pages keep it open until reaped. */
   struct thread *curr = thread_current ();
-  uint32_t *pd;
+  struct reap_item item;
+  if (proc->exec_file != NULL)
+    file_allow_write (proc->exec_file);
+  item.exec_file = proc->exec_file;
+  proc->exec_file = NULL;
+
+  /* Detach the current process's memory and switch back to the
+     kernel-only page directory.  Correct ordering here is
+     crucial.  We must set cur->pagedir to NULL before switching
+     page directories, so that a timer interrupt can't switch back
+     to the process page directory.  We must activate the base
+     page directory before the process's page directory is
+     destroyed, or our active page directory will be one that's
+     been freed (and cleared). */
+  item.pagedir = curr->pagedir;
+  curr->pagedir = NULL;
+  if (item.pagedir != NULL)
+    pagedir_activate (NULL);
+#ifdef VM
+  item.suppl_pt = curr->suppl_pt;
+  curr->suppl_pt = NULL;
+#endif
+
+  /* Hand the memory to the reaper, or free it here if there is
+     none or no memory for that. */
+  struct reap_item *r = item.pagedir != NULL ? malloc (sizeof *r) : NULL;
+  if (r != NULL)
+    {
+      *r = item;
+      lock_acquire (&reap_lock);
+      list_push_back (&reap_list, &r->elem);
+      lock_release (&reap_lock);
+      sema_up (&reap_sema);
+    }
+  else
+    reap (&item);
+
+  /* Update the process status. */
+  lock_acquire (&pid_lock);
+  report_exit (proc->info);
+  lock_release (&pid_lock);
+}
+
+/* Waits until the threads of PROC, the current process, other
+   than its leader have exited. */
+static void
+wait_threads (struct process *proc)
+{
+  lock_acquire (&proc->thread_lock);
+  while (proc->thread_cnt > 0)
+    cond_wait (&proc->thread_done, &proc->thread_lock);
+  lock_release (&proc->thread_lock);
+}
+
+/* Ends thread T, the current thread, which is not the leader of
+   its process.  The leader frees the memory T shared. */
+static void
+exit_clone (struct thread *t)
+{
+  struct process *proc = &t->leader->process;
+  enum intr_level old_level;
 
+  /* Leave the process's page directory before the leader may
+     destroy it. */
+  t->pagedir = NULL;
+  pagedir_activate (NULL);
 #ifdef VM
-  /* Destroy the current process's supplemental page table. */
-  struct suppl_pt *pt = curr->suppl_pt;
-  if (pt != NULL)
-    suppl_pt_destroy (pt);
+  t->suppl_pt = NULL;
 #endif
 
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
-  pd = curr->pagedir;
-  if (pd != NULL)
+  /* Hand T's resource use over to the process. */
+  old_level = intr_disable ();
+  rusage_add (&proc->rusage_exited, &t->rusage);
+  memset (&t->rusage, 0, sizeof t->rusage);
+  intr_set_level (old_level);
+
+  /* Report to joiners, then let the leader go on. */
+  lock_acquire (&proc->thread_lock);
+  lock_acquire (&pid_lock);
+  report_exit (t->process.info);
+  lock_release (&pid_lock);
+  proc->thread_cnt--;
+  cond_signal (&proc->thread_done, &proc->thread_lock);
+  lock_release (&proc->thread_lock);
+}
+
+/* Frees the memory of every dead process waiting for the
+   reaper. */
+void
+process_reap (void)
+{
+  for (;;)
+    {
+      struct reap_item *r = NULL;
+
+      lock_acquire (&reap_lock);
+      if (!list_empty (&reap_list))
+        r = list_entry (list_pop_front (&reap_list), struct reap_item, elem);
+      lock_release (&reap_lock);
+      if (r == NULL)
+        return;
+      reap (r);
+      free (r);
+    }
+}
+
+/* The reaper thread, which frees dead processes' memory. */
+static void
+reaper (void *aux UNUSED)
+{
+  for (;;)
     {
-      /* Correct ordering here is crucial.  We must set
-         cur->pagedir to NULL before switching page directories,
-         so that a timer interrupt can't switch back to the
-         process page directory.  We must activate the base page
-         directory before destroying the process's page
-         directory, or our active page directory will be one
-         that's been freed (and cleared). */
-      curr->pagedir = NULL;
-      pagedir_activate (NULL);
-      pagedir_destroy (pd);
+      sema_down (&reap_sema);
+      process_reap ();
     }
 }
 
+/* Frees the memory of a dead process described by R. */
+static void
+reap (struct reap_item *r)
+{
+#ifdef VM
+  if (r->suppl_pt != NULL)
+    suppl_pt_destroy (r->suppl_pt);
+#endif
+
+  /* Close the executable only now, since code pages refer to it. */
+  file_close (r->exec_file);
+  pagedir_destroy (r->pagedir);
+}
+
 /* Sets up the CPU for running user code in the current
    thread.
    This function is called on every context switch. */
@@ -258,19 +823,44 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  A kernel thread keeps the
+     active ones, since every page directory maps the kernel, and
+     reloading an already active page directory would only flush
+     the TLB. */
+  if (t->pagedir != NULL)
+    pagedir_switch (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
   tss_update ();
+
+#ifdef VM
+  /* Note that the process runs, for page replacement. */
+  if (t->suppl_pt != NULL)
+    {
+      t->suppl_pt->run_tick = timer_ticks ();
+      t->suppl_pt->run_priority = t->priority;
+    }
+#endif
+}
+
+/* Notes that thread PREV was switched away from, possibly to
+   block or die.  Called with interrupts off on every context
+   switch, before process_activate(). */
+void
+process_deactivate (struct thread *prev UNUSED)
+{
+#ifdef VM
+  if (prev->suppl_pt != NULL)
+    prev->suppl_pt->run_tick = timer_ticks ();
+#endif
 }
 
 /* Returns the current process. */
 struct process *
 process_current (void)
 {
-  return &thread_current ()->process;
+  return &thread_current ()->leader->process;
 }
 
 /* Returns the child process of the current process
@@ -278,72 +868,281 @@ process_current (void)
 struct process_info *
 process_find_child (pid_t pid)
 {
-  struct list *list = &process_current ()->child_list;
-  struct list_elem *e;
-  for (e = list_begin (list); e != list_end (list); e = list_next (e))
+  struct process_info *found;
+
+  lock_acquire (&pid_lock);
+  found = find_child (pid);
+  lock_release (&pid_lock);
+  return found;
+}
+
+/* Returns the child of the current process with PID, or a null
+   pointer if there is none.  pid_lock must be held. */
+static struct process_info *
+find_child (pid_t pid)
+{
+  struct process_info key, *found;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&pid_lock));
+
+  key.pid = pid;
+  e = hash_find (&pid_table, &key.pid_elem);
+  if (e == NULL)
+    return NULL;
+  found = hash_entry (e, struct process_info, pid_elem);
+  return found->parent == process_current () ? found : NULL;
+}
+
+/* Marks the child described by INFO, if not null, as exited, and
+   wakes its waiter, or queues it for process_wait_any() if
+   nobody waits for it.  pid_lock must be held. */
+static void
+report_exit (struct process_info *info)
+{
+  ASSERT (lock_held_by_current_thread (&pid_lock));
+
+  if (info == NULL)
+    return;
+  info->status |= PROCESS_EXIT;
+  if (!info->is_waiting && !(info->status & PROCESS_THREAD))
     {
-      struct process_info *child = list_entry (e, struct process_info, elem);
-      if (child->pid == pid)
-        return child;
+      list_push_back (&info->parent->exited_list, &info->exited_elem);
+      cond_broadcast (&info->parent->child_exited, &pid_lock);
     }
-  return NULL;
+  sema_up (&info->exited);
 }
 
-/* Returns a process' file by the file descriptor. */
+/* Removes CHILD from the children of PROC and from the pid
+   table, without freeing it.  pid_lock must be held. */
+static void
+forget_child (struct process *proc UNUSED, struct process_info *child)
+{
+  ASSERT (lock_held_by_current_thread (&pid_lock));
+  ASSERT (child->parent == proc);
+
+  list_remove (&child->elem);
+  hash_delete (&pid_table, &child->pid_elem);
+}
+
+/* Returns a hash value for the pid of process information E. */
+static unsigned
+pid_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct process_info, pid_elem)->pid);
+}
+
+/* Returns true if process information A has a smaller pid than
+   B. */
+static bool
+pid_less (const struct hash_elem *a, const struct hash_elem *b,
+          void *aux UNUSED)
+{
+  return (hash_entry (a, struct process_info, pid_elem)->pid
+          < hash_entry (b, struct process_info, pid_elem)->pid);
+}
+
+/* Returns the current process's descriptor FD, or NULL if FD is
+   not open. */
+struct fd_entry *
+process_get_fd (int fd)
+{
+  struct process *curr = process_current ();
+  struct fd_entry *e;
+
+  if (fd < FD_MIN || fd - FD_MIN >= curr->fd_cnt)
+    return NULL;
+  e = &curr->fds[fd - FD_MIN];
+  return e->file != NULL || e->pipe != NULL ? e : NULL;
+}
+
+/* Returns a process' file by the file descriptor, or NULL if FD
+   is not an open file. */
 struct file *
 process_get_file (int fd)
 {
-  struct list *list = &process_current ()->file_list;
-  struct list_elem *e;
-  for (e = list_begin (list); e != list_end (list); e = list_next (e))
+  struct fd_entry *e = process_get_fd (fd);
+  return e != NULL ? e->file : NULL;
+}
+
+/* Sets descriptor E, which the current process takes over, into
+   the current process and returns its number, the lowest one
+   free, or -1 if memory is short.  The descriptor table doubles
+   in size when full. */
+int
+process_set_fd (const struct fd_entry *e)
+{
+  struct process *curr = process_current ();
+  int i;
+
+  /* Find the lowest free slot. */
+  for (i = curr->fd_free; i < curr->fd_cnt; i++)
+    if (curr->fds[i].file == NULL && curr->fds[i].pipe == NULL)
+      break;
+
+  /* Grow the table if there is none. */
+  if (i == curr->fd_cnt)
     {
-      struct process_file *pfe = list_entry (e, struct process_file, elem);
-      if (pfe->fd == fd)
-        return pfe->file;
+      int cnt = curr->fd_cnt > 0 ? curr->fd_cnt * 2 : FDS_INIT;
+      struct fd_entry *fds = realloc (curr->fds, cnt * sizeof *fds);
+      if (fds == NULL)
+        return -1;
+      memset (fds + curr->fd_cnt, 0, (cnt - curr->fd_cnt) * sizeof *fds);
+      curr->fds = fds;
+      curr->fd_cnt = cnt;
     }
-  return NULL;
+
+  curr->fds[i] = *e;
+  curr->fd_free = i + 1;
+  return i + FD_MIN;
 }
 
-/* Sets the file into the current process and returns the file descriptor. */
+/* Sets the file into the current process and returns the file
+   descriptor, or -1 if memory is short. */
 int
 process_set_file (struct file *file)
 {
-  /* Create a file element. */
-  struct process_file *pfe;
-  pfe = (struct process_file *) malloc (sizeof (struct process_file));
-  if (pfe == NULL)
-    return -1;
+  struct fd_entry e = { file, NULL, false, 0 };
+  return process_set_fd (&e);
+}
 
-  /* Initialize the file element. */
+/* Closes descriptor FD of the current process.
+   Returns false if FD is not open. */
+bool
+process_close_fd (int fd)
+{
   struct process *curr = process_current ();
-  pfe->fd = curr->fd_next++;
-  pfe->file = file;
-  list_push_back (&curr->file_list, &pfe->elem);
+  struct fd_entry *e = process_get_fd (fd);
+  if (e == NULL)
+    return false;
 
-  /* Return the file descriptor. */
-  return pfe->fd;
+  process_fd_close (e);
+  if (fd - FD_MIN < curr->fd_free)
+    curr->fd_free = fd - FD_MIN;
+  return true;
+}
+
+/* Makes DST a descriptor for what SRC refers to, with its own
+   file position for a file.  A closed SRC makes DST closed.
+   Returns true if successful, false if memory is short. */
+bool
+process_fd_dup (struct fd_entry *dst, const struct fd_entry *src)
+{
+  *dst = *src;
+  if (src->pipe != NULL)
+    pipe_reopen (src->pipe, src->pipe_writer);
+  else if (src->file != NULL)
+    {
+      dst->file = file_reopen (src->file);
+      if (dst->file == NULL)
+        return false;
+      file_seek (dst->file, file_tell (src->file));
+    }
+  return true;
+}
+
+/* Closes descriptor E, leaving it closed. */
+void
+process_fd_close (struct fd_entry *e)
+{
+  if (e->pipe != NULL)
+    pipe_close (e->pipe, e->pipe_writer);
+  file_close (e->file);
+  e->file = NULL;
+  e->pipe = NULL;
+}
+
+/* Opens the current process's working directory again and
+   returns it, or a null pointer if memory is short. */
+struct dir *
+process_open_cwd (void)
+{
+  return open_cwd (process_current ());
+}
+
+/* Makes DIR, which the current process takes over, its working
+   directory. */
+void
+process_set_cwd (struct dir *dir)
+{
+  struct process *proc = process_current ();
+  struct dir *old;
+
+  lock_acquire (&proc->thread_lock);
+  old = proc->cwd;
+  proc->cwd = dir;
+  lock_release (&proc->thread_lock);
+  dir_close (old);
+}
+
+/* Opens the working directory of PROC again and returns it, or
+   a null pointer if memory is short.  A process without one
+   works in the root directory. */
+static struct dir *
+open_cwd (struct process *proc)
+{
+  struct dir *dir;
+
+  lock_acquire (&proc->thread_lock);
+  dir = proc->cwd != NULL ? dir_reopen (proc->cwd) : dir_open_root ();
+  lock_release (&proc->thread_lock);
+  return dir;
 }
 
 #ifdef VM
+/* Orders memory mapped files by identifier. */
+static bool
+mmap_id_less (const struct rb_elem *a_, const struct rb_elem *b_,
+              void *aux UNUSED)
+{
+  const struct process_mmap *a = rb_entry (a_, struct process_mmap, id_elem);
+  const struct process_mmap *b = rb_entry (b_, struct process_mmap, id_elem);
+  return a->id < b->id;
+}
+
+/* Initializes PROC's sets of memory mapped files, which are kept
+   in trees so that finding one by identifier or by address takes
+   O(lg n) time. */
+void
+process_mmap_init (struct process *proc)
+{
+  rb_init (&proc->mmap_ids, mmap_id_less, NULL, NULL);
+  itree_init (&proc->mmap_ranges);
+}
+
 /* Returns a process' memory mapped file by its identifier. */
 struct process_mmap *
 process_get_mmap (mapid_t id)
 {
-  struct list *list = &process_current ()->mmap_list;
-  struct list_elem *e;
-  for (e = list_begin (list); e != list_end (list); e = list_next (e))
-    {
-      struct process_mmap *mmap = list_entry (e, struct process_mmap, elem);
-      if (mmap->id == id)
-        return mmap;
-    }
-  return NULL;
+  struct process_mmap key;
+  struct rb_elem *e;
+
+  key.id = id;
+  e = rb_find (&process_current ()->mmap_ids, &key.id_elem);
+  return e != NULL ? rb_entry (e, struct process_mmap, id_elem) : NULL;
+}
+
+/* Returns a memory mapped file of the current process that
+   overlaps the SIZE bytes at user virtual address ADDR, or NULL
+   if there is none. */
+struct process_mmap *
+process_find_mmap (const void *addr, size_t size)
+{
+  struct itree_elem *e;
+
+  ASSERT (size > 0);
+
+  e = itree_find (&process_current ()->mmap_ranges, (uintptr_t) addr,
+                  (uintptr_t) addr + size);
+  return e != NULL ? itree_entry (e, struct process_mmap, range_elem) : NULL;
 }
 
-/* Sets the memory mapped file information into
-   the current process and returns its identifier. */
+/* Sets the memory mapped file information, or the mapping of
+   shared memory segment SHM if FILE is null, into the current
+   process and returns its identifier. */
 mapid_t
-process_set_mmap (struct file *file, void *addr, size_t size)
+process_set_mmap (struct file *file, struct shm_segment *shm, void *addr,
+                  size_t size)
 {
   struct process_mmap *mmap = malloc (sizeof (struct process_mmap));
   if (mmap == NULL)
@@ -352,12 +1151,26 @@ process_set_mmap (struct file *file, void *addr, size_t size)
   struct process *curr = process_current ();
   mmap->id = curr->mapid_next++;
   mmap->file = file;
+  mmap->shm = shm;
   mmap->addr = addr;
   mmap->size = size;
-  list_push_back (&curr->mmap_list, &mmap->elem);
+  rb_insert (&curr->mmap_ids, &mmap->id_elem);
+  itree_insert (&curr->mmap_ranges, &mmap->range_elem, (uintptr_t) addr,
+                (uintptr_t) addr + size);
 
   return mmap->id;
 }
+
+/* Removes MMAP from the memory mapped files of the current
+   process. */
+void
+process_remove_mmap (struct process_mmap *mmap)
+{
+  struct process *curr = process_current ();
+
+  rb_remove (&curr->mmap_ids, &mmap->id_elem);
+  itree_remove (&curr->mmap_ranges, &mmap->range_elem);
+}
 #endif
 
 /* We load ELF binaries.  The following definitions are taken
@@ -423,28 +1236,136 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
+/* A load segment of an executable, already validated. */
+struct exec_segment
+  {
+    uint32_t file_page;         /* File offset of its first page. */
+    uint8_t *upage;             /* Its first user page. */
+    uint32_t read_bytes;        /* Bytes read from the file. */
+    uint32_t zero_bytes;        /* Bytes zeroed after them. */
+    bool writable;              /* Whether its pages are writable. */
+  };
+
+/* The parsed image of an executable: what load() needs of its
+   ELF headers. */
+struct exec_image
+  {
+    bool in_use;                /* Whether a cache entry is in use. */
+    disk_sector_t inumber;      /* Inode sector of the executable. */
+    unsigned generation;        /* Inode generation when parsed. */
+    void (*entry) (void);       /* Entry point. */
+    int segment_cnt;            /* Number of load segments. */
+    struct exec_segment *segments;      /* Load segments. */
+#ifdef VM
+    struct bitmap *startup;     /* File pages faulted in early in its
+                                   runs, or NULL.  Kept by cache
+                                   entries only. */
+#endif
+  };
+
+/* Executable cache.  Repeated executions of a binary reuse its
+   parsed headers while its inode generation is unchanged, that
+   is, until the file is written.  Entries are replaced in
+   rotation. */
+#define EXEC_CACHE_SIZE 8
+static struct exec_image exec_cache[EXEC_CACHE_SIZE];
+static int exec_cache_next;
+static struct lock exec_cache_lock;
+
+#ifdef VM
+/* Startup profiles.  The file pages that the runs of a cached
+   executable fault in during their first startup_profile_ms ms
+   are marked in its cache entry, up to STARTUP_PAGES pages, and
+   the next run has them read into the buffer cache in the
+   background while it starts, so that its faults find them
+   there instead of waiting for the disk one page at a time. */
+#define STARTUP_PAGES 256
+
+/* Milliseconds of each run profiled, or 0 to not profile.
+   Controlled by kernel command-line option "-startup=MS". */
+unsigned startup_profile_ms = 500;
+
+/* Reads the profiled pages of an executable. */
+struct startup_prefetch
+  {
+    struct work work;           /* Work item. */
+    struct inode *inode;        /* Executable. */
+    size_t page_cnt;            /* Number of pages. */
+    uint16_t pages[];           /* Page numbers, ascending. */
+  };
+
+/* Queue with the worker that reads profiled pages. */
+static struct workqueue startup_wq;
+
+/* Segments of at most EAGER_PAGES pages, such as the code and
+   data of small programs, are read in and mapped while the
+   process loads, instead of at a fault per page once it runs.
+   Larger segments stay lazy, since a run may touch little of
+   them. */
+#define EAGER_PAGES 4
+#endif
+
+static bool exec_image_get (struct file *, const char *file_name,
+                            struct exec_image *);
+static bool exec_image_copy (struct exec_image *dst,
+                             const struct exec_image *src);
+static bool exec_image_parse (struct file *, const char *file_name,
+                              struct exec_image *);
+#ifdef VM
+static void startup_prefetch (struct inode *, const struct bitmap *);
+static work_func startup_read;
+static void load_segment_eager (struct file *, const struct exec_segment *);
+#endif
 static bool setup_stack (struct arguments *args, void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
-static void *push_args_on_stack(struct arguments *args);
+static void *push_args_on_stack (struct arguments *args);
+
+/* Initializes the pid table, before the first thread is
+   created. */
+void
+process_table_init (void)
+{
+  lock_init (&pid_lock);
+  if (!hash_init (&pid_table, pid_hash, pid_less, NULL))
+    PANIC ("cannot allocate the pid table");
+}
+
+/* Initializes the executable cache and starts the reaper. */
+void
+process_init (void)
+{
+  lock_init (&exec_cache_lock);
+#ifdef VM
+  workqueue_init (&startup_wq, "startup", 1, SCHED_NORMAL, PRI_DEFAULT);
+#endif
+  list_init (&reap_list);
+  lock_init (&reap_lock);
+  sema_init (&reap_sema, 0);
+  if (thread_create ("reaper", PRI_DEFAULT, reaper, NULL) == TID_ERROR)
+    PANIC ("cannot start the reaper");
+}
 
 /* Loads an ELF executable from FILE_NAME into the current thread.
-   Stores the executable's entry point into *EIP
-   and its initial stack pointer into *ESP.
+   Stores the executable's entry point into IF_'s EIP
+   and its initial stack pointer into its ESP.  With a checkpoint
+   image instead, restores the process saved in it and sets up
+   IF_ to resume it.
    Returns true if successful, false otherwise. */
 bool
-load (struct arguments *args, void (**eip) (void), void **esp,
+load (struct arguments *args, struct intr_frame *if_,
       struct file **exec_file)
 {
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
+  struct exec_image image;
   struct file *file = NULL;
-  char *file_name = args->argv[0];
-  off_t file_ofs;
+  char *file_name = args->file;
   int i;
 
+  image.segments = NULL;
+
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL)
@@ -456,6 +1377,7 @@ load (struct arguments *args, void (**eip) (void), void **esp,
   t->suppl_pt = suppl_pt_create ();
   if (t->suppl_pt == NULL)
     goto fail;
+  t->process.heap_start = NULL;
 #endif
 
   /* Open executable file. */
@@ -469,8 +1391,247 @@ load (struct arguments *args, void (**eip) (void), void **esp,
   /* Deny writing to executable file. */
   file_deny_write (file);
 
+#ifdef VM
+  /* Resume a checkpointed process, whose pages are in FILE. */
+  if (checkpoint_is_image (file))
+    {
+      if (!checkpoint_restore (file, if_))
+        goto fail;
+      *exec_file = file;
+      return true;
+    }
+#endif
+
+  /* Get the executable's segments, parsed unless cached. */
+  if (!exec_image_get (file, file_name, &image))
+    goto fail;
+
+#ifdef VM
+  /* Profile the start of the run. */
+  t->process.startup_end = (startup_profile_ms != 0
+                            ? timer_ticks ()
+                              + (int64_t) startup_profile_ms * TIMER_FREQ
+                                / 1000
+                            : 0);
+#endif
+
+  /* Load segments. */
+  for (i = 0; i < image.segment_cnt; i++)
+    {
+      struct exec_segment *seg = image.segments + i;
+      if (!load_segment (file, seg->file_page, seg->upage, seg->read_bytes,
+                         seg->zero_bytes, seg->writable))
+        goto fail;
+#ifdef VM
+      if (DIV_ROUND_UP (seg->read_bytes + seg->zero_bytes, PGSIZE)
+          <= EAGER_PAGES)
+        load_segment_eager (file, seg);
+
+      /* The heap starts after the last segment. */
+      void *end = seg->upage + seg->read_bytes + seg->zero_bytes;
+      if (end > t->process.heap_start)
+        t->process.heap_start = end;
+#endif
+    }
+
+#ifdef VM
+  t->process.brk = t->process.heap_start;
+#endif
+
+  /* Set up stack. */
+  if (!setup_stack (args, &if_->esp))
+    goto fail;
+
+  /* Start address. */
+  if_->eip = image.entry;
+
+  /* Save the executable file. */
+  *exec_file = file;
+
+  free (image.segments);
+  return true;
+
+ fail:
+  /* We arrive here when the load is failed. */
+  free (image.segments);
+  file_close (file);
+  return false;
+}
+
+/* Stores in IMAGE the parsed image of FILE, the executable named
+   FILE_NAME, from the executable cache if it holds the file's
+   current contents.  Otherwise parses FILE and caches the
+   result.  The caller must free IMAGE->segments.
+   Returns true if successful, false if FILE is not a valid
+   executable. */
+static bool
+exec_image_get (struct file *file, const char *file_name,
+                struct exec_image *image)
+{
+  struct inode *inode = file_get_inode (file);
+  disk_sector_t inumber = inode_get_inumber (inode);
+  unsigned generation = inode_generation (inode);
+  struct exec_image *e;
+
+  /* Look for the image in the cache. */
+  lock_acquire (&exec_cache_lock);
+  for (e = exec_cache; e < exec_cache + EXEC_CACHE_SIZE; e++)
+    if (e->in_use && e->inumber == inumber && e->generation == generation
+        && exec_image_copy (image, e))
+      {
+#ifdef VM
+        if (e->startup != NULL && startup_profile_ms != 0)
+          startup_prefetch (inode, e->startup);
+#endif
+        lock_release (&exec_cache_lock);
+        return true;
+      }
+  lock_release (&exec_cache_lock);
+
+  /* Parse it, and cache a copy in place of the entry next in
+     rotation. */
+  if (!exec_image_parse (file, file_name, image))
+    return false;
+  image->inumber = inumber;
+  image->generation = generation;
+  lock_acquire (&exec_cache_lock);
+  e = exec_cache + exec_cache_next;
+  exec_cache_next = (exec_cache_next + 1) % EXEC_CACHE_SIZE;
+  free (e->segments);
+#ifdef VM
+  if (e->startup != NULL)
+    bitmap_destroy (e->startup);
+#endif
+  e->in_use = exec_image_copy (e, image);
+#ifdef VM
+  if (e->in_use)
+    e->startup = bitmap_create (STARTUP_PAGES);
+#endif
+  lock_release (&exec_cache_lock);
+  return true;
+}
+
+/* Copies image SRC into DST, with a new segment array.
+   Returns true if successful, false if out of memory. */
+static bool
+exec_image_copy (struct exec_image *dst, const struct exec_image *src)
+{
+  size_t size = src->segment_cnt * sizeof *src->segments;
+
+  *dst = *src;
+  dst->segments = NULL;
+#ifdef VM
+  dst->startup = NULL;
+#endif
+  if (size == 0)
+    return true;
+  dst->segments = malloc (size);
+  if (dst->segments == NULL)
+    return false;
+  memcpy (dst->segments, src->segments, size);
+  return true;
+}
+
+#ifdef VM
+/* Notes that the current process faulted in the page of PTE,
+   for the startup profile of its executable if the page is one
+   of the executable's and the run is young enough. */
+void
+process_startup_fault (const struct suppl_pte *pte)
+{
+  struct process *proc = process_current ();
+  struct inode *inode;
+  disk_sector_t inumber;
+  unsigned generation;
+  size_t page;
+  struct exec_image *e;
+
+  if (proc->startup_end == 0 || pte->type != PAGE_FILE || pte->mmap
+      || proc->exec_file == NULL)
+    return;
+  if (timer_ticks () >= proc->startup_end)
+    {
+      proc->startup_end = 0;
+      return;
+    }
+  inode = file_get_inode (pte->file);
+  if (inode != file_get_inode (proc->exec_file))
+    return;
+  page = pte->ofs / PGSIZE;
+  if (page >= STARTUP_PAGES)
+    return;
+
+  inumber = inode_get_inumber (inode);
+  generation = inode_generation (inode);
+  lock_acquire (&exec_cache_lock);
+  for (e = exec_cache; e < exec_cache + EXEC_CACHE_SIZE; e++)
+    if (e->in_use && e->inumber == inumber && e->generation == generation
+        && e->startup != NULL)
+      bitmap_mark (e->startup, page);
+  lock_release (&exec_cache_lock);
+}
+
+/* Queues a read of the pages of INODE marked in STARTUP into the
+   buffer cache.  Does nothing if none is marked or out of
+   memory. */
+static void
+startup_prefetch (struct inode *inode, const struct bitmap *startup)
+{
+  size_t cnt = bitmap_count (startup, 0, STARTUP_PAGES, true);
+  struct startup_prefetch *sp;
+  size_t page;
+
+  ASSERT (lock_held_by_current_thread (&exec_cache_lock));
+
+  if (cnt == 0)
+    return;
+  sp = malloc (sizeof *sp + cnt * sizeof *sp->pages);
+  if (sp == NULL)
+    return;
+  sp->inode = inode_reopen (inode);
+  sp->page_cnt = 0;
+  for (page = bitmap_scan (startup, 0, 1, true); page != BITMAP_ERROR;
+       page = bitmap_scan (startup, page + 1, 1, true))
+    sp->pages[sp->page_cnt++] = page;
+  work_init (&sp->work, startup_read, sp);
+  work_queue (&startup_wq, &sp->work);
+}
+
+/* Work function that reads the pages of startup prefetch SP_
+   into the buffer cache. */
+static void
+startup_read (void *sp_)
+{
+  struct startup_prefetch *sp = sp_;
+  void *buffer = palloc_get_page (0);
+  size_t i;
+
+  if (buffer != NULL)
+    for (i = 0; i < sp->page_cnt; i++)
+      inode_read_at_cached (sp->inode, buffer, PGSIZE,
+                            (off_t) sp->pages[i] * PGSIZE);
+  palloc_free_page (buffer);
+  inode_close (sp->inode);
+  free (sp);
+}
+#endif
+
+/* Reads and validates the ELF headers of FILE, the executable
+   named FILE_NAME, into IMAGE.  Returns true if successful,
+   false otherwise. */
+static bool
+exec_image_parse (struct file *file, const char *file_name,
+                  struct exec_image *image)
+{
+  struct Elf32_Ehdr ehdr;
+  off_t file_ofs;
+  int i;
+
+  image->segment_cnt = 0;
+  image->segments = NULL;
+
   /* Read and verify executable header. */
-  if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
+  if (file_read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
       || ehdr.e_type != 2
       || ehdr.e_machine != 3
@@ -479,8 +1640,14 @@ load (struct arguments *args, void (**eip) (void), void **esp,
       || ehdr.e_phnum > 1024)
     {
       printf ("load: %s: error loading executable\n", file_name);
-      goto fail;
+      return false;
     }
+  image->entry = (void (*) (void)) ehdr.e_entry;
+  if (ehdr.e_phnum == 0)
+    return true;
+  image->segments = malloc (ehdr.e_phnum * sizeof *image->segments);
+  if (image->segments == NULL)
+    return false;
 
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
@@ -490,9 +1657,7 @@ load (struct arguments *args, void (**eip) (void), void **esp,
 
       if (file_ofs < 0 || file_ofs > file_length (file))
         goto fail;
-      file_seek (file, file_ofs);
-
-      if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
+      if (file_read_at (file, &phdr, sizeof phdr, file_ofs) != sizeof phdr)
         goto fail;
       file_ofs += sizeof phdr;
       switch (phdr.p_type)
@@ -511,51 +1676,40 @@ load (struct arguments *args, void (**eip) (void), void **esp,
         case PT_LOAD:
           if (validate_segment (&phdr, file))
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
+              struct exec_segment *seg;
               uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
+              seg = image->segments + image->segment_cnt++;
+              seg->writable = (phdr.p_flags & PF_W) != 0;
+              seg->file_page = phdr.p_offset & ~PGMASK;
+              seg->upage = (uint8_t *) (phdr.p_vaddr & ~PGMASK);
               if (phdr.p_filesz > 0)
                 {
                   /* Normal segment.
                      Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
+                  seg->read_bytes = page_offset + phdr.p_filesz;
+                  seg->zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz,
+                                               PGSIZE)
+                                     - seg->read_bytes);
                 }
               else
                 {
                   /* Entirely zero.
                      Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+                  seg->read_bytes = 0;
+                  seg->zero_bytes = ROUND_UP (page_offset + phdr.p_memsz,
+                                              PGSIZE);
                 }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto fail;
             }
           else
             goto fail;
           break;
         }
     }
-
-  /* Set up stack. */
-  if (!setup_stack (args, esp))
-    goto fail;
-
-  /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
-
-  /* Save the executable file. */
-  *exec_file = file;
-
   return true;
 
  fail:
-  /* We arrive here when the load is failed. */
-  file_close (file);
+  free (image->segments);
+  image->segments = NULL;
   return false;
 }
 
@@ -606,6 +1760,11 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
   if (phdr->p_vaddr < PGSIZE)
     return false;
 
+  /* The clock page is taken. */
+  if (phdr->p_vaddr < (uintptr_t) CLOCK_PAGE + PGSIZE
+      && phdr->p_vaddr + phdr->p_memsz > (uintptr_t) CLOCK_PAGE)
+    return false;
+
   /* It's okay. */
   return true;
 }
@@ -642,8 +1801,15 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
 #ifdef VM
-      if (!suppl_pt_set_file (upage, file, ofs, page_read_bytes,
-                              page_zero_bytes, writable, false))
+      /* Writable pages with nothing to read, such as most of the
+         BSS, start on the shared zero page. */
+      if (writable && page_read_bytes == 0)
+        {
+          if (!suppl_pt_set_zero (upage))
+            return false;
+        }
+      else if (!suppl_pt_set_file (upage, file, ofs, page_read_bytes,
+                                   page_zero_bytes, writable, false))
         return false;
 #else
       /* Get a page of memory. */
@@ -678,40 +1844,72 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+#ifdef VM
+/* Reads in the pages of SEG, a segment of FILE that
+   load_segment() has just added to the current process, and
+   maps them, while free frames last.  The reads of all of its
+   sectors are started at once, so that the pages are copied out
+   of the buffer cache rather than each waiting for the disk in
+   turn.  Pages with nothing to read get the shared zero page.
+   A page left out is loaded by its first fault as usual. */
+static void
+load_segment_eager (struct file *file, const struct exec_segment *seg)
+{
+  uint8_t *end = seg->upage + seg->read_bytes + seg->zero_bytes;
+  bool locked = suppl_pt_lock ();
+  uint8_t *upage;
+
+  if (seg->read_bytes > 0)
+    inode_prefetch (file_get_inode (file), seg->file_page, seg->read_bytes);
+  for (upage = seg->upage; upage < end; upage += PGSIZE)
+    {
+      struct suppl_pte *pte = suppl_pt_get_page (upage);
+
+      if (pte == NULL || pte->kpage != NULL || pte->zero_mapped)
+        continue;
+      if (pte->type == PAGE_ZERO)
+        suppl_pt_map_zero (upage);
+      else if (frame_low ())
+        break;
+      else
+        suppl_pt_load_page (upage);
+    }
+  suppl_pt_unlock (locked);
+}
+#endif
+
+/* Create the stack by mapping zeroed pages at the top of user
+   virtual memory, as many as ARGS need, and pushes ARGS on it. */
 static bool
 setup_stack (struct arguments *args, void **esp)
 {
-#ifdef VM
-  if (!suppl_pt_set_zero (PHYS_BASE - PGSIZE))
+  size_t size = (ROUND_UP (args->size, sizeof (uintptr_t))
+                 + (args->argc + 4) * sizeof (uintptr_t));
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  size_t i;
+
+  if (page_cnt > ARGS_PAGES)
     return false;
-  *esp = push_args_on_stack (args);
-  if (*esp == NULL)
+  for (i = 1; i <= page_cnt; i++)
     {
-      suppl_pt_clear_page (PHYS_BASE - PGSIZE);
-      return false;
-    }
-  return true;
+      uint8_t *upage = (uint8_t *) PHYS_BASE - i * PGSIZE;
+#ifdef VM
+      if (!suppl_pt_set_zero (upage))
+        return false;
 #else
-  uint8_t *kpage;
-  bool success = false;
-
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL)
-    {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
+      uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+      if (kpage == NULL)
+        return false;
+      if (!install_page (upage, kpage, true))
         {
-          *esp = push_args_on_stack (args);
-          if (*esp == NULL)
-            success = false;
+          palloc_free_page (kpage);
+          return false;
         }
-      if (!success)
-        palloc_free_page (kpage);
-    }
-  return success;
 #endif
+    }
+
+  *esp = push_args_on_stack (args);
+  return true;
 }
 
 #ifndef VM
@@ -736,52 +1934,29 @@ install_page (void *upage, void *kpage, bool writable)
 }
 #endif
 
-/* Push arguments on newly initialized stack. Returns pointer
-   that ESP should point to if successful, NULL otherwise. */
+/* Pushes ARGS on the newly initialized stack: the argument
+   strings at its top, then the argv array pointing to them,
+   argv, argc and a null return address.  Returns the pointer
+   that ESP should point to. */
 static void *
-push_args_on_stack(struct arguments *args)
+push_args_on_stack (struct arguments *args)
 {
-  uint32_t **arg_ptrs = (uint32_t **) calloc (args->argc, sizeof (uint32_t *));
-  if (arg_ptrs == NULL)
-    return NULL;
-  uint8_t *curr8 = (uint8_t *) PHYS_BASE;
+  size_t size = ROUND_UP (args->size, sizeof (uintptr_t));
+  char *strings = (char *) PHYS_BASE - size;
+  char **argv = (char **) strings - (args->argc + 1);
+  uint32_t *esp = (uint32_t *) argv - 3;
+  char *s;
   int i;
 
-  /* Push arguments on stack, save their address in arg_ptrs. */
-  int arg_len;
-  for (i = args->argc - 1; i >= 0; i--)
-    {
-      arg_len = strlen (args->argv[i]) + 1;
-      curr8 -= arg_len;
-      memcpy (curr8, args->argv[i], arg_len);
-      arg_ptrs[i] = (uint32_t *) curr8;
-    }
-
-  /* Align, and push bytes required for aligning. */
-  int alignment = ((uint32_t) curr8) % sizeof (uintptr_t);
-  for (i = 0; i < alignment ; i++)
-     *--curr8 = 0;
-
-  /* Insert pointer to argv[argc], which must be empty. */
-  uint32_t *curr32 = (uint32_t *) curr8;
-  *--curr32 = 0;
-
-  /* Push a pointer to argv[argc-1], argv[argc-2] ...
-     until a pointer to argv[0] is pushed. */
-  for (i = args->argc - 1; i >= 0; i--)
-    *--curr32 = (uint32_t) arg_ptrs[i];
-
-  /* Push address of argv on stack. */
-  --curr32;
-  *curr32 = (uint32_t) (curr32 + 1);
-
-  /* Push argument count on stack. */
-  *--curr32 = (uint32_t) args->argc;
-
-  /* Push return address as 0 values. */
-  *--curr32 = 0;
-
-  /* Return result. */
-  free (arg_ptrs);
-  return curr32;
+  /* Strings, with their pointers below them. */
+  memcpy (strings, args->strings, args->size);
+  for (i = 0, s = strings; i < args->argc; i++, s += strlen (s) + 1)
+    argv[i] = s;
+  argv[args->argc] = NULL;
+
+  /* argv, argc and the return address. */
+  esp[2] = (uint32_t) argv;
+  esp[1] = args->argc;
+  esp[0] = 0;
+  return esp;
 }
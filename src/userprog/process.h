@@ -1,7 +1,21 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include <hash.h>
+#include <itree.h>
 #include <list.h>
+#include <rbtree.h>
+#include <rusage.h>
+#include "threads/synch.h"
+
+struct aio_context;
+struct dir;
+struct file;
+struct intr_frame;
+struct pipe;
+struct shm_segment;
+struct suppl_pte;
+struct thread;
 
 /* Process identifier type. */
 typedef int pid_t;
@@ -11,13 +25,48 @@ typedef int pid_t;
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)   /* Error value for mapid_t. */
+
+/* Lowest address the stack may grow down to, and the limit of the
+   heap. */
+#define STACK_LIMIT ((void *) 0x40000000)
 #endif
 
+/* Most pages the arguments of a new process may take on its
+   stack. */
+#define ARGS_PAGES 8
+
+/* Most files one process may hand down to another it spawns. */
+#define SPAWN_FD_MAX 16
+
+/* An open file descriptor: a file or one end of a pipe. */
+struct fd_entry
+  {
+    struct file *file;              /* Open file, or NULL. */
+    struct pipe *pipe;              /* Pipe, or NULL. */
+    bool pipe_writer;               /* Write end of PIPE? */
+    int flags;                      /* O_NONBLOCK, or 0. */
+  };
+
+/* Arguments of a new process.  STRINGS holds the strings one
+   after another, as they are copied to the top of its stack. */
+struct arguments
+  {
+    char *file;                     /* Executable file name. */
+    int argc;                       /* Number of arguments. */
+    char *strings;                  /* Argument strings. */
+    size_t size;                    /* Bytes used in STRINGS. */
+    size_t page_cnt;                /* Pages in STRINGS. */
+    int fd_cnt;                     /* Number of entries in FDS. */
+    struct fd_entry fds[SPAWN_FD_MAX];  /* Descriptors handed down. */
+    struct dir *cwd;                /* Working directory handed down. */
+  };
+
 /* Process status flags. */
 #define PROCESS_LOADING 0           /* Process is loading. */
 #define PROCESS_RUNNING 1           /* Process is running. */
 #define PROCESS_FAIL 2              /* Process loading failed. */
 #define PROCESS_EXIT 4              /* Process has exited. */
+#define PROCESS_THREAD 8            /* A thread, not a process. */
 
 /* An user process. */
 struct process
@@ -26,14 +75,37 @@ struct process
     struct process *parent;         /* Parent process. */
     struct file *exec_file;         /* Process executable file. */
     struct list child_list;         /* List of child processes. */
-    struct list file_list;          /* List of files in use. */
+    struct list exited_list;        /* Dead child processes not
+                                       waited for, oldest first. */
+    int wait_cnt;                   /* Child processes not waited
+                                       for. */
+    struct condition child_exited;  /* Signaled as a child process
+                                       joins EXITED_LIST. */
+    struct fd_entry *fds;           /* Open descriptors, from FD_MIN. */
+    int fd_cnt;                     /* Number of slots in FDS. */
 #ifdef VM
-    struct list mmap_list;          /* List of memory mapped file. */
+    struct rb_tree mmap_ids;        /* Memory mapped files by id. */
+    struct itree mmap_ranges;       /* Memory mapped files by address. */
 #endif
     struct process_info *info;      /* Process information for its parent. */
-    int fd_next;                    /* File descriptor tracker. */
+    int fd_free;                    /* No free slot in FDS below. */
+    int thread_cnt;                 /* Threads running in the process
+                                       besides its leader. */
+    bool exiting;                   /* Are all its threads to exit? */
+    struct dir *cwd;                /* Working directory, or NULL for
+                                       the root directory. */
+    struct lock thread_lock;        /* Protects the three above. */
+    struct condition thread_done;   /* Signaled as a thread exits. */
+    struct aio_context *aio;        /* Asynchronous I/O, or NULL. */
+    int stdin_flags;                /* O_NONBLOCK for the console, or 0. */
+    struct rusage rusage_exited;    /* Resource use of exited threads
+                                       besides the leader. */
 #ifdef VM
     mapid_t mapid_next;             /* Mapping identifier tracker. */ 
+    void *heap_start;               /* Page following the executable. */
+    void *brk;                      /* Program break, the heap's end. */
+    int64_t startup_end;            /* Timer tick at which its startup
+                                       profile ends, or 0. */
 #endif
   };
 
@@ -45,40 +117,76 @@ struct process_info
     int status;                     /* Process status. */
     int exit_code;                  /* Exit code. */
     bool is_waiting;                /* Whether parent is waiting or not. */
-    struct list_elem elem;          /* List element. */
-  };
-
-/* A file held by some process. */
-struct process_file
-  {
-    int fd;                         /* File descriptor. */
-    struct file *file;              /* Open file. */
-    struct list_elem elem;          /* List element. */
+    struct semaphore loaded;        /* Upped once loading is over. */
+    struct semaphore exited;        /* Upped once the process exits. */
+    struct process *parent;         /* Parent process. */
+    struct list_elem elem;          /* Element in parent's CHILD_LIST. */
+    struct list_elem exited_elem;   /* Element in parent's EXITED_LIST. */
+    struct hash_elem pid_elem;      /* Element in the pid table. */
   };
 
 #ifdef VM
-/* A memory mapped file information by some process. */
+/* A memory mapped file information by some process.  Its pages
+   get supplemental page table entries on first access.  A
+   mapping of a shared memory segment has a null FILE, and its
+   pages get their entries when it is made. */
 struct process_mmap
   {
     mapid_t id;                     /* Mapping identifier. */
-    struct file *file;              /* Memory mapped file. */
+    struct file *file;              /* Memory mapped file, or NULL. */
+    struct shm_segment *shm;        /* Shared memory segment, or NULL. */
     void *addr;                     /* Mapped address. */
-    size_t size;                    /* File size. */
-    struct list_elem elem;          /* List element. */
+    size_t size;                    /* File or mapping size. */
+    struct rb_elem id_elem;         /* Element in `mmap_ids'. */
+    struct itree_elem range_elem;   /* Element in `mmap_ranges'. */
   };
+
+/* Milliseconds of each run profiled to prefetch the next one's
+   startup, or 0. */
+extern unsigned startup_profile_ms;
 #endif
 
-pid_t process_execute (const char *file_name);
+void process_table_init (void);
+void process_init (void);
+pid_t process_execute (const char *cmd_line);
+pid_t process_spawn (struct arguments *);
+struct arguments *process_args_create (const char *file, size_t len);
+bool process_args_grow (struct arguments *);
+bool process_args_push (struct arguments *, const char *arg, size_t len);
+void process_args_destroy (struct arguments *);
+#ifdef VM
+pid_t process_fork (struct intr_frame *);
+#endif
 int process_wait (pid_t);
+pid_t process_wait_any (int *exit_code);
+void process_add_child (struct process *, struct process_info *);
 void process_exit (void);
+void process_reap (void);
 void process_activate (void);
+void process_deactivate (struct thread *prev);
 struct process *process_current (void);
+pid_t process_clone (void *eip, void *esp);
+bool process_stop (void);
+bool process_exiting (void);
+void process_rusage (struct rusage *);
 struct process_info *process_find_child (pid_t);
+struct fd_entry *process_get_fd (int fd);
 struct file *process_get_file (int fd);
+int process_set_fd (const struct fd_entry *);
 int process_set_file (struct file *);
+bool process_close_fd (int fd);
+bool process_fd_dup (struct fd_entry *dst, const struct fd_entry *src);
+void process_fd_close (struct fd_entry *);
+struct dir *process_open_cwd (void);
+void process_set_cwd (struct dir *);
 #ifdef VM
+void process_mmap_init (struct process *);
 struct process_mmap *process_get_mmap (mapid_t);
-mapid_t process_set_mmap (struct file *, void *addr, size_t);
+struct process_mmap *process_find_mmap (const void *addr, size_t);
+mapid_t process_set_mmap (struct file *, struct shm_segment *, void *addr,
+                          size_t);
+void process_remove_mmap (struct process_mmap *);
+void process_startup_fault (const struct suppl_pte *);
 #endif
 
 #endif /* userprog/process.h */
@@ -1,30 +1,80 @@
 #include "userprog/syscall.h"
+#include <batch.h>
 #include <debug.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <madvise.h>
+#include <poll.h>
+#include <rusage.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <uio.h>
 #include "devices/input.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/perf.h"
+#include "threads/poll.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#include "userprog/aio.h"
+#include "userprog/futex.h"
+#include "userprog/pipe.h"
 #include "userprog/process.h"
 #ifdef VM
 #include "userprog/pagedir.h"
+#include "vm/checkpoint.h"
 #include "vm/frame.h"
 #include "vm/page.h"
-#include "vm/swap.h"
+#include "vm/shm.h"
 #endif
 
-/* A Lock for mutual exclusion between system calls. */
-static struct lock filesys_lock;
+/* Most bytes of a user buffer pinned at a time for a pipe. */
+#define PIPE_IO_MAX (8 * PGSIZE)
+
+#ifdef VM
+/* Most pages in a batch of mmap_wb. */
+#define MMAP_WB_PAGES 32
+
+/* A batch of dirty pages of an unmapped file, detached from the
+   address space, written back and freed by a worker of
+   mmap_wq. */
+struct mmap_wb
+  {
+    struct work work;                   /* Runs mmap_wb_run(). */
+    struct file *file;                  /* Reopened mapped file. */
+    size_t cnt;                         /* Number of pages. */
+    struct
+      {
+        void *kpage;                    /* Page, to free once written. */
+        off_t ofs;                      /* Offset in FILE. */
+        size_t size;                    /* Bytes that are FILE's. */
+      }
+    pages[MMAP_WB_PAGES];
+  };
+
+/* Writes back the pages of unmapped files.  A single worker
+   writes the batches in the order they were queued, so that a
+   later unmapping of the same pages wins. */
+static struct workqueue mmap_wq;
+#endif
 
 static int get_byte (const uint8_t *uaddr);
 static uint32_t get_word (const uint32_t *uaddr);
 static bool put_byte (uint8_t *udst, uint8_t byte);
+static bool is_user_range (const void *uaddr, size_t size);
+static int strncpy_from_user (char *dst, const char *usrc, size_t size);
+static char *strdup_from_user (const char *ustr);
 static void validate_ptr_read (const uint8_t *uaddr, unsigned);
 static void validate_ptr_write (uint8_t *udst, unsigned size);
 
@@ -32,96 +82,235 @@ static void syscall_handler (struct intr_frame *);
 
 static void syscall_halt (void);
 static pid_t syscall_exec (const char *cmd_line);
+static pid_t syscall_spawn (const char *file, char *const *argv,
+                            const int *fds, int fd_cnt);
+static pid_t wait_for_load (pid_t pid);
 static int syscall_wait (pid_t pid);
+static pid_t syscall_wait_any (int *status);
 static bool syscall_create (const char *file, unsigned init_size);
 static bool syscall_remove (const char *file);
 static int syscall_open (const char *file);
 static int syscall_filesize (int fd);
 static int syscall_read (int fd, void *buffer, unsigned size);
 static int syscall_write (int fd, void *buffer, unsigned size);
+static struct file *get_regular_file (int fd);
+static int read_file (int fd, void *buffer, unsigned size, off_t ofs);
+static int write_file (int fd, const void *buffer, unsigned size,
+                       off_t ofs);
+static int read_pipe (struct fd_entry *, void *buffer, unsigned size);
+static int write_pipe (struct fd_entry *, const void *buffer,
+                       unsigned size);
+static int syscall_readv (int fd, const struct iovec *iov, int iovcnt);
+static int syscall_writev (int fd, const struct iovec *iov, int iovcnt);
+static int syscall_pread (int fd, void *buffer, unsigned size,
+                          unsigned offset);
+static int syscall_pwrite (int fd, const void *buffer, unsigned size,
+                           unsigned offset);
+static int syscall_copy_file_range (int fd_in, int fd_out, unsigned size);
+static bool syscall_punch_hole (int fd, unsigned offset, unsigned size);
+static bool syscall_fsync (int fd);
+static bool syscall_fdatasync (int fd);
 static void syscall_seek (int fd, unsigned position);
 static unsigned syscall_tell (int fd);
 static void syscall_close (int fd);
+static bool syscall_chdir (const char *dir);
+static bool syscall_mkdir (const char *dir);
+static bool syscall_snapshot (const char *dir, const char *snap);
+static bool syscall_readdir (int fd, char *name);
+static bool syscall_isdir (int fd);
+static int syscall_inumber (int fd);
+static int syscall_getdents (int fd, struct dirent *ents, unsigned cnt);
+static int syscall_pipe (int *fds);
+static int syscall_poll (struct pollfd *fds, unsigned nfds, int timeout);
+static int syscall_fcntl (int fd, int cmd, int arg);
+static int syscall_getrusage (int who, struct rusage *usage);
+static int poll_fd (int fd);
+static pid_t syscall_clone (void *eip, void *arg0, void *arg1, void *stack);
+static void syscall_thread_exit (int status);
+static int syscall_futex_wait (int *addr, int val);
+static int syscall_futex_wake (int *addr, int cnt);
+static void syscall_perfstat (struct perfstat *st);
+static bool syscall_perfhist (int kind, unsigned idx, struct perfhist *h);
+static uint32_t syscall_cycles (struct intr_frame *f);
+static uint32_t syscall_gettime (struct intr_frame *f);
+static int syscall_aio_setup (struct aio_ring *ring);
+static int syscall_aio_enter (unsigned min_complete);
+static int syscall_batch (struct batch_call *calls, int cnt);
 #ifdef VM
 static mapid_t syscall_mmap (int fd, void *addr);
 static void syscall_munmap (mapid_t mapping);
+static mapid_t syscall_shm_map (const char *name, size_t size, void *addr);
+static pid_t syscall_fork (struct intr_frame *f);
+static int syscall_checkpoint (struct intr_frame *f);
+static void *syscall_sbrk (intptr_t increment);
+static void syscall_memstat (struct memstat *st);
+static bool syscall_madvise (void *addr, size_t size, int advice);
+static void mmap_defer_write_back (struct mmap_wb **, struct file *,
+                                   void *kpage, off_t ofs, size_t size);
+static work_func mmap_wb_run;
+#endif
+
+/* A system call handler, called with the call's word arguments.
+   Handlers taking fewer arguments ignore the rest, and the result
+   of one returning nothing is ignored by the user program.  A
+   bool result is only defined in the low byte. */
+typedef uint32_t syscall_func (uint32_t, uint32_t, uint32_t, uint32_t,
+                               uint32_t);
+
+/* Most word arguments a system call takes. */
+#define SYSCALL_ARGS_MAX 5
+
+/* Argument count of a handler that takes the interrupt frame
+   instead of word arguments. */
+#define SYSCALL_FRAME -1
+
+/* System call table entry. */
+struct syscall
+  {
+    syscall_func *func;         /* Handler, or NULL if undefined. */
+    int argc;                   /* Number of word arguments. */
+    bool boolean;               /* Returns bool? */
+  };
+
+#define SYSCALL_ENTRY(FUNC, ARGC, BOOLEAN) \
+  { (syscall_func *) (void (*) (void)) FUNC, ARGC, BOOLEAN }
+#define SYSCALL(FUNC, ARGC) SYSCALL_ENTRY (FUNC, ARGC, false)
+#define SYSCALL_BOOL(FUNC, ARGC) SYSCALL_ENTRY (FUNC, ARGC, true)
+
+/* System calls by number. */
+static const struct syscall syscall_table[] =
+  {
+    [SYS_HALT] = SYSCALL (syscall_halt, 0),
+    [SYS_EXIT] = SYSCALL (syscall_exit, 1),
+    [SYS_EXEC] = SYSCALL (syscall_exec, 1),
+    [SYS_WAIT] = SYSCALL (syscall_wait, 1),
+    [SYS_CREATE] = SYSCALL_BOOL (syscall_create, 2),
+    [SYS_REMOVE] = SYSCALL_BOOL (syscall_remove, 1),
+    [SYS_OPEN] = SYSCALL (syscall_open, 1),
+    [SYS_FILESIZE] = SYSCALL (syscall_filesize, 1),
+    [SYS_READ] = SYSCALL (syscall_read, 3),
+    [SYS_WRITE] = SYSCALL (syscall_write, 3),
+    [SYS_SEEK] = SYSCALL (syscall_seek, 2),
+    [SYS_TELL] = SYSCALL (syscall_tell, 1),
+    [SYS_CLOSE] = SYSCALL (syscall_close, 1),
+    [SYS_CHDIR] = SYSCALL_BOOL (syscall_chdir, 1),
+    [SYS_MKDIR] = SYSCALL_BOOL (syscall_mkdir, 1),
+    [SYS_READDIR] = SYSCALL_BOOL (syscall_readdir, 2),
+    [SYS_ISDIR] = SYSCALL_BOOL (syscall_isdir, 1),
+    [SYS_INUMBER] = SYSCALL (syscall_inumber, 1),
+    [SYS_GETDENTS] = SYSCALL (syscall_getdents, 3),
+    [SYS_READV] = SYSCALL (syscall_readv, 3),
+    [SYS_WRITEV] = SYSCALL (syscall_writev, 3),
+    [SYS_PREAD] = SYSCALL (syscall_pread, 4),
+    [SYS_PWRITE] = SYSCALL (syscall_pwrite, 4),
+    [SYS_COPY_FILE_RANGE] = SYSCALL (syscall_copy_file_range, 3),
+    [SYS_PUNCH_HOLE] = SYSCALL_BOOL (syscall_punch_hole, 3),
+    [SYS_FSYNC] = SYSCALL_BOOL (syscall_fsync, 1),
+    [SYS_FDATASYNC] = SYSCALL_BOOL (syscall_fdatasync, 1),
+    [SYS_SPAWN] = SYSCALL (syscall_spawn, 4),
+    [SYS_PIPE] = SYSCALL (syscall_pipe, 1),
+    [SYS_CLONE] = SYSCALL (syscall_clone, 4),
+    [SYS_THREAD_EXIT] = SYSCALL (syscall_thread_exit, 1),
+    [SYS_FUTEX_WAIT] = SYSCALL (syscall_futex_wait, 2),
+    [SYS_FUTEX_WAKE] = SYSCALL (syscall_futex_wake, 2),
+    [SYS_PERFSTAT] = SYSCALL (syscall_perfstat, 1),
+    [SYS_CYCLES] = SYSCALL (syscall_cycles, SYSCALL_FRAME),
+    [SYS_GETTIME] = SYSCALL (syscall_gettime, SYSCALL_FRAME),
+    [SYS_AIO_SETUP] = SYSCALL (syscall_aio_setup, 1),
+    [SYS_AIO_ENTER] = SYSCALL (syscall_aio_enter, 1),
+    [SYS_BATCH] = SYSCALL (syscall_batch, 2),
+    [SYS_SNAPSHOT] = SYSCALL_BOOL (syscall_snapshot, 2),
+    [SYS_WAIT_ANY] = SYSCALL (syscall_wait_any, 1),
+    [SYS_POLL] = SYSCALL (syscall_poll, 3),
+    [SYS_FCNTL] = SYSCALL (syscall_fcntl, 3),
+    [SYS_GETRUSAGE] = SYSCALL (syscall_getrusage, 2),
+    [SYS_PERFHIST] = SYSCALL_BOOL (syscall_perfhist, 3),
+#ifdef VM
+    [SYS_MMAP] = SYSCALL (syscall_mmap, 2),
+    [SYS_MUNMAP] = SYSCALL (syscall_munmap, 1),
+    [SYS_SHM_MAP] = SYSCALL (syscall_shm_map, 3),
+    [SYS_FORK] = SYSCALL (syscall_fork, SYSCALL_FRAME),
+    [SYS_CHECKPOINT] = SYSCALL (syscall_checkpoint, SYSCALL_FRAME),
+    [SYS_SBRK] = SYSCALL (syscall_sbrk, 1),
+    [SYS_MEMSTAT] = SYSCALL (syscall_memstat, 1),
+    [SYS_MADVISE] = SYSCALL_BOOL (syscall_madvise, 3),
 #endif
+  };
+
+#define SYSCALL_CNT (sizeof syscall_table / sizeof *syscall_table)
+
+/* Calls SC's handler with ARGS and returns its result, cut to a
+   bool if it returns one. */
+static uint32_t
+syscall_invoke (const struct syscall *sc,
+                const uint32_t args[SYSCALL_ARGS_MAX])
+{
+  uint32_t result = sc->func (args[0], args[1], args[2], args[3], args[4]);
+  return sc->boolean ? (uint8_t) result != 0 : result;
+}
 
+/* System calls come in by two conventions.  With int $0x30, the
+   system call number and then its arguments are words on the
+   user stack.  With int $0x31, and with SYSENTER (see
+   sysenter.S), the number is in EAX and the arguments in EBX,
+   ECX, EDX, ESI, and EDI, which saves reading user memory. */
 void
 syscall_init (void)
 {
-  lock_init(&filesys_lock);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  intr_register_int (0x31, 3, INTR_ON, syscall_handler,
+                     "syscall (registers)");
+#ifdef VM
+  workqueue_init (&mmap_wq, "mmap-wb", 1, SCHED_NORMAL, PRI_DEFAULT);
+#endif
 }
 
-/* Handler which matches the appropriate system call. */
+/* Handler which dispatches to the appropriate system call through
+   syscall_table[], after fetching all its arguments, from F's
+   registers or in one copy from the user stack.  Undefined
+   system calls terminate the process. */
 static void
-syscall_handler (struct intr_frame *f UNUSED)
+syscall_handler (struct intr_frame *f)
 {
   uint32_t *esp = f->esp;
+  uint32_t args[SYSCALL_ARGS_MAX] = { 0, 0, 0, 0, 0 };
+  bool regs = f->vec_no == 0x31;
+  const struct syscall *sc;
+  uint64_t start = timer_cycles ();
+  uint32_t nr;
+
   thread_current ()->esp = esp;
 
-  switch (get_word (esp))
-    {
-    case SYS_HALT:
-      syscall_halt ();
-      break;
-    case SYS_EXIT:
-      syscall_exit ((int) get_word (esp + 1));
-      break;
-    case SYS_EXEC:
-      f->eax = syscall_exec ((const char *) get_word (esp + 1));
-      break;
-    case SYS_WAIT:
-      f->eax = syscall_wait ((pid_t) get_word (esp + 1));
-      break;
-    case SYS_CREATE:
-      f->eax = syscall_create ((const char *) get_word (esp + 1),
-                               (unsigned) get_word (esp + 2));
-      break;
-    case SYS_REMOVE:
-      f->eax = syscall_remove ((const char *) get_word (esp + 1));
-      break;
-    case SYS_OPEN:
-      f->eax = syscall_open ((const char *) get_word (esp + 1));
-      break;
-    case SYS_FILESIZE:
-      f->eax = syscall_filesize ((int) get_word (esp + 1));
-      break;
-    case SYS_READ:
-      f->eax = syscall_read ((int) get_word (esp + 1),
-                             (void *) get_word (esp + 2),
-                             (unsigned) get_word (esp + 3));
-      break;
-    case SYS_WRITE:
-      f->eax = syscall_write ((int) get_word (esp + 1),
-                              (void *) get_word (esp + 2),
-                              (unsigned) get_word (esp + 3));
-      break;
-    case SYS_SEEK:
-      syscall_seek ((int) get_word (esp + 1),
-                    (unsigned) get_word (esp + 2));
-      break;
-    case SYS_TELL:
-      f->eax = syscall_tell ((int) get_word (esp + 1));
-      break;
-    case SYS_CLOSE:
-      syscall_close ((int) get_word (esp + 1));
-      break;
-#ifdef VM
-    case SYS_MMAP:
-      f->eax = syscall_mmap ((int) get_word (esp + 1),
-                             (void *) get_word (esp + 2));
-      break;
-    case SYS_MUNMAP:
-      syscall_munmap ((mapid_t) get_word (esp + 1));
-      break;
-#endif
-    default:
-      /* Undefined system calls. */
+  nr = regs ? f->eax : get_word (esp);
+  if (nr >= SYSCALL_CNT || syscall_table[nr].func == NULL)
+    {
       thread_exit ();
       NOT_REACHED ();
     }
+  sc = &syscall_table[nr];
+  perf_syscall (nr);
+
+  if (sc->argc == SYSCALL_FRAME)
+    args[0] = (uint32_t) f;
+  else if (regs)
+    {
+      args[0] = f->ebx;
+      args[1] = f->ecx;
+      args[2] = f->edx;
+      args[3] = f->esi;
+      args[4] = f->edi;
+    }
+  else if (!copy_from_user (args, esp + 1, sc->argc * sizeof *args))
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  f->eax = syscall_invoke (sc, args);
+  perf_hist_add (PERF_HIST_SYSCALL, nr, timer_cycles () - start);
+
+  /* Another thread may have ended the process meanwhile. */
+  if (process_exiting ())
+    thread_exit ();
 }
 
 /* Terminates pintos. */
@@ -133,16 +322,20 @@ syscall_halt (void)
 }
 
 /* Terminates the current user program, returning status
-   to the kernel. */
+   to the kernel.  Its other threads exit too, and only the first
+   thread to exit so sets the exit code. */
 void
 syscall_exit (int status)
 {
-  /* Set exit code. */
-  if (process_current ()->info != NULL)
-    process_current ()->info->exit_code = status;
+  if (process_stop ())
+    {
+      /* Set exit code. */
+      if (process_current ()->info != NULL)
+        process_current ()->info->exit_code = status;
 
-  /* Print the termination message. */
-  printf ("%s: exit(%d)\n", thread_current ()->name, status);
+      /* Print the termination message. */
+      printf ("%s: exit(%d)\n", thread_current ()->name, status);
+    }
 
   /* Exit the current thread. */
   thread_exit ();
@@ -155,11 +348,105 @@ syscall_exit (int status)
 static pid_t
 syscall_exec (const char *cmd_line)
 {
-  /* Check the validity. */
-  validate_ptr_read (cmd_line, 1);
+  /* Copy the command line. */
+  char *kcmd = strdup_from_user (cmd_line);
+  if (kcmd == NULL)
+    return PID_ERROR;
 
   /* Create a new process. */
-  pid_t pid = process_execute (cmd_line);
+  pid_t pid = process_execute (kcmd);
+  palloc_free_page (kcmd);
+  return wait_for_load (pid);
+}
+
+/* Runs the executable FILE with the null-terminated argument
+   vector ARGV, as exec() would with them joined by spaces.  The
+   new process gets the files open as the FD_CNT descriptors in
+   FDS, in order, as its first descriptors; a negative entry
+   leaves its descriptor closed.  The argument strings are copied
+   from the user once, into the block the new process's stack is
+   filled from, and may take up to ARGS_PAGES pages.  Returns the
+   new process's pid, or -1 if it cannot be started. */
+static pid_t
+syscall_spawn (const char *file, char *const *argv, const int *fds,
+               int fd_cnt)
+{
+  int kfds[SPAWN_FD_MAX];
+  struct arguments *args;
+  char *kfile;
+  int i;
+
+  /* Copy the descriptors and the program name. */
+  if (fd_cnt < 0 || fd_cnt > SPAWN_FD_MAX)
+    return PID_ERROR;
+  if (fd_cnt > 0 && !copy_from_user (kfds, fds, fd_cnt * sizeof *kfds))
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  kfile = strdup_from_user (file);
+  if (kfile == NULL)
+    return PID_ERROR;
+  args = process_args_create (kfile, strlen (kfile));
+  palloc_free_page (kfile);
+  if (args == NULL)
+    return PID_ERROR;
+
+  /* Copy each argument string into place, growing the block
+     when one does not fit. */
+  for (i = 0; ; i++)
+    {
+      char *uarg;
+      size_t room;
+      int len;
+
+      if (!copy_from_user (&uarg, argv + i, sizeof uarg))
+        goto kill;
+      if (uarg == NULL)
+        break;
+      for (;;)
+        {
+          room = args->page_cnt * PGSIZE - args->size;
+          len = strncpy_from_user (args->strings + args->size, uarg, room);
+          if (len == -1)
+            goto kill;
+          if ((size_t) len < room)
+            break;
+          if (!process_args_grow (args))
+            goto fail;
+        }
+      args->size += len + 1;
+      args->argc++;
+    }
+
+  /* Open the descriptors again for the new process. */
+  args->fd_cnt = fd_cnt;
+  memset (args->fds, 0, sizeof args->fds);
+  for (i = 0; i < fd_cnt; i++)
+    if (kfds[i] >= 0)
+      {
+        struct fd_entry *e = process_get_fd (kfds[i]);
+        if (e == NULL || !process_fd_dup (&args->fds[i], e))
+          goto fail;
+      }
+
+  return wait_for_load (process_spawn (args));
+
+ fail:
+  process_args_destroy (args);
+  return PID_ERROR;
+
+ kill:
+  process_args_destroy (args);
+  syscall_exit (-1);
+  NOT_REACHED ();
+}
+
+/* Waits until child PID, just created, has loaded.  Returns PID
+   if it did, or PID_ERROR if it failed or PID is PID_ERROR. */
+static pid_t
+wait_for_load (pid_t pid)
+{
   if (pid == PID_ERROR)
     return pid;
 
@@ -169,12 +456,15 @@ syscall_exec (const char *cmd_line)
     return PID_ERROR;
 
   /* Wait until the new process is successfully loaded. */
-  while (child->status == PROCESS_LOADING)
-    thread_yield ();
+  sema_down (&child->loaded);
 
-  /* Return PID. */
+  /* Return PID.  A child that failed to load is reaped here, so
+     that wait_any() does not report a pid the caller never saw. */
   if (child->status & PROCESS_FAIL)
-    return PID_ERROR;
+    {
+      process_wait (pid);
+      return PID_ERROR;
+    }
   return pid;
 }
 
@@ -185,18 +475,36 @@ syscall_wait (pid_t pid)
   return process_wait (pid);
 }
 
+/* Waits for any child process to die, stores its exit status in
+   *STATUS, and returns its pid, or returns -1 if no child is left
+   to wait for. */
+static pid_t
+syscall_wait_any (int *status)
+{
+  int exit_code;
+  pid_t pid = process_wait_any (&exit_code);
+
+  if (pid != PID_ERROR && !copy_to_user (status, &exit_code, sizeof exit_code))
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  return pid;
+}
+
 /* Creates a new file initially the given bytes in size.
    Returns true if successful, false otherwise. */
 static bool
 syscall_create (const char *file, unsigned init_size)
 {
-  /* Check the validity. */
-  validate_ptr_read (file, 1);
+  /* Copy the file name. */
+  char *name = strdup_from_user (file);
+  if (name == NULL)
+    return false;
 
   /* Create a new file. */
-  lock_acquire (&filesys_lock);
-  bool success = filesys_create (file, init_size);
-  lock_release (&filesys_lock);
+  bool success = filesys_create (name, init_size);
+  palloc_free_page (name);
   return success;
 }
 
@@ -204,13 +512,14 @@ syscall_create (const char *file, unsigned init_size)
 static bool
 syscall_remove (const char *file)
 {
-  /* Check the validity. */
-  validate_ptr_read (file, 1);
+  /* Copy the file name. */
+  char *name = strdup_from_user (file);
+  if (name == NULL)
+    return false;
 
-  /* Create a new file. */
-  lock_acquire (&filesys_lock);
-  bool success = filesys_remove (file);
-  lock_release (&filesys_lock);
+  /* Remove the file. */
+  bool success = filesys_remove (name);
+  palloc_free_page (name);
   return success;
 }
 
@@ -219,23 +528,21 @@ syscall_remove (const char *file)
 static int
 syscall_open (const char *file)
 {
-  /* Check the validity. */
-  validate_ptr_read (file, 1);
+  /* Copy the file name. */
+  char *name = strdup_from_user (file);
+  if (name == NULL)
+    return -1;
 
   /* Open the file. */
-  lock_acquire (&filesys_lock);
-  struct file *f = filesys_open (file);
+  struct file *f = filesys_open (name);
+  palloc_free_page (name);
   if (f == NULL)
-    {
-      lock_release (&filesys_lock);
-      return -1;
-    }
+    return -1;
 
   /* Set the file. */
   int fd = process_set_file (f);
 
   /* Return the file descriptor. */
-  lock_release (&filesys_lock);
   return fd;
 }
 
@@ -244,113 +551,387 @@ static int
 syscall_filesize (int fd)
 {
   /* Open the file. */
-  lock_acquire (&filesys_lock);
   struct file *file = process_get_file (fd);
   if (file == NULL)
-    {
-      lock_release (&filesys_lock);
-      return -1;
-    }
+    return -1;
 
   /* Get the size of the file. */
   int size = file_length (file);
 
   /* Return the size of the file. */
-  lock_release (&filesys_lock);
   return size;
 }
 
-/* Reads size bytes from the file open as fd into buffer.
-   Returns the number of bytes actually read, or -1
-   if the file could not be read. */
+/* Returns the file open as fd, or NULL if fd is not an open
+   file or is a directory, whose data system calls other than
+   readdir() do not reach. */
+static struct file *
+get_regular_file (int fd)
+{
+  struct file *file = process_get_file (fd);
+  if (file == NULL || inode_is_dir (file_get_inode (file)))
+    return NULL;
+  return file;
+}
+
+/* Reads size bytes from the file or pipe open as fd into
+   buffer.  Returns the number of bytes actually read, -1 if the
+   file could not be read, or -EAGAIN if fd is non-blocking and
+   nothing could be read without waiting. */
 static int
 syscall_read (int fd, void *buffer, unsigned size)
 {
-  /* Check the validity. */
   uint8_t *bf = (uint8_t *) buffer;
-  validate_ptr_read (bf, size);
-  validate_ptr_write (bf, size);
-
-  /* Read from STDIN. */
   unsigned bytes = 0;
+  struct fd_entry *e;
+
+  /* Read from STDIN, copying out a chunk at a time.  A
+     non-blocking read stops when the input buffer runs dry. */
   if (fd == STDIN_FILENO)
     {
-      uint8_t b;
-      while (bytes < size && (b = input_getc ()) != 0)
+      bool nonblock = process_current ()->stdin_flags & O_NONBLOCK;
+      uint8_t chunk[64];
+      bool eof = false;
+      bool empty = false;
+      while (bytes < size && !eof && !empty)
         {
-          *bf++ = b;
-          bytes ++;
+          size_t n = 0;
+          while (n < sizeof chunk && bytes + n < size)
+            {
+              if (nonblock && input_empty ())
+                {
+                  empty = true;
+                  break;
+                }
+              chunk[n] = input_getc ();
+              if (chunk[n] == 0)
+                {
+                  eof = true;
+                  break;
+                }
+              n++;
+            }
+          if (!copy_to_user (bf + bytes, chunk, n))
+            {
+              syscall_exit (-1);
+              NOT_REACHED ();
+            }
+          bytes += n;
         }
-      return (int) bytes;
+      return bytes == 0 && empty ? -EAGAIN : (int) bytes;
     }
 
-  /* Get the file. */
-  lock_acquire (&filesys_lock);
-  struct file *file = process_get_file (fd);
-  if (file == NULL)
-    {
-      lock_release (&filesys_lock);
-      return -1;
-    }
+  e = process_get_fd (fd);
+  if (e != NULL && e->pipe != NULL)
+    return read_pipe (e, buffer, size);
+  return read_file (fd, buffer, size, -1);
+}
+
+/* Reads size bytes from the file open as fd into buffer, at
+   offset OFS, or at the file's position if OFS is negative.
+   Returns the number of bytes actually read, or -1 if fd is not
+   an open file. */
+static int
+read_file (int fd, void *buffer, unsigned size, off_t ofs)
+{
+  /* Check the validity.  The pages are pinned before they are
+     probed for writing, so that they stay in meanwhile. */
+  validate_ptr_read (buffer, size);
+#ifdef VM
+  if (!suppl_pt_pin_write (buffer, size))
+    syscall_exit (-1);
+#endif
+  validate_ptr_write (buffer, size);
 
   /* Read from the file. */
-  bytes = file_read (file, buffer, size);
+  struct file *file = get_regular_file (fd);
+  off_t bytes = -1;
+  if (file != NULL)
+    bytes = (ofs < 0 ? file_read (file, buffer, size)
+             : file_read_at (file, buffer, size, ofs));
+#ifdef VM
+  suppl_pt_unpin (buffer, size);
+#endif
 
   /* Return bytes read. */
-  lock_release (&filesys_lock);
-  return (int) bytes;
+  return bytes;
 }
 
-/* Writes size bytes from buffer to the open file fd.
+/* Writes size bytes from buffer to the open file or pipe fd.
    Returns the number of bytes actually written. */
 static int
 syscall_write (int fd, void *buffer, unsigned size)
 {
-  /* Check the validity. */
-  validate_ptr_read (buffer, size);
+  struct fd_entry *e;
 
   /* Write to STDOUT. */
   if (fd == STDOUT_FILENO)
     {
+      /* The console copies the buffer with interrupts off, so
+         its pages must stay in memory. */
+      validate_ptr_read (buffer, size);
+#ifdef VM
+      if (!suppl_pt_pin (buffer, size))
+        syscall_exit (-1);
+#endif
       putbuf (buffer, size);
+#ifdef VM
+      suppl_pt_unpin (buffer, size);
+#endif
       return size;
     }
 
+  e = process_get_fd (fd);
+  if (e != NULL && e->pipe != NULL)
+    return write_pipe (e, buffer, size);
+  return write_file (fd, buffer, size, -1);
+}
+
+/* Writes size bytes from buffer to the file open as fd, at
+   offset OFS, or at the file's position if OFS is negative.
+   Returns the number of bytes actually written, or -1 if fd is
+   not an open file. */
+static int
+write_file (int fd, const void *buffer, unsigned size, off_t ofs)
+{
+  /* Check the validity. */
+  validate_ptr_read (buffer, size);
+
   /* Get the file. */
-  lock_acquire (&filesys_lock);
-  struct file *file = process_get_file (fd);
+  struct file *file = get_regular_file (fd);
   if (file == NULL)
-    {
-      lock_release (&filesys_lock);
-      return -1;
-    }
+    return -1;
 
   /* Write to the file. */
-  int bytes = file_write (file, buffer, size);
+#ifdef VM
+  if (!suppl_pt_pin (buffer, size))
+    syscall_exit (-1);
+#endif
+  off_t bytes = (ofs < 0 ? file_write (file, buffer, size)
+                 : file_write_at (file, buffer, size, ofs));
+#ifdef VM
+  suppl_pt_unpin (buffer, size);
+#endif
 
   /* Return bytes written. */
-  lock_release (&filesys_lock);
   return bytes;
 }
 
+/* Reads up to SIZE bytes, and at most PIPE_IO_MAX, from the
+   read end of a pipe E into BUFFER, which stays pinned while the
+   pipe copies into it.  Returns the number of bytes read, -1 if
+   E is a write end, or -EAGAIN if E is non-blocking and the pipe
+   is empty. */
+static int
+read_pipe (struct fd_entry *e, void *buffer, unsigned size)
+{
+  int bytes;
+
+  if (e->pipe_writer)
+    return -1;
+  if (size > PIPE_IO_MAX)
+    size = PIPE_IO_MAX;
+  validate_ptr_read (buffer, size);
+#ifdef VM
+  if (!suppl_pt_pin_write (buffer, size))
+    syscall_exit (-1);
+#endif
+  validate_ptr_write (buffer, size);
+  bytes = pipe_read (e->pipe, buffer, size, e->flags & O_NONBLOCK);
+#ifdef VM
+  suppl_pt_unpin (buffer, size);
+#endif
+  return bytes;
+}
+
+/* Writes SIZE bytes from BUFFER to the write end of a pipe E,
+   pinning PIPE_IO_MAX bytes of it at a time, so that the pipe
+   may copy straight out of it.  Returns the number of bytes
+   written, -1 if E is a read end or no read end is open, or
+   -EAGAIN if E is non-blocking and the pipe is full. */
+static int
+write_pipe (struct fd_entry *e, const void *buffer, unsigned size)
+{
+  const uint8_t *bf = buffer;
+  unsigned bytes = 0;
+
+  if (!e->pipe_writer)
+    return -1;
+  validate_ptr_read (buffer, size);
+  do
+    {
+      unsigned n = size - bytes < PIPE_IO_MAX ? size - bytes : PIPE_IO_MAX;
+      int written;
+#ifdef VM
+      if (!suppl_pt_pin (bf + bytes, n))
+        syscall_exit (-1);
+#endif
+      written = pipe_write (e->pipe, bf + bytes, n,
+                            e->flags & O_NONBLOCK);
+#ifdef VM
+      suppl_pt_unpin (bf + bytes, n);
+#endif
+      if (written < 0)
+        return bytes > 0 ? (int) bytes : written;
+      bytes += written;
+      if ((unsigned) written < n)
+        break;
+    }
+  while (bytes < size);
+  return bytes;
+}
+
+/* Reads from the file open as fd into the IOVCNT buffers in IOV
+   in turn, as one read() of their total size would.  Returns the
+   number of bytes read, or -1 if fd cannot be read or IOVCNT is
+   out of range. */
+static int
+syscall_readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  struct iovec kiov[IOV_MAX];
+  int total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  if (!copy_from_user (kiov, iov, iovcnt * sizeof *kiov))
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  for (i = 0; i < iovcnt; i++)
+    {
+      int bytes = syscall_read (fd, kiov[i].iov_base, kiov[i].iov_len);
+      if (bytes < 0)
+        return i == 0 ? bytes : total;
+      total += bytes;
+      if ((size_t) bytes < kiov[i].iov_len)
+        break;
+    }
+  return total;
+}
+
+/* Writes the IOVCNT buffers in IOV in turn to the file open as
+   fd, as one write() of their total size would.  Returns the
+   number of bytes written, or -1 if fd cannot be written or
+   IOVCNT is out of range. */
+static int
+syscall_writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  struct iovec kiov[IOV_MAX];
+  int total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  if (!copy_from_user (kiov, iov, iovcnt * sizeof *kiov))
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  for (i = 0; i < iovcnt; i++)
+    {
+      int bytes = syscall_write (fd, kiov[i].iov_base, kiov[i].iov_len);
+      if (bytes < 0)
+        return i == 0 ? bytes : total;
+      total += bytes;
+      if ((size_t) bytes < kiov[i].iov_len)
+        break;
+    }
+  return total;
+}
+
+/* Reads size bytes at offset of the file open as fd into buffer,
+   leaving the file's position alone.  Returns the number of bytes
+   actually read, or -1 if fd is not an open file. */
+static int
+syscall_pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  if ((off_t) offset < 0)
+    return -1;
+  return read_file (fd, buffer, size, offset);
+}
+
+/* Writes size bytes from buffer at offset of the file open as fd,
+   leaving the file's position alone.  Returns the number of bytes
+   actually written, or -1 if fd is not an open file. */
+static int
+syscall_pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  if ((off_t) offset < 0)
+    return -1;
+  return write_file (fd, buffer, size, offset);
+}
+
+/* Copies size bytes from the position of the file open as fd_in
+   to the position of the file open as fd_out without passing
+   through user memory, advancing both positions.  Returns the
+   number of bytes copied, or -1 if either descriptor is not an
+   open file or both name overlapping ranges of one file. */
+static int
+syscall_copy_file_range (int fd_in, int fd_out, unsigned size)
+{
+  struct file *in = get_regular_file (fd_in);
+  struct file *out = get_regular_file (fd_out);
+
+  if (in == NULL || out == NULL || (off_t) size < 0)
+    return -1;
+  return file_copy (out, in, size);
+}
+
+/* Frees size bytes at offset of the file open as fd, which then
+   read as zeros, leaving its length and position alone.  Returns
+   false if fd is not an open file or cannot be written. */
+static bool
+syscall_punch_hole (int fd, unsigned offset, unsigned size)
+{
+  struct file *file = get_regular_file (fd);
+
+  if (file == NULL || (off_t) offset < 0 || (off_t) size < 0)
+    return false;
+  return file_punch (file, size, offset);
+}
+
+/* Writes the file or directory open as fd back to disk, data and
+   metadata, so that it survives a crash.  Returns false if fd is
+   not an open file. */
+static bool
+syscall_fsync (int fd)
+{
+  struct file *file = process_get_file (fd);
+
+  if (file == NULL)
+    return false;
+  file_sync (file, false);
+  return true;
+}
+
+/* Like fsync, but leaves the metadata of fd in the journal's
+   care unless its length or layout changed, so that overwriting
+   a file in place costs only its own data sectors. */
+static bool
+syscall_fdatasync (int fd)
+{
+  struct file *file = process_get_file (fd);
+
+  if (file == NULL)
+    return false;
+  file_sync (file, true);
+  return true;
+}
+
 /* Changes the next byte to be read or written in open file fd
    to position, expressed in bytes from the beginning of the file. */
 static void
 syscall_seek (int fd, unsigned position)
 {
   /* Open the file. */
-  lock_acquire (&filesys_lock);
   struct file *file = process_get_file (fd);
   if (file == NULL)
-    {
-      lock_release (&filesys_lock);
-      return;
-    }
+    return;
 
   /* Seek the file. */
   file_seek (file, position);
-
-  lock_release (&filesys_lock);
 }
 
 /* Returns the position of the next byte to be read or written
@@ -360,19 +941,14 @@ static unsigned
 syscall_tell (int fd)
 {
   /* Open the file. */
-  lock_acquire (&filesys_lock);
   struct file *file = process_get_file (fd);
   if (file == NULL)
-    {
-      lock_release (&filesys_lock);
-      return -1;
-    }
+    return -1;
 
   /* Get the position. */
   unsigned position = file_tell (file);
 
   /* Return the position. */
-  lock_release (&filesys_lock);
   return position;
 }
 
@@ -380,78 +956,552 @@ syscall_tell (int fd)
 static void
 syscall_close (int fd)
 {
-  lock_acquire (&filesys_lock);
-  struct list *list = &process_current ()->file_list;
-  struct list_elem *e;
-  for (e = list_begin (list); e != list_end (list); e = list_next (e))
-    {
-      struct process_file *pfe = list_entry (e, struct process_file, elem);
-      if (pfe->fd == fd)
-        {
-          file_close (pfe->file);
-          list_remove (e);
-          free (pfe);
-          lock_release (&filesys_lock);
-          return;
-        }
-    }
-  lock_release (&filesys_lock);
+  process_close_fd (fd);
 }
 
-#ifdef VM
-/* Maps the file open as FD into the process’s virtual address
-   space. */
-static mapid_t
-syscall_mmap (int fd, void *addr)
+/* Changes the current working directory of the process to dir,
+   which may be relative or absolute.  Returns true if
+   successful, false on failure. */
+static bool
+syscall_chdir (const char *dir)
 {
-  off_t fault_ofs = -1;
-  struct file *f = NULL;
+  /* Copy the directory name. */
+  char *name = strdup_from_user (dir);
+  if (name == NULL)
+    return false;
 
-  /* Check the validity. */
-  lock_acquire (&filesys_lock);
-  if (addr == NULL || !is_user_vaddr (addr) || pg_ofs (addr) != 0)
-    goto fail;
+  /* Open the directory. */
+  struct dir *d = filesys_open_dir (name);
+  palloc_free_page (name);
+  if (d == NULL)
+    return false;
 
-  /* Get the file. */
-  f = process_get_file (fd);
-  if (f == NULL)
-    goto fail;
+  /* Work in it. */
+  process_set_cwd (d);
+  return true;
+}
 
-  /* Reopen the file. */
-  size_t size;
-  f = file_reopen (f);
-  if (f == NULL || (size = file_length (f)) == 0)
-    goto fail;
+/* Creates the directory named dir, which may be relative or
+   absolute.  Returns true if successful, false on failure. */
+static bool
+syscall_mkdir (const char *dir)
+{
+  /* Copy the directory name. */
+  char *name = strdup_from_user (dir);
+  if (name == NULL)
+    return false;
 
-  /* Install a new page. */
-  off_t ofs;
-  for (ofs = 0; (size_t) ofs < size; ofs += PGSIZE)
+  /* Create a new directory. */
+  bool success = filesys_mkdir (name);
+  palloc_free_page (name);
+  return success;
+}
+
+/* Takes a snapshot of the directory named dir as the new
+   directory named snap, which share their files' data until
+   either is written.  Returns true if successful, false on
+   failure. */
+static bool
+syscall_snapshot (const char *dir, const char *snap)
+{
+  /* Copy the directory names. */
+  char *src = strdup_from_user (dir);
+  char *dst;
+  bool success;
+
+  if (src == NULL)
+    return false;
+  dst = strdup_from_user (snap);
+  if (dst == NULL)
     {
-      size_t read_bytes = (size_t) ofs + PGSIZE < size ? PGSIZE : size - ofs;
-      size_t zero_bytes = PGSIZE - read_bytes;
-      if (!suppl_pt_set_file (addr + ofs, f, ofs, read_bytes, zero_bytes,
-                              true, true))
+      palloc_free_page (src);
+      return false;
+    }
+
+  success = filesys_snapshot (src, dst);
+  palloc_free_page (src);
+  palloc_free_page (dst);
+  return success;
+}
+
+/* Reads a directory entry from fd, which must represent a
+   directory, and stores its null-terminated file name in name,
+   which must have room for READDIR_MAX_LEN + 1 bytes.  Returns
+   true if successful, false if the directory holds no more
+   entries. */
+static bool
+syscall_readdir (int fd, char *name)
+{
+  struct file *file = process_get_file (fd);
+  char kname[NAME_MAX + 1];
+  off_t pos;
+
+  if (file == NULL || !inode_is_dir (file_get_inode (file)))
+    return false;
+
+  /* The file's position is the directory's. */
+  pos = file_tell (file);
+  if (!dir_readdir_at (file_get_inode (file), &pos, kname))
+    return false;
+  file_seek (file, pos);
+  if (!copy_to_user (name, kname, strlen (kname) + 1))
+    syscall_exit (-1);
+  return true;
+}
+
+/* Returns true if fd represents a directory, false if it
+   represents an ordinary file. */
+static bool
+syscall_isdir (int fd)
+{
+  struct file *file = process_get_file (fd);
+  return file != NULL && inode_is_dir (file_get_inode (file));
+}
+
+/* Returns the inode number of the inode associated with fd,
+   which may represent an ordinary file or a directory, or -1 if
+   fd is not open. */
+static int
+syscall_inumber (int fd)
+{
+  struct file *file = process_get_file (fd);
+  if (file == NULL)
+    return -1;
+  return inode_get_inumber (file_get_inode (file));
+}
+
+/* Reads up to cnt entries, and at most DIRENT_MAX, from fd, which
+   must represent a directory, into ents, as readdir() would one
+   at a time.  Returns the number of entries read, 0 at the end
+   of the directory, or -1 if fd is not a directory or memory is
+   short. */
+static int
+syscall_getdents (int fd, struct dirent *ents, unsigned cnt)
+{
+  struct file *file = process_get_file (fd);
+  struct dirent *kents;
+  off_t pos;
+  size_t n;
+
+  if (file == NULL || !inode_is_dir (file_get_inode (file)))
+    return -1;
+  if (cnt > DIRENT_MAX)
+    cnt = DIRENT_MAX;
+  if (cnt == 0)
+    return 0;
+  kents = malloc (cnt * sizeof *kents);
+  if (kents == NULL)
+    return -1;
+
+  /* The file's position is the directory's. */
+  pos = file_tell (file);
+  n = dir_read_entries (file_get_inode (file), &pos, kents, cnt);
+  file_seek (file, pos);
+  if (!copy_to_user (ents, kents, n * sizeof *kents))
+    {
+      free (kents);
+      syscall_exit (-1);
+    }
+  free (kents);
+  return n;
+}
+
+/* Creates a pipe and stores descriptors for its read end and its
+   write end in FDS[0] and FDS[1].  Returns 0 if successful, -1
+   if memory is short. */
+static int
+syscall_pipe (int *fds)
+{
+  struct fd_entry reader = { NULL, NULL, false, 0 };
+  struct fd_entry writer = { NULL, NULL, true, 0 };
+  int kfds[2];
+
+  reader.pipe = writer.pipe = pipe_create ();
+  if (reader.pipe == NULL)
+    return -1;
+  kfds[0] = process_set_fd (&reader);
+  if (kfds[0] < 0)
+    {
+      process_fd_close (&reader);
+      process_fd_close (&writer);
+      return -1;
+    }
+  kfds[1] = process_set_fd (&writer);
+  if (kfds[1] < 0)
+    {
+      process_close_fd (kfds[0]);
+      process_fd_close (&writer);
+      return -1;
+    }
+
+  if (!copy_to_user (fds, kfds, sizeof kfds))
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  return 0;
+}
+
+/* Waits until one of the NFDS descriptors in FDS is ready for
+   the events it asks for, or for TIMEOUT milliseconds, forever
+   if TIMEOUT is negative, and sets the revents of each.  Besides
+   files and pipes, the console may be polled for input and
+   POLL_AIO_FD for completed asynchronous I/Os.  Returns the
+   number of descriptors with events, 0 if TIMEOUT passed first,
+   or -1 if NFDS exceeds POLL_FDS_MAX. */
+static int
+syscall_poll (struct pollfd *fds, unsigned nfds, int timeout)
+{
+  struct pollfd kfds[POLL_FDS_MAX];
+  int64_t deadline = -1;
+  unsigned i;
+
+  if (nfds > POLL_FDS_MAX)
+    return -1;
+  if (nfds > 0 && !copy_from_user (kfds, fds, nfds * sizeof *kfds))
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  if (timeout >= 0)
+    deadline = (timer_ticks ()
+                + ((int64_t) timeout * TIMER_FREQ + 999) / 1000);
+
+  for (;;)
+    {
+      unsigned events = poll_events ();
+      int ready = 0;
+
+      for (i = 0; i < nfds; i++)
         {
-          fault_ofs = ofs;
-          goto fail;
+          kfds[i].revents = poll_fd (kfds[i].fd)
+                            & (kfds[i].events | POLLERR | POLLHUP | POLLNVAL);
+          if (kfds[i].revents != 0)
+            ready++;
+        }
+      if (ready > 0 || process_exiting ()
+          || !poll_wait (events, deadline))
+        {
+          if (nfds > 0 && !copy_to_user (fds, kfds, nfds * sizeof *kfds))
+            {
+              syscall_exit (-1);
+              NOT_REACHED ();
+            }
+          return ready;
+        }
+    }
+}
+
+/* Returns the poll events that are ready on descriptor FD. */
+static int
+poll_fd (int fd)
+{
+  struct fd_entry *e;
+
+  if (fd == STDIN_FILENO)
+    return input_empty () ? 0 : POLLIN;
+  if (fd == STDOUT_FILENO)
+    return POLLOUT;
+  if (fd == POLL_AIO_FD)
+    switch (aio_ready ())
+      {
+      case 1: return POLLIN;
+      case 0: return 0;
+      default: return POLLNVAL;
+      }
+
+  e = process_get_fd (fd);
+  if (e == NULL || (e->file == NULL && e->pipe == NULL))
+    return POLLNVAL;
+  if (e->pipe != NULL)
+    return pipe_poll (e->pipe, e->pipe_writer);
+  return POLLIN | POLLOUT;
+}
+
+/* Carries out command CMD on descriptor FD: F_GETFL returns its
+   flags, F_SETFL sets them to ARG and returns 0.  O_NONBLOCK is
+   the only flag; it applies to the console and to pipes, since
+   files are never waited on for long.  Returns -1 if FD is not
+   open or CMD is unknown. */
+static int
+syscall_fcntl (int fd, int cmd, int arg)
+{
+  int *flags;
+
+  if (fd == STDIN_FILENO)
+    flags = &process_current ()->stdin_flags;
+  else
+    {
+      struct fd_entry *e = process_get_fd (fd);
+      if (e == NULL || (e->file == NULL && e->pipe == NULL))
+        return -1;
+      flags = &e->flags;
+    }
+
+  switch (cmd)
+    {
+    case F_GETFL:
+      return *flags;
+    case F_SETFL:
+      *flags = arg & O_NONBLOCK;
+      return 0;
+    default:
+      return -1;
+    }
+}
+
+/* Stores in USAGE the resource use of the current process, if WHO
+   is RUSAGE_SELF, or of the calling thread, if RUSAGE_THREAD.
+   Returns 0 if successful, -1 if WHO is unknown. */
+static int
+syscall_getrusage (int who, struct rusage *usage)
+{
+  struct rusage ru;
+
+  if (who == RUSAGE_SELF)
+    process_rusage (&ru);
+  else if (who == RUSAGE_THREAD)
+    ru = thread_current ()->rusage;
+  else
+    return -1;
+  if (!copy_to_user (usage, &ru, sizeof ru))
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  return 0;
+}
+
+/* Starts a thread in the current process that runs the user code
+   at EIP as if called with ARG0 and ARG1, on the user stack whose
+   top is STACK.  The thread shares the process's memory and
+   descriptors; it ends with thread_exit(), and wait() on its
+   thread id joins it.  Returns the thread id, or -1 if it cannot
+   be started. */
+static pid_t
+syscall_clone (void *eip, void *arg0, void *arg1, void *stack)
+{
+  /* A null return address, then the arguments. */
+  uint32_t frame[3] = { 0, (uint32_t) arg0, (uint32_t) arg1 };
+  uint32_t *esp = (uint32_t *) stack - 3;
+
+  if (!is_user_vaddr (eip) || !copy_to_user (esp, frame, sizeof frame))
+    return PID_ERROR;
+  return process_clone (eip, esp);
+}
+
+/* Terminates the current thread with STATUS, which wait() on its
+   thread id returns.  In the process's first thread, this is
+   exit (STATUS). */
+static void
+syscall_thread_exit (int status)
+{
+  struct thread *t = thread_current ();
+
+  if (t->leader == t)
+    syscall_exit (status);
+  t->process.info->exit_code = status;
+  thread_exit ();
+  NOT_REACHED ();
+}
+
+/* Puts the current thread to sleep on the futex at ADDR if it
+   holds VAL, until futex_wake() on ADDR wakes it.  The check and
+   the sleep are atomic with respect to futex_wake().  Returns 0
+   once woken, or -1 if ADDR is misaligned or does not hold
+   VAL. */
+static int
+syscall_futex_wait (int *addr, int val)
+{
+  struct futex_queue *q;
+  int cur;
+
+  if (pg_ofs (addr) % sizeof *addr != 0)
+    return -1;
+  q = futex_queue_lock (addr);
+  if (!copy_from_user (&cur, addr, sizeof cur))
+    {
+      futex_queue_unlock (q);
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  if (cur != val || process_exiting ())
+    {
+      futex_queue_unlock (q);
+      return -1;
+    }
+  futex_queue_sleep (q, addr);
+  return 0;
+}
+
+/* Wakes up to CNT threads sleeping on the futex at ADDR, those
+   of highest priority first.  Returns the number woken. */
+static int
+syscall_futex_wake (int *addr, int cnt)
+{
+  return futex_wake (addr, cnt);
+}
+
+/* Stores a snapshot of the kernel performance counters in ST. */
+static void
+syscall_perfstat (struct perfstat *st)
+{
+  struct perfstat kst;
+
+  perf_read (&kst);
+  if (!copy_to_user (st, &kst, sizeof kst))
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+}
+
+/* Stores latency histogram IDX of kind KIND, an enum perf_hist,
+   in H.  Returns false if there is no such histogram. */
+static bool
+syscall_perfhist (int kind, unsigned idx, struct perfhist *h)
+{
+  struct perfhist kh;
+
+  if (kind < 0 || kind >= PERF_HIST_CNT
+      || !perf_hist_read (kind, idx, &kh))
+    return false;
+  if (!copy_to_user (h, &kh, sizeof kh))
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  return true;
+}
+
+/* Returns the time stamp counter, with its low word as the
+   result and its high word in F's EDX. */
+static uint32_t
+syscall_cycles (struct intr_frame *f)
+{
+  uint64_t tsc = timer_cycles ();
+
+  f->edx = tsc >> 32;
+  return tsc;
+}
+
+/* Returns the nanoseconds since boot, with the low word as the
+   result and the high word in F's EDX. */
+static uint32_t
+syscall_gettime (struct intr_frame *f)
+{
+  uint64_t nanos = timer_nanos ();
+
+  f->edx = nanos >> 32;
+  return nanos;
+}
+
+/* Registers the rings at RING for asynchronous I/O.  Returns 0
+   if successful, -1 otherwise. */
+static int
+syscall_aio_setup (struct aio_ring *ring)
+{
+  return aio_setup (ring);
+}
+
+/* Starts the submitted asynchronous I/Os and waits for at least
+   MIN_COMPLETE completions.  Returns the number of I/Os started,
+   or -1 on error. */
+static int
+syscall_aio_enter (unsigned min_complete)
+{
+  return aio_enter (min_complete);
+}
+
+/* Runs the CNT system calls described by the array at CALLS in
+   order within this one system call, storing each one's result
+   back in its entry, and returns the number run.  Stops short at
+   an undefined call, at one that needs the interrupt frame, such
+   as fork, or at a nested batch, and as soon as the process
+   starts exiting.  Returns -1 if CNT is out of range. */
+static int
+syscall_batch (struct batch_call *calls, int cnt)
+{
+  int i;
+
+  if (cnt < 0 || cnt > BATCH_MAX)
+    return -1;
+  for (i = 0; i < cnt && !process_exiting (); i++)
+    {
+      uint32_t args[SYSCALL_ARGS_MAX] = { 0, 0, 0, 0, 0 };
+      struct batch_call call;
+      const struct syscall *sc;
+      uint64_t start;
+
+      if (!copy_from_user (&call, &calls[i], sizeof call))
+        {
+          syscall_exit (-1);
+          NOT_REACHED ();
+        }
+      if (call.nr < 0 || (size_t) call.nr >= SYSCALL_CNT
+          || call.nr == SYS_BATCH)
+        break;
+      sc = &syscall_table[call.nr];
+      if (sc->func == NULL || sc->argc == SYSCALL_FRAME)
+        break;
+      perf_syscall (call.nr);
+
+      memcpy (args, call.args, sizeof call.args);
+      start = timer_cycles ();
+      call.result = syscall_invoke (sc, args);
+      perf_hist_add (PERF_HIST_SYSCALL, call.nr, timer_cycles () - start);
+      if (!copy_to_user (&calls[i].result, &call.result, sizeof call.result))
+        {
+          syscall_exit (-1);
+          NOT_REACHED ();
         }
     }
-  fault_ofs = size;
+  return i;
+}
+
+#ifdef VM
+/* Maps the file open as FD into the process’s virtual address
+   space.  Only the mapping is recorded here; its pages get
+   supplemental page table entries as they are touched. */
+static mapid_t
+syscall_mmap (int fd, void *addr)
+{
+  struct file *f = NULL;
+  bool locked = suppl_pt_lock ();
+
+  /* Check the validity. */
+  if (addr == NULL || !is_user_vaddr (addr) || pg_ofs (addr) != 0)
+    goto fail;
+
+  /* Get the file. */
+  f = get_regular_file (fd);
+  if (f == NULL)
+    goto fail;
+
+  /* Reopen the file. */
+  size_t size;
+  f = file_reopen (f);
+  if (f == NULL || (size = file_length (f)) == 0)
+    goto fail;
+
+  /* The pages must be in user space and not in use. */
+  if (size > (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) addr)
+      || process_find_mmap (addr, size) != NULL
+      || !suppl_pt_range_free (addr, size))
+    goto fail;
 
   /* Create a new mmap item. */
-  mapid_t id = process_set_mmap (f, addr, size);
+  mapid_t id = process_set_mmap (f, NULL, addr, size);
   if (id == MAP_FAILED)
     goto fail;
 
   /* Return mapping id. */
-  lock_release (&filesys_lock);
+  suppl_pt_unlock (locked);
   return id;
 
  fail:
-  for (ofs = 0; ofs < fault_ofs; ofs += PGSIZE)
-    suppl_pt_clear_page (addr + ofs);
+  suppl_pt_unlock (locked);
   file_close (f);
-  lock_release (&filesys_lock);
   return MAP_FAILED;
 }
 
@@ -461,76 +1511,354 @@ syscall_mmap (int fd, void *addr)
 static void
 syscall_munmap (mapid_t mapping)
 {
+  bool locked = suppl_pt_lock ();
   struct process_mmap *mmap = process_get_mmap (mapping);
-  if (mmap == NULL)
-    return;
-  mmap_unmap_item (mmap);
+  if (mmap != NULL)
+    mmap_unmap_item (mmap);
+  suppl_pt_unlock (locked);
 }
 
-/* Wirtes data back to the original file with given offset. */
+/* Maps the first SIZE bytes of the shared memory segment NAME at
+   ADDR, creating the segment with SIZE bytes if there is none.
+   The processes mapping a segment share its frames and see each
+   other's writes.  The mapping is removed by munmap() like that
+   of a file, and the segment is freed once no process maps it.
+   Returns the mapping identifier, or MAP_FAILED if NAME is empty
+   or too long, the pages are not free, or the segment is
+   smaller than SIZE. */
+static mapid_t
+syscall_shm_map (const char *name, size_t size, void *addr)
+{
+  char kname[SHM_NAME_MAX + 1];
+  struct shm_segment *seg;
+  mapid_t id = MAP_FAILED;
+  bool locked;
+
+  /* Copy the name. */
+  int len = strncpy_from_user (kname, name, sizeof kname);
+  if (len == -1)
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  if (len == 0 || (size_t) len == sizeof kname)
+    return MAP_FAILED;
+
+  /* The pages must be in user space and not in use. */
+  locked = suppl_pt_lock ();
+  if (addr == NULL || !is_user_vaddr (addr) || pg_ofs (addr) != 0
+      || size == 0
+      || size > (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) addr)
+      || process_find_mmap (addr, size) != NULL
+      || !suppl_pt_range_free (addr, size))
+    goto done;
+
+  /* Map the segment. */
+  seg = shm_attach (kname, size);
+  if (seg == NULL)
+    goto done;
+  if (!shm_map (seg, addr, size))
+    {
+      shm_detach (seg);
+      goto done;
+    }
+  id = process_set_mmap (NULL, seg, addr, size);
+  if (id == MAP_FAILED)
+    {
+      shm_unmap (addr, size);
+      shm_detach (seg);
+    }
+
+ done:
+  suppl_pt_unlock (locked);
+  return id;
+}
+
+/* Creates a copy of the current process, which shares its memory
+   copy-on-write and returns 0, and returns the new process's
+   process id. */
+static pid_t
+syscall_fork (struct intr_frame *f)
+{
+  /* Create a new process and wait until it has its copy. */
+  return wait_for_load (process_fork (f));
+}
+
+/* Saves the current process to a new file, named by the first
+   argument of the call that interrupted it in F, from which
+   exec() later resumes it.  Returns 0 if successful, -1 if the
+   file cannot be created or the process has other threads or
+   memory mappings.  The resumed process returns 1 instead. */
+static int
+syscall_checkpoint (struct intr_frame *f)
+{
+  const char *ufile = (const char *) (f->vec_no == 0x31
+                                      ? f->ebx
+                                      : get_word ((uint32_t *) f->esp + 1));
+  char *file = strdup_from_user (ufile);
+  bool success;
+
+  if (file == NULL)
+    return -1;
+  success = checkpoint_save (file, f);
+  palloc_free_page (file);
+  return success ? 0 : -1;
+}
+
+/* Moves the program break of the current process by INCREMENT
+   bytes and returns the old break.  Pages that come under the
+   break are zero pages, given frames only when touched; pages
+   that leave it are freed.  Returns (void *) -1 if the heap
+   would shrink below its start, reach STACK_LIMIT, or run into
+   memory in use. */
+static void *
+syscall_sbrk (intptr_t increment)
+{
+  struct process *curr = process_current ();
+  bool locked = suppl_pt_lock ();
+  uint8_t *old = curr->brk;
+  uint8_t *brk = old + increment;
+  uint8_t *old_end = pg_round_up (old);
+  uint8_t *new_end = pg_round_up (brk);
+  uint8_t *upage;
+
+  /* Check the validity. */
+  if (increment >= 0
+      ? brk < old || brk > (uint8_t *) STACK_LIMIT
+      : brk > old || brk < (uint8_t *) curr->heap_start)
+    goto fail;
+
+  /* Add zero pages for the growth. */
+  if (new_end > old_end)
+    {
+      if (process_find_mmap (old_end, new_end - old_end) != NULL
+          || !suppl_pt_range_free (old_end, new_end - old_end))
+        goto fail;
+      for (upage = old_end; upage < new_end; upage += PGSIZE)
+        if (!suppl_pt_set_zero (upage))
+          {
+            while (upage > old_end)
+              suppl_pt_free_page (upage -= PGSIZE);
+            goto fail;
+          }
+    }
+
+  /* Free the pages given back. */
+  for (upage = new_end; upage < old_end; upage += PGSIZE)
+    suppl_pt_free_page (upage);
+
+  curr->brk = brk;
+  suppl_pt_unlock (locked);
+  return old;
+
+ fail:
+  suppl_pt_unlock (locked);
+  return (void *) -1;
+}
+
+/* Stores the memory use of the current process in ST. */
+static void
+syscall_memstat (struct memstat *st)
+{
+  struct memstat kst;
+
+  frame_memstat (thread_current ()->suppl_pt, &kst);
+  if (!copy_to_user (st, &kst, sizeof kst))
+    {
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+}
+
+/* Applies ADVICE, an enum madvise_advice, to the pages of the
+   current process spanning SIZE bytes at ADDR, as
+   suppl_pt_advise() describes.  Returns false if ADDR is not
+   page-aligned, the range is not in user space, or ADVICE is
+   unknown. */
+static bool
+syscall_madvise (void *addr, size_t size, int advice)
+{
+  bool locked;
+
+  if (pg_ofs (addr) != 0 || !is_user_range (addr, size)
+      || advice < MADV_NORMAL || advice > MADV_DONTNEED)
+    return false;
+  locked = suppl_pt_lock ();
+  suppl_pt_advise (addr, size, advice);
+  suppl_pt_unlock (locked);
+  return true;
+}
+
+/* Writes the SIZE bytes at KPAGE, a page of memory mapped FILE,
+   back to it at offset OFS, which is sector-aligned.  Sectors
+   that the buffer cache holds with the same contents are skipped,
+   so that a page changed in a few bytes costs a sector or two
+   rather than a whole page; the page was read through the cache,
+   which usually still holds it.  The changed sectors go in runs,
+   written to the inode directly, since file_write_at() would
+   wait for the write-back of unmapped pages that this may be
+   part of.
+   Returns the number of bytes of the page that the file holds
+   now, or -1 if FILE cannot be reopened. */
 off_t
-mmap_write_back (struct file *file, void *kpage, off_t ofs)
+mmap_write_back (struct file *file, void *kpage, off_t ofs, size_t size)
 {
-  lock_acquire (&filesys_lock);
+  uint8_t *page = kpage;
+  struct inode *inode;
+  size_t start, pos;
+
+  ASSERT (ofs % DISK_SECTOR_SIZE == 0);
+
   file = file_reopen (file);
   if (file == NULL)
     return -1;
-  off_t writes_byte = file_write_at (file, kpage, PGSIZE, ofs);
-  lock_release (&filesys_lock);
-  return writes_byte;
+  inode = file_get_inode (file);
+
+  start = 0;
+  for (pos = 0; pos < size; pos += DISK_SECTOR_SIZE)
+    {
+      size_t n = size - pos < DISK_SECTOR_SIZE ? size - pos
+                                               : DISK_SECTOR_SIZE;
+      if (!inode_unchanged (inode, page + pos, n, ofs + pos))
+        continue;
+
+      /* Write the run of changed sectors before this one. */
+      if (start < pos
+          && inode_write_at (inode, page + start, pos - start, ofs + start)
+             != (off_t) (pos - start))
+        {
+          size = start;
+          break;
+        }
+      start = pos + n;
+    }
+  if (start < size)
+    size = start + inode_write_at (inode, page + start, size - start,
+                                   ofs + start);
+  file_close (file);
+  return size;
 }
 
 /* Unmaps the mapping, which must be a mapping ID returned by
    a previous call to mmap by the same process that has not yet
-   been unmapped. */
+   been unmapped.
+   Only the pages touched have supplemental page table entries.
+   Each is detached from the address space at once.  Dirty ones
+   are handed, in file order, to mmap_wq, which writes each up to
+   the end of the file and as far as it changed, see
+   mmap_write_back(), so that unmapping takes no longer for a
+   large dirty mapping.  Reads and writes of the file wait for
+   that meanwhile.
+   Eviction never moves a memory mapped page to swap. */
 void
 mmap_unmap_item (struct process_mmap *mmap)
 {
   ASSERT (pg_ofs (mmap->addr) == 0);
 
-  lock_acquire (&filesys_lock);
-  
-  /* Write back to the file. */
-  off_t ofs;
-  for (ofs = 0; (size_t) ofs < mmap->size; ofs += PGSIZE)
+  /* Shared memory is kept by its segment. */
+  if (mmap->shm != NULL)
     {
-      void *addr = mmap->addr + ofs;
-      struct suppl_pte *pte = suppl_pt_get_page (addr);
-      if (pte == NULL)
-        continue;
+      shm_unmap (mmap->addr, mmap->size);
+      shm_detach (mmap->shm);
+      process_remove_mmap (mmap);
+      free (mmap);
+      return;
+    }
+
+  /* Detach the pages that were touched, handing the dirty ones
+     over for write-back. */
+  struct suppl_pt *pt = thread_current ()->suppl_pt;
+  void *addr = mmap->addr;
+  void *end = mmap->addr + mmap->size;
+  struct mmap_wb *wb = NULL;
+  struct suppl_pte *pte;
+  while ((pte = suppl_pt_next (pt, addr, end)) != NULL)
+    {
+      off_t ofs = (uint8_t *) pte->upage - (uint8_t *) mmap->addr;
+      addr = pte->upage + PGSIZE;
+      frame_wait (pte);
 
       /* If page is loaded now. */
       if (pte->kpage != NULL)
         {
-          if (suppl_pt_update_dirty (pte))
-            file_write_at (mmap->file, pte->kpage, PGSIZE, ofs);
+          bool dirty = suppl_pt_update_dirty (pte);
+
+          pagedir_clear_page (pte->pagedir, pte->upage);
           frame_remove (pte->kpage);
-          palloc_free_page (pte->kpage);
-        }
-      /* If page is on swap disk. */
-      else if (pte->type == PAGE_SWAP)
-        {
-          if (suppl_pt_update_dirty (pte))
-            {
-              void *kpage = palloc_get_page (0);
-              swap_in (kpage, pte->swap_index);
-              file_write_at (mmap->file, pte->kpage, PGSIZE, ofs);
-              palloc_free_page (kpage);
-            }
+          if (dirty)
+            mmap_defer_write_back (&wb, mmap->file, pte->kpage, ofs,
+                                   pte->read_bytes);
           else
-            swap_remove (pte->swap_index);
+            palloc_free_page (pte->kpage);
+          pte->kpage = NULL;
         }
 
       /* Free resources. */
       pagedir_clear_page (pte->pagedir, pte->upage);
-      hash_delete (&thread_current ()->suppl_pt->hash, &pte->elem);
+      suppl_pt_free_pte (pte, pt);
     }
+  if (wb != NULL)
+    work_queue (&mmap_wq, &wb->work);
 
   /* Free resources. */
-  list_remove (&mmap->elem);
+  process_remove_mmap (mmap);
   file_close (mmap->file);
   free (mmap);
-  lock_release (&filesys_lock);
+}
+
+/* Adds KPAGE, a dirty page of memory mapped FILE at offset OFS
+   that is detached from the address space and of which SIZE
+   bytes are the file's, to the batch *WB of pages to write back,
+   queueing *WB and starting a new batch if it is null or full.
+   The batch frees KPAGE once it is written.  If memory is short,
+   writes KPAGE back and frees it now instead. */
+static void
+mmap_defer_write_back (struct mmap_wb **wb, struct file *file,
+                       void *kpage, off_t ofs, size_t size)
+{
+  if (*wb != NULL && (*wb)->cnt == MMAP_WB_PAGES)
+    {
+      work_queue (&mmap_wq, &(*wb)->work);
+      *wb = NULL;
+    }
+  if (*wb == NULL)
+    {
+      struct mmap_wb *new = malloc (sizeof *new);
+      if (new == NULL || (new->file = file_reopen (file)) == NULL)
+        {
+          free (new);
+          mmap_write_back (file, kpage, ofs, size);
+          palloc_free_page (kpage);
+          return;
+        }
+      work_init (&new->work, mmap_wb_run, new);
+      new->cnt = 0;
+      inode_defer_writes (file_get_inode (new->file));
+      *wb = new;
+    }
+  (*wb)->pages[(*wb)->cnt].kpage = kpage;
+  (*wb)->pages[(*wb)->cnt].ofs = ofs;
+  (*wb)->pages[(*wb)->cnt].size = size;
+  (*wb)->cnt++;
+}
+
+/* Writes back and frees the pages of WB_, a struct mmap_wb.
+   Work function of mmap_wq. */
+static void
+mmap_wb_run (void *wb_)
+{
+  struct mmap_wb *wb = wb_;
+  size_t i;
+
+  for (i = 0; i < wb->cnt; i++)
+    {
+      mmap_write_back (wb->file, wb->pages[i].kpage, wb->pages[i].ofs,
+                       wb->pages[i].size);
+      palloc_free_page (wb->pages[i].kpage);
+    }
+  inode_deferred_done (file_get_inode (wb->file));
+  file_close (wb->file);
+  free (wb);
 }
 #endif
 
@@ -555,17 +1883,10 @@ static uint32_t
 get_word (const uint32_t *uaddr)
 {
   uint32_t res;
-  int byte;
-  int i;
-  for (i = 0; i < 4; i++)
+  if (!copy_from_user (&res, uaddr, sizeof res))
     {
-      byte = get_byte ((uint8_t *) uaddr + i);
-      if (byte == -1)
-        {
-          syscall_exit (-1);
-          NOT_REACHED ();
-        }
-      *((uint8_t *) &res + i) = (uint8_t) byte;
+      syscall_exit (-1);
+      NOT_REACHED ();
     }
   return res;
 }
@@ -584,6 +1905,114 @@ put_byte (uint8_t *udst, uint8_t byte)
   return error_code != -1;
 }
 
+/* Returns true if the SIZE bytes at UADDR lie in the user
+   space. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  return is_user_vaddr (uaddr)
+         && size <= (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) uaddr);
+}
+
+/* Copies SIZE bytes from user address USRC to DST in one string
+   move.  A fault on a bad user page resumes at the end of it, as
+   in get_byte(), so nothing is probed beforehand.
+   Returns true if successful, false if a segfault occurred or
+   the bytes are not all in the user space. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  int result;
+
+  if (!is_user_range (usrc, size))
+    return false;
+  asm volatile ("movl $1f, %0; rep movsb; 1:"
+                : "=&a" (result), "+S" (usrc), "+D" (dst), "+c" (size)
+                : : "memory");
+  return result != -1;
+}
+
+/* Copies SIZE bytes from SRC to user address UDST in one string
+   move.  Returns true if successful, false if a segfault
+   occurred or the bytes are not all in the user space. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  int result;
+
+  if (!is_user_range (udst, size))
+    return false;
+  asm volatile ("movl $1f, %0; rep movsb; 1:"
+                : "=&a" (result), "+S" (src), "+D" (udst), "+c" (size)
+                : : "memory");
+  return result != -1;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   DST, which holds SIZE bytes, in one pass.
+   Returns the length of the string, SIZE if it does not fit
+   with its null terminator, so that DST is not terminated, or -1
+   if a segfault occurred or the string is not in the user
+   space. */
+static int
+strncpy_from_user (char *dst, const char *usrc, size_t size)
+{
+  const char *src = usrc;
+  size_t max = size;
+  int result;
+  int last = 1;
+
+  /* Stop at the end of the user space. */
+  if (!is_user_vaddr (usrc))
+    return -1;
+  if (size > (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) usrc))
+    size = (uint8_t *) PHYS_BASE - (uint8_t *) usrc;
+  asm volatile ("movl $2f, %0\n"
+                "1:\ttestl %3, %3\n"
+                "\tjz 2f\n"
+                "\tmovb (%1), %b4\n"
+                "\tmovb %b4, (%2)\n"
+                "\tincl %1\n"
+                "\tincl %2\n"
+                "\tdecl %3\n"
+                "\ttestb %b4, %b4\n"
+                "\tjnz 1b\n"
+                "2:"
+                : "=&a" (result), "+S" (src), "+D" (dst), "+c" (size),
+                  "+q" (last)
+                : : "memory");
+  if (result == -1)
+    return -1;
+  if ((last & 0xff) == 0)
+    return src - usrc - 1;
+  return (size_t) (src - usrc) == max ? (int) max : -1;
+}
+
+/* Returns a copy of the null-terminated string at user address
+   USTR in a new page, which the caller frees, or NULL if it does
+   not fit in a page.  Terminates the process if USTR is not
+   readable. */
+static char *
+strdup_from_user (const char *ustr)
+{
+  char *kstr = palloc_get_page (0);
+  if (kstr == NULL)
+    return NULL;
+  int len = strncpy_from_user (kstr, ustr, PGSIZE);
+  if (len == -1)
+    {
+      palloc_free_page (kstr);
+      syscall_exit (-1);
+      NOT_REACHED ();
+    }
+  if (len == PGSIZE)
+    {
+      palloc_free_page (kstr);
+      return NULL;
+    }
+  return kstr;
+}
+
 /* Validates reading to a given user virtual address UADDR up to
    size SIZE. */
 static void
@@ -603,7 +2032,8 @@ validate_ptr_read (const uint8_t *uaddr, size_t size)
 /* Validates writing to a given user virtual address UADDR up to
    size SIZE.
 
-   Use this method after validate_ptr_read(). */
+   Use this method after validate_ptr_read() and, under VM, after
+   pinning the pages with suppl_pt_pin_write(). */
 static void
 validate_ptr_write (uint8_t *udst, unsigned size)
 {
@@ -1,6 +1,8 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #ifdef VM
 #include "filesys/off_t.h"
 #include "userprog/process.h"
@@ -8,9 +10,11 @@
 
 void syscall_init (void);
 void syscall_exit (int);
+bool copy_from_user (void *dst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *src, size_t size);
 
 #ifdef VM
-off_t mmap_write_back (struct file *, void *kpage, off_t);
+off_t mmap_write_back (struct file *, void *kpage, off_t, size_t);
 void mmap_unmap_item (struct process_mmap *);
 #endif
 
@@ -75,6 +75,16 @@ struct tss
 /* Kernel TSS. */
 static struct tss *tss;
 
+/* CPUID feature flag: SYSENTER and SYSEXIT. */
+#define CPUID_SEP (1u << 11)
+
+/* Model-specific registers that set up SYSENTER. */
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+static void sysenter_init (void);
+
 /* Initializes the kernel TSS. */
 void
 tss_init (void) 
@@ -86,6 +96,48 @@ tss_init (void)
   tss->ss0 = SEL_KDSEG;
   tss->bitmap = 0xdfff;
   tss_update ();
+  sysenter_init ();
+}
+
+/* Lets user programs make system calls with SYSENTER, if the CPU
+   has it, as a faster form of the register convention of
+   int $0x31.  See sysenter.S.
+
+   SYSENTER loads its stack pointer from an MSR, not from the
+   TSS, and rewriting the MSR on every thread switch would be
+   slow.  Instead we point it at our TSS's esp0, which
+   tss_update() keeps current, and sysenter_entry loads the real
+   stack pointer from there.
+
+   SYSENTER and SYSEXIT take the kernel data, user code, and user
+   data selectors to be the kernel code selector plus 8, 16, and
+   24, which is how our GDT is laid out.  See [IA32-v2b]
+   "SYSENTER". */
+static void
+sysenter_init (void) 
+{
+  extern void sysenter_entry (void);
+  uint32_t eax, ebx, ecx, edx;
+
+  ASSERT (SEL_KDSEG == SEL_KCSEG + 8);
+  ASSERT (SEL_UCSEG == (SEL_KCSEG + 16) + 3);
+  ASSERT (SEL_UDSEG == (SEL_KCSEG + 24) + 3);
+
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1));
+
+  /* The Pentium Pro claims SEP but does not implement it. */
+  if ((edx & CPUID_SEP) == 0
+      || (((eax >> 8) & 0xf) == 6 && ((eax >> 4) & 0xf) < 3
+          && (eax & 0xf) < 3))
+    return;
+
+  asm volatile ("wrmsr" : : "c" (MSR_SYSENTER_CS), "a" (SEL_KCSEG), "d" (0));
+  asm volatile ("wrmsr" : : "c" (MSR_SYSENTER_ESP), "a" (&tss->esp0),
+                "d" (0));
+  asm volatile ("wrmsr" : : "c" (MSR_SYSENTER_EIP), "a" (sysenter_entry),
+                "d" (0));
 }
 
 /* Returns the kernel TSS. */
@@ -0,0 +1,614 @@
+/* pintos-mkfs: builds a Pintos disk holding a formatted file
+   system with files already in it, so that the kernel can run
+   on it without -f and without copying files in over the
+   scratch disk.
+
+   The image is laid out as the kernel in filesys/ would lay it
+   out, in the default indexed inode layout: the free map file's
+   inode in sector 0, the root directory's in sector 1, the
+   journal in the blocks after them, and then each inode in a
+   block of its own followed by its data, all in one contiguous
+   run, and its index blocks.  Directories come before the files
+   in them.  The definitions below must agree with
+   filesys/filesys.h, filesys/inode.c, filesys/directory.c,
+   filesys/free-map.c, filesys/journal.c and lib/kernel/hash.c.
+   Only a little-endian host writes the image the kernel
+   expects. */
+
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SECTOR_SIZE 512
+
+/* Sectors of system file inodes and of the journal. */
+#define FREE_MAP_SECTOR 0
+#define ROOT_DIR_SECTOR 1
+#define JOURNAL_SECTOR 2
+#define JOURNAL_BLOCKS 123
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Inodes. */
+#define INODE_MAGIC 0x494e4f44
+#define INODE_INLINE 0x1
+#define INODE_DIR 0x2
+#define NUM_ADDR 15
+#define IND_BLOCK 12
+#define DIND_BLOCK 14
+#define SIZE_BLOCK (SECTOR_SIZE / sizeof (uint32_t))
+#define INLINE_MAX 432
+
+/* Directories. */
+#define FS_NAME_MAX 63
+#define DIR_HASH_MAGIC 0x44495248
+#define BUCKET_MAX 4096
+
+/* On-disk inode. */
+struct inode_disk
+  {
+    uint32_t sectors[NUM_ADDR];         /* Blocks. */
+    int32_t length;                     /* File size in bytes. */
+    uint32_t magic;                     /* Magic number. */
+    uint32_t sector_cnt;                /* Bound of allocated sectors. */
+    uint32_t flags;                     /* INODE_* flags. */
+    uint32_t create_gen;                /* Creation generation, 0 here. */
+    uint8_t inline_data[INLINE_MAX];    /* Data of an inline file. */
+  };
+
+/* Directory entry, followed by its name, not null terminated. */
+struct dir_entry
+  {
+    uint32_t inode_sector;              /* Sector number of header. */
+    uint8_t in_use;                     /* In use or free? */
+    uint8_t name_len;                   /* Length of the name. */
+  } __attribute__ ((packed));
+
+/* Block of directory entries, filling one sector. */
+struct dir_block
+  {
+    uint16_t used;                      /* Bytes of DATA holding entries. */
+    uint16_t free;                      /* Bytes of those in free entries. */
+    uint8_t data[SECTOR_SIZE - 4];      /* Entries, packed. */
+  };
+
+/* Bytes taken by the entry for NAME. */
+#define ENTRY_SIZE(NAME) (sizeof (struct dir_entry) + strlen (NAME))
+
+/* Journal header. */
+struct journal_header
+  {
+    uint32_t magic;                     /* Magic number. */
+    uint32_t block_sectors;             /* Sectors per block. */
+    uint32_t volume;                    /* Volume number. */
+    uint32_t chunk_sectors;             /* Sectors per chunk, or 0. */
+    uint32_t cnt;                       /* Number of sectors logged. */
+    uint32_t sectors[JOURNAL_BLOCKS];   /* Home sectors. */
+  };
+
+/* A file to copy into the image: a host path and its name
+   there. */
+struct source
+  {
+    char *path;
+    char name[FS_NAME_MAX + 1];
+  };
+
+static const char *program_name;
+static int disk_fd;                     /* Image being written. */
+static uint32_t block_sectors = 1;      /* Sectors per block. */
+static uint32_t block_cnt;              /* Blocks on the disk. */
+static uint32_t next_block;             /* Blocks below it are in use. */
+
+static void fail (const char *, ...)
+  __attribute__ ((noreturn, format (printf, 1, 2)));
+static void usage (int status) __attribute__ ((noreturn));
+static void write_disk (off_t ofs, const void *, size_t size);
+static uint32_t allocate (uint32_t blocks);
+static uint32_t layout (struct inode_disk *, uint32_t flags, size_t length);
+static void write_inode (uint32_t sector, const struct inode_disk *);
+static void write_data (uint32_t sector, struct inode_disk *, size_t ofs,
+                        const void *, size_t length);
+static void make_dir (uint32_t sector, uint32_t parent,
+                      struct source *, size_t cnt);
+static void make_file (uint32_t sector, const char *path);
+static uint32_t hash_string (const char *);
+
+int
+main (int argc, char *argv[])
+{
+  static const struct option options[] =
+    {
+      {"block", required_argument, NULL, 'b'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+    };
+  struct journal_header header;
+  struct inode_disk free_map;
+  struct source *sources;
+  uint8_t *map;
+  size_t map_size, disk_sectors, i;
+  uint32_t map_sector;
+  double mb;
+  int c;
+
+  program_name = argv[0];
+  if (sizeof (struct inode_disk) != SECTOR_SIZE
+      || sizeof (struct dir_entry) != 6
+      || sizeof (struct dir_block) != SECTOR_SIZE
+      || sizeof (struct journal_header) != SECTOR_SIZE)
+    fail ("on-disk structures have the wrong size on this host");
+
+  while ((c = getopt_long (argc, argv, "b:h", options, NULL)) != -1)
+    switch (c)
+      {
+      case 'b':
+        {
+          long bytes = strtol (optarg, NULL, 10);
+          if (bytes < SECTOR_SIZE || bytes > 4096 || (bytes & (bytes - 1)))
+            fail ("block size must be a power of 2 from %d to 4096 bytes",
+                  SECTOR_SIZE);
+          block_sectors = bytes / SECTOR_SIZE;
+        }
+        break;
+      case 'h':
+        usage (EXIT_SUCCESS);
+      default:
+        usage (EXIT_FAILURE);
+      }
+  if (argc - optind < 2)
+    usage (EXIT_FAILURE);
+
+  /* Create the disk, sized as pintos-mkdisk does, in whole
+     cylinders of 16 heads by 63 sectors. */
+  mb = strtod (argv[optind + 1], NULL);
+  if (mb <= 0 || mb > 1024)
+    fail ("\"%s\" is not a valid size in megabytes", argv[optind + 1]);
+  disk_sectors = (size_t) (mb * 2 + .999999) * 16 * 63;
+  disk_fd = open (argv[optind], O_WRONLY | O_CREAT | O_EXCL, 0666);
+  if (disk_fd < 0)
+    fail ("%s: create: %s", argv[optind], strerror (errno));
+  if (ftruncate (disk_fd, (off_t) disk_sectors * SECTOR_SIZE) < 0)
+    fail ("%s: truncate: %s", argv[optind], strerror (errno));
+  block_cnt = disk_sectors / block_sectors;
+
+  /* Reserve the blocks of the free map and root directory inodes
+     and of the journal, and write the journal header. */
+  next_block = ((JOURNAL_SECTOR + JOURNAL_BLOCKS + 1 + block_sectors - 1)
+                / block_sectors);
+  memset (&header, 0, sizeof header);
+  header.magic = JOURNAL_MAGIC;
+  header.block_sectors = block_sectors;
+  write_disk ((off_t) JOURNAL_SECTOR * SECTOR_SIZE, &header, sizeof header);
+
+  /* The free map file holds the bitmap, in 32-bit words, and a
+     reference count byte per block, all zero.  Its blocks come
+     first, as when the kernel formats a disk, but it is written
+     last, once everything else is allocated. */
+  map_size = (block_cnt + 31) / 32 * 4 + block_cnt;
+  map_sector = layout (&free_map, 0, map_size);
+
+  /* Copy the files. */
+  sources = calloc (argc - optind - 2 + 1, sizeof *sources);
+  if (sources == NULL)
+    fail ("out of memory");
+  for (i = 0; i < (size_t) (argc - optind - 2); i++)
+    {
+      char *arg = argv[optind + 2 + i];
+      char *colon = strrchr (arg, ':');
+      const char *name;
+
+      sources[i].path = arg;
+      if (colon != NULL)
+        {
+          *colon = '\0';
+          name = colon + 1;
+        }
+      else
+        name = strrchr (arg, '/') != NULL ? strrchr (arg, '/') + 1 : arg;
+      if (*name == '\0' || strlen (name) > FS_NAME_MAX || strchr (name, '/'))
+        fail ("%s: name \"%s\" is empty or longer than %d characters",
+              arg, name, FS_NAME_MAX);
+      strcpy (sources[i].name, name);
+    }
+  make_dir (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, sources, argc - optind - 2);
+  free (sources);
+
+  /* Write the free map.  Everything allocated lies below
+     NEXT_BLOCK. */
+  map = calloc (map_size, 1);
+  if (map == NULL)
+    fail ("out of memory");
+  for (i = 0; i < next_block; i++)
+    map[i / 32 * 4 + i % 32 / 8] |= 1 << (i % 8);
+  write_data (map_sector, &free_map, 0, map, map_size);
+  write_inode (FREE_MAP_SECTOR, &free_map);
+  free (map);
+
+  if (close (disk_fd) < 0)
+    fail ("%s: close: %s", argv[optind], strerror (errno));
+  return EXIT_SUCCESS;
+}
+
+/* Prints a message formatted as printf() does, and exits. */
+static void
+fail (const char *format, ...)
+{
+  va_list args;
+
+  fprintf (stderr, "%s: ", program_name);
+  va_start (args, format);
+  vfprintf (stderr, format, args);
+  va_end (args);
+  putc ('\n', stderr);
+  exit (EXIT_FAILURE);
+}
+
+/* Prints a usage message and exits with STATUS. */
+static void
+usage (int status)
+{
+  printf ("pintos-mkfs, a utility for creating Pintos file system disks\n"
+          "Usage: %s [OPTION...] DISK MB [FILE...]\n"
+          "Creates DISK, a disk of about MB megabytes, holding a file\n"
+          "system formatted as the kernel's -f does, with each FILE copied\n"
+          "into its root directory.  A FILE that is a directory is copied\n"
+          "along with everything under it.  FILE may be given as\n"
+          "HOSTFILE:NAME to name it NAME in the file system.\n"
+          "Options:\n"
+          "  -b, --block=BYTES Format with BYTES-byte blocks, as -block=BYTES.\n"
+          "  -h, --help        Display this help message.\n",
+          program_name);
+  exit (status);
+}
+
+/* Writes SIZE bytes from BUFFER to the disk at byte offset
+   OFS. */
+static void
+write_disk (off_t ofs, const void *buffer, size_t size)
+{
+  const uint8_t *p = buffer;
+
+  while (size > 0)
+    {
+      ssize_t n = pwrite (disk_fd, p, size, ofs);
+      if (n <= 0)
+        fail ("write: %s", n < 0 ? strerror (errno) : "disk full");
+      p += n;
+      ofs += n;
+      size -= n;
+    }
+}
+
+/* Allocates BLOCKS contiguous blocks and returns the first
+   one's first sector. */
+static uint32_t
+allocate (uint32_t blocks)
+{
+  uint32_t block = next_block;
+
+  if (blocks > block_cnt - next_block)
+    fail ("disk is full");
+  next_block += blocks;
+  return block * block_sectors;
+}
+
+/* Initializes *DI for a file with FLAGS of LENGTH bytes, and
+   allocates its data, which is kept inline if it fits, and its
+   index blocks, which are written.  Returns the first sector of
+   the data, which is contiguous, or 0 if it is inline. */
+static uint32_t
+layout (struct inode_disk *di, uint32_t flags, size_t length)
+{
+  size_t entries = SIZE_BLOCK * block_sectors;
+  size_t blocks, i, j;
+  uint32_t data, *index;
+
+  memset (di, 0, sizeof *di);
+  di->length = length;
+  di->magic = INODE_MAGIC;
+  di->flags = flags;
+  if (length <= INLINE_MAX)
+    {
+      di->flags |= INODE_INLINE;
+      return 0;
+    }
+
+  blocks = (length + SECTOR_SIZE * block_sectors - 1)
+           / (SECTOR_SIZE * block_sectors);
+  if (blocks > IND_BLOCK + 2 * entries + entries * entries)
+    fail ("file of %zu bytes is too large", length);
+  di->sector_cnt = blocks * block_sectors;
+  data = allocate (blocks);
+
+  /* Index blocks follow the data.  The indirect blocks map
+     ENTRIES blocks each, and the doubly indirect block maps that
+     many indirect blocks. */
+  index = malloc (entries * sizeof *index);
+  if (index == NULL)
+    fail ("out of memory");
+  for (i = 0; i < blocks && i < IND_BLOCK; i++)
+    di->sectors[i] = data + i * block_sectors;
+  for (j = IND_BLOCK; j < DIND_BLOCK && i < blocks; j++)
+    {
+      size_t k;
+
+      memset (index, 0, entries * sizeof *index);
+      for (k = 0; k < entries && i < blocks; k++, i++)
+        index[k] = data + i * block_sectors;
+      di->sectors[j] = allocate (1);
+      write_disk ((off_t) di->sectors[j] * SECTOR_SIZE, index,
+                  entries * sizeof *index);
+    }
+  if (i < blocks)
+    {
+      uint32_t *dind = calloc (entries, sizeof *dind);
+      size_t k, l;
+
+      if (dind == NULL)
+        fail ("out of memory");
+      di->sectors[DIND_BLOCK] = allocate (1);
+      for (k = 0; i < blocks; k++)
+        {
+          memset (index, 0, entries * sizeof *index);
+          for (l = 0; l < entries && i < blocks; l++, i++)
+            index[l] = data + i * block_sectors;
+          dind[k] = allocate (1);
+          write_disk ((off_t) dind[k] * SECTOR_SIZE, index,
+                      entries * sizeof *index);
+        }
+      write_disk ((off_t) di->sectors[DIND_BLOCK] * SECTOR_SIZE, dind,
+                  entries * sizeof *dind);
+      free (dind);
+    }
+  free (index);
+  return data;
+}
+
+/* Writes inode DI to SECTOR. */
+static void
+write_inode (uint32_t sector, const struct inode_disk *di)
+{
+  write_disk ((off_t) sector * SECTOR_SIZE, di, sizeof *di);
+}
+
+/* Writes LENGTH bytes of data at BUFFER for inode DI, laid out
+   by layout() with its data at SECTOR, at byte offset OFS of
+   its data, inline or there. */
+static void
+write_data (uint32_t sector, struct inode_disk *di, size_t ofs,
+            const void *buffer, size_t length)
+{
+  if (sector == 0)
+    memcpy (di->inline_data + ofs, buffer, length);
+  else
+    write_disk ((off_t) sector * SECTOR_SIZE + ofs, buffer, length);
+}
+
+/* Makes a directory with its inode at SECTOR, in the directory
+   whose inode is at PARENT, holding copies of the CNT files in
+   SOURCES.  One whose entries fit in a block is that block, up
+   to the end of its entries, and a larger one is a hashed
+   directory with buckets about half full, as
+   filesys/directory.c makes them. */
+static void
+make_dir (uint32_t sector, uint32_t parent, struct source *sources,
+          size_t cnt)
+{
+  size_t entry_cnt = cnt + 2;
+  size_t room = sizeof ((struct dir_block *) 0)->data;
+  struct inode_disk di;
+  struct dir_block *blocks;
+  size_t bucket_cnt = 0;
+  size_t length, total, i;
+  uint32_t data;
+
+  /* Pick the layout, and the number of buckets in which no
+     bucket overflows. */
+  total = ENTRY_SIZE (".") + ENTRY_SIZE ("..");
+  for (i = 0; i < cnt; i++)
+    total += ENTRY_SIZE (sources[i].name);
+  if (total <= room)
+    length = offsetof (struct dir_block, data) + total;
+  else
+    {
+      bucket_cnt = (2 * total + room - 1) / room;
+      for (; bucket_cnt <= BUCKET_MAX; bucket_cnt *= 2)
+        {
+          size_t *fill = calloc (bucket_cnt, sizeof *fill);
+
+          if (fill == NULL)
+            fail ("out of memory");
+          fill[hash_string (".") % bucket_cnt] += ENTRY_SIZE (".");
+          fill[hash_string ("..") % bucket_cnt] += ENTRY_SIZE ("..");
+          for (i = 0; i < cnt; i++)
+            fill[hash_string (sources[i].name) % bucket_cnt]
+              += ENTRY_SIZE (sources[i].name);
+          for (i = 0; i < bucket_cnt && fill[i] <= room; i++)
+            continue;
+          free (fill);
+          if (i == bucket_cnt)
+            break;
+        }
+      if (bucket_cnt > BUCKET_MAX)
+        fail ("directory of %zu entries is too large", cnt);
+      length = (bucket_cnt + 1) * SECTOR_SIZE;
+    }
+  blocks = calloc (bucket_cnt + 1, sizeof *blocks);
+  if (blocks == NULL)
+    fail ("out of memory");
+
+  /* The directory's data comes right after its inode, and its
+     files after that. */
+  data = layout (&di, INODE_DIR, length);
+
+  /* Fill in the entries, copying each file. */
+  for (i = 0; i < entry_cnt; i++)
+    {
+      struct dir_entry e;
+      struct dir_block *b;
+      const char *name;
+
+      e.in_use = 1;
+      if (i < 2)
+        {
+          name = i == 0 ? "." : "..";
+          e.inode_sector = i == 0 ? sector : parent;
+        }
+      else
+        {
+          struct source *s = &sources[i - 2];
+          struct stat st;
+
+          name = s->name;
+          e.inode_sector = allocate (1);
+          if (stat (s->path, &st) < 0)
+            fail ("%s: stat: %s", s->path, strerror (errno));
+          if (S_ISDIR (st.st_mode))
+            {
+              /* Copy the directory's entries, skipping the
+                 hidden ones, "." and ".." among them. */
+              struct source *subs = NULL;
+              size_t sub_cnt = 0;
+              struct dirent *de;
+              DIR *dir = opendir (s->path);
+
+              if (dir == NULL)
+                fail ("%s: opendir: %s", s->path, strerror (errno));
+              while ((de = readdir (dir)) != NULL)
+                {
+                  struct source *sub;
+
+                  if (de->d_name[0] == '.')
+                    continue;
+                  if (strlen (de->d_name) > FS_NAME_MAX)
+                    fail ("%s/%s: name longer than %d characters",
+                          s->path, de->d_name, FS_NAME_MAX);
+                  subs = realloc (subs, (sub_cnt + 1) * sizeof *subs);
+                  if (subs == NULL)
+                    fail ("out of memory");
+                  sub = &subs[sub_cnt++];
+                  sub->path = malloc (strlen (s->path)
+                                      + strlen (de->d_name) + 2);
+                  if (sub->path == NULL)
+                    fail ("out of memory");
+                  sprintf (sub->path, "%s/%s", s->path, de->d_name);
+                  strcpy (sub->name, de->d_name);
+                }
+              closedir (dir);
+              make_dir (e.inode_sector, sector, subs, sub_cnt);
+              while (sub_cnt-- > 0)
+                free (subs[sub_cnt].path);
+              free (subs);
+            }
+          else
+            make_file (e.inode_sector, s->path);
+        }
+
+      /* Append the entry to the single block, or to the block of
+         its bucket. */
+      b = &blocks[bucket_cnt == 0 ? 0 : hash_string (name) % bucket_cnt + 1];
+      e.name_len = strlen (name);
+      memcpy (b->data + b->used, &e, sizeof e);
+      memcpy (b->data + b->used + sizeof e, name, e.name_len);
+      b->used += ENTRY_SIZE (name);
+    }
+
+  /* A hashed directory's header takes the first block. */
+  if (bucket_cnt != 0)
+    {
+      uint32_t h[2] = { DIR_HASH_MAGIC, bucket_cnt };
+      memcpy (&blocks[0], h, sizeof h);
+    }
+  write_data (data, &di, 0, blocks, length);
+  write_inode (sector, &di);
+  free (blocks);
+}
+
+/* Copies the host file at PATH into a new file with its inode at
+   SECTOR. */
+static void
+make_file (uint32_t sector, const char *path)
+{
+  struct inode_disk di;
+  struct stat st;
+  uint8_t *buffer;
+  size_t ofs;
+  uint32_t data;
+  int fd;
+
+  fd = open (path, O_RDONLY);
+  if (fd < 0 || fstat (fd, &st) < 0)
+    fail ("%s: open: %s", path, strerror (errno));
+  if (!S_ISREG (st.st_mode) || st.st_size > INT32_MAX)
+    fail ("%s: not a regular file of under 2 GB", path);
+  data = layout (&di, 0, st.st_size);
+
+  /* Copy, a buffer at a time. */
+  buffer = malloc (1 << 16);
+  if (buffer == NULL)
+    fail ("out of memory");
+  for (ofs = 0; ofs < (size_t) st.st_size; )
+    {
+      ssize_t n = read (fd, buffer, 1 << 16);
+      if (n <= 0)
+        fail ("%s: read: %s", path, n < 0 ? strerror (errno) : "file shrank");
+      if (ofs + n > (size_t) st.st_size)
+        n = st.st_size - ofs;
+      write_data (data, &di, ofs, buffer, n);
+      ofs += n;
+    }
+  free (buffer);
+  close (fd);
+  write_inode (sector, &di);
+}
+
+/* Returns the hash of string S that lib/kernel/hash.c's
+   hash_string() returns, a 32-bit MurmurHash3. */
+static uint32_t
+hash_string (const char *s)
+{
+  const uint32_t c1 = 0xcc9e2d51u, c2 = 0x1b873593u;
+  size_t size = strlen (s);
+  uint32_t hash = 0;
+  uint32_t k;
+  size_t i;
+
+#define ROTL(X, N) (((X) << (N)) | ((X) >> (32 - (N))))
+  for (i = 0; i + 4 <= size; i += 4)
+    {
+      memcpy (&k, s + i, 4);
+      k = ROTL (k * c1, 15) * c2;
+      hash = ROTL (hash ^ k, 13) * 5 + 0xe6546b64u;
+    }
+  k = 0;
+  switch (size & 3)
+    {
+    case 3:
+      k ^= (uint8_t) s[i + 2] << 16;
+      /* Fall through. */
+    case 2:
+      k ^= (uint8_t) s[i + 1] << 8;
+      /* Fall through. */
+    case 1:
+      k ^= (uint8_t) s[i];
+      hash ^= ROTL (k * c1, 15) * c2;
+    }
+#undef ROTL
+
+  hash ^= size;
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
@@ -0,0 +1,399 @@
+#include "vm/checkpoint.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#include "vm/page.h"
+
+/* Process checkpoints.
+
+   checkpoint_save() writes the state of the current process to
+   a new file, its image, and exec() of the image starts a copy
+   of the process where it left off instead of loading an
+   executable.  The image holds a header, a record for each page
+   of user memory and for each descriptor slot, and then the
+   contents of the pages that have any, one after another from
+   the first page boundary after the records.
+
+   Restoring reads only the records.  Each page with contents
+   becomes a file page of the image, read in on first access like
+   a page of an executable, so a large process runs again at
+   once and brings back only what it touches; the image is kept
+   from being written meanwhile.  Pages never touched before the
+   checkpoint come back as zero pages.
+
+   Only what the kernel can find again is saved: the general
+   registers, the heap bounds, the working directory, and
+   descriptors of files and directories, which are opened again
+   by inode number at their saved positions and so must not have
+   been removed.  Each inode number is saved with the inode's
+   creation generation, and restoring fails if the inode found
+   then does not match it, as when the file was removed and its
+   sector reused.  Descriptors of pipes come back closed.  A
+   process with other threads or with memory mappings cannot be
+   saved. */
+
+/* "CKPT" in little-endian. */
+#define CHECKPOINT_MAGIC 0x54504b43
+
+/* Header at the start of an image. */
+struct checkpoint_header
+  {
+    uint32_t magic;             /* CHECKPOINT_MAGIC. */
+    uint32_t page_cnt;          /* Number of page records. */
+    uint32_t fd_cnt;            /* Number of descriptor records. */
+    disk_sector_t cwd;          /* Working directory, or 0 for the
+                                   root directory. */
+    uint32_t cwd_gen;           /* Its creation generation. */
+    uint32_t heap_start;        /* Start of the heap. */
+    uint32_t brk;               /* Program break. */
+    uint32_t edi, esi, ebp, ebx, edx, ecx;  /* Saved registers. */
+    uint32_t eip, esp;          /* Where the process resumes. */
+  };
+
+/* Page record flags. */
+#define CHECKPOINT_DATA 1       /* Has contents in the image. */
+#define CHECKPOINT_WRITABLE 2   /* Writable by the process. */
+
+/* Record of one page of user memory. */
+struct checkpoint_page
+  {
+    uint32_t upage;             /* User virtual page. */
+    uint32_t flags;             /* CHECKPOINT_* flags. */
+  };
+
+/* Record of one descriptor slot, from FD_MIN up. */
+struct checkpoint_fd
+  {
+    disk_sector_t inumber;      /* File or directory, or 0 if the
+                                   slot is closed. */
+    uint32_t create_gen;        /* Its creation generation. */
+    bool is_dir;                /* Is it a directory? */
+    off_t pos;                  /* File position. */
+    int flags;                  /* Descriptor flags. */
+  };
+
+/* Most records of each kind an image may hold. */
+#define CHECKPOINT_RECORDS_MAX ((uintptr_t) PHYS_BASE / PGSIZE)
+
+static bool save_pages (struct checkpoint_page **, uint32_t *cnt);
+static bool save_fds (struct process *, struct checkpoint_fd **,
+                      uint32_t *cnt);
+static bool restore_fds (struct process *, const struct checkpoint_fd *,
+                         uint32_t cnt);
+static off_t data_start (const struct checkpoint_header *);
+
+/* Saves the current process, as of the system call that
+   interrupted it in F, to a new file named FILE_NAME.  Returns
+   true if successful, false if the file cannot be created or
+   written or the process cannot be saved, in which case no file
+   is left behind. */
+bool
+checkpoint_save (const char *file_name, const struct intr_frame *f)
+{
+  struct process *proc = process_current ();
+  struct checkpoint_header h;
+  struct checkpoint_page *pages = NULL;
+  struct checkpoint_fd *fds = NULL;
+  struct file *file = NULL;
+  uint8_t *kpage = NULL;
+  bool success = false;
+  off_t ofs;
+  size_t i;
+
+  if (proc->thread_cnt != 0 || !rb_empty (&proc->mmap_ids))
+    return false;
+
+  /* Gather the records. */
+  memset (&h, 0, sizeof h);
+  h.magic = CHECKPOINT_MAGIC;
+  if (proc->cwd != NULL)
+    {
+      h.cwd = inode_get_inumber (dir_get_inode (proc->cwd));
+      h.cwd_gen = inode_create_gen (dir_get_inode (proc->cwd));
+    }
+  h.heap_start = (uint32_t) proc->heap_start;
+  h.brk = (uint32_t) proc->brk;
+  h.edi = f->edi;
+  h.esi = f->esi;
+  h.ebp = f->ebp;
+  h.ebx = f->ebx;
+  h.edx = f->edx;
+  h.ecx = f->ecx;
+  h.eip = (uint32_t) f->eip;
+  h.esp = (uint32_t) f->esp;
+  if (!save_pages (&pages, &h.page_cnt) || !save_fds (proc, &fds, &h.fd_cnt))
+    goto done;
+
+  /* Create the image and write the records. */
+  kpage = palloc_get_page (0);
+  if (kpage == NULL || !filesys_create (file_name, 0))
+    goto done;
+  file = filesys_open (file_name);
+  if (file == NULL
+      || file_write_at (file, &h, sizeof h, 0) != sizeof h
+      || (file_write_at (file, pages, h.page_cnt * sizeof *pages, sizeof h)
+          != (off_t) (h.page_cnt * sizeof *pages))
+      || (file_write_at (file, fds, h.fd_cnt * sizeof *fds,
+                         sizeof h + h.page_cnt * sizeof *pages)
+          != (off_t) (h.fd_cnt * sizeof *fds)))
+    goto done;
+
+  /* Write the contents of the pages, faulting them in. */
+  ofs = data_start (&h);
+  for (i = 0; i < h.page_cnt; i++)
+    if (pages[i].flags & CHECKPOINT_DATA)
+      {
+        if (!copy_from_user (kpage, (void *) pages[i].upage, PGSIZE)
+            || file_write_at (file, kpage, PGSIZE, ofs) != PGSIZE)
+          goto done;
+        ofs += PGSIZE;
+      }
+  success = true;
+
+ done:
+  file_close (file);
+  if (!success && file != NULL)
+    filesys_remove (file_name);
+  palloc_free_page (kpage);
+  free (pages);
+  free (fds);
+  return success;
+}
+
+/* Returns true if FILE is a checkpoint image. */
+bool
+checkpoint_is_image (struct file *file)
+{
+  uint32_t magic;
+
+  return (file_read_at (file, &magic, sizeof magic, 0) == sizeof magic
+          && magic == CHECKPOINT_MAGIC);
+}
+
+/* Restores the process saved in the image FILE into the current
+   process, whose address space must be empty, and sets up IF_ to
+   resume it with 1 as the result of its checkpoint() call.  The
+   restored pages refer to FILE, which the process must keep open
+   and unwritable while it runs.  Returns true if successful,
+   false if the image is corrupt or memory is short. */
+bool
+checkpoint_restore (struct file *file, struct intr_frame *if_)
+{
+  struct process *proc = process_current ();
+  struct checkpoint_header h;
+  struct checkpoint_page *pages = NULL;
+  struct checkpoint_fd *fds = NULL;
+  struct dir *cwd = NULL;
+  bool success = false;
+  size_t data_cnt;
+  off_t ofs;
+  size_t i;
+
+  /* Read the records. */
+  if (file_read_at (file, &h, sizeof h, 0) != sizeof h
+      || h.magic != CHECKPOINT_MAGIC
+      || h.page_cnt > CHECKPOINT_RECORDS_MAX
+      || h.fd_cnt > CHECKPOINT_RECORDS_MAX
+      || h.heap_start > h.brk
+      || h.brk > (uint32_t) STACK_LIMIT)
+    return false;
+  pages = malloc (h.page_cnt * sizeof *pages + 1);
+  fds = malloc (h.fd_cnt * sizeof *fds + 1);
+  if (pages == NULL || fds == NULL
+      || (file_read_at (file, pages, h.page_cnt * sizeof *pages, sizeof h)
+          != (off_t) (h.page_cnt * sizeof *pages))
+      || (file_read_at (file, fds, h.fd_cnt * sizeof *fds,
+                        sizeof h + h.page_cnt * sizeof *pages)
+          != (off_t) (h.fd_cnt * sizeof *fds)))
+    goto done;
+
+  /* The image must hold the contents of the pages. */
+  data_cnt = 0;
+  for (i = 0; i < h.page_cnt; i++)
+    if (pages[i].flags & CHECKPOINT_DATA)
+      data_cnt++;
+  if ((size_t) file_length (file) / PGSIZE
+      < (size_t) data_start (&h) / PGSIZE + data_cnt)
+    goto done;
+
+  /* Map the pages to the image. */
+  ofs = data_start (&h);
+  for (i = 0; i < h.page_cnt; i++)
+    {
+      void *upage = (void *) pages[i].upage;
+
+      if (pg_ofs (upage) != 0 || !is_user_vaddr (upage))
+        goto done;
+      if (pages[i].flags & CHECKPOINT_DATA)
+        {
+          if (!suppl_pt_set_file (upage, file, ofs, PGSIZE, 0,
+                                  pages[i].flags & CHECKPOINT_WRITABLE,
+                                  false))
+            goto done;
+          ofs += PGSIZE;
+        }
+      else if (!suppl_pt_set_zero (upage))
+        goto done;
+    }
+
+  /* Reopen the descriptors and the working directory. */
+  if (!restore_fds (proc, fds, h.fd_cnt))
+    goto done;
+  if (h.cwd != 0)
+    {
+      cwd = dir_open (inode_open_checked (h.cwd, h.cwd_gen, true));
+      if (cwd == NULL)
+        goto done;
+    }
+  process_set_cwd (cwd);
+
+  proc->heap_start = (void *) h.heap_start;
+  proc->brk = (void *) h.brk;
+  proc->startup_end = 0;
+  if_->edi = h.edi;
+  if_->esi = h.esi;
+  if_->ebp = h.ebp;
+  if_->ebx = h.ebx;
+  if_->edx = h.edx;
+  if_->ecx = h.ecx;
+  if_->eax = 1;
+  if_->eip = (void (*) (void)) h.eip;
+  if_->esp = (void *) h.esp;
+  success = true;
+
+ done:
+  free (pages);
+  free (fds);
+  return success;
+}
+
+/* Stores in *PAGES a new array of records of the current
+   process's pages, in address order, and their number in *CNT.
+   Returns true if successful, false if memory is short. */
+static bool
+save_pages (struct checkpoint_page **pages, uint32_t *cnt)
+{
+  struct suppl_pt *pt = thread_current ()->suppl_pt;
+  bool locked = suppl_pt_lock ();
+  struct suppl_pte *pte;
+  size_t size = 0;
+
+  *pages = NULL;
+  *cnt = 0;
+  for (pte = suppl_pt_next (pt, NULL, PHYS_BASE); pte != NULL;
+       pte = suppl_pt_next (pt, (uint8_t *) pte->upage + PGSIZE, PHYS_BASE))
+    {
+      struct checkpoint_page *p;
+
+      if (*cnt == size)
+        {
+          size_t new_size = size > 0 ? size * 2 : 64;
+          p = realloc (*pages, new_size * sizeof *p);
+          if (p == NULL)
+            {
+              suppl_pt_unlock (locked);
+              return false;
+            }
+          *pages = p;
+          size = new_size;
+        }
+
+      /* A zero page that was never touched has no contents. */
+      p = *pages + (*cnt)++;
+      p->upage = (uint32_t) pte->upage;
+      p->flags = 0;
+      if (pte->type != PAGE_ZERO || pte->kpage != NULL || pte->share != NULL)
+        p->flags |= CHECKPOINT_DATA;
+      if (pte->type != PAGE_FILE || pte->writable)
+        p->flags |= CHECKPOINT_WRITABLE;
+    }
+  suppl_pt_unlock (locked);
+  return true;
+}
+
+/* Stores in *FDS a new array of records of PROC's descriptor
+   slots and their number in *CNT.  Returns true if successful,
+   false if memory is short or an open file has been removed. */
+static bool
+save_fds (struct process *proc, struct checkpoint_fd **fds, uint32_t *cnt)
+{
+  int i;
+
+  *cnt = proc->fd_cnt;
+  *fds = calloc (proc->fd_cnt + 1, sizeof **fds);
+  if (*fds == NULL)
+    return false;
+  for (i = 0; i < proc->fd_cnt; i++)
+    {
+      struct file *file = proc->fds[i].file;
+      struct inode *inode;
+
+      if (file == NULL)
+        continue;
+      inode = file_get_inode (file);
+      if (inode_is_removed (inode))
+        return false;
+      (*fds)[i].inumber = inode_get_inumber (inode);
+      (*fds)[i].create_gen = inode_create_gen (inode);
+      (*fds)[i].is_dir = inode_is_dir (inode);
+      (*fds)[i].pos = file_tell (file);
+      (*fds)[i].flags = proc->fds[i].flags;
+    }
+  return true;
+}
+
+/* Gives PROC, which has no descriptors, the CNT descriptor slots
+   in FDS.  Returns true if successful, false if a file cannot be
+   opened or is not the one saved. */
+static bool
+restore_fds (struct process *proc, const struct checkpoint_fd *fds,
+             uint32_t cnt)
+{
+  uint32_t i;
+
+  ASSERT (proc->fd_cnt == 0);
+
+  if (cnt == 0)
+    return true;
+  proc->fds = calloc (cnt, sizeof *proc->fds);
+  if (proc->fds == NULL)
+    return false;
+  proc->fd_cnt = cnt;
+  proc->fd_free = 0;
+  for (i = 0; i < cnt; i++)
+    if (fds[i].inumber != 0)
+      {
+        struct inode *inode = inode_open_checked (fds[i].inumber,
+                                                  fds[i].create_gen,
+                                                  fds[i].is_dir);
+        struct file *file = file_open (inode);
+        if (file == NULL)
+          return false;
+        file_seek (file, fds[i].pos);
+        proc->fds[i].file = file;
+        proc->fds[i].flags = fds[i].flags;
+      }
+  return true;
+}
+
+/* Returns the offset in an image with header H of the contents
+   of its first page. */
+static off_t
+data_start (const struct checkpoint_header *h)
+{
+  return ROUND_UP (sizeof *h + h->page_cnt * sizeof (struct checkpoint_page)
+                   + h->fd_cnt * sizeof (struct checkpoint_fd), PGSIZE);
+}
@@ -0,0 +1,13 @@
+#ifndef VM_CHECKPOINT_H
+#define VM_CHECKPOINT_H
+
+#include <stdbool.h>
+
+struct file;
+struct intr_frame;
+
+bool checkpoint_save (const char *file_name, const struct intr_frame *);
+bool checkpoint_is_image (struct file *);
+bool checkpoint_restore (struct file *, struct intr_frame *);
+
+#endif /* vm/checkpoint.h */
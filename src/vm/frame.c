@@ -7,44 +7,197 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <list.h>
+#include <round.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/perf.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#ifdef FILESYS
+#include "filesys/cache.h"
+#endif
 #include "vm/swap.h"
 
-/* Frame table lock. */
+#define THREAD_PAGEOUT "pageout"
+#define THREAD_MERGE "merge"
+#define THREAD_AGE "age"
+
+/* Frames the merger scans with the frame table lock held, and
+   times it wakes up each second. */
+#define MERGE_BATCH 32
+#define MERGE_WAKEUPS 10
+
+/* How the contents of an eviction victim are kept. */
+enum frame_evict_action
+  {
+    EVICT_DROP,         /* Clean, so simply dropped. */
+    EVICT_FILE,         /* Written back to its memory mapped file. */
+    EVICT_SWAP          /* Written to the swap disk. */
+  };
+
+/* Frame table lock.
+   Not held across eviction write-outs. */
 static struct lock frame_table_lock;
 
-/* Frame table. */
+/* Signaled when a frame's write-out ends. */
+static struct condition frame_transit_done;
+
+/* Frame table: frames in use, in replacement order. */
 static struct list frame_table;
 
+/* Share table: shared pages by file page. */
+static struct hash frame_shares;
+
+/* Cache of shared pages. */
+static struct slab_cache *share_cache;
+
+/* Merge table: frames holding anonymous pages that the merger
+   saw unchanged on two scans in a row, by checksum. */
+static struct hash frame_merges;
+
+/* Index in FRAMES of the next frame the merger scans. */
+static size_t merge_pos;
+
+/* Frame descriptors, one per user pool page, so that a kernel
+   page's frame is found by indexing. */
+static struct frame *frames;
+static uint8_t *frames_base;
+static size_t frames_cnt;
+
+/* Free user page watermarks.  The page-out daemon is woken when
+   fewer than FRAMES_LOW pages are free and then evicts pages
+   until FRAMES_HIGH are free. */
+static size_t frames_low;
+static size_t frames_high;
+
+/* Resident set limits of each process in pages, or 0 for none. */
+size_t frame_rss_soft = 0;
+size_t frame_rss_hard = 0;
+
+/* Frames scanned each second for identical pages, or 0. */
+size_t frame_merge_rate = 0;
+
+/* Upped to wake the page-out daemon, which is started the first
+   time memory runs low once the swap disk is ready. */
+static struct semaphore pageout_sema;
+static bool pageout_ready;
+static bool pageout_started;
+
 #ifdef VM_CLOCK
-/* Current frame table position. */
-static struct list_elem *frame_table_pos;
+/* Generations of the frames on the frame table, youngest first,
+   each in the order the aging scan last placed its frames.
+   Frames are placed by how many scans ago they were last
+   accessed: in the last one, up to 3, up to 7, or longer. */
+#define GEN_CNT 4
+static struct list frame_gens[GEN_CNT];
+
+/* Ticks between scans of the aging daemon, and frames it scans
+   with the frame table lock held. */
+#define AGE_INTERVAL (TIMER_FREQ / 2)
+#define AGE_BATCH 64
+
+/* Frames the clock goes on looking at for a clean victim after
+   finding an old one that costs a write-out. */
+#define CLEAN_SCAN 16
+
+/* Ticks for which no thread of a process may run before it
+   counts as idle, that is, blocked waiting for a child, a timer
+   or I/O, or starved by others. */
+#define IDLE_TICKS (TIMER_FREQ / 4)
 #endif
 
-static struct frame *frame_evict_and_get (void);
+static struct frame *frame_of (void *kpage);
+static void frame_list (struct frame *);
+static void frame_unlist (struct frame *);
+static struct suppl_pt *frame_owner (struct frame *);
+static bool frame_movable (struct frame *);
+static size_t frame_compact_block (size_t page_cnt);
+static void frame_move (struct frame *, void *kpage);
+static void frame_set_age (struct frame *, uint8_t age);
+static void frame_set_user (struct frame *, struct suppl_pte *,
+                            struct frame_share *);
+static void frame_share_wait (struct frame_share *);
+static void frame_share_release (struct frame_share *);
+static struct frame_share *frame_share_private (struct suppl_pte *);
+static hash_hash_func frame_share_hash;
+static hash_less_func frame_share_less;
+static void frame_merge_daemon (void *aux);
+static void frame_merge_scan (size_t cnt);
+static void frame_merge_one (struct frame *);
+static bool frame_mergeable (struct frame *);
+static bool frame_merge (struct frame *, struct frame *);
+static bool frame_merge_into (struct frame *, struct frame_share *);
+static void frame_merge_forget (struct frame *);
+static hash_hash_func frame_merge_hash;
+static hash_less_func frame_merge_less;
+static void frame_pageout (void *aux);
+static void frame_pageout_wake (void);
+static struct frame *frame_evict_and_get (struct suppl_pt *);
+static size_t frame_evict_batch (size_t cnt);
+static struct frame *frame_to_evict (struct suppl_pt *);
+static enum frame_evict_action frame_evict_begin (struct frame *);
+static bool frame_write_back (struct frame *, enum frame_evict_action);
+static bool frame_swap_out (struct frame **, size_t cnt);
+static bool frame_evict_end (struct frame *, bool success);
 #ifdef VM_CLOCK
-static struct frame *frame_to_evict_clock (void);
+static void frame_age_daemon (void *aux);
+static void frame_age_scan (size_t start, size_t cnt);
+static void frame_age (struct frame *, bool accessed);
+static struct frame *frame_to_evict_clock (struct suppl_pt *);
+static bool frame_accessed (struct frame *);
+static bool frame_is_clean (struct frame *);
+static bool frame_older (struct frame *, struct frame *);
+static bool frame_over_soft (struct suppl_pt *);
+static bool frame_owner_idle (struct suppl_pt *);
+static bool frame_owner_favored (struct suppl_pt *);
 #elif VM_FIFO
-static struct frame *frame_to_evict_fifo (void);
+static struct frame *frame_to_evict_fifo (struct suppl_pt *);
 #endif
 
 /* Initializes the frame table and its lock. */
 void
 frame_table_init (void)
 {
+#ifdef VM_CLOCK
+  size_t i;
+#endif
+
   lock_init (&frame_table_lock);
+  lock_set_name (&frame_table_lock, "frame_table");
+  cond_init (&frame_transit_done);
   list_init (&frame_table);
+  if (!hash_init (&frame_shares, frame_share_hash, frame_share_less, NULL))
+    PANIC ("cannot allocate share table");
+  if (!hash_init (&frame_merges, frame_merge_hash, frame_merge_less, NULL))
+    PANIC ("cannot allocate merge table");
+  share_cache = slab_cache_create ("frame_share", sizeof (struct frame_share),
+                                   NULL);
+  frames_base = palloc_user_base ();
+  frames_cnt = palloc_user_page_cnt ();
+  frames = calloc (frames_cnt, sizeof *frames);
+  if (frames == NULL && frames_cnt > 0)
+    PANIC ("cannot allocate frame table");
+  frames_low = frames_cnt / 64 + 2;
+  frames_high = frames_low * 2;
+  sema_init (&pageout_sema, 0);
 #ifdef VM_CLOCK
-  frame_table_pos = list_tail (&frame_table);
+  for (i = 0; i < GEN_CNT; i++)
+    list_init (&frame_gens[i]);
 #endif
 }
 
 /* Allocates a new user frame with given pte and flags.
    Note that this method is used only for that user frame flag
-   is set. */
+   is set.  With PAL_ZERO, the frame is zeroed: a free page comes
+   zeroed from the idle thread's stock when it can, while an
+   evicted frame is cleared here. */
 struct frame *
 frame_alloc (struct suppl_pte *pte, enum palloc_flags flags)
 {
@@ -53,212 +206,1680 @@ frame_alloc (struct suppl_pte *pte, enum palloc_flags flags)
 
   lock_acquire (&frame_table_lock);
 
-  struct frame *f;
-  void *kpage = palloc_get_page (flags); 
-  if (kpage == NULL)
+  struct frame *f = NULL;
+  void *kpage = NULL;
+
+  /* A process at its hard limit replaces one of its own pages. */
+  if (frame_rss_hard != 0 && pte->pt->rss_cnt >= frame_rss_hard)
+    f = frame_evict_and_get (pte->pt);
+  if (f == NULL)
     {
-      f = frame_evict_and_get ();
-      if (f == NULL)
+      kpage = palloc_get_page (flags);
+#ifdef FILESYS
+      /* Take back pages lent to the buffer cache before evicting. */
+      while (kpage == NULL && buffer_cache_shrink ())
+        kpage = palloc_get_page (flags);
+#endif
+      if (kpage == NULL)
+        f = frame_evict_and_get (NULL);
+      if (kpage == NULL && f == NULL)
         {
           lock_release (&frame_table_lock);
           return NULL;
         }
+    }
+  if (f != NULL)
+    {
       f->suppl_pte = pte;
-
-      list_remove (&f->elem);
+      f->share = NULL;
 
       lock_release (&frame_table_lock);
 
+      if (flags & PAL_ZERO)
+        memset (f->kpage, 0, PGSIZE);
+      frame_pageout_wake ();
       return f;
     }
 
-  f = malloc (sizeof (struct frame));
-  if (f == NULL)
-    {
-      palloc_free_page (kpage);
-      lock_release (&frame_table_lock);
-      return NULL;
-    }
-
+  f = frame_of (kpage);
   f->kpage = kpage;
   f->suppl_pte = pte;
+  f->share = NULL;
+  f->in_table = false;
+  f->in_transit = false;
+  f->pin_cnt = 0;
+  f->age = 0;
 
   lock_release (&frame_table_lock);
 
+  /* Have the daemon make room before the next fault needs it. */
+  if (frame_low ())
+    frame_pageout_wake ();
+
   return f;
 }
 
-/* Appends the frame entry into the frame table. */
+/* Lets the page-out daemon start.  Called once the swap disk is
+   ready. */
 void
-frame_append (struct frame *frame)
+frame_pageout_init (void)
 {
-  list_push_back (&frame_table, &frame->elem);
+  pageout_ready = true;
 }
 
-/* Returns frame associated KPAGE. Returns NULL if failed. */
-static struct frame *
-frame_search (void *kpage)
+/* Wakes the page-out daemon, starting it first if it has not
+   run yet.  Does nothing until the swap disk is ready. */
+static void
+frame_pageout_wake (void)
 {
-  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+  if (!pageout_ready)
+    return;
+  if (!pageout_started)
+    {
+      enum intr_level old_level = intr_disable ();
+      bool start = !pageout_started;
+      pageout_started = true;
+      intr_set_level (old_level);
+      if (start
+          && thread_create (THREAD_PAGEOUT, PRI_MAX, frame_pageout,
+                            NULL) == TID_ERROR)
+        return;
+    }
+  sema_up (&pageout_sema);
+}
 
-  struct frame *f = NULL;
-  struct list_elem *e;
-  for (e = list_begin (&frame_table); e != list_end (&frame_table);
-       e = list_next (e))
+/* Returns true if free user pages are below the low
+   watermark. */
+bool
+frame_low (void)
+{
+  return palloc_user_free_cnt () < frames_low;
+}
+
+/* Thread function of the page-out daemon.  Each time it is
+   woken it frees pages in one run up to the high watermark, so
+   page faults usually find a free frame without evicting and
+   the write-outs of several victims come together. */
+static void
+frame_pageout (void *aux UNUSED)
+{
+  thread_set_class (SCHED_RR, PRI_MAX);
+  for (;;)
     {
-      struct frame *f_ = list_entry (e, struct frame, elem);
-      if (f_->kpage == kpage)
+      sema_down (&pageout_sema);
+      for (;;)
         {
-          f = f_;
-          break;
+          size_t free_cnt = palloc_user_free_cnt ();
+          if (free_cnt >= frames_high)
+            break;
+
+          /* Prefer pages lent to the buffer cache to evictions. */
+#ifdef FILESYS
+          if (buffer_cache_shrink ())
+            continue;
+#endif
+          if (frame_evict_batch (frames_high - free_cnt) == 0)
+            break;
         }
     }
+}
 
-  return f;
+/* Appends the frame entry into the frame table. */
+void
+frame_append (struct frame *frame)
+{
+  lock_acquire (&frame_table_lock);
+  frame_list (frame);
+  lock_release (&frame_table_lock);
 }
 
-/* Frees the given frame at kpage.
-   If such frame exists in the frame table, remove it. */
+/* Waits until the page of PTE is not being written out.  Its
+   owner calls this before loading or dropping the page. */
 void
-frame_free (struct frame *frame)
+frame_wait (struct suppl_pte *pte)
 {
   lock_acquire (&frame_table_lock);
+  while (pte->kpage != NULL && frame_of (pte->kpage)->in_transit)
+    cond_wait (&frame_transit_done, &frame_table_lock);
+  lock_release (&frame_table_lock);
+}
 
-#ifdef VM_CLOCK
-  if (&frame->elem == frame_table_pos)
-    frame_table_pos = list_next (frame_table_pos);
-#endif
-  list_remove (&frame->elem);
-  free (frame);
-  palloc_free_page (frame->kpage);
+/* Pins the frame holding the page of PTE so that it is not
+   evicted.  Returns true if successful, false if the page is
+   not in memory. */
+bool
+frame_pin (struct suppl_pte *pte)
+{
+  bool success = false;
 
+  lock_acquire (&frame_table_lock);
+  while (pte->kpage != NULL && frame_of (pte->kpage)->in_transit)
+    cond_wait (&frame_transit_done, &frame_table_lock);
+  if (pte->kpage != NULL)
+    {
+      frame_of (pte->kpage)->pin_cnt++;
+      success = true;
+    }
   lock_release (&frame_table_lock);
+
+  return success;
 }
 
-/* Removes the frame table entry associated with KPAGE without
-   freeing it. */
+/* Unpins the frame holding the page of PTE, which must have been
+   pinned by frame_pin(). */
 void
-frame_remove (void *kpage)
+frame_unpin (struct suppl_pte *pte)
 {
   lock_acquire (&frame_table_lock);
+  ASSERT (pte->kpage != NULL);
+  ASSERT (frame_of (pte->kpage)->pin_cnt > 0);
+  frame_of (pte->kpage)->pin_cnt--;
+  lock_release (&frame_table_lock);
+}
 
-  struct frame *f = frame_search (kpage);
-  if (f != NULL)
+/* Returns the shared page for the READ_BYTES bytes at offset OFS
+   in FILE, followed by zeros, creating it if needed, and takes a
+   reference to it.  Returns NULL if memory allocation fails. */
+struct frame_share *
+frame_share_get (struct file *file, off_t ofs, uint32_t read_bytes)
+{
+  struct frame_share key;
+  struct frame_share *share;
+  struct hash_elem *e;
+
+  key.inode = file_get_inode (file);
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+
+  lock_acquire (&frame_table_lock);
+  e = hash_find (&frame_shares, &key.elem);
+  if (e != NULL)
+    share = hash_entry (e, struct frame_share, elem);
+  else
     {
-#ifdef VM_CLOCK
-      if (&f->elem == frame_table_pos)
-        frame_table_pos = list_next (frame_table_pos);
-#endif
-      list_remove (&f->elem);
-      free (f);
+      share = slab_alloc (share_cache);
+      if (share == NULL)
+        {
+          lock_release (&frame_table_lock);
+          return NULL;
+        }
+      *share = key;
+      share->kpage = NULL;
+      share->swap_index = BITMAP_ERROR;
+      share->writable = false;
+      list_init (&share->users);
+      share->ref_cnt = 0;
+      hash_insert (&frame_shares, &share->elem);
     }
+  share->ref_cnt++;
+  lock_release (&frame_table_lock);
+
+  return share;
+}
+
+/* Returns a new page of shared memory, zero until first written,
+   with one reference taken.  Returns NULL if memory allocation
+   fails. */
+struct frame_share *
+frame_share_create (void)
+{
+  struct frame_share *share = slab_alloc (share_cache);
+  if (share == NULL)
+    return NULL;
+  share->inode = NULL;
+  share->ofs = 0;
+  share->read_bytes = 0;
+  share->kpage = NULL;
+  share->swap_index = BITMAP_ERROR;
+  share->writable = true;
+  list_init (&share->users);
+  share->ref_cnt = 1;
+  return share;
+}
+
+/* Takes another reference to SHARE. */
+void
+frame_share_ref (struct frame_share *share)
+{
+  lock_acquire (&frame_table_lock);
+  ASSERT (share->ref_cnt > 0);
+  share->ref_cnt++;
+  lock_release (&frame_table_lock);
+}
 
+/* Drops a reference to SHARE.  The last one frees it along with
+   its page. */
+void
+frame_share_put (struct frame_share *share)
+{
+  lock_acquire (&frame_table_lock);
+  ASSERT (share->ref_cnt > 0);
+  share->ref_cnt--;
+  frame_share_release (share);
   lock_release (&frame_table_lock);
 }
 
-static struct frame *
-frame_evict_and_get (void)
+/* Frees SHARE, its page and its swap slot if no entry refers to
+   it any more.  If its page is being written out, that is left
+   to the end of the write-out. */
+static void
+frame_share_release (struct frame_share *share)
 {
   ASSERT (lock_held_by_current_thread (&frame_table_lock));
 
-#ifdef VM_CLOCK
-  struct frame *f = frame_to_evict_clock ();
-#elif VM_FIFO
-  struct frame *f = frame_to_evict_fifo ();
-#endif
-  if (f == NULL)
-    return NULL;
+  if (share->ref_cnt > 0)
+    return;
+  ASSERT (list_empty (&share->users));
+  if (share->kpage != NULL)
+    {
+      struct frame *f = frame_of (share->kpage);
+      if (f->in_transit)
+        return;
+      frame_unlist (f);
+      palloc_free_page (share->kpage);
+    }
+  else if (share->swap_index != BITMAP_ERROR)
+    swap_remove (share->swap_index);
+  if (share->inode != NULL)
+    hash_delete (&frame_shares, &share->elem);
+  slab_free (share_cache, share);
+}
+
+/* Waits until the page of SHARE is not in transit. */
+static void
+frame_share_wait (struct frame_share *share)
+{
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
 
-  ASSERT (f->suppl_pte != NULL);
+  while (share->kpage != NULL && frame_of (share->kpage)->in_transit)
+    cond_wait (&frame_transit_done, &frame_table_lock);
+}
 
-  size_t idx;
-  struct suppl_pte *pte = f->suppl_pte;
-  switch (pte->type)
+/* Maps the shared page of PTE, of the current process, if it is
+   in memory.  Returns true if successful. */
+bool
+frame_share_map (struct suppl_pte *pte)
+{
+  struct frame_share *share = pte->share;
+  bool success = false;
+
+  lock_acquire (&frame_table_lock);
+  frame_share_wait (share);
+  if (share->kpage != NULL
+      && pagedir_set_page (pte->pagedir, pte->upage, share->kpage,
+                           share->writable))
     {
-    case PAGE_FILE:
-      if (!pte->writable)
-        break;
-      if (pte->mmap)
+      pte->kpage = share->kpage;
+      list_push_back (&share->users, &pte->share_elem);
+      success = true;
+    }
+  lock_release (&frame_table_lock);
+
+  return success;
+}
+
+/* Makes frame F, just allocated for PTE and filled with its
+   contents, the page shared by PTE's file page and maps it.  If
+   another process brought that page in meanwhile, F is freed and
+   the existing page is mapped instead.  F goes on the frame
+   table.  Returns true if successful. */
+bool
+frame_share_install (struct frame *f, struct suppl_pte *pte)
+{
+  struct frame_share *share = pte->share;
+  bool success = false;
+
+  lock_acquire (&frame_table_lock);
+  frame_share_wait (share);
+  if (share->kpage != NULL)
+    palloc_free_page (f->kpage);
+  else
+    {
+      share->kpage = f->kpage;
+      f->suppl_pte = NULL;
+      f->share = share;
+      frame_list (f);
+    }
+  if (pagedir_set_page (pte->pagedir, pte->upage, share->kpage,
+                        share->writable))
+    {
+      pte->kpage = share->kpage;
+      list_push_back (&share->users, &pte->share_elem);
+      success = true;
+    }
+  lock_release (&frame_table_lock);
+
+  return success;
+}
+
+/* Unmaps the shared page of PTE, of the current process, without
+   freeing it. */
+void
+frame_share_unmap (struct suppl_pte *pte)
+{
+  lock_acquire (&frame_table_lock);
+  if (pte->kpage != NULL)
+    {
+      pagedir_clear_page (pte->pagedir, pte->upage);
+      list_remove (&pte->share_elem);
+      pte->kpage = NULL;
+    }
+  lock_release (&frame_table_lock);
+}
+
+/* Reads the anonymous shared page of PTE, of the current
+   process, back from swap into frame F, just allocated for it,
+   and maps it.  A shared memory page never swapped out is zeroed
+   instead.  If another process brought the page in meanwhile, F
+   is freed and that page is mapped instead.  The users of the page
+   wait for the read in frame_share_map().  Returns true if
+   successful; on failure F is freed. */
+bool
+frame_share_swap_in (struct frame *f, struct suppl_pte *pte)
+{
+  struct frame_share *share = pte->share;
+  bool success = true;
+
+  ASSERT (share->inode == NULL);
+
+  lock_acquire (&frame_table_lock);
+  frame_share_wait (share);
+  if (share->kpage != NULL)
+    palloc_free_page (f->kpage);
+  else
+    {
+      share->kpage = f->kpage;
+      f->suppl_pte = NULL;
+      f->share = share;
+      f->in_transit = true;
+      lock_release (&frame_table_lock);
+
+      if (share->swap_index != BITMAP_ERROR)
+        success = swap_in (f->kpage, share->swap_index);
+      else
+        memset (f->kpage, 0, PGSIZE);
+
+      lock_acquire (&frame_table_lock);
+      f->in_transit = false;
+      cond_broadcast (&frame_transit_done, &frame_table_lock);
+      if (success)
         {
-          if (!suppl_pt_update_dirty (pte))
-            break;
-          if (mmap_write_back (pte->file, pte->kpage, pte->ofs) == -1)
-            return NULL;
+          share->swap_index = BITMAP_ERROR;
+          frame_list (f);
         }
+      else
+        {
+          share->kpage = NULL;
+          palloc_free_page (f->kpage);
+        }
+    }
+  if (success
+      && pagedir_set_page (pte->pagedir, pte->upage, share->kpage,
+                           share->writable))
+    {
+      pte->kpage = share->kpage;
+      list_push_back (&share->users, &pte->share_elem);
+    }
+  else
+    success = false;
+  lock_release (&frame_table_lock);
 
-    case PAGE_ZERO:
-      if (!suppl_pt_update_dirty (pte))
-        break;
+  return success;
+}
 
-    case PAGE_SWAP:
-      idx = swap_out (f->kpage);
-      if (idx == BITMAP_ERROR)
-        return NULL;
-      pte->type = PAGE_SWAP;
-      pte->swap_index = idx;
-      break;
+/* Gives PTE, of the current process, a page of its own on a write
+   to its copy-on-write page: the page itself if no other entry
+   refers to it, or else a copy.  Returns true if the write may be
+   retried, false if memory ran out. */
+bool
+frame_share_copy (struct suppl_pte *pte)
+{
+  struct frame_share *share = pte->share;
+  struct frame *f;
 
-    /* Unintended type. */
-    default:
-      NOT_REACHED ();
+  ASSERT (share->inode == NULL && !share->writable);
+
+  /* Evicted meanwhile, so the retry faults it in again. */
+  lock_acquire (&frame_table_lock);
+  if (pte->kpage == NULL)
+    {
+      lock_release (&frame_table_lock);
+      return true;
     }
 
-  /* Save dirty bit. */
-  suppl_pt_update_dirty (pte);
+  /* The last user takes the page over. */
+  if (share->ref_cnt == 1)
+    {
+      f = frame_of (pte->kpage);
+      frame_set_user (f, pte, NULL);
+      list_remove (&pte->share_elem);
+      slab_free (share_cache, share);
+      goto remap;
+    }
+  lock_release (&frame_table_lock);
 
-  /* Uninstall frame. */
-  pte->kpage = NULL;
+  f = frame_alloc (pte, PAL_USER);
+  if (f == NULL)
+    return false;
+
+  lock_acquire (&frame_table_lock);
+  if (pte->kpage == NULL)
+    {
+      palloc_free_page (f->kpage);
+      lock_release (&frame_table_lock);
+      return true;
+    }
+  memcpy (f->kpage, pte->kpage, PGSIZE);
+  list_remove (&pte->share_elem);
+  share->ref_cnt--;
+  frame_share_release (share);
+  frame_list (f);
+
+ remap:
   pagedir_clear_page (pte->pagedir, pte->upage);
+  if (!pagedir_set_page (pte->pagedir, pte->upage, f->kpage, true))
+    PANIC ("cannot map a page copied on write");
+  pte->kpage = f->kpage;
+  pte->share = NULL;
+  pte->dirty = true;
+  lock_release (&frame_table_lock);
 
-  return f;
+  return true;
 }
 
-#ifdef VM_CLOCK
-/* Returns the next frame in the frame table as circular list. */
-static struct frame *
-frame_next_circ (void)
+/* Fills in CHILD, an entry of the current process, which is being
+   forked, as a copy of PARENT, the entry of the forking process
+   for the same page.  CHILD's PAGEDIR and PT are kept.  A private
+   page in memory or in swap becomes a copy-on-write page that
+   both share, write-protected in the parent; clean file pages and
+   untouched zero pages are simply loaded again by the child.
+   Returns false if memory allocation fails. */
+bool
+frame_fork (struct suppl_pte *parent, struct suppl_pte *child)
+{
+  uint32_t *pagedir = child->pagedir;
+  struct suppl_pt *pt = child->pt;
+  struct frame_share *share;
+
+  lock_acquire (&frame_table_lock);
+  while (parent->kpage != NULL && frame_of (parent->kpage)->in_transit)
+    cond_wait (&frame_transit_done, &frame_table_lock);
+
+  *child = *parent;
+  child->pagedir = pagedir;
+  child->pt = pt;
+  child->kpage = NULL;
+  child->zero_mapped = false;
+
+  share = parent->share;
+  if (share == NULL
+      && (parent->type == PAGE_SWAP
+          || (parent->kpage != NULL
+              && (parent->type == PAGE_ZERO
+                  || suppl_pt_update_dirty (parent)))))
+    {
+      share = frame_share_private (parent);
+      if (share == NULL)
+        {
+          lock_release (&frame_table_lock);
+          return false;
+        }
+      child->type = PAGE_ZERO;
+      child->share = share;
+    }
+  if (share != NULL)
+    share->ref_cnt++;
+  lock_release (&frame_table_lock);
+
+  return true;
+}
+
+/* Makes the private page of PTE, in memory or in swap, a
+   copy-on-write page with PTE its only user, write-protected if
+   it is in memory, and returns it.  Returns NULL if memory
+   allocation fails. */
+static struct frame_share *
+frame_share_private (struct suppl_pte *pte)
 {
-  ASSERT (!list_empty (&frame_table));
+  struct frame_share *share;
+
   ASSERT (lock_held_by_current_thread (&frame_table_lock));
+  ASSERT (pte->share == NULL);
 
-  struct list_elem *next;
-  if (frame_table_pos == list_back (&frame_table)
-      || frame_table_pos == list_tail (&frame_table))
-    next = list_front (&frame_table);
+  share = slab_alloc (share_cache);
+  if (share == NULL)
+    return NULL;
+  share->inode = NULL;
+  share->ofs = 0;
+  share->read_bytes = 0;
+  share->kpage = pte->kpage;
+  share->swap_index = BITMAP_ERROR;
+  share->writable = false;
+  list_init (&share->users);
+  share->ref_cnt = 1;
+  if (pte->kpage != NULL)
+    {
+      frame_set_user (frame_of (pte->kpage), NULL, share);
+
+      /* Shares keep no swap slot while in memory. */
+      if (pte->type == PAGE_SWAP && pte->swap_index != BITMAP_ERROR)
+        swap_remove (pte->swap_index);
+      pagedir_clear_page (pte->pagedir, pte->upage);
+      if (!pagedir_set_page (pte->pagedir, pte->upage, pte->kpage, false))
+        PANIC ("cannot write-protect a shared page");
+      list_push_back (&share->users, &pte->share_elem);
+    }
   else
-    next = list_next (frame_table_pos);
-  frame_table_pos = next;
-  return list_entry (next, struct frame, elem);
+    share->swap_index = pte->swap_index;
+  pte->type = PAGE_ZERO;
+  pte->share = share;
+  return share;
 }
 
-/* Returns the frame to be evicted.
+/* Fills in ST with the memory use of PT. */
+void
+frame_memstat (struct suppl_pt *pt, struct memstat *st)
+{
+  lock_acquire (&frame_table_lock);
+  st->resident = pt->rss_cnt;
+  st->working_set = pt->ws_cnt;
+  lock_release (&frame_table_lock);
+  st->soft_limit = frame_rss_soft;
+  st->hard_limit = frame_rss_hard;
+}
 
-   This implements the clock algorithm. */
-static struct frame *
-frame_to_evict_clock (void)
+/* Starts the aging daemon, which keeps the generations that
+   eviction picks victims from. */
+void
+frame_age_init (void)
 {
-  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+#ifdef VM_CLOCK
+  thread_create (THREAD_AGE, PRI_DEFAULT, frame_age_daemon, NULL);
+#endif
+}
 
-  struct frame *f;
-  for (f = frame_next_circ ();
-       pagedir_is_accessed (f->suppl_pte->pagedir, f->suppl_pte->upage);
-       f = frame_next_circ ())
-    pagedir_set_accessed (f->suppl_pte->pagedir, f->suppl_pte->upage, false);
-  return f;
+/* Starts the merger, unless frame_merge_rate is 0. */
+void
+frame_merge_init (void)
+{
+  if (frame_merge_rate != 0)
+    thread_create (THREAD_MERGE, PRI_MIN, frame_merge_daemon, NULL);
 }
-#elif VM_FIFO
-/* Returns the frame to be evicted.
 
-   This implements the FIFO algorithm. You can use this instead of
-   the clock algorithm by giving VM_FIFO option to the compiler. */
-static struct frame *
-frame_to_evict_fifo (void)
+/* Thread function of the merger, which finds frames holding the
+   same anonymous page, such as the zeroed buffers or the same
+   computed data of several processes running one program, and
+   keeps the page once as a copy-on-write page.  It runs in the
+   SCHED_IDLE class, so that it uses only time nobody else wants,
+   but scans each batch at normal priority, since page faults
+   wait for the frame table lock it holds meanwhile. */
+static void
+frame_merge_daemon (void *aux UNUSED)
 {
-  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+  thread_set_class (SCHED_IDLE, PRI_MIN);
+  for (;;)
+    {
+      size_t cnt = DIV_ROUND_UP (frame_merge_rate, MERGE_WAKEUPS);
+      while (cnt > 0)
+        {
+          size_t n = cnt < MERGE_BATCH ? cnt : MERGE_BATCH;
+          thread_set_class (SCHED_NORMAL, PRI_DEFAULT);
+          frame_merge_scan (n);
+          thread_set_class (SCHED_IDLE, PRI_MIN);
+          cnt -= n;
+        }
+      timer_sleep (TIMER_FREQ / MERGE_WAKEUPS);
+    }
+}
 
-  struct frame *f = list_entry (list_begin (&frame_table), struct frame, elem);
-  list_remove (&f->elem);
-  list_push_back (&frame_table, &f->elem);
-  return f;
+/* Scans the next CNT frames in the user pool, going round, and
+   merges the pages in them with identical ones. */
+static void
+frame_merge_scan (size_t cnt)
+{
+  lock_acquire (&frame_table_lock);
+  for (; cnt > 0 && frames_cnt > 0; cnt--)
+    {
+      struct frame *f = frames + merge_pos;
+      merge_pos = (merge_pos + 1) % frames_cnt;
+      if (frame_mergeable (f))
+        frame_merge_one (f);
+    }
+  lock_release (&frame_table_lock);
+}
+
+/* Merges the page in frame F with an identical page in the merge
+   table, or else files F there.  A private page is filed only
+   once it is the same on two scans in a row, since one being
+   written is not worth sharing; a copy-on-write page cannot
+   change. */
+static void
+frame_merge_one (struct frame *f)
+{
+  unsigned checksum = hash_bytes (f->kpage, PGSIZE);
+  struct hash_elem *e;
+  struct frame *g;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  if (checksum != f->checksum)
+    {
+      frame_merge_forget (f);
+      f->checksum = checksum;
+      if (f->share == NULL)
+        return;
+    }
+  if (f->merge_listed)
+    return;
+
+  e = hash_insert (&frame_merges, &f->merge_elem);
+  if (e == NULL)
+    {
+      f->merge_listed = true;
+      return;
+    }
+
+  /* A pinned page is passed over for now. */
+  g = hash_entry (e, struct frame, merge_elem);
+  if (!frame_mergeable (g))
+    {
+      hash_replace (&frame_merges, &f->merge_elem);
+      g->merge_listed = false;
+      f->merge_listed = true;
+      return;
+    }
+
+  if (frame_merge (f, g))
+    perf_inc (PERF_PAGE_MERGE);
+
+  /* F survives if it kept G's page. */
+  if (f->in_table && !f->merge_listed)
+    f->merge_listed = hash_insert (&frame_merges, &f->merge_elem) == NULL;
+}
+
+/* Returns true if frame F holds an anonymous page, private or
+   copy-on-write, that may be merged now: on the frame table, not
+   being written out and not pinned, since the kernel writes a
+   pinned page. */
+static bool
+frame_mergeable (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  if (!f->in_table || f->in_transit || f->pin_cnt > 0)
+    return false;
+  if (f->share != NULL)
+    return f->share->inode == NULL && !f->share->writable;
+  return f->suppl_pte->type == PAGE_ZERO || f->suppl_pte->type == PAGE_SWAP;
+}
+
+/* Keeps the page in frames A and B once if the two are
+   identical, by making a private page of either a user of the
+   other's copy-on-write page, which the other first becomes if
+   it is private too.  Two copy-on-write pages stay apart.
+   Returns true if a frame was freed.
+
+   A process's faults change its entries without the frame table
+   lock, so the lock of each process whose entry changes is held
+   meanwhile.  It is taken in the wrong order here, so a busy one
+   is not waited for. */
+static bool
+frame_merge (struct frame *a, struct frame *b)
+{
+  struct suppl_pt *pa = frame_owner (a);
+  struct suppl_pt *pb = frame_owner (b);
+  struct frame_share *share;
+  bool merged = false;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  if ((pa == NULL && pb == NULL)
+      || memcmp (a->kpage, b->kpage, PGSIZE) != 0)
+    return false;
+  if (pa != NULL && !lock_try_acquire (&pa->lock))
+    return false;
+  if (pb != NULL && pb != pa && !lock_try_acquire (&pb->lock))
+    {
+      if (pa != NULL)
+        lock_release (&pa->lock);
+      return false;
+    }
+
+  if (pa == NULL)
+    merged = frame_merge_into (b, a->share);
+  else
+    {
+      share = pb != NULL ? frame_share_private (b->suppl_pte) : b->share;
+      if (share != NULL)
+        merged = frame_merge_into (a, share);
+    }
+
+  if (pb != NULL && pb != pa)
+    lock_release (&pb->lock);
+  if (pa != NULL)
+    lock_release (&pa->lock);
+  return merged;
+}
+
+/* Makes the private page in frame P a user of SHARE, which is in
+   memory with the same contents, and frees P.  P's owner may
+   have written the page since it was compared, so it is unmapped
+   and compared again first, and mapped back if it differs now.
+   Returns true if successful. */
+static bool
+frame_merge_into (struct frame *p, struct frame_share *share)
+{
+  struct suppl_pte *pte = p->suppl_pte;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+  ASSERT (share->kpage != NULL);
+
+  suppl_pt_update_dirty (pte);
+  pagedir_clear_page (pte->pagedir, pte->upage);
+  if (memcmp (p->kpage, share->kpage, PGSIZE) != 0)
+    {
+      if (!pagedir_set_page (pte->pagedir, pte->upage, p->kpage, true))
+        PANIC ("cannot map a page back after a failed merge");
+      return false;
+    }
+
+  if (pte->type == PAGE_SWAP && pte->swap_index != BITMAP_ERROR)
+    swap_remove (pte->swap_index);
+  if (!pagedir_set_page (pte->pagedir, pte->upage, share->kpage, false))
+    PANIC ("cannot map a merged page");
+  pte->type = PAGE_ZERO;
+  pte->kpage = share->kpage;
+  pte->share = share;
+  share->ref_cnt++;
+  list_push_back (&share->users, &pte->share_elem);
+  frame_unlist (p);
+  palloc_free_page (p->kpage);
+  return true;
+}
+
+/* Takes frame F out of the merge table if it is there. */
+static void
+frame_merge_forget (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  if (f->merge_listed)
+    {
+      hash_delete (&frame_merges, &f->merge_elem);
+      f->merge_listed = false;
+    }
+}
+
+static unsigned
+frame_merge_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_entry (e, struct frame, merge_elem)->checksum;
+}
+
+static bool
+frame_merge_less (const struct hash_elem *e1, const struct hash_elem *e2,
+                  void *aux UNUSED)
+{
+  return (hash_entry (e1, struct frame, merge_elem)->checksum
+          < hash_entry (e2, struct frame, merge_elem)->checksum);
+}
+
+static unsigned
+frame_share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  struct frame_share *share = hash_entry (e, struct frame_share, elem);
+  return hash_ptr (share->inode) ^ hash_int (share->ofs);
+}
+
+static bool
+frame_share_less (const struct hash_elem *e1, const struct hash_elem *e2,
+                  void *aux UNUSED)
+{
+  struct frame_share *s1 = hash_entry (e1, struct frame_share, elem);
+  struct frame_share *s2 = hash_entry (e2, struct frame_share, elem);
+  if (s1->inode != s2->inode)
+    return s1->inode < s2->inode;
+  if (s1->ofs != s2->ofs)
+    return s1->ofs < s2->ofs;
+  return s1->read_bytes < s2->read_bytes;
+}
+
+/* Returns the frame descriptor of KPAGE, a user pool page. */
+static struct frame *
+frame_of (void *kpage)
+{
+  size_t idx = ((uint8_t *) kpage - frames_base) / PGSIZE;
+
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT ((uint8_t *) kpage >= frames_base && idx < frames_cnt);
+
+  return frames + idx;
+}
+
+/* Returns the supplemental page table owning the page in frame
+   F, or NULL if the page is shared. */
+static struct suppl_pt *
+frame_owner (struct frame *f)
+{
+  return f->suppl_pte != NULL ? f->suppl_pte->pt : NULL;
+}
+
+/* Sets the age of frame F to AGE, keeping its owner's working
+   set count. */
+static void
+frame_set_age (struct frame *f, uint8_t age)
+{
+  struct suppl_pt *pt = frame_owner (f);
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  if (pt != NULL)
+    pt->ws_cnt += (age != 0) - (f->age != 0);
+  f->age = age;
+}
+
+/* Makes PTE, or SHARE if PTE is null, the user of frame F, which
+   is on the frame table, moving its resident set and working set
+   counts along. */
+static void
+frame_set_user (struct frame *f, struct suppl_pte *pte,
+                struct frame_share *share)
+{
+  struct suppl_pt *pt = frame_owner (f);
+  uint8_t age = f->age;
+
+  ASSERT (f->in_table);
+
+  frame_set_age (f, 0);
+  if (pt != NULL)
+    pt->rss_cnt--;
+  f->suppl_pte = pte;
+  f->share = share;
+  pt = frame_owner (f);
+  if (pt != NULL)
+    pt->rss_cnt++;
+  frame_set_age (f, age);
+}
+
+/* Puts FRAME at the end of the frame table, in the youngest
+   generation, and counts it in its owner's resident set. */
+static void
+frame_list (struct frame *frame)
+{
+  struct suppl_pt *pt = frame_owner (frame);
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+  ASSERT (!frame->in_table);
+
+  list_push_back (&frame_table, &frame->elem);
+#ifdef VM_CLOCK
+  list_push_back (&frame_gens[0], &frame->gen_elem);
+#endif
+  frame->in_table = true;
+  if (pt != NULL)
+    pt->rss_cnt++;
+}
+
+/* Takes FRAME out of the frame table, and out of the merge
+   table, if it is there. */
+static void
+frame_unlist (struct frame *frame)
+{
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  if (!frame->in_table)
+    return;
+  frame_merge_forget (frame);
+  frame_set_age (frame, 0);
+  if (frame_owner (frame) != NULL)
+    frame_owner (frame)->rss_cnt--;
+#ifdef VM_CLOCK
+  list_remove (&frame->gen_elem);
+#endif
+  list_remove (&frame->elem);
+  frame->in_table = false;
+}
+
+/* Frees the given frame and its page.
+   If such frame exists in the frame table, remove it. */
+void
+frame_free (struct frame *frame)
+{
+  lock_acquire (&frame_table_lock);
+  frame_unlist (frame);
+  palloc_free_page (frame->kpage);
+  lock_release (&frame_table_lock);
+}
+
+/* Removes the frame table entry associated with KPAGE without
+   freeing it. */
+void
+frame_remove (void *kpage)
+{
+  lock_acquire (&frame_table_lock);
+  frame_unlist (frame_of (kpage));
+  lock_release (&frame_table_lock);
+}
+
+/* Empties a block of 2**ORDER pages of the user pool, aligned
+   to its size, by moving the pages of user processes in it to
+   other free pages, so that a request for that many contiguous
+   pages can be met.  The block chosen has the fewest pages in
+   use of those in which every page in use can be moved.  Returns
+   true if the block was emptied, though others may take its
+   pages before the caller gets to them. */
+bool
+frame_compact (int order)
+{
+  size_t page_cnt = (size_t) 1 << order;
+  size_t start, i;
+  void *held = NULL;
+  bool success = true;
+
+  if (frames == NULL)
+    return false;
+
+  /* Cached pages are free but marked used, so put them back on
+     the buddy lists before choosing a block. */
+  lock_acquire (&frame_table_lock);
+  palloc_user_drain_cache ();
+  start = frame_compact_block (page_cnt);
+  if (start == SIZE_MAX)
+    {
+      lock_release (&frame_table_lock);
+      return false;
+    }
+
+  for (i = start; i < start + page_cnt && success; i++)
+    {
+      struct frame *f = frames + i;
+      void *kpage;
+
+      if (!frame_movable (f))
+        {
+          /* Free, or held below, or else taken meanwhile. */
+          void *h = held;
+          while (h != NULL && h != frames_base + i * PGSIZE)
+            h = *(void **) h;
+          if (h == NULL && palloc_user_page_used (i))
+            success = false;
+          continue;
+        }
+
+      /* Find a free page outside the block, holding on to those
+         in it meanwhile, chained through their first word. */
+      for (;;)
+        {
+          size_t idx;
+
+          kpage = palloc_get_page (PAL_USER | PAL_NOCACHE);
+          if (kpage == NULL)
+            break;
+          idx = ((uint8_t *) kpage - frames_base) / PGSIZE;
+          if (idx < start || idx >= start + page_cnt)
+            break;
+          *(void **) kpage = held;
+          held = kpage;
+        }
+      if (kpage == NULL)
+        {
+          success = false;
+          break;
+        }
+
+      frame_move (f, kpage);
+      palloc_free_page (frames_base + i * PGSIZE);
+      perf_inc (PERF_PAGE_MIGRATE);
+    }
+
+  while (held != NULL)
+    {
+      void *next = *(void **) held;
+      palloc_free_page (held);
+      held = next;
+    }
+
+  /* The pages freed above went to the cache; return them to the
+     buddy lists so that the block coalesces. */
+  palloc_user_drain_cache ();
+  lock_release (&frame_table_lock);
+  return success;
+}
+
+/* Returns the index of the first page of the block of PAGE_CNT
+   user pool pages, aligned to PAGE_CNT, to empty for
+   frame_compact(), or SIZE_MAX if there is none. */
+static size_t
+frame_compact_block (size_t page_cnt)
+{
+  size_t best = SIZE_MAX;
+  size_t best_used = page_cnt;
+  size_t start, i;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  for (start = 0; start + page_cnt <= frames_cnt; start += page_cnt)
+    {
+      size_t used = 0;
+
+      for (i = start; i < start + page_cnt; i++)
+        if (palloc_user_page_used (i))
+          {
+            if (!frame_movable (frames + i))
+              break;
+            used++;
+          }
+      if (i == start + page_cnt && used < best_used
+          && used <= palloc_user_free_cnt ())
+        {
+          best = start;
+          best_used = used;
+        }
+    }
+  return best;
+}
+
+/* Returns true if frame F holds a page that frame_move() may
+   move: one on the frame table, neither pinned nor being written
+   out. */
+static bool
+frame_movable (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  return f->in_table && f->pin_cnt == 0 && !f->in_transit;
+}
+
+/* Moves the page in frame F, which is movable, to the free page
+   KPAGE, and points its mappings and F's place in the frame
+   table at KPAGE's frame instead.  Interrupts are off while the
+   page is copied and remapped, so that no process uses it
+   meanwhile.  F's page is left for the caller to free. */
+static void
+frame_move (struct frame *f, void *kpage)
+{
+  struct frame *n = frame_of (kpage);
+  enum intr_level old_level;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+  ASSERT (frame_movable (f));
+
+  /* Fold in the dirty bit of the kernel's mapping of the old
+     page, which stays behind. */
+  if (f->suppl_pte != NULL)
+    suppl_pt_update_dirty (f->suppl_pte);
+
+  old_level = intr_disable ();
+  memcpy (kpage, f->kpage, PGSIZE);
+  if (f->share != NULL)
+    {
+      struct list_elem *e;
+      for (e = list_begin (&f->share->users);
+           e != list_end (&f->share->users); e = list_next (e))
+        {
+          struct suppl_pte *user = list_entry (e, struct suppl_pte,
+                                               share_elem);
+          pagedir_remap (user->pagedir, user->upage, kpage);
+          user->kpage = kpage;
+        }
+      f->share->kpage = kpage;
+    }
+  else
+    {
+      pagedir_remap (f->suppl_pte->pagedir, f->suppl_pte->upage, kpage);
+      f->suppl_pte->kpage = kpage;
+    }
+  intr_set_level (old_level);
+
+  /* N takes F's place, with the same owner and age. */
+  frame_merge_forget (f);
+  n->kpage = kpage;
+  n->suppl_pte = f->suppl_pte;
+  n->share = f->share;
+  n->in_transit = false;
+  n->pin_cnt = 0;
+  n->age = f->age;
+  n->checksum = f->checksum;
+  n->merge_listed = false;
+  list_insert (&f->elem, &n->elem);
+  list_remove (&f->elem);
+#ifdef VM_CLOCK
+  list_insert (&f->gen_elem, &n->gen_elem);
+  list_remove (&f->gen_elem);
+#endif
+  n->in_table = true;
+  f->in_table = false;
+  f->age = 0;
+}
+
+/* Evicts a frame, of PT only if it is nonnull, and returns it,
+   off the frame table but with its page still allocated.
+   Returns NULL if every such frame is pinned or the write-out
+   failed.  The frame table lock is released during the
+   write-out. */
+static struct frame *
+frame_evict_and_get (struct suppl_pt *pt)
+{
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  struct frame *f = frame_to_evict (pt);
+  if (f == NULL)
+    return NULL;
+
+  enum frame_evict_action action = frame_evict_begin (f);
+  lock_release (&frame_table_lock);
+
+  bool success;
+  if (action == EVICT_SWAP)
+    success = frame_swap_out (&f, 1);
+  else
+    success = frame_write_back (f, action);
+
+  lock_acquire (&frame_table_lock);
+  return frame_evict_end (f, success) ? f : NULL;
+}
+
+/* Evicts up to CNT frames, at most SWAP_BATCH, and frees their
+   pages.  The victims are taken off the frame table together
+   and their swap write-outs are grouped by owner, so each
+   process's pages go out to contiguous swap slots in one
+   transfer.  Returns the number of pages freed. */
+static size_t
+frame_evict_batch (size_t cnt)
+{
+  struct frame *victims[SWAP_BATCH];
+  enum frame_evict_action actions[SWAP_BATCH];
+  bool success[SWAP_BATCH];
+  bool done[SWAP_BATCH];
+  size_t n, freed, i, j;
+
+  if (cnt > SWAP_BATCH)
+    cnt = SWAP_BATCH;
+
+  /* Choose and unmap victims. */
+  lock_acquire (&frame_table_lock);
+  for (n = 0; n < cnt && !list_empty (&frame_table); n++)
+    {
+      victims[n] = frame_to_evict (NULL);
+      if (victims[n] == NULL)
+        break;
+      actions[n] = frame_evict_begin (victims[n]);
+      done[n] = false;
+    }
+  lock_release (&frame_table_lock);
+
+  /* Write them out. */
+  for (i = 0; i < n; i++)
+    {
+      struct frame *group[SWAP_BATCH];
+      size_t members[SWAP_BATCH];
+      size_t group_cnt = 0;
+
+      if (done[i])
+        continue;
+      if (actions[i] != EVICT_SWAP)
+        {
+          success[i] = frame_write_back (victims[i], actions[i]);
+          continue;
+        }
+      for (j = i; j < n; j++)
+        if (!done[j] && actions[j] == EVICT_SWAP
+            && frame_owner (victims[j]) == frame_owner (victims[i]))
+          {
+            members[group_cnt] = j;
+            group[group_cnt++] = victims[j];
+            done[j] = true;
+          }
+      bool group_success = frame_swap_out (group, group_cnt);
+      for (j = 0; j < group_cnt; j++)
+        success[members[j]] = group_success;
+    }
+
+  /* Free their pages. */
+  lock_acquire (&frame_table_lock);
+  for (i = freed = 0; i < n; i++)
+    if (frame_evict_end (victims[i], success[i]))
+      {
+        palloc_free_page (victims[i]->kpage);
+        freed++;
+      }
+  lock_release (&frame_table_lock);
+
+  return freed;
+}
+
+/* Returns the frame to be evicted, or NULL if all are pinned.
+   Only frames holding pages of PT are considered if it is
+   nonnull. */
+static struct frame *
+frame_to_evict (struct suppl_pt *pt)
+{
+#ifdef VM_CLOCK
+  struct frame *f;
+
+  pagedir_batch_begin ();
+  f = frame_to_evict_clock (pt);
+  pagedir_batch_end ();
+  return f;
+#elif VM_FIFO
+  return frame_to_evict_fifo (pt);
+#endif
+}
+
+/* Starts evicting frame F and returns how its contents are to
+   be kept.  The page is unmapped first, so that its owner faults
+   and waits in frame_wait() rather than modify it while it is
+   written out, and F is taken off the frame table. */
+static enum frame_evict_action
+frame_evict_begin (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  /* Unmap a shared page from all its users.  A file page is clean,
+     while an anonymous page has to be swapped out. */
+  if (f->share != NULL)
+    {
+      struct frame_share *share = f->share;
+      while (!list_empty (&share->users))
+        {
+          struct list_elem *e = list_pop_front (&share->users);
+          struct suppl_pte *user = list_entry (e, struct suppl_pte,
+                                               share_elem);
+          pagedir_clear_page (user->pagedir, user->upage);
+          user->kpage = NULL;
+        }
+      frame_unlist (f);
+      f->in_transit = true;
+      return share->inode != NULL ? EVICT_DROP : EVICT_SWAP;
+    }
+
+  /* Uninstall frame and save dirty bit. */
+  struct suppl_pte *pte = f->suppl_pte;
+  pagedir_clear_page (pte->pagedir, pte->upage);
+  bool dirty = suppl_pt_update_dirty (pte);
+  frame_unlist (f);
+  f->in_transit = true;
+
+  switch (pte->type)
+    {
+    case PAGE_FILE:
+      if (pte->mmap)
+        return dirty ? EVICT_FILE : EVICT_DROP;
+      if (!pte->writable)
+        return EVICT_DROP;
+      /* Fall through. */
+
+    case PAGE_ZERO:
+      return dirty ? EVICT_SWAP : EVICT_DROP;
+
+    /* A clean page still in its swap slot is simply dropped. */
+    case PAGE_SWAP:
+      return dirty || pte->swap_index == BITMAP_ERROR ? EVICT_SWAP
+                                                      : EVICT_DROP;
+
+    /* Unintended type. */
+    default:
+      NOT_REACHED ();
+    }
+}
+
+/* Writes the page in frame F back to its file if ACTION says so.
+   Returns true if successful. */
+static bool
+frame_write_back (struct frame *f, enum frame_evict_action action)
+{
+  struct suppl_pte *pte = f->suppl_pte;
+
+  if (action != EVICT_FILE)
+    return true;
+  return mmap_write_back (pte->file, f->kpage, pte->ofs,
+                          pte->read_bytes) != -1;
+}
+
+/* Swaps out the pages in the CNT frames in FRAMES, which belong
+   to the same process or are all shared, to the compressed swap
+   pool or else to contiguous slots near the owner's other
+   swapped-out pages.  Returns true if successful. */
+static bool
+frame_swap_out (struct frame **frames, size_t cnt)
+{
+  struct suppl_pt *pt = frame_owner (frames[0]);
+  void *kpages[SWAP_BATCH];
+  size_t idxs[SWAP_BATCH];
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    kpages[i] = frames[i]->kpage;
+  if (!swap_out_multiple (kpages, cnt, pt != NULL ? &pt->swap_hint : NULL,
+                          idxs))
+    return false;
+  for (i = 0; i < cnt; i++)
+    {
+      struct suppl_pte *pte = frames[i]->suppl_pte;
+      if (pte == NULL)
+        {
+          frames[i]->share->swap_index = idxs[i];
+          continue;
+        }
+      if (pte->type == PAGE_SWAP && pte->swap_index != BITMAP_ERROR)
+        swap_remove (pte->swap_index);
+      pte->type = PAGE_SWAP;
+      pte->swap_index = idxs[i];
+    }
+  return true;
+}
+
+/* Finishes evicting frame F, whose write-out succeeded if
+   SUCCESS is true, and wakes up threads waiting for it.  On
+   failure the page is mapped back and F returns to the frame
+   table.  Returns SUCCESS. */
+static bool
+frame_evict_end (struct frame *f, bool success)
+{
+  struct suppl_pte *pte = f->suppl_pte;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  f->in_transit = false;
+  cond_broadcast (&frame_transit_done, &frame_table_lock);
+  if (f->share != NULL)
+    {
+      /* A page no one refers to any more goes either way. */
+      struct frame_share *share = f->share;
+      if (!success && share->ref_cnt > 0)
+        {
+          frame_list (f);
+          return false;
+        }
+      share->kpage = NULL;
+      frame_share_release (share);
+      return true;
+    }
+  if (!success)
+    {
+      /* Put the page back where it was. */
+      bool writable = pte->type != PAGE_FILE || pte->writable;
+      if (!pagedir_set_page (pte->pagedir, pte->upage, f->kpage, writable))
+        PANIC ("cannot reinstall a page after failed eviction");
+      frame_list (f);
+      return false;
+    }
+  pte->kpage = NULL;
+  return true;
+}
+
+#ifdef VM_CLOCK
+/* Thread function of the aging daemon.  Every AGE_INTERVAL
+   ticks it goes over all the frames, a batch at a time, shifting
+   each one's accessed bit into its age and moving it to the
+   generation of its new age, so that eviction finds old frames
+   without sweeping the frame table itself.  It also folds the
+   dirty bits into the supplemental page table entries, where
+   eviction looks first. */
+static void
+frame_age_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      size_t pos;
+
+      timer_sleep (AGE_INTERVAL);
+      for (pos = 0; pos < frames_cnt; pos += AGE_BATCH)
+        frame_age_scan (pos, AGE_BATCH);
+    }
+}
+
+/* Ages the frames on the frame table among the CNT frames of the
+   user pool starting at START. */
+static void
+frame_age_scan (size_t start, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&frame_table_lock);
+  pagedir_batch_begin ();
+  for (i = start; i < start + cnt && i < frames_cnt; i++)
+    {
+      struct frame *f = frames + i;
+      if (!f->in_table || f->pin_cnt > 0)
+        continue;
+      frame_age (f, frame_accessed (f));
+      if (f->suppl_pte != NULL)
+        suppl_pt_update_dirty (f->suppl_pte);
+    }
+  pagedir_batch_end ();
+  lock_release (&frame_table_lock);
+}
+
+/* Shifts ACCESSED into the age of frame F, which is on the frame
+   table, and moves F to the back of the generation of its new
+   age.  Frames of a process over the soft resident set limit, or
+   of an idle process, whose threads have not run for a while,
+   age twice as fast, or four times if both, so that memory goes
+   to the processes that are using it. */
+static void
+frame_age (struct frame *f, bool accessed)
+{
+  struct suppl_pt *owner = frame_owner (f);
+  int shift = 1 + frame_over_soft (owner) + frame_owner_idle (owner);
+  uint8_t age = (f->age >> shift) | (accessed ? 0x80 : 0);
+  int gen;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+  ASSERT (f->in_table);
+
+  frame_set_age (f, age);
+  if (age & 0x80)
+    gen = 0;
+  else if (age & 0x60)
+    gen = 1;
+  else if (age & 0x1e)
+    gen = 2;
+  else
+    gen = 3;
+  list_remove (&f->gen_elem);
+  list_push_back (&frame_gens[gen], &f->gen_elem);
+}
+
+/* Returns the frame to be evicted, or NULL if all are pinned.
+
+   The aging daemon keeps the frames sorted into generations by
+   age, so the candidates are taken from the oldest generation
+   first.  A candidate accessed since it was last aged is given a
+   second chance in the youngest generation instead.  The first
+   candidate that is clean is taken, as it costs no write-out; if
+   the first one found is dirty, CLEAN_SCAN more frames of its
+   generation are tried for a clean one before it is taken.
+   Frames of a process that ran lately above the default priority
+   are passed over.  If no other frame is found, the frame that
+   frame_older() ranks first goes.  Frames not of PT, if it is
+   nonnull, are passed over untouched. */
+static struct frame *
+frame_to_evict_clock (struct suppl_pt *pt)
+{
+  struct frame *oldest = NULL;
+  int gen;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  for (gen = GEN_CNT - 1; gen >= 0; gen--)
+    {
+      struct frame *dirty = NULL;
+      size_t scan = CLEAN_SCAN;
+      struct list_elem *e, *next;
+
+      for (e = list_begin (&frame_gens[gen]); e != list_end (&frame_gens[gen]);
+           e = next)
+        {
+          struct frame *f = list_entry (e, struct frame, gen_elem);
+          next = list_next (e);
+          if (f->pin_cnt > 0 || (pt != NULL && frame_owner (f) != pt))
+            continue;
+          if (frame_accessed (f))
+            {
+              frame_age (f, true);
+              continue;
+            }
+          if (frame_owner_favored (frame_owner (f)))
+            {
+              if (oldest == NULL || frame_older (f, oldest))
+                oldest = f;
+              continue;
+            }
+          if (frame_is_clean (f))
+            return f;
+          if (dirty == NULL)
+            dirty = f;
+          else if (scan-- == 0)
+            break;
+        }
+      if (dirty != NULL)
+        return dirty;
+    }
+  return oldest;
+}
+
+/* Returns true if evicting frame F costs no write-out. */
+static bool
+frame_is_clean (struct frame *f)
+{
+  struct suppl_pte *pte = f->suppl_pte;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  if (f->share != NULL)
+    return f->share->inode != NULL;
+  switch (pte->type)
+    {
+    case PAGE_FILE:
+      if (!pte->mmap && !pte->writable)
+        return true;
+      /* Fall through. */
+
+    case PAGE_ZERO:
+      return !suppl_pt_update_dirty (pte);
+
+    case PAGE_SWAP:
+      return pte->swap_index != BITMAP_ERROR && !suppl_pt_update_dirty (pte);
+
+    default:
+      return false;
+    }
+}
+
+/* Returns true if frame A is to be evicted before frame B: its
+   owner alone is over the soft resident set limit, or alone is
+   idle, or alone is not favored, or it is older, or as old but
+   its owner has a larger working set. */
+static bool
+frame_older (struct frame *a, struct frame *b)
+{
+  struct suppl_pt *pa = frame_owner (a);
+  struct suppl_pt *pb = frame_owner (b);
+
+  if (frame_over_soft (pa) != frame_over_soft (pb))
+    return frame_over_soft (pa);
+  if (frame_owner_idle (pa) != frame_owner_idle (pb))
+    return frame_owner_idle (pa);
+  if (frame_owner_favored (pa) != frame_owner_favored (pb))
+    return frame_owner_favored (pb);
+  if (a->age != b->age)
+    return a->age < b->age;
+  return (pa != NULL ? pa->ws_cnt : 0) > (pb != NULL ? pb->ws_cnt : 0);
+}
+
+/* Returns true if PT, which may be null for shared pages, has
+   more frames than the soft resident set limit. */
+static bool
+frame_over_soft (struct suppl_pt *pt)
+{
+  return pt != NULL && frame_rss_soft != 0 && pt->rss_cnt > frame_rss_soft;
+}
+
+/* Returns true if no thread of the process of PT, which may be
+   null for shared pages, has run for IDLE_TICKS ticks.  The
+   running thread's own process is never idle. */
+static bool
+frame_owner_idle (struct suppl_pt *pt)
+{
+  enum intr_level old_level;
+  int64_t run_tick;
+
+  if (pt == NULL || pt == thread_current ()->suppl_pt)
+    return false;
+  old_level = intr_disable ();
+  run_tick = pt->run_tick;
+  intr_set_level (old_level);
+  return timer_elapsed (run_tick) >= IDLE_TICKS;
+}
+
+/* Returns true if the process of PT, which may be null for
+   shared pages, is not idle and last ran above the default
+   priority, so that its working set is to be kept. */
+static bool
+frame_owner_favored (struct suppl_pt *pt)
+{
+  return (pt != NULL && pt->run_priority > PRI_DEFAULT
+          && !frame_owner_idle (pt));
+}
+
+/* Returns true if the page in frame F was accessed through any
+   of its mappings since the last call, and clears the accessed
+   bits. */
+static bool
+frame_accessed (struct frame *f)
+{
+  bool accessed = false;
+
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  if (f->share != NULL)
+    {
+      struct list_elem *e;
+      for (e = list_begin (&f->share->users);
+           e != list_end (&f->share->users); e = list_next (e))
+        {
+          struct suppl_pte *user = list_entry (e, struct suppl_pte,
+                                               share_elem);
+          if (pagedir_is_accessed (user->pagedir, user->upage))
+            {
+              accessed = true;
+              pagedir_set_accessed (user->pagedir, user->upage, false);
+            }
+        }
+    }
+  else
+    {
+      struct suppl_pte *pte = f->suppl_pte;
+      accessed = pagedir_is_accessed (pte->pagedir, pte->upage);
+      if (accessed)
+        pagedir_set_accessed (pte->pagedir, pte->upage, false);
+    }
+  return accessed;
+}
+#elif VM_FIFO
+/* Returns the frame to be evicted, or NULL if all are pinned.
+
+   This implements the FIFO algorithm. You can use this instead of
+   the clock algorithm by giving VM_FIFO option to the compiler.
+   Frames not of PT, if it is nonnull, are passed over. */
+static struct frame *
+frame_to_evict_fifo (struct suppl_pt *pt)
+{
+  ASSERT (lock_held_by_current_thread (&frame_table_lock));
+
+  struct list_elem *e;
+  for (e = list_begin (&frame_table); e != list_end (&frame_table);
+       e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      if (f->pin_cnt == 0 && (pt == NULL || frame_owner (f) == pt))
+        {
+          list_remove (&f->elem);
+          list_push_back (&frame_table, &f->elem);
+          return f;
+        }
+    }
+  return NULL;
 }
 #endif
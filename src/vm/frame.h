@@ -1,22 +1,107 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
+#include <hash.h>
 #include <list.h>
+#include <memstat.h>
+#include "filesys/off_t.h"
 #include "threads/palloc.h"
 #include "vm/page.h"
 
-/* Frame table element. */
+/* Frame table element.
+   All members but KPAGE are protected by the frame table lock.
+   A frame being written out by eviction is IN_TRANSIT and off
+   the frame table; its page stays unmapped until the write-out
+   ends.  A frame with a nonzero PIN_CNT is never evicted.  AGE
+   holds the accessed bits sampled by the last sweeps of the
+   clock, the latest in the top bit; a frame off the frame table
+   has age 0.  CHECKSUM is a hash of the page as the merger last
+   saw it, which files a frame on the frame table in the merge
+   table. */
 struct frame
   {
     void *kpage;                  /* Kernel page maps to the frame. */
-    struct suppl_pte *suppl_pte;  /* Supplemental page table entry. */
+    struct suppl_pte *suppl_pte;  /* Supplemental page table entry,
+                                     or NULL if shared. */
+    struct frame_share *share;    /* Shared page, or NULL. */
+    bool in_table;                /* In the frame table list? */
+    bool in_transit;              /* Being written out? */
+    int pin_cnt;                  /* Pinned if nonzero. */
+    uint8_t age;                  /* Aging counter. */
     struct list_elem elem;        /* List element. */
+    struct list_elem gen_elem;    /* Element in its generation. */
+    unsigned checksum;            /* Hash of the page when scanned. */
+    bool merge_listed;            /* In the merge table? */
+    struct hash_elem merge_elem;  /* Element in the merge table. */
   };
 
+/* A read-only file page, such as executable code, that all the
+   processes mapping the same file page share.  It is found by
+   the file's inode and the offset and length read from it, and
+   lives while supplemental page table entries refer to it.
+
+   With a null INODE, it is instead a private page that a fork
+   left shared between parent and child, or that the merger found
+   in several places and keeps once.  Its users map it read-only,
+   and the first to write it gets a copy.  Out of memory it is
+   kept at SWAP_INDEX.
+
+   A WRITABLE page, which has a null INODE too, is a page of a
+   shared memory segment.  Its users map it writable and see each
+   other's writes.
+   Protected by the frame table lock. */
+struct frame_share
+  {
+    struct inode *inode;          /* File the page is read from. */
+    off_t ofs;                    /* Offset in the file. */
+    uint32_t read_bytes;          /* Bytes read; the rest is zero. */
+    void *kpage;                  /* Kernel page, or NULL if not in
+                                     memory. */
+    size_t swap_index;            /* Swap slot if anonymous and not
+                                     in memory. */
+    bool writable;                /* Shared memory, mapped writable? */
+    struct list users;            /* Entries mapping KPAGE. */
+    int ref_cnt;                  /* Entries referring to this. */
+    struct hash_elem elem;        /* Element in the share table. */
+  };
+
+/* Resident set limits of each process in pages, or 0 for none.
+   A process over the soft limit has its pages evicted first; one
+   at the hard limit replaces its own pages.  Controlled by kernel
+   command-line options "-rss-soft=PAGES" and "-rss-hard=PAGES". */
+extern size_t frame_rss_soft;
+extern size_t frame_rss_hard;
+
+/* Frames scanned each second for pages identical to others, or 0
+   to not merge pages.  Controlled by kernel command-line option
+   "-merge=PAGES". */
+extern size_t frame_merge_rate;
+
 void frame_table_init (void);
+void frame_pageout_init (void);
+void frame_merge_init (void);
+void frame_age_init (void);
+bool frame_low (void);
 struct frame *frame_alloc (struct suppl_pte *, enum palloc_flags);
 void frame_free (struct frame *);
 void frame_remove (void *kpage);
+bool frame_compact (int order);
 void frame_append (struct frame *);
+void frame_wait (struct suppl_pte *);
+bool frame_pin (struct suppl_pte *);
+void frame_unpin (struct suppl_pte *);
+
+struct frame_share *frame_share_get (struct file *, off_t ofs,
+                                     uint32_t read_bytes);
+struct frame_share *frame_share_create (void);
+void frame_share_ref (struct frame_share *);
+void frame_share_put (struct frame_share *);
+bool frame_share_map (struct suppl_pte *);
+bool frame_share_install (struct frame *, struct suppl_pte *);
+void frame_share_unmap (struct suppl_pte *);
+bool frame_share_swap_in (struct frame *, struct suppl_pte *);
+bool frame_share_copy (struct suppl_pte *);
+bool frame_fork (struct suppl_pte *parent, struct suppl_pte *child);
+void frame_memstat (struct suppl_pt *, struct memstat *);
 
 #endif /* vm/frame.h */
@@ -1,17 +1,82 @@
 #include "vm/page.h"
-#include <hash.h>
+#include <bitmap.h>
+#include <clock.h>
+#include <round.h>
 #include <string.h>
+#include "devices/timer.h"
+#ifdef FILESYS
+#include "filesys/inode.h"
+#endif
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
 
-static hash_hash_func suppl_pt_hash;
-static hash_less_func suppl_pt_less;
+/* Page of zeros, mapped read-only for reads of zero pages.  A
+   write to it gets the page a frame of its own. */
+static void *zero_page;
 
-/* Creates and returns a new supplemental page table. */
+/* Leaf of a supplemental page table: the entries of the user
+   pages of one page table, indexed by pt_no(), in a page. */
+struct suppl_pt_leaf
+  {
+    struct suppl_pte *ptes[1 << PTBITS];
+  };
+
+/* Number of page directory entries below PHYS_BASE. */
+#define USER_PDE_CNT (pd_no (PHYS_BASE))
+
+/* A page of a supplemental page table's entry pool.  The
+   entries follow this header. */
+struct pte_chunk
+  {
+    struct list_elem elem;          /* Element in POOL_PAGES. */
+  };
+
+/* Entries per page of an entry pool. */
+#define PTES_PER_CHUNK \
+  ((PGSIZE - sizeof (struct pte_chunk)) / sizeof (struct suppl_pte))
+
+static struct suppl_pte **suppl_pt_slot (struct suppl_pt *, void *upage,
+                                          bool create);
+static bool suppl_pt_swap_in (struct suppl_pte *, struct frame *);
+static bool suppl_pt_pin_range (const void *, size_t, bool write);
+static bool suppl_pt_is_cheap (struct suppl_pte *);
+static void suppl_pt_prefetch (struct suppl_pte *);
+static void suppl_pt_discard (struct suppl_pte *);
+static struct suppl_pte *pte_alloc (struct suppl_pt *);
+static void pte_free (struct suppl_pt *, struct suppl_pte *);
+static bool pool_grow (struct suppl_pt *);
+
+/* Pages in the aligned window mapped around a faulting page. */
+#define FAULT_AROUND 8
+
+/* Maximum number of pages read from swap on a sequential
+   swap-in fault, including the faulting page. */
+#define SWAP_READ_AROUND 4
+
+/* Most pages made ahead of a stack growth fault. */
+#define STACK_AHEAD_MAX 16
+
+/* Most pages the stack may grow to, or 0 for no limit but
+   STACK_LIMIT. */
+size_t suppl_pt_stack_pages = 0;
+
+/* Initializes the shared zero page. */
+void
+suppl_pt_init (void)
+{
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+}
+
+/* Creates and returns a new supplemental page table, with a page
+   of entries in its pool. */
 struct suppl_pt *
 suppl_pt_create (void)
 {
@@ -19,19 +84,86 @@ suppl_pt_create (void)
   if (pt == NULL)
     return NULL;
 
-  hash_init (&pt->hash, suppl_pt_hash, suppl_pt_less, NULL);
+  pt->dir = palloc_get_page (PAL_ZERO);
+  if (pt->dir == NULL)
+    {
+      free (pt);
+      return NULL;
+    }
+  lock_init (&pt->lock);
+  lock_set_name (&pt->lock, "suppl_pt");
+  list_init (&pt->pool_pages);
+  list_init (&pt->pool_free);
+  pt->swap_hint = BITMAP_ERROR;
+  pt->swap_upage = NULL;
+  pt->ws_cnt = 0;
+  pt->rss_cnt = 0;
+  pt->run_tick = timer_ticks ();
+  pt->run_priority = PRI_DEFAULT;
+  pt->stack_bottom = NULL;
+  pt->stack_ahead = 0;
+  if (!pool_grow (pt))
+    {
+      palloc_free_page (pt->dir);
+      free (pt);
+      return NULL;
+    }
 
   return pt;
 }
 
 /* Destroys the given supplemental page table PT.
-   Frees its supplemental page table entries and removes frame
-   table entries but not frees frame table entries since they
-   will be freed by pagedir_destroy(). */
+   Frees PT and its supplemental page table entries and removes
+   frame table entries but not frees frame table entries since
+   they will be freed by pagedir_destroy(). */
 void
 suppl_pt_destroy (struct suppl_pt *pt)
 {
-  hash_destroy (&pt->hash, suppl_pt_free_pte);
+  size_t i, j;
+
+  /* Keep the merger off the entries while they go. */
+  lock_acquire (&pt->lock);
+  for (i = 0; i < USER_PDE_CNT; i++)
+    {
+      struct suppl_pt_leaf *leaf = pt->dir[i];
+      if (leaf == NULL)
+        continue;
+      for (j = 0; j < 1 << PTBITS; j++)
+        if (leaf->ptes[j] != NULL)
+          suppl_pt_free_pte (leaf->ptes[j], NULL);
+      palloc_free_page (leaf);
+    }
+  lock_release (&pt->lock);
+  palloc_free_page (pt->dir);
+  while (!list_empty (&pt->pool_pages))
+    palloc_free_page (list_entry (list_pop_front (&pt->pool_pages),
+                                  struct pte_chunk, elem));
+  free (pt);
+}
+
+/* Locks the supplemental page table of the current process
+   unless the current thread holds its lock already, as it does
+   when the kernel faults on user memory while changing the
+   table.  Returns true if it took the lock, to be passed to
+   suppl_pt_unlock(). */
+bool
+suppl_pt_lock (void)
+{
+  struct suppl_pt *pt = thread_current ()->suppl_pt;
+
+  if (pt == NULL || lock_held_by_current_thread (&pt->lock))
+    return false;
+  lock_acquire (&pt->lock);
+  return true;
+}
+
+/* Releases the lock of the current process's supplemental page
+   table if LOCKED, as suppl_pt_lock() returned, is true. */
+void
+suppl_pt_unlock (bool locked)
+{
+  if (locked)
+    lock_release (&thread_current ()->suppl_pt->lock);
 }
 
 /* Adds a new supplemental page table entry of zero-fill with
@@ -40,9 +172,11 @@ suppl_pt_destroy (struct suppl_pt *pt)
 bool
 suppl_pt_set_zero (void *upage)
 {
-  if (suppl_pt_get_page (upage) != NULL)
+  struct suppl_pt *pt = thread_current ()->suppl_pt;
+  struct suppl_pte **slot = suppl_pt_slot (pt, upage, true);
+  if (slot == NULL || *slot != NULL)
     return false;
-  struct suppl_pte *pte = malloc (sizeof (struct suppl_pte));
+  struct suppl_pte *pte = pte_alloc (pt);
   if (pte == NULL)
     return false;
 
@@ -50,11 +184,61 @@ suppl_pt_set_zero (void *upage)
   pte->upage = upage;
   pte->kpage = NULL;
   pte->pagedir = thread_current ()->pagedir;
+  pte->pt = pt;
   pte->dirty = false;
+  pte->zero_mapped = false;
+  pte->advice = MADV_NORMAL;
+  pte->share = NULL;
+
+  *slot = pte;
+
+  return true;
+}
 
+/* Grows the stack of the current process down to UPAGE, which
+   has no entry, by adding a zero page for it.  A fault just below
+   the page the last growth made means the stack keeps growing,
+   as under deep recursion or large local arrays, so a run of
+   pages below UPAGE is made and loaded as well while free frames
+   last, one page the second time and twice as many each time
+   after, up to STACK_AHEAD_MAX.  The run stops at a page of a
+   memory mapped file, which keeps its own entry.  Any other
+   growth fault starts over.  Returns false if UPAGE is beyond the stack's limit or
+   out of memory. */
+bool
+suppl_pt_grow_stack (void *upage)
+{
   struct suppl_pt *pt = thread_current ()->suppl_pt;
-  hash_insert (&pt->hash, &pte->elem);
+  uint8_t *limit = STACK_LIMIT;
+  uint8_t *page = upage;
+  size_t i;
 
+  if (suppl_pt_stack_pages != 0
+      && suppl_pt_stack_pages < (size_t) ((uint8_t *) PHYS_BASE - limit)
+                                / PGSIZE)
+    limit = (uint8_t *) PHYS_BASE - suppl_pt_stack_pages * PGSIZE;
+  if (page < limit || !suppl_pt_set_zero (upage))
+    return false;
+
+  if (pt->stack_bottom != NULL
+      && page == (uint8_t *) pt->stack_bottom - PGSIZE)
+    pt->stack_ahead = (pt->stack_ahead == 0 ? 1
+                       : pt->stack_ahead * 2 < STACK_AHEAD_MAX
+                       ? pt->stack_ahead * 2 : STACK_AHEAD_MAX);
+  else
+    pt->stack_ahead = 0;
+
+  for (i = 0; i < pt->stack_ahead; i++)
+    {
+      if (page - PGSIZE < limit || frame_low ()
+          || process_find_mmap (page - PGSIZE, 1) != NULL
+          || !suppl_pt_set_zero (page - PGSIZE))
+        break;
+      page -= PGSIZE;
+      if (!suppl_pt_load_page (page))
+        break;
+    }
+  pt->stack_bottom = page;
   return true;
 }
 
@@ -66,9 +250,11 @@ suppl_pt_set_file (void *upage, struct file *file, off_t ofs,
                    uint32_t read_bytes, uint32_t zero_bytes,
                    bool writable, bool mmap)
 {
-  if (suppl_pt_get_page (upage) != NULL)
+  struct suppl_pt *pt = thread_current ()->suppl_pt;
+  struct suppl_pte **slot = suppl_pt_slot (pt, upage, true);
+  if (slot == NULL || *slot != NULL)
     return false;
-  struct suppl_pte *pte = malloc (sizeof (struct suppl_pte));
+  struct suppl_pte *pte = pte_alloc (pt);
   if (pte == NULL)
     return false;
 
@@ -76,48 +262,101 @@ suppl_pt_set_file (void *upage, struct file *file, off_t ofs,
   pte->upage = upage;
   pte->kpage = NULL;
   pte->pagedir = thread_current ()->pagedir;
+  pte->pt = pt;
   pte->dirty = false;
+  pte->zero_mapped = false;
+  pte->advice = MADV_NORMAL;
   pte->file = file;
   pte->ofs = ofs;
   pte->read_bytes = read_bytes;
   pte->zero_bytes = zero_bytes;
   pte->writable = writable;
   pte->mmap = mmap;
+  pte->share = NULL;
 
-  struct suppl_pt *pt = thread_current ()->suppl_pt;
-  hash_insert (&pt->hash, &pte->elem);
+  /* Read-only file pages are shared between processes. */
+  if (!writable && !mmap)
+    {
+      pte->share = frame_share_get (file, ofs, read_bytes);
+      if (pte->share == NULL)
+        {
+          pte_free (pt, pte);
+          return false;
+        }
+    }
+
+  *slot = pte;
 
   return true;
 }
 
+/* Adds a new supplemental page table entry with user virtual
+   page UPAGE for SHARE, a page of shared memory, and takes a
+   reference to it.
+   Note that this does not involve actual frame allocation. */
+bool
+suppl_pt_set_shared (void *upage, struct frame_share *share)
+{
+  if (!suppl_pt_set_zero (upage))
+    return false;
+  frame_share_ref (share);
+  suppl_pt_get_page (upage)->share = share;
+  return true;
+}
+
 /* Loads user virtual page UPAGE on the memory with frame
    allocation. */
 bool
 suppl_pt_load_page (void *upage)
 {
   /* Get supplemental page table entry. */
-  struct suppl_pte *pte = suppl_pt_get_page (upage);
-  if (pte == NULL || pte->kpage != NULL)
+  struct suppl_pte *pte = suppl_pt_lookup (upage);
+  if (pte == NULL)
     return false;
+  frame_wait (pte);
+  if (pte->kpage != NULL)
+    return false;
+
+  /* Leave the shared zero page. */
+  if (pte->zero_mapped)
+    {
+      pagedir_clear_page (pte->pagedir, upage);
+      pte->zero_mapped = false;
+    }
+
+  /* Map a shared page if some process has it in memory. */
+  bool shared = pte->share != NULL;
+  if (shared && frame_share_map (pte))
+    return true;
 
-  /* Obtain a new frame. */
-  struct frame *f = frame_alloc (pte, PAL_USER);
+  /* Obtain a new frame, zeroed for a zero page. */
+  struct frame *f = frame_alloc (pte, PAL_USER
+                                 | (pte->type == PAGE_ZERO && !shared
+                                    ? PAL_ZERO : 0));
   if (f == NULL)
     return false;
 
+  /* A copy-on-write page out of memory is in swap. */
+  if (shared && pte->type == PAGE_ZERO)
+    return frame_share_swap_in (f, pte);
+
   /* Load page content for each page type. */
   bool writable = true;
   switch (pte->type)
     {
-    /* Page filled with zeros. */
+    /* Page filled with zeros, by frame_alloc(). */
     case PAGE_ZERO:
-      memset (f->kpage, 0, PGSIZE);
       break;
 
-    /* Page content from the file system. */
+    /* Page content from the file system.  A memory mapped page
+       is read through the buffer cache, whose copy then shows
+       mmap_write_back() the sectors that changed. */
     case PAGE_FILE:
       file_seek (pte->file, pte->ofs);
-      if (file_read (pte->file, f->kpage, pte->read_bytes)
+      if ((pte->mmap
+           ? file_read_at_cached (pte->file, f->kpage, pte->read_bytes,
+                                  pte->ofs)
+           : file_read (pte->file, f->kpage, pte->read_bytes))
           != (int) pte->read_bytes)
         {
           frame_free (f);
@@ -129,7 +368,7 @@ suppl_pt_load_page (void *upage)
 
     /* Page content from the swap disk. */
     case PAGE_SWAP:
-      if (!swap_in (f->kpage, pte->swap_index))
+      if (!suppl_pt_swap_in (pte, f))
         {
           frame_free (f);
           return false;
@@ -141,6 +380,10 @@ suppl_pt_load_page (void *upage)
       NOT_REACHED ();
     }
 
+  /* Install a shared page, which goes to the frame table too. */
+  if (shared)
+    return frame_share_install (f, pte);
+
   /* Install upage to kpage. */
   if (!pagedir_set_page (pte->pagedir, upage, f->kpage, writable))
     {
@@ -160,6 +403,346 @@ suppl_pt_load_page (void *upage)
   return true;
 }
 
+/* Maps zero page UPAGE of the current process to the shared
+   zero page, read-only, on behalf of a read fault.  Returns true
+   if successful, false if UPAGE is not a zero page that is out
+   of memory. */
+bool
+suppl_pt_map_zero (void *upage)
+{
+  struct suppl_pte *pte = suppl_pt_get_page (upage);
+  if (pte == NULL || pte->type != PAGE_ZERO || pte->share != NULL
+      || pte->kpage != NULL || pte->zero_mapped)
+    return false;
+  if (!pagedir_set_page (pte->pagedir, upage, zero_page, false))
+    return false;
+  pte->zero_mapped = true;
+  return true;
+}
+
+/* Gives UPAGE of the current process a page of its own on a write
+   to it while it is mapped read-only, that is to the shared zero
+   page or to a copy-on-write page.  Returns true if the write may
+   be retried, false if UPAGE is not such a page or memory ran
+   out. */
+bool
+suppl_pt_copy_on_write (void *upage)
+{
+  struct suppl_pte *pte = suppl_pt_get_page (upage);
+  if (pte == NULL)
+    return false;
+  if (pte->zero_mapped)
+    return suppl_pt_load_page (upage);
+  if (pte->type != PAGE_ZERO || pte->share == NULL || pte->share->writable)
+    return false;
+  return frame_share_copy (pte);
+}
+
+/* Copies the supplemental page table PARENT of the process being
+   forked into that of the current process, its child, whose file
+   pages are read from EXEC_FILE.  See frame_fork() for how pages
+   are shared.  Memory mapped files and shared memory are not
+   inherited.  Returns true if successful. */
+bool
+suppl_pt_fork (struct suppl_pt *parent, struct file *exec_file)
+{
+  struct suppl_pt *pt = thread_current ()->suppl_pt;
+  struct suppl_pte *p;
+  bool success = true;
+
+  /* The parent's other threads may fault meanwhile. */
+  lock_acquire (&parent->lock);
+  for (p = suppl_pt_next (parent, NULL, PHYS_BASE); p != NULL;
+       p = suppl_pt_next (parent, p->upage + PGSIZE, PHYS_BASE))
+    {
+      /* Eviction never changes the type of a memory mapped page. */
+      if ((p->type == PAGE_FILE && p->mmap)
+          || (p->share != NULL && p->share->writable))
+        continue;
+
+      struct suppl_pte **slot = suppl_pt_slot (pt, p->upage, true);
+      struct suppl_pte *pte = slot != NULL ? pte_alloc (pt) : NULL;
+      if (pte == NULL)
+        {
+          success = false;
+          break;
+        }
+      pte->pagedir = thread_current ()->pagedir;
+      pte->pt = pt;
+      if (!frame_fork (p, pte))
+        {
+          pte_free (pt, pte);
+          success = false;
+          break;
+        }
+      if (pte->type == PAGE_FILE)
+        pte->file = exec_file;
+      *slot = pte;
+    }
+  lock_release (&parent->lock);
+  return success;
+}
+
+/* Maps the not yet present pages around UPAGE, which has just
+   been loaded, in the FAULT_AROUND-page aligned window holding
+   it, as far as that costs no disk I/O: shared pages that are in
+   memory, zero pages, which get the shared zero page, and while
+   free frames last, file pages held by the buffer cache.
+   Sequential accesses then fault once per window rather than
+   once per page.  Nothing is mapped around a page advised
+   MADV_RANDOM, while for one advised MADV_SEQUENTIAL the file
+   pages of the next window are read into the buffer cache as
+   well, so that they are cheap by the time they are touched. */
+void
+suppl_pt_fault_around (void *upage)
+{
+  uint8_t *start = (uint8_t *) upage
+                   - (pg_no (upage) % FAULT_AROUND) * PGSIZE;
+  struct suppl_pte *fault = suppl_pt_get_page (upage);
+  uint8_t *p;
+
+  if (fault != NULL && fault->advice == MADV_RANDOM)
+    return;
+  if (fault != NULL && fault->advice == MADV_SEQUENTIAL && !frame_low ())
+    for (p = start + FAULT_AROUND * PGSIZE;
+         p < start + 2 * FAULT_AROUND * PGSIZE && is_user_vaddr (p);
+         p += PGSIZE)
+      {
+        struct suppl_pte *pte = suppl_pt_lookup (p);
+        if (pte != NULL && pte->kpage == NULL && pte->type == PAGE_FILE)
+          suppl_pt_prefetch (pte);
+      }
+
+  for (p = start; p < start + FAULT_AROUND * PGSIZE; p += PGSIZE)
+    {
+      struct suppl_pte *pte;
+
+      if (p == upage || !is_user_vaddr (p))
+        continue;
+      pte = frame_low () ? suppl_pt_get_page (p) : suppl_pt_lookup (p);
+      if (pte == NULL || pte->kpage != NULL || pte->zero_mapped)
+        continue;
+      if (pte->share != NULL)
+        frame_share_map (pte);
+      else if (pte->type == PAGE_ZERO)
+        suppl_pt_map_zero (p);
+      else if (!frame_low () && suppl_pt_is_cheap (pte))
+        suppl_pt_load_page (p);
+    }
+}
+
+/* Applies ADVICE to the pages of the current process spanning
+   SIZE bytes at ADDR, which is page-aligned, skipping those not
+   mapped.  MADV_NORMAL, MADV_SEQUENTIAL, and MADV_RANDOM are kept
+   in the pages' entries for fault-around and swap-in to follow.
+   MADV_WILLNEED starts reading in the pages not in memory, and
+   MADV_DONTNEED frees them; see suppl_pt_prefetch() and
+   suppl_pt_discard(). */
+void
+suppl_pt_advise (void *addr, size_t size, enum madvise_advice advice)
+{
+  uint8_t *upage;
+
+  ASSERT (pg_ofs (addr) == 0);
+
+  for (upage = addr; upage < (uint8_t *) addr + size; upage += PGSIZE)
+    {
+      struct suppl_pte *pte;
+
+      /* Untouched pages of a memory mapped file have no entry, and
+         get one to keep a hint in. */
+      if (advice == MADV_DONTNEED)
+        pte = suppl_pt_get_page (upage);
+      else
+        pte = suppl_pt_lookup (upage);
+      if (pte == NULL)
+        continue;
+
+      switch (advice)
+        {
+        case MADV_NORMAL:
+        case MADV_SEQUENTIAL:
+        case MADV_RANDOM:
+          pte->advice = advice;
+          break;
+
+        case MADV_WILLNEED:
+          if (pte->kpage == NULL)
+            suppl_pt_prefetch (pte);
+          break;
+
+        case MADV_DONTNEED:
+          suppl_pt_discard (pte);
+          break;
+        }
+    }
+}
+
+/* Starts reading in the page of PTE, of the current process,
+   which is not in memory.  A file page is read into the buffer
+   cache without waiting, and a page out in swap is loaded while
+   free frames last.  A zero page needs nothing. */
+static void
+suppl_pt_prefetch (struct suppl_pte *pte)
+{
+#ifdef FILESYS
+  if (pte->type == PAGE_FILE)
+    {
+      inode_prefetch (file_get_inode (pte->file), pte->ofs,
+                      pte->read_bytes);
+      return;
+    }
+#endif
+  if ((pte->type == PAGE_SWAP || pte->share != NULL) && !frame_low ())
+    suppl_pt_load_page (pte->upage);
+}
+
+/* Frees the frame and swap slot of the page of PTE, of the
+   current process, which reads afresh when next touched: a page
+   of a memory mapped file is written back first and read from
+   the file again, a writable page of the executable is read from
+   it again, and an anonymous page reads as zeros.  Read-only
+   pages and shared memory, whose contents do not go away, are
+   left alone. */
+static void
+suppl_pt_discard (struct suppl_pte *pte)
+{
+  void *upage = pte->upage;
+  uint8_t advice = pte->advice;
+
+  frame_wait (pte);
+  if (pte->type == PAGE_FILE)
+    {
+      struct file *file = pte->file;
+      off_t ofs = pte->ofs;
+      uint32_t read_bytes = pte->read_bytes;
+      uint32_t zero_bytes = pte->zero_bytes;
+      bool mmap = pte->mmap;
+
+      if (!pte->writable)
+        return;
+      if (mmap && pte->kpage != NULL && suppl_pt_update_dirty (pte))
+        mmap_write_back (file, pte->kpage, ofs, read_bytes);
+      suppl_pt_free_page (upage);
+
+      /* A memory mapped page gets its entry again from the
+         mapping. */
+      if (!mmap)
+        suppl_pt_set_file (upage, file, ofs, read_bytes, zero_bytes,
+                           true, false);
+    }
+  else
+    {
+      if (pte->share != NULL && pte->share->writable)
+        return;
+      suppl_pt_free_page (upage);
+      suppl_pt_set_zero (upage);
+    }
+
+  /* The entry just freed is taken again, so this cannot fail. */
+  pte = suppl_pt_lookup (upage);
+  ASSERT (pte != NULL);
+  pte->advice = advice;
+}
+
+/* Returns true if loading the page of PTE, which is not shared,
+   needs no disk I/O. */
+static bool
+suppl_pt_is_cheap (struct suppl_pte *pte)
+{
+  switch (pte->type)
+    {
+#ifdef FILESYS
+    case PAGE_FILE:
+      return inode_cached (file_get_inode (pte->file), pte->ofs,
+                           pte->read_bytes);
+#endif
+    default:
+      return false;
+    }
+}
+
+/* Loads and pins the user pages spanning SIZE bytes at UADDR so
+   that they stay in memory while the kernel accesses them.
+   Pages that are neither in the supplemental page table nor in a
+   memory mapped file are skipped.
+   Returns true if successful.  On failure nothing stays pinned. */
+bool
+suppl_pt_pin (const void *uaddr, size_t size)
+{
+  return suppl_pt_pin_range (uaddr, size, false);
+}
+
+/* Pins the user pages spanning SIZE bytes at UADDR as
+   suppl_pt_pin() does, for the kernel to write to them.  A
+   copy-on-write page first gets a page of its own, as a write
+   fault would give it, so that the page pinned is the one the
+   writes go to.  Fails if a page is read-only.
+   Returns true if successful.  On failure nothing stays pinned. */
+bool
+suppl_pt_pin_write (const void *uaddr, size_t size)
+{
+  return suppl_pt_pin_range (uaddr, size, true);
+}
+
+/* Pins the user pages spanning SIZE bytes at UADDR, for writing
+   if WRITE is true, for suppl_pt_pin() and suppl_pt_pin_write(). */
+static bool
+suppl_pt_pin_range (const void *uaddr, size_t size, bool write)
+{
+  void *first = pg_round_down (uaddr);
+  void *upage;
+  bool locked;
+
+  if (size == 0)
+    return true;
+  locked = suppl_pt_lock ();
+  for (upage = first; upage < uaddr + size; upage += PGSIZE)
+    {
+      struct suppl_pte *pte = suppl_pt_lookup (upage);
+      if (pte == NULL)
+        continue;
+      if (write && pte->type == PAGE_FILE && !pte->writable)
+        goto fail;
+      while (write && pte->type == PAGE_ZERO && pte->share != NULL
+             && !pte->share->writable)
+        if ((pte->kpage == NULL && !suppl_pt_load_page (upage))
+            || !frame_share_copy (pte))
+          goto fail;
+      while (!frame_pin (pte))
+        if (!suppl_pt_load_page (upage))
+          goto fail;
+    }
+  suppl_pt_unlock (locked);
+  return true;
+
+ fail:
+  suppl_pt_unpin (first, upage - first);
+  suppl_pt_unlock (locked);
+  return false;
+}
+
+/* Unpins the user pages pinned by suppl_pt_pin() with the same
+   UADDR and SIZE. */
+void
+suppl_pt_unpin (const void *uaddr, size_t size)
+{
+  void *upage;
+  bool locked;
+
+  if (size == 0)
+    return;
+  locked = suppl_pt_lock ();
+  for (upage = pg_round_down (uaddr); upage < uaddr + size;
+       upage += PGSIZE)
+    {
+      struct suppl_pte *pte = suppl_pt_get_page (upage);
+      if (pte != NULL)
+        frame_unpin (pte);
+    }
+  suppl_pt_unlock (locked);
+}
+
 /* Marks user virtual page UPAGE "not present" in page
    directory of the current process and removes correspoding
    supplemental page table element.
@@ -171,7 +754,27 @@ suppl_pt_clear_page (void *upage)
   if (pte == NULL)
     return;
   pagedir_clear_page (pte->pagedir, upage);
-  suppl_pt_free_pte (&pte->elem, thread_current ()->suppl_pt);
+  suppl_pt_free_pte (pte, thread_current ()->suppl_pt);
+}
+
+/* Removes user virtual page UPAGE of the current process from
+   its page directory and supplemental page table, and frees its
+   frame or swap slot. */
+void
+suppl_pt_free_page (void *upage)
+{
+  struct suppl_pte *pte = suppl_pt_get_page (upage);
+  if (pte == NULL)
+    return;
+  frame_wait (pte);
+
+  /* A private frame is ours to free once off the frame table. */
+  void *kpage = pte->share == NULL ? pte->kpage : NULL;
+  uint32_t *pagedir = pte->pagedir;
+  suppl_pt_free_pte (pte, thread_current ()->suppl_pt);
+  pagedir_clear_page (pagedir, upage);
+  if (kpage != NULL)
+    palloc_free_page (kpage);
 }
 
 /* Returns the supplemental page table entry associated with
@@ -179,14 +782,82 @@ suppl_pt_clear_page (void *upage)
    Returns NULL if not exist. */
 struct suppl_pte *
 suppl_pt_get_page (void *upage)
+{
+  struct suppl_pte **slot = suppl_pt_slot (thread_current ()->suppl_pt,
+                                           upage, false);
+  return slot != NULL ? *slot : NULL;
+}
+
+/* Returns the supplemental page table entry of user virtual
+   page UPAGE like suppl_pt_get_page(), first adding it if UPAGE
+   lies in a memory mapped file of the current process that has
+   not been touched there yet.  Returns NULL if neither exists. */
+struct suppl_pte *
+suppl_pt_lookup (void *upage)
+{
+  struct suppl_pte *pte = suppl_pt_get_page (upage);
+  if (pte != NULL)
+    return pte;
+
+  struct process_mmap *mmap = process_find_mmap (upage, 1);
+  if (mmap == NULL || mmap->file == NULL)
+    return NULL;
+  off_t ofs = (uint8_t *) upage - (uint8_t *) mmap->addr;
+  size_t read_bytes = mmap->size - ofs < PGSIZE ? mmap->size - ofs : PGSIZE;
+  if (!suppl_pt_set_file (upage, mmap->file, ofs, read_bytes,
+                          PGSIZE - read_bytes, true, true))
+    return NULL;
+  return suppl_pt_get_page (upage);
+}
+
+/* Returns the entry of PT with the lowest user virtual page at
+   or above START and below END, or NULL if there is none.  A
+   null START means the bottom of memory.  Leaves with no entries
+   are skipped whole, so walking a range costs one step per page
+   table it spans plus one per page in the leaves it meets. */
+struct suppl_pte *
+suppl_pt_next (struct suppl_pt *pt, void *start, void *end)
+{
+  uintptr_t va = (uintptr_t) pg_round_down (start);
+
+  if (end > PHYS_BASE)
+    end = PHYS_BASE;
+  while (va < (uintptr_t) end)
+    {
+      struct suppl_pt_leaf *leaf = pt->dir[pd_no ((void *) va)];
+
+      if (leaf == NULL)
+        va = (va | ~PDMASK) + 1;
+      else
+        {
+          struct suppl_pte *pte = leaf->ptes[pt_no ((void *) va)];
+          if (pte != NULL)
+            return pte;
+          va += PGSIZE;
+        }
+
+      /* Wrapped past the top of memory. */
+      if (va == 0)
+        break;
+    }
+  return NULL;
+}
+
+/* Returns true if none of the SIZE bytes of user virtual memory
+   from page UPAGE on has a supplemental page table entry or is
+   the clock page. */
+bool
+suppl_pt_range_free (void *upage, size_t size)
 {
   struct suppl_pt *pt = thread_current ()->suppl_pt;
-  struct suppl_pte pte;
-  struct hash_elem *e;
+  uint8_t *end = (uint8_t *) upage + size;
 
-  pte.upage = upage;
-  e = hash_find (&pt->hash, &pte.elem);
-  return e != NULL ? hash_entry (e, struct suppl_pte, elem) : NULL;
+  if (end < (uint8_t *) upage)
+    end = PHYS_BASE;
+  if ((uint8_t *) upage < (uint8_t *) CLOCK_PAGE + PGSIZE
+      && end > (uint8_t *) CLOCK_PAGE)
+    return false;
+  return suppl_pt_next (pt, upage, end) == NULL;
 }
 
 /* Updates dirty bit at the given supplemental page table entry
@@ -205,34 +876,155 @@ suppl_pt_update_dirty (struct suppl_pte *pte)
   return pte->dirty;
 }
 
-static unsigned
-suppl_pt_hash (const struct hash_elem *e, void *aux UNUSED)
+/* Swaps the page of PTE, of the current process, in to frame F.
+   If the process swapped in the page just below it last, it
+   seems to go through its memory sequentially, so the pages that
+   follow it both in memory and on the swap disk are read along
+   with it while free frames last.  The pages keep their slots on
+   the swap disk while they are clean.  Returns true if
+   successful. */
+static bool
+suppl_pt_swap_in (struct suppl_pte *pte, struct frame *f)
 {
-  struct suppl_pte *pte = hash_entry (e, struct suppl_pte, elem);
-  return hash_bytes (&pte->upage, sizeof pte->upage);
+  struct suppl_pt *pt = pte->pt;
+  struct frame *frames[SWAP_READ_AROUND];
+  void *kpages[SWAP_READ_AROUND];
+  size_t cnt, i;
+
+  frames[0] = f;
+  kpages[0] = f->kpage;
+  cnt = 1;
+  if (pte->advice == MADV_SEQUENTIAL
+      || (pte->advice == MADV_NORMAL && pt->swap_upage != NULL
+          && pte->upage == pt->swap_upage + PGSIZE))
+    while (cnt < SWAP_READ_AROUND && !frame_low ())
+      {
+        struct suppl_pte *next;
+        next = suppl_pt_get_page (pte->upage + cnt * PGSIZE);
+        if (next == NULL || next->type != PAGE_SWAP || next->kpage != NULL
+            || next->swap_index != pte->swap_index + cnt)
+          break;
+        frames[cnt] = frame_alloc (next, PAL_USER);
+        if (frames[cnt] == NULL)
+          break;
+        kpages[cnt] = frames[cnt]->kpage;
+        cnt++;
+      }
+
+  if (!swap_in_multiple (kpages, pte->swap_index, cnt, true))
+    {
+      for (i = 1; i < cnt; i++)
+        frame_free (frames[i]);
+      return false;
+    }
+  pt->swap_upage = pte->upage + (cnt - 1) * PGSIZE;
+  for (i = 0; i < cnt; i++)
+    {
+      struct suppl_pte *p = frames[i]->suppl_pte;
+      if (!swap_on_disk (p->swap_index))
+        p->swap_index = BITMAP_ERROR;
+      p->dirty = false;
+    }
+
+  /* Install the pages read along.  Their page table exists, since
+     they were mapped before they were swapped out. */
+  for (i = 1; i < cnt; i++)
+    {
+      struct suppl_pte *next = frames[i]->suppl_pte;
+      if (!pagedir_set_page (next->pagedir, next->upage, kpages[i], true))
+        PANIC ("cannot map a page read from swap");
+
+      /* Clear both dirty bits that suppl_pt_update_dirty() reads:
+         the user page's and that of the kernel page the read
+         went to. */
+      pagedir_set_dirty (next->pagedir, next->upage, false);
+      pagedir_set_dirty (next->pagedir, kpages[i], false);
+      next->kpage = kpages[i];
+      frame_append (frames[i]);
+    }
+  return true;
 }
 
-static bool
-suppl_pt_less (const struct hash_elem *e1, const struct hash_elem *e2,
-               void *aux UNUSED)
+/* Returns the slot of user virtual page UPAGE in PT, or NULL if
+   UPAGE is not a user address or its leaf does not exist.  If
+   CREATE is true, a missing leaf is added, and NULL means memory
+   is short. */
+static struct suppl_pte **
+suppl_pt_slot (struct suppl_pt *pt, void *upage, bool create)
 {
-  struct suppl_pte *pte1 = hash_entry (e1, struct suppl_pte, elem);
-  struct suppl_pte *pte2 = hash_entry (e2, struct suppl_pte, elem);
-  return pte1->upage < pte2->upage;
+  struct suppl_pt_leaf **leafp;
+
+  if (!is_user_vaddr (upage))
+    return NULL;
+  leafp = &pt->dir[pd_no (upage)];
+  if (*leafp == NULL)
+    {
+      if (!create)
+        return NULL;
+      *leafp = palloc_get_page (PAL_ZERO);
+      if (*leafp == NULL)
+        return NULL;
+    }
+  return &(*leafp)->ptes[pt_no (upage)];
 }
 
-/* Frees a supplemental page table entry.
-   This also removes the frame table entry if supplemental page
-   PT is given, but not frees allocated page. */ 
+/* Frees supplemental page table entry PTE.
+   This also removes it from supplemental page table PT if PT is
+   given, but not frees allocated page. */ 
 void
-suppl_pt_free_pte (struct hash_elem *e, void *pt)
+suppl_pt_free_pte (struct suppl_pte *pte, struct suppl_pt *pt)
 {
-  struct suppl_pte *pte = hash_entry (e, struct suppl_pte, elem);
-  if (pte->kpage != NULL)
-    frame_remove (pte->kpage);
-  else if (pte->type == PAGE_SWAP)
-    swap_remove (pte->swap_index);
+  frame_wait (pte);
+  if (pte->zero_mapped)
+    pagedir_clear_page (pte->pagedir, pte->upage);
+  if (pte->share != NULL)
+    {
+      frame_share_unmap (pte);
+      frame_share_put (pte->share);
+    }
+  else
+    {
+      if (pte->kpage != NULL)
+        frame_remove (pte->kpage);
+      if (pte->type == PAGE_SWAP && pte->swap_index != BITMAP_ERROR)
+        swap_remove (pte->swap_index);
+    }
   if (pt != NULL)
-    hash_delete (&((struct suppl_pt *) pt)->hash, &pte->elem);
-  free (pte);
+    *suppl_pt_slot (pt, pte->upage, false) = NULL;
+  pte_free (pte->pt, pte);
+}
+
+/* Takes an entry from the pool of PT, growing the pool by a page
+   if it is empty.  Returns NULL if memory is short. */
+static struct suppl_pte *
+pte_alloc (struct suppl_pt *pt)
+{
+  if (list_empty (&pt->pool_free) && !pool_grow (pt))
+    return NULL;
+  return list_entry (list_pop_front (&pt->pool_free), struct suppl_pte,
+                     share_elem);
+}
+
+/* Gives PTE back to the pool of PT. */
+static void
+pte_free (struct suppl_pt *pt, struct suppl_pte *pte)
+{
+  list_push_front (&pt->pool_free, &pte->share_elem);
+}
+
+/* Adds a page of entries to the pool of PT.  Returns true if
+   successful, false if memory is short. */
+static bool
+pool_grow (struct suppl_pt *pt)
+{
+  struct pte_chunk *chunk = palloc_get_page (0);
+  struct suppl_pte *ptes = (struct suppl_pte *) (chunk + 1);
+  size_t i;
+
+  if (chunk == NULL)
+    return false;
+  list_push_back (&pt->pool_pages, &chunk->elem);
+  for (i = 0; i < PTES_PER_CHUNK; i++)
+    list_push_back (&pt->pool_free, &ptes[i].share_elem);
+  return true;
 }
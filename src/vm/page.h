@@ -1,10 +1,16 @@
 #ifndef VM_PAGE_H
 #define VM_PAGE_H
 
-#include <hash.h>
+#include <list.h>
+#include <madvise.h>
+#include <stdint.h>
 #include "filesys/file.h"
+#include "threads/synch.h"
 #include "vm/swap.h"
 
+struct frame_share;
+struct suppl_pt_leaf;
+
 /* Page statuses. */
 enum page_type
   {
@@ -13,10 +19,32 @@ enum page_type
     PAGE_SWAP           /* Page content from the swap disk. */
   };
 
-/* Supplemental page table. */
+/* Supplemental page table.
+   A two-level table laid out like the page directory: DIR has a
+   leaf for each page table's worth of user pages that has
+   entries, and each leaf has an entry pointer for each page. */
 struct suppl_pt
   {
-    struct hash hash;   /* Hash table. */
+    struct suppl_pt_leaf **dir; /* Leaves by page directory index. */
+    struct lock lock;   /* Serializes faults and changes to the table
+                           by the threads of its process, and keeps
+                           the page merger off while held. */
+    size_t swap_hint;   /* Swap slot after the last one swapped out. */
+    void *swap_upage;   /* Page swapped in last, or NULL. */
+    size_t ws_cnt;      /* Frames in the working set, that is with a
+                           nonzero age.  Protected by the frame table
+                           lock. */
+    size_t rss_cnt;     /* Frames on the frame table holding private
+                           pages.  Protected by the frame table
+                           lock. */
+    int64_t run_tick;   /* Timer tick at which a thread of the process
+                           was last switched to or from.  Updated
+                           with interrupts off. */
+    int run_priority;   /* Priority of the thread last switched to. */
+    void *stack_bottom; /* Lowest page stack growth made, or NULL. */
+    size_t stack_ahead; /* Pages made below the next one it makes. */
+    struct list pool_pages; /* Pages holding the entry pool. */
+    struct list pool_free;  /* Free entries, by SHARE_ELEM. */
   };
 
 /* Supplemental page table entry. */
@@ -27,7 +55,16 @@ struct suppl_pte
     void *kpage;                    /* Kernel virtual page.
                                        NULL if not on the memory. */
     uint32_t *pagedir;              /* Page directory. */
+    struct suppl_pt *pt;            /* Owning supplemental page table. */
     bool dirty;                     /* Dirty bit. */
+    bool zero_mapped;               /* Mapped to the shared zero page? */
+    uint8_t advice;                 /* MADV_NORMAL, MADV_SEQUENTIAL, or
+                                       MADV_RANDOM. */
+    struct frame_share *share;      /* Shared page, or NULL.  For
+                                       PAGE_ZERO, a page copied on
+                                       write after fork. */
+    struct list_elem share_elem;    /* Element in SHARE's users, or
+                                       in PT's POOL_FREE when free. */
     union
       {
         struct                      /* Only for page type PAGE_FILE. */
@@ -41,23 +78,46 @@ struct suppl_pte
           };
         struct                      /* Only for page type PAGE_SWAP. */
           {
-            size_t swap_index;      /* Swap disk index. */
+            size_t swap_index;      /* Swap disk index.  While the
+                                       page is in memory, the slot
+                                       still holding its contents,
+                                       or BITMAP_ERROR. */
           };
       };
-
-    struct hash_elem elem;          /* Hash element. */
   };
 
+/* Most pages the stack of a process may grow to, or 0 to let it
+   grow down to STACK_LIMIT.  Controlled by kernel command-line
+   option "-stack=PAGES". */
+extern size_t suppl_pt_stack_pages;
+
+void suppl_pt_init (void);
 struct suppl_pt *suppl_pt_create (void);
 void suppl_pt_destroy (struct suppl_pt *);
+bool suppl_pt_lock (void);
+void suppl_pt_unlock (bool locked);
 
 bool suppl_pt_set_zero (void *upage);
+bool suppl_pt_grow_stack (void *upage);
 bool suppl_pt_set_file (void *upage, struct file *, off_t, uint32_t read_bytes,
                         uint32_t zero_bytes, bool writable, bool mmap);
+bool suppl_pt_set_shared (void *upage, struct frame_share *);
 bool suppl_pt_load_page (void *upage);
+bool suppl_pt_map_zero (void *upage);
+bool suppl_pt_copy_on_write (void *upage);
+bool suppl_pt_fork (struct suppl_pt *parent, struct file *exec_file);
+void suppl_pt_fault_around (void *upage);
+void suppl_pt_advise (void *addr, size_t size, enum madvise_advice);
+bool suppl_pt_pin (const void *uaddr, size_t size);
+bool suppl_pt_pin_write (const void *uaddr, size_t size);
+void suppl_pt_unpin (const void *uaddr, size_t size);
 struct suppl_pte *suppl_pt_get_page (void *upage);
+struct suppl_pte *suppl_pt_lookup (void *upage);
+struct suppl_pte *suppl_pt_next (struct suppl_pt *, void *start, void *end);
+bool suppl_pt_range_free (void *upage, size_t size);
 void suppl_pt_clear_page (void *upage);
-void suppl_pt_free_pte (struct hash_elem *e, void *pt);
+void suppl_pt_free_page (void *upage);
+void suppl_pt_free_pte (struct suppl_pte *, struct suppl_pt *);
 
 bool suppl_pt_update_dirty (struct suppl_pte *);
 
@@ -0,0 +1,174 @@
+#include "vm/shm.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Shared memory segments.
+
+   A segment is a named run of anonymous pages.  Each page is a
+   writable frame_share, so the processes mapping the segment map
+   the same frame while it is in memory, and it is swapped out
+   and back in like a copy-on-write page.  A segment lives while
+   some process has it mapped. */
+
+/* A shared memory segment. */
+struct shm_segment
+  {
+    char name[SHM_NAME_MAX + 1];    /* Name. */
+    size_t page_cnt;                /* Number of pages. */
+    struct frame_share **pages;     /* Its pages. */
+    int map_cnt;                    /* Mappings of it. */
+    struct list_elem elem;          /* Element in shm_list. */
+  };
+
+/* Segments, and the lock protecting the list and map counts. */
+static struct list shm_list;
+static struct lock shm_lock;
+
+static struct shm_segment *shm_create (const char *name, size_t page_cnt);
+static void shm_destroy (struct shm_segment *);
+
+/* Initializes the segment list. */
+void
+shm_init (void)
+{
+  list_init (&shm_list);
+  lock_init (&shm_lock);
+}
+
+/* Returns segment NAME, creating it with SIZE bytes if there is
+   none, and counts a mapping of it.  Returns NULL if an existing
+   segment is smaller than SIZE or memory is short. */
+struct shm_segment *
+shm_attach (const char *name, size_t size)
+{
+  struct shm_segment *seg = NULL;
+  struct list_elem *e;
+
+  ASSERT (strlen (name) <= SHM_NAME_MAX);
+
+  lock_acquire (&shm_lock);
+  for (e = list_begin (&shm_list); e != list_end (&shm_list);
+       e = list_next (e))
+    {
+      struct shm_segment *s = list_entry (e, struct shm_segment, elem);
+      if (!strcmp (s->name, name))
+        {
+          seg = s;
+          break;
+        }
+    }
+  if (seg == NULL)
+    {
+      seg = shm_create (name, DIV_ROUND_UP (size, PGSIZE));
+      if (seg != NULL)
+        list_push_back (&shm_list, &seg->elem);
+    }
+  else if (DIV_ROUND_UP (size, PGSIZE) > seg->page_cnt)
+    seg = NULL;
+  if (seg != NULL)
+    seg->map_cnt++;
+  lock_release (&shm_lock);
+
+  return seg;
+}
+
+/* Drops a mapping of SEG, freeing it after the last. */
+void
+shm_detach (struct shm_segment *seg)
+{
+  bool dead;
+
+  lock_acquire (&shm_lock);
+  ASSERT (seg->map_cnt > 0);
+  dead = --seg->map_cnt == 0;
+  if (dead)
+    list_remove (&seg->elem);
+  lock_release (&shm_lock);
+
+  if (dead)
+    shm_destroy (seg);
+}
+
+/* Maps the first SIZE bytes of SEG at page ADDR in the current
+   process.  The pages get frames as they are touched.  Returns
+   true if successful; on failure nothing stays mapped. */
+bool
+shm_map (struct shm_segment *seg, void *addr, size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  size_t i;
+
+  ASSERT (pg_ofs (addr) == 0);
+  ASSERT (page_cnt <= seg->page_cnt);
+
+  for (i = 0; i < page_cnt; i++)
+    if (!suppl_pt_set_shared ((uint8_t *) addr + i * PGSIZE,
+                              seg->pages[i]))
+      {
+        shm_unmap (addr, i * PGSIZE);
+        return false;
+      }
+  return true;
+}
+
+/* Unmaps the SIZE bytes of shared memory at page ADDR in the
+   current process. */
+void
+shm_unmap (void *addr, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < DIV_ROUND_UP (size, PGSIZE); i++)
+    suppl_pt_clear_page ((uint8_t *) addr + i * PGSIZE);
+}
+
+/* Returns a new segment NAME of PAGE_CNT pages with no mapping,
+   or NULL if memory is short. */
+static struct shm_segment *
+shm_create (const char *name, size_t page_cnt)
+{
+  struct shm_segment *seg = malloc (sizeof *seg);
+  size_t i;
+
+  if (seg == NULL)
+    return NULL;
+  seg->pages = calloc (page_cnt, sizeof *seg->pages);
+  if (seg->pages == NULL)
+    {
+      free (seg);
+      return NULL;
+    }
+  strlcpy (seg->name, name, sizeof seg->name);
+  seg->page_cnt = page_cnt;
+  seg->map_cnt = 0;
+  for (i = 0; i < page_cnt; i++)
+    {
+      seg->pages[i] = frame_share_create ();
+      if (seg->pages[i] == NULL)
+        {
+          shm_destroy (seg);
+          return NULL;
+        }
+    }
+  return seg;
+}
+
+/* Frees SEG and drops its references to its pages, which are
+   freed once no process maps them. */
+static void
+shm_destroy (struct shm_segment *seg)
+{
+  size_t i;
+
+  for (i = 0; i < seg->page_cnt && seg->pages[i] != NULL; i++)
+    frame_share_put (seg->pages[i]);
+  free (seg->pages);
+  free (seg);
+}
@@ -0,0 +1,18 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Longest shared memory segment name. */
+#define SHM_NAME_MAX 14
+
+struct shm_segment;
+
+void shm_init (void);
+struct shm_segment *shm_attach (const char *name, size_t size);
+void shm_detach (struct shm_segment *);
+bool shm_map (struct shm_segment *, void *addr, size_t size);
+void shm_unmap (void *addr, size_t size);
+
+#endif /* vm/shm.h */
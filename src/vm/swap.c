@@ -1,125 +1,531 @@
 #include <bitmap.h>
 #include <debug.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/disk.h"
+#include "filesys/volume.h"
+#include "threads/perf.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 
 #define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
 
+/* Swap slots given to a process at a time, so that the pages it
+   has swapped out lie near each other on the swap disk. */
+#define SWAP_CLUSTER 16
+
+/* Most swap disks. */
+#define SWAP_DISK_MAX 4
+
+/* Most slots used on one swap disk, 128 GB.  Their bitmap takes
+   4 MB; larger disks would need more than the kernel pool has. */
+#define SWAP_DISK_SLOTS_MAX ((size_t) 1 << 25)
+
+/* Swap disks, as a comma-separated list of "hdC:D" names, or
+   null for just hd1:1. */
+const char *swap_disk_names;
+
 /* Swap table lock. */
 static struct lock swap_table_lock;
 
-/* Swap disk. */
-static struct disk *swap_disk;
+/* A swap disk.  The slots of all the swap disks make up one
+   swap table, numbered one disk after another, so that slot IDX
+   is slot IDX - BASE of the disk whose slots start at BASE.
+   Slot indexes past the last disk's name compressed swap pool
+   entries. */
+struct swap_disk
+  {
+    struct disk *disk;          /* Disk. */
+    struct bitmap *slots;       /* Slots, true if free. */
+    size_t base;                /* Swap table index of first slot. */
+
+    /* Slot at which the search for the next free cluster starts.
+       The bitmap is searched a word at a time, and clusters are
+       taken in rotation from here, so the slots before the
+       cursor, which filled up first, are not rescanned on every
+       swap-out. */
+    size_t cursor;
+
+    /* Pages being transferred, protected by swap_table_lock. */
+    size_t busy;
+  };
+
+static struct swap_disk swap_disks[SWAP_DISK_MAX];
+static size_t swap_disk_cnt;
+
+/* Number of slots on all the swap disks. */
+static size_t swap_slot_cnt;
+
+/* Disk where the search for the least busy disk starts, so that
+   disks equally busy take turns.  Protected by
+   swap_table_lock. */
+static size_t swap_next_disk;
 
-/* Swap table. */
-static struct bitmap *swap_table;
+/* Statistics, protected by swap_table_lock.  Pages swapped in and
+   out count both the swap disks and the compressed pool; slots
+   count the swap disks only. */
+static long long swap_in_cnt;
+static long long swap_out_cnt;
+static size_t swap_slots_used;
+static size_t swap_slots_peak;
 
-/* Initializes the swap table. */
+static void swap_add_disk (int chan_no, int dev_no);
+static struct swap_disk *slot_disk (size_t idx);
+static bool slots_taken (size_t idx, size_t cnt);
+static void set_slots (size_t idx, size_t cnt, bool free);
+static size_t swap_alloc (size_t cnt, size_t *hint);
+static size_t disk_alloc (struct swap_disk *, size_t cnt);
+static void swap_transfer (void **kpages, size_t idx, size_t cnt,
+                           bool write);
+
+/* Initializes the swap table over the disks named by
+   swap_disk_names. */
 void
 swap_table_init (void)
 {
-  lock_init (&swap_table_lock);
+  const char *names = swap_disk_names != NULL ? swap_disk_names : "hd1:1";
+  const char *p;
 
-  /* Get swap disk. */
-  swap_disk = disk_get (1, 1);
-  if (swap_disk == NULL)
-    {
-      PANIC ("Cannot retrieve the swap disk");
-      NOT_REACHED ();
-    }
+  lock_init (&swap_table_lock);
+  lock_set_name (&swap_table_lock, "swap_table");
 
-  /* Create swap table. */
-  swap_table = bitmap_create (disk_size (swap_disk) / SECTORS_PER_PAGE);
-  if (swap_table == NULL)
+  for (p = names; ; p += 6)
     {
-      PANIC ("Cannot create the swap table");
-      NOT_REACHED ();
+      if (memcmp (p, "hd", 2)
+          || p[2] < '0' || p[2] > '1' || p[3] != ':'
+          || p[4] < '0' || p[4] > '1' || (p[5] != ',' && p[5] != '\0'))
+        PANIC ("bad swap disk list \"%s\"", names);
+      swap_add_disk (p[2] - '0', p[4] - '0');
+      if (p[5] == '\0')
+        break;
     }
+  swap_next_disk = 0;
 
-  /* Set all swap slots empty. */
-  bitmap_set_all (swap_table, true);
+  zswap_init ();
 }
 
-/* Swaps the page at IDX of the swap disk into KPAGE.
+/* Swaps the page in slot IDX into KPAGE.
    Returns true if successful, false otherwise. */
 bool
 swap_in (void *kpage, size_t idx)
 {
+  return swap_in_multiple (&kpage, idx, 1, false);
+}
+
+/* Swaps the CNT pages in the consecutive slots starting at IDX
+   into KPAGES.  Slots on the swap disk are read with the
+   transfers submitted together so that the disk reads them in
+   one go; slots in the compressed pool are decompressed, and
+   freed only once every page is in.  If KEEP is true, the slots on the swap disk stay taken,
+   so that a page that is not modified can be evicted again
+   without being written.
+   Returns true if successful, false otherwise. */
+bool
+swap_in_multiple (void **kpages, size_t idx, size_t cnt, bool keep)
+{
+  size_t disk_cnt = swap_slot_cnt;
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= SWAP_BATCH);
+
   lock_acquire (&swap_table_lock);
+  swap_in_cnt += cnt;
+  lock_release (&swap_table_lock);
+  perf_add (PERF_SWAP_IN, cnt);
 
-  /* False if index is larger than swap table size. */
-  if (idx >= bitmap_size (swap_table))
+  /* Slots on the disk come first. */
+  if (idx < disk_cnt)
+    disk_cnt = cnt < disk_cnt - idx ? cnt : disk_cnt - idx;
+  else
+    disk_cnt = 0;
+
+  /* False if any disk slot is empty. */
+  lock_acquire (&swap_table_lock);
+  if (disk_cnt > 0 && !slots_taken (idx, disk_cnt))
     {
       lock_release (&swap_table_lock);
       return false;
     }
+  lock_release (&swap_table_lock);
 
-  /* False if swap slot is empty. */
-  if (bitmap_test (swap_table, idx))
-    {
-      lock_release (&swap_table_lock);
+  /* Decompress pages from the pool, keeping their entries until
+     all of them are in, so that a failure loses none. */
+  for (i = disk_cnt; i < cnt; i++)
+    if (!zswap_load (idx + i - swap_slot_cnt, kpages[i]))
       return false;
-    }
+  for (i = disk_cnt; i < cnt; i++)
+    zswap_remove (idx + i - swap_slot_cnt);
+  if (disk_cnt == 0)
+    return true;
 
-  /* Copy contents from swap disk to frame. */
-  disk_sector_t sec_no = SECTORS_PER_PAGE * idx;
-  size_t i;
-  for (i = 0; i < SECTORS_PER_PAGE; i++)
+  /* Copy contents from swap disk to frames.  The slots stay
+     taken meanwhile, so nobody reuses them. */
+  swap_transfer (kpages, idx, disk_cnt, false);
+
+  /* Set swap slots empty. */
+  if (!keep)
     {
-      disk_read (swap_disk, sec_no, kpage);
-      sec_no++;
-      kpage += DISK_SECTOR_SIZE;
+      lock_acquire (&swap_table_lock);
+      set_slots (idx, disk_cnt, true);
+      lock_release (&swap_table_lock);
     }
 
-  /* Set swap slot empty. */
-  bitmap_set (swap_table, idx, true);
-
-  lock_release (&swap_table_lock);
-
   return true;
 }
 
+/* Returns true if IDX names a slot on a swap disk rather than
+   an entry of the compressed swap pool. */
+bool
+swap_on_disk (size_t idx)
+{
+  return idx < swap_slot_cnt;
+}
+
 /* Swaps KPAGE out to the swap disk.
    Returns the index of swap slot if successful, BITMAP_ERROR
-   if the swap table is full. */ 
+   if the swap table is full. */
 size_t
 swap_out (void *kpage)
 {
+  size_t idx;
+
+  return swap_out_multiple (&kpage, 1, NULL, &idx) ? idx : BITMAP_ERROR;
+}
+
+/* Swaps the CNT pages in KPAGES out and stores their slot
+   indexes in IDXS.  Pages that compress well are kept in the
+   compressed pool while it has room.  The others go to
+   contiguous slots of the swap disk, with the transfers
+   submitted together so that the disk writes them in one go.
+   If HINT is nonnull, it names the disk slot following the
+   owner's last swapped-out page, which is tried first, and is
+   updated.
+   Returns true if successful, false if the swap disk has no
+   room for the pages the pool does not take. */
+bool
+swap_out_multiple (void **kpages, size_t cnt, size_t *hint, size_t *idxs)
+{
+  void *disk_pages[SWAP_BATCH];
+  size_t which[SWAP_BATCH];
+  size_t disk_cnt = 0;
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= SWAP_BATCH);
+
   lock_acquire (&swap_table_lock);
+  swap_out_cnt += cnt;
+  lock_release (&swap_table_lock);
+  perf_add (PERF_SWAP_OUT, cnt);
+
+  /* Try the compressed pool first. */
+  for (i = 0; i < cnt; i++)
+    {
+      size_t z;
+      if (zswap_store (kpages[i], &z))
+        idxs[i] = swap_slot_cnt + z;
+      else
+        {
+          disk_pages[disk_cnt] = kpages[i];
+          which[disk_cnt++] = i;
+        }
+    }
+  if (disk_cnt == 0)
+    return true;
 
-  /* Get empty swap slot. */
-  size_t idx = bitmap_scan (swap_table, 0, 1, true);
+  /* Get empty swap slots. */
+  lock_acquire (&swap_table_lock);
+  size_t idx = swap_alloc (disk_cnt, hint);
+  lock_release (&swap_table_lock);
   if (idx == BITMAP_ERROR)
     {
-      lock_release (&swap_table_lock);
-      return BITMAP_ERROR;
+      /* Give back the pool entries taken. */
+      size_t j = 0;
+      for (i = 0; i < cnt; i++)
+        if (j < disk_cnt && which[j] == i)
+          j++;
+        else
+          swap_remove (idxs[i]);
+      return false;
     }
 
-  /* Copy contents from frame to swap disk. */
-  disk_sector_t sec_no = SECTORS_PER_PAGE * idx;
+  /* Copy contents from frames to swap disk. */
+  swap_transfer (disk_pages, idx, disk_cnt, true);
+  for (i = 0; i < disk_cnt; i++)
+    idxs[which[i]] = idx + i;
+
+  return true;
+}
+
+/* Marks slot IDX empty. */
+void
+swap_remove (size_t idx)
+{
+  struct swap_disk *sd;
+
+  if (idx >= swap_slot_cnt)
+    {
+      zswap_remove (idx - swap_slot_cnt);
+      return;
+    }
+  sd = slot_disk (idx);
+  lock_acquire (&swap_table_lock);
+  if (!bitmap_test (sd->slots, idx - sd->base))
+    set_slots (idx, 1, true);
+  lock_release (&swap_table_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  if (swap_disk_cnt == 0)
+    return;
+  lock_acquire (&swap_table_lock);
+  printf ("Swap: %lld pages in, %lld pages out, "
+          "%zu of %zu slots in use, %zu at most, on %zu disk%s\n",
+          swap_in_cnt, swap_out_cnt, swap_slots_used,
+          swap_slot_cnt, swap_slots_peak,
+          swap_disk_cnt, swap_disk_cnt != 1 ? "s" : "");
+  lock_release (&swap_table_lock);
+}
+
+/* Adds disk DEV_NO of channel CHAN_NO to the swap disks, with
+   all of its slots empty.  Panics if the disk holds a mounted
+   file system, or the second half of a striped root file
+   system, which swap would overwrite. */
+static void
+swap_add_disk (int chan_no, int dev_no)
+{
+  struct swap_disk *sd;
+  struct disk *d = disk_get (chan_no, dev_no);
+  int volume = volume_for_disk (chan_no, dev_no);
+  size_t slot_cnt;
+  size_t i;
+
+  if (swap_disk_cnt >= SWAP_DISK_MAX)
+    PANIC ("too many swap disks");
+  if (chan_no == 0)
+    PANIC ("hd0:%d holds the kernel or file system, not swap", dev_no);
+  if (volume_present (volume)
+      || (volume == 1 && volume_present (0) && volume_chunk_sectors != 0))
+    PANIC ("hd%d:%d holds a file system, not swap", chan_no, dev_no);
+  if (d == NULL)
+    PANIC ("Cannot retrieve swap disk hd%d:%d", chan_no, dev_no);
+  for (i = 0; i < swap_disk_cnt; i++)
+    if (swap_disks[i].disk == d)
+      PANIC ("hd%d:%d named twice as swap disk", chan_no, dev_no);
+
+  /* Use as much of the disk as a swap table fits in memory for,
+     up to SWAP_DISK_SLOTS_MAX slots. */
+  sd = &swap_disks[swap_disk_cnt];
+  sd->disk = d;
+  slot_cnt = disk_size (d) / SECTORS_PER_PAGE;
+  if (slot_cnt > SWAP_DISK_SLOTS_MAX)
+    slot_cnt = SWAP_DISK_SLOTS_MAX;
+  while ((sd->slots = bitmap_create (slot_cnt)) == NULL)
+    {
+      if (slot_cnt <= SWAP_CLUSTER)
+        PANIC ("Cannot create the swap table");
+      slot_cnt /= 2;
+    }
+  if (slot_cnt < disk_size (d) / SECTORS_PER_PAGE)
+    printf ("hd%d:%d: swapping to its first %zu MB only\n",
+            chan_no, dev_no, slot_cnt / (1024 * 1024 / PGSIZE));
+  bitmap_set_all (sd->slots, true);
+  sd->base = swap_slot_cnt;
+  sd->cursor = 0;
+  sd->busy = 0;
+  swap_slot_cnt += bitmap_size (sd->slots);
+  swap_disk_cnt++;
+}
+
+/* Returns the swap disk holding slot IDX. */
+static struct swap_disk *
+slot_disk (size_t idx)
+{
   size_t i;
-  for (i = 0; i < SECTORS_PER_PAGE; i++)
+
+  ASSERT (idx < swap_slot_cnt);
+
+  for (i = 0; idx - swap_disks[i].base >= bitmap_size (swap_disks[i].slots);
+       i++)
+    continue;
+  return &swap_disks[i];
+}
+
+/* Returns true if the CNT slots starting at IDX, which may span
+   swap disks, are all taken. */
+static bool
+slots_taken (size_t idx, size_t cnt)
+{
+  ASSERT (lock_held_by_current_thread (&swap_table_lock));
+
+  while (cnt > 0)
     {
-      disk_write (swap_disk, sec_no, kpage);
-      sec_no++;
-      kpage += DISK_SECTOR_SIZE;
+      struct swap_disk *sd = slot_disk (idx);
+      size_t ofs = idx - sd->base;
+      size_t n = bitmap_size (sd->slots) - ofs;
+
+      if (n > cnt)
+        n = cnt;
+      if (!bitmap_none (sd->slots, ofs, n))
+        return false;
+      idx += n;
+      cnt -= n;
     }
+  return true;
+}
 
-  /* Set swap slot not empty. */
-  bitmap_set (swap_table, idx, false);
+/* Marks the CNT slots starting at IDX, which may span swap
+   disks, empty if FREE is true, or taken otherwise.  Each must
+   be marked the other way beforehand. */
+static void
+set_slots (size_t idx, size_t cnt, bool free)
+{
+  ASSERT (lock_held_by_current_thread (&swap_table_lock));
 
-  lock_release (&swap_table_lock);
+  if (free)
+    swap_slots_used -= cnt;
+  else
+    {
+      swap_slots_used += cnt;
+      if (swap_slots_used > swap_slots_peak)
+        swap_slots_peak = swap_slots_used;
+    }
+  while (cnt > 0)
+    {
+      struct swap_disk *sd = slot_disk (idx);
+      size_t ofs = idx - sd->base;
+      size_t n = bitmap_size (sd->slots) - ofs;
+
+      if (n > cnt)
+        n = cnt;
+      bitmap_set_multiple (sd->slots, ofs, n, free);
+      idx += n;
+      cnt -= n;
+    }
+}
+
+/* Takes CNT contiguous free slots on one swap disk and returns
+   the first, or BITMAP_ERROR if there are none.  The slots at
+   *HINT are used if free, unless *HINT starts a new stripe of
+   SWAP_CLUSTER slots and there are other disks.  Otherwise, the
+   slots come from the disk with the fewest pages in transfer,
+   with disks equally busy taking turns, or from any disk with
+   room.  So a process's pages stay together a stripe at a time,
+   to be swapped back in together, while the stripes are spread
+   over the disks, which transfer them at the same time. */
+static size_t
+swap_alloc (size_t cnt, size_t *hint)
+{
+  size_t idx = BITMAP_ERROR;
+  size_t best, i;
+
+  ASSERT (lock_held_by_current_thread (&swap_table_lock));
+
+  if (hint != NULL && *hint < swap_slot_cnt)
+    {
+      struct swap_disk *sd = slot_disk (*hint);
+      size_t ofs = *hint - sd->base;
+
+      if ((swap_disk_cnt == 1 || ofs % SWAP_CLUSTER != 0)
+          && cnt <= bitmap_size (sd->slots) - ofs
+          && bitmap_all (sd->slots, ofs, cnt))
+        idx = *hint;
+    }
+
+  if (idx == BITMAP_ERROR)
+    {
+      best = swap_next_disk;
+      for (i = 1; i < swap_disk_cnt; i++)
+        {
+          size_t d = (swap_next_disk + i) % swap_disk_cnt;
+          if (swap_disks[d].busy < swap_disks[best].busy)
+            best = d;
+        }
+      swap_next_disk = (best + 1) % swap_disk_cnt;
+
+      for (i = 0; i < swap_disk_cnt && idx == BITMAP_ERROR; i++)
+        {
+          struct swap_disk *sd = &swap_disks[(best + i) % swap_disk_cnt];
+          size_t ofs = disk_alloc (sd, cnt);
+          if (ofs != BITMAP_ERROR)
+            idx = sd->base + ofs;
+        }
+      if (idx == BITMAP_ERROR)
+        return BITMAP_ERROR;
+    }
 
+  set_slots (idx, cnt, false);
+  if (hint != NULL)
+    *hint = idx + cnt;
   return idx;
 }
 
-/* Marks IDX at the swap disk empty. */
-void
-swap_remove (size_t idx)
+/* Finds CNT contiguous free slots on SD and returns the first,
+   relative to SD, or BITMAP_ERROR if there are none.  A free
+   cluster is searched for, after the last one handed out, so
+   that each process's pages get a neighbourhood of their own;
+   failing that, any CNT free slots do.  The slots are not
+   marked taken. */
+static size_t
+disk_alloc (struct swap_disk *sd, size_t cnt)
+{
+  size_t size = bitmap_size (sd->slots);
+  size_t run = cnt > SWAP_CLUSTER ? cnt : SWAP_CLUSTER;
+  size_t ofs;
+
+  ofs = bitmap_scan (sd->slots, sd->cursor, run, true);
+  if (ofs == BITMAP_ERROR)
+    ofs = bitmap_scan (sd->slots, 0, run, true);
+  if (ofs != BITMAP_ERROR)
+    sd->cursor = ofs + run < size ? ofs + run : 0;
+  else
+    ofs = bitmap_scan (sd->slots, 0, cnt, true);
+  return ofs;
+}
+
+/* Transfers the CNT pages in KPAGES to or from the contiguous
+   slots starting at IDX, writing to the disks if WRITE is true.
+   The pages after the first are queued ahead of it, so the disk
+   driver merges those on the first's disk into the transfer of
+   the first, which is made as a synchronous request, while any
+   other disk transfers the rest at the same time. */
+static void
+swap_transfer (void **kpages, size_t idx, size_t cnt, bool write)
 {
+  struct disk_request reqs[SWAP_BATCH];
+  struct swap_disk *sds[SWAP_BATCH];
+  disk_sector_t sector;
+  size_t i;
+
+  lock_acquire (&swap_table_lock);
+  for (i = 0; i < cnt; i++)
+    {
+      sds[i] = slot_disk (idx + i);
+      sds[i]->busy++;
+    }
+  lock_release (&swap_table_lock);
+
+  for (i = 1; i < cnt; i++)
+    {
+      sector = (idx + i - sds[i]->base) * SECTORS_PER_PAGE;
+      disk_request_init (reqs + i, sds[i]->disk, sector,
+                         kpages[i], SECTORS_PER_PAGE, write, NULL, NULL);
+      disk_submit (reqs + i);
+    }
+  sector = (idx - sds[0]->base) * SECTORS_PER_PAGE;
+  if (write)
+    disk_write_multiple (sds[0]->disk, sector, kpages[0], SECTORS_PER_PAGE);
+  else
+    disk_read_multiple (sds[0]->disk, sector, kpages[0], SECTORS_PER_PAGE);
+  for (i = 1; i < cnt; i++)
+    disk_wait (reqs + i);
+
   lock_acquire (&swap_table_lock);
-  bitmap_set (swap_table, idx, true);
+  for (i = 0; i < cnt; i++)
+    sds[i]->busy--;
   lock_release (&swap_table_lock);
 }
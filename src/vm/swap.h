@@ -2,10 +2,24 @@
 #define VM_SWAP_H
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Maximum number of pages swapped in or out together. */
+#define SWAP_BATCH 8
+
+/* Swap disks, as a comma-separated list of "hdC:D" names.
+   Controlled by kernel command-line option "-swap=DISKS". */
+extern const char *swap_disk_names;
 
 void swap_table_init (void);
 bool swap_in (void *kpage, size_t idx);
+bool swap_in_multiple (void **kpages, size_t idx, size_t cnt, bool keep);
+bool swap_on_disk (size_t idx);
 size_t swap_out (void *kpage);
+bool swap_out_multiple (void **kpages, size_t cnt, size_t *hint,
+                        size_t *idxs);
 void swap_remove (size_t idx);
+void swap_print_stats (void);
 
 #endif /* vm/swap.h */
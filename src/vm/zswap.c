@@ -0,0 +1,345 @@
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Compressed swap pool.
+
+   Swapped-out pages are compressed with a byte-oriented LZ77
+   scheme in the style of LZ4 and kept in kernel memory, as long
+   as the pool has room.  All-zero pages take no memory at all.
+   A page that does not compress to ZSWAP_SIZE_MAX bytes goes to
+   the swap disk instead. */
+
+/* Largest block kept, so that blocks come from malloc()'s
+   arenas rather than taking whole pages. */
+#define ZSWAP_SIZE_MAX (PGSIZE / 4)
+
+/* Entries per pool page.  Caps the entry table when many pages
+   compress to almost nothing. */
+#define ZSWAP_ENTRIES_PER_PAGE 32
+
+/* Compression hash table size, as a power of 2. */
+#define HASH_BITS 10
+
+/* Shortest match worth encoding, and the number of bytes at the
+   end of a page that are always literals. */
+#define MATCH_MIN 4
+#define LAST_LITERALS 5
+
+/* A compressed page. */
+struct zswap_entry
+  {
+    uint8_t *data;              /* Compressed data, or NULL if zero. */
+    size_t size;                /* Bytes in DATA. */
+  };
+
+/* Compressed swap pool size in pages. */
+size_t zswap_pages = 0;
+
+/* Pool lock. */
+static struct lock zswap_lock;
+
+/* Entries, and the bitmap of free ones. */
+static struct zswap_entry *zswap_entries;
+static struct bitmap *zswap_free_map;
+
+/* Bytes of compressed data held, at most ZSWAP_PAGES pages. */
+static size_t zswap_bytes;
+
+/* Compression state, protected by zswap_lock. */
+static uint16_t zswap_hash[1 << HASH_BITS];
+static uint8_t zswap_buf[ZSWAP_SIZE_MAX];
+
+static size_t zswap_compress (const uint8_t *src, uint8_t *dst,
+                              size_t dst_max);
+static bool zswap_decompress (const uint8_t *src, size_t size,
+                              uint8_t *dst);
+
+/* Initializes the compressed swap pool if it is enabled. */
+void
+zswap_init (void)
+{
+  size_t cnt = zswap_pages * ZSWAP_ENTRIES_PER_PAGE;
+
+  lock_init (&zswap_lock);
+  lock_set_name (&zswap_lock, "zswap");
+  zswap_bytes = 0;
+  if (cnt == 0)
+    return;
+  zswap_entries = calloc (cnt, sizeof *zswap_entries);
+  zswap_free_map = bitmap_create (cnt);
+  if (zswap_entries == NULL || zswap_free_map == NULL)
+    PANIC ("cannot create the compressed swap pool");
+  bitmap_set_all (zswap_free_map, true);
+}
+
+/* Returns the number of entries in the pool. */
+size_t
+zswap_entry_cnt (void)
+{
+  return zswap_free_map != NULL ? bitmap_size (zswap_free_map) : 0;
+}
+
+/* Compresses KPAGE into the pool and stores its entry index in
+   *IDX.  Returns true if successful, false if the page is not
+   compressible enough or the pool is full. */
+bool
+zswap_store (const void *kpage, size_t *idx)
+{
+  const uint32_t *words = kpage;
+  uint8_t *data = NULL;
+  size_t size = 0;
+  size_t i;
+
+  if (zswap_free_map == NULL)
+    return false;
+
+  /* All-zero pages need no data. */
+  for (i = 0; i < PGSIZE / sizeof *words; i++)
+    if (words[i] != 0)
+      break;
+
+  lock_acquire (&zswap_lock);
+  if (i < PGSIZE / sizeof *words)
+    {
+      size = zswap_compress (kpage, zswap_buf, sizeof zswap_buf);
+      if (size == 0 || zswap_bytes + size > zswap_pages * PGSIZE)
+        goto fail;
+      data = malloc (size);
+      if (data == NULL)
+        goto fail;
+      memcpy (data, zswap_buf, size);
+    }
+  *idx = bitmap_scan_and_flip (zswap_free_map, 0, 1, true);
+  if (*idx == BITMAP_ERROR)
+    goto fail;
+  zswap_entries[*idx].data = data;
+  zswap_entries[*idx].size = size;
+  zswap_bytes += size;
+  lock_release (&zswap_lock);
+  return true;
+
+ fail:
+  lock_release (&zswap_lock);
+  free (data);
+  return false;
+}
+
+/* Decompresses entry IDX into KPAGE.  The entry stays in use
+   until zswap_remove() frees it.
+   Returns true if successful, false if IDX is not in use. */
+bool
+zswap_load (size_t idx, void *kpage)
+{
+  struct zswap_entry *e;
+
+  lock_acquire (&zswap_lock);
+  if (idx >= zswap_entry_cnt () || bitmap_test (zswap_free_map, idx))
+    {
+      lock_release (&zswap_lock);
+      return false;
+    }
+  e = zswap_entries + idx;
+  if (e->data == NULL)
+    memset (kpage, 0, PGSIZE);
+  else if (!zswap_decompress (e->data, e->size, kpage))
+    PANIC ("corrupt compressed swap entry %zu", idx);
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* Frees entry IDX. */
+void
+zswap_remove (size_t idx)
+{
+  struct zswap_entry *e;
+  uint8_t *data;
+
+  lock_acquire (&zswap_lock);
+  ASSERT (idx < zswap_entry_cnt ());
+  ASSERT (!bitmap_test (zswap_free_map, idx));
+  e = zswap_entries + idx;
+  data = e->data;
+  zswap_bytes -= e->size;
+  e->data = NULL;
+  e->size = 0;
+  bitmap_mark (zswap_free_map, idx);
+  lock_release (&zswap_lock);
+
+  free (data);
+}
+
+/* Returns the 4 bytes at P. */
+static inline uint32_t
+load32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+/* Appends length LEN, beyond what its token holds, to *OP as a
+   run of 255s and a final byte.  Returns false if that would
+   pass END. */
+static bool
+put_length (uint8_t **op, uint8_t *end, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    {
+      if (*op >= end)
+        return false;
+      *(*op)++ = 255;
+    }
+  if (*op >= end)
+    return false;
+  *(*op)++ = len;
+  return true;
+}
+
+/* Compresses the page at SRC into at most DST_MAX bytes at DST.
+
+   The output is a series of sequences, each a token byte
+   holding a literal count and a match length in its high and
+   low nibbles, the literal count's extension bytes if the
+   nibble is 15, the literals, a 2-byte match offset, and the
+   match length's extension bytes.  The last sequence has only
+   literals.  Returns the compressed size, or 0 if it would
+   exceed DST_MAX. */
+static size_t
+zswap_compress (const uint8_t *src, uint8_t *dst, size_t dst_max)
+{
+  const uint8_t *end = src + PGSIZE;
+  const uint8_t *match_limit = end - LAST_LITERALS;
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + dst_max;
+
+  ASSERT (lock_held_by_current_thread (&zswap_lock));
+
+  memset (zswap_hash, 0, sizeof zswap_hash);
+  while (ip + MATCH_MIN <= match_limit)
+    {
+      uint32_t seq = load32 (ip);
+      size_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+      const uint8_t *ref = src + zswap_hash[h] - 1;
+
+      /* Positions are stored plus one, so zero means none. */
+      bool found = zswap_hash[h] != 0 && load32 (ref) == seq;
+      zswap_hash[h] = ip - src + 1;
+      if (!found)
+        {
+          ip++;
+          continue;
+        }
+
+      /* Extend the match. */
+      size_t len = MATCH_MIN;
+      while (ip + len < match_limit && ip[len] == ref[len])
+        len++;
+
+      /* Emit literals, then the match. */
+      size_t lit = ip - anchor;
+      uint8_t *token = op++;
+      if (token >= op_end)
+        return 0;
+      *token = ((lit < 15 ? lit : 15) << 4)
+               | (len - MATCH_MIN < 15 ? len - MATCH_MIN : 15);
+      if (lit >= 15 && !put_length (&op, op_end, lit - 15))
+        return 0;
+      if ((size_t) (op_end - op) < lit + 2)
+        return 0;
+      memcpy (op, anchor, lit);
+      op += lit;
+      *op++ = (ip - ref) & 0xff;
+      *op++ = (ip - ref) >> 8;
+      if (len - MATCH_MIN >= 15
+          && !put_length (&op, op_end, len - MATCH_MIN - 15))
+        return 0;
+
+      ip += len;
+      anchor = ip;
+    }
+
+  /* Last literals. */
+  size_t lit = end - anchor;
+  if (op >= op_end)
+    return 0;
+  *op++ = (lit < 15 ? lit : 15) << 4;
+  if (lit >= 15 && !put_length (&op, op_end, lit - 15))
+    return 0;
+  if ((size_t) (op_end - op) < lit)
+    return 0;
+  memcpy (op, anchor, lit);
+  op += lit;
+
+  return op - dst;
+}
+
+/* Reads a length extension from *IP, which may not pass END,
+   adding it to *LEN.  Returns false on malformed input. */
+static bool
+get_length (const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+  uint8_t b;
+
+  do
+    {
+      if (*ip >= end)
+        return false;
+      b = *(*ip)++;
+      *len += b;
+    }
+  while (b == 255);
+  return true;
+}
+
+/* Decompresses SIZE bytes at SRC, produced by zswap_compress(),
+   into the page at DST.  Returns true if successful, false if
+   the input is malformed. */
+static bool
+zswap_decompress (const uint8_t *src, size_t size, uint8_t *dst)
+{
+  const uint8_t *ip = src;
+  const uint8_t *end = src + size;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + PGSIZE;
+
+  while (ip < end)
+    {
+      uint8_t token = *ip++;
+      size_t lit = token >> 4;
+      if (lit == 15 && !get_length (&ip, end, &lit))
+        return false;
+      if ((size_t) (end - ip) < lit || (size_t) (op_end - op) < lit)
+        return false;
+      memcpy (op, ip, lit);
+      op += lit;
+      ip += lit;
+      if (ip == end)
+        break;
+
+      /* Match. */
+      if (end - ip < 2)
+        return false;
+      size_t ofs = ip[0] | (ip[1] << 8);
+      ip += 2;
+      size_t len = (token & 15) + MATCH_MIN;
+      if ((token & 15) == 15 && !get_length (&ip, end, &len))
+        return false;
+      if (ofs == 0 || ofs > (size_t) (op - dst)
+          || (size_t) (op_end - op) < len)
+        return false;
+
+      /* Byte by byte, since the match may overlap its output. */
+      const uint8_t *m = op - ofs;
+      while (len-- > 0)
+        *op++ = *m++;
+    }
+  return op == op_end;
+}
@@ -0,0 +1,17 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Compressed swap pool size in pages.  Zero disables the pool.
+   Controlled by kernel command-line option "-zswap=PAGES". */
+extern size_t zswap_pages;
+
+void zswap_init (void);
+size_t zswap_entry_cnt (void);
+bool zswap_store (const void *kpage, size_t *idx);
+bool zswap_load (size_t idx, void *kpage);
+void zswap_remove (size_t idx);
+
+#endif /* vm/zswap.h */